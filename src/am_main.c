@@ -1,5 +1,6 @@
 /* am_main.c -- automap */
 
+#include "gl/gl_automap.h"
 #include "gl/gl_render.h"
 #include "rb/rb_common.h"
 #include "jagcry.h"
@@ -48,7 +49,20 @@ char currentcheat[11] = "0000000000";
 int  showAllThings; // CHEAT VARS
 int  showAllLines;
 
-static uint32_t *framebuffer; // CALICO: framebuffer pointer
+static uint32_t *framebuffer;    // CALICO: framebuffer pointer
+static uint16_t *framebuffercry; // CALICO: set instead when the playfield is CRY
+
+// CALICO: lines handed over to the GL, which are handed over again only when
+// one is newly mapped or the computer map comes or goes
+int             mappedlines;
+static int     *glline;      // each line's number in the GL's list, or -1
+static int      glmapped;    // mappedlines when the list was made
+static boolean  glallmap;    // whether it was made with the whole map shown
+static boolean  gldrawing;   // this frame is drawn by the GL
+
+// CALICO: this frame's position and scale
+static fixed_t  amx, amy;
+static int      xshift, yshift;
 
 //=================================================================
 //
@@ -59,10 +73,15 @@ void AM_Start(void)
 {
    scale = 3;
    showAllThings = showAllLines = 0;
+   glline = NULL; // CALICO: a new level's lines
+
    players[consoleplayer].automapflags &= ~AF_ACTIVE;
    
    // CALICO: get framebuffer pointer
-   framebuffer = GL_GetFramebuffer(FB_160);
+   if(GL_FramebufferIsCRY())
+      framebuffercry = GL_GetFramebuffer(FB_160);
+   else
+      framebuffer = GL_GetFramebuffer(FB_160);
 }
 
 //=================================================================
@@ -171,8 +190,28 @@ void DrawLine(pixel_t color, int x1, int y1, int x2, int y2)
       y = fy / FRACUNIT;
       if(x >= 0 && x < SCREENWIDTH && y >= 0 && y < SCREENHEIGHT)
       {
-         a1ptr = framebuffer + y * SCREENWIDTH + x;
-         *a1ptr = quadcolor;
+         // CALICO: each map pixel covers a block of the scaled playfield
+         int bx, by, size = 1 << rendershift;
+         int offset = ((y * renderwidth + x) << rendershift) + renderxoffset;
+
+         if(framebuffercry)
+         {
+            uint16_t *c1ptr = framebuffercry + offset;
+            for(by = 0; by < size; by++, c1ptr += renderwidth)
+            {
+               for(bx = 0; bx < size; bx++)
+                  c1ptr[bx] = color;
+            }
+         }
+         else
+         {
+            a1ptr = framebuffer + offset;
+            for(by = 0; by < size; by++, a1ptr += renderwidth)
+            {
+               for(bx = 0; bx < size; bx++)
+                  a1ptr[bx] = quadcolor;
+            }
+         }
       }
       fx += xstep;
       fy += ystep;
@@ -307,6 +346,160 @@ void AM_Control(player_t *player)
    ticbuttons[playernum] &= ~(BT_B|BT_LEFT|BT_RIGHT|BT_UP|BT_DOWN);
 }
 
+//
+// CALICO: check if a line is to be shown
+//
+static boolean AM_LineShown(player_t *p, line_t *line)
+{
+   return (p->powers[pw_allmap] + showAllLines) ||
+          ((line->flags & ML_MAPPED) && !(line->flags & ML_DONTDRAW));
+}
+
+//
+// CALICO: Figure out a line's color
+//
+static int AM_LineColor(player_t *p, line_t *line)
+{
+   int color = CRY_BROWN;
+
+   if((p->powers[pw_allmap] +
+      showAllLines) && // IF COMPMAP && !MAPPED YET
+      !(line->flags & ML_MAPPED))
+      color = CRY_GREY;
+   else if (!(line->flags & ML_TWOSIDED)) // ONE-SIDED LINE
+      color = CRY_RED;
+   else if (line->special == 97 || // TELEPORT LINE
+      line->special == 39)
+      color = CRY_GREEN;
+   else if (line->flags & ML_SECRET)
+      color = CRY_RED;
+   else if (line->special)
+      color = CRY_BLUE; // SPECIAL LINE
+   else if (line->frontsector->floorheight != line->backsector->floorheight)
+      color = CRY_YELLOW;
+   else if (line->frontsector->ceilingheight != line->backsector->ceilingheight)
+      color = CRY_BROWN;
+
+   return color;
+}
+
+//
+// CALICO: hand the GL every line to be shown, if they have changed since
+// they were last handed over
+//
+static void AM_UpdateGLLines(player_t *p)
+{
+   boolean allmap = (p->powers[pw_allmap] + showAllLines) != 0;
+   line_t *line;
+   int     i;
+
+   if(glline && glmapped == mappedlines && glallmap == allmap)
+      return;
+
+   if(!glline)
+      glline = Z_Malloc(numlines * sizeof(*glline), PU_LEVEL, &glline);
+   glmapped = mappedlines;
+   glallmap = allmap;
+
+   GL_ClearAutomapLines();
+   for(i = 0, line = lines; i < numlines; i++, line++)
+   {
+      if(AM_LineShown(p, line))
+      {
+         glline[i] = GL_AddAutomapLine(line->v1->x, line->v1->y, line->v2->x, line->v2->y,
+                                       CRYToRGB[AM_LineColor(p, line)]);
+      }
+      else
+         glline[i] = -1;
+   }
+}
+
+//
+// CALICO: draw a line given relative to the center of the map in map units
+//
+static void AM_DrawMark(int color, fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2)
+{
+   if(gldrawing)
+      GL_AddAutomapMark(amx + x1, amy + y1, amx + x2, amy + y2, CRYToRGB[color]);
+   else
+   {
+      x1 >>= xshift;
+      y1 >>= yshift;
+      x2 >>= xshift;
+      y2 >>= yshift;
+      DrawLine(color, 80 + x1, 90 - y1, 80 + x2, 90 - y2);
+   }
+}
+
+//
+// Draw a map line if it is on screen, and return true if it was
+//
+static boolean AM_DrawMapLine(player_t *p, line_t *line)
+{
+   int x1,y1;
+   int x2,y2;
+   int outcode;
+   int outcode2;
+
+   if(!AM_LineShown(p, line))
+      return false;
+
+   x1 = line->v1->x;
+   y1 = line->v1->y;
+   x2 = line->v2->x;
+   y2 = line->v2->y;
+
+   x1 -= amx;
+   x2 -= amx;
+   y1 -= amy;
+   y2 -= amy;
+   x1 >>= xshift;
+   x2 >>= xshift;
+   y1 >>= yshift;
+   y2 >>= yshift;
+
+   outcode = (y1 > 90) << 1;
+   outcode |= (y1 < -90);
+   outcode2 = (y2 > 90) << 1;
+   outcode2 |= (y2 < -90);
+   if(outcode & outcode2) 
+      return false;
+
+   outcode = (x1 > 80) << 1;
+   outcode |= (x1 < -80);
+   outcode2 = (x2 > 80) << 1;
+   outcode2 |= (x2 < -80);
+   if(outcode & outcode2)
+      return false;
+
+   // CALICO: the GL has it already, with its color
+   if(gldrawing)
+   {
+      int num = glline[line - lines];
+      if(num >= 0)
+         GL_ShowAutomapLine(num);
+   }
+   else
+      DrawLine(AM_LineColor(p, line), 80 + x1, 90 - y1, 80 + x2, 90 - y2);
+
+   return true;
+}
+
+//
+// CALICO: get the range of blockmap cells covering a span of map units
+//
+static void AM_BlockRange(fixed_t center, int halfsize, int shift, fixed_t org, int size, int *lo, int *hi)
+{
+   int64_t half = (int64_t)(halfsize + 1) << shift;
+
+   *lo = (int)(((int64_t)center - half - org) >> MAPBLOCKSHIFT);
+   *hi = (int)(((int64_t)center + half - org) >> MAPBLOCKSHIFT);
+   if(*lo < 0)
+      *lo = 0;
+   if(*hi > size - 1)
+      *hi = size - 1;
+}
+
 /*
 ==================
 =
@@ -321,87 +514,51 @@ void AM_Drawer(void)
    int       i;
    player_t *p;
    line_t   *line;
-   int       x1,y1;
-   int       x2,y2;
-   int       ox,oy;
-   int       outcode;
-   int       outcode2;
    int       color;
-   int       xshift;
-   int       yshift;
+   int       bx, by, left, right, bottom, top;
    int       drawn; // HOW MANY LINES DRAWN?
 
-   // CALICO: Clear playfield framebuffer
-   GL_ClearFramebuffer(FB_160, RB_COLOR_BLACK);
-
    p = &players[consoleplayer];
-   ox = p->automapx;
-   oy = p->automapy;
+   amx = p->automapx;
+   amy = p->automapy;
 
    xshift = scalex[scale];
    yshift = scaley[scale];
 
-   line = lines;
+   // CALICO: the GL draws the lines at the window's resolution when it can
+   gldrawing = GL_AutomapAvailable();
+   if(gldrawing)
+   {
+      AM_UpdateGLLines(p);
+      GL_BeginAutomap(amx, amy, xshift, yshift);
+   }
+   else
+      GL_ClearFramebuffer(FB_160, RB_COLOR_BLACK); // CALICO: Clear playfield framebuffer
+   GL_SetFramebufferShade(FB_160, 0);
+
+   // CALICO: only the lines in the blockmap cells on screen are looked at
+   AM_BlockRange(amx, 80, xshift, bmaporgx, bmapwidth,  &left,   &right);
+   AM_BlockRange(amy, 90, yshift, bmaporgy, bmapheight, &bottom, &top);
+
    drawn = 0;
-   for(i = 0; i < numlines; i++, line++)
+   validcount++;
+   for(by = bottom; by <= top; by++)
    {
-      if((!(line->flags & ML_MAPPED) || // IF NOT MAPPED OR DON'T DRAW
-         line->flags & ML_DONTDRAW) &&
-         (!(p->powers[pw_allmap] + showAllLines)))
-         continue;
-
-      x1 = line->v1->x;
-      y1 = line->v1->y;
-      x2 = line->v2->x;
-      y2 = line->v2->y;
-
-      x1 -= ox;
-      x2 -= ox;
-      y1 -= oy;
-      y2 -= oy;
-      x1 >>= xshift;
-      x2 >>= xshift;
-      y1 >>= yshift;
-      y2 >>= yshift;
+      for(bx = left; bx <= right; bx++)
+      {
+         int b = by * bmapwidth + bx;
 
-      outcode = (y1 > 90) << 1;
-      outcode |= (y1 < -90);
-      outcode2 = (y2 > 90) << 1;
-      outcode2 |= (y2 < -90);
-      if(outcode & outcode2) 
-         continue;
-
-      outcode = (x1 > 80) << 1;
-      outcode |= (x1 < -80);
-      outcode2 = (x2 > 80) << 1;
-      outcode2 |= (x2 < -80);
-      if(outcode & outcode2)
-         continue;
-
-      //
-      // Figure out color
-      //
-      color = CRY_BROWN;
-      if((p->powers[pw_allmap] +
-         showAllLines) && // IF COMPMAP && !MAPPED YET
-         !(line->flags & ML_MAPPED))
-         color = CRY_GREY;
-      else if (!(line->flags & ML_TWOSIDED)) // ONE-SIDED LINE
-         color = CRY_RED;
-      else if (line->special == 97 || // TELEPORT LINE
-         line->special == 39)
-         color = CRY_GREEN;
-      else if (line->flags & ML_SECRET)
-         color = CRY_RED;
-      else if (line->special)
-         color = CRY_BLUE; // SPECIAL LINE
-      else if (line->frontsector->floorheight != line->backsector->floorheight)
-         color = CRY_YELLOW;
-      else if (line->frontsector->ceilingheight != line->backsector->ceilingheight)
-         color = CRY_BROWN;
+         for(i = blocklinefirst[b]; i < blocklinefirst[b + 1]; i++)
+         {
+            line = blocklines[i].line;
+            if(line->validcount == validcount)
+               continue;
+            line->validcount = validcount;
 
-      DrawLine(color, 80 + x1, 90 - y1, 80 + x2, 90 - y2);
-      drawn++;
+            if(AM_DrawMapLine(p, line))
+               drawn++;
+         }
+      }
    }
 
    // IF <5 LINES DRAWN, MOVE TO LAST POSITION!
@@ -447,16 +604,9 @@ void AM_Drawer(void)
          nx3 = FixedMul(c, NOSELENGTH) + x1;
          ny3 = FixedMul(s, NOSELENGTH) + y1;
 
-         nx1 >>= xshift;
-         ny1 >>= yshift;
-         nx2 >>= xshift;
-         ny2 >>= yshift;
-         nx3 >>= xshift;
-         ny3 >>= yshift;
-
-         DrawLine(color, 80 + nx1, 90 - ny1, 80 + nx2, 90 - ny2);
-         DrawLine(color, 80 + nx2, 90 - ny2, 80 + nx3, 90 - ny3);
-         DrawLine(color, 80 + nx1, 90 - ny1, 80 + nx3, 90 - ny3);
+         AM_DrawMark(color, nx1, ny1, nx2, ny2);
+         AM_DrawMark(color, nx2, ny2, nx3, ny3);
+         AM_DrawMark(color, nx1, ny1, nx3, ny3);
       }
    }
 
@@ -464,9 +614,6 @@ void AM_Drawer(void)
    if(showAllThings)
    {
       fixed_t  x1,y1;
-      fixed_t  nx1,ny1;
-      fixed_t  nx2,ny2;
-      fixed_t  nx3,ny3;
       mobj_t  *mo;
       mobj_t  *next;
 
@@ -480,18 +627,15 @@ void AM_Drawer(void)
          x1 = mo->x - p->automapx;
          y1 = mo->y - p->automapy;
 
-         nx1 = x1 >> xshift;
-         ny1 = (y1 - MOBJLENGTH) >> yshift;
-         nx2 = (x1 - MOBJLENGTH) >> xshift;
-         ny2 = (y1 + MOBJLENGTH) >> yshift;
-         nx3 = (x1 + MOBJLENGTH) >> xshift;
-         ny3 = ny2;
-
-         DrawLine(CRY_AQUA, 80 + nx1, 90 - ny1, 80 + nx2, 90 - ny2);
-         DrawLine(CRY_AQUA, 80 + nx2, 90 - ny2, 80 + nx3, 90 - ny3);
-         DrawLine(CRY_AQUA, 80 + nx1, 90 - ny1, 80 + nx3, 90 - ny3);
+         AM_DrawMark(CRY_AQUA, x1, y1 - MOBJLENGTH, x1 - MOBJLENGTH, y1 + MOBJLENGTH);
+         AM_DrawMark(CRY_AQUA, x1 - MOBJLENGTH, y1 + MOBJLENGTH, x1 + MOBJLENGTH, y1 + MOBJLENGTH);
+         AM_DrawMark(CRY_AQUA, x1, y1 - MOBJLENGTH, x1 + MOBJLENGTH, y1 + MOBJLENGTH);
       }
    }
+
+   // CALICO: the lines went into the framebuffer, so it isn't clear any more
+   if(!gldrawing)
+      GL_FramebufferSetUpdated(FB_160);
 }
 
 // EOF
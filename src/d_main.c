@@ -1,9 +1,21 @@
 /* D_main.c  */
 
+#include <stdlib.h>
 #include "hal/hal_input.h"
+#include "hal/hal_sfx.h"
 #include "hal/hal_timer.h"
 #include "doomdef.h" 
+#include "m_alloc.h"
 #include "m_argv.h"
+#include "m_bench.h"
+#include "m_init.h"
+#include "m_jobs.h"
+#include "m_mem.h"
+#include "m_perfhud.h"
+#include "m_prof.h"
+#include "m_session.h"
+#include "m_thread.h"
+#include "m_trace.h"
  
 unsigned int BT_ATTACK = BT_B;
 unsigned int BT_USE    = BT_C;
@@ -259,11 +271,61 @@ mobj_t	emptymobj;
 ===============
 */
 
+//
+// CALICO: Set renderfrac to how far the clock is into the current tic
+//
+static void D_SetRenderFrac(void)
+{
+   unsigned int ms = hal_timer.getTimeMS();
+
+   renderfrac = (fixed_t)((ms * CALICO_GLOBAL_FPS) % 1000 * FRACUNIT / 1000);
+}
+
+// CALICO: milliseconds before a tic is due at which D_WaitForTic stops
+// sleeping, leaving MiniLoop to wait out the rest exactly
+static int frameslack = 2;
+
+//
+// CALICO: Sleep until the given tic is nearly due, so that waiting for it
+// doesn't keep a core busy
+//
+static void D_WaitForTic(unsigned int tic)
+{
+   unsigned int due = (unsigned int)(((unsigned long long)tic * 1000 + CALICO_GLOBAL_FPS - 1) / CALICO_GLOBAL_FPS);
+   unsigned int now = hal_timer.getTimeMS();
+
+   if(now + frameslack < due)
+      hal_timer.delay(due - now - frameslack);
+}
+
+// CALICO: tics drawn in while throttled in the background, and how long a
+// paused game sleeps between looks at the window
+#define BACKGROUNDDRAWTICS 5
+#define BACKGROUNDSLEEPMS  50
+
+//
+// CALICO: What to do while the window is in the background, holding looped
+// sounds for as long as it is. A netgame has to keep up with the other
+// player, and a timedemo or -seek is meant to run flat out.
+//
+static int D_BackgroundState(void)
+{
+   int state = HAL_BACKGROUND_NONE;
+
+   if(hal_appstate.getBackgroundState && !netgame && !dedicated && !spectating &&
+      !timedemo && !demoseeking)
+      state = hal_appstate.getBackgroundState();
+
+   hal_sound.holdLoops(state != HAL_BACKGROUND_NONE ? HAL_TRUE : HAL_FALSE);
+   return state;
+}
+
 int MiniLoop(void (*start)(void), void (*stop)(void),
              int (*ticker)(void), void (*drawer)(void))
 {
    int exit;
    int buttons;
+   int background = HAL_BACKGROUND_NONE; // CALICO
 
    //
    // setup (cache graphics, etc)
@@ -280,60 +342,125 @@ int MiniLoop(void (*start)(void), void (*stop)(void),
 
    ticbuttons[0] = ticbuttons[1] = oldticbuttons[0] = oldticbuttons[1] = 0;
 
+   M_SessionBreak(); // CALICO: the setup above isn't a frame
+
    do
    {
       // CALICO: timing
       static unsigned int oldentertic;
       unsigned int entertic;
+      unsigned int tracestart; // CALICO: for -trace
+      unsigned int framestart, ticstart; // CALICO: for the session report
+
+      // CALICO: a paused game only looks for its window coming back, then
+      // carries on from the tic it stopped at rather than catching up
+      if(background == HAL_BACKGROUND_PAUSE)
+      {
+         hal_input.getEvents();
+         if((background = D_BackgroundState()) == HAL_BACKGROUND_PAUSE)
+         {
+            hal_timer.delay(BACKGROUNDSLEEPMS);
+            continue;
+         }
+         oldentertic = 0;
+         M_SessionBreak();
+      }
 
       entertic = hal_timer.getTime();
 
       if(!oldentertic)
          oldentertic = entertic;
 
-      if(entertic <= oldentertic)
-         continue;
+      // CALICO: -seek runs a demo's first tics unseen, as fast as it can
+      demoseeking = (demoplayback && gametic < demoseektic);
+      if(!demoseeking)
+         demoseeking = G_SpectateBehind(); // CALICO: catch up with a broadcast
 
-      lasttics = entertic - oldentertic;
-      oldentertic = entertic;
-
-      // run the tic immediately
-      gamevbls += vblsinframe;
-      exit = ticker();
-
-      // adaptive timing based on previous frame
-      if(demoplayback || demorecording)
-         vblsinframe = 4;
-      else
+      // CALICO: a timedemo runs every tic as soon as it can
+      if(entertic <= oldentertic && !timedemo && !demoseeking)
       {
-         vblsinframe = lasttics * 4;
-         if(vblsinframe > 8)
-            vblsinframe = 8;
+         // CALICO: keep drawing the game view until the next tic is due
+         tracestart = M_TraceBegin();
+         if(interpolate && drawer == P_Drawer && background == HAL_BACKGROUND_NONE)
+         {
+            D_SetRenderFrac();
+            P_DrawInterpolated();
+            M_TraceEnd("interpolated", tracestart);
+         }
+         else
+         {
+            D_WaitForTic(oldentertic + 1);
+            M_TraceEnd("waittic", tracestart);
+         }
+         continue;
       }
-      // get buttons for next tic
-      oldticbuttons[0] = ticbuttons[0];
-      oldticbuttons[1] = ticbuttons[1];
 
-      buttons = I_ReadControls();
-      ticbuttons[consoleplayer] = buttons;
-      if(demoplayback)
+      // CALICO: get buttons for this tic now that it is due, rather than
+      // right after the previous one had run, so they are up to a tic
+      // fresher. The first tic still runs with no buttons, and every tic
+      // still sees the same commands, so demos keep their sync.
+      tracestart = M_TraceBegin();
+      framestart = M_SessionTime();
+      if(ticon)
       {
-         if(buttons & (BT_A|BT_B|BT_C))
+         // adaptive timing based on previous frame
+         if(demoplayback || demorecording)
+            vblsinframe = 4;
+         else
+         {
+            vblsinframe = lasttics * 4;
+            if(vblsinframe > 8)
+               vblsinframe = 8;
+         }
+         oldticbuttons[0] = ticbuttons[0];
+         oldticbuttons[1] = ticbuttons[1];
+
+         buttons = I_ReadControls();
+         ticbuttons[consoleplayer] = buttons;
+         if(demoplayback)
+         {
+            if(buttons & (BT_A|BT_B|BT_C))
+            {
+               exit = ga_exitdemo;
+               break;
+            }
+            ticbuttons[consoleplayer] = buttons = GetDemoCmd ();
+         }
+
+         if(spectating)
+            G_SpectateTic(); // CALICO: both players' buttons come from the broadcast
+         else if(dedicated)
+            I_NetServeTic(); // CALICO: and here from both players
+         else if(netgame) // may also change vblsinframe
          {
-            exit = ga_exitdemo;
+            ticbuttons[!consoleplayer] = NetToLocal(I_NetTransfer(LocalToNet(ticbuttons[consoleplayer])));
+            ticbuttons[consoleplayer]  = NetToLocal(netlocalbuttons); // CALICO: may be delayed
+         }
+
+         if(demorecording)
+            G_WriteDemoCmd(buttons); // CALICO: streamed out to a file
+
+         G_BroadcastTic(); // CALICO
+
+         if((demorecording || demoplayback) && (buttons & BT_PAUSE))
+         {
+            exit = ga_completed;
             break;
          }
-         ticbuttons[consoleplayer] = buttons = GetDemoCmd ();
       }
 
-      if(netgame) // may also change vblsinframe
-         ticbuttons[!consoleplayer] = NetToLocal(I_NetTransfer(LocalToNet(ticbuttons[consoleplayer])));
+      M_TraceEnd("input", tracestart);
 
-      if(demorecording)
-         *demo_p++ = BIGLONG(buttons); // CALICO: correct endianness
+      lasttics = entertic - oldentertic;
+      oldentertic = entertic;
 
-      if((demorecording || demoplayback) && (buttons & BT_PAUSE))
-         exit = ga_completed;
+      // run the tic immediately
+      gamevbls += vblsinframe;
+      tracestart = M_TraceBegin();
+      ticstart   = M_SessionTime();
+      exit = ticker();
+      M_SessionTic(ticstart);
+      M_TraceEnd("ticker", tracestart);
 
       if(gameaction == ga_warped)
       {
@@ -344,10 +471,33 @@ int MiniLoop(void (*start)(void), void (*stop)(void),
       ticon++;
 
       // sync up with the refresh
+      tracestart = M_TraceBegin();
       while(!I_RefreshCompleted())
          ;
       S_UpdateSounds();
-      drawer();
+      M_TraceEnd("refreshwait", tracestart);
+      if(interpolate)
+         D_SetRenderFrac();
+      background = D_BackgroundState(); // CALICO: as of this tic's input
+      if(!nodrawing && !demoseeking && (background == HAL_BACKGROUND_NONE ||
+         (background == HAL_BACKGROUND_THROTTLE && !(ticon % BACKGROUNDDRAWTICS))))
+      {
+         tracestart = M_TraceBegin();
+         drawer();
+         M_TraceEnd("drawer", tracestart);
+         M_SessionFrame(framestart);
+      }
+
+      // CALICO: hand back any lumps the streaming thread has finished, and
+      // queue more of the map's working set
+      W_RetireStreams();
+      W_PrefetchWorkingSet();
+
+      M_AllocFrame(); // CALICO
+      M_MemFrame();   // CALICO
+
+      if(timedemo)
+         G_TimeDemoFrame();
 
       // CALICO: Jag-specific
 #if 0
@@ -411,11 +561,16 @@ int TIC_Abortable(void)
 
 jagobj_t *titlepic;
 
+// CALICO: doublebuffergen when titlepic was drawn; the title and the credits
+// are still pictures, so each is only drawn into the framebuffer once
+static int titlepicgen;
+
 void START_Title(void)
 {
    backgroundpic = W_POINTLUMPNUM(W_GetNumForName("M_TITLE"));
    DoubleBufferSetup();
    titlepic = W_CacheLumpName("title", PU_STATIC);
+   W_PrefetchLump(W_GetNumForName("credits"), PU_CACHE); // CALICO: after the demo
    S_StartSong(mus_intro, 0);
    hal_appstate.setGrabState(HAL_FALSE); // CALICO: don't grab input
 }
@@ -428,7 +583,11 @@ void STOP_Title(void)
 
 void DRAW_Title(void)
 {
-   DrawJagobj(titlepic, 0, 0, NULL);
+   if(titlepicgen != doublebuffergen)
+   {
+      DrawJagobj(titlepic, 0, 0, NULL);
+      titlepicgen = doublebuffergen;
+   }
    UpdateBuffer();
 }
 
@@ -463,7 +622,11 @@ int TIC_Credits(void)
 
 void DRAW_Credits(void)
 {
-   DrawJagobj(titlepic, 0, 0, NULL);
+   if(titlepicgen != doublebuffergen)
+   {
+      DrawJagobj(titlepic, 0, 0, NULL);
+      titlepicgen = doublebuffergen;
+   }
    UpdateBuffer();
 }
 
@@ -513,6 +676,7 @@ reselect:
    }
 
    G_InitNew(startskill, startmap, starttype);
+   G_StartBroadcast(); // CALICO
    G_RunGame();
 }
 
@@ -523,33 +687,92 @@ skill_t    startskill = sk_medium;
 int        startmap   = 3;
 gametype_t starttype  = gt_single;
 
+//
+// CALICO: the startup stages, each with the stages it needs run first
+//
+static const initstage_t doomstages[] =
+{
+   { "C_Init",        C_Init                            }, // set up object list / etc
+   { "Z_Init",        Z_Init                            },
+   { "M_InitThreads", M_InitThreads                     }, // timer period and main thread core
+   { "M_InitJobs",    M_InitJobs                        }, // W_Init may decode the whole IWAD
+   { "W_Init",        W_Init,        { "Z_Init", "M_InitJobs" } },
+   { "I_Init",        I_Init,        { "W_Init" }       },
+   { "M_ProfInit",    M_ProfInit                        },
+   { "M_TraceInit",   M_TraceInit                       },
+   { "M_InitAllocCounts", M_InitAllocCounts, { "M_TraceInit" } },
+   { "M_InitPerfHUD", M_InitPerfHUD, { "M_ProfInit" }   },
+   { "M_InitSession", M_InitSession, { "M_ProfInit" }   },
+   { "M_InitMemReport", M_InitMemReport, { "Z_Init" }   },
+   { "R_Init",        R_Init,        { "W_Init", "I_Init" } },
+   { "P_Init",        P_Init,        { "R_Init" }       },
+   { "S_Init",        S_Init,        { "W_Init" }       },
+   { "ST_Init",       ST_Init,       { "W_Init" }       },
+   { "O_Init",        O_Init,        { "W_Init", "S_Init" } }
+};
+
 //
 // Main function
 //
 void D_DoomMain(void) 
 {    
-   D_printf("C_Init\n");
-   C_Init(); // set up object list / etc
-   D_printf("Z_Init\n");
-   Z_Init(); 
-   D_printf("W_Init\n");
-   W_Init();
-   D_printf("I_Init\n");
-   I_Init(); 
-   D_printf("R_Init\n");
-   R_Init(); 
-   D_printf("P_Init\n");
-   P_Init(); 
-
-   D_printf("S_Init\n");
-   S_Init();
-   ST_Init();
-   O_Init();
+   int p;
+
+   // CALICO: run and time the startup stages
+   M_RunInitStages(doomstages, sizeof(doomstages) / sizeof(*doomstages));
+   M_InitReport();
+
+   interpolate = M_FindArgument("-uncapped"); // CALICO: draw frames between tics
+   latelatch   = M_FindArgument("-latelatch"); // CALICO: see R_ViewAngle
+   if((p = M_GetArgParameters("-frameslack", 1))) // CALICO: see D_WaitForTic
+      frameslack = emax(atoi(myargv[p]), 0);
+   if(M_FindArgument("-checklzss")) // CALICO: verify the fast LZSS decoders
+   {
+      W_CheckDecode();
+      R_CheckDecode();
+   }
 
    //==========================================================================
 
    D_printf("DM_Main\n");
 
+   // CALICO: time the engine's kernels and exit
+   if(M_FindArgument("-bench"))
+      M_Bench();
+
+   // CALICO: time the renderer from fixed views of each map and exit
+   if(M_FindArgument("-renderbench"))
+      M_RenderBench();
+
+   // CALICO: check a set of demos against their state hashes and exit
+   if((p = M_GetArgParameters("-verifydemos", 1)))
+      G_VerifyDemos(p);
+
+   // CALICO: time a set of demos against a baseline and exit
+   if((p = M_GetArgParameters("-perfdemos", 1)))
+      G_PerfDemos(p);
+
+   // CALICO: benchmark a demo and exit
+   if((p = M_GetArgParameters("-timedemo", 1)))
+      G_TimeDemo(myargv[p]);
+
+   // CALICO: record a demo of the starting level to a file
+   if((p = M_GetArgParameters("-record", 1)))
+      G_RecordDemo(myargv[p]);
+
+   // CALICO: watch a demo, possibly from partway through
+   if((p = M_GetArgParameters("-playdemo", 1)))
+      G_PlayDemo(myargv[p]);
+
+   // CALICO: watch a match being broadcast, or broadcast the ones played here
+   if((p = M_GetArgParameters("-spectate", 1)))
+      G_Spectate(myargv[p]);
+   G_InitBroadcast();
+
+   // CALICO: run a game for two remote players, drawing nothing
+   if(M_FindArgument("-dedicated"))
+      I_NetServe();
+
    while(1)
    {
       RunTitle();
@@ -159,6 +159,16 @@ typedef struct mobj_s
 
    // info for drawing
    fixed_t        x, y, z;
+
+   // CALICO: the fields which P_CheckSights2 and P_RunMobjBase2 read for
+   // every mobj in every tic come straight after the ones shared with
+   // degenmobj_t, so that the list sweeps read the first 64 bytes of each
+   // mobj rather than fields spread over all of it
+   int              flags;
+   VINT             tics;        // state tic counter
+   struct mobj_s   *target;      // thing being chased/attacked (or NULL), also the originator for missiles
+   struct player_s *player;      // only valid if type == MT_PLAYER
+
    struct mobj_s *snext, *sprev; // links in sector (if needed)
    angle_t        angle;
    VINT           sprite;        // used to find patch_t and flip value
@@ -173,16 +183,12 @@ typedef struct mobj_s
 
    mobjtype_t  type;
    mobjinfo_t *info;         // &mobjinfo[mobj->type]
-   VINT        tics;         // state tic counter
    state_t    *state;
-   int         flags;
    VINT        health;
    VINT        movedir;      // 0-7 
    VINT        movecount;    // when 0, select a new dir
-   struct mobj_s *target;    // thing being chased/attacked (or NULL), also the originator for missiles
    VINT reactiontime;        // if non 0, don't attack yet; used by player to freeze a bit after teleporting
    VINT threshold;           // if >0, the target will be chased no matter what (even if shot)
-   struct player_s *player;  // only valid if type == MT_PLAYER
    struct line_s *extradata; // for latecall functions
 
    short spawnx, spawny, spawntype, spawnangle; // for deathmatch respawning
@@ -190,6 +196,11 @@ typedef struct mobj_s
    // CALICO: reference counting
    struct mobj_s *extramobj;    // for latecall functions that need an mobj_t *
    int            references;   // number of other mobjs with references to this mobj
+
+   // CALICO: position at the start of the tic, for interpolated rendering
+   fixed_t        prevx, prevy, prevz;
+
+   VINT           lookcount;    // CALICO: looks seen by -staggerlook
 } mobj_t;
 
 // each sector has a degenmobj_t in it's center for sound origin purposes
@@ -380,6 +391,10 @@ typedef struct player_s
 
    int            automapx, automapy, automapscale, automapflags;
    int            turnheld; // for accelerative turning
+
+   // CALICO: view at the start of the tic, for interpolated rendering
+   fixed_t        prevviewz;
+   angle_t        prevviewangle;
 } player_t;
 
 #define CF_NOCLIP  1
@@ -441,7 +456,8 @@ extern int     totalkills, totalitems, totalsecret; // for intermission
 
 extern int     gametic;
 
-extern mapthing_t deathmatchstarts[10], *deathmatch_p;
+#define MAXDMSTARTS 64 // CALICO: was 10, and the count could run past it
+extern mapthing_t deathmatchstarts[MAXDMSTARTS], *deathmatch_p;
 extern mapthing_t playerstarts[MAXPLAYERS];
 
 /*
@@ -453,8 +469,7 @@ GLOBAL FUNCTIONS
 */
 
 
-fixed_t FixedMul(fixed_t a, fixed_t b);
-fixed_t FixedDiv(fixed_t a, fixed_t b);
+#include "m_fixed.h" // CALICO: FixedMul and FixedDiv are inline
 
 #define ACC_FIXEDMUL 4
 #define ACC_FIXEDDIV 8
@@ -500,6 +515,7 @@ long  LongSwap(long dat);
 #define PU_CACHE      101
 
 #define	ZONEID 0x1d4a
+#define LEVELID 0x1d4b // CALICO: a block in the level arena
 
 typedef struct memblock_s
 {
@@ -512,10 +528,15 @@ typedef struct memblock_s
    struct memblock_s *prev;
 } memblock_t;
 
-typedef struct
+// CALICO: free blocks are kept on lists by size; see z_zone.c
+#define NUMZONESMALL 32 // lists of one block size each, 8 bytes apart
+#define NUMZONELISTS (NUMZONESMALL + 24)
+
+typedef struct memzone_s
 {
    int         size;      // total bytes malloced, including header
-   memblock_t *rover;
+   struct memzone_s *next; // CALICO: arenas added when the zone fills up
+   memblock_t *freelists[NUMZONELISTS];
    memblock_t  blocklist; // start / end cap for linked list
 } memzone_t;
 
@@ -523,20 +544,86 @@ typedef struct
 extern int framecount;
 
 extern memzone_t *mainzone;
-extern memzone_t *refzone;
 
 void       Z_Init(void);
 memzone_t *Z_InitZone(byte *base, int size);
-void      *Z_Malloc2(memzone_t *mainzone, int size, int tag, void *ptr);
-void       Z_Free2(memzone_t *mainzone,void *ptr);
+void      *Z_Malloc2(memzone_t *mainzone, int size, int tag, void *ptr, const char *file, int line);
+void       Z_Free2(memzone_t *mainzone,void *ptr, const char *file, int line);
 
-#define Z_Malloc(x, y, z) Z_Malloc2(mainzone, x, y, z)
-#define Z_Free(x) Z_Free2(mainzone, x)
+// CALICO: the call site is passed along for -zonetrace
+#define Z_Malloc(x, y, z) Z_Malloc2(mainzone, x, y, z, __FILE__, __LINE__)
+#define Z_Free(x) Z_Free2(mainzone, x, __FILE__, __LINE__)
 
 void Z_FreeTags(memzone_t *mainzone);
 void Z_CheckHeap(memzone_t *mainzone);
 void Z_ChangeTag(void *ptr, int tag);
 int  Z_FreeMemory(memzone_t *mainzone);
+int  Z_TotalMemory(memzone_t *mainzone); // CALICO
+
+// CALICO: the level arena; see z_level.c
+memblock_t *Z_LevelAlloc(int size, int tag, void **user);
+void        Z_LevelFree(memblock_t *block);
+void        Z_ResetLevelArena(void);
+void        Z_GetLevelArenaStats(int *used, int *size);
+
+// CALICO: zone config vars; see z_config.cpp
+int  Z_ConfigZoneSize(void);
+int  Z_ConfigZoneGrow(void);
+
+// CALICO: pools of one kind of level object; see z_slab.c
+typedef struct slab_s
+{
+   const char *name;
+   int         size;       // of one object
+   int         tag;        // of the chunks taken from the zone
+   void       *freelist;
+   int         generation; // the free list is stale if not current
+   int         capacity;   // objects in the slab's chunks
+   int         count;      // objects in use
+   int         highwater;  // most objects in use at once
+} slab_t;
+
+void *Z_SlabAlloc(slab_t *slab);
+void  Z_SlabFree(void *ptr);
+void  Z_SlabReserve(slab_t *slab, int count);
+void  Z_ResetSlabs(void);
+
+// CALICO: zone usage reports and tracing; see z_debug.c
+enum
+{
+   ZT_STATIC,
+   ZT_SOUND,
+   ZT_MUSIC,
+   ZT_LEVEL,
+   ZT_LEVSPEC,
+   ZT_PURGABLE,
+   ZT_OTHER,
+   NUMZONETAGS,
+   ZT_FREE = NUMZONETAGS // in a zone map
+};
+
+typedef struct zonestats_s
+{
+   int tagbytes[NUMZONETAGS];
+   int tagblocks[NUMZONETAGS];
+   int freebytes;
+   int freeblocks;
+   int largestfree;
+   int numblocks;
+   int numzones; // the zone and its added arenas
+} zonestats_t;
+
+extern boolean zonetracing;
+
+void        Z_InitTrace(void);
+void        Z_TraceMalloc(void *ptr, int size, int tag, const char *file, int line);
+void        Z_TraceFree(void *ptr, const char *file, int line);
+void        Z_FlushTrace(void);
+int         Z_TagIndex(int tag);
+const char *Z_TagName(int tagindex);
+void        Z_GetZoneStats(memzone_t *zone, zonestats_t *stats);
+void        Z_PrintZoneStats(memzone_t *zone);
+void        Z_MapZone(memzone_t *zone, byte *cells, int numcells);
 
 //------- //
 //WADFILE //
@@ -571,10 +658,49 @@ int   W_CheckNumForName(const char *name);
 int   W_GetNumForName(const char *name);
 int   W_LumpLength(int lump);
 void  W_ReadLump(int lump, void *dest);
+void  W_CheckDecode(void);
+void  W_InitDecodedCache(void);
+byte *W_DecodedLump(int lump);
+long  W_DecodedCacheSize(void);
 void *W_CacheLumpNum(int lump, int tag);
 void *W_CacheLumpName(const char *name, int tag);
 int   W_strncasecmp(const char *s1, const char *s2, int len);
 
+// CALICO: read-only lump data, used in place when it isn't compressed
+const void *W_LumpData(int lump, void *buffer);
+const void *W_CacheLumpNumConst(int lump, int tag);
+
+// CALICO: lumps decoded ahead of time on a streaming thread
+typedef void (*streamfunc_t)(int lump, void *dest);
+typedef void (*finishfunc_t)(int lump, void *dest, int data);
+
+extern boolean streaming;
+
+void    W_InitStreaming(void);
+boolean W_CanStream(void);
+boolean W_StreamLump(int lump, void *dest, streamfunc_t decode, finishfunc_t finish, int data);
+boolean W_LumpStreaming(int lump);
+void    W_WaitStream(int lump);
+void    W_RetireStreams(void);
+void    W_PrefetchLump(int lump, int tag);
+
+// CALICO: what each map used the last time it was played, for -worksets
+typedef enum
+{
+   WS_GRAPHIC, // decoded pixels of a texture, flat or sprite
+   WS_LUMP,    // anything through W_CacheLumpNum
+   WS_SOUND,   // a sound effect number
+   NUMWSKINDS
+} wskind_t;
+
+void W_BeginWorkingSet(int maplump);
+void W_EndWorkingSet(void);
+void W_TouchWorkingSet(wskind_t kind, int num);
+int  W_WorkingSetGraphic(int *index);
+void W_PreloadWorkingSet(int maplump);
+void W_QueuePrefetch(wskind_t kind, int num);
+void W_PrefetchWorkingSet(void);
+
 #define W_POINTLUMPNUM(x) (void*)(wadfileptr + BIGLONG(lumpinfo[x].filepos))
 
 //---------- //
@@ -583,8 +709,17 @@ int   W_strncasecmp(const char *s1, const char *s2, int len);
 void D_DoomMain(void);
 
 extern boolean demoplayback, demorecording;
+extern boolean timedemo;  // CALICO
+extern boolean nodrawing; // CALICO
+extern boolean demoseeking; // CALICO
+extern int     demoseektic; // CALICO
+extern boolean spectating;  // CALICO: running a match from a broadcast
 extern int    *demo_p, *demobuffer;
 
+// CALICO: demo files written by G_RecordDemo start with these, big-endian
+#define DEMOMAGIC   0x43444d4f // "CDMO"
+#define DEMOVERSION 1
+
 extern skill_t    startskill;
 extern int        startmap;
 extern gametype_t starttype;
@@ -600,6 +735,20 @@ extern gametype_t starttype;
 #define SCREENHEIGHT 144
 #endif
 
+// CALICO: the 3D view can be rendered at a power-of-two multiple of the
+// playfield size; SCREENWIDTH and SCREENHEIGHT remain the logical size used
+// by everything drawn in 2D. On a wide window the view may also be widened
+// to twice the playfield width, rather than stretched.
+#define MAXRENDERSHIFT  2
+#define MAXVIEWWIDTH    (SCREENWIDTH * 2)
+#define MAXRENDERWIDTH  (MAXVIEWWIDTH << MAXRENDERSHIFT)
+#define MAXRENDERHEIGHT (SCREENHEIGHT << MAXRENDERSHIFT)
+
+extern int rendershift;   // log2 of the render scale
+extern int renderwidth;   // SCREENWIDTH << rendershift, or more when widened
+extern int renderheight;  // SCREENHEIGHT << rendershift
+extern int renderxoffset; // first column of the playfield when widened
+
 void  I_Init(void);
 byte *I_WadBase(void);
 byte *I_ZoneBase(int *size);
@@ -607,11 +756,17 @@ byte *I_ZoneBase(int *size);
 // return a pointer to a 64k or so temp work buffer for level setup uses 
 //(non-displayed frame buffer)
 byte *I_TempBuffer(void);
+int   I_TempBufferSize(void); // CALICO
 
 int  I_ReadControls(void);
+int  I_LatchControls(void); // CALICO
 
 void I_NetSetup(void);
 unsigned int I_NetTransfer(unsigned int buttons);
+extern unsigned int netlocalbuttons; // CALICO: this tic's own buttons after I_NetTransfer
+extern boolean dedicated; // CALICO: -dedicated; runs the game for two remote players
+void I_NetServe(void);    // CALICO
+void I_NetServeTic(void); // CALICO
 
 boolean I_RefreshCompleted(void);
 boolean I_RefreshLatched(void);
@@ -619,10 +774,16 @@ int     I_GetTime(void);
 
 void I_Update(void);
 void I_Error(const char *error, ...);
-void I_DrawColumn(int dc_x, int dc_yl, int dc_yh, int light, fixed_t frac, fixed_t fracstep, inpixel_t *dc_source, int dc_texheight);
-void I_DrawColumnNPO2(int dc_x, int dc_yl, int dc_yh, int light, fixed_t frac, fixed_t fracstep, inpixel_t *dc_source, int dc_texheight);
-void I_DrawSpan(int ds_y, int ds_x1, int ds_x2, int light, fixed_t ds_xfrac, fixed_t ds_yfrac, fixed_t ds_xstep, fixed_t ds_ystep, inpixel_t *ds_source);
+// CALICO: drawers are selected at startup by I_InitDrawers (see jagdraw.c)
+extern void (*I_DrawColumn)(int dc_x, int dc_yl, int dc_yh, int light, fixed_t frac, fixed_t fracstep, inpixel_t *dc_source, int dc_texheight);
+extern void (*I_DrawColumnNPO2)(int dc_x, int dc_yl, int dc_yh, int light, fixed_t frac, fixed_t fracstep, inpixel_t *dc_source, int dc_texheight);
+extern void (*I_DrawSpan)(int ds_y, int ds_x1, int ds_x2, int light, fixed_t ds_xfrac, fixed_t ds_yfrac, fixed_t ds_xstep, fixed_t ds_ystep, inpixel_t *ds_source);
+extern void (*I_DrawShadowColumn)(int dc_x, int dc_yl, int dc_yh); // CALICO
+void I_CopyColumn(int dc_x, int src_x, int dc_yl, int dc_yh); // CALICO
+void I_SetupSky(pixel_t *data, int lumpnum, int texheight); // CALICO
+void I_DrawSkyColumn(int dc_x, int dc_yl, int dc_yh, int colnum, fixed_t frac, fixed_t fracstep); // CALICO
 void I_Print8(int x, int y, char *string);
+void I_DrawText8(int x, int y, const char *string, unsigned int color); // CALICO
 
 //---- //
 //GAME //
@@ -633,20 +794,36 @@ void G_InitNew(skill_t skill, int map, gametype_t gametype);
 void G_ExitLevel(void);
 void G_SecretExitLevel(void);
 
-void G_RecordDemo(void);
+void G_RecordDemo(const char *filename); // CALICO: takes a file name
+void G_WriteDemoCmd(unsigned int buttons); // CALICO
 int  G_PlayDemoPtr(int *demo);
+void G_TimeDemo(const char *name); // CALICO
+void G_PlayDemo(const char *name); // CALICO
+void G_VerifyDemos(int first);     // CALICO: index of the first name in myargv
+void G_PerfDemos(int first);       // CALICO: index of the baseline in myargv
+void G_TimeDemoFrame(void);        // CALICO
+
+// CALICO: spectator broadcasts
+void    G_InitBroadcast(void);
+void    G_StartBroadcast(void);
+void    G_BroadcastTic(void);
+boolean G_SpectateBehind(void);
+void    G_SpectateTic(void);
+void    G_Spectate(const char *host);
 
 //----- //
 //PLAY  //
 //----- //
 
 void P_SetupLevel(int map, skill_t skill);
+void P_PreloadLevel(int map); // CALICO
 void P_Init(void);
 
 void P_Start(void);
 void P_Stop(void);
 int  P_Ticker(void);
 void P_Drawer(void);
+void P_DrawInterpolated(void);
 
 void IN_Start(void);
 void IN_Stop(void);
@@ -663,6 +840,8 @@ void F_Stop(void);
 int  F_Ticker(void);
 void F_Drawer(void);
 
+extern int mappedlines; // CALICO: lines marked ML_MAPPED so far
+
 void AM_Control(player_t *player);
 void AM_Drawer(void);
 void AM_Start(void);
@@ -689,13 +868,49 @@ void ST_InitEveryLevel(void);
 //------- //
 struct seg_s;
 
-void R_RenderPlayerView(void);
+// CALICO: everything needed to draw one view; see r_local.h
+typedef struct rview_s rview_t;
+
+extern rview_t *mainview;
+
+void R_RenderPlayerView(rview_t *rv, player_t *player);
+void R_FinishRefresh(void); // CALICO
+void R_InvalidateView(rview_t *rv); // CALICO
 void R_Init(void);
+void R_PrecacheLevel(void);
+void R_PinAnimations(void); // CALICO
+void R_PrefetchSprite(int sprite, int frame); // CALICO
+void R_PrefetchPixels(int lumpnum); // CALICO
+void R_InitPVS(void);
+void R_CheckDecode(void);
+
+// CALICO: with -compactpixels, decoded graphics are kept as palette indices
+// at a byte a texel, and are turned into CRY through vgatojag as they are
+// drawn; see I_InitDrawers
+extern boolean compactpixels;
+extern pixel_t vgatojag[256];
+
+// CALICO: address, and CRY value, of the nth texel of decoded graphic data
+#define R_TexelAddr(data, n) \
+   ((inpixel_t *)((byte *)(data) + (size_t)(n) * (compactpixels ? 1 : sizeof(pixel_t))))
+#define R_TexelCRY(data, n) \
+   (compactpixels ? vgatojag[((const byte *)(data))[n]] : ((const pixel_t *)(data))[n])
+
+// CALICO: interpolated rendering between tics
+extern boolean interpolate; // true if frames are drawn between tics
+extern fixed_t renderfrac;  // fraction of the tic elapsed since it was run
+extern boolean latelatch;   // turn the view by the buttons held while drawing
+
+void R_SaveInterpolation(void);
+void R_ResetMobjInterpolation(mobj_t *mo);
 int  R_FlatNumForName(const char *name);
+int  R_CheckFlatNumForName(const char *name); // CALICO
 int  R_TextureNumForName(const char *name);
 int  R_CheckTextureNumForName(const char *name);
 angle_t R_PointToAngle2(fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2);
 struct subsector_s *R_PointInSubsector(fixed_t x, fixed_t y);
+void R_InitSubsectorHulls(void); // CALICO
+struct subsector_s *R_PointInSubsectorHint(fixed_t x, fixed_t y, struct subsector_s *hint); // CALICO
 
 //---- //
 //MISC //
@@ -764,6 +979,7 @@ typedef struct
 #endif
 
 void DoubleBufferSetup(void);
+extern int doublebuffergen; // CALICO: bumped by DoubleBufferSetup
 void EraseBlock(int x, int y, int width, int height, void *destResource);
 void DrawJagobj(jagobj_t *jo, int x, int y, void *destResource);
 void UpdateBuffer(void);
@@ -780,6 +996,7 @@ extern volatile int dspcodestart, dspcodeend, dspfinished;
 extern unsigned short *palette8;
 
 extern boolean   gamepaused;
+extern int       worldtic; // CALICO: tics the playsim has run
 extern jagobj_t *pausepic;
 
 extern int       controltype;
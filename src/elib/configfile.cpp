@@ -30,6 +30,7 @@
 #include <map>
 
 #include "../hal/hal_platform.h"
+#include "../m_save.h"
 #include "atexit.h"
 #include "configfile.h"
 #include "parser.h"
@@ -159,12 +160,11 @@ void CfgItem::writeItem(qstring &qstr)
 }
 
 //
-// Find a configuration binding item by name.
+// Find a configuration binding item by name and the name's hash code.
 //
-CfgItem *CfgItem::FindByName(const char *name)
+CfgItem *CfgItem::FindInChain(const char *name, unsigned int hc)
 {
-   unsigned int chain = qstring::HashCodeStatic(name) % NUMCHAINS;
-   CfgItem *item = items[chain];
+   CfgItem *item = items[hc % NUMCHAINS];
 
    while(item && strcasecmp(name, item->m_name))
       item = item->m_next;
@@ -172,6 +172,23 @@ CfgItem *CfgItem::FindByName(const char *name)
    return item;
 }
 
+//
+// Find a configuration binding item by name.
+//
+CfgItem *CfgItem::FindByName(const char *name)
+{
+   return FindInChain(name, qstring::HashCodeStatic(name));
+}
+
+//
+// CALICO: Overload for qstring, which will have hashed itself already if
+// it has been looked up before.
+//
+CfgItem *CfgItem::FindByName(const qstring &name)
+{
+   return FindInChain(name.constPtr(), name.hashCode());
+}
+
 //
 // Get a variable's string representation.
 //
@@ -302,7 +319,7 @@ bool CfgFileParser::doStateExpectValue(Tokenizer &token)
 {
    qstring &value = token.getToken();
 
-   auto item = CfgItem::FindByName(m_key.constPtr());
+   auto item = CfgItem::FindByName(m_key);
    if(item)
       item->readItem(value);
    m_state = STATE_EXPECTKEYWORD;
@@ -338,69 +355,36 @@ static void AddItemToMap(CfgItem *item, void *data)
    cwd->itemMap->emplace(qstring(item->getName()), item);
 }
 
-static bool WriteCfgItem(CfgItem *item, FILE *f)
+static void WriteCfgItem(CfgItem *item, qstring &out)
 {
    qstring value;
    item->writeItem(value);
-   if(std::fprintf(f, "%s \"%s\"\n", item->getName(), value.constPtr()) < 0)
-      return false;
-   return true;
+   out << item->getName() << " \"" << value << "\"\n";
 }
 
+//
+// CALICO: the file's contents are put together here and written out by
+// M_SaveFile, which writes a temporary file and moves it into place.
+//
 void Cfg_WriteFile(void)
 {
    cfgwritedata_t cwd;
-   FILE *f     = nullptr;
-   bool  error = false;
    std::map<qstring, CfgItem *> items;
-   qstring tmpName(hal_platform.getWriteDirectory());
    qstring dstName(hal_platform.getWriteDirectory());
+   qstring out;
 
-   tmpName.pathConcatenate("temp.cfg");
    dstName.pathConcatenate("calico.cfg");
 
    cwd.itemMap = &items;
-   f = std::fopen(tmpName.constPtr(), "w");
-   if(!f)
-   {
-      hal_platform.debugMsg("Warning: could not open temp.cfg\n");
-      return;
-   }
-
-   if(std::fprintf(f, "// CALICO configuration file\n") < 0)
-   {
-      hal_platform.debugMsg("Warning: failed write to temp.cfg\n");
-      return;
-   }
+   out << "// CALICO configuration file\n";
 
    // add config items to the map
    CfgItem::ItemIterator(AddItemToMap, &cwd);
 
    for(auto &item : items)
-   {
-      if(!WriteCfgItem(item.second, f))
-      {
-         error = true;
-         break;
-      }
-   }
-
-   if(error)
-   {
-      std::fclose(f);
-      hal_platform.debugMsg("Warning: failed one or more cfg writes\n");
-      return;
-   }
-
-   if(std::fclose(f) < 0)
-   {
-      hal_platform.debugMsg("Warning: failed to close temp.cfg\n");
-      return;
-   }
+      WriteCfgItem(item.second, out);
 
-   std::remove(dstName.constPtr());
-   if(std::rename(tmpName.constPtr(), dstName.constPtr()))
-      hal_platform.debugMsg("Warning: failed to write calico.cfg\n");
+   M_SaveFile(dstName.constPtr(), out.constPtr(), out.length());
 }
 
 // EOF
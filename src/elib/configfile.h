@@ -69,6 +69,8 @@ protected:
 
    void init(const char *name, itemtype_t type, void *var);
 
+   static CfgItem *FindInChain(const char *name, unsigned int hc);
+
 public:
    CfgItem(const char *name, int     *i, cfgrange_t<int> *range = nullptr);
    CfgItem(const char *name, bool    *b);
@@ -82,6 +84,7 @@ public:
    const char *getName() const { return m_name; }
 
    static CfgItem *FindByName(const char *name);
+   static CfgItem *FindByName(const qstring &name);
    static void GetValueAsString(const char *name, qstring &qstr);
    static void ItemIterator(void (*func)(CfgItem *, void *), void *data);
 };
@@ -134,7 +134,17 @@ void qstring::freeBuffer()
 // Required for efficiency when using qstring with Collection<T>.
 //
 qstring::qstring(qstring &&other) noexcept
-   : index(0), size(16)
+   : index(0), size(16), hashcache(0), hashvalid(false)
+{
+   buffer = local;
+   moveFrom(other);
+}
+
+//
+// CALICO: Take over the contents of another qstring, leaving it empty. This
+// qstring must be localized already.
+//
+void qstring::moveFrom(qstring &other)
 {
    // When other is not localized, take direct ownership of its buffer
    if(!other.isLocal())
@@ -146,7 +156,6 @@ qstring::qstring(qstring &&other) noexcept
 
       // leave the other object in a usable state, it's not necessarily dead.
       other.buffer = nullptr;
-      other.freeBuffer(); // returns to being localized
    }
    else
    {
@@ -154,7 +163,13 @@ qstring::qstring(qstring &&other) noexcept
       std::memcpy(local, other.local, sizeof(local));
       buffer = local;
       index  = other.index;
+      size   = basesize;
    }
+
+   hashcache = other.hashcache;
+   hashvalid = other.hashvalid;
+
+   other.freeBuffer(); // returns to being localized
 }
 
 //=============================================================================
@@ -180,6 +195,7 @@ char qstring::charAt(size_t idx) const
 //
 char *qstring::bufferAt(size_t idx)
 {
+   dirty();
    return idx < size ? buffer + idx : NULL;
 }
 
@@ -191,6 +207,7 @@ char &qstring::operator [] (size_t idx)
    if(idx >= size)
       hal_platform.fatalError("qstring::operator []: index out of range");
 
+   dirty();
    return buffer[idx];
 }
 
@@ -219,6 +236,7 @@ qstring &qstring::clear()
 {
    std::memset(buffer, 0, size);
    index = 0;
+   dirty();
 
    return *this;
 }
@@ -273,6 +291,7 @@ qstring &qstring::push(char ch)
       grow(size);        // double buffer size
 
    buffer[index++] = ch;
+   dirty();
 
    return *this;
 }
@@ -294,6 +313,7 @@ qstring &qstring::pop()
    {
       index--;
       buffer[index] = '\0';
+      dirty();
    }
 
    return *this;
@@ -314,6 +334,7 @@ qstring &qstring::concat(const char *str)
    std::strcat(buffer, str);
 
    index = std::strlen(buffer);
+   dirty();
 
    return *this;
 }
@@ -369,6 +390,7 @@ qstring &qstring::insert(const char *insertstr, size_t pos)
    std::memmove(insertpoint, insertstr, insertstrlen);
 
    index = std::strlen(buffer);
+   dirty();
 
    return *this;
 }
@@ -401,6 +423,7 @@ qstring &qstring::copy(const char *str, size_t count)
    std::strncpy(buffer, str, count);
 
    index = std::strlen(buffer);
+   dirty();
 
    return *this;
 }
@@ -456,25 +479,14 @@ qstring &qstring::copyInto(qstring &dest) const
 //
 void qstring::swapWith(qstring &str2)
 {
-   char   *tmpbuffer;
-   size_t tmpsize;
-   size_t tmpindex;
-
-   // Both must be unlocalized.
-   unLocalize(size);
-   str2.unLocalize(str2.size);
-
-   tmpbuffer = this->buffer; // make a shallow copy
-   tmpsize   = this->size;
-   tmpindex  = this->index;
-
-   this->buffer = str2.buffer;
-   this->size   = str2.size;
-   this->index  = str2.index;
+   if(this == &str2)
+      return;
 
-   str2.buffer = tmpbuffer;
-   str2.size   = tmpsize;
-   str2.index  = tmpindex;
+   // CALICO: move through a temporary rather than unlocalizing both, so that
+   // short strings stay in their local buffers
+   qstring tmp(std::move(str2));
+   str2.moveFrom(*this);
+   moveFrom(tmp);
 }
 
 //
@@ -497,6 +509,7 @@ qstring &qstring::lstrip(char c)
          std::memmove(buffer, buffer + i, len);
          std::memset(buffer + len, 0, size - len);
          index -= i;
+         dirty();
       }
    }
 
@@ -525,6 +538,7 @@ qstring &qstring::truncate(size_t pos)
 
    std::memset(buffer + pos, 0, index - pos);
    index = pos;
+   dirty();
 
    return *this;
 }
@@ -561,6 +575,7 @@ qstring &qstring::erase(size_t pos, size_t n)
    }
 
    index -= (endPos - pos);
+   dirty();
    return *this;
 }
 
@@ -726,10 +741,17 @@ unsigned int qstring::HashCodeCaseStatic(const char *str)
 //
 // Calls the standard D_HashTableKey that is used for the vast majority of
 // string hash code computations in Eternity.
+// CALICO: The result is kept until the qstring is next modified.
 //
 unsigned int qstring::hashCode() const
 {
-   return HashCodeStatic(buffer);
+   if(!hashvalid)
+   {
+      hashcache = HashCodeStatic(buffer);
+      hashvalid = true;
+   }
+
+   return hashcache;
 }
 
 //
@@ -929,6 +951,7 @@ char *qstring::duplicate() const
 qstring &qstring::toLower()
 {
    M_Strlwr(buffer);
+   dirty();
    return *this;
 }
 
@@ -940,6 +963,7 @@ qstring &qstring::toLower()
 qstring &qstring::toUpper()
 {
    M_Strupr(buffer);
+   dirty();
    return *this;
 }
 
@@ -1021,6 +1045,7 @@ qstring &qstring::normalizeSlashes()
 {
    M_NormalizeSlashes(buffer);
    index = std::strlen(buffer);
+   dirty();
 
    return *this;
 }
@@ -1240,6 +1265,7 @@ int qstring::printf(size_t maxlen, const char *fmt, ...)
    va_end(va2);
 
    index = strlen(buffer);
+   dirty();
 
    return returnval;
 }
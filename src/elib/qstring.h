@@ -39,9 +39,15 @@ private:
    char   *buffer;
    size_t  index;
    size_t  size;
+
+   // CALICO: case-insensitive hash code, valid until the contents may change
+   mutable unsigned int hashcache;
+   mutable bool         hashvalid;
    
    bool isLocal() const { return (buffer == local); }
    void unLocalize(size_t pSize);
+   void moveFrom(qstring &other);
+   void dirty() { hashvalid = false; }
 
 public:
    static const size_t npos;
@@ -49,7 +55,7 @@ public:
 
    // Constructors / Destructor
    qstring(size_t startSize = 0) 
-      : index(0), size(16)
+      : index(0), size(16), hashcache(0), hashvalid(false)
    {
       buffer = local;
       std::memset(local, 0, sizeof(local));
@@ -58,7 +64,7 @@ public:
    }
 
    qstring(const qstring &other) 
-      : index(0), size(16)
+      : index(0), size(16), hashcache(0), hashvalid(false)
    {
       buffer = local;
       std::memset(local, 0, sizeof(local));
@@ -66,7 +72,7 @@ public:
    }
 
    explicit qstring(const char *cstr)
-      : index(0), size(16)
+      : index(0), size(16), hashcache(0), hashvalid(false)
    {
       buffer = local;
       std::memset(local, 0, sizeof(local));
@@ -84,9 +90,10 @@ public:
    //
    // Retrieves a pointer to the internal buffer. This pointer shouldn't be 
    // cached, and is not meant for writing into (although it is safe to do so, it
-   // circumvents the encapsulation and security of this structure).
+   // circumvents the encapsulation and security of this structure). Anything
+   // written must be written before the qstring is next hashed.
    //
-   char *getBuffer() { return buffer; }
+   char *getBuffer() { dirty(); return buffer; }
 
    //
    // qstring::constPtr
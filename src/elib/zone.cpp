@@ -28,33 +28,40 @@
 
 #include "elib.h"
 #include "../hal/hal_platform.h"
+#include "../m_alloc.h"
 
 void *E_Malloc(size_t size)
 {
+   unsigned int start = M_AllocBegin();
    void *ret;
 
    if(!(ret = std::malloc(size)))
       hal_platform.fatalError("E_Malloc: failed on allocation of %lu bytes", size);
+   M_AllocEnd(ALLOC_ELIB, size, start);
 
    return ret;
 }
 
 void *E_Calloc(size_t count, size_t size)
 {
+   unsigned int start = M_AllocBegin();
    void *ret;
 
    if(!(ret = std::calloc(count, size)))
       hal_platform.fatalError("E_Calloc: failed on allocation of %lu bytes", count*size);
+   M_AllocEnd(ALLOC_ELIB, count * size, start);
 
    return ret;
 }
 
 void *E_Realloc(void *ptr, size_t size)
 {
+   unsigned int start = M_AllocBegin();
    void *ret;
 
    if(!(ret = std::realloc(ptr, size)))
       hal_platform.fatalError("E_Realloc: failed on allocation of %lu bytes", size);
+   M_AllocEnd(ALLOC_ELIB, size, start);
 
    return ret;
 }
@@ -71,10 +78,14 @@ char *E_Strdup(const char *str)
 
 void E_Free(void *ptr)
 {
+   unsigned int start;
+
    if(!ptr)
       hal_platform.fatalError("E_Free: attempt to free null pointer");
 
+   start = M_AllocBegin();
    std::free(ptr);
+   M_FreeEnd(ALLOC_ELIB, start);
 }
 
 // EOF
@@ -1,9 +1,12 @@
 /* f_main.c -- finale */
 
+#include <stdio.h>
+#include <string.h>
 #include "hal/hal_input.h"
 #include "gl/gl_render.h"
 #include "doomdef.h"
 #include "jagcry.h"
+#include "m_text.h"
 #include "r_local.h"
 
 extern int mystrlen(const char *string);
@@ -14,6 +17,9 @@ extern int mystrlen(const char *string);
 = BufferedDrawSprite
 =
 = Cache and draw a game sprite to the 8 bit buffered screen
+= CALICO: each lump and flip is decoded once into a texture resource, so a
+= cast frame is a single draw command rather than a lump read and per-pixel
+= framebuffer writes every frame.
 ==================
 */
 
@@ -23,10 +29,12 @@ void BufferedDrawSprite(int sprite, int frame, int rotation)
    spriteframe_t *sprframe;
    patch_t       *patch;
    patch_t        tpatch;    // CALICO
-   uint32_t      *fb, *dest; // CALICO
+   uint32_t      *store;     // CALICO
+   void          *rez;       // CALICO
+   char           name[16];  // CALICO
    byte          *pixels, *src, pix;
    int            count;
-   int            x, sprleft, sprtop;
+   int            x, y, sprleft, sprtop;
    column_t      *column;
    int            lump;
    boolean        flip;
@@ -44,10 +52,6 @@ void BufferedDrawSprite(int sprite, int frame, int rotation)
    flip = (boolean)sprframe->flip[rotation];
 
    patch = (patch_t *)W_POINTLUMPNUM(lump);
-   pixels = Z_Malloc(BIGLONG(lumpinfo[lump+1].size), PU_STATIC, NULL); // CALICO: endianness
-   W_ReadLump(lump + 1, pixels);
-
-   S_UpdateSounds();
 
    //
    // coordinates are in a 160*112 screen (doubled pixels)
@@ -64,44 +68,54 @@ void BufferedDrawSprite(int sprite, int frame, int rotation)
    sprtop  -= tpatch.topoffset;
    sprleft -= tpatch.leftoffset;
 
-   // CALICO: get framebuffer dest
-   fb = GL_GetFramebuffer(FB_320);
-   GL_FramebufferSetUpdated(FB_320);
-
-   //
-   // draw it by hand
-   //
-   for(x = 0; x < tpatch.width; x++)
+   // CALICO: create or retrieve a texture resource for this lump and flip
+   sprintf(name, "cast%i%s", lump, flip ? "f" : "");
+   if(!(rez = GL_CheckForTextureResource(name)))
    {
-      if(flip)
-         texturecolumn = tpatch.width - 1 - x;
-      else
-         texturecolumn = x;
+      if(!(rez = GL_NewTextureResource(name, NULL, tpatch.width, tpatch.height, RES_FRAMEBUFFER, 0)))
+         return;
+
+      GL_TextureResourceSetUpdated(rez);
+      store = GL_GetTextureResourceStore(rez); // starts out transparent
 
-      column = (column_t *)((byte *)patch + BIGSHORT(patch->columnofs[texturecolumn]));
+      pixels = Z_Malloc(BIGLONG(lumpinfo[lump+1].size), PU_STATIC, NULL); // CALICO: endianness
+      W_ReadLump(lump + 1, pixels);
 
       //
-      // draw a masked column
+      // draw it by hand
       //
-      for(; column->topdelta != 0xff; column++)
+      for(x = 0; x < tpatch.width; x++)
       {
-         // calculate unclipped screen coordinates for post
-         // CALICO: draw to framebuffer
-         dest  = fb + (sprtop + column->topdelta) * 640 + (sprleft + x) * 2;
-         count = column->length;
-         src   = pixels + BIGSHORT(column->dataofs); // CALICO: endianness
-         while(count--)
+         if(flip)
+            texturecolumn = tpatch.width - 1 - x;
+         else
+            texturecolumn = x;
+
+         column = (column_t *)((byte *)patch + BIGSHORT(patch->columnofs[texturecolumn]));
+
+         //
+         // draw a masked column
+         //
+         for(; column->topdelta != 0xff; column++)
          {
-            pix = *src++;
-            if(!pix)
-               pix = 8;
-            dest[0] = dest[1] = dest[320] = dest[321] = CRYToRGB[palette8[pix]];
-            dest += 640;
+            y     = column->topdelta;
+            count = column->length;
+            src   = pixels + BIGSHORT(column->dataofs); // CALICO: endianness
+            while(count-- && y < tpatch.height)
+            {
+               pix = *src++;
+               if(!pix)
+                  pix = 8;
+               store[y * tpatch.width + x] = CRYToRGB[palette8[pix]];
+               ++y;
+            }
          }
       }
+
+      Z_Free(pixels);
    }
-   
-   Z_Free(pixels);
+
+   GL_AddLateDrawCommand(rez, sprleft * 2, sprtop * 2, tpatch.width * 2, tpatch.height * 2);
 }
 
 
@@ -184,54 +198,60 @@ char	endtextstring[] =
    "*"
    "  congratulations!";
 
+// CALICO: cached layouts of the end text and the cast member's name
+static textcache_t endtext, casttext;
+
 //===============================================
 //
 // Print a string in big font - LOWERCASE INPUT ONLY!
+// CALICO: laid out into a text cache, only when the string has changed
 //
 //===============================================
-void F_PrintString(const char *string)
+void F_PrintString(textcache_t *tc, const char *string)
 {
    int index;
    int val;
 
-   index = 0;
-   while(1)
+   if(M_TextChanged(tc, string, text_x, text_y))
    {
-      switch(string[index])
+      for(index = 0; string[index]; index++)
       {
-      case 0: return;
-      case ' ':
-         text_x += SPACEWIDTH;
-         val = 30;
-         break;
-      case '.':
-         val = 26;
-         break;
-      case '!':
-         val = 27;
-         break;
-      case '*':
-         val = 30;
-         text_x = STARTX;
-         text_y += BIGSHORT(endobj[0]->height) + 4; // CALICO: endianness
-         break;
-      default:
-         val = string[index] - 'a';
-         break;
-      }
-
-      if(val < NUMENDOBJ)
-      {
-         DrawJagobj(endobj[val], text_x, text_y, NULL);
-         text_x += BIGSHORT(endobj[val]->width);
-         if(text_x > 316)
+         switch(string[index])
          {
+         case ' ':
+            text_x += SPACEWIDTH;
+            val = 30;
+            break;
+         case '.':
+            val = 26;
+            break;
+         case '!':
+            val = 27;
+            break;
+         case '*':
+            val = 30;
             text_x = STARTX;
-            text_y += BIGSHORT(endobj[val]->height) + 4;
+            text_y += BIGSHORT(endobj[0]->height) + 4; // CALICO: endianness
+            break;
+         default:
+            val = string[index] - 'a';
+            break;
+         }
+
+         if(val < NUMENDOBJ)
+         {
+            M_AddTextGlyph(endobj[val], text_x, text_y);
+            text_x += BIGSHORT(endobj[val]->width);
+            if(text_x > 316)
+            {
+               text_x = STARTX;
+               text_y += BIGSHORT(endobj[val]->height) + 4;
+            }
          }
       }
-      index++;
    }
+
+   M_DrawText(tc);
 }
 
 //===============================================
@@ -256,7 +276,7 @@ void F_CastPrint(const char *string)
 
    text_x = 160 - (width >> 1);
    text_y = 20;
-   F_PrintString(string);
+   F_PrintString(&casttext, string);
 }
 
 /*
@@ -477,17 +497,22 @@ void F_Drawer(void)
    switch(status)
    {
    case fin_endtext:
+      // CALICO: the text printed so far is drawn again every frame from its
+      // cached layout, which is redone only when another character is added
       if(!--textdelay)
       {
-         char str[2];
-
-         str[1] = 0;
-         str[0] = endtextstring[textindex];
-         if(!str[0])
-            return;
-         F_PrintString(str);
+         if(endtextstring[textindex])
+            textindex++;
          textdelay = TEXTTIME;
-         textindex++;
+      }
+      {
+         char str[sizeof(endtextstring)];
+
+         memcpy(str, endtextstring, textindex);
+         str[textindex] = 0;
+         text_x = STARTX;
+         text_y = STARTY;
+         F_PrintString(&endtext, str);
       }
       break;
    case fin_charcast:
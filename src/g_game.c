@@ -1,7 +1,17 @@
 /* G_game.c  */
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "elib/atexit.h"
 #include "hal/hal_input.h"
+#include "hal/hal_ml.h"
+#include "hal/hal_timer.h"
+#include "hal/hal_video.h"
 #include "doomdef.h" 
+#include "m_alloc.h"
+#include "m_argv.h"
+#include "m_prof.h"
 #include "p_local.h" 
  
 void G_PlayerReborn(int player); 
@@ -24,6 +34,10 @@ int          totalkills, totalitems, totalsecret; // for intermission
 char         demoname[32]; 
 boolean      demorecording; 
 boolean      demoplayback; 
+boolean      timedemo;      // CALICO: play the demo as fast as possible
+boolean      nodrawing;     // CALICO: a timedemo skips drawing with -nodraw
+boolean      demoseeking;   // CALICO: running unseen up to demoseektic
+int          demoseektic;   // CALICO: -seek
  
 /* 
 ============== 
@@ -404,6 +418,8 @@ void G_RunGame(void)
       }
 
       // run a stats intermission
+      // CALICO: while the next map's graphics stream in
+      P_PreloadLevel(nextmap);
       MiniLoop(IN_Start, IN_Stop, IN_Ticker, IN_Drawer);
 
       // run the finale if needed
@@ -435,10 +451,509 @@ int G_PlayDemoPtr(int *demo)
    demoplayback = true;
    exit = MiniLoop(P_Start, P_Stop, P_Ticker, P_Drawer);
    demoplayback = false;
+   P_EndStateHash(); // CALICO
 
    return exit;
 }
 
+//=============================================================================
+//
+// CALICO: -timedemo
+//
+
+static unsigned int *frametimes; // microseconds
+static int           numframes, maxframes;
+static unsigned int  lastframetime;
+static unsigned int  synccheck;  // running hash of where the players have been
+
+//
+// Fold the state of the players into the sync check, so that two runs of a
+// demo can be compared by a single number
+//
+static void G_UpdateSyncCheck(void)
+{
+   int i;
+
+   for(i = 0; i < MAXPLAYERS; i++)
+   {
+      player_t *pl = &players[i];
+      unsigned int v[6];
+      int j;
+
+      if(!playeringame[i] || !pl->mo)
+         continue;
+
+      v[0] = pl->mo->x;
+      v[1] = pl->mo->y;
+      v[2] = pl->mo->z;
+      v[3] = pl->mo->angle;
+      v[4] = pl->mo->health;
+      v[5] = pl->killcount;
+
+      for(j = 0; j < 6; j++)
+         synccheck = (synccheck ^ v[j]) * 16777619u; // FNV-1a, a word at a time
+   }
+}
+
+//
+// Record the time since the last frame of a timedemo. Called by MiniLoop
+// after every tic has been drawn.
+//
+void G_TimeDemoFrame(void)
+{
+   unsigned int now = hal_timer.getTimeUS();
+
+   G_UpdateSyncCheck();
+
+   if(lastframetime)
+   {
+      if(numframes == maxframes)
+      {
+         maxframes = maxframes ? maxframes * 2 : 4096;
+         if(!(frametimes = realloc(frametimes, maxframes * sizeof(*frametimes))))
+            I_Error("G_TimeDemoFrame: no memory for %i frames", maxframes);
+      }
+      frametimes[numframes++] = now - lastframetime;
+   }
+
+   lastframetime = now;
+}
+
+static int G_CompareFrameTimes(const void *a, const void *b)
+{
+   unsigned int ta = *(const unsigned int *)a, tb = *(const unsigned int *)b;
+
+   return (ta > tb) - (ta < tb);
+}
+
+#define G_Percentile(p) (frametimes[(numframes - 1) * (p) / 100] / 1000.0)
+
+//
+// Load a demo from a lump or, failing that, a file. Files may be as long as
+// they like, so they are kept out of the zone, and are given a final
+// command which stops playback in case their end wasn't recorded.
+//
+static void   *loadeddemo;     // CALICO: block to free when done with it
+static boolean loadedfromlump;
+
+static int *G_LoadDemo(const char *name)
+{
+   FILE *f;
+   long  len;
+   int  *demo;
+   int   lump;
+
+   if((lump = W_CheckNumForName(name)) != -1)
+   {
+      loadedfromlump = true;
+      return loadeddemo = W_CacheLumpNum(lump, PU_STATIC);
+   }
+
+   if(!(f = fopen(name, "rb")))
+      I_Error("G_LoadDemo: can't find %s", name);
+
+   fseek(f, 0, SEEK_END);
+   len = ftell(f) & ~3;
+   fseek(f, 0, SEEK_SET);
+
+   if(len < 2 * (long)sizeof(int))
+      I_Error("G_LoadDemo: %s is not a demo", name);
+
+   if(!(demo = malloc(len + sizeof(int))))
+      I_Error("G_LoadDemo: no memory for %s", name);
+   if(fread(demo, 1, len, f) != (size_t)len)
+      I_Error("G_LoadDemo: error reading %s", name);
+   fclose(f);
+   loadedfromlump = false;
+   loadeddemo     = demo;
+
+   demo[len / sizeof(int)] = BIGLONG(BT_PAUSE);
+
+   // files written by G_RecordDemo start with a header
+   if(BIGLONG(demo[0]) == DEMOMAGIC)
+   {
+      if(len < 4 * (long)sizeof(int) || BIGLONG(demo[1]) != DEMOVERSION)
+         I_Error("G_LoadDemo: %s is version %i, not %i", name, BIGLONG(demo[1]), DEMOVERSION);
+      demo += 2; // skill, map, and commands follow, as in a lump
+   }
+
+   return demo;
+}
+
+//
+// CALICO: Free the demo G_LoadDemo last loaded
+//
+static void G_FreeDemo(void)
+{
+   if(loadedfromlump)
+      Z_Free(loadeddemo);
+   else
+      free(loadeddemo);
+   loadeddemo = NULL;
+}
+
+//
+// Play a demo without waiting for the timer, print how long it took, and
+// exit. The render phase and playsim stage breakdown comes from the
+// profiler, and covers the last frames it keeps. The sync check is the same
+// for every run of a demo which plays out the same way, with or without
+// -nodraw or -headless.
+//
+void G_TimeDemo(const char *name)
+{
+   int         *demo;
+   unsigned int start;
+   double       seconds;
+
+   if(!hal_timer.getTimeUS)
+      I_Error("G_TimeDemo: no microsecond timer");
+
+   demo = G_LoadDemo(name);
+   synccheck = 2166136261u;
+
+   M_ProfEnable();
+   nodrawing = M_FindArgument("-nodraw");
+   if(hal_video.toggleGLSwap)
+      hal_video.toggleGLSwap(HAL_FALSE); // don't wait for the display either
+
+   timedemo = true;
+   start    = hal_timer.getTimeUS();
+   G_PlayDemoPtr(demo);
+   seconds  = (hal_timer.getTimeUS() - start) / 1000000.0;
+   timedemo = nodrawing = false;
+
+   // G_InitNew starts gametic over from 0
+   printf("timedemo %s: %i tics in %.3f seconds, %.1f fps\n", name, gametic,
+          seconds, seconds > 0 ? gametic / seconds : 0.0);
+   printf("sync check: %08x\n", synccheck);
+
+   if(numframes)
+   {
+      double total = 0;
+      int    i;
+
+      qsort(frametimes, numframes, sizeof(*frametimes), G_CompareFrameTimes);
+      for(i = 0; i < numframes; i++)
+         total += frametimes[i];
+
+      printf("frame ms: min %.2f, avg %.2f, p50 %.2f, p90 %.2f, p99 %.2f, max %.2f\n",
+             frametimes[0] / 1000.0, total / numframes / 1000.0, G_Percentile(50),
+             G_Percentile(90), G_Percentile(99), frametimes[numframes - 1] / 1000.0);
+   }
+
+   M_ProfPrint();
+   fflush(stdout);
+
+   // CALICO: -zeroalloc fails a demo which still allocates once it's going
+   if(M_AllocSteadyFailures())
+      I_Error("G_TimeDemo: %i frames allocated memory", M_AllocSteadyFailures());
+
+   hal_medialayer.exit();
+}
+
+//
+// CALICO: -verifydemos <demo> [<demo> ...] plays each demo in turn, unseen
+// and as fast as it can, all in the one process so that the IWAD is loaded
+// and decoded only once for the whole set. A demo with a <demo>.hash file
+// beside it is checked against it tic by tic; one without has the file
+// written, as the baseline for later runs. A corpus can be shared out
+// between several processes, one per core. Exits with an error if any
+// demo played out differently.
+//
+void G_VerifyDemos(int first)
+{
+   int   i, count, failed;
+   char *hashname;
+   FILE *f;
+
+   timedemo = nodrawing = true;
+   if(hal_video.toggleGLSwap)
+      hal_video.toggleGLSwap(HAL_FALSE);
+
+   count = failed = 0;
+   for(i = first; i < myargc && myargv[i][0] != '-'; i++)
+   {
+      const char *name = myargv[i];
+      const char *result;
+      boolean     checking;
+      int        *demo;
+
+      if(!(hashname = malloc(strlen(name) + 6)))
+         I_Error("G_VerifyDemos: no memory for file name");
+      sprintf(hashname, "%s.hash", name);
+
+      if((checking = ((f = fopen(hashname, "rb")) != NULL)))
+         fclose(f);
+      P_OpenStateHash(checking ? NULL : hashname, checking ? hashname : NULL);
+
+      demo      = G_LoadDemo(name);
+      synccheck = 2166136261u;
+      G_PlayDemoPtr(demo);
+      G_FreeDemo();
+
+      if(!checking)
+         result = "baseline written";
+      else if(P_StateHashDiverged())
+      {
+         result = "DIFFERS";
+         ++failed;
+      }
+      else
+         result = "matches";
+
+      printf("verifydemos %s: %i tics, sync check %08x, %s\n", name, gametic, synccheck, result);
+      fflush(stdout);
+      free(hashname);
+      ++count;
+   }
+
+   timedemo = nodrawing = false;
+
+   if(failed)
+      I_Error("G_VerifyDemos: %i of %i demos differ", failed, count);
+   printf("verifydemos: %i demos\n", count);
+   fflush(stdout);
+
+   hal_medialayer.exit();
+}
+
+//
+// CALICO: -perfdemos <baseline> [<demo> ...] times DEMO1, DEMO2, and then
+// each demo named, and checks them against a baseline of earlier runs. The
+// frame time percentiles and the average of each render phase and playsim
+// stage are kept for every demo, at the render scale it was drawn at, so one
+// baseline can hold the results of runs with different -renderscale values.
+// A result more than -perfthreshold percent (10 by default) and PERFMINMS
+// slower than its baseline is a regression, and makes the run exit with an
+// error. Results missing from the baseline are added to it; -perfupdate
+// replaces the ones already there.
+//
+#define PERFMINMS 0.05 // differences smaller than this are noise
+
+typedef struct perfresult_s
+{
+   char   demo[64];
+   char   metric[16];
+   int    shift;   // rendershift the demo was drawn at
+   double value;   // milliseconds
+} perfresult_t;
+
+typedef struct perflist_s
+{
+   perfresult_t *results;
+   int           num, max;
+} perflist_t;
+
+static perfresult_t *G_FindPerfResult(perflist_t *list, const perfresult_t *r)
+{
+   int i;
+
+   for(i = 0; i < list->num; i++)
+   {
+      perfresult_t *l = &list->results[i];
+
+      if(l->shift == r->shift && !strcmp(l->demo, r->demo) && !strcmp(l->metric, r->metric))
+         return l;
+   }
+
+   return NULL;
+}
+
+static perfresult_t *G_AddPerfResult(perflist_t *list)
+{
+   if(list->num == list->max)
+   {
+      list->max = list->max ? list->max * 2 : 256;
+      if(!(list->results = realloc(list->results, list->max * sizeof(*list->results))))
+         I_Error("G_AddPerfResult: no memory for %i results", list->max);
+   }
+
+   return memset(&list->results[list->num++], 0, sizeof(perfresult_t));
+}
+
+static void G_AddPerfValue(perflist_t *list, const char *demo, const char *metric, double value)
+{
+   perfresult_t *r = G_AddPerfResult(list);
+
+   strncpy(r->demo, demo, sizeof(r->demo) - 1);
+   strncpy(r->metric, metric, sizeof(r->metric) - 1);
+   r->shift = rendershift;
+   r->value = value;
+}
+
+//
+// Read a baseline of "<demo> <shift> <metric> <ms>" lines, if there is one
+//
+static void G_ReadPerfBaseline(perflist_t *list, const char *name)
+{
+   perfresult_t r;
+   FILE *f;
+
+   if(!(f = fopen(name, "r")))
+      return;
+
+   memset(&r, 0, sizeof(r));
+   while(fscanf(f, "%63s %d %15s %lf", r.demo, &r.shift, r.metric, &r.value) == 4)
+      *G_AddPerfResult(list) = r;
+
+   fclose(f);
+}
+
+static void G_WritePerfBaseline(const perflist_t *list, const char *name)
+{
+   FILE *f;
+   int   i;
+
+   if(!(f = fopen(name, "w")))
+      I_Error("G_WritePerfBaseline: can't write %s", name);
+
+   for(i = 0; i < list->num; i++)
+   {
+      const perfresult_t *r = &list->results[i];
+      fprintf(f, "%s %d %s %.4f\n", r->demo, r->shift, r->metric, r->value);
+   }
+
+   fclose(f);
+}
+
+//
+// Time one demo, adding its results to the list
+//
+static void G_PerfDemo(perflist_t *list, const char *name)
+{
+   static const profcounter_t phases[] =
+   {
+      PROF_FRAME, PROF_BSP, PROF_WALLPREP, PROF_SPRITEPREP, PROF_LATEPREP,
+      PROF_CACHE, PROF_SEGCOMMANDS, PROF_DRAWPLANES, PROF_SPRITES, PROF_UPDATE,
+      PROF_TIC, PROF_PLAYERS, PROF_THINKERS, PROF_SIGHTS, PROF_MOBJBASE,
+      PROF_MOBJLATE, PROF_SPECIALS
+   };
+   int *demo;
+   int  i;
+
+   numframes = lastframetime = 0;
+   M_ProfReset();
+
+   demo      = G_LoadDemo(name);
+   synccheck = 2166136261u;
+   G_PlayDemoPtr(demo);
+   G_FreeDemo();
+
+   if(!numframes)
+      I_Error("G_PerfDemo: %s drew no frames", name);
+
+   qsort(frametimes, numframes, sizeof(*frametimes), G_CompareFrameTimes);
+   G_AddPerfValue(list, name, "p50", G_Percentile(50));
+   G_AddPerfValue(list, name, "p90", G_Percentile(90));
+   G_AddPerfValue(list, name, "p99", G_Percentile(99));
+
+   for(i = 0; i < (int)(sizeof(phases) / sizeof(*phases)); i++)
+      G_AddPerfValue(list, name, M_ProfName(phases[i]), M_ProfAverage(phases[i]) / 1000.0);
+
+   printf("perfdemos %s: %i tics, %i frames at %ix, p50 %.2f, p90 %.2f, p99 %.2f ms\n",
+          name, gametic, numframes, 1 << rendershift, G_Percentile(50), G_Percentile(90),
+          G_Percentile(99));
+   fflush(stdout);
+}
+
+void G_PerfDemos(int first)
+{
+   static const char *lumps[] = { "DEMO1", "DEMO2" };
+   perflist_t  baseline, current;
+   const char *basename = myargv[first];
+   double      threshold = 10.0;
+   boolean     update, changed;
+   int         i, p, regressed;
+
+   if(!hal_timer.getTimeUS)
+      I_Error("G_PerfDemos: no microsecond timer");
+
+   if((p = M_GetArgParameters("-perfthreshold", 1)))
+      threshold = atof(myargv[p]);
+   update = M_FindArgument("-perfupdate");
+
+   memset(&baseline, 0, sizeof(baseline));
+   memset(&current,  0, sizeof(current));
+   G_ReadPerfBaseline(&baseline, basename);
+
+   M_ProfEnable();
+   if(hal_video.toggleGLSwap)
+      hal_video.toggleGLSwap(HAL_FALSE);
+
+   timedemo = true;
+   for(i = 0; i < (int)(sizeof(lumps) / sizeof(*lumps)); i++)
+   {
+      if(W_CheckNumForName(lumps[i]) != -1)
+         G_PerfDemo(&current, lumps[i]);
+   }
+   for(i = first + 1; i < myargc && myargv[i][0] != '-'; i++)
+      G_PerfDemo(&current, myargv[i]);
+   timedemo = false;
+
+   regressed = 0;
+   changed   = false;
+   for(i = 0; i < current.num; i++)
+   {
+      const perfresult_t *r = &current.results[i];
+      perfresult_t       *b = G_FindPerfResult(&baseline, r);
+
+      if(!b)
+      {
+         *G_AddPerfResult(&baseline) = *r;
+         changed = true;
+         continue;
+      }
+
+      if(r->value > b->value * (1.0 + threshold / 100.0) && r->value - b->value > PERFMINMS)
+      {
+         printf("perfdemos %s at %ix: %s %.2f ms, baseline %.2f ms, REGRESSED\n",
+                r->demo, 1 << r->shift, r->metric, r->value, b->value);
+         ++regressed;
+      }
+
+      if(update)
+      {
+         b->value = r->value;
+         changed  = true;
+      }
+   }
+
+   if(changed)
+      G_WritePerfBaseline(&baseline, basename);
+
+   free(baseline.results);
+   free(current.results);
+
+   if(regressed)
+      I_Error("G_PerfDemos: %i results regressed by more than %g%%", regressed, threshold);
+   printf("perfdemos: %i results within %g%% of %s\n", current.num, threshold, basename);
+   fflush(stdout);
+
+   hal_medialayer.exit();
+}
+
+//
+// CALICO: Play a demo from a lump or file in real time, then go back to the
+// title loop. With -seek <tic>, the tics before that one are run as fast as
+// they can be, without drawing or sound, so that a point late in a long demo
+// can be watched without sitting through everything before it.
+//
+void G_PlayDemo(const char *name)
+{
+   int *demo;
+   int  p;
+
+   demo = G_LoadDemo(name);
+
+   if((p = M_GetArgParameters("-seek", 1)))
+      demoseektic = atoi(myargv[p]);
+
+   G_PlayDemoPtr(demo);
+   G_FreeDemo();
+   demoseektic = 0;
+   demoseeking = false;
+}
+
 /*
 =================
 =
@@ -447,29 +962,78 @@ int G_PlayDemoPtr(int *demo)
 =================
 */
 
-// CALICO_FIXME: go to file
-void G_RecordDemo(void)
+// CALICO: recorded commands go straight out to a file rather than into a
+// buffer in the zone, so there is no limit to how long a demo can be
+static FILE *demofile;
+static char  demofilebuf[0x10000];
+
+//
+// CALICO: Write one tic's buttons to the demo being recorded
+//
+void G_WriteDemoCmd(unsigned int buttons)
+{
+   int cmd = BIGLONG(buttons);
+
+   if(demofile && fwrite(&cmd, sizeof(cmd), 1, demofile) != 1)
+   {
+      fclose(demofile); // don't try to finish it on the way out
+      demofile = NULL;
+      I_Error("G_WriteDemoCmd: error writing demo");
+   }
+}
+
+//
+// CALICO: Finish the demo file. The closing command is a pause, which is
+// what ends playback.
+//
+static void G_StopRecording(void)
+{
+   if(!demofile)
+      return;
+
+   G_WriteDemoCmd(BT_PAUSE);
+   fclose(demofile);
+   demofile = NULL;
+}
+
+//
+// CALICO: Record a demo of one level to a file, headed by DEMOMAGIC and
+// DEMOVERSION, then go back to the title loop
+//
+void G_RecordDemo(const char *filename)
 {
+   static boolean atexitset;
+   int header[4];
+
+   if(!(demofile = fopen(filename, "wb")))
+      I_Error("G_RecordDemo: can't write %s", filename);
+   setvbuf(demofile, demofilebuf, _IOFBF, sizeof(demofilebuf));
+
+   // still finish the file if the game is quit while recording
+   if(!atexitset)
+   {
+      E_AtExit(G_StopRecording, true);
+      atexitset = true;
+   }
+
    hal_appstate.setGrabState(HAL_TRUE); // CALICO: grab input
-   demo_p = demobuffer = Z_Malloc(0x8000, PU_STATIC, NULL);
 
    // CALICO: these must be corrected for endianness (dst format is big-endian)
-   *demo_p++ = BIGLONG(startskill);
-   *demo_p++ = BIGLONG(startmap);
+   header[0] = BIGLONG(DEMOMAGIC);
+   header[1] = BIGLONG(DEMOVERSION);
+   header[2] = BIGLONG(startskill);
+   header[3] = BIGLONG(startmap);
+   if(fwrite(header, sizeof(header), 1, demofile) != 1)
+      I_Error("G_RecordDemo: error writing %s", filename);
 
    G_InitNew(startskill, startmap, gt_single);
    G_DoLoadLevel();  
    demorecording = true; 
    MiniLoop(P_Start, P_Stop, P_Ticker, P_Drawer);
    demorecording = false;
+   P_EndStateHash(); // CALICO
 
-   D_printf("w %x,%x", demobuffer, demo_p);
-
-   while(1)
-   {
-      G_PlayDemoPtr(demobuffer);
-      D_printf("w %x,%x", demobuffer, demo_p);
-   }
+   G_StopRecording();
 }
 
 // EOF
@@ -0,0 +1,293 @@
+/*
+  CALICO
+
+  Spectator broadcasts
+
+  With -broadcast, a game started from the menu streams each tic's buttons
+  for both players to any number of spectators over TCP, on the port given
+  by -specport (default 5030). With -spectate <host>, the game instead
+  connects to such a server and runs its own copy of the match from those
+  buttons, drawing it from player 0's view.
+
+  The stream starts with a header giving the skill, map and game type, as a
+  demo does, followed by one record per tic. The server keeps every record
+  since the match began, so a spectator who joins late is sent all of them
+  and runs through the backlog unseen and as fast as it can, as -seek does,
+  before watching live. The playsim has no way to serialize its state, so
+  this is what stands in for a snapshot.
+
+  The MIT License (MIT)
+
+  Copyright (c) 2016 James Haley
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hal/hal_ml.h"
+#include "hal/hal_net.h"
+#include "hal/hal_timer.h"
+#include "doomdef.h"
+#include "m_argv.h"
+
+#define SPECMAGIC   0x53504543 // "SPEC"
+#define SPECVERSION 1
+#define SPECPORT    5030
+
+#define SPECHEADER   20 // magic, version, skill, map, game type
+#define SPECTICBYTES 10 // buttons for each player, vblsinframe, flags
+
+#define SF_WARPED 1 // a net reconnect reloaded the level on this tic
+
+boolean spectating;
+
+static boolean broadcasting;
+static int     specport = SPECPORT;
+
+static byte *backlog;            // the server's records since the match began
+static int   backloglen, maxbacklog;
+static byte  specheader[SPECHEADER];
+
+static byte *specbuf;            // the spectator's records not yet run
+static int   specpos, speclen, maxspecbuf;
+
+static void G_SpecWriteLong(byte *p, int v)
+{
+   p[0] = (byte)(v >> 24);
+   p[1] = (byte)(v >> 16);
+   p[2] = (byte)(v >>  8);
+   p[3] = (byte)v;
+}
+
+static int G_SpecReadLong(const byte *p)
+{
+   return (int)(((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]);
+}
+
+static byte *G_GrowSpecBuffer(byte *buf, int *max, int count)
+{
+   if(count > *max)
+   {
+      int newmax = *max ? *max : 0x10000;
+
+      while(newmax < count)
+         newmax *= 2;
+      if(!(buf = realloc(buf, newmax)))
+         I_Error("G_GrowSpecBuffer: no memory for %i bytes", newmax);
+      *max = newmax;
+   }
+
+   return buf;
+}
+
+static int G_SpecPort(void)
+{
+   int p;
+
+   if((p = M_GetArgParameters("-specport", 1)))
+      return atoi(myargv[p]);
+   return SPECPORT;
+}
+
+//
+// Listen for spectators if -broadcast was given
+//
+void G_InitBroadcast(void)
+{
+   if(!M_FindArgument("-broadcast") || !hal_net.listenStream)
+      return;
+
+   specport = G_SpecPort();
+   if(!hal_net.listenStream(specport))
+      I_Error("G_InitBroadcast: can't listen on port %i", specport);
+   broadcasting = true;
+}
+
+//
+// A match is starting; spectators of any earlier one are dropped, and must
+// connect again to see this one
+//
+void G_StartBroadcast(void)
+{
+   if(!broadcasting)
+      return;
+
+   if(backloglen && !hal_net.listenStream(specport))
+      I_Error("G_StartBroadcast: can't listen on port %i", specport);
+
+   G_SpecWriteLong(specheader,      SPECMAGIC);
+   G_SpecWriteLong(specheader +  4, SPECVERSION);
+   G_SpecWriteLong(specheader +  8, gameskill);
+   G_SpecWriteLong(specheader + 12, gamemap);
+   G_SpecWriteLong(specheader + 16, netgame);
+   backloglen = 0;
+}
+
+//
+// Send this tic's buttons to every spectator, and catch up any who have
+// just connected
+//
+void G_BroadcastTic(void)
+{
+   byte *rec;
+   int   client;
+
+   if(!broadcasting)
+      return;
+
+   backlog = G_GrowSpecBuffer(backlog, &maxbacklog, backloglen + SPECTICBYTES);
+   rec = backlog + backloglen;
+   backloglen += SPECTICBYTES;
+
+   G_SpecWriteLong(rec,     ticbuttons[0]);
+   G_SpecWriteLong(rec + 4, ticbuttons[1]);
+   rec[8] = (byte)vblsinframe;
+   rec[9] = (gameaction == ga_warped) ? SF_WARPED : 0;
+
+   hal_net.sendStream(-1, rec, SPECTICBYTES);
+
+   while((client = hal_net.acceptStream()) >= 0)
+   {
+      if(hal_net.sendStream(client, specheader, SPECHEADER))
+         hal_net.sendStream(client, backlog, backloglen);
+   }
+}
+
+//
+// Read whatever the server has sent. Returns false if the stream has ended.
+//
+static boolean G_ReadSpectateStream(void)
+{
+   int len;
+
+   // keep what has not been run at the front of the buffer
+   if(specpos)
+   {
+      memmove(specbuf, specbuf + specpos, speclen - specpos);
+      speclen -= specpos;
+      specpos  = 0;
+   }
+
+   do
+   {
+      specbuf = G_GrowSpecBuffer(specbuf, &maxspecbuf, speclen + 0x1000);
+      len = hal_net.receiveStream(specbuf + speclen, maxspecbuf - speclen);
+      if(len < 0)
+         return false;
+      speclen += len;
+   }
+   while(len > 0);
+
+   return true;
+}
+
+static void G_SpectateEnded(void)
+{
+   printf("spectate: the broadcast has ended\n");
+   fflush(stdout);
+   hal_medialayer.exit();
+}
+
+//
+// True while the spectator has records waiting beyond the next one, and
+// should run tics without waiting for the timer or drawing them
+//
+boolean G_SpectateBehind(void)
+{
+   if(!spectating)
+      return false;
+
+   if(!G_ReadSpectateStream() && speclen - specpos < SPECTICBYTES)
+      G_SpectateEnded();
+
+   return speclen - specpos >= 2 * SPECTICBYTES;
+}
+
+void G_PlayerReborn(int player);
+
+//
+// Take both players' buttons for this tic from the broadcast, waiting for
+// them if need be
+//
+void G_SpectateTic(void)
+{
+   const byte *rec;
+
+   while(speclen - specpos < SPECTICBYTES)
+   {
+      if(!G_ReadSpectateStream())
+         G_SpectateEnded();
+      if(speclen - specpos < SPECTICBYTES)
+         hal_timer.delay(1);
+   }
+
+   rec = specbuf + specpos;
+   specpos += SPECTICBYTES;
+
+   ticbuttons[0] = G_SpecReadLong(rec);
+   ticbuttons[1] = G_SpecReadLong(rec + 4);
+   vblsinframe   = rec[8];
+
+   // do what I_NetTransfer did on the server when its link was lost
+   if(rec[9] & SF_WARPED)
+   {
+      G_PlayerReborn(0);
+      G_PlayerReborn(1);
+      gameaction = ga_warped;
+      oldticbuttons[0] = oldticbuttons[1] = 0;
+   }
+}
+
+//
+// Connect to a broadcast and watch it. Does not return.
+//
+void G_Spectate(const char *host)
+{
+   int port = G_SpecPort();
+   int magic, version;
+
+   if(!hal_net.connectStream || !hal_net.connectStream(host, port))
+      I_Error("G_Spectate: can't connect to %s on port %i", host, port);
+
+   while(speclen < SPECHEADER)
+   {
+      if(!G_ReadSpectateStream())
+         I_Error("G_Spectate: %s closed the connection", host);
+      hal_timer.delay(1);
+   }
+
+   magic   = G_SpecReadLong(specbuf);
+   version = G_SpecReadLong(specbuf + 4);
+   if(magic != SPECMAGIC)
+      I_Error("G_Spectate: %s is not a broadcast", host);
+   if(version != SPECVERSION)
+      I_Error("G_Spectate: broadcast is version %i, not %i", version, SPECVERSION);
+
+   G_InitNew(G_SpecReadLong(specbuf + 8), G_SpecReadLong(specbuf + 12), G_SpecReadLong(specbuf + 16));
+   specpos = SPECHEADER;
+
+   consoleplayer = 0;
+   spectating    = true;
+   G_RunGame();
+}
+
+// EOF
+
@@ -0,0 +1,247 @@
+/*
+  CALICO
+
+  OpenGL automap
+
+  The MIT License (MIT)
+
+  Copyright (C) 2016 James Haley
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <vector>
+
+#include "../elib/elib.h"
+#include "../elib/configfile.h"
+#include "../hal/hal_types.h"
+#include "../hal/hal_video.h"
+#include "../rb/rb_common.h"
+#include "../rb/rb_draw.h"
+#include "../rb/rb_main.h"
+#include "gl_automap.h"
+#include "gl_render.h"
+
+//
+// The automap hands over the map's lines once, in map units, and hands them
+// over again only when the set of lines to be shown changes. Each frame it
+// picks which of them lie in the blocks on screen, and those are drawn as
+// one list of GL lines through the automap's scale and position, at the
+// window's resolution rather than the playfield's. The player arrows and
+// things are handed over every frame as marks.
+//
+
+//
+// Config Vars
+//
+
+// draw the automap with GL lines rather than into the playfield framebuffer
+static bool hardware_automap = true;
+
+static CfgItem cfgHardwareAutomap("hardware_automap", &hardware_automap);
+
+// view pixels of the playfield, which the automap's scales are in
+#define VIEWWIDTH  160.0
+#define VIEWHEIGHT 180.0
+
+static std::vector<vtx_t>    lineVerts;  // two for each line handed over
+static std::vector<uint16_t> shownLines; // first vertex of each line to draw
+static std::vector<vtx_t>    markVerts;  // two for each mark this frame
+
+static bool    automapPending; // a frame has been handed over and not yet drawn
+static GLfloat automapX, automapY;
+static GLfloat automapXScale, automapYScale;
+
+static void GL_setAutomapVertex(vtx_t &v, int x, int y, unsigned int color)
+{
+   v.coords[VTX_X]     = x / 65536.0f;
+   v.coords[VTX_Y]     = y / 65536.0f;
+   v.coords[VTX_Z]     = 0.0f;
+   v.txcoords[VTX_U]   = 0.0f;
+   v.txcoords[VTX_V]   = 0.0f;
+   RB_SetVertexColors(&v, 1, color);
+}
+
+//
+// Check whether the automap can be drawn with the GL now
+//
+int GL_AutomapAvailable(void)
+{
+   return hardware_automap && !GL_IsHeadless();
+}
+
+//
+// Drop the lines handed over, before handing over a new set
+//
+void GL_ClearAutomapLines(void)
+{
+   lineVerts.clear();
+   shownLines.clear();
+}
+
+//
+// Hand over a line from (x1, y1) to (x2, y2) in map fixed point, in an RGBA
+// color. Returns the number to show it by, or -1 if no more will fit.
+//
+int GL_AddAutomapLine(int x1, int y1, int x2, int y2, unsigned int color)
+{
+   const size_t first = lineVerts.size();
+
+   // every vertex must be reachable by a 16-bit index
+   if(first + 2 > 0x10000)
+      return -1;
+
+   lineVerts.resize(first + 2);
+   GL_setAutomapVertex(lineVerts[first    ], x1, y1, color);
+   GL_setAutomapVertex(lineVerts[first + 1], x2, y2, color);
+
+   return int(first);
+}
+
+//
+// Start a frame centered on (x, y) in map fixed point, with map units
+// shifted down by xshift and yshift to give view pixels
+//
+void GL_BeginAutomap(int x, int y, int xshift, int yshift)
+{
+   shownLines.clear();
+   markVerts.clear();
+
+   automapX      = x / 65536.0f;
+   automapY      = y / 65536.0f;
+   automapXScale = 65536.0f / float(1 << xshift);
+   automapYScale = 65536.0f / float(1 << yshift);
+
+   automapPending = true;
+}
+
+//
+// Draw a line handed over by GL_AddAutomapLine in this frame
+//
+void GL_ShowAutomapLine(int index)
+{
+   shownLines.push_back(uint16_t(index));
+}
+
+//
+// Draw a line in this frame only, in map fixed point
+//
+void GL_AddAutomapMark(int x1, int y1, int x2, int y2, unsigned int color)
+{
+   const size_t first = markVerts.size();
+
+   markVerts.resize(first + 2);
+   GL_setAutomapVertex(markVerts[first    ], x1, y1, color);
+   GL_setAutomapVertex(markVerts[first + 1], x2, y2, color);
+}
+
+//
+// Clear out any frame which was handed over and not drawn
+//
+void GL_ClearAutomap(void)
+{
+   shownLines.clear();
+   markVerts.clear();
+   automapPending = false;
+}
+
+//
+// Check whether a frame has been handed over to be drawn
+//
+int GL_AutomapPending(void)
+{
+   return automapPending;
+}
+
+//
+// Draw the frame handed over into the game screen rect (gx, gy, gw, gh).
+// Returns false if there is no frame to draw, in which case the software
+// framebuffer should be drawn instead.
+//
+int GL_DrawAutomap(int gx, int gy, unsigned int gw, unsigned int gh)
+{
+   int sx, sy, winw, winh;
+
+   if(!automapPending)
+      return false;
+
+   // GL counts viewport rows from the bottom of the window
+   hal_video.transformGameCoord2i(gx, gy, &sx, &sy);
+   hal_video.getWindowSize(&winw, &winh);
+
+   const rbScissor_t rect =
+   {
+      sx,
+      winh - (sy + int(hal_video.transformHeight(gh))),
+      int(hal_video.transformWidth(gw)),
+      int(hal_video.transformHeight(gh))
+   };
+
+   glViewport(rect.x, rect.y, rect.width, rect.height);
+   RB_SetScissorRect(rect);
+   RB_SetState(RB_GLSTATE_SCISSOR, true);
+   glClear(GL_COLOR_BUFFER_BIT);
+
+   RB_SetState(RB_GLSTATE_TEXTURE0, false);
+   RB_SetState(RB_GLSTATE_BLEND, false);
+   RB_SetState(RB_GLSTATE_ALPHATEST, false);
+
+   // map units to view pixels, with y down the screen as in AM_Drawer
+   glMatrixMode(GL_PROJECTION);
+   glLoadIdentity();
+   glOrtho(0.0, VIEWWIDTH, VIEWHEIGHT, 0.0, -1.0, 1.0);
+   glMatrixMode(GL_MODELVIEW);
+   glLoadIdentity();
+   glTranslatef(GLfloat(VIEWWIDTH / 2.0), GLfloat(VIEWHEIGHT / 2.0), 0.0f);
+   glScalef(automapXScale, -automapYScale, 1.0f);
+   glTranslatef(-automapX, -automapY, 0.0f);
+
+   if(!shownLines.empty())
+   {
+      RB_BindDrawPointers(&lineVerts[0], int(lineVerts.size()));
+      for(uint16_t index : shownLines)
+         RB_AddLine(index, uint16_t(index + 1));
+      RB_DrawElements(GL_LINES);
+      RB_ResetElements();
+   }
+
+   if(!markVerts.empty())
+   {
+      RB_BindDrawPointers(&markVerts[0], int(markVerts.size()));
+      RB_DrawArrays(GL_LINES, 0, int(markVerts.size()));
+   }
+
+   // back to the whole window for everything else
+   RB_SetState(RB_GLSTATE_TEXTURE0, true);
+   RB_SetState(RB_GLSTATE_BLEND, true);
+   RB_SetState(RB_GLSTATE_ALPHATEST, true);
+   RB_SetState(RB_GLSTATE_SCISSOR, false);
+   glViewport(0, 0, winw, winh);
+   glMatrixMode(GL_PROJECTION);
+   glLoadIdentity();
+   glOrtho(0.0, GLdouble(winw), GLdouble(winh), 0.0, -1.0, 1.0);
+   glMatrixMode(GL_MODELVIEW);
+   glLoadIdentity();
+
+   automapPending = false;
+   return true;
+}
+
+// EOF
+
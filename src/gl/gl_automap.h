@@ -0,0 +1,53 @@
+/*
+  CALICO
+
+  OpenGL automap
+
+  The MIT License (MIT)
+
+  Copyright (C) 2016 James Haley
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef GL_AUTOMAP_H__
+#define GL_AUTOMAP_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int  GL_AutomapAvailable(void);
+void GL_ClearAutomapLines(void);
+int  GL_AddAutomapLine(int x1, int y1, int x2, int y2, unsigned int color);
+void GL_BeginAutomap(int x, int y, int xshift, int yshift);
+void GL_ShowAutomapLine(int index);
+void GL_AddAutomapMark(int x1, int y1, int x2, int y2, unsigned int color);
+int  GL_AutomapPending(void);
+int  GL_DrawAutomap(int x, int y, unsigned int w, unsigned int h);
+void GL_ClearAutomap(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+// EOF
+
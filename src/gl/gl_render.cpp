@@ -26,8 +26,11 @@
   SOFTWARE.
 */
 
+#include <algorithm>
+#include <vector>
+
 #include "../elib/elib.h"
-#include "../elib/bdlist.h"
+#include "../elib/configfile.h"
 #include "../elib/zone.h"
 #include "../hal/hal_types.h"
 #include "../hal/hal_platform.h"
@@ -35,12 +38,20 @@
 #include "../rb/rb_common.h"
 #include "../rb/rb_draw.h"
 #include "../rb/rb_main.h"
+#include "../rb/rb_shader.h"
 #include "../rb/rb_texture.h"
 #include "../rb/valloc.h"
 #include "../jagcry.h"
+#include "../m_jobs.h"
+#include "../m_trace.h"
+#include "gl_automap.h"
 #include "gl_render.h"
+#include "gl_world.h"
 #include "resource.h"
 
+// no GL context exists with -headless; resources only keep their pixels
+static bool headless;
+
 //=============================================================================
 //
 // Primitives and utilities
@@ -73,48 +84,104 @@ static void GL_setDefaultStates()
    RB_SetBlend(RB_GLSRC_SRC_ALPHA, RB_GLDST_ONE_MINUS_SRC_ALPHA);
 }
 
-//
-// Bind vertex draw pointers and output two triangles
-//
-static void GL_drawRectImmediate(vtx_t v[4])
-{
-   // set states
-   GL_setDefaultStates();
-
-   // render
-   RB_BindDrawPointers(v);
-   RB_AddTriangle(0, 1, 2);
-   RB_AddTriangle(3, 2, 1);
-   RB_DrawElements(GL_TRIANGLES);
-   RB_ResetElements();
-}
+// while the screen is being composed offscreen, game coordinates are taken
+// to it rather than to the window; see GL_beginCompose
+static bool composing;
+static int  composeX, composeXScale, composeYScale;
 
 //
-// Draw a rect from game coordinates (gx, gy) to translated framebuffer
+// Set up a quad from game coordinates (gx, gy) to translated framebuffer
 // coordinates with the provided information.
 //
-static void GL_drawGameRect(int gx, int gy, 
+static void GL_initGameRect(int gx, int gy, 
                             unsigned int gw, unsigned int gh,
-                            rbTexture &tx, vtx_t v[4])
+                            const float uv[4], vtx_t v[4])
 {
    float sx, sy, sw, sh;
    
    RB_SetVertexColors(v, 4, 0xff, 0xff, 0xff, 0xff);
-   RB_DefTexCoords(v, &tx);
-   
-   // bind texture
-   tx.bind();
 
-   // transform coordinates into screen space
-   hal_video.transformGameCoord2f(gx, gy, &sx, &sy);
+   // the graphic may be only part of its texture
+   v[0].txcoords[VTX_U] = v[2].txcoords[VTX_U] = uv[0];
+   v[0].txcoords[VTX_V] = v[1].txcoords[VTX_V] = uv[1];
+   v[1].txcoords[VTX_U] = v[3].txcoords[VTX_U] = uv[2];
+   v[2].txcoords[VTX_V] = v[3].txcoords[VTX_V] = uv[3];
 
-   // scale width and height into screen space
-   sw = float(hal_video.transformWidth(gw));
-   sh = float(hal_video.transformHeight(gh));
+   if(composing)
+   {
+      sx = float((gx + composeX) * composeXScale);
+      sy = float(gy * composeYScale);
+      sw = float(int(gw) * composeXScale);
+      sh = float(int(gh) * composeYScale);
+   }
+   else
+   {
+      // transform coordinates into screen space
+      hal_video.transformGameCoord2f(gx, gy, &sx, &sy);
+
+      // scale width and height into screen space
+      sw = float(hal_video.transformWidth(gw));
+      sh = float(hal_video.transformHeight(gh));
+   }
 
    GL_initVtxCoords(v, sx, sy, sw, sh);
+}
+
+//
+// Quad batching
+//
+// Quads sharing a texture, including graphics on the same atlas page, are
+// gathered into one vertex array and drawn with a single bind and a single
+// element draw.
+//
+
+// quads per batch; every vertex must be reachable by a 16-bit index
+#define MAXBATCHQUADS 1024
 
-   GL_drawRectImmediate(v);
+static vtx_t batchVtx[MAXBATCHQUADS * 4];
+static int   numBatchQuads;
+
+//
+// Add a rect in game coordinates to the batch
+//
+static void GL_addBatchRect(int gx, int gy, 
+                            unsigned int gw, unsigned int gh,
+                            const float uv[4])
+{
+   vtx_t    *v    = &batchVtx[numBatchQuads * 4];
+   uint16_t  base = uint16_t(numBatchQuads * 4);
+
+   GL_initGameRect(gx, gy, gw, gh, uv, v);
+   RB_AddTriangle(base + 0, base + 1, base + 2);
+   RB_AddTriangle(base + 3, base + 2, base + 1);
+   ++numBatchQuads;
+}
+
+//
+// Bind the batch's texture and vertex draw pointers and output every quad
+//
+static void GL_drawBatch(rbTexture &tx, bool cry, int shade)
+{
+   bool decode = false;
+
+   if(!numBatchQuads)
+      return;
+
+   // set states
+   GL_setDefaultStates();
+
+   // render
+   tx.bind();
+   if(cry)
+   {
+      decode = RB_BeginCRYDecode(CRY_ADDC(shade), CRY_ADDR(shade), CRY_ADDY(shade));
+   }
+   RB_BindDrawPointers(batchVtx, numBatchQuads * 4);
+   RB_DrawElements(GL_TRIANGLES);
+   RB_ResetElements();
+   if(decode)
+      RB_EndCRYDecode();
+   numBatchQuads = 0;
 }
 
 //=============================================================================
@@ -127,41 +194,416 @@ static void GL_drawGameRect(int gx, int gy,
 //
 static ResourceHive graphics;
 
+//
+// Texture atlas pages
+//
+// Small graphics, such as the status bar and the pause and loading plaques,
+// share a few large textures so that drawing them doesn't need a bind each.
+// Every graphic has its edge pixels repeated around it, so that filtering
+// behaves as though it were clamped to its own edges.
+//
+
+#define ATLASSIZE   1024 // width and height of a page
+#define ATLASMAXW   320  // largest graphic put in a page
+#define ATLASMAXH   64
+#define ATLASGUTTER 1
+
+class AtlasPage
+{
+protected:
+   rbTexture    m_tex;
+   unsigned int m_shelfx, m_shelfy, m_shelfh; // current shelf being filled
+
+public:
+   AtlasPage *next;
+
+   AtlasPage() : m_tex(), m_shelfx(0), m_shelfy(0), m_shelfh(0), next(nullptr)
+   {
+   }
+
+   //
+   // Find room for a w by h graphic, including its gutter, on the page's
+   // shelves. Returns false if the page is full.
+   //
+   bool place(unsigned int w, unsigned int h, unsigned int &x, unsigned int &y)
+   {
+      if(m_shelfx + w > ATLASSIZE)
+      {
+         // start a new shelf
+         m_shelfy += m_shelfh;
+         m_shelfx  = 0;
+         m_shelfh  = 0;
+      }
+      if(m_shelfy + h > ATLASSIZE)
+         return false;
+
+      x = m_shelfx;
+      y = m_shelfy;
+      m_shelfx += w;
+      m_shelfh  = emax(m_shelfh, h);
+      return true;
+   }
+
+   //
+   // Create the GL texture, if it hasn't been already
+   //
+   void generate()
+   {
+      if(m_tex.getTextureID())
+         return;
+
+      std::unique_ptr<uint32_t []> clear(new uint32_t [ATLASSIZE * ATLASSIZE]());
+      m_tex.init(rbTexture::TCR_RGBA, ATLASSIZE, ATLASSIZE);
+      m_tex.upload(clear.get(), rbTexture::TC_CLAMP, rbTexture::TF_AUTO);
+   }
+
+   rbTexture &getTexture() { return m_tex; }
+};
+
+static AtlasPage *atlasPages;
+
+//
+// Find a page with room for a w by h graphic
+//
+static AtlasPage *GL_placeInAtlas(unsigned int w, unsigned int h, 
+                                  unsigned int &x, unsigned int &y)
+{
+   AtlasPage *page;
+
+   if(!w || !h || w > ATLASMAXW || h > ATLASMAXH)
+      return nullptr;
+
+   w += 2 * ATLASGUTTER;
+   h += 2 * ATLASGUTTER;
+
+   for(page = atlasPages; page; page = page->next)
+   {
+      if(page->place(w, h, x, y))
+         break;
+   }
+
+   if(!page)
+   {
+      if(!(page = new (std::nothrow) AtlasPage()))
+         return nullptr;
+      page->place(w, h, x, y);
+      page->next = atlasPages;
+      atlasPages = page;
+   }
+
+   x += ATLASGUTTER;
+   y += ATLASGUTTER;
+   return page;
+}
+
+//
+// Scratch space for copies made on the way to the GL, which is kept and
+// reused so that regenerating every texture after a mode change doesn't
+// allocate for each one
+//
+static std::unique_ptr<uint32_t []> scratchBuffer;
+static unsigned int                 scratchSize;
+
+static uint32_t *GL_scratchBuffer(unsigned int count)
+{
+   if(count > scratchSize)
+   {
+      scratchBuffer.reset(new uint32_t [count]);
+      scratchSize = count;
+   }
+
+   return scratchBuffer.get();
+}
+
+#define MAXDIRTYRECTS 4 // changed areas kept apart before they are merged
+
+//
+// Part of a texture whose pixels have changed since it was last uploaded
+//
+struct dirtyrect_t
+{
+   unsigned int x1, y1, x2, y2; // x2 and y2 are exclusive
+
+   bool touches(const dirtyrect_t &r) const
+   {
+      return x1 <= r.x2 && r.x1 <= x2 && y1 <= r.y2 && r.y1 <= y2;
+   }
+
+   void merge(const dirtyrect_t &r)
+   {
+      x1 = emin(x1, r.x1);
+      y1 = emin(y1, r.y1);
+      x2 = emax(x2, r.x2);
+      y2 = emax(y2, r.y2);
+   }
+};
+
+// resources whose GL textures went with the last context and haven't been
+// regenerated yet
+static int lostResources;
+
 //
 // Texture resource class
 //
 class TextureResource : public Resource
 {
 protected:
-   rbTexture    m_tex;
+   rbTexture    m_tex;    // own texture, when not in an atlas page
+   AtlasPage   *m_page;   // page holding the graphic, if any
+   unsigned int m_x, m_y; // place on the page
+   float        m_uv[4];  // texture coordinates of the graphic's corners
    unsigned int m_width;
    unsigned int m_height;
    bool         m_needUpdate;
+   bool         m_streaming; // replaced every frame, so uploaded through PBOs
+   bool         m_cry;       // 16-bit CRY pixels, decoded when drawn
+   bool         m_lost;      // GL texture must be regenerated before use
+   int          m_shade;     // CRY color added while decoding
+   bool         m_clear;      // store holds nothing but m_clearColor
+   uint32_t     m_clearColor;
    std::unique_ptr<uint32_t []> m_data;
 
+   // changed areas still to be uploaded; none means all of it
+   dirtyrect_t  m_dirty[MAXDIRTYRECTS];
+   int          m_numDirty;
+
+   //
+   // Copy part of the graphic to its place on its atlas page. Edges of the
+   // graphic are repeated into its gutter.
+   //
+   void uploadToPage(const dirtyrect_t &r)
+   {
+      const unsigned int px1 = r.x1 ? r.x1 + ATLASGUTTER : 0;
+      const unsigned int py1 = r.y1 ? r.y1 + ATLASGUTTER : 0;
+      const unsigned int px2 = r.x2 + ATLASGUTTER * (r.x2 == m_width  ? 2 : 1);
+      const unsigned int py2 = r.y2 + ATLASGUTTER * (r.y2 == m_height ? 2 : 1);
+      const unsigned int pw  = px2 - px1, ph = py2 - py1;
+      uint32_t *padded = GL_scratchBuffer(pw * ph);
+
+      for(unsigned int y = 0; y < ph; y++)
+      {
+         unsigned int sy = emin(emax(py1 + y, unsigned(ATLASGUTTER)) - ATLASGUTTER, m_height - 1);
+         for(unsigned int x = 0; x < pw; x++)
+         {
+            unsigned int sx = emin(emax(px1 + x, unsigned(ATLASGUTTER)) - ATLASGUTTER, m_width - 1);
+            padded[y * pw + x] = m_data[sy * m_width + sx];
+         }
+      }
+
+      m_page->getTexture().updateRect(padded, m_x - ATLASGUTTER + px1, m_y - ATLASGUTTER + py1, pw, ph);
+   }
+
+   //
+   // Copy part of the graphic to its own texture
+   //
+   void uploadRect(const dirtyrect_t &r)
+   {
+      const unsigned int w = r.x2 - r.x1, h = r.y2 - r.y1;
+      uint32_t *rect = GL_scratchBuffer(w * h);
+
+      for(unsigned int y = 0; y < h; y++)
+         std::memcpy(rect + y * w, &m_data[(r.y1 + y) * m_width + r.x1], w * sizeof(uint32_t));
+
+      m_tex.updateRect(rect, r.x1, r.y1, w, h);
+   }
+
+   dirtyrect_t wholeRect() const
+   {
+      dirtyrect_t r = { 0, 0, m_width, m_height };
+      return r;
+   }
+
 public:
-   TextureResource(const char *tag, uint32_t *pixels, unsigned int w, unsigned int h)
-      : Resource(tag), m_tex(), m_width(w), m_height(h), m_needUpdate(false), 
-        m_data(pixels)
+   TextureResource(const char *tag, uint32_t *pixels, unsigned int w, unsigned int h,
+                   bool streaming = false, bool cry = false)
+      : Resource(tag), m_tex(), m_page(nullptr), m_x(0), m_y(0), m_width(w), m_height(h), 
+        m_needUpdate(false), m_streaming(streaming), m_cry(cry), m_lost(false), m_shade(0),
+        m_clear(false), m_clearColor(0), m_data(pixels), m_numDirty(0)
    {
+      m_uv[0] = m_uv[1] = 0.0f;
+      m_uv[2] = m_uv[3] = 1.0f;
+
+      // atlas pages hold only RGBA
+      if(!cry && (m_page = GL_placeInAtlas(w, h, m_x, m_y)))
+      {
+         m_uv[0] = float(m_x) / ATLASSIZE;
+         m_uv[1] = float(m_y) / ATLASSIZE;
+         m_uv[2] = float(m_x + w) / ATLASSIZE;
+         m_uv[3] = float(m_y + h) / ATLASSIZE;
+      }
    }
 
    void generate()
    {
-      m_tex.init(rbTexture::TCR_RGBA, m_width, m_height);
-      m_tex.upload(m_data.get(), rbTexture::TC_CLAMP, rbTexture::TF_AUTO);
+      if(headless)
+         return;
+
+      if(m_page)
+      {
+         m_page->generate();
+         uploadToPage(wholeRect());
+         return;
+      }
+
+      const rbTexture::texColorMode_t color = m_cry ? rbTexture::TCR_LUMALPHA : rbTexture::TCR_RGBA;
+
+      if(m_streaming)
+         m_tex.initStreaming(color, m_width, m_height);
+      else
+         m_tex.init(color, m_width, m_height);
+
+      // filtering would blend CRY values rather than colors
+      m_tex.upload(m_data.get(), rbTexture::TC_CLAMP, 
+                   m_cry ? rbTexture::TF_NEAREST : rbTexture::TF_AUTO);
+   }
+
+   //
+   // Forget the GL texture after the context is lost. It is regenerated the
+   // next time it is updated or drawn, or sooner when prewarming.
+   //
+   void abandon()
+   {
+      if(!m_page)
+         m_tex.abandonTexture();
+      if(!m_lost)
+      {
+         m_lost = true;
+         ++lostResources;
+      }
    }
   
    void update()
    {
-      m_tex.update(m_data.get());
+      if(headless)
+      {
+         m_needUpdate = false;
+         m_numDirty   = 0;
+         return;
+      }
+
+      if(m_lost)
+      {
+         // sends all of the pixels
+         generate();
+         m_lost = false;
+         --lostResources;
+      }
+      else if(m_page)
+      {
+         if(!m_numDirty)
+            uploadToPage(wholeRect());
+         for(int i = 0; i < m_numDirty; i++)
+            uploadToPage(m_dirty[i]);
+      }
+      else if(m_numDirty && !m_streaming && !m_cry)
+      {
+         for(int i = 0; i < m_numDirty; i++)
+            uploadRect(m_dirty[i]);
+      }
+      else
+         m_tex.update(m_data.get());
       m_needUpdate = false;
+      m_numDirty   = 0;
    }
 
-   rbTexture  &getTexture() { return m_tex;        }
-   uint32_t   *getPixels()  { return m_data.get(); }
-   bool needsUpdate() const { return m_needUpdate; }
-   void setUpdated()        { m_needUpdate = true; }
+   // texture to bind when drawing, which may be shared with other resources
+   rbTexture  &getTexture() { return m_page ? m_page->getTexture() : m_tex; }
+   const float *getUVs() const { return m_uv; }
+
+   // anything given the store may draw into it
+   uint32_t   *getPixels()  { m_clear = false; return m_data.get(); }
+   unsigned int getWidth()  const { return m_width;  }
+   unsigned int getHeight() const { return m_height; }
+   bool isCRY()       const { return m_cry; }
+
+   // bytes of the system memory copy kept of the pixels
+   size_t getStoreBytes() const
+   {
+      size_t pixels = size_t(m_width) * m_height;
+      return (m_cry ? (pixels + 1) / 2 : pixels) * sizeof(uint32_t);
+   }
+   int  getShade()    const { return m_shade; }
+   void setShade(int shade) { m_shade = shade; }
+   bool needsUpdate() const { return m_needUpdate || m_lost; }
+   bool isLost()      const { return m_lost; }
+
+   void setUpdated()
+   {
+      m_needUpdate = true;
+      m_numDirty   = 0;
+      m_clear      = false;
+   }
+
+   //
+   // Fill the store with one color. Drawing into the store is always marked
+   // with setUpdated or setRectUpdated, so if neither has been called since
+   // the store was last cleared to the same color, it is still clear and
+   // nothing needs doing, not even another upload.
+   //
+   void clear(uint32_t color)
+   {
+      const size_t pixels = size_t(m_width) * m_height;
+
+      if(m_cry)
+         color = 0; // CRY 0 is black, which is all the game ever clears to
+
+      if(m_clear && m_clearColor == color)
+         return;
+
+      uint32_t *data = m_data.get();
+      if(m_cry)
+         std::memset(data, 0, pixels * sizeof(uint16_t));
+      else if(color == (color & 0xff) * 0x01010101u)
+         std::memset(data, int(color & 0xff), pixels * sizeof(uint32_t));
+      else
+         std::fill_n(data, pixels, color);
+
+      setUpdated();
+      m_clear      = true;
+      m_clearColor = color;
+   }
+
+   //
+   // Mark only part of the graphic as changed. Once the whole graphic is
+   // marked, nothing more precise is kept until it has been uploaded.
+   //
+   void setRectUpdated(int x, int y, unsigned int w, unsigned int h)
+   {
+      m_clear = false;
+
+      if(m_needUpdate && !m_numDirty)
+         return;
+
+      dirtyrect_t r;
+      r.x1 = unsigned(emax(x, 0));
+      r.y1 = unsigned(emax(y, 0));
+      r.x2 = emin(unsigned(emax(x, 0)) + w, m_width);
+      r.y2 = emin(unsigned(emax(y, 0)) + h, m_height);
+      if(r.x1 >= r.x2 || r.y1 >= r.y2)
+         return;
+
+      m_needUpdate = true;
+
+      // grow an area it meets, so the same digits redrawn upload only once
+      for(int i = 0; i < m_numDirty; i++)
+      {
+         if(m_dirty[i].touches(r))
+         {
+            m_dirty[i].merge(r);
+            return;
+         }
+      }
+
+      if(m_numDirty == MAXDIRTYRECTS)
+      {
+         for(int i = 1; i < m_numDirty; i++)
+            m_dirty[0].merge(m_dirty[i]);
+         m_dirty[0].merge(r);
+         m_numDirty = 1;
+      }
+      else
+         m_dirty[m_numDirty++] = r;
+   }
 };
 
 //
@@ -170,20 +612,121 @@ public:
 static TextureResource *framebuffer160;
 static TextureResource *framebuffer320;
 
+// width of the 3D view in playfield columns, and how far it reaches past
+// each side of the 320-wide screen
+static int viewWidth = CALICO_ORIG_GAMESCREENWIDTH;
+static int viewExtra;
+
 //
 // Abandon old texture IDs and regenerate all textures in the resource hive 
 // if a resolution change occurs.
 //
 VALLOCATION(graphics)
 {
+   for(AtlasPage *page = atlasPages; page; page = page->next)
+      page->getTexture().abandonTexture();
+
+   graphics.forEachOfType<TextureResource>([] (TextureResource *tr) {
+      tr->abandon();
+   });
+}
+
+// resources regenerated at the end of each frame ahead of being drawn, after
+// a context loss; 0 leaves each one until it is first needed
+static int texture_prewarm = 8;
+
+static cfgrange_t<int> tpRange = { 0, 256 };
+
+static CfgItem cfgTexturePrewarm("texture_prewarm", &texture_prewarm, &tpRange);
+
+static int prewarmBudget;
+
+//
+// Regenerate a few lost texture resources, so a context loss is caught up
+// with over several frames instead of all at once or when each is drawn
+//
+static void GL_prewarmTextures(void)
+{
+   if(!lostResources || !texture_prewarm)
+      return;
+
+   prewarmBudget = texture_prewarm;
    graphics.forEachOfType<TextureResource>([] (TextureResource *tr) {
-      tr->getTexture().abandonTexture();
-      tr->generate();
+      if(prewarmBudget > 0 && tr->isLost())
+      {
+         tr->update();
+         --prewarmBudget;
+      }
    });
 }
 
 extern "C" unsigned short *palette8;
 
+// from m_argv.c, for -renderscale
+extern "C" const char *const *myargv;
+extern "C" int M_GetArgParameters(const char *arg, int count);
+
+// rows converted by each job
+#define CONVERTROWS 32
+
+//
+// An 8-bit graphic being converted to 32-bit color. Every source byte is
+// looked up once in a table made for the graphic, which already holds the
+// palette, the CRY conversion, and transparency; packed graphics look up
+// both of a byte's pixels at once.
+//
+struct convertjob_t
+{
+   byte         *src;
+   uint32_t     *buffer;
+   unsigned int  w, h;
+   uint32_t      colors[256];     // for 8-bit graphics
+   uint32_t      pairs[256][2];   // for packed graphics
+};
+
+//
+// Fill in the color of every palette index; index 0 is transparent
+//
+static void GL_build8bppColors(uint32_t colors[256])
+{
+   colors[0] = 0;
+   for(int i = 1; i < 256; i++)
+      colors[i] = CRYToRGB[palette8[i]];
+}
+
+static void GL_8bppJob(void *data, int index)
+{
+   auto job = static_cast<convertjob_t *>(data);
+   unsigned int first = index * CONVERTROWS * job->w;
+   unsigned int last  = emin(static_cast<unsigned int>(index + 1) * CONVERTROWS, job->h) * job->w;
+   const byte     *src    = job->src;
+   const uint32_t *colors = job->colors;
+   uint32_t       *dest   = job->buffer;
+   unsigned int    p      = first;
+
+   for(; p + 4 <= last; p += 4)
+   {
+      dest[p    ] = colors[src[p    ]];
+      dest[p + 1] = colors[src[p + 1]];
+      dest[p + 2] = colors[src[p + 2]];
+      dest[p + 3] = colors[src[p + 3]];
+   }
+   for(; p < last; p++)
+      dest[p] = colors[src[p]];
+}
+
+static void GL_8bppPackedJob(void *data, int index)
+{
+   auto job = static_cast<convertjob_t *>(data);
+   unsigned int first = index * CONVERTROWS * job->w / 2;
+   unsigned int last  = emin(static_cast<unsigned int>(index + 1) * CONVERTROWS, job->h) * job->w / 2;
+   const byte *src  = job->src;
+   uint32_t   *dest = job->buffer;
+
+   for(unsigned int p = first; p < last; p++)
+      std::memcpy(&dest[p*2], job->pairs[src[p]], sizeof(job->pairs[0]));
+}
+
 //
 // Convert 8-bit Jaguar graphic to 32-bit color
 //
@@ -193,9 +736,14 @@ static uint32_t *GL_8bppTo32bpp(void *data, unsigned int w, unsigned int h)
 
    if(buffer)
    {
-      byte *src = static_cast<byte *>(data);
-      for(unsigned int p = 0; p <  w * h; p++)
-         buffer[p] = src[p] ? CRYToRGB[palette8[src[p]]] : 0;
+      std::unique_ptr<convertjob_t> job(new convertjob_t);
+
+      job->src    = static_cast<byte *>(data);
+      job->buffer = buffer;
+      job->w      = w;
+      job->h      = h;
+      GL_build8bppColors(job->colors);
+      M_RunJobs("convert8bpp", GL_8bppJob, job.get(), (h + CONVERTROWS - 1) / CONVERTROWS);
    }
 
    return buffer;
@@ -212,16 +760,22 @@ static uint32_t *GL_8bppPackedTo32bpp(void *data,
 
    if(buffer)
    {
-      byte *src = static_cast<byte *>(data);
-      for(unsigned int p = 0; p < w * h / 2; p++)
-      {
-         byte pix[2];
-         pix[0] = (palshift << 1) + ((src[p] & 0xF0) >> 4);
-         pix[1] = (palshift << 1) +  (src[p] & 0x0F);
+      std::unique_ptr<convertjob_t> job(new convertjob_t);
+
+      job->src    = static_cast<byte *>(data);
+      job->buffer = buffer;
+      job->w      = w;
+      job->h      = h;
+      GL_build8bppColors(job->colors);
 
-         buffer[p*2  ] = pix[0] ? CRYToRGB[palette8[pix[0]]] : 0;
-         buffer[p*2+1] = pix[1] ? CRYToRGB[palette8[pix[1]]] : 0;
+      // each nibble picks one of 16 colors starting at palshift * 2
+      for(int i = 0; i < 256; i++)
+      {
+         job->pairs[i][0] = job->colors[byte((palshift << 1) + (i >> 4))];
+         job->pairs[i][1] = job->colors[byte((palshift << 1) + (i & 0x0F))];
       }
+
+      M_RunJobs("convert8bpp", GL_8bppPackedJob, job.get(), (h + CONVERTROWS - 1) / CONVERTROWS);
    }
 
    return buffer;
@@ -246,6 +800,10 @@ void *GL_NewTextureResource(const char *name, void *data,
          pixels = new (std::nothrow) uint32_t [width * height];
          std::memset(pixels, 0, width * height * sizeof(uint32_t));
          break;
+      case RES_CRYBUFFER:
+         // two CRY pixels to an element of the store
+         pixels = new (std::nothrow) uint32_t [(width * height + 1) / 2]();
+         break;
       case RES_8BIT:
          pixels = GL_8bppTo32bpp(data, width, height);
          break;
@@ -255,7 +813,10 @@ void *GL_NewTextureResource(const char *name, void *data,
       }
       if(pixels)
       {
-         tr = new (std::nothrow) TextureResource(name, pixels, width, height);
+         // framebuffers are redrawn every frame
+         tr = new (std::nothrow) TextureResource(name, pixels, width, height, 
+                                                 restype == RES_FRAMEBUFFER || restype == RES_CRYBUFFER,
+                                                 restype == RES_CRYBUFFER);
          if(tr)
          {
             tr->generate();
@@ -288,7 +849,8 @@ void GL_UpdateTextureResource(void *resource)
 }
 
 //
-// Call from game code to get the 32-bit backing store of a texture resource
+// Call from game code to get the 32-bit backing store of a texture resource,
+// or the 16-bit store of a CRY framebuffer
 //
 unsigned int *GL_GetTextureResourceStore(void *resource)
 {
@@ -303,6 +865,15 @@ void GL_TextureResourceSetUpdated(void *resource)
    static_cast<TextureResource *>(resource)->setUpdated();
 }
 
+//
+// Set only part of a texture resource as needing its GL texture updated.
+//
+void GL_TextureResourceSetRectUpdated(void *resource, int x, int y, 
+                                      unsigned int w, unsigned int h)
+{
+   static_cast<TextureResource *>(resource)->setRectUpdated(x, y, w, h);
+}
+
 //
 // Get a framebuffer as a GL resource
 //
@@ -324,15 +895,8 @@ void *GL_TextureResourceGetFramebuffer(glfbwhich_t which)
 //
 void GL_ClearTextureResource(void *resource, unsigned int clearColor)
 {
-   auto rez = static_cast<TextureResource *>(resource);
-   if(rez)
-   {
-      uint32_t  *buffer = rez->getPixels();
-      rbTexture &tex = rez->getTexture();
-      for(unsigned int i = 0; i < tex.getWidth() * tex.getHeight(); i++)
-         buffer[i] = clearColor;
-      rez->setUpdated();
-   }
+   if(resource)
+      static_cast<TextureResource *>(resource)->clear(clearColor);
 }
 
 //=============================================================================
@@ -342,14 +906,34 @@ void GL_ClearTextureResource(void *resource, unsigned int clearColor)
 
 struct drawcommand_t
 {
-   BDListItem<drawcommand_t> links; // list links
    TextureResource *res;            // source graphics
    int x, y;                        // where to put it (in 320x224 coord space)
    unsigned int w, h;               // size (in 320x224 coord space)
+   bool drawn;                      // already taken into a batch
 };
 
-static BDList<drawcommand_t, &drawcommand_t::links> drawCommands;
-static BDList<drawcommand_t, &drawcommand_t::links> lateDrawCommands;
+// Commands only last a frame, so they are kept in arrays which are emptied
+// rather than freed, and stop allocating once they have grown to fit.
+static std::vector<drawcommand_t> drawCommands;
+static std::vector<drawcommand_t> lateDrawCommands;
+
+static void GL_addDrawCommand(std::vector<drawcommand_t> &list, void *res, 
+                              int x, int y, unsigned int w, unsigned int h)
+{
+   drawcommand_t dc;
+
+   dc.res   = static_cast<TextureResource *>(res);
+   dc.x     = x;
+   dc.y     = y;
+   dc.w     = w;
+   dc.h     = h;
+   dc.drawn = false;
+
+   list.push_back(dc);
+
+   if(dc.res->needsUpdate())
+      dc.res->update();
+}
 
 //
 // Add a texture resource to the draw command list. If the resource needs its
@@ -357,21 +941,8 @@ static BDList<drawcommand_t, &drawcommand_t::links> lateDrawCommands;
 //
 void GL_AddDrawCommand(void *res, int x, int y, unsigned int w, unsigned int h)
 {
-   if(!res)
-      return;
-   
-   auto dc = estructalloc(drawcommand_t, 1);
-
-   dc->res = static_cast<TextureResource *>(res);
-   dc->x   = x;
-   dc->y   = y;
-   dc->w   = w;
-   dc->h   = h;
-
-   drawCommands.insert(dc);
-
-   if(dc->res->needsUpdate())
-      dc->res->update();
+   if(res)
+      GL_addDrawCommand(drawCommands, res, x, y, w, h);
 }
 
 //
@@ -379,49 +950,89 @@ void GL_AddDrawCommand(void *res, int x, int y, unsigned int w, unsigned int h)
 //
 void GL_AddLateDrawCommand(void *res, int x, int y, unsigned int w, unsigned int h)
 {
-   if(!res)
-      return;
-
-   auto dc = estructalloc(drawcommand_t, 1);
-
-   dc->res = static_cast<TextureResource *>(res);
-   dc->x   = x;
-   dc->y   = y;
-   dc->w   = w;
-   dc->h   = h;
-
-   lateDrawCommands.insert(dc);
-
-   if(dc->res->needsUpdate())
-      dc->res->update();
+   if(res)
+      GL_addDrawCommand(lateDrawCommands, res, x, y, w, h);
 }
 
 static void GL_clearDrawCommands(void)
 {
-   while(!drawCommands.empty())
-   {
-      drawcommand_t *cmd = drawCommands.first()->bdObject;
-      drawCommands.remove(cmd);
-      efree(cmd);
-   }
+   drawCommands.clear();
+   lateDrawCommands.clear();
 }
 
+//
+// Check if two draw commands cover any of the same screen
+//
+static bool GL_drawCommandsOverlap(const drawcommand_t *a, const drawcommand_t *b)
+{
+   return a->x < b->x + int(b->w) && b->x < a->x + int(a->w) &&
+          a->y < b->y + int(b->h) && b->y < a->y + int(a->h);
+}
+
+//
+// Draw the commands in batches by texture. A command is only drawn ahead of
+// commands added before it if it doesn't overlap any of them, so that the
+// result is the same as drawing every command in order.
+//
 static void GL_executeDrawCommands(void)
 {
-   BDListItem<drawcommand_t> *item;
-   vtx_t v[4];
+   static drawcommand_t *skipped[MAXBATCHQUADS];
 
    // fold in the late draw commands now
-   while((item = lateDrawCommands.first()) != &lateDrawCommands.head)
-   {
-      lateDrawCommands.remove(item->bdObject);
-      drawCommands.insert(item->bdObject);
-   }
+   drawCommands.insert(drawCommands.end(), lateDrawCommands.begin(), lateDrawCommands.end());
+   lateDrawCommands.clear();
+
+   const size_t numCommands = drawCommands.size();
 
-   for(item = drawCommands.first(); item != &drawCommands.head; item = item->bdNext)
+   for(size_t c = 0; c < numCommands; c++)
    {
-      drawcommand_t *cmd = item->bdObject;
-      GL_drawGameRect(cmd->x, cmd->y, cmd->w, cmd->h, cmd->res->getTexture(), v);
+      drawcommand_t *cmd = &drawCommands[c];
+      rbTexture     &tx  = cmd->res->getTexture();
+      int numskipped = 0;
+
+      if(cmd->drawn)
+         continue;
+
+      // the hardware renderer and the GL automap draw the playfield themselves;
+      // the automap is never widened
+      if(cmd->res == framebuffer160 && 
+         (GL_DrawAutomap(cmd->x + viewExtra, cmd->y, cmd->w - 2 * viewExtra, cmd->h) ||
+          GL_DrawWorld(cmd->x, cmd->y, cmd->w, cmd->h, cmd->res->getShade())))
+      {
+         cmd->drawn = true;
+         continue;
+      }
+
+      GL_addBatchRect(cmd->x, cmd->y, cmd->w, cmd->h, cmd->res->getUVs());
+      cmd->drawn = true;
+
+      // gather later commands with the same texture which can be moved up
+      for(size_t l = c + 1; l < numCommands && numBatchQuads < MAXBATCHQUADS; l++)
+      {
+         drawcommand_t *lcmd = &drawCommands[l];
+         int i;
+
+         if(lcmd->drawn)
+            continue;
+
+         for(i = 0; i < numskipped; i++)
+         {
+            if(GL_drawCommandsOverlap(lcmd, skipped[i]))
+               break;
+         }
+
+         if(&lcmd->res->getTexture() == &tx && i == numskipped)
+         {
+            GL_addBatchRect(lcmd->x, lcmd->y, lcmd->w, lcmd->h, lcmd->res->getUVs());
+            lcmd->drawn = true;
+         }
+         else if(numskipped < MAXBATCHQUADS)
+            skipped[numskipped++] = lcmd;
+         else
+            break; // too many to check against
+      }
+
+      GL_drawBatch(tx, cmd->res->isCRY(), cmd->res->getShade());
    }
 }
 
@@ -430,24 +1041,99 @@ static void GL_executeDrawCommands(void)
 // Software Framebuffers
 //
 
+//
+// Config Vars
+//
+
+// multiple of 160x180 at which the 3D view is rendered
+static int render_scale = 1;
+
+static cfgrange_t<int> rsRange = { 1, 4 };
+
+static CfgItem cfgRenderScale("render_scale", &render_scale, &rsRange);
+
+// keep the 3D view as CRY and decode it on the GPU
+static bool cry_framebuffer = false;
+
+static CfgItem cfgCRYFramebuffer("cry_framebuffer", &cry_framebuffer);
+
+// on a window wider than the game's aspect, widen the 3D view into the sides
+static bool widescreen = true;
+
+static CfgItem cfgWidescreen("widescreen", &widescreen);
+
+//
+// Get the render scale as a shift. Only powers of two are supported, so any
+// other value is rounded down. -renderscale <n> overrides the config file
+// for one run, so that the same demos can be timed at each scale.
+//
+int GL_GetRenderShift(void)
+{
+   int shift = 0, scale = render_scale, p;
+
+   if((p = M_GetArgParameters("-renderscale", 1)))
+      scale = rsRange.clamp(atoi(myargv[p]));
+
+   while((2 << shift) <= scale)
+      ++shift;
+
+   return shift;
+}
+
+//
+// Find how many playfield columns it takes to fill the window across, so
+// that a wide window shows more of the view rather than stretching it. The
+// subscreen is the game's own aspect, centered; each playfield column covers
+// two of its 320 across. Rounded up to an even width so the view stays
+// centered, and limited to twice the original width.
+//
+static int GL_calcViewWidth(void)
+{
+   int winw, winh, subw;
+   int width = CALICO_ORIG_GAMESCREENWIDTH;
+
+   if(!widescreen || headless || hal_video.getAspectRatioType() != HAL_ASPECT_WIDE)
+      return width;
+
+   hal_video.getWindowSize(&winw, &winh);
+   hal_video.getSubscreenExtents(nullptr, nullptr, &subw, nullptr);
+   if(subw <= 0)
+      return width;
+
+   width = (CALICO_ORIG_GAMESCREENWIDTH * winw + subw - 1) / subw;
+   width = (width + 1) & ~1;
+
+   if(width > CALICO_ORIG_GAMESCREENWIDTH * 2)
+      width = CALICO_ORIG_GAMESCREENWIDTH * 2;
+
+   return width;
+}
+
 //
 // Create the GL texture handle for the framebuffer texture
 //
 void GL_InitFramebufferTextures(void)
 {
-   // create 160x180 playfield texture
+   const int shift = GL_GetRenderShift();
+   const bool cry = (cry_framebuffer && !headless && RB_InitCRYDecode(CRYToRGB));
+
+   viewWidth = GL_calcViewWidth();
+   viewExtra = viewWidth - CALICO_ORIG_GAMESCREENWIDTH;
+
+   // create playfield texture at 160x180 times the render scale, widened to
+   // fit the window
    framebuffer160 = static_cast<TextureResource *>(
       GL_NewTextureResource(
          "framebuffer",
          nullptr,
-         CALICO_ORIG_GAMESCREENWIDTH,
-         CALICO_ORIG_GAMESCREENHEIGHT,
-         RES_FRAMEBUFFER,
+         viewWidth << shift,
+         CALICO_ORIG_GAMESCREENHEIGHT << shift,
+         cry ? RES_CRYBUFFER : RES_FRAMEBUFFER,
          0
       )
    );
    if(!framebuffer160)
-      hal_platform.fatalError("Could not create 160x180 framebuffer texture");
+      hal_platform.fatalError("Could not create playfield framebuffer texture");
 
    // create 320x224 screen texture
    framebuffer320 = static_cast<TextureResource *>(
@@ -465,7 +1151,26 @@ void GL_InitFramebufferTextures(void)
 }
 
 //
-// Return the pointer to the local 32-bit framebuffer
+// Width of the playfield framebuffer in pixels, which is the width the 3D
+// view is rendered at. Only known once GL_InitFramebufferTextures has been
+// called.
+//
+int GL_GetRenderWidth(void)
+{
+   return int(framebuffer160->getWidth());
+}
+
+//
+// Check whether the playfield framebuffer holds 16-bit CRY rather than RGBA.
+// Only known once GL_InitFramebufferTextures has been called.
+//
+int GL_FramebufferIsCRY(void)
+{
+   return framebuffer160 && framebuffer160->isCRY();
+}
+
+//
+// Return the pointer to the local 32-bit framebuffer, or the 16-bit CRY one
 //
 void *GL_GetFramebuffer(glfbwhich_t which)
 {
@@ -497,7 +1202,11 @@ void GL_UpdateFramebuffer(glfbwhich_t which)
    }
 
    if(fb->needsUpdate())
+   {
+      if(!headless)
+         RB_MarkGPUTime(RB_GPUMARK_UPLOAD);
       fb->update();
+   }
 }
 
 void GL_ClearFramebuffer(glfbwhich_t which, unsigned int clearColor)
@@ -534,6 +1243,26 @@ void GL_FramebufferSetUpdated(glfbwhich_t which)
    }
 }
 
+//
+// Set the screen shading (a packed CRY color add) to be applied to a CRY
+// framebuffer as it is decoded. Ignored for RGBA framebuffers, which must be
+// shaded as they are drawn.
+//
+void GL_SetFramebufferShade(glfbwhich_t which, int shade)
+{
+   switch(which)
+   {
+   case FB_160:
+      framebuffer160->setShade(shade);
+      break;
+   case FB_320:
+      framebuffer320->setShade(shade);
+      break;
+   default:
+      break;
+   }
+}
+
 void GL_AddFramebuffer(glfbwhich_t which)
 {
    TextureResource *fb;
@@ -542,7 +1271,8 @@ void GL_AddFramebuffer(glfbwhich_t which)
    {
    case FB_160:
       fb = framebuffer160;
-      GL_AddDrawCommand(fb, 0, 2, CALICO_ORIG_SCREENWIDTH, CALICO_ORIG_GAMESCREENHEIGHT);
+      GL_AddDrawCommand(fb, -viewExtra, 2, CALICO_ORIG_SCREENWIDTH + 2 * viewExtra, 
+                        CALICO_ORIG_GAMESCREENHEIGHT);
       break;
    case FB_320:
       fb = framebuffer320;
@@ -553,18 +1283,242 @@ void GL_AddFramebuffer(glfbwhich_t which)
    }
 }
 
+//=============================================================================
+//
+// Screen composition
+//
+// The hardware renderer and the GL automap draw at the window's own
+// resolution, but when neither has anything in a frame, every graphic is
+// drawn into an offscreen screen at the largest whole multiple of 320x224
+// which fits the window, widened as the 3D view is. That screen is then
+// scaled into the window with a single quad, so filling the graphics costs
+// the same however big the window is.
+//
+
+// compose the screen offscreen and scale it up once
+static bool screen_compose = true;
+
+static CfgItem cfgScreenCompose("screen_compose", &screen_compose);
+
+// scale the composed screen up with bilinear filtering; starting from a
+// whole multiple, this only softens the edges between pixels
+static bool sharp_bilinear = false;
+
+static CfgItem cfgSharpBilinear("sharp_bilinear", &sharp_bilinear);
+
+static rbTexture composeTex;
+
+VALLOCATION(composeTex)
+{
+   composeTex.abandonTexture();
+   composing = false;
+}
+
+//
+// Set the projection to width by height pixels, with y down
+//
+static void GL_setScreenOrtho(int width, int height)
+{
+   glViewport(0, 0, width, height);
+   glMatrixMode(GL_PROJECTION);
+   glLoadIdentity();
+   glOrtho(0.0, GLdouble(width), GLdouble(height), 0.0, -1.0, 1.0);
+   glMatrixMode(GL_MODELVIEW);
+   glLoadIdentity();
+}
+
+//
+// Start drawing the frame into the offscreen screen, if it can be. Returns
+// false if the frame must be drawn straight into the window.
+//
+static bool GL_beginCompose(void)
+{
+   int subw, subh;
+
+   if(!screen_compose || GL_WorldPending() || GL_AutomapPending())
+      return false;
+
+   hal_video.getSubscreenExtents(nullptr, nullptr, &subw, &subh);
+   composeXScale = subw / CALICO_ORIG_SCREENWIDTH;
+   composeYScale = subh / CALICO_ORIG_SCREENHEIGHT;
+   if(composeXScale < 1)
+      composeXScale = 1;
+   if(composeYScale < 1)
+      composeYScale = 1;
+   composeX = viewExtra;
+
+   const unsigned int w = unsigned((CALICO_ORIG_SCREENWIDTH + 2 * viewExtra) * composeXScale);
+   const unsigned int h = unsigned(CALICO_ORIG_SCREENHEIGHT * composeYScale);
+   const rbTexture::texFilterMode_t filter =
+      (sharp_bilinear ? rbTexture::TF_LINEAR : rbTexture::TF_NEAREST);
+
+   if(!composeTex.getTextureID() || composeTex.getWidth() != w || composeTex.getHeight() != h)
+   {
+      composeTex.init(rbTexture::TCR_RGBA, w, h);
+      composeTex.upload(nullptr, rbTexture::TC_CLAMP, filter);
+   }
+   else if(composeTex.getFilterMode() != filter)
+   {
+      composeTex.bind(false);
+      composeTex.changeTexParameters(rbTexture::TC_CLAMP, filter);
+      rbTexture::Unbind();
+   }
+
+   if(!RB_SetRenderTarget(&composeTex))
+      return false;
+
+   GL_setScreenOrtho(int(w), int(h));
+   glClear(GL_COLOR_BUFFER_BIT);
+   composing = true;
+   return true;
+}
+
+//
+// Go back to the window and scale the composed screen into it
+//
+static void GL_endCompose(void)
+{
+   int   winw, winh;
+   float sx, sy;
+   vtx_t v[4];
+
+   composing = false;
+   RB_SetRenderTarget(nullptr);
+   hal_video.getWindowSize(&winw, &winh);
+   GL_setScreenOrtho(winw, winh);
+   glClear(GL_COLOR_BUFFER_BIT);
+
+   hal_video.transformGameCoord2f(-viewExtra, 0, &sx, &sy);
+   GL_initVtxCoords(v, sx, sy,
+                    float(hal_video.transformWidth(CALICO_ORIG_SCREENWIDTH + 2 * viewExtra)),
+                    float(hal_video.transformHeight(CALICO_ORIG_SCREENHEIGHT)));
+   RB_SetVertexColors(v, 4, RB_COLOR_WHITE);
+
+   // the screen's first row is at the bottom of its texture
+   v[0].txcoords[VTX_U] = v[2].txcoords[VTX_U] = 0.0f;
+   v[1].txcoords[VTX_U] = v[3].txcoords[VTX_U] = 1.0f;
+   v[0].txcoords[VTX_V] = v[1].txcoords[VTX_V] = 1.0f;
+   v[2].txcoords[VTX_V] = v[3].txcoords[VTX_V] = 0.0f;
+
+   // already blended as it was drawn
+   GL_setDefaultStates();
+   RB_SetState(RB_GLSTATE_BLEND, false);
+   RB_SetState(RB_GLSTATE_ALPHATEST, false);
+
+   composeTex.bind();
+   RB_BindDrawPointers(v, 4);
+   RB_AddTriangle(0, 1, 2);
+   RB_AddTriangle(3, 2, 1);
+   RB_DrawElements(GL_TRIANGLES);
+   RB_ResetElements();
+}
+
 //=============================================================================
 //
 // Refresh
 //
 
+static rbStats_t lastFrameStats;
+
+//
+// Get the GL work done in the last frame rendered
+//
+void GL_GetFrameStats(glframestats_t *stats)
+{
+   rbGPUTimes_t gpu;
+
+   RB_GetGPUTimes(&gpu);
+   stats->stateChanges = lastFrameStats.stateChanges;
+   stats->textureBinds = lastFrameStats.textureBinds;
+   stats->drawCalls    = lastFrameStats.drawCalls;
+   stats->uploadBytes  = lastFrameStats.uploadBytes;
+   stats->gpuUploadUS  = gpu.uploadUS;
+   stats->gpuDrawUS    = gpu.drawUS;
+   stats->gpuPresentUS = gpu.presentUS;
+}
+
+static void (*storeCallback)(const char *, unsigned int);
+
+static void GL_reportStore(TextureResource *tr)
+{
+   storeCallback(tr->getTag().constPtr(), unsigned(tr->getStoreBytes()));
+}
+
+//
+// Call fn with the name and store size of every texture resource
+//
+void GL_ForEachTextureStore(void (*fn)(const char *name, unsigned int bytes))
+{
+   storeCallback = fn;
+   graphics.forEachOfType<TextureResource>(GL_reportStore);
+   storeCallback = nullptr;
+}
+
+//
+// The GL renderer's own name for itself, to tell machines apart by
+//
+const char *GL_GetRendererName(void)
+{
+   const char *name;
+
+   if(headless || !(name = reinterpret_cast<const char *>(glGetString(GL_RENDERER))))
+      return "none";
+
+   return name;
+}
+
+//
+// Run without a GL context, for -headless. Must be called before any texture
+// resources are created.
+//
+void GL_SetHeadless(void)
+{
+   headless = true;
+}
+
+//
+// Check whether there is no GL context to draw with
+//
+int GL_IsHeadless(void)
+{
+   return headless;
+}
+
 void GL_RenderFrame(void)
 {
-   glClear(GL_COLOR_BUFFER_BIT);
+   unsigned int start = M_TraceBegin();
+
+   if(headless)
+   {
+      GL_clearDrawCommands();
+      GL_ClearWorld();
+      GL_ClearAutomap();
+      hal_video.endFrame();
+      M_TraceEnd("glframe", start);
+      return;
+   }
+
+   // a frame with no uploads marks them as taking no time
+   RB_MarkGPUTime(RB_GPUMARK_UPLOAD);
+   RB_MarkGPUTime(RB_GPUMARK_DRAW);
+
+   const bool composed = GL_beginCompose();
+
+   if(!composed)
+      glClear(GL_COLOR_BUFFER_BIT);
 
    GL_executeDrawCommands();
+   if(composed)
+      GL_endCompose();
    GL_clearDrawCommands();
+   GL_ClearWorld();
+   GL_ClearAutomap();
+   GL_prewarmTextures();
+   RB_MarkGPUTime(RB_GPUMARK_PRESENT);
    hal_video.endFrame();
+   RB_MarkGPUTime(RB_GPUMARK_END);
+   RB_ResetStats(&lastFrameStats);
+   M_TraceEnd("glframe", start);
 }
 
 // EOF
@@ -32,6 +32,7 @@
 typedef enum glrestype_e
 {
    RES_FRAMEBUFFER, // a raw framebuffer of specified dimensions
+   RES_CRYBUFFER,   // a raw framebuffer of 16-bit CRY pixels
    RES_8BIT,        // 8-bit Jag resource
    RES_8BIT_PACKED  // 8-bit packed Jag resource
 } glrestype_t;
@@ -42,17 +43,35 @@ typedef enum glfbwhich_e
    FB_320
 } glfbwhich_t;
 
+// GL work done in one frame
+typedef struct glframestats_s
+{
+   unsigned int stateChanges;
+   unsigned int textureBinds;
+   unsigned int drawCalls;
+   unsigned int uploadBytes;
+   unsigned int gpuUploadUS;  // GPU time, from a few frames before; 0 if
+   unsigned int gpuDrawUS;    //  the GL has no timer queries
+   unsigned int gpuPresentUS;
+} glframestats_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+int   GL_GetRenderShift(void);
 void  GL_InitFramebufferTextures(void);
+int   GL_GetRenderWidth(void);
+int   GL_FramebufferIsCRY(void);
 void *GL_GetFramebuffer(glfbwhich_t which);
 void  GL_UpdateFramebuffer(glfbwhich_t which);
 void  GL_ClearFramebuffer(glfbwhich_t which, unsigned int clearColor);
 void  GL_FramebufferSetUpdated(glfbwhich_t which);
+void  GL_SetFramebufferShade(glfbwhich_t which, int shade);
 void  GL_AddFramebuffer(glfbwhich_t which);
 void  GL_RenderFrame(void);
+void  GL_SetHeadless(void);
+int   GL_IsHeadless(void);
 
 void *GL_NewTextureResource(const char *lumpname, void *data,
                             unsigned int width, unsigned int height,
@@ -62,11 +81,17 @@ void *GL_CheckForTextureResource(const char *name);
 
 void          GL_UpdateTextureResource(void *resource);
 void          GL_TextureResourceSetUpdated(void *resource);
+void          GL_TextureResourceSetRectUpdated(void *resource, int x, int y, 
+                                               unsigned int w, unsigned int h);
 unsigned int *GL_GetTextureResourceStore(void *resource);
 void          GL_ClearTextureResource(void *resource, unsigned int clearColor);
 void          GL_AddDrawCommand(void *res, int x, int y, unsigned int w, unsigned int h);
 void          GL_AddLateDrawCommand(void *res, int x, int y, unsigned int w, unsigned int h);
 
+void GL_GetFrameStats(glframestats_t *stats);
+void GL_ForEachTextureStore(void (*fn)(const char *name, unsigned int bytes));
+const char *GL_GetRendererName(void);
+
 #ifdef __cplusplus
 }
 #endif
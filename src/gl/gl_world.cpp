@@ -0,0 +1,384 @@
+/*
+  CALICO
+
+  OpenGL world rendering
+
+  The MIT License (MIT)
+
+  Copyright (C) 2016 James Haley
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <map>
+#include <vector>
+
+#include "../elib/elib.h"
+#include "../elib/configfile.h"
+#include "../hal/hal_types.h"
+#include "../hal/hal_video.h"
+#include "../rb/rb_common.h"
+#include "../rb/rb_draw.h"
+#include "../rb/rb_main.h"
+#include "../rb/rb_shader.h"
+#include "../rb/rb_texture.h"
+#include "../rb/valloc.h"
+#include "../jagcry.h"
+#include "gl_render.h"
+#include "gl_world.h"
+
+//
+// The hardware renderer hands over the walls, flats, and sprites of each
+// frame here as textured polygons, which are drawn into the playfield in
+// place of the software framebuffer. Textures keep their CRY texels, which
+// are lit and decoded by the world program in rb_shader.cpp the same way the
+// Jaguar's drawers would.
+//
+
+//
+// Config Vars
+//
+
+// draw the 3D view with the GL rather than in software
+static bool hardware_render = false;
+
+static CfgItem cfgHardwareRender("hardware_render", &hardware_render);
+
+// view pixels of the playfield, which sky and overlay surfaces are given in;
+// the view may be wider, by as much as the game screen rect is
+#define VIEWWIDTH  160.0
+#define VIEWHEIGHT 180.0
+
+// focal lengths of the software renderer's projection, in view pixels
+#define FOCALX 80.0
+#define FOCALY 176.0
+
+#define ZNEAR 4.0
+#define ZFAR  131072.0
+
+//
+// World textures, by the lump their graphic came from
+//
+struct worldtexture_t
+{
+   rbTexture          tex;
+   float              uscale, vscale; // texels to texture coordinates
+   std::vector<vtx_t> verts;          // GLWS_WORLD triangles this frame
+};
+
+static std::map<int, worldtexture_t> worldTextures;
+
+// textures with GLWS_WORLD triangles this frame
+static std::vector<worldtexture_t *> worldUsed;
+
+//
+// Surfaces which must be drawn in the order they were added
+//
+struct worldrun_t
+{
+   worldtexture_t *wt; // nullptr for sky masks
+   int             first;
+   int             count;
+};
+
+struct worldlist_t
+{
+   std::vector<vtx_t>      verts;
+   std::vector<worldrun_t> runs;
+};
+
+static worldlist_t worldLists[GLWS_NUMSURFS]; // GLWS_WORLD is not used
+
+static bool    worldPending; // a frame has been handed over and not yet drawn
+static GLfloat worldMatrix[16];
+
+//
+// Textures are lost along with the context, and will be handed over again
+//
+VALLOCATION(worldTextures)
+{
+   for(auto &wtp : worldTextures)
+      wtp.second.tex.abandonTexture();
+
+   GL_ClearWorld();
+   worldTextures.clear();
+}
+
+//
+// Check whether the hardware renderer is enabled and can be used now
+//
+int GL_WorldAvailable(void)
+{
+   return hardware_render && !GL_IsHeadless() && RB_InitWorldDecode(CRYToRGB);
+}
+
+//
+// Check whether the graphic from lump has been handed over
+//
+int GL_HasWorldTexture(int lump)
+{
+   return worldTextures.find(lump) != worldTextures.end();
+}
+
+//
+// Hand over the graphic from lump as w by h row-major texels, each holding a
+// 16-bit CRY value in its low bits and, in its top byte, 0 where the graphic
+// is transparent and 0xff elsewhere
+//
+void GL_NewWorldTexture(int lump, const unsigned int *texels, unsigned int w, unsigned int h)
+{
+   worldtexture_t &wt = worldTextures[lump];
+
+   // CRY can't be filtered; the texels are decoded after they are read
+   wt.tex.init(rbTexture::TCR_RGBA, w, h);
+   wt.tex.upload(const_cast<unsigned int *>(texels), rbTexture::TC_REPEAT, rbTexture::TF_NEAREST);
+   wt.uscale = 1.0f / w;
+   wt.vscale = 1.0f / h;
+}
+
+//
+// Clear out any frame which was handed over and not drawn
+//
+void GL_ClearWorld(void)
+{
+   for(worldtexture_t *wt : worldUsed)
+      wt->verts.clear();
+   worldUsed.clear();
+
+   for(worldlist_t &list : worldLists)
+   {
+      list.verts.clear();
+      list.runs.clear();
+   }
+
+   worldPending = false;
+}
+
+//
+// Start handing over a frame seen from (x, y, z) in map units, facing angle
+// radians counterclockwise from east
+//
+void GL_BeginWorld(float x, float y, float z, float angle)
+{
+   const float s = sinf(angle), c = cosf(angle);
+
+   GL_ClearWorld();
+
+   // map to eye space, with x to the right of the view and y up
+   worldMatrix[ 0] =  s; worldMatrix[ 4] = -c; worldMatrix[ 8] = 0.0f; worldMatrix[12] = -(x * s - y * c);
+   worldMatrix[ 1] =  0; worldMatrix[ 5] =  0; worldMatrix[ 9] = 1.0f; worldMatrix[13] = -z;
+   worldMatrix[ 2] = -c; worldMatrix[ 6] = -s; worldMatrix[10] = 0.0f; worldMatrix[14] = x * c + y * s;
+   worldMatrix[ 3] =  0; worldMatrix[ 7] =  0; worldMatrix[11] = 0.0f; worldMatrix[15] = 1.0f;
+
+   worldPending = true;
+}
+
+//
+// Add a convex polygon of count vertices, textured with the graphic from lump
+// and lit as for a software renderer light level of light, going no lower
+// than lightmin, at a rate of lightk. Sky masks ignore lump and the lights.
+//
+void GL_AddWorldSurface(glworldsurf_t type, int lump, const glworldvtx_t *verts, int count,
+                        int light, int lightmin, int lightk)
+{
+   worldtexture_t     *wt = nullptr;
+   std::vector<vtx_t> *out;
+
+   if(!worldPending || count < 3 || type < 0 || type >= GLWS_NUMSURFS)
+      return;
+
+   if(type != GLWS_SKYMASK)
+   {
+      auto itr = worldTextures.find(lump);
+      if(itr == worldTextures.end())
+         return;
+      wt = &itr->second;
+   }
+
+   if(type == GLWS_WORLD)
+   {
+      if(wt->verts.empty())
+         worldUsed.push_back(wt);
+      out = &wt->verts;
+   }
+   else
+   {
+      worldlist_t &list = worldLists[type];
+      int first = int(list.verts.size());
+
+      // join a run of the same texture
+      if(!list.runs.empty() && list.runs.back().wt == wt)
+         list.runs.back().count += (count - 2) * 3;
+      else
+         list.runs.push_back({ wt, first, (count - 2) * 3 });
+      out = &list.verts;
+   }
+
+   // fan out the polygon into triangles
+   for(int i = 2; i < count; i++)
+   {
+      const glworldvtx_t *tri[3] = { &verts[0], &verts[i - 1], &verts[i] };
+
+      for(const glworldvtx_t *wv : tri)
+      {
+         vtx_t v;
+
+         v.coords[VTX_X] = wv->x;
+         v.coords[VTX_Y] = wv->y;
+         v.coords[VTX_Z] = wv->z;
+         v.txcoords[VTX_U] = wt ? wv->u * wt->uscale : 0.0f;
+         v.txcoords[VTX_V] = wt ? wv->v * wt->vscale : 0.0f;
+         v.colors[VTX_R] = rbbyte(light);
+         v.colors[VTX_G] = rbbyte(lightmin);
+         v.colors[VTX_B] = rbbyte(lightk);
+         v.colors[VTX_A] = 0xff;
+         out->push_back(v);
+      }
+   }
+}
+
+//
+// Draw a list of surfaces in order
+//
+static void GL_drawWorldList(worldlist_t &list)
+{
+   if(list.verts.empty())
+      return;
+
+   RB_BindDrawPointers(&list.verts[0], int(list.verts.size()));
+   for(const worldrun_t &run : list.runs)
+   {
+      if(run.wt)
+         run.wt->tex.bind();
+      RB_DrawArrays(GL_TRIANGLES, run.first, run.count);
+   }
+}
+
+//
+// Set up a projection of view pixels, for sky and overlay surfaces
+//
+static void GL_setViewOrtho(double viewwidth)
+{
+   glMatrixMode(GL_PROJECTION);
+   glLoadIdentity();
+   glOrtho(0.0, viewwidth, VIEWHEIGHT, 0.0, -1.0, 1.0);
+   glMatrixMode(GL_MODELVIEW);
+   glLoadIdentity();
+}
+
+//
+// Set up the software renderer's projection of the view handed over
+//
+static void GL_setViewPerspective(double viewwidth)
+{
+   const double xn = ZNEAR * (viewwidth  / 2.0) / FOCALX;
+   const double yn = ZNEAR * (VIEWHEIGHT / 2.0) / FOCALY;
+
+   glMatrixMode(GL_PROJECTION);
+   glLoadIdentity();
+   glFrustum(-xn, xn, -yn, yn, ZNEAR, ZFAR);
+   glMatrixMode(GL_MODELVIEW);
+   glLoadMatrixf(worldMatrix);
+}
+
+//
+// Check whether a frame has been handed over to be drawn
+//
+int GL_WorldPending(void)
+{
+   return worldPending;
+}
+
+//
+// Draw the frame handed over into the game screen rect (gx, gy, gw, gh),
+// with the screen shading shade. Returns false if there is no frame to draw,
+// in which case the software framebuffer should be drawn instead.
+//
+int GL_DrawWorld(int gx, int gy, unsigned int gw, unsigned int gh, int shade)
+{
+   int sx, sy, winw, winh;
+   const double viewwidth = VIEWWIDTH * gw / CALICO_ORIG_SCREENWIDTH;
+
+   if(!worldPending || !RB_BeginWorldDecode(CRY_ADDC(shade), CRY_ADDR(shade), CRY_ADDY(shade)))
+      return false;
+
+   // GL counts viewport rows from the bottom of the window
+   hal_video.transformGameCoord2i(gx, gy, &sx, &sy);
+   hal_video.getWindowSize(&winw, &winh);
+
+   const rbScissor_t rect =
+   {
+      sx,
+      winh - (sy + int(hal_video.transformHeight(gh))),
+      int(hal_video.transformWidth(gw)),
+      int(hal_video.transformHeight(gh))
+   };
+
+   glViewport(rect.x, rect.y, rect.width, rect.height);
+   RB_SetScissorRect(rect);
+   RB_SetState(RB_GLSTATE_SCISSOR, true);
+   glClear(GL_DEPTH_BUFFER_BIT);
+
+   RB_SetState(RB_GLSTATE_CULL, false);
+   RB_SetState(RB_GLSTATE_BLEND, false);
+   RB_SetState(RB_GLSTATE_ALPHATEST, false);
+
+   // sky, behind everything
+   GL_setViewOrtho(viewwidth);
+   RB_SetState(RB_GLSTATE_DEPTHTEST, false);
+   glDepthMask(GL_FALSE);
+   GL_drawWorldList(worldLists[GLWS_SKY]);
+
+   // sky ceilings hide what is behind them, and show the sky
+   GL_setViewPerspective(viewwidth);
+   RB_SetState(RB_GLSTATE_DEPTHTEST, true);
+   glDepthMask(GL_TRUE);
+   RB_EndCRYDecode();
+   glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+   GL_drawWorldList(worldLists[GLWS_SKYMASK]);
+   glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+   // walls, flats, and sprites in any order, one draw per texture
+   RB_BeginWorldDecode(CRY_ADDC(shade), CRY_ADDR(shade), CRY_ADDY(shade));
+   for(worldtexture_t *wt : worldUsed)
+   {
+      wt->tex.bind();
+      RB_BindDrawPointers(&wt->verts[0], int(wt->verts.size()));
+      RB_DrawArrays(GL_TRIANGLES, 0, int(wt->verts.size()));
+   }
+
+   // player weapon sprites, over everything
+   GL_setViewOrtho(viewwidth);
+   RB_SetState(RB_GLSTATE_DEPTHTEST, false);
+   GL_drawWorldList(worldLists[GLWS_OVERLAY]);
+
+   // back to the whole window for everything else
+   RB_EndCRYDecode();
+   RB_SetState(RB_GLSTATE_SCISSOR, false);
+   glViewport(0, 0, winw, winh);
+   glMatrixMode(GL_PROJECTION);
+   glLoadIdentity();
+   glOrtho(0.0, GLdouble(winw), GLdouble(winh), 0.0, -1.0, 1.0);
+   glMatrixMode(GL_MODELVIEW);
+   glLoadIdentity();
+
+   return true;
+}
+
+// EOF
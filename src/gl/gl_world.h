@@ -0,0 +1,71 @@
+/*
+  CALICO
+
+  OpenGL world rendering
+
+  The MIT License (MIT)
+
+  Copyright (C) 2016 James Haley
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef GL_WORLD_H__
+#define GL_WORLD_H__
+
+//
+// Surfaces handed over by the hardware renderer. Sky and overlay surfaces
+// are given in 160x180 view pixels rather than map units, and ignore z.
+//
+typedef enum glworldsurf_e
+{
+   GLWS_SKY,     // drawn behind everything else
+   GLWS_SKYMASK, // sky ceilings, which only hide what is behind them
+   GLWS_WORLD,   // walls, flats, and sprites
+   GLWS_OVERLAY, // player weapon sprites, drawn over everything in order
+   GLWS_NUMSURFS
+} glworldsurf_t;
+
+typedef struct glworldvtx_s
+{
+   float x, y, z; // map units, with z up
+   float u, v;    // in texels
+} glworldvtx_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int  GL_WorldAvailable(void);
+int  GL_HasWorldTexture(int lump);
+void GL_NewWorldTexture(int lump, const unsigned int *texels, unsigned int w, unsigned int h);
+void GL_BeginWorld(float x, float y, float z, float angle);
+void GL_AddWorldSurface(glworldsurf_t type, int lump, const glworldvtx_t *verts, int count,
+                        int light, int lightmin, int lightk);
+int  GL_WorldPending(void);
+int  GL_DrawWorld(int x, int y, unsigned int w, unsigned int h, int shade);
+void GL_ClearWorld(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+// EOF
@@ -26,21 +26,44 @@
   SOFTWARE.
 */
 
+#include <utility>
+
 #include "../elib/elib.h"
+#include "../elib/zone.h"
 #include "resource.h"
 
+//=============================================================================
+//
+// Resource
+//
+
+//
+// Destructor; leave the hive, if in one.
+//
+Resource::~Resource()
+{
+   if(m_hive)
+      m_hive->removeResource(this);
+}
+
 //=============================================================================
 //
 // ResourceHive
 //
 
+// never dereferenced; only needs an address no real resource can have
+static char tombstoneObject;
+
+Resource *const ResourceHive::Tombstone = reinterpret_cast<Resource *>(&tombstoneObject);
+
+static const unsigned int MINSLOTS = 256;
+
 //
 // Constructor
 //
 ResourceHive::ResourceHive()
+   : m_slots(nullptr), m_numslots(0), m_count(0), m_numused(0), m_serial(0)
 {
-   for(int i = 0; i < NUMCHAINS; i++)
-      chains[i].head = nullptr;
 }
 
 //
@@ -49,16 +72,144 @@ ResourceHive::ResourceHive()
 ResourceHive::~ResourceHive()
 {
    purgeAll();
+   if(m_slots)
+      efree(m_slots);
+}
+
+//
+// Put a resource in the first free slot along its probe sequence, after any
+// newer resource of the same name and ahead of any older one, which is moved
+// further along in turn.
+//
+void ResourceHive::insertSlot(Resource *res)
+{
+   unsigned int mask = m_numslots - 1;
+   unsigned int hc   = res->hashCode();
+   unsigned int i    = hc & mask;
+   slot_t      *free = nullptr;
+
+   for(;; i = (i + 1) & mask)
+   {
+      slot_t *slot = &m_slots[i];
+
+      if(!slot->res)
+      {
+         if(!free)
+         {
+            free = slot;
+            ++m_numused;
+         }
+         break;
+      }
+
+      if(slot->res == Tombstone)
+      {
+         if(!free)
+            free = slot;
+      }
+      else if(slot->hash == hc && slot->res->getTag() == res->getTag())
+      {
+         // if this one is newer it goes here instead, and the older one looks
+         // for a slot later on; either way the older one must come after
+         if(slot->res->m_serial < res->m_serial)
+            std::swap(slot->res, res);
+         free = nullptr;
+      }
+   }
+
+   free->hash = hc;
+   free->res  = res;
+}
+
+//
+// Move every resource into a new table of the given size
+//
+void ResourceHive::rehash(unsigned int numslots)
+{
+   slot_t      *oldslots    = m_slots;
+   unsigned int oldnumslots = m_numslots;
+
+   m_slots    = ecalloc(slot_t, numslots, sizeof(slot_t));
+   m_numslots = numslots;
+   m_numused  = 0;
+
+   for(unsigned int i = 0; i < oldnumslots; i++)
+   {
+      if(oldslots[i].res && oldslots[i].res != Tombstone)
+         insertSlot(oldslots[i].res);
+   }
+
+   if(oldslots)
+      efree(oldslots);
 }
 
 //
-// Add a new resource. It will be head-inserted into its hash chain, so if 
-// there are multiple resources of the same name, the newest one added wins.
+// Add a new resource. If there are multiple resources of the same name, the 
+// newest one added wins.
 //
 void ResourceHive::addResource(Resource *res)
 {
-   unsigned int hc = res->hashCode() % NUMCHAINS;
-   chains[hc].insert(res);
+   if(res->m_hive)
+      res->m_hive->removeResource(res);
+
+   // once three quarters of the slots have been used, rebuild the table at a
+   // size where the resources it really holds fill no more than half of it
+   if((m_numused + 1) * 4 > m_numslots * 3)
+   {
+      unsigned int numslots = m_numslots ? m_numslots : MINSLOTS;
+
+      while((m_count + 1) * 2 > numslots)
+         numslots *= 2;
+      rehash(numslots);
+   }
+
+   res->m_hive   = this;
+   res->m_serial = ++m_serial;
+   insertSlot(res);
+   ++m_count;
+}
+
+//
+// Take a resource out of the hive without deleting it
+//
+void ResourceHive::removeResource(Resource *res)
+{
+   unsigned int mask = m_numslots - 1;
+   unsigned int i    = res->hashCode() & mask;
+
+   for(; m_slots[i].res; i = (i + 1) & mask)
+   {
+      if(m_slots[i].res == res)
+      {
+         m_slots[i].res = Tombstone;
+         --m_count;
+         break;
+      }
+   }
+
+   res->m_hive = nullptr;
+}
+
+//
+// CALICO: Find a resource by its tag name and the tag's hash code. Names
+// are only compared for resources whose tags have the same hash code.
+//
+Resource *ResourceHive::findResource(const char *tag, unsigned int hc)
+{
+   if(!m_count)
+      return nullptr;
+
+   unsigned int mask = m_numslots - 1;
+
+   for(unsigned int i = hc & mask; m_slots[i].res; i = (i + 1) & mask)
+   {
+      const slot_t &slot = m_slots[i];
+
+      if(slot.hash == hc && slot.res != Tombstone && slot.res->getTag() == tag)
+         return slot.res;
+   }
+
+   return nullptr;
 }
 
 //
@@ -67,21 +218,16 @@ void ResourceHive::addResource(Resource *res)
 //
 Resource *ResourceHive::findResource(const char *tag)
 {
-   unsigned int hc = qstring::HashCodeStatic(tag) % NUMCHAINS;
-   DLListItem<Resource> *res = chains[hc].head;
-
-   while(res && res->dllObject->getTag() != tag)
-      res = res->dllNext;
-   
-   return res ? res->dllObject : nullptr;
+   return findResource(tag, qstring::HashCodeStatic(tag));
 }
 
 //
 // Convenience method for loading a resource given a qstring instance.
+// CALICO: uses the qstring's own hash code, if it has one already.
 //
 Resource *ResourceHive::findResource(const qstring &tag)
 {
-   return findResource(tag.constPtr());
+   return findResource(tag.constPtr(), tag.hashCode());
 }
 
 //
@@ -139,17 +285,20 @@ bool ResourceHive::purgeAllResourceNamed(const char *tag)
 //
 void ResourceHive::purgeAll()
 {
-   for(int i = 0; i < NUMCHAINS; i++)
+   for(unsigned int i = 0; i < m_numslots; i++)
    {
-      auto item = chains[i].head;
+      Resource *res = m_slots[i].res;
 
-      while(item)
+      if(res && res != Tombstone)
       {
-         DLListItem<Resource> *next = item->dllNext;
-         delete item->dllObject;
-         item = next;
+         res->m_hive = nullptr; // nothing to look for
+         delete res;
       }
+      m_slots[i].res = nullptr;
    }
+
+   m_count   = 0;
+   m_numused = 0;
 }
 
 //
@@ -157,16 +306,12 @@ void ResourceHive::purgeAll()
 //
 void ResourceHive::forEach(foreachfn_t fn)
 {
-   for(int i = 0; i < NUMCHAINS; i++)
+   for(unsigned int i = 0; i < m_numslots; i++)
    {
-      auto item = chains[i].head;
+      Resource *res = m_slots[i].res;
 
-      while(item)
-      {
-         DLListItem<Resource> *next = item->dllNext;
-         fn(item->dllObject);
-         item = next;
-      }
+      if(res && res != Tombstone)
+         fn(res);
    }
 }
 
@@ -29,9 +29,10 @@
 #ifndef RESOURCE_H__
 #define RESOURCE_H__
 
-#include "../elib/dllist.h"
 #include "../elib/qstring.h"
 
+class ResourceHive;
+
 //
 // Inherit from this class to participate in resource management.
 //
@@ -40,20 +41,17 @@ class Resource
 protected:
    friend class ResourceHive;
 
-   qstring m_tag;
-   DLListItem<Resource> m_links;
+   qstring       m_tag;
+   ResourceHive *m_hive;   // hive holding this resource, if any
+   unsigned int  m_serial; // order added to the hive; the newest of a name wins
 
 public:
    Resource(const char *tag)
-      : m_tag(tag), m_links()
+      : m_tag(tag), m_hive(nullptr), m_serial(0)
    {
    }
 
-   virtual ~Resource() 
-   {
-      if(m_links.dllPrev)
-         m_links.remove();
-   }
+   virtual ~Resource();
 
    const qstring &getTag()   const { return m_tag; }
    unsigned int   hashCode() const { return m_tag.hashCode(); }
@@ -62,11 +60,35 @@ public:
 //
 // Manages resources.
 //
+// CALICO: Resources are kept in an open-addressed table with linear
+// probing, which grows to keep itself no more than three quarters full.
+// Each slot holds the hash code of its resource's tag, so a probe only
+// compares names once the hash codes match. Resources themselves never
+// move, so pointers to them stay good until they are purged.
+//
 class ResourceHive
 {
 protected:
-   enum chaincount_e { NUMCHAINS = 257 };
-   DLList<Resource, &Resource::m_links> chains[NUMCHAINS];
+   struct slot_t
+   {
+      unsigned int  hash;
+      Resource     *res; // nullptr if empty, or Tombstone
+   };
+
+   static Resource *const Tombstone; // marks a slot whose resource was removed
+
+   slot_t      *m_slots;
+   unsigned int m_numslots;  // always a power of two
+   unsigned int m_count;     // resources held
+   unsigned int m_numused;   // slots not empty, including tombstones
+   unsigned int m_serial;
+
+   friend class Resource;
+
+   Resource *findResource(const char *tag, unsigned int hc);
+   void      insertSlot(Resource *res);
+   void      rehash(unsigned int numslots);
+   void      removeResource(Resource *res);
 
 public:
    ResourceHive();
@@ -96,24 +118,25 @@ public:
    bool purgeAllResourceNamed(const char *tag);
    void purgeAll();
 
+   unsigned int getNumResources() const { return m_count; }
+
+   //
+   // Callbacks may purge resources, including the one they are given, but
+   // must not add any.
+   //
    typedef void (*foreachfn_t)(Resource *);
    void forEach(foreachfn_t fn);   
 
    template<typename T>
    void forEachOfType(void (*fn)(T *))
    {
-      for(int i = 0; i < NUMCHAINS; i++)
+      for(unsigned int i = 0; i < m_numslots; i++)
       {
-         auto item = chains[i].head;
-
-         while(item)
-         {
-            auto next = item->dllNext;
-            T *asT;
-            if((asT = dynamic_cast<T *>(item->dllObject)))
-               fn(asT);
-            item = next;
-         }
+         Resource *res = m_slots[i].res;
+         T *asT;
+
+         if(res && res != Tombstone && (asT = dynamic_cast<T *>(res)))
+            fn(asT);
       }
    }
 };
@@ -32,7 +32,11 @@
 #include "../posix/posix_platform.h"
 #include "../win32/win32_platform.h"
 
-hal_bool HAL_Init(void)
+//
+// Set up the HAL. With headless true, no window, input, or sound devices are
+// used.
+//
+hal_bool HAL_Init(hal_bool headless)
 {
    hal_bool res = HAL_FALSE;
 
@@ -46,6 +50,8 @@ hal_bool HAL_Init(void)
    // initialize media layer HAL
 #ifdef USE_SDL2
    SDL2_InitHAL();
+   if(headless)
+      SDL2_InitHeadlessHAL();
    res = hal_medialayer.init();
 #endif
 
@@ -31,7 +31,7 @@
 
 #include "hal_types.h"
 
-hal_bool HAL_Init(void);
+hal_bool HAL_Init(hal_bool headless);
 
 #endif
 
@@ -31,6 +31,15 @@
 
 #include "hal_types.h"
 
+// what the game should do while its window is in the background
+typedef enum hal_background_e
+{
+   HAL_BACKGROUND_NONE,     // focused, or set to carry on as usual
+   HAL_BACKGROUND_THROTTLE, // unfocused: run, but draw less often
+   HAL_BACKGROUND_HIDDEN,   // minimized: run, but don't draw
+   HAL_BACKGROUND_PAUSE     // stop until the window comes back
+} hal_background_t;
+
 typedef struct hal_appstate_s
 {
    hal_bool (*mouseShouldBeGrabbed)(void);
@@ -38,6 +47,7 @@ typedef struct hal_appstate_s
    void     (*updateFocus)(void);
    void     (*setGrabState)(hal_bool state);
    hal_bool (*gameGrabCallback)(void);
+   int      (*getBackgroundState)(void); // a hal_background_t
 } hal_appstate_t;
 
 typedef struct hal_input_s
@@ -31,13 +31,19 @@
 
 #include "hal_types.h"
 
+// CPU instruction set extensions reported by getCPUFeatures
+#define HAL_CPU_SSE2 0x00000001
+#define HAL_CPU_AVX2 0x00000002
+#define HAL_CPU_NEON 0x00000004
+
 typedef struct hal_medialayer_s
 {
-   hal_bool (*init)(void);
-   void     (*exit)(void);
-   void     (*error)(void);
-   int      (*msgbox)(const char *title, const char *msg, hal_bool isError);
-   hal_bool (*isExiting)(void);
+   hal_bool     (*init)(void);
+   void         (*exit)(void);
+   void         (*error)(void);
+   int          (*msgbox)(const char *title, const char *msg, hal_bool isError);
+   hal_bool     (*isExiting)(void);
+   unsigned int (*getCPUFeatures)(void);
 } hal_medialayer_t;
 
 #ifdef __cplusplus
@@ -0,0 +1,72 @@
+/*
+  CALICO
+  
+  HAL Network Interface
+  
+  The MIT License (MIT)
+  
+  Copyright (c) 2016 James Haley
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef HAL_NET_H__
+#define HAL_NET_H__
+
+#include "hal_types.h"
+
+// A single UDP link to the other player. Opening with no host listens on
+// the port, and the peer is then whoever last sent a datagram to it. A
+// dedicated server instead tells its peers apart with receiveFrom, which
+// numbers each new sender in turn, and answers them with sendTo.
+//
+// Streams are TCP connections for spectators: a server listens and sends
+// the same bytes to each client it accepts, and a client connects to one
+// server and only reads.
+typedef struct hal_net_s
+{
+   hal_bool (*open)(const char *host, int port);
+   void     (*close)(void);
+   hal_bool (*send)(const void *data, int len);
+   int      (*receive)(void *data, int maxlen); // 0 if nothing waiting; never blocks
+   hal_bool (*sendTo)(int peer, const void *data, int len);
+   int      (*receiveFrom)(void *data, int maxlen, int *peer);
+
+   hal_bool (*listenStream)(int port);
+   int      (*acceptStream)(void); // a new client's number, or -1; never blocks
+   hal_bool (*sendStream)(int client, const void *data, int len); // -1 for all; closes on failure
+   void     (*closeStreams)(void); // all clients, or the connection to the server
+   hal_bool (*connectStream)(const char *host, int port);
+   int      (*receiveStream)(void *data, int maxlen); // 0 if nothing waiting, -1 if closed
+} hal_net_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern hal_net_t hal_net;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+// EOF
+
@@ -29,6 +29,20 @@
 #ifndef HAL_PLATFORM_H__
 #define HAL_PLATFORM_H__
 
+#include <stddef.h>
+
+// CALICO: an open serial port
+typedef void *hal_serialhandle_t;
+
+// CALICO: thread priorities for setThreadPriority
+enum
+{
+   HAL_PRIORITY_LOW = -1,
+   HAL_PRIORITY_NORMAL,
+   HAL_PRIORITY_HIGH,
+   HAL_PRIORITY_REALTIME // time-critical audio; MMCSS on Windows
+};
+
 typedef struct hal_platform_s
 {
    void        (*debugMsg)(const char *msg, ...);
@@ -36,6 +50,32 @@ typedef struct hal_platform_s
    void        (*fatalError)(const char *msg, ...);
    const char *(*getWriteDirectory)(void);
    void        (*setIcon)(void);
+   const void *(*mapFile)(const char *filename, long *length); // CALICO: read-only; may be NULL
+
+   // CALICO: serial ports for a link cable, 8N1 with no flow control; may be
+   // NULL. readSerial waits a millisecond or so for input, returning the
+   // bytes read or -1 on a line error.
+   hal_serialhandle_t (*openSerial)(const char *device, int baud);
+   void               (*closeSerial)(hal_serialhandle_t port);
+   int                (*readSerial)(hal_serialhandle_t port, void *buf, int maxlen);
+   int                (*writeSerial)(hal_serialhandle_t port, const void *buf, int len);
+
+   // CALICO: scheduling of the calling thread; may be NULL. Each returns
+   // nonzero if the system accepted the request. core is a logical CPU
+   // number. setTimerResolution sets the system timer period in ms, or
+   // restores the default when given 0.
+   int                (*setThreadPriority)(int priority);
+   int                (*setThreadAffinity)(int core);
+   int                (*setTimerResolution)(int ms);
+
+   // CALICO: resident memory of the process now and at its peak, in bytes;
+   // may be NULL. Either is left 0 where the system can't tell.
+   void               (*getProcessMemory)(size_t *resident, size_t *peak);
+
+   // CALICO: put a file in place of another in one step, so that nothing
+   // can find a filename with neither file there; may be NULL. Returns
+   // nonzero on success.
+   int                (*replaceFile)(const char *tmpname, const char *filename);
 } hal_platform_t;
 
 #ifdef __cplusplus
@@ -36,17 +36,38 @@
 
 #include "hal_types.h"
 
+// music renderer run by the mixer; adds frames of interleaved stereo to buffer
+// and returns the number of voices it has sounding
+typedef int (*hal_musicrender_t)(float *buffer, int frames);
+
+// output timing gathered since the last getStats call
+typedef struct hal_soundstats_s
+{
+   unsigned int callbackInterval; // longest time between mixer callbacks, in us
+   unsigned int underruns;        // callbacks which came too late
+   unsigned int startLatency;     // startSound to output of the latest sound, in us; 0 if none
+   unsigned int dspLoadPeak;      // most of a buffer period spent mixing, in 0.1% units
+   unsigned int dspLoadAvg;       // average of the same; both 0 if no callbacks ran
+   unsigned int voicesPeak;       // most sound effect and music voices mixed at once
+} hal_soundstats_t;
+
 typedef struct hal_sound_s
 {
    hal_bool (*initSound)(void);
    hal_bool (*isInit)(void);
    int      (*startSound)(float *data, size_t numsamples, int volume, hal_bool loop);
    void     (*stopSound)(int handle);
+   void     (*setSoundParams)(int handle, int volume, int separation);
    hal_bool (*isSamplePlaying)(int handle);
    hal_bool (*isSampleAtStart)(int handle);
    void     (*stopAllChannels)(void);
    void     (*updateEQParams)(void);
    int      (*getSampleRate)(void);
+   int      (*getNumChannels)(void);
+   void     (*setMusicRenderer)(hal_musicrender_t renderer);
+   void     (*getStats)(hal_soundstats_t *stats);
+   void     (*holdLoops)(hal_bool hold); // stop looped sounds and music where they are
+   void     (*batchCommands)(hal_bool begin); // optional; hold what is posted until the end
 } hal_sound_t;
 
 #ifdef __cplusplus
@@ -0,0 +1,62 @@
+/*
+  CALICO
+  
+  HAL Thread Interface
+  
+  The MIT License (MIT)
+  
+  Copyright (c) 2016 James Haley
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef HAL_THREAD_H__
+#define HAL_THREAD_H__
+
+// Opaque handles to platform threads and semaphores
+typedef void *hal_threadhandle_t;
+typedef void *hal_semhandle_t;
+
+typedef int (*hal_threadfunc_t)(void *);
+
+typedef struct hal_threads_s
+{
+   hal_threadhandle_t (*createThread)(hal_threadfunc_t func, const char *name, void *data);
+   int                (*waitThread)(hal_threadhandle_t thread);
+   hal_semhandle_t    (*createSemaphore)(unsigned int initialValue);
+   void               (*destroySemaphore)(hal_semhandle_t sem);
+   void               (*semPost)(hal_semhandle_t sem);
+   void               (*semWait)(hal_semhandle_t sem);
+   int                (*getCPUCount)(void);
+} hal_threads_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern hal_threads_t hal_threads;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+// EOF
+
@@ -29,6 +29,8 @@
 #ifndef HAL_TIMER_H__
 #define HAL_TIMER_H__
 
+#include <stdint.h>
+
 #define CALICO_GLOBAL_FPS 15
 
 typedef struct hal_timer_s
@@ -36,6 +38,9 @@ typedef struct hal_timer_s
    void         (*delay)(unsigned int ms);
    unsigned int (*getTime)(void);
    unsigned int (*getTimeMS)(void);
+   unsigned int (*getTimeUS)(void); // monotonic, for profiling; wraps
+   uint64_t     (*getTimeNS)(void); // monotonic from startup; doesn't wrap
+   void         (*sleepUntilNS)(uint64_t ns); // until getTimeNS reaches ns
 } hal_timer_t;
 
 #ifdef __cplusplus
@@ -57,6 +57,7 @@ typedef struct hal_video_s
    unsigned int  (*transformHeight)(unsigned int h);
    int           (*toggleGLSwap)(hal_bool swap);
    void          (*endFrame)(void);
+   unsigned int  (*getPresentInterval)(void); // microseconds
    int           (*isFullScreen)(void);
    int           (*getCurrentDisplay)(void);
    unsigned int  (*getWindowFlags)(void);
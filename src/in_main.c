@@ -2,6 +2,7 @@
 /* in_main.c -- intermission */
 #include "hal/hal_input.h"
 #include "doomdef.h"
+#include "m_text.h"
 #include "st_main.h"
 
 #define KVALX 172
@@ -89,58 +90,74 @@ jagobj_t *snums[10];
 jagobj_t *infaces[10];
 jagobj_t *uchar[52];
 
+// CALICO: cached layouts of the intermission's strings and values
+static textcache_t labeltext[4];
+static textcache_t valuetext[6];
+
 //
 // Lame-o print routine
+// CALICO: laid out into a text cache, only when the string has changed
 //
-void print(int x, int y, char *string)
+void print(textcache_t *tc, int x, int y, char *string)
 {
    int i, c;
    int len = mystrlen(string);
 
-   for(i = 0; i < len; i++)
+   if(M_TextChanged(tc, string, x, y))
    {
-      c = string[i];
-
-      if(c >= 'A' && c <= 'Z')
-      {
-         DrawJagobj(uchar[c-'A'], x, y, NULL);
-         x += BIGSHORT(uchar[c-'A']->width); // CALICO: endianness
-      }
-      else if(c >= 'a' && c <= 'z')
-      {
-         DrawJagobj(uchar[c-'a' + 26], x, y + 4, NULL);
-         x += BIGSHORT(uchar[c-'a' + 26]->width);
-      }
-      else if(c >= '0' && c <= '9')
+      for(i = 0; i < len; i++)
       {
-         DrawJagobj(snums[c-48], x, y, NULL);
-         x += BIGSHORT(snums[c-48]->width) + 1;
-      }
-      else
-      {
-         x += 6;
-         continue;
+         c = string[i];
+
+         if(c >= 'A' && c <= 'Z')
+         {
+            M_AddTextGlyph(uchar[c-'A'], x, y);
+            x += BIGSHORT(uchar[c-'A']->width); // CALICO: endianness
+         }
+         else if(c >= 'a' && c <= 'z')
+         {
+            M_AddTextGlyph(uchar[c-'a' + 26], x, y + 4);
+            x += BIGSHORT(uchar[c-'a' + 26]->width);
+         }
+         else if(c >= '0' && c <= '9')
+         {
+            M_AddTextGlyph(snums[c-48], x, y);
+            x += BIGSHORT(snums[c-48]->width) + 1;
+         }
+         else
+         {
+            x += 6;
+            continue;
+         }
       }
    }
+
+   M_DrawText(tc);
 }
 
 //
 // Draws 'value' at x, y
+// CALICO: through a text cache, like print
 //
-void IN_DrawValue(int x, int y, int value)
+void IN_DrawValue(textcache_t *tc, int x, int y, int value)
 {
    char v[4];
    int  j;
    int  index;
 
    valtostr(v, value, sizeof(v));
-   j = mystrlen(v) - 1;
-   while(j >= 0)
+   if(M_TextChanged(tc, v, x, y))
    {
-      index = (v[j--] - '0');
-      x -= BIGSHORT(snums[index]->width) + 2; // CALICO: endianness
-      DrawJagobj(snums[index], x, y, NULL);
+      j = mystrlen(v) - 1;
+      while(j >= 0)
+      {
+         index = (v[j--] - '0');
+         x -= BIGSHORT(snums[index]->width) + 2; // CALICO: endianness
+         M_AddTextGlyph(snums[index], x, y);
+      }
    }
+
+   M_DrawText(tc);
 }
 
 //
@@ -161,47 +178,40 @@ void IN_NetgameDrawer(void)
       }
    }
 
-   if(statsdrawn == false)
+   // CALICO: the graphics which never change are drawn into the framebuffer
+   // once; the text is drawn over it every frame from its cached layout, so
+   // there is no longer any need to erase the old values first
+   if(statsdrawn == false && netgame != gt_deathmatch)
    {
-      if(netgame == gt_deathmatch)
-      {
-         print(30 , FVALY, "Your Frags");
-         print(54 , FVALY + 40, "His Frags");
-         IN_DrawValue(FVALX, FVALY, fragvalue[consoleplayer]);
-         IN_DrawValue(FVALX, FVALY + 40, fragvalue[!consoleplayer]);
-      }
-      else
-      {
-         print(28, 50, "Player");
-         print(KVALX - 18, 50, "1");
-         print(KVALX + 66, 50, "2");
-         DrawJagobj(i_kills,  57,  80, NULL);
-         DrawJagobj(i_items,  51, 110, NULL);
-         DrawJagobj(i_secret, 13, 140, NULL);
-      }
+      DrawJagobj(i_kills,  57,  80, NULL);
+      DrawJagobj(i_items,  51, 110, NULL);
+      DrawJagobj(i_secret, 13, 140, NULL);
+      DrawJagobj(i_percent, KVALX,      KVALY, NULL);
+      DrawJagobj(i_percent, KVALX + 80, KVALY, NULL);
+      DrawJagobj(i_percent, IVALX,      IVALY, NULL);
+      DrawJagobj(i_percent, IVALX + 80, IVALY, NULL);
+      DrawJagobj(i_percent, SVALX,      SVALY, NULL);
+      DrawJagobj(i_percent, SVALX + 80, SVALY, NULL);
    }
 
    if(netgame == gt_deathmatch)
    {
-      EraseBlock(30 + (mystrlen("Your Frags") * 15), FVALY,  80, 80, NULL);
-      IN_DrawValue(FVALX, FVALY,      fragvalue[ consoleplayer]);
-      IN_DrawValue(FVALX, FVALY + 40, fragvalue[!consoleplayer]);
+      print(&labeltext[0], 30 , FVALY, "Your Frags");
+      print(&labeltext[1], 54 , FVALY + 40, "His Frags");
+      IN_DrawValue(&valuetext[0], FVALX, FVALY,      fragvalue[ consoleplayer]);
+      IN_DrawValue(&valuetext[1], FVALX, FVALY + 40, fragvalue[!consoleplayer]);
    }
    else
    {
-      EraseBlock(57 + (mystrlen("Kills") * 15), KVALY, 100, 100, NULL);
-      IN_DrawValue(KVALX,      KVALY,   killvalue[ consoleplayer]);
-      IN_DrawValue(KVALX + 80, KVALY,   killvalue[!consoleplayer]);
-      IN_DrawValue(IVALX,      IVALY,   itemvalue[ consoleplayer]);
-      IN_DrawValue(IVALX + 80, IVALY,   itemvalue[!consoleplayer]);
-      IN_DrawValue(SVALX,      SVALY, secretvalue[ consoleplayer]);
-      IN_DrawValue(SVALX + 80, SVALY, secretvalue[!consoleplayer]);
-      DrawJagobj(i_percent, KVALX,      KVALY, NULL);
-      DrawJagobj(i_percent, KVALX + 80, KVALY, NULL);
-      DrawJagobj(i_percent, IVALX,      IVALY, NULL);
-      DrawJagobj(i_percent, IVALX + 80, IVALY, NULL);
-      DrawJagobj(i_percent, SVALX,      SVALY, NULL);
-      DrawJagobj(i_percent, SVALX + 80, SVALY, NULL);
+      print(&labeltext[0], 28, 50, "Player");
+      print(&labeltext[1], KVALX - 18, 50, "1");
+      print(&labeltext[2], KVALX + 66, 50, "2");
+      IN_DrawValue(&valuetext[0], KVALX,      KVALY,   killvalue[ consoleplayer]);
+      IN_DrawValue(&valuetext[1], KVALX + 80, KVALY,   killvalue[!consoleplayer]);
+      IN_DrawValue(&valuetext[2], IVALX,      IVALY,   itemvalue[ consoleplayer]);
+      IN_DrawValue(&valuetext[3], IVALX + 80, IVALY,   itemvalue[!consoleplayer]);
+      IN_DrawValue(&valuetext[4], SVALX,      SVALY, secretvalue[ consoleplayer]);
+      IN_DrawValue(&valuetext[5], SVALX + 80, SVALY, secretvalue[!consoleplayer]);
    }
 }
 
@@ -219,34 +229,33 @@ void IN_SingleDrawer(void)
       secretvalue[0] = pstats[0].secretpercent;
    }
 
-   EraseBlock(71 + (mystrlen("Secrets") * 15), 70, 55, 80, NULL);
-
+   // CALICO: as in IN_NetgameDrawer, only the graphics go in the framebuffer
    if(statsdrawn == false)
    {
-      length = mystrlen(mapnames[gamemap - 1]);
-      print((320 - (length * 14)) >> 1 , 10, mapnames[gamemap - 1]);
-      length = mystrlen("Finished");
-      print((320 - (length * 14)) >> 1, 34, "Finished");
-
-      if(nextmap != 23)
-      {
-         length = mystrlen("Entering");
-         print((320 - (length * 14)) >> 1, 162, "Entering");
-         length = mystrlen(mapnames[nextmap - 1]);
-         print((320 - (length*14)) >> 1, 182, mapnames[nextmap - 1]);
-      }
-
       DrawJagobj(i_kills,  71,  70, NULL);
       DrawJagobj(i_items,  65, 100, NULL);
       DrawJagobj(i_secret, 27, 130, NULL);
+      DrawJagobj(i_percent, KVALX + 60, KVALY - 10, NULL);
+      DrawJagobj(i_percent, IVALX + 60, IVALY - 10, NULL);
+      DrawJagobj(i_percent, SVALX + 60, SVALY - 10, NULL);
+   }
+
+   length = mystrlen(mapnames[gamemap - 1]);
+   print(&labeltext[0], (320 - (length * 14)) >> 1 , 10, mapnames[gamemap - 1]);
+   length = mystrlen("Finished");
+   print(&labeltext[1], (320 - (length * 14)) >> 1, 34, "Finished");
+
+   if(nextmap != 23)
+   {
+      length = mystrlen("Entering");
+      print(&labeltext[2], (320 - (length * 14)) >> 1, 162, "Entering");
+      length = mystrlen(mapnames[nextmap - 1]);
+      print(&labeltext[3], (320 - (length*14)) >> 1, 182, mapnames[nextmap - 1]);
    }
 
-   IN_DrawValue(KVALX + 60, KVALY - 10, killvalue[0]);
-   DrawJagobj  (i_percent,  KVALX + 60, KVALY - 10, NULL);
-   IN_DrawValue(IVALX + 60, IVALY - 10, itemvalue[0]);
-   DrawJagobj  (i_percent,  IVALX + 60, IVALY - 10, NULL);
-   IN_DrawValue(SVALX + 60, SVALY - 10, secretvalue[0]);
-   DrawJagobj  (i_percent,  SVALX + 60, SVALY - 10, NULL);
+   IN_DrawValue(&valuetext[0], KVALX + 60, KVALY - 10, killvalue[0]);
+   IN_DrawValue(&valuetext[1], IVALX + 60, IVALY - 10, itemvalue[0]);
+   IN_DrawValue(&valuetext[2], SVALX + 60, SVALY - 10, secretvalue[0]);
 }
 
 void IN_Start(void)
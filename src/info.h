@@ -536,14 +536,17 @@ typedef enum
    NUMSTATES
 } statenum_t;
 
+// CALICO: the Jaguar's longs are ints, so that where long is 8 bytes a state
+// takes 40 bytes rather than 56, and everything a state transition reads is
+// within the first 28
 typedef struct
 {
    spritenum_t sprite;
-   long        frame;
-   long        tics;
+   int         frame;
+   int         tics;
    void        (*action)();
    statenum_t  nextstate;
-   long        misc1, misc2;
+   int         misc1, misc2;
 } state_t;
 
 extern state_t states[NUMSTATES];
@@ -27,9 +27,18 @@
 */
 
 #include <stdio.h>
+#include "m_save.h"
+
+#define EEPROMFILE  "eeprom.cal"
+#define EEPROMWORDS 8
 
 static FILE *eepromFile;
 
+// CALICO: the words last written, which are what reads should see even if
+// the saving thread hasn't written them out yet
+static unsigned short eepromImage[EEPROMWORDS];
+static int            eepromWritten;
+
 //
 // Open a file to use as the Jaguar EEPROM store.
 //
@@ -40,7 +49,7 @@ static void J_OpenEEPROM(const char *mode)
       fclose(eepromFile);
       eepromFile = NULL;
    }
-   eepromFile = fopen("eeprom.cal", mode);
+   eepromFile = fopen(EEPROMFILE, mode);
 }
 
 //
@@ -50,6 +59,9 @@ unsigned short eeread(int address)
 {
    unsigned short temp, value = 0;
 
+   if(eepromWritten)
+      return (address >= 0 && address < EEPROMWORDS) ? eepromImage[address] : 0;
+
    if(address == 0)
       J_OpenEEPROM("rb");
 
@@ -58,7 +70,7 @@ unsigned short eeread(int address)
       if(fread(&temp, sizeof(temp), 1, eepromFile) == 1)
          value = temp;
 
-      if(address == 7)
+      if(address == EEPROMWORDS - 1)
       {
          fclose(eepromFile);
          eepromFile = NULL;
@@ -69,24 +81,20 @@ unsigned short eeread(int address)
 }
 
 //
-// Write to emulated EEPROM
+// Write to emulated EEPROM. CALICO: the words are gathered up and saved in
+// the background once the last one is written.
 //
 int eewrite(int data, int address)
 {
-   unsigned short store = (unsigned short)data;
+   if(address < 0 || address >= EEPROMWORDS)
+      return -1;
 
-   if(address == 0)
-      J_OpenEEPROM("wb");
+   eepromImage[address] = (unsigned short)data;
 
-   if(eepromFile)
+   if(address == EEPROMWORDS - 1)
    {
-      fwrite(&store, sizeof(store), 1, eepromFile);
-      
-      if(address == 7)
-      {
-         fclose(eepromFile);
-         eepromFile = NULL;
-      }
+      eepromWritten = 1;
+      M_SaveFile(EEPROMFILE, eepromImage, sizeof(eepromImage));
    }
 
    return -1; // always successful (we currently lie if it wasn't...)
@@ -27,6 +27,8 @@
 */
 
 #include <stdint.h>
+#include <stdlib.h>
+#include "hal/hal_thread.h"
 #include "rb/rb_common.h"
 #include "jagcry.h"
 
@@ -120,5 +122,125 @@ void CRY_BuildRGBTable(void)
    }
 }
 
+//=============================================================================
+//
+// Pre-lit tables
+//
+// A lit table maps an unlit CRY texel directly to the RGB value it has after
+// a given light value has been applied, so that drawers need only a single
+// load per pixel. Only the whole luminance offset of a light value affects
+// the result, so there's one possible table per offset; normal sector light
+// levels only use 65 of them. Tables are built on first use and the least
+// recently used ones are freed between frames once more than the configured
+// number exist. Tables used on the most recent frame are always kept.
+//
+//=============================================================================
+
+typedef struct littable_s
+{
+   uint32_t *rgb;
+   unsigned int lastframe; // last frame on which the table was requested
+} littable_t;
+
+static littable_t      littables[CRY_NUMLUMAS];
+static int             numlittables;
+static int             maxlittables;
+static unsigned int    litframe;
+static hal_semhandle_t litlock;
+
+//
+// Set the number of lit tables to keep; 0 disables them.
+//
+void CRY_InitLitTables(int maxtables)
+{
+   maxlittables = maxtables;
+
+   if(maxlittables > 0 && !litlock && hal_threads.createSemaphore)
+      litlock = hal_threads.createSemaphore(1);
+}
+
+//
+// Build the lit table for a luminance offset
+//
+static uint32_t *CRY_BuildLitTable(int luma)
+{
+   uint32_t *rgb;
+   int i, y;
+
+   if(!(rgb = malloc(0x10000 * sizeof(*rgb))))
+      return NULL;
+
+   for(i = 0; i < 0x10000; i++)
+   {
+      y = (i & CRY_YMASK) + luma;
+      if(y < 0)
+         y = 0;
+      rgb[i] = CRYToRGB[(i & CRY_COLORMASK) | (y & 0xff)];
+   }
+
+   return rgb;
+}
+
+//
+// Get the lit table for a hardware light value, building it if needed.
+// Returns NULL if lit tables are disabled or memory is exhausted, in which
+// case the caller must light pixels itself. Safe to call from render threads.
+//
+const uint32_t *CRY_GetLitTable(int light)
+{
+   littable_t *lt;
+
+   if(maxlittables <= 0)
+      return NULL;
+
+   lt = &littables[CRY_LIGHTTOLUMA(light) - CRY_MINLUMA];
+   lt->lastframe = litframe;
+
+   if(!lt->rgb)
+   {
+      if(litlock)
+         hal_threads.semWait(litlock);
+
+      if(!lt->rgb && (lt->rgb = CRY_BuildLitTable(CRY_LIGHTTOLUMA(light))))
+         ++numlittables;
+
+      if(litlock)
+         hal_threads.semPost(litlock);
+   }
+
+   return lt->rgb;
+}
+
+//
+// Start a new frame, freeing least recently used tables which are over the
+// limit. Must not be called while any drawing is in progress.
+//
+void CRY_AgeLitTables(void)
+{
+   int i, oldest;
+
+   while(numlittables > maxlittables)
+   {
+      oldest = -1;
+      for(i = 0; i < CRY_NUMLUMAS; i++)
+      {
+         if(littables[i].rgb && littables[i].lastframe != litframe &&
+            (oldest < 0 || littables[i].lastframe < littables[oldest].lastframe))
+         {
+            oldest = i;
+         }
+      }
+
+      if(oldest < 0)
+         break; // everything in use was used on the last frame
+
+      free(littables[oldest].rgb);
+      littables[oldest].rgb = NULL;
+      --numlittables;
+   }
+
+   ++litframe;
+}
+
 // EOF
 
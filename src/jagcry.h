@@ -43,6 +43,19 @@
 
 #define CRY_IINCSHIFT 16
 
+// Whole luminance offset applied by a 24-bit hardware light value
+#define CRY_LIGHTTOLUMA(light) \
+   (((int32_t)((uint32_t)(light) << 8) >> 8) >> CRY_IINCSHIFT)
+
+// Signed components of a packed CRY color add, such as the screen shading
+#define CRY_ADDC(add) (((((add) & CRY_CMASK) >> CRY_CSHIFT) ^ 0x08) - 0x08)
+#define CRY_ADDR(add) (((((add) & CRY_RMASK) >> CRY_RSHIFT) ^ 0x08) - 0x08)
+#define CRY_ADDY(add) (((((add) & CRY_YMASK) >> CRY_YSHIFT) ^ 0x80) - 0x80)
+
+// Range of CRY_LIGHTTOLUMA
+#define CRY_MINLUMA   -128
+#define CRY_NUMLUMAS  256
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -52,6 +65,11 @@ extern uint32_t CRYToRGB[0x10000];
 
 void CRY_BuildRGBTable(void);
 
+// Pre-lit translation tables
+void            CRY_InitLitTables(int maxtables);
+const uint32_t *CRY_GetLitTable(int light);
+void            CRY_AgeLitTables(void);
+
 #ifdef __cplusplus
 }
 #endif
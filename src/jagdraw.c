@@ -0,0 +1,647 @@
+/*
+  CALICO
+
+  Column and span drawers
+
+  The reference drawers live in jagonly.c. The ones here process a batch of
+  pixels at a time with SIMD instructions and are selected at startup based
+  on what the host CPU supports. Pass -nosimd to force the reference drawers.
+
+  When pre-lit CRY tables are enabled (-littables <count>, 0 to disable), the
+  lit drawers at the bottom of this file go in front of whichever set was
+  chosen and reduce the inner loop to a single table load per pixel.
+
+  With -compactpixels, decoded graphics are palette indices rather than CRY.
+  The lit tables for those have one entry per palette index, so a table for
+  every light level takes no more room than a single CRY one, and they are
+  all built up front. The reference compact drawers are used when shading
+  is active or the tables are disabled, and there are no SIMD versions.
+
+  The MIT License (MIT)
+
+  Copyright (c) 2016 James Haley
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "hal/hal_ml.h"
+#include "hal/hal_platform.h"
+#include "doomdef.h"
+#include "jagcry.h"
+#include "jagdraw.h"
+#include "m_argv.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define CALICO_SIMD_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define CALICO_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(__GNUC__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
+#define DRAWBATCHSIZE 8
+
+// drawers in use
+void (*I_DrawColumn)(int, int, int, int, fixed_t, fixed_t, inpixel_t *, int) = I_DrawColumnC;
+void (*I_DrawColumnNPO2)(int, int, int, int, fixed_t, fixed_t, inpixel_t *, int) = I_DrawColumnNPO2C;
+void (*I_DrawSpan)(int, int, int, int, fixed_t, fixed_t, fixed_t, fixed_t, inpixel_t *) = I_DrawSpanC;
+void (*I_DrawShadowColumn)(int, int, int) = I_DrawShadowColumnC;
+
+// underlying drawers, used by the lit drawers when no table is available
+static void (*basecolumn)(int, int, int, int, fixed_t, fixed_t, inpixel_t *, int);
+static void (*basecolumnnpo2)(int, int, int, int, fixed_t, fixed_t, inpixel_t *, int);
+static void (*basespan)(int, int, int, int, fixed_t, fixed_t, fixed_t, fixed_t, inpixel_t *);
+
+// default number of pre-lit tables (256 KB each); covers all normal light levels
+#define DEFAULTLITTABLES 72
+
+boolean compactpixels; // CALICO: decoded graphics are palette indices
+
+// lit palette tables for compact pixels, one for each luminance offset
+static uint32_t (*palettelit)[256];
+
+extern int shadepixel;
+
+//
+// Per-call lighting and shading parameters, unpacked for the batch converters
+//
+typedef struct drawlight_s
+{
+   int luma;       // signed luminance offset
+   int shade;      // true if shadepixel is active
+   int sc, sr, sy; // signed shadepixel components
+} drawlight_t;
+
+struct cextender_s { signed int ext:4;  };
+struct iextender_s { signed int ext:8;  };
+
+//
+// Convert a hardware light value to a whole luminance offset. The reference
+// drawers add the 24-bit light value to the 8.16 luminance, clamp at zero,
+// and then drop the fraction; since the luminance has no fractional bits,
+// this gives the same result as adding the integer part alone.
+//
+static void I_SetupDrawLight(drawlight_t *dl, int light)
+{
+   struct cextender_s c;
+   struct iextender_s i;
+
+   dl->luma = CRY_LIGHTTOLUMA(light);
+
+   if((dl->shade = (shadepixel != 0)))
+   {
+      dl->sc = (c.ext = (shadepixel & CRY_CMASK) >> CRY_CSHIFT);
+      dl->sr = (c.ext = (shadepixel & CRY_RMASK) >> CRY_RSHIFT);
+      dl->sy = (i.ext = (shadepixel & CRY_YMASK) >> CRY_YSHIFT);
+   }
+}
+
+#ifdef CALICO_SIMD_X86
+
+//
+// Light and shade eight CRY texels in 16-bit lanes
+//
+TARGET_SSE2 static inline __m128i I_LightCRYSSE2(__m128i cry, const drawlight_t *dl)
+{
+   const __m128i zero  = _mm_setzero_si128();
+   const __m128i ymask = _mm_set1_epi16(CRY_YMASK);
+   __m128i y;
+
+   y   = _mm_add_epi16(_mm_and_si128(cry, ymask), _mm_set1_epi16((short)dl->luma));
+   y   = _mm_and_si128(_mm_max_epi16(y, zero), ymask);
+   cry = _mm_or_si128(_mm_andnot_si128(ymask, cry), y);
+
+   if(dl->shade)
+   {
+      const __m128i nibble = _mm_set1_epi16(0x0f);
+      __m128i cc = _mm_srli_epi16(cry, CRY_CSHIFT);
+      __m128i cr = _mm_and_si128(_mm_srli_epi16(cry, CRY_RSHIFT), nibble);
+      __m128i cy = _mm_and_si128(cry, ymask);
+
+      cc = _mm_add_epi16(cc, _mm_set1_epi16((short)dl->sc));
+      cr = _mm_add_epi16(cr, _mm_set1_epi16((short)dl->sr));
+      cy = _mm_add_epi16(cy, _mm_set1_epi16((short)dl->sy));
+
+      cc = _mm_min_epi16(_mm_max_epi16(cc, zero), nibble);
+      cr = _mm_min_epi16(_mm_max_epi16(cr, zero), nibble);
+      cy = _mm_min_epi16(_mm_max_epi16(cy, zero), ymask);
+
+      cry = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(cc, CRY_CSHIFT), 
+                                      _mm_slli_epi16(cr, CRY_RSHIFT)), cy);
+   }
+
+   return cry;
+}
+
+//
+// SSE2 batch: vector lighting, scalar table lookup
+//
+TARGET_SSE2 static inline void I_ConvertBatchSSE2(uint16_t *texels, uint32_t *out, 
+                                                  const drawlight_t *dl)
+{
+   int i;
+   __m128i cry = _mm_loadu_si128((const __m128i *)texels);
+
+   _mm_storeu_si128((__m128i *)texels, I_LightCRYSSE2(cry, dl));
+
+   for(i = 0; i < DRAWBATCHSIZE; i++)
+      out[i] = CRYToRGB[texels[i]];
+}
+
+//
+// AVX2 batch: vector lighting and gathered table lookup
+//
+TARGET_AVX2 static inline void I_ConvertBatchAVX2(uint16_t *texels, uint32_t *out, 
+                                                  const drawlight_t *dl)
+{
+   __m128i cry = I_LightCRYSSE2(_mm_loadu_si128((const __m128i *)texels), dl);
+   __m256i idx = _mm256_cvtepu16_epi32(cry);
+
+   _mm256_storeu_si256((__m256i *)out, 
+                       _mm256_i32gather_epi32((const int *)CRYToRGB, idx, 4));
+}
+
+#define DRAWFUNC(name) name##SSE2
+#define DRAWTARGET     TARGET_SSE2
+#define DRAWBATCH      I_ConvertBatchSSE2
+#include "jagdraw_kernels.h"
+#undef DRAWFUNC
+#undef DRAWTARGET
+#undef DRAWBATCH
+
+#define DRAWFUNC(name) name##AVX2
+#define DRAWTARGET     TARGET_AVX2
+#define DRAWBATCH      I_ConvertBatchAVX2
+#include "jagdraw_kernels.h"
+#undef DRAWFUNC
+#undef DRAWTARGET
+#undef DRAWBATCH
+
+#endif // CALICO_SIMD_X86
+
+#ifdef CALICO_SIMD_NEON
+
+//
+// NEON batch: vector lighting, scalar table lookup
+//
+static inline void I_ConvertBatchNEON(uint16_t *texels, uint32_t *out, 
+                                      const drawlight_t *dl)
+{
+   const uint16x8_t ymask = vdupq_n_u16(CRY_YMASK);
+   const int16x8_t  zero  = vdupq_n_s16(0);
+   uint16x8_t cry = vld1q_u16(texels);
+   int16x8_t  y;
+   int i;
+
+   y   = vaddq_s16(vreinterpretq_s16_u16(vandq_u16(cry, ymask)), vdupq_n_s16((int16_t)dl->luma));
+   y   = vmaxq_s16(y, zero);
+   cry = vorrq_u16(vbicq_u16(cry, ymask), vandq_u16(vreinterpretq_u16_s16(y), ymask));
+
+   if(dl->shade)
+   {
+      const int16x8_t nibble = vdupq_n_s16(0x0f);
+      int16x8_t cc = vreinterpretq_s16_u16(vshrq_n_u16(cry, CRY_CSHIFT));
+      int16x8_t cr = vandq_s16(vreinterpretq_s16_u16(vshrq_n_u16(cry, CRY_RSHIFT)), nibble);
+      int16x8_t cy = vreinterpretq_s16_u16(vandq_u16(cry, ymask));
+
+      cc = vminq_s16(vmaxq_s16(vaddq_s16(cc, vdupq_n_s16((int16_t)dl->sc)), zero), nibble);
+      cr = vminq_s16(vmaxq_s16(vaddq_s16(cr, vdupq_n_s16((int16_t)dl->sr)), zero), nibble);
+      cy = vminq_s16(vmaxq_s16(vaddq_s16(cy, vdupq_n_s16((int16_t)dl->sy)), zero), 
+                     vreinterpretq_s16_u16(ymask));
+
+      cry = vorrq_u16(vorrq_u16(vshlq_n_u16(vreinterpretq_u16_s16(cc), CRY_CSHIFT),
+                                vshlq_n_u16(vreinterpretq_u16_s16(cr), CRY_RSHIFT)),
+                      vreinterpretq_u16_s16(cy));
+   }
+
+   vst1q_u16(texels, cry);
+
+   for(i = 0; i < DRAWBATCHSIZE; i++)
+      out[i] = CRYToRGB[texels[i]];
+}
+
+#define DRAWFUNC(name) name##NEON
+#define DRAWTARGET
+#define DRAWBATCH      I_ConvertBatchNEON
+#include "jagdraw_kernels.h"
+#undef DRAWFUNC
+#undef DRAWTARGET
+#undef DRAWBATCH
+
+#endif // CALICO_SIMD_NEON
+
+//=============================================================================
+//
+// Lit drawers
+//
+// Shading is applied after lighting, so these step aside for the underlying
+// drawers whenever shadepixel is active rather than build tables which would
+// only be good for a few frames.
+//
+//=============================================================================
+
+static void I_DrawColumnLit(int dc_x, int dc_yl, int dc_yh, int light, fixed_t frac, 
+                            fixed_t fracstep, inpixel_t *dc_source, int dc_texheight)
+{
+   const uint32_t *lit;
+   int       count, heightmask;
+   uint32_t *dest;
+
+   if(shadepixel || !(lit = CRY_GetLitTable(light)))
+   {
+      basecolumn(dc_x, dc_yl, dc_yh, light, frac, fracstep, dc_source, dc_texheight);
+      return;
+   }
+
+   count = dc_yh - dc_yl;
+   if(count < 0)
+      return;
+
+#ifdef RANGECHECK
+   if(dc_x < 0 || dc_x >= renderwidth || dc_yl < 0 || dc_yh >= renderheight)
+      I_Error("R_DrawColumn: %i to %i at %i", dc_yl, dc_yh, dc_x);
+#endif
+
+   dest = framebuffer160_p + dc_yl * renderwidth + dc_x;
+   heightmask = dc_texheight - 1;
+
+   do
+   {
+      *dest = lit[dc_source[(frac >> FRACBITS) & heightmask]];
+      dest += renderwidth;
+      frac += fracstep;
+   }
+   while(count--);
+}
+
+static void I_DrawColumnNPO2Lit(int dc_x, int dc_yl, int dc_yh, int light, fixed_t frac, 
+                                fixed_t fracstep, inpixel_t *dc_source, int dc_texheight)
+{
+   const uint32_t *lit;
+   int       count, heightmask;
+   uint32_t *dest;
+
+   if(shadepixel || !(lit = CRY_GetLitTable(light)))
+   {
+      basecolumnnpo2(dc_x, dc_yl, dc_yh, light, frac, fracstep, dc_source, dc_texheight);
+      return;
+   }
+
+   count = dc_yh - dc_yl;
+   if(count < 0)
+      return;
+
+#ifdef RANGECHECK
+   if(dc_x < 0 || dc_x >= renderwidth || dc_yl < 0 || dc_yh >= renderheight)
+      I_Error("R_DrawColumn: %i to %i at %i", dc_yl, dc_yh, dc_x);
+#endif
+
+   dest = framebuffer160_p + dc_yl * renderwidth + dc_x;
+   heightmask = dc_texheight << FRACBITS;
+
+   if(frac < 0)
+      while((frac += heightmask) < 0);
+   else
+   {
+      while(frac >= heightmask)
+         frac -= heightmask;
+   }
+
+   do
+   {
+      *dest = lit[dc_source[frac >> FRACBITS]];
+      dest += renderwidth;
+      if((frac += fracstep) >= heightmask)
+         frac -= heightmask;
+   }
+   while(count--);
+}
+
+static void I_DrawSpanLit(int ds_y, int ds_x1, int ds_x2, int light, fixed_t ds_xfrac, 
+                          fixed_t ds_yfrac, fixed_t ds_xstep, fixed_t ds_ystep, 
+                          inpixel_t *ds_source)
+{
+   const uint32_t *lit;
+   int       count;
+   uint32_t *dest;
+
+   if(shadepixel || !(lit = CRY_GetLitTable(light)))
+   {
+      basespan(ds_y, ds_x1, ds_x2, light, ds_xfrac, ds_yfrac, ds_xstep, ds_ystep, ds_source);
+      return;
+   }
+
+#ifdef RANGECHECK 
+   if(ds_x2 < ds_x1 || ds_x1 < 0 || ds_x2 >= renderwidth || ds_y < 0 || ds_y >= renderheight) 
+      I_Error("R_DrawSpan: %i to %i at %i", ds_x1, ds_x2, ds_y); 
+#endif 
+
+   dest  = framebuffer160_p + ds_y * renderwidth + ds_x1;
+   count = ds_x2 - ds_x1;
+
+   do
+   {
+      *dest++ = lit[ds_source[((ds_yfrac >> (16 - 6)) & (63 * 64)) + ((ds_xfrac >> 16) & 63)]];
+      ds_xfrac += ds_xstep;
+      ds_yfrac += ds_ystep;
+   }
+   while(count--);
+}
+
+//=============================================================================
+//
+// Compact drawers
+//
+// The lit palette tables take in the lighting as well, so unlike the lit
+// drawers above these only need to step aside when shading is active.
+//
+//=============================================================================
+
+//
+// Build the lit palette table for every luminance offset
+//
+static void I_BuildPaletteLitTables(void)
+{
+   int luma, i, y;
+
+   if(!(palettelit = malloc(CRY_NUMLUMAS * sizeof(*palettelit))))
+      return;
+
+   for(luma = 0; luma < CRY_NUMLUMAS; luma++)
+   {
+      for(i = 0; i < 256; i++)
+      {
+         pixel_t cry = vgatojag[i];
+
+         y = (cry & CRY_YMASK) + luma + CRY_MINLUMA;
+         if(y < 0)
+            y = 0;
+         palettelit[luma][i] = CRYToRGB[(cry & CRY_COLORMASK) | (y & 0xff)];
+      }
+   }
+}
+
+static void I_DrawColumnCompactLit(int dc_x, int dc_yl, int dc_yh, int light, fixed_t frac, 
+                                   fixed_t fracstep, inpixel_t *dc_source, int dc_texheight)
+{
+   const uint32_t *lit;
+   const byte     *source = (const byte *)dc_source;
+   int       count, heightmask;
+   uint32_t *dest;
+
+   if(shadepixel)
+   {
+      basecolumn(dc_x, dc_yl, dc_yh, light, frac, fracstep, dc_source, dc_texheight);
+      return;
+   }
+
+   count = dc_yh - dc_yl;
+   if(count < 0)
+      return;
+
+#ifdef RANGECHECK
+   if(dc_x < 0 || dc_x >= renderwidth || dc_yl < 0 || dc_yh >= renderheight)
+      I_Error("R_DrawColumn: %i to %i at %i", dc_yl, dc_yh, dc_x);
+#endif
+
+   lit  = palettelit[CRY_LIGHTTOLUMA(light) - CRY_MINLUMA];
+   dest = framebuffer160_p + dc_yl * renderwidth + dc_x;
+   heightmask = dc_texheight - 1;
+
+   do
+   {
+      *dest = lit[source[(frac >> FRACBITS) & heightmask]];
+      dest += renderwidth;
+      frac += fracstep;
+   }
+   while(count--);
+}
+
+static void I_DrawColumnNPO2CompactLit(int dc_x, int dc_yl, int dc_yh, int light, fixed_t frac, 
+                                       fixed_t fracstep, inpixel_t *dc_source, int dc_texheight)
+{
+   const uint32_t *lit;
+   const byte     *source = (const byte *)dc_source;
+   int       count, heightmask;
+   uint32_t *dest;
+
+   if(shadepixel)
+   {
+      basecolumnnpo2(dc_x, dc_yl, dc_yh, light, frac, fracstep, dc_source, dc_texheight);
+      return;
+   }
+
+   count = dc_yh - dc_yl;
+   if(count < 0)
+      return;
+
+#ifdef RANGECHECK
+   if(dc_x < 0 || dc_x >= renderwidth || dc_yl < 0 || dc_yh >= renderheight)
+      I_Error("R_DrawColumn: %i to %i at %i", dc_yl, dc_yh, dc_x);
+#endif
+
+   lit  = palettelit[CRY_LIGHTTOLUMA(light) - CRY_MINLUMA];
+   dest = framebuffer160_p + dc_yl * renderwidth + dc_x;
+   heightmask = dc_texheight << FRACBITS;
+
+   if(frac < 0)
+      while((frac += heightmask) < 0);
+   else
+   {
+      while(frac >= heightmask)
+         frac -= heightmask;
+   }
+
+   do
+   {
+      *dest = lit[source[frac >> FRACBITS]];
+      dest += renderwidth;
+      if((frac += fracstep) >= heightmask)
+         frac -= heightmask;
+   }
+   while(count--);
+}
+
+static void I_DrawSpanCompactLit(int ds_y, int ds_x1, int ds_x2, int light, fixed_t ds_xfrac, 
+                                 fixed_t ds_yfrac, fixed_t ds_xstep, fixed_t ds_ystep, 
+                                 inpixel_t *ds_source)
+{
+   const uint32_t *lit;
+   const byte     *source = (const byte *)ds_source;
+   int       count;
+   uint32_t *dest;
+
+   if(shadepixel)
+   {
+      basespan(ds_y, ds_x1, ds_x2, light, ds_xfrac, ds_yfrac, ds_xstep, ds_ystep, ds_source);
+      return;
+   }
+
+#ifdef RANGECHECK 
+   if(ds_x2 < ds_x1 || ds_x1 < 0 || ds_x2 >= renderwidth || ds_y < 0 || ds_y >= renderheight) 
+      I_Error("R_DrawSpan: %i to %i at %i", ds_x1, ds_x2, ds_y); 
+#endif 
+
+   lit   = palettelit[CRY_LIGHTTOLUMA(light) - CRY_MINLUMA];
+   dest  = framebuffer160_p + ds_y * renderwidth + ds_x1;
+   count = ds_x2 - ds_x1;
+
+   do
+   {
+      *dest++ = lit[source[((ds_yfrac >> (16 - 6)) & (63 * 64)) + ((ds_xfrac >> 16) & 63)]];
+      ds_xfrac += ds_xstep;
+      ds_yfrac += ds_ystep;
+   }
+   while(count--);
+}
+
+//
+// Select the drawers for compact pixels
+//
+static void I_InitCompactDrawers(void)
+{
+   int p, numlit = DEFAULTLITTABLES;
+
+   if(framebuffer160cry_p)
+   {
+      I_DrawColumn     = I_DrawColumnCompactCRY;
+      I_DrawColumnNPO2 = I_DrawColumnNPO2CompactCRY;
+      I_DrawSpan       = I_DrawSpanCompactCRY;
+      I_DrawShadowColumn = I_DrawShadowColumnCRY;
+      hal_platform.debugMsg("I_InitDrawers: using compact CRY drawers\n");
+      return;
+   }
+
+   I_DrawColumn     = I_DrawColumnCompactC;
+   I_DrawColumnNPO2 = I_DrawColumnNPO2CompactC;
+   I_DrawSpan       = I_DrawSpanCompactC;
+
+   // -littables only turns the tables on or off here, as they are all built
+   if((p = M_GetArgParameters("-littables", 1)))
+      numlit = atoi(myargv[p]);
+
+   if(numlit > 0)
+      I_BuildPaletteLitTables();
+
+   if(palettelit)
+   {
+      basecolumn       = I_DrawColumn;
+      basecolumnnpo2   = I_DrawColumnNPO2;
+      basespan         = I_DrawSpan;
+      I_DrawColumn     = I_DrawColumnCompactLit;
+      I_DrawColumnNPO2 = I_DrawColumnNPO2CompactLit;
+      I_DrawSpan       = I_DrawSpanCompactLit;
+   }
+
+   hal_platform.debugMsg("I_InitDrawers: using compact drawers%s\n", 
+                         palettelit ? " with lit palette tables" : "");
+}
+
+//
+// Select the fastest drawers supported by the host CPU
+//
+void I_InitDrawers(void)
+{
+   unsigned int features = 0;
+   const char  *name     = "reference";
+   int          p, numlit = DEFAULTLITTABLES;
+
+   if((compactpixels = M_FindArgument("-compactpixels")))
+   {
+      I_InitCompactDrawers();
+      return;
+   }
+
+   // CRY is only written by the reference drawers, which need no tables
+   if(framebuffer160cry_p)
+   {
+      I_DrawColumn     = I_DrawColumnCRY;
+      I_DrawColumnNPO2 = I_DrawColumnNPO2CRY;
+      I_DrawSpan       = I_DrawSpanCRY;
+      I_DrawShadowColumn = I_DrawShadowColumnCRY;
+      hal_platform.debugMsg("I_InitDrawers: using CRY drawers\n");
+      return;
+   }
+
+   if(!M_FindArgument("-nosimd") && hal_medialayer.getCPUFeatures)
+      features = hal_medialayer.getCPUFeatures();
+
+#ifdef CALICO_SIMD_X86
+   if(features & HAL_CPU_AVX2)
+   {
+      I_DrawColumn     = I_DrawColumnAVX2;
+      I_DrawColumnNPO2 = I_DrawColumnNPO2AVX2;
+      I_DrawSpan       = I_DrawSpanAVX2;
+      name = "AVX2";
+   }
+   else if(features & HAL_CPU_SSE2)
+   {
+      I_DrawColumn     = I_DrawColumnSSE2;
+      I_DrawColumnNPO2 = I_DrawColumnNPO2SSE2;
+      I_DrawSpan       = I_DrawSpanSSE2;
+      name = "SSE2";
+   }
+#endif
+
+#ifdef CALICO_SIMD_NEON
+   if(features & HAL_CPU_NEON)
+   {
+      I_DrawColumn     = I_DrawColumnNEON;
+      I_DrawColumnNPO2 = I_DrawColumnNPO2NEON;
+      I_DrawSpan       = I_DrawSpanNEON;
+      name = "NEON";
+   }
+#endif
+
+   hal_platform.debugMsg("I_InitDrawers: using %s drawers\n", name);
+
+   // put the lit drawers in front, if enabled
+   if((p = M_GetArgParameters("-littables", 1)))
+      numlit = atoi(myargv[p]);
+
+   CRY_InitLitTables(numlit);
+
+   if(numlit > 0)
+   {
+      basecolumn       = I_DrawColumn;
+      basecolumnnpo2   = I_DrawColumnNPO2;
+      basespan         = I_DrawSpan;
+      I_DrawColumn     = I_DrawColumnLit;
+      I_DrawColumnNPO2 = I_DrawColumnNPO2Lit;
+      I_DrawSpan       = I_DrawSpanLit;
+
+      hal_platform.debugMsg("I_InitDrawers: using up to %d pre-lit tables\n", numlit);
+   }
+}
+
+// EOF
+
@@ -0,0 +1,89 @@
+/*
+  CALICO
+
+  Column and span drawers
+
+  The MIT License (MIT)
+
+  Copyright (c) 2016 James Haley
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef JAGDRAW_H__
+#define JAGDRAW_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 32-bit destination for all textured drawing
+extern uint32_t *framebuffer160_p;
+
+// 16-bit destination used instead when the playfield is kept as CRY
+extern uint16_t *framebuffer160cry_p;
+
+// Portable reference drawers, defined in jagonly.c
+void I_DrawColumnC(int dc_x, int dc_yl, int dc_yh, int light, fixed_t frac, 
+                   fixed_t fracstep, inpixel_t *dc_source, int dc_texheight);
+void I_DrawColumnNPO2C(int dc_x, int dc_yl, int dc_yh, int light, fixed_t frac, 
+                       fixed_t fracstep, inpixel_t *dc_source, int dc_texheight);
+void I_DrawSpanC(int ds_y, int ds_x1, int ds_x2, int light, fixed_t ds_xfrac, 
+                 fixed_t ds_yfrac, fixed_t ds_xstep, fixed_t ds_ystep, 
+                 inpixel_t *ds_source);
+void I_DrawShadowColumnC(int dc_x, int dc_yl, int dc_yh);
+
+// Reference drawers writing CRY, defined in jagonly.c
+void I_DrawColumnCRY(int dc_x, int dc_yl, int dc_yh, int light, fixed_t frac, 
+                     fixed_t fracstep, inpixel_t *dc_source, int dc_texheight);
+void I_DrawColumnNPO2CRY(int dc_x, int dc_yl, int dc_yh, int light, fixed_t frac, 
+                         fixed_t fracstep, inpixel_t *dc_source, int dc_texheight);
+void I_DrawSpanCRY(int ds_y, int ds_x1, int ds_x2, int light, fixed_t ds_xfrac, 
+                   fixed_t ds_yfrac, fixed_t ds_xstep, fixed_t ds_ystep, 
+                   inpixel_t *ds_source);
+void I_DrawShadowColumnCRY(int dc_x, int dc_yl, int dc_yh);
+
+// Reference drawers reading compact pixels, defined in jagonly.c
+void I_DrawColumnCompactC(int dc_x, int dc_yl, int dc_yh, int light, fixed_t frac, 
+                          fixed_t fracstep, inpixel_t *dc_source, int dc_texheight);
+void I_DrawColumnNPO2CompactC(int dc_x, int dc_yl, int dc_yh, int light, fixed_t frac, 
+                              fixed_t fracstep, inpixel_t *dc_source, int dc_texheight);
+void I_DrawSpanCompactC(int ds_y, int ds_x1, int ds_x2, int light, fixed_t ds_xfrac, 
+                        fixed_t ds_yfrac, fixed_t ds_xstep, fixed_t ds_ystep, 
+                        inpixel_t *ds_source);
+void I_DrawColumnCompactCRY(int dc_x, int dc_yl, int dc_yh, int light, fixed_t frac, 
+                            fixed_t fracstep, inpixel_t *dc_source, int dc_texheight);
+void I_DrawColumnNPO2CompactCRY(int dc_x, int dc_yl, int dc_yh, int light, fixed_t frac, 
+                                fixed_t fracstep, inpixel_t *dc_source, int dc_texheight);
+void I_DrawSpanCompactCRY(int ds_y, int ds_x1, int ds_x2, int light, fixed_t ds_xfrac, 
+                          fixed_t ds_yfrac, fixed_t ds_xstep, fixed_t ds_ystep, 
+                          inpixel_t *ds_source);
+
+void I_InitDrawers(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+// EOF
+
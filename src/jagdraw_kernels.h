@@ -0,0 +1,207 @@
+/*
+  CALICO
+
+  Column and span drawer kernels
+
+  This file is included once per instruction set by jagdraw.c, with the
+  following defined:
+
+    DRAWFUNC(name)  - decorates a kernel name with the instruction set
+    DRAWTARGET      - compiler target attribute for the kernels
+    DRAWBATCH       - converts DRAWBATCHSIZE texels to RGB
+
+  The MIT License (MIT)
+
+  Copyright (c) 2016 James Haley
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+//
+// Draw a vertical column of pixels from a projected wall texture.
+//
+DRAWTARGET static void DRAWFUNC(I_DrawColumn)(int dc_x, int dc_yl, int dc_yh, int light, 
+                                              fixed_t frac, fixed_t fracstep, 
+                                              inpixel_t *dc_source, int dc_texheight)
+{
+   int          count, heightmask, i, n;
+   uint16_t     texels[DRAWBATCHSIZE];
+   uint32_t     rgb[DRAWBATCHSIZE];
+   uint32_t    *dest;
+   drawlight_t  dl;
+
+   count = dc_yh - dc_yl + 1;
+   if(count < DRAWBATCHSIZE)
+   {
+      I_DrawColumnC(dc_x, dc_yl, dc_yh, light, frac, fracstep, dc_source, dc_texheight);
+      return;
+   }
+
+#ifdef RANGECHECK
+   if(dc_x < 0 || dc_x >= renderwidth || dc_yl < 0 || dc_yh >= renderheight)
+      I_Error("R_DrawColumn: %i to %i at %i", dc_yl, dc_yh, dc_x);
+#endif
+
+   dest = framebuffer160_p + dc_yl * renderwidth + dc_x;
+   heightmask = dc_texheight - 1;
+   I_SetupDrawLight(&dl, light);
+
+   do
+   {
+      // the final batch may be partial; pad it out without touching the source
+      n = (count < DRAWBATCHSIZE) ? count : DRAWBATCHSIZE;
+      for(i = 0; i < n; i++)
+      {
+         texels[i] = dc_source[(frac >> FRACBITS) & heightmask];
+         frac += fracstep;
+      }
+      for(; i < DRAWBATCHSIZE; i++)
+         texels[i] = 0;
+
+      DRAWBATCH(texels, rgb, &dl);
+
+      for(i = 0; i < n; i++)
+      {
+         *dest = rgb[i];
+         dest += renderwidth;
+      }
+   }
+   while((count -= n) > 0);
+}
+
+//
+// Draw a column from a texture without a power-of-two height.
+//
+DRAWTARGET static void DRAWFUNC(I_DrawColumnNPO2)(int dc_x, int dc_yl, int dc_yh, int light, 
+                                                  fixed_t frac, fixed_t fracstep, 
+                                                  inpixel_t *dc_source, int dc_texheight)
+{
+   int          count, heightmask, i, n;
+   uint16_t     texels[DRAWBATCHSIZE];
+   uint32_t     rgb[DRAWBATCHSIZE];
+   uint32_t    *dest;
+   drawlight_t  dl;
+
+   count = dc_yh - dc_yl + 1;
+   if(count < DRAWBATCHSIZE)
+   {
+      I_DrawColumnNPO2C(dc_x, dc_yl, dc_yh, light, frac, fracstep, dc_source, dc_texheight);
+      return;
+   }
+
+#ifdef RANGECHECK
+   if(dc_x < 0 || dc_x >= renderwidth || dc_yl < 0 || dc_yh >= renderheight)
+      I_Error("R_DrawColumn: %i to %i at %i", dc_yl, dc_yh, dc_x);
+#endif
+
+   dest = framebuffer160_p + dc_yl * renderwidth + dc_x;
+   heightmask = dc_texheight << FRACBITS;
+   I_SetupDrawLight(&dl, light);
+
+   if(frac < 0)
+      while((frac += heightmask) < 0);
+   else
+   {
+      while(frac >= heightmask)
+         frac -= heightmask;
+   }
+
+   do
+   {
+      n = (count < DRAWBATCHSIZE) ? count : DRAWBATCHSIZE;
+      for(i = 0; i < n; i++)
+      {
+         texels[i] = dc_source[frac >> FRACBITS];
+         if((frac += fracstep) >= heightmask)
+            frac -= heightmask;
+      }
+      for(; i < DRAWBATCHSIZE; i++)
+         texels[i] = 0;
+
+      DRAWBATCH(texels, rgb, &dl);
+
+      for(i = 0; i < n; i++)
+      {
+         *dest = rgb[i];
+         dest += renderwidth;
+      }
+   }
+   while((count -= n) > 0);
+}
+
+//
+// Draw a horizontal span of a 64x64 flat.
+//
+DRAWTARGET static void DRAWFUNC(I_DrawSpan)(int ds_y, int ds_x1, int ds_x2, int light, 
+                                            fixed_t ds_xfrac, fixed_t ds_yfrac, 
+                                            fixed_t ds_xstep, fixed_t ds_ystep, 
+                                            inpixel_t *ds_source)
+{
+   int          count, i, n;
+   uint16_t     texels[DRAWBATCHSIZE];
+   uint32_t     rgb[DRAWBATCHSIZE];
+   uint32_t    *dest;
+   drawlight_t  dl;
+
+   count = ds_x2 - ds_x1 + 1;
+   if(count < DRAWBATCHSIZE)
+   {
+      I_DrawSpanC(ds_y, ds_x1, ds_x2, light, ds_xfrac, ds_yfrac, ds_xstep, ds_ystep, ds_source);
+      return;
+   }
+
+#ifdef RANGECHECK 
+   if(ds_x1 < 0 || ds_x2 >= renderwidth || ds_y < 0 || ds_y >= renderheight) 
+      I_Error("R_DrawSpan: %i to %i at %i", ds_x1, ds_x2, ds_y); 
+#endif 
+
+   dest = framebuffer160_p + ds_y * renderwidth + ds_x1;
+   I_SetupDrawLight(&dl, light);
+
+   do
+   {
+      n = (count < DRAWBATCHSIZE) ? count : DRAWBATCHSIZE;
+      for(i = 0; i < n; i++)
+      {
+         texels[i] = ds_source[((ds_yfrac >> (16 - 6)) & (63 * 64)) + ((ds_xfrac >> 16) & 63)];
+         ds_xfrac += ds_xstep;
+         ds_yfrac += ds_ystep;
+      }
+
+      if(n == DRAWBATCHSIZE)
+      {
+         // spans are contiguous, so a full batch can go straight to the screen
+         DRAWBATCH(texels, dest, &dl);
+      }
+      else
+      {
+         for(; i < DRAWBATCHSIZE; i++)
+            texels[i] = 0;
+         DRAWBATCH(texels, rgb, &dl);
+         for(i = 0; i < n; i++)
+            dest[i] = rgb[i];
+      }
+
+      dest += n;
+   }
+   while((count -= n) > 0);
+}
+
+// EOF
+
@@ -0,0 +1,177 @@
+/*
+  CALICO
+
+  Reference column and span drawer variants
+
+  This file is included once per variant by jagonly.c, with the following
+  defined:
+
+    DRAWVARIANT(name) - decorates a drawer name with the variant
+    DRAWLIGHT         - 1 if the light value must be applied, 0 for full bright
+    DRAWSHADE         - 1 if screen shading (shadepixel) is active
+    DRAWCRY           - 1 to write CRY to framebuffer160cry_p rather than
+                        RGB to framebuffer160_p
+    DRAWCOMPACT       - 1 if the source is compact pixels, which are palette
+                        indices to be looked up in vgatojag
+
+  The MIT License (MIT)
+
+  Copyright (c) 2016 James Haley
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#if DRAWCRY
+#define DRAWPIXEL  uint16_t
+#define DRAWBUFFER framebuffer160cry_p
+#else
+#define DRAWPIXEL  uint32_t
+#define DRAWBUFFER framebuffer160_p
+#endif
+
+#if DRAWCOMPACT
+#define DRAWTEXEL(source, i) vgatojag[((byte *)(source))[i]]
+#else
+#define DRAWTEXEL(source, i) (source)[i]
+#endif
+
+//
+// Get the framebuffer value of a source texel
+//
+static inline DRAWPIXEL DRAWVARIANT(I_TexelToPixel)(inpixel_t cry, int light)
+{
+#if DRAWLIGHT
+   cry = I_LightCRY(cry, light);
+#endif
+#if DRAWSHADE
+   cry = I_BlendCRY(cry);
+#endif
+#if DRAWCRY
+   return cry;
+#else
+   return CRYToRGB[cry];
+#endif
+}
+
+//
+// Draw a vertical column of pixels from a projected wall texture.
+//
+static void DRAWVARIANT(I_DrawColumn)(int dc_x, int dc_yl, int dc_yh, int light, 
+                                      fixed_t frac, fixed_t fracstep, 
+                                      inpixel_t *dc_source, int dc_texheight)
+{
+   int        count, heightmask;
+   DRAWPIXEL *dest;
+
+   count = dc_yh - dc_yl;
+   if(count < 0)
+      return;
+
+#ifdef RANGECHECK
+   if(dc_x < 0 || dc_x >= renderwidth || dc_yl < 0 || dc_yh >= renderheight)
+      I_Error("R_DrawColumn: %i to %i at %i", dc_yl, dc_yh, dc_x);
+#endif
+
+   dest = DRAWBUFFER + dc_yl * renderwidth + dc_x;
+   heightmask = dc_texheight - 1;
+
+   do
+   {
+      *dest = DRAWVARIANT(I_TexelToPixel)(DRAWTEXEL(dc_source, (frac >> FRACBITS) & heightmask), light);
+      dest += renderwidth;
+      frac += fracstep;
+   }
+   while(count--);
+}
+
+//
+// Draw a column from a texture without a power-of-two height.
+//
+static void DRAWVARIANT(I_DrawColumnNPO2)(int dc_x, int dc_yl, int dc_yh, int light, 
+                                          fixed_t frac, fixed_t fracstep, 
+                                          inpixel_t *dc_source, int dc_texheight)
+{
+   int        count, heightmask;
+   DRAWPIXEL *dest;
+
+   count = dc_yh - dc_yl;
+   if(count < 0)
+      return;
+
+#ifdef RANGECHECK
+   if(dc_x < 0 || dc_x >= renderwidth || dc_yl < 0 || dc_yh >= renderheight)
+      I_Error("R_DrawColumn: %i to %i at %i", dc_yl, dc_yh, dc_x);
+#endif
+
+   dest = DRAWBUFFER + dc_yl * renderwidth + dc_x;
+   heightmask = dc_texheight << FRACBITS;
+
+   if(frac < 0)
+      while((frac += heightmask) < 0);
+   else
+   {
+      while(frac >= heightmask)
+         frac -= heightmask;
+   }
+
+   do
+   {
+      *dest = DRAWVARIANT(I_TexelToPixel)(DRAWTEXEL(dc_source, frac >> FRACBITS), light);
+      dest += renderwidth;
+
+      if((frac += fracstep) >= heightmask)
+         frac -= heightmask;
+   }
+   while(count--);
+}
+
+//
+// Draw a horizontal span of a 64x64 flat.
+//
+static void DRAWVARIANT(I_DrawSpan)(int ds_y, int ds_x1, int ds_x2, int light, 
+                                    fixed_t ds_xfrac, fixed_t ds_yfrac, 
+                                    fixed_t ds_xstep, fixed_t ds_ystep, 
+                                    inpixel_t *ds_source)
+{
+   int        count;
+   DRAWPIXEL *dest;
+
+#ifdef RANGECHECK 
+   if(ds_x2 < ds_x1 || ds_x1 < 0 || ds_x2 >= renderwidth || ds_y < 0 || ds_y >= renderheight) 
+      I_Error("R_DrawSpan: %i to %i at %i", ds_x1, ds_x2, ds_y); 
+#endif 
+
+   dest  = DRAWBUFFER + ds_y * renderwidth + ds_x1;
+   count = ds_x2 - ds_x1;
+
+   do
+   {
+      *dest++ = DRAWVARIANT(I_TexelToPixel)(DRAWTEXEL(ds_source, ((ds_yfrac >> (16 - 6)) & (63 * 64)) + ((ds_xfrac >> 16) & 63)), light);
+      ds_xfrac += ds_xstep;
+      ds_yfrac += ds_ystep;
+   }
+   while(count--);
+}
+
+#undef DRAWPIXEL
+#undef DRAWBUFFER
+#undef DRAWTEXEL
+
+// EOF
+
@@ -1,19 +1,30 @@
 /* marsonly.c */
 
+#include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 
 #include "elib/configfile.h"
 #include "hal/hal_init.h"
 #include "hal/hal_input.h"
+#include "hal/hal_net.h"
 #include "hal/hal_platform.h"
+#include "hal/hal_thread.h"
 #include "hal/hal_timer.h"
 #include "hal/hal_video.h"
 #include "gl/gl_render.h"
+#include "rb/rb_capture.h"
 #include "rb/rb_common.h"
 #include "doomdef.h"
 #include "jagcry.h"
+#include "jagdraw.h"
 #include "m_argv.h"
+#include "m_init.h"
+#include "m_perfhud.h"
+#include "m_prof.h"
+#include "m_save.h"
+#include "m_thread.h"
+#include "p_local.h"
 #include "r_local.h"
 #include "w_iwad.h"
 
@@ -39,6 +50,7 @@ pixel_t *workingscreen; will point to the undisplayed screens[workpage]
 */
 
 static boolean debugscreenstate = false;
+static boolean heapmap; // CALICO: draw a map of the zone on the debug screen
 
 boolean debugscreenactive;
 
@@ -51,7 +63,6 @@ extern void     *sbartop;
 
 static void *sbarrez;
 
-int joypad[32]; 
 int joystick1; 
 
 int junk; 
@@ -70,6 +81,42 @@ static hal_bool ShouldGrabInput(void)
    return !gamepaused;
 }
 
+// CALICO: the startup stages which need the HAL, run before D_DoomMain
+static void I_InitVideo(void)
+{
+   hal_video.initVideo();
+}
+
+static void I_InitInput(void)
+{
+   hal_input.initInput();
+   hal_appstate.gameGrabCallback = ShouldGrabInput;
+}
+
+static void I_InitDebugScreen(void)
+{
+   if(M_FindArgument("-devparm")) // CALICO: turn on debugging features
+      debugscreenstate = true;
+   if(M_FindArgument("-heapmap")) // CALICO: show zone usage
+      heapmap = debugscreenstate = true;
+
+   debugscreenactive = debugscreenstate;
+   debugscreenrez = GL_NewTextureResource("debugscreen", NULL, 256, 224, RES_FRAMEBUFFER, 0);
+   debugscreen    = GL_GetTextureResourceStore(debugscreenrez);
+}
+
+static const initstage_t halstages[] =
+{
+   { "M_InitSaves",       M_InitSaves                                             },
+   { "Cfg_LoadFile",      Cfg_LoadFile,      { "M_InitSaves" }                    },
+   { "I_InitVideo",       I_InitVideo,       { "Cfg_LoadFile" }                   },
+   { "CRY_BuildRGBTable", CRY_BuildRGBTable                                       },
+   { "I_GetFramebuffer",  I_GetFramebuffer,  { "I_InitVideo", "CRY_BuildRGBTable" } },
+   { "I_InitDrawers",     I_InitDrawers,     { "I_GetFramebuffer" }               },
+   { "I_InitInput",       I_InitInput,       { "Cfg_LoadFile", "I_InitVideo" }    },
+   { "I_InitDebugScreen", I_InitDebugScreen, { "I_InitVideo" }                    }
+};
+
 /* 
 ================ 
 = 
@@ -83,38 +130,23 @@ static hal_bool ShouldGrabInput(void)
 //
 void Jag68k_main(int argc, const char *const *argv)
 {
+   boolean headless;
+
    // CALICO: initialize global command line state
    myargc = argc;
    myargv = argv;
 
-   // CALICO: initialize HAL
-   if(!HAL_Init())
+   // CALICO: initialize HAL; -headless runs with no window, GPU, or sound
+   headless = M_FindArgument("-headless") || M_FindArgument("-dedicated");
+   if(!HAL_Init(headless))
       hal_platform.fatalError("HAL initialization failed");
+   if(headless)
+      GL_SetHeadless();
 
    hal_platform.debugMsg("HAL initialized\n");
 
-   // CALICO: read global configuration
-   Cfg_LoadFile();
-
-   hal_platform.debugMsg("Read config file\n");
-
-   // CALICO: initialize video
-   hal_video.initVideo();
-   CRY_BuildRGBTable();
-   I_GetFramebuffer();
-
-   hal_platform.debugMsg("Video initialized\n");
-
-   // CALICO: initialize input
-   hal_input.initInput();
-   hal_appstate.gameGrabCallback = ShouldGrabInput;
-
-   if(M_FindArgument("-devparm")) // CALICO: turn on debugging features
-      debugscreenstate = true;
-
-   debugscreenactive = debugscreenstate;
-   debugscreenrez = GL_NewTextureResource("debugscreen", NULL, 256, 224, RES_FRAMEBUFFER, 0);
-   debugscreen    = GL_GetTextureResourceStore(debugscreenrez);
+   // CALICO: read global configuration, then start video and input
+   M_RunInitStages(halstages, sizeof(halstages) / sizeof(*halstages));
 
    // CALICO: Jag-specific
 #if 0
@@ -256,6 +288,43 @@ void I_Print8(int x, int y, char *string)
    }
 }
 
+//
+// CALICO: draw text onto the debug screen at a pixel position, leaving the
+// pixels around the glyphs as they are and echoing nothing, for overlays
+// which are redrawn every frame
+//
+void I_DrawText8(int x, int y, const char *string, unsigned int color)
+{
+   int c;
+
+   if(y < 0 || y > 224 - 7)
+      return;
+
+   while((c = *string++) && x <= 256 - 8)
+   {
+      const byte *source;
+      uint32_t   *d;
+      int         i, b;
+
+      if(c < 32 || c >= 128)
+         continue;
+
+      source = font8 + ((c - 32) << 3);
+      d      = debugscreen + (y << 8) + x;
+      for(i = 0; i < 7; i++, d += 256)
+      {
+         byte s = *source++;
+         for(b = 0; b < 8; b++)
+         {
+            if(s & (1 << (7 - b)))
+               d[b] = color;
+         }
+      }
+
+      x += 8;
+   }
+}
+
 static char errormessage[80];
 
 void I_Error(const char *error, ...) 
@@ -283,7 +352,7 @@ void I_Error(const char *error, ...)
 //
 void I_Init(void) 
 {
-   int i;
+   int i, p, q, r;
 
    palette8 = W_CacheLumpName("CRYPAL", PU_STATIC);
    
@@ -292,6 +361,15 @@ void I_Init(void)
    {
       palette8[i] = BIGSHORT(palette8[i]);
    }
+
+   // CALICO: record what is shown and heard
+   p = M_GetArgParameters("-capture", 1);
+   q = M_GetArgParameters("-captureaudio", 1);
+   if(p || q)
+   {
+      r = M_GetArgParameters("-capturefps", 1);
+      RB_StartCapture(p ? myargv[p] : NULL, q ? myargv[q] : NULL, r ? atoi(myargv[r]) : 0);
+   }
 } 
 
 //
@@ -340,6 +418,8 @@ boolean I_RefreshCompleted(void)
 #if 0
    return gpufinished;
 #else
+   // CALICO: a -pipeline frame may still be drawing on the render thread
+   R_FinishRefresh();
    return true;
 #endif
 }
@@ -384,14 +464,28 @@ byte *I_WadBase(void)
 byte *I_ZoneBase(int *size)
 {
    static byte *zonebase;
+   static int   zonesize;
+   int p, kb;
    
-   *size = ENDHEAP - STARTHEAP; // leave 64k for stack
+   // CALICO: the size can be set in the config file or on the command line
+   if(!zonesize)
+   {
+      zonesize = ENDHEAP - STARTHEAP; // leave 64k for stack
+
+      kb = Z_ConfigZoneSize();
+      if((p = M_GetArgParameters("-zonesize", 1)))
+         kb = atoi(myargv[p]);
+      if(kb > 0)
+         zonesize = kb * 1024;
+   }
+
+   *size = zonesize;
    
    // CALICO: allocate from C heap
    if(!zonebase)
    {
       if(!(zonebase = calloc(*size, 1)))
-         hal_platform.fatalError("I_ZoneBase: could not allocate %d bytes for zone", size);
+         hal_platform.fatalError("I_ZoneBase: could not allocate %d bytes for zone", *size);
    }
 
    return zonebase;
@@ -399,30 +493,37 @@ byte *I_ZoneBase(int *size)
 
 #define TICSCALE 2
  
+// CALICO: buttons held at any poll since the controls were last read
+static int latchedbuttons;
+
+//
+// CALICO: Poll the controls without consuming them, and return the buttons
+// held right now. Anything seen is also kept for the next I_ReadControls,
+// so a press and release between tics still reaches the game.
+//
+int I_LatchControls(void)
+{
+   int buttons = hal_input.getEvents();
+
+   latchedbuttons |= buttons;
+
+   return buttons;
+}
+
 //
 // Read gamepad controls
 //
 int I_ReadControls(void) 
 { 
-   static int oldticcount;
-   int stoptic, i, cumulative;
-   int ticcount = I_GetTime();
-
-   // CALICO: run event loop
-   joypad[ticcount&31] = hal_input.getEvents();
-
-   stoptic = ticcount;
-   if(stoptic - oldticcount > 4)
-      oldticcount = stoptic - 4;
-   if(oldticcount >= stoptic)
-      oldticcount = stoptic - 1;
-   cumulative = 0;
-   for(i = oldticcount; i < stoptic; i++)
-   {
-      cumulative |= joypad[i&31];
-   }
+   int cumulative;
 
-   oldticcount = stoptic;
+   // CALICO: run event loop. This takes the place of ORing together the
+   // joypad[] samples the Jaguar's vblank handler took since the last read,
+   // but includes the buttons held now rather than stopping a tic short.
+   I_LatchControls();
+
+   cumulative = latchedbuttons;
+   latchedbuttons = 0;
 
    return cumulative;
 } 
@@ -435,32 +536,21 @@ int I_GetTime(void)
    return (int)(hal_timer.getTime());
 }
 
-//
-// Perform a signed 16.16 by 16.16 mutliply
-//
-fixed_t FixedMul(fixed_t a, fixed_t b) 
-{ 
-   // CALICO: rewritten to use PC version
-   return (fixed_t)((int64_t)a * b >> FRACBITS);
-} 
- 
-//
-// Perform a signed 16.16 by 16.16 divide (a/b)
-//
-fixed_t FixedDiv(fixed_t a, fixed_t b) 
-{ 
-   // CALICO: rewritten to use PC version
-   return (D_abs(a) >> 14) >= D_abs(b) ? ((a ^ b) >> 31) ^ D_MAXINT :
-      (fixed_t)(((int64_t)a << FRACBITS) / b);
-} 
- 
 //=============================================================================
 //
 // TEXTURE MAPPING CODE
 //
 //=============================================================================
 
-static uint32_t *framebuffer160_p, *framebuffer320_p;
+uint32_t *framebuffer160_p; // CALICO: shared with the drawers in jagdraw.c
+uint16_t *framebuffer160cry_p; // CALICO: set instead when the playfield is CRY
+static uint32_t *framebuffer320_p;
+
+// CALICO: size of the 3D view, which may be a multiple of the playfield
+int rendershift;
+int renderwidth  = SCREENWIDTH;
+int renderheight = SCREENHEIGHT;
+int renderxoffset;
 
 //
 // CALICO: Get the framebuffer pointers from the low-level graphics code
@@ -468,7 +558,16 @@ static uint32_t *framebuffer160_p, *framebuffer320_p;
 static void I_GetFramebuffer(void)
 {
    GL_InitFramebufferTextures();
-   framebuffer160_p = GL_GetFramebuffer(FB_160);
+
+   rendershift   = GL_GetRenderShift();
+   renderwidth   = GL_GetRenderWidth();
+   renderheight  = SCREENHEIGHT << rendershift;
+   renderxoffset = (renderwidth - (SCREENWIDTH << rendershift)) / 2;
+
+   if(GL_FramebufferIsCRY())
+      framebuffer160cry_p = GL_GetFramebuffer(FB_160);
+   else
+      framebuffer160_p = GL_GetFramebuffer(FB_160);
    framebuffer320_p = GL_GetFramebuffer(FB_320);
 }
 
@@ -482,8 +581,8 @@ struct iextender_s { signed int ext:8; }; // sign extender for 8-bit CRY luminan
 //
 static inline inpixel_t I_BlendCRY(inpixel_t in)
 {
-   static struct cextender_s c;
-   static struct iextender_s i;
+   struct cextender_s c; // CALICO: not static; column drawers may run on several threads
+   struct iextender_s i;
 
    int cc = (in & CRY_CMASK) >> CRY_CSHIFT;
    int cr = (in & CRY_RMASK) >> CRY_RSHIFT;
@@ -507,164 +606,535 @@ static inline inpixel_t I_BlendCRY(inpixel_t in)
 // Sign extender for 24-bit CRY luminance values
 struct yextender_s { signed int ext:24; };
 
+//
+// CALICO: Apply a hardware light value to a CRY color
+//
+static inline inpixel_t I_LightCRY(inpixel_t cry, int light)
+{
+   struct yextender_s s;
+   int32_t y;
+
+   y = (cry & CRY_YMASK) << CRY_IINCSHIFT;
+   y += (s.ext = light);
+   if(y < 0)
+      y = 0;
+   y >>= CRY_IINCSHIFT;
+
+   return (inpixel_t)((cry & CRY_COLORMASK) | (y & 0xff));
+}
+
+//
+// CALICO: the drawers are specialized at compile time on whether lighting 
+// and screen shading apply, so that the choice is made once per call rather
+// than once per pixel. A light value with no whole luminance offset leaves
+// texels unchanged, which covers full bright sprites and walls.
+//
+// The NPO2 column drawers do the "tutti frutti" fix: the Jag blitter could
+// wrap around textures of arbitrary height, but Carmack didn't bother fixing
+// this for the NeXT "simulator" build of the game.
+//
+#define DRAWVARIANT(name) name##Unlit
+#define DRAWLIGHT 0
+#define DRAWSHADE 0
+#define DRAWCRY 0
+#define DRAWCOMPACT 0
+#include "jagdraw_ref.h"
+#undef DRAWVARIANT
+#undef DRAWLIGHT
+#undef DRAWSHADE
+#undef DRAWCRY
+#undef DRAWCOMPACT
+
+#define DRAWVARIANT(name) name##Lit
+#define DRAWLIGHT 1
+#define DRAWSHADE 0
+#define DRAWCRY 0
+#define DRAWCOMPACT 0
+#include "jagdraw_ref.h"
+#undef DRAWVARIANT
+#undef DRAWLIGHT
+#undef DRAWSHADE
+#undef DRAWCRY
+#undef DRAWCOMPACT
+
+#define DRAWVARIANT(name) name##UnlitShaded
+#define DRAWLIGHT 0
+#define DRAWSHADE 1
+#define DRAWCRY 0
+#define DRAWCOMPACT 0
+#include "jagdraw_ref.h"
+#undef DRAWVARIANT
+#undef DRAWLIGHT
+#undef DRAWSHADE
+#undef DRAWCRY
+#undef DRAWCOMPACT
+
+#define DRAWVARIANT(name) name##LitShaded
+#define DRAWLIGHT 1
+#define DRAWSHADE 1
+#define DRAWCRY 0
+#define DRAWCOMPACT 0
+#include "jagdraw_ref.h"
+#undef DRAWVARIANT
+#undef DRAWLIGHT
+#undef DRAWSHADE
+#undef DRAWCRY
+#undef DRAWCOMPACT
+
+// CALICO: the same again, writing CRY for the GPU to decode. Shading is
+// left to the GPU as well, so these never need to look at shadepixel.
+#define DRAWVARIANT(name) name##UnlitCRY
+#define DRAWLIGHT 0
+#define DRAWSHADE 0
+#define DRAWCRY 1
+#define DRAWCOMPACT 0
+#include "jagdraw_ref.h"
+#undef DRAWVARIANT
+#undef DRAWLIGHT
+#undef DRAWSHADE
+#undef DRAWCRY
+#undef DRAWCOMPACT
+
+#define DRAWVARIANT(name) name##LitCRY
+#define DRAWLIGHT 1
+#define DRAWSHADE 0
+#define DRAWCRY 1
+#define DRAWCOMPACT 0
+#include "jagdraw_ref.h"
+#undef DRAWVARIANT
+#undef DRAWLIGHT
+#undef DRAWSHADE
+#undef DRAWCRY
+#undef DRAWCOMPACT
+
+// CALICO: and all of them again, reading compact pixels
+#define DRAWVARIANT(name) name##UnlitCompact
+#define DRAWLIGHT 0
+#define DRAWSHADE 0
+#define DRAWCRY 0
+#define DRAWCOMPACT 1
+#include "jagdraw_ref.h"
+#undef DRAWVARIANT
+#undef DRAWLIGHT
+#undef DRAWSHADE
+#undef DRAWCRY
+#undef DRAWCOMPACT
+
+#define DRAWVARIANT(name) name##LitCompact
+#define DRAWLIGHT 1
+#define DRAWSHADE 0
+#define DRAWCRY 0
+#define DRAWCOMPACT 1
+#include "jagdraw_ref.h"
+#undef DRAWVARIANT
+#undef DRAWLIGHT
+#undef DRAWSHADE
+#undef DRAWCRY
+#undef DRAWCOMPACT
+
+#define DRAWVARIANT(name) name##UnlitShadedCompact
+#define DRAWLIGHT 0
+#define DRAWSHADE 1
+#define DRAWCRY 0
+#define DRAWCOMPACT 1
+#include "jagdraw_ref.h"
+#undef DRAWVARIANT
+#undef DRAWLIGHT
+#undef DRAWSHADE
+#undef DRAWCRY
+#undef DRAWCOMPACT
+
+#define DRAWVARIANT(name) name##LitShadedCompact
+#define DRAWLIGHT 1
+#define DRAWSHADE 1
+#define DRAWCRY 0
+#define DRAWCOMPACT 1
+#include "jagdraw_ref.h"
+#undef DRAWVARIANT
+#undef DRAWLIGHT
+#undef DRAWSHADE
+#undef DRAWCRY
+#undef DRAWCOMPACT
+
+#define DRAWVARIANT(name) name##UnlitCRYCompact
+#define DRAWLIGHT 0
+#define DRAWSHADE 0
+#define DRAWCRY 1
+#define DRAWCOMPACT 1
+#include "jagdraw_ref.h"
+#undef DRAWVARIANT
+#undef DRAWLIGHT
+#undef DRAWSHADE
+#undef DRAWCRY
+#undef DRAWCOMPACT
+
+#define DRAWVARIANT(name) name##LitCRYCompact
+#define DRAWLIGHT 1
+#define DRAWSHADE 0
+#define DRAWCRY 1
+#define DRAWCOMPACT 1
+#include "jagdraw_ref.h"
+#undef DRAWVARIANT
+#undef DRAWLIGHT
+#undef DRAWSHADE
+#undef DRAWCRY
+#undef DRAWCOMPACT
+
+// select a variant for a light value and the current screen shading
+#define I_DRAWVARIANT(name, light) \
+   (shadepixel ? \
+      (CRY_LIGHTTOLUMA(light) ? name##LitShaded : name##UnlitShaded) : \
+      (CRY_LIGHTTOLUMA(light) ? name##Lit : name##Unlit))
+
+#define I_DRAWVARIANTCRY(name, light) \
+   (CRY_LIGHTTOLUMA(light) ? name##LitCRY : name##UnlitCRY)
+
+#define I_DRAWVARIANTCOMPACT(name, light) \
+   (shadepixel ? \
+      (CRY_LIGHTTOLUMA(light) ? name##LitShadedCompact : name##UnlitShadedCompact) : \
+      (CRY_LIGHTTOLUMA(light) ? name##LitCompact : name##UnlitCompact))
+
+#define I_DRAWVARIANTCRYCOMPACT(name, light) \
+   (CRY_LIGHTTOLUMA(light) ? name##LitCRYCompact : name##UnlitCRYCompact)
+
 // 
 // Draw a vertical column of pixels from a projected wall texture.
 // Source is the top of the column to scale.
 // 
-void I_DrawColumn(int dc_x, int dc_yl, int dc_yh, int light, fixed_t frac, 
-                  fixed_t fracstep, inpixel_t *dc_source, int dc_texheight)
+void I_DrawColumnC(int dc_x, int dc_yl, int dc_yh, int light, fixed_t frac, 
+                   fixed_t fracstep, inpixel_t *dc_source, int dc_texheight)
+{ 
+   I_DRAWVARIANT(I_DrawColumn, light)(dc_x, dc_yl, dc_yh, light, frac, fracstep, 
+                                      dc_source, dc_texheight);
+} 
+
+//
+// Draw a column from a texture without a power-of-two height.
+//
+void I_DrawColumnNPO2C(int dc_x, int dc_yl, int dc_yh, int light, fixed_t frac, 
+                       fixed_t fracstep, inpixel_t *dc_source, int dc_texheight)
+{
+   I_DRAWVARIANT(I_DrawColumnNPO2, light)(dc_x, dc_yl, dc_yh, light, frac, fracstep, 
+                                          dc_source, dc_texheight);
+}
+ 
+//
+// Draw a horizontal span of a 64x64 flat.
+//
+void I_DrawSpanC(int ds_y, int ds_x1, int ds_x2, int light, fixed_t ds_xfrac, 
+                 fixed_t ds_yfrac, fixed_t ds_xstep, fixed_t ds_ystep, 
+                 inpixel_t *ds_source) 
 { 
-   static struct yextender_s s;
+   I_DRAWVARIANT(I_DrawSpan, light)(ds_y, ds_x1, ds_x2, light, ds_xfrac, ds_yfrac, 
+                                    ds_xstep, ds_ystep, ds_source);
+} 
+
+//
+// CALICO: Draw a column into the CRY framebuffer
+//
+void I_DrawColumnCRY(int dc_x, int dc_yl, int dc_yh, int light, fixed_t frac, 
+                     fixed_t fracstep, inpixel_t *dc_source, int dc_texheight)
+{
+   I_DRAWVARIANTCRY(I_DrawColumn, light)(dc_x, dc_yl, dc_yh, light, frac, fracstep, 
+                                         dc_source, dc_texheight);
+}
+
+//
+// CALICO: Draw a column without a power-of-two height into the CRY framebuffer
+//
+void I_DrawColumnNPO2CRY(int dc_x, int dc_yl, int dc_yh, int light, fixed_t frac, 
+                         fixed_t fracstep, inpixel_t *dc_source, int dc_texheight)
+{
+   I_DRAWVARIANTCRY(I_DrawColumnNPO2, light)(dc_x, dc_yl, dc_yh, light, frac, fracstep, 
+                                             dc_source, dc_texheight);
+}
 
-   int        count, heightmask;
-   inpixel_t  cry;
-   int32_t    y;
-   uint32_t  *dest;
+//
+// CALICO: Draw a span into the CRY framebuffer
+//
+void I_DrawSpanCRY(int ds_y, int ds_x1, int ds_x2, int light, fixed_t ds_xfrac, 
+                   fixed_t ds_yfrac, fixed_t ds_xstep, fixed_t ds_ystep, 
+                   inpixel_t *ds_source)
+{
+   I_DRAWVARIANTCRY(I_DrawSpan, light)(ds_y, ds_x1, ds_x2, light, ds_xfrac, ds_yfrac, 
+                                       ds_xstep, ds_ystep, ds_source);
+}
+
+//
+// CALICO: the reference drawers for compact pixels
+//
+void I_DrawColumnCompactC(int dc_x, int dc_yl, int dc_yh, int light, fixed_t frac, 
+                          fixed_t fracstep, inpixel_t *dc_source, int dc_texheight)
+{
+   I_DRAWVARIANTCOMPACT(I_DrawColumn, light)(dc_x, dc_yl, dc_yh, light, frac, fracstep, 
+                                             dc_source, dc_texheight);
+}
+
+void I_DrawColumnNPO2CompactC(int dc_x, int dc_yl, int dc_yh, int light, fixed_t frac, 
+                              fixed_t fracstep, inpixel_t *dc_source, int dc_texheight)
+{
+   I_DRAWVARIANTCOMPACT(I_DrawColumnNPO2, light)(dc_x, dc_yl, dc_yh, light, frac, fracstep, 
+                                                 dc_source, dc_texheight);
+}
+
+void I_DrawSpanCompactC(int ds_y, int ds_x1, int ds_x2, int light, fixed_t ds_xfrac, 
+                        fixed_t ds_yfrac, fixed_t ds_xstep, fixed_t ds_ystep, 
+                        inpixel_t *ds_source)
+{
+   I_DRAWVARIANTCOMPACT(I_DrawSpan, light)(ds_y, ds_x1, ds_x2, light, ds_xfrac, ds_yfrac, 
+                                           ds_xstep, ds_ystep, ds_source);
+}
+
+//
+// CALICO: and writing CRY
+//
+void I_DrawColumnCompactCRY(int dc_x, int dc_yl, int dc_yh, int light, fixed_t frac, 
+                            fixed_t fracstep, inpixel_t *dc_source, int dc_texheight)
+{
+   I_DRAWVARIANTCRYCOMPACT(I_DrawColumn, light)(dc_x, dc_yl, dc_yh, light, frac, fracstep, 
+                                                dc_source, dc_texheight);
+}
+
+void I_DrawColumnNPO2CompactCRY(int dc_x, int dc_yl, int dc_yh, int light, fixed_t frac, 
+                                fixed_t fracstep, inpixel_t *dc_source, int dc_texheight)
+{
+   I_DRAWVARIANTCRYCOMPACT(I_DrawColumnNPO2, light)(dc_x, dc_yl, dc_yh, light, frac, fracstep, 
+                                                    dc_source, dc_texheight);
+}
+
+void I_DrawSpanCompactCRY(int ds_y, int ds_x1, int ds_x2, int light, fixed_t ds_xfrac, 
+                          fixed_t ds_yfrac, fixed_t ds_xstep, fixed_t ds_ystep, 
+                          inpixel_t *ds_source)
+{
+   I_DRAWVARIANTCRYCOMPACT(I_DrawSpan, light)(ds_y, ds_x1, ds_x2, light, ds_xfrac, ds_yfrac, 
+                                              ds_xstep, ds_ystep, ds_source);
+}
+
+//
+// CALICO: Darken a column of what is already in the framebuffer, for shadow
+// sprites. No texels are read; each pixel's channels are halved in one go,
+// keeping its alpha.
+//
+void I_DrawShadowColumnC(int dc_x, int dc_yl, int dc_yh)
+{
+   int       count = dc_yh - dc_yl;
+   uint32_t *dest;
 
-   count = dc_yh - dc_yl;
    if(count < 0)
       return;
 
 #ifdef RANGECHECK
-   if(dc_x < 0 || dc_x >= SCREENWIDTH || dc_yl < 0 || dc_yh >= SCREENHEIGHT)
-      I_Error("R_DrawColumn: %i to %i at %i", dc_yl, dc_yh, dc_x);
+   if(dc_x < 0 || dc_x >= renderwidth || dc_yl < 0 || dc_yh >= renderheight)
+      I_Error("I_DrawShadowColumn: %i to %i at %i", dc_yl, dc_yh, dc_x);
 #endif
 
-   // CALICO: our destination framebuffer is 32-bit
-   dest = framebuffer160_p + dc_yl * SCREENWIDTH + dc_x;
-
-   heightmask = dc_texheight - 1;
+   dest = framebuffer160_p + dc_yl * renderwidth + dc_x;
 
    do
    {
-      // CALICO: calculate CRY lighting and lookup RGB
-      cry = dc_source[(frac >> FRACBITS) & heightmask];
-      y = (cry & CRY_YMASK) << CRY_IINCSHIFT;
-      y += (s.ext = light);
-      if(y < 0)
-         y = 0;
-      y >>= CRY_IINCSHIFT;
-      cry = (cry & CRY_COLORMASK) | (y & 0xff);
-      
-      // CALICO: apply screen shading if active
-      if(shadepixel)
-         cry = I_BlendCRY(cry);
- 
-      *dest = CRYToRGB[cry];
-      dest += SCREENWIDTH;
-      frac += fracstep;
+      uint32_t p = *dest;
+      *dest = ((p >> 1) & 0x007f7f7f) | (p & 0xff000000);
+      dest += renderwidth;
    }
    while(count--);
-} 
+}
 
 //
-// CALICO: the Jag blitter could wrap around textures of arbitrary height, so
-// we need to do the "tutti frutti" fix here. Carmack didn't bother fixing
-// this for the NeXT "simulator" build of the game.
+// CALICO: Darken a column of the CRY framebuffer by halving its luminance
 //
-void I_DrawColumnNPO2(int dc_x, int dc_yl, int dc_yh, int light, fixed_t frac, 
-                      fixed_t fracstep, inpixel_t *dc_source, int dc_texheight)
+void I_DrawShadowColumnCRY(int dc_x, int dc_yl, int dc_yh)
 {
-   static struct yextender_s s;
+   int       count = dc_yh - dc_yl;
+   uint16_t *dest;
+
+   if(count < 0)
+      return;
+
+#ifdef RANGECHECK
+   if(dc_x < 0 || dc_x >= renderwidth || dc_yl < 0 || dc_yh >= renderheight)
+      I_Error("I_DrawShadowColumn: %i to %i at %i", dc_yl, dc_yh, dc_x);
+#endif
+
+   dest = framebuffer160cry_p + dc_yl * renderwidth + dc_x;
+
+   do
+   {
+      uint16_t p = *dest;
+      *dest = (p & ~CRY_YMASK) | ((p & CRY_YMASK) >> 1);
+      dest += renderwidth;
+   }
+   while(count--);
+}
 
-   int        count, heightmask;
-   inpixel_t  cry;
-   int32_t    y;
-   uint32_t  *dest;
+//
+// CALICO: copy rows dc_yl to dc_yh of an already drawn column src_x into
+// column dc_x, in whichever framebuffer is being drawn to
+//
+void I_CopyColumn(int dc_x, int src_x, int dc_yl, int dc_yh)
+{
+   int count = dc_yh - dc_yl;
+   int offset;
 
-   count = dc_yh - dc_yl;
    if(count < 0)
       return;
 
 #ifdef RANGECHECK
-   if(dc_x < 0 || dc_x >= SCREENWIDTH || dc_yl < 0 || dc_yh >= SCREENHEIGHT)
-      I_Error("R_DrawColumn: %i to %i at %i", dc_yl, dc_yh, dc_x);
+   if(dc_x < 0 || dc_x >= renderwidth || src_x < 0 || src_x >= renderwidth || 
+      dc_yl < 0 || dc_yh >= renderheight)
+      I_Error("I_CopyColumn: %i to %i from %i to %i", dc_yl, dc_yh, src_x, dc_x);
 #endif
 
-   // CALICO: our destination framebuffer is 32-bit
-   dest = framebuffer160_p + dc_yl * SCREENWIDTH + dc_x;
+   offset = dc_yl * renderwidth;
 
-   heightmask = dc_texheight << FRACBITS;
+   if(framebuffer160cry_p)
+   {
+      uint16_t *dest = framebuffer160cry_p + offset + dc_x;
+      uint16_t *src  = framebuffer160cry_p + offset + src_x;
 
-   if(frac < 0)
-      while((frac += heightmask) < 0);
+      do
+      {
+         *dest = *src;
+         dest += renderwidth;
+         src  += renderwidth;
+      }
+      while(count--);
+   }
    else
    {
-      while(frac >= heightmask)
-         frac -= heightmask;
+      uint32_t *dest = framebuffer160_p + offset + dc_x;
+      uint32_t *src  = framebuffer160_p + offset + src_x;
+
+      do
+      {
+         *dest = *src;
+         dest += renderwidth;
+         src  += renderwidth;
+      }
+      while(count--);
    }
+}
 
-   do
+//
+// CALICO: the sky is always full bright, so its texels are turned into
+// framebuffer pixels once, when the sky or the screen shading changes, and
+// sky columns are then a plain copy. The CRY framebuffer takes the texels
+// as they are and leaves shading to the GPU.
+//
+#define SKYWIDTH  256
+#define SKYHEIGHT 128
+
+static uint32_t   skypixels[SKYWIDTH * SKYHEIGHT];
+static pixel_t   *skydata;
+static int        skylump = -1;
+static pixel_t    skyshade;
+static int        skytexheight;
+
+void I_SetupSky(pixel_t *data, int lumpnum, int texheight)
+{
+   int c, r;
+
+   if(data == skydata && lumpnum == skylump && texheight == skytexheight &&
+      (framebuffer160cry_p || shadepixel == skyshade))
+      return;
+
+   skydata      = data;
+   skylump      = lumpnum;
+   skytexheight = texheight;
+   skyshade     = shadepixel;
+
+   if(framebuffer160cry_p)
+      return;
+
+   for(c = 0; c < SKYWIDTH; c++)
    {
-      cry = dc_source[frac >> FRACBITS];
-      y = (cry & CRY_YMASK) << CRY_IINCSHIFT;
-      y += (s.ext = light);
-      y >>= CRY_IINCSHIFT;
-      if(y < 0)
-         y = 0;
-      cry = (cry & CRY_COLORMASK) | (y & 0xff);
-
-      // CALICO: apply screen shading if active
-      if(shadepixel)
-         cry = I_BlendCRY(cry);
-
-      *dest = CRYToRGB[cry];
-      dest += SCREENWIDTH;
-
-      if((frac += fracstep) >= heightmask)
-         frac -= heightmask;
+      uint32_t *dest = skypixels + c * SKYHEIGHT;
+
+      for(r = 0; r < SKYHEIGHT; r++)
+      {
+         pixel_t cry = R_TexelCRY(data, c * texheight + r);
+         dest[r] = CRYToRGB[shadepixel ? I_BlendCRY(cry) : cry];
+      }
    }
-   while(count--);
 }
- 
-void I_DrawSpan(int ds_y, int ds_x1, int ds_x2, int light, fixed_t ds_xfrac, 
-                fixed_t ds_yfrac, fixed_t ds_xstep, fixed_t ds_ystep, 
-                inpixel_t *ds_source) 
-{ 
-   static struct yextender_s s;
-
-   fixed_t    xfrac, yfrac; 
-   int        count; 
-   inpixel_t  cry;
-   int32_t    y;
-   uint32_t  *dest;
-
-#ifdef RANGECHECK 
-   if(ds_x2 < ds_x1 || ds_x1 < 0 || ds_x2 >= SCREENWIDTH || ds_y < 0 || ds_y >= SCREENHEIGHT) 
-      I_Error("R_DrawSpan: %i to %i at %i", ds_x1, ds_x2, ds_y); 
-#endif 
-   
-   xfrac = ds_xfrac; 
-   yfrac = ds_yfrac; 
-
-   // CALICO: our destination framebuffer is 32-bit
-   dest = framebuffer160_p + ds_y * SCREENWIDTH + ds_x1;
-   count = ds_x2 - ds_x1;
-
-   do 
-   { 
-      // CALICO: calculate CRY lighting and lookup RGB
-      cry = ds_source[((yfrac >> (16 - 6)) & (63 * 64)) + ((xfrac >> 16) & 63)];
-      y = (cry & CRY_YMASK) << CRY_IINCSHIFT;
-      y += (s.ext = light);
-      y >>= CRY_IINCSHIFT;
-      if(y < 0)
-         y = 0;
-      cry = (cry & CRY_COLORMASK) | (y & 0xff);
-
-      // CALICO: apply screen shading if active
-      if(shadepixel)
-         cry = I_BlendCRY(cry);
-
-      *dest++ = CRYToRGB[cry];
-      xfrac += ds_xstep; 
-      yfrac += ds_ystep; 
+
+//
+// CALICO: draw a column of the sky set up by I_SetupSky, from the sky
+// texture column colnum
+//
+void I_DrawSkyColumn(int dc_x, int dc_yl, int dc_yh, int colnum, fixed_t frac, 
+                     fixed_t fracstep)
+{
+   int count = dc_yh - dc_yl;
+
+   if(count < 0)
+      return;
+
+#ifdef RANGECHECK
+   if(dc_x < 0 || dc_x >= renderwidth || dc_yl < 0 || dc_yh >= renderheight)
+      I_Error("I_DrawSkyColumn: %i to %i at %i", dc_yl, dc_yh, dc_x);
+#endif
+
+   if(framebuffer160cry_p)
+   {
+      int       col  = colnum * skytexheight;
+      uint16_t *dest = framebuffer160cry_p + dc_yl * renderwidth + dc_x;
+
+      do
+      {
+         *dest = R_TexelCRY(skydata, col + ((frac >> FRACBITS) & (SKYHEIGHT - 1)));
+         dest += renderwidth;
+         frac += fracstep;
+      }
+      while(count--);
    }
-   while(count--); 
-} 
+   else
+   {
+      const uint32_t *src  = skypixels + colnum * SKYHEIGHT;
+      uint32_t       *dest = framebuffer160_p + dc_yl * renderwidth + dc_x;
+
+      do
+      {
+         *dest = src[(frac >> FRACBITS) & (SKYHEIGHT - 1)];
+         dest += renderwidth;
+         frac += fracstep;
+      }
+      while(count--);
+   }
+}
 
 //=============================================================================
 
+//
+// CALICO: Draw a map of the zone across the bottom of the debug screen, one
+// pixel for each equal slice of it, coloured by the tag of the block there
+//
+#define HEAPMAPTOP   160
+#define HEAPMAPCELLS (256 * (224 - HEAPMAPTOP))
+
+static void I_DrawHeapMap(void)
+{
+   static const uint32_t colors[NUMZONETAGS + 1] =
+   {
+      D_RGBA(0x40, 0x40, 0xff, 0xff), // static
+      D_RGBA(0x00, 0xc0, 0xc0, 0xff), // sound
+      D_RGBA(0x00, 0x80, 0x80, 0xff), // music
+      D_RGBA(0xff, 0x40, 0x40, 0xff), // level
+      D_RGBA(0xff, 0xa0, 0x00, 0xff), // levspec
+      D_RGBA(0x40, 0xc0, 0x40, 0xff), // purgable
+      D_RGBA(0xff, 0x40, 0xff, 0xff), // other
+      D_RGBA(0x20, 0x20, 0x20, 0xff)  // free
+   };
+   static byte cells[HEAPMAPCELLS];
+   uint32_t *dest = debugscreen + (HEAPMAPTOP << 8);
+   int i;
+
+   Z_MapZone(mainzone, cells, HEAPMAPCELLS);
+   for(i = 0; i < HEAPMAPCELLS; i++)
+      dest[i] = colors[cells[i]];
+
+   GL_TextureResourceSetUpdated(debugscreenrez);
+}
+
 #define GPULINE (BASEORGY+SCREENHEIGHT+1)
 int lastticcount;
 int lasttics;
@@ -684,12 +1154,35 @@ void I_Update(void)
    GL_AddFramebuffer(FB_160);
    GL_AddDrawCommand(sbarrez, 0, 2 + SCREENHEIGHT + 1, 320, 40);
    GL_AddDrawCommand(sbartop, 0, 2 + SCREENHEIGHT + 1, 320, 40);
-   if(debugscreenactive)
+   if(heapmap)
+      I_DrawHeapMap(); // CALICO
+   if(perfhud)
+      M_DrawPerfHUD(); // CALICO
+   if(debugscreenactive || perfhud)
       GL_AddDrawCommand(debugscreenrez, 0, 0, 256, 224);
    GL_RenderFrame();
+
+   // CALICO: count the GL work of gameplay frames
+   if(profiling)
+   {
+      glframestats_t stats;
+
+      GL_GetFrameStats(&stats);
+      M_ProfCount(PROF_GLSTATES,   stats.stateChanges);
+      M_ProfCount(PROF_GLBINDS,    stats.textureBinds);
+      M_ProfCount(PROF_GLDRAWS,    stats.drawCalls);
+      M_ProfCount(PROF_GLUPLOADKB, stats.uploadBytes / 1024);
+      if(hal_video.getPresentInterval)
+         M_ProfCount(PROF_PRESENT, hal_video.getPresentInterval());
+      M_ProfCount(PROF_GPUUPLOAD,  stats.gpuUploadUS);
+      M_ProfCount(PROF_GPUDRAW,    stats.gpuDrawUS);
+      M_ProfCount(PROF_GPUPRESENT, stats.gpuPresentUS);
+   }
 }
 
-static byte tempbuffer[0x10000];
+#define TEMPBUFFERSIZE 0x10000
+
+static byte tempbuffer[TEMPBUFFERSIZE];
 
 // 
 // Return a pointer to a 64k or so temp work buffer for level setup uses
@@ -701,6 +1194,14 @@ byte *I_TempBuffer(void)
    return tempbuffer;
 }
 
+//
+// CALICO: the size of the buffer returned by I_TempBuffer
+//
+int I_TempBufferSize(void)
+{
+   return TEMPBUFFERSIZE;
+}
+
 //=============================================================================
 //
 // DOUBLE BUFFERED DRAWING FUNCTIONS
@@ -711,6 +1212,10 @@ byte *I_TempBuffer(void)
 
 extern int cy;
 
+// CALICO: a screen drawn into the 320x224 framebuffer since this last changed
+// is still there, and need not be drawn again to be shown
+int doublebuffergen;
+
 //
 // Set up the double buffered work screens
 //
@@ -724,6 +1229,7 @@ void DoubleBufferSetup(void)
    GL_ClearTextureResource(debugscreenrez, RB_COLOR_CLEAR);
 
    cy = 4;
+   ++doublebuffergen;
 }
 
 //
@@ -757,7 +1263,7 @@ void EraseBlock(int x, int y, int width, int height, void *destResource)
    if(destResource)
    {
       base = GL_GetTextureResourceStore(destResource);
-      GL_TextureResourceSetUpdated(destResource);
+      GL_TextureResourceSetRectUpdated(destResource, x, y, width, height);
    }
    else
    {
@@ -820,7 +1326,7 @@ void DrawJagobj(jagobj_t *jo, int x, int y, void *destResource)
    if(destResource)
    {
       base = GL_GetTextureResourceStore(destResource);
-      GL_TextureResourceSetUpdated(destResource);
+      GL_TextureResourceSetRectUpdated(destResource, x, y, width, height);
    }
    else
    {
@@ -1021,9 +1527,116 @@ void WriteEEProm(void)
 #define	UCLK_115200	((PCLK/(16*115200))-1)
 #endif
 
-// CALICO_FIXME: Jag-specific
-int GetSerialChar(void)
-{
+//
+// CALICO: link cable
+//
+// With -serial <device> (and -baud, default 115200), the serial code below
+// talks to a real port. A background thread moves bytes between the port
+// and a ring buffer each way, so that getting or putting a byte never
+// waits on the line; only WaitGetSerialChar waits, and it sleeps between
+// looks rather than spinning.
+//
+
+#define SERIALRING 4096 // power of two
+
+static hal_serialhandle_t serialport;
+static hal_semhandle_t    seriallock; // guards the ring indices
+static byte               serialrx[SERIALRING];
+static byte               serialtx[SERIALRING];
+static unsigned int       rxhead, rxtail; // the thread adds at head
+static unsigned int       txhead, txtail; // the game adds at head
+static int                serialdropped;  // bytes lost to full rings
+
+//
+// Serial thread main loop
+//
+static int I_SerialThread(void *data)
+{
+   byte buf[256];
+   int  len, i;
+
+   M_ScheduleThread(THREAD_IO);
+
+   while(1)
+   {
+      unsigned int head, tail;
+
+      // read whatever has come in, waiting a moment if nothing has
+      if((len = hal_platform.readSerial(serialport, buf, sizeof(buf))) > 0)
+      {
+         hal_threads.semWait(seriallock);
+         for(i = 0; i < len; i++)
+         {
+            if(rxhead - rxtail < SERIALRING)
+               serialrx[rxhead++ & (SERIALRING - 1)] = buf[i];
+            else
+               ++serialdropped;
+         }
+         hal_threads.semPost(seriallock);
+      }
+
+      // then send whatever is waiting to go out
+      hal_threads.semWait(seriallock);
+      head = txhead;
+      tail = txtail;
+      hal_threads.semPost(seriallock);
+
+      for(len = 0; tail + len != head && len < (int)sizeof(buf); len++)
+         buf[len] = serialtx[(tail + len) & (SERIALRING - 1)];
+
+      if(len && (len = hal_platform.writeSerial(serialport, buf, len)) > 0)
+      {
+         hal_threads.semWait(seriallock);
+         txtail += len;
+         hal_threads.semPost(seriallock);
+      }
+   }
+
+   return 0;
+}
+
+//
+// Open the port given by -serial, once. Returns false if there is none.
+//
+static boolean I_InitSerial(void)
+{
+   int p, b, baud = 115200;
+
+   if(serialport)
+      return true;
+   if(!(p = M_GetArgParameters("-serial", 1)) || !hal_platform.openSerial || !hal_threads.createThread)
+      return false;
+
+   if((b = M_GetArgParameters("-baud", 1)))
+      baud = atoi(myargv[b]);
+
+   if(!(serialport = hal_platform.openSerial(myargv[p], baud)))
+      I_Error("I_InitSerial: can't open %s at %i baud", myargv[p], baud);
+
+   if(!(seriallock = hal_threads.createSemaphore(1)) ||
+      !hal_threads.createThread(I_SerialThread, "I_SerialThread", NULL))
+      I_Error("I_InitSerial: can't start the serial thread");
+
+   D_printf("I_InitSerial: %s at %i baud\n", myargv[p], baud);
+   return true;
+}
+
+// CALICO_FIXME: Jag-specific
+int GetSerialChar(void)
+{
+   // CALICO: take a byte the serial thread has read, if there is one
+   int val = -1;
+
+   if(!serialport)
+      return -1;
+
+   hal_threads.semWait(seriallock);
+   if(rxtail != rxhead)
+      val = serialrx[rxtail++ & (SERIALRING - 1)];
+   hal_threads.semPost(seriallock);
+
+   return val;
+
 #if 0
    unsigned int val;
 
@@ -1041,8 +1654,6 @@ reget:
    val = ASIDATA;
 
    return val;
-#else
-   return -1;
 #endif
 }
 
@@ -1057,7 +1668,8 @@ int WaitGetSerialChar(void)
    {
       if(I_GetTime() >= vblstop)
          return -1; // timeout
-      val = GetSerialChar();
+      if((val = GetSerialChar()) == -1)
+         hal_timer.delay(1); // CALICO: don't spin while the line is quiet
    }
    while(val == -1);
 
@@ -1067,6 +1679,19 @@ int WaitGetSerialChar(void)
 // CALICO_FIXME: Jag-specific
 void PutSerialChar(int data)
 {
+   // CALICO: queue the byte for the serial thread. A full ring means the
+   // line has been stuck for a long time, so the byte is dropped, and the
+   // other side's timeout will bring about a reconnect.
+   if(serialport)
+   {
+      hal_threads.semWait(seriallock);
+      if(txhead - txtail < SERIALRING)
+         serialtx[txhead++ & (SERIALRING - 1)] = (byte)data;
+      else
+         ++serialdropped;
+      hal_threads.semPost(seriallock);
+   }
+
 #if 0
    unsigned int val;
 
@@ -1087,6 +1712,7 @@ void wait(int tics)
    start = I_GetTime();
    do
    {
+      hal_timer.delay(1); // CALICO: sleep rather than spin
       junk = I_GetTime();
    } 
    while(junk < start + tics);
@@ -1175,6 +1801,343 @@ void Player1Setup(void)
    PutSerialChar(0x22);
 }
 
+//
+// CALICO: UDP transport
+//
+// When the platform layer provides one, the serial link is replaced by UDP
+// datagrams. Each side resends every tic the other has not yet acknowledged,
+// so a lost packet only costs a resend rather than the game. The tic data
+// itself is the same six bytes the serial link carried, and the lockstep
+// and consistancy rules are unchanged.
+//
+// -netdelay <tics> schedules each local command that many tics ahead, so
+// the other side's command for a tic is usually already waiting when it
+// comes due, and the game only stalls when a link falls further behind
+// than the delay. Player 0's value is used by both sides.
+//
+
+#define NETPORT      5029
+#define NETBACKUP    16  // tics carried by one packet, and kept for resending
+#define NETMAXDELAY  6   // in flight each way: delay + 1 tics, plus one unacked
+#define NETTICBYTES  6
+#define NETTIMEOUT   120 // I_GetTime tics without progress before reconnecting
+#define NETRESENDMS  10
+
+enum
+{
+   NP_HELLO,  // player 1 asking to join
+   NP_SETUP,  // player 0's map, skill and game type
+   NP_READY,  // player 1 has the setup
+   NP_TIC     // [seq 4][ack 4][count][count * NETTICBYTES]
+};
+
+#define NETTICHEADER 10
+#define NETMAXPACKET (NETTICHEADER + NETBACKUP * NETTICBYTES)
+
+typedef struct netlink_s
+{
+   int  peerack; // last tic it has of those sent to it
+   int  inlast;  // last contiguous tic received from it
+   byte in[NETBACKUP][NETTICBYTES];
+} netlink_t;
+
+static boolean   netudp;   // set by I_NetSetup unless using -serial
+static int       nettic;   // next tic to be exchanged
+static int       netdelay; // tics local commands are held
+static byte      netout[NETBACKUP][NETTICBYTES];
+static netlink_t netlinks[MAXPLAYERS]; // a player uses the first; a server, one each
+
+static void I_NetWriteLong(byte *p, int v)
+{
+   p[0] = (byte)(v >> 24);
+   p[1] = (byte)(v >> 16);
+   p[2] = (byte)(v >>  8);
+   p[3] = (byte)v;
+}
+
+static int I_NetReadLong(const byte *p)
+{
+   return (int)(((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]);
+}
+
+static void I_NetSendType(int type)
+{
+   byte b = (byte)type;
+   hal_net.send(&b, 1);
+}
+
+//
+// Build the game setup for the given player, and return its length
+//
+static int I_NetBuildSetup(byte *packet, int player)
+{
+   packet[0] = NP_SETUP;
+   packet[1] = (byte)startmap;
+   packet[2] = (byte)startskill;
+   packet[3] = (byte)starttype;
+   packet[4] = (byte)netdelay;
+   packet[5] = (byte)player;
+   return 6;
+}
+
+//
+// Build a packet of the tics up to last in ring out which link has not
+// acknowledged, and return its length
+//
+static int I_NetBuildTics(byte *packet, byte (*out)[NETTICBYTES], int last, const netlink_t *link)
+{
+   int first, count, i;
+
+   first = link->peerack + 1;
+   if(first < last - NETBACKUP + 1)
+      first = last - NETBACKUP + 1;
+   count = last - first + 1;
+   if(count < 0)
+      count = 0; // nothing new; still carries the ack
+
+   packet[0] = NP_TIC;
+   I_NetWriteLong(packet + 1, first);
+   I_NetWriteLong(packet + 5, link->inlast);
+   packet[9] = (byte)count;
+   for(i = 0; i < count; i++)
+      D_memcpy(packet + NETTICHEADER + i * NETTICBYTES, out[(first + i) % NETBACKUP], NETTICBYTES);
+
+   return NETTICHEADER + count * NETTICBYTES;
+}
+
+//
+// Send every tic scheduled so far that the other side has not acknowledged
+//
+static void I_NetSendTics(void)
+{
+   byte packet[NETMAXPACKET];
+
+   hal_net.send(packet, I_NetBuildTics(packet, netout, nettic + netdelay, &netlinks[0]));
+}
+
+//
+// Take in the tics from one NP_TIC packet. Acks past maxack are not for
+// anything sent yet.
+//
+static void I_NetReadTics(netlink_t *link, const byte *packet, int len, int maxack)
+{
+   int first, ack, count, i;
+
+   if(len < NETTICHEADER)
+      return;
+
+   first = I_NetReadLong(packet + 1);
+   ack   = I_NetReadLong(packet + 5);
+   count = packet[9];
+   if(count > NETBACKUP || len < NETTICHEADER + count * NETTICBYTES)
+      return;
+
+   if(ack > link->peerack && ack <= maxack)
+      link->peerack = ack;
+
+   // keep tics in order, and never overwrite one not yet run
+   for(i = 0; i < count; i++)
+   {
+      int tic = first + i;
+      if(tic == link->inlast + 1 && tic < nettic + NETBACKUP)
+      {
+         D_memcpy(link->in[tic % NETBACKUP], packet + NETTICHEADER + i * NETTICBYTES, NETTICBYTES);
+         link->inlast = tic;
+      }
+   }
+}
+
+static boolean I_NetAborted(void)
+{
+   joystick1 = hal_input.getEvents();
+   if(joystick1 == JP_OPTION)
+   {
+      starttype = gt_single;
+      return true;
+   }
+   return false;
+}
+
+//
+// Player 0 listens, and answers each hello with the game setup until player
+// 1 says it is ready or starts sending tics
+//
+static void I_NetUDPPlayer0Setup(void)
+{
+   byte packet[NETMAXPACKET];
+   int  len;
+
+   I_Print8(1, 1, "waiting...");
+   consoleplayer = 0;
+
+   while(!I_NetAborted())
+   {
+      while((len = hal_net.receive(packet, sizeof(packet))) > 0)
+      {
+         switch(packet[0])
+         {
+         case NP_HELLO:
+            hal_net.send(packet, I_NetBuildSetup(packet, 1));
+            break;
+         case NP_TIC:
+            I_NetReadTics(&netlinks[0], packet, len, nettic + netdelay);
+            // fall through
+         case NP_READY:
+            return;
+         }
+      }
+      wait(1);
+   }
+}
+
+//
+// Player 1 says hello until it hears the setup
+//
+static void I_NetUDPPlayer1Setup(void)
+{
+   byte packet[NETMAXPACKET];
+   int  len;
+
+   I_Print8(1, 1, "connecting...");
+
+   while(!I_NetAborted())
+   {
+      I_NetSendType(NP_HELLO);
+      wait(4);
+
+      while((len = hal_net.receive(packet, sizeof(packet))) > 0)
+      {
+         if(packet[0] == NP_SETUP && len >= 5)
+         {
+            startmap   = packet[1];
+            startskill = packet[2];
+            starttype  = packet[3];
+            netdelay   = packet[4] <= NETMAXDELAY ? packet[4] : NETMAXDELAY;
+
+            // a dedicated server may make this side either player
+            consoleplayer = (len >= 6) ? (packet[5] & 1) : 1;
+
+            I_NetSendType(NP_READY);
+            I_NetSendType(NP_READY);
+            return;
+         }
+      }
+   }
+}
+
+static int I_NetPort(void)
+{
+   int p;
+
+   if((p = M_GetArgParameters("-port", 1)))
+      return atoi(myargv[p]);
+   return NETPORT;
+}
+
+static int I_NetDelay(void)
+{
+   int p;
+
+   if((p = M_GetArgParameters("-netdelay", 1)))
+      return emax(emin(atoi(myargv[p]), NETMAXDELAY), 0);
+   return 0;
+}
+
+//
+// -connect <host> joins a game as player 1; otherwise this side listens as
+// player 0. -port sets the UDP port for both.
+//
+static void I_NetUDPSetup(void)
+{
+   const char *host = NULL;
+   int port;
+   int p;
+
+   if((p = M_GetArgParameters("-connect", 1)))
+      host = myargv[p];
+   port     = I_NetPort();
+   netdelay = I_NetDelay();
+
+   if(!hal_net.open(host, port))
+   {
+      if(host)
+         I_Error("I_NetSetup: can't reach %s on port %i", host, port);
+      else
+         I_Error("I_NetSetup: can't listen on port %i", port);
+   }
+
+   nettic     = 0;
+   netlinks[0].peerack = -1;
+   netlinks[0].inlast  = -1;
+
+   if(host)
+      I_NetUDPPlayer1Setup();
+   else
+      I_NetUDPPlayer0Setup();
+
+   if(starttype == gt_single)
+   {
+      hal_net.close();
+      return;
+   }
+
+   // the first tics of the delay run with no buttons held, at the rate
+   // MiniLoop starts with
+   for(p = 0; p < netdelay; p++)
+   {
+      D_memset(netout[p], 0, NETTICBYTES);
+      netout[p][5] = 4;
+   }
+}
+
+//
+// Schedule outbytes netdelay tics ahead, then exchange the current tic,
+// resending until the other side's copy of it arrives. Returns false on a
+// timeout; otherwise mybytes and inbytes are both sides' commands for it.
+//
+static boolean I_NetUDPTransfer(const byte *outbytes, byte *mybytes, byte *inbytes)
+{
+   byte packet[NETMAXPACKET];
+   int  len;
+   int  stoptime;
+   unsigned int nextsend;
+
+   D_memcpy(netout[(nettic + netdelay) % NETBACKUP], outbytes, NETTICBYTES);
+
+   stoptime = I_GetTime() + NETTIMEOUT;
+   nextsend = hal_timer.getTimeMS();
+
+   while(netlinks[0].inlast < nettic)
+   {
+      if(hal_timer.getTimeMS() >= nextsend)
+      {
+         I_NetSendTics();
+         nextsend = hal_timer.getTimeMS() + NETRESENDMS;
+      }
+
+      while((len = hal_net.receive(packet, sizeof(packet))) > 0)
+      {
+         if(packet[0] == NP_TIC)
+            I_NetReadTics(&netlinks[0], packet, len, nettic + netdelay);
+      }
+
+      if(netlinks[0].inlast >= nettic)
+         break;
+      if(I_GetTime() >= stoptime)
+         return false;
+      hal_timer.delay(1);
+   }
+
+   // let the other side know at once that this tic arrived
+   if(netlinks[0].peerack < nettic + netdelay - 1)
+      I_NetSendTics();
+
+   D_memcpy(mybytes, netout[nettic % NETBACKUP], NETTICBYTES);
+   D_memcpy(inbytes, netlinks[0].in[nettic % NETBACKUP], NETTICBYTES);
+   ++nettic;
+   return true;
+}
+
 void DrawSinglePlaque(jagobj_t *pl, const char *name);
 
 int listen1, listen2;
@@ -1191,6 +2154,25 @@ void I_NetSetup(void)
 
    UpdateBuffer(); // CALICO: after plaque
 
+   // CALICO: a link cable given by -serial takes the place of UDP
+   netudp = !I_InitSerial() && hal_net.open;
+   if(netudp)
+   {
+      I_NetUDPSetup();
+      DoubleBufferSetup();
+      UpdateBuffer();
+      return;
+   }
+
+   if(serialport)
+   {
+      hal_threads.semWait(seriallock);
+      if(serialdropped)
+         D_printf("I_NetSetup: %i serial bytes were dropped\n", serialdropped);
+      serialdropped = 0;
+      hal_threads.semPost(seriallock);
+   }
+
    // CALICO_FIXME: Jag-specific
 #if 0
    ASICLK = UCLK_115200;
@@ -1229,12 +2211,32 @@ void I_NetSetup(void)
 
 void G_PlayerReborn(int player);
 
+//
+// CALICO: the byte both sides compare each tic to catch a desync
+//
+static byte I_NetConsistancy(void)
+{
+   int consistancy; // CALICO: truncation not handled properly in original code
+
+   consistancy = players[0].mo->x ^ players[0].mo->y ^ players[1].mo->x ^ players[1].mo->y;
+   consistancy = (consistancy>>8) ^ consistancy ^ (consistancy>>16);
+
+   return (byte)(consistancy & 0xff);
+}
+
+unsigned int netlocalbuttons;
+
+//
+// Exchange buttons with the other player, returning theirs for this tic.
+// netlocalbuttons is set to this player's own buttons for the tic, which
+// are not the ones passed in when -netdelay is holding them back.
+//
 unsigned I_NetTransfer(unsigned int buttons)
 {
    int  val;
    byte inbytes[6];
    byte outbytes[6];
-   int  consistancy; // CALICO: truncation not handled properly in original code
+   byte mybytes[6];
    int  i;
 
    outbytes[0] = buttons>>24;
@@ -1242,13 +2244,19 @@ unsigned I_NetTransfer(unsigned int buttons)
    outbytes[2] = buttons>>8;
    outbytes[3] = buttons;
 
-   consistancy = players[0].mo->x ^ players[0].mo->y ^ players[1].mo->x ^ players[1].mo->y;
-   consistancy = (consistancy>>8) ^ consistancy ^ (consistancy>>16);
-
-   outbytes[4] = (byte)(consistancy & 0xff);
+   outbytes[4] = I_NetConsistancy();
    outbytes[5] = vblsinframe;
+   D_memcpy(mybytes, outbytes, sizeof(mybytes));
 
-   if(consoleplayer)
+   if(netudp)
+   {
+      if(!I_NetUDPTransfer(outbytes, mybytes, inbytes))
+         goto reconnect;
+
+      // both take gamevbls from player 0's command for the tic
+      vblsinframe = consoleplayer ? inbytes[5] : mybytes[5];
+   }
+   else if(consoleplayer)
    {
       // player 1 waits before sending
       for(i = 0; i <= 5; i++)
@@ -1276,7 +2284,7 @@ unsigned I_NetTransfer(unsigned int buttons)
    }
 
    // check for consistancy error
-   if(inbytes[4] != outbytes[4])
+   if(inbytes[4] != mybytes[4])
    {
       jagobj_t *pl;
 
@@ -1289,6 +2297,7 @@ unsigned I_NetTransfer(unsigned int buttons)
       goto reconnect;
    }
 
+   netlocalbuttons = (mybytes[0]<<24) + (mybytes[1]<<16) + (mybytes[2]<<8) + mybytes[3];
    val = (inbytes[0]<<24) + (inbytes[1]<<16) + (inbytes[2]<<8) + inbytes[3];
 
    return val;
@@ -1309,8 +2318,220 @@ reconnect:
 
    gameaction = ga_warped;
    ticbuttons[0] = ticbuttons[1] = oldticbuttons[0] = oldticbuttons[1] = 0;
+   netlocalbuttons = 0;
    return 0;
 }
 
+//=============================================================================
+//
+// CALICO: dedicated server
+//
+// With -dedicated, the game runs headless, and both players join it with
+// -connect rather than one of them listening. It runs every tic itself from
+// their commands and passes each command on to the other player as a peer
+// would have sent it, so the players only need to reach the server. -warp,
+// -skill and -deathmatch choose the game, -port and -netdelay are as for a
+// player, and every -hashevery tics (default 150, 0 for never) the server
+// prints a hash of the game state for hosts to log.
+//
+
+boolean dedicated;
+
+static int     serverport;
+static int     serverhashevery = 150;
+static byte    servercons[NETBACKUP]; // consistancy the players should send
+static boolean serverdesync[MAXPLAYERS];
+
+unsigned int NetToLocal(unsigned int cmd);
+
+//
+// Wait for both players. Each is answered only once both have said hello,
+// so neither starts sending tics that will not be passed on.
+//
+static void I_NetServeSetup(void)
+{
+   byte    packet[NETMAXPACKET];
+   byte    setup[NETMAXPACKET];
+   boolean hello[MAXPLAYERS], ready[MAXPLAYERS];
+   int     len, peer, i;
+   int     numhello = 0, numready = 0;
+
+   if(!hal_net.open || !hal_net.open(NULL, serverport))
+      I_Error("I_NetServeSetup: can't listen on port %i", serverport);
+
+   nettic = 0;
+   for(i = 0; i < MAXPLAYERS; i++)
+   {
+      netlinks[i].peerack = netlinks[i].inlast = -1;
+      hello[i] = ready[i] = serverdesync[i] = false;
+   }
+
+   printf("server: waiting for players on port %i\n", serverport);
+   fflush(stdout);
+
+   while(numready < MAXPLAYERS)
+   {
+      while((len = hal_net.receiveFrom(packet, sizeof(packet), &peer)) > 0)
+      {
+         if(peer >= MAXPLAYERS)
+            continue;
+
+         switch(packet[0])
+         {
+         case NP_HELLO:
+            if(!hello[peer])
+            {
+               hello[peer] = true;
+               ++numhello;
+            }
+            if(numhello == MAXPLAYERS)
+               hal_net.sendTo(peer, setup, I_NetBuildSetup(setup, peer));
+            break;
+         case NP_TIC:
+            I_NetReadTics(&netlinks[peer], packet, len, -1);
+            // fall through
+         case NP_READY:
+            if(numhello == MAXPLAYERS && !ready[peer])
+            {
+               ready[peer] = true;
+               ++numready;
+               printf("server: player %i joined\n", peer);
+               fflush(stdout);
+            }
+            break;
+         }
+      }
+      hal_timer.delay(1);
+   }
+
+   // the players' first tics of delay carry no consistancy
+   for(i = 0; i < netdelay; i++)
+      servercons[i] = 0;
+}
+
+//
+// Send each player the other's tics it does not have yet
+//
+static void I_NetServeSend(void)
+{
+   byte packet[NETMAXPACKET];
+   int  i;
+
+   for(i = 0; i < MAXPLAYERS; i++)
+   {
+      netlink_t *other = &netlinks[!i];
+      hal_net.sendTo(i, packet, I_NetBuildTics(packet, other->in, other->inlast, &netlinks[i]));
+   }
+}
+
+//
+// A player has stopped answering; do what I_NetTransfer does on each side
+// of a lost link, once both are back
+//
+static void I_NetServeLost(void)
+{
+   printf("server: lost a player at tic %i; waiting again\n", gametic);
+   fflush(stdout);
+
+   I_NetServeSetup();
+
+   G_PlayerReborn(0);
+   G_PlayerReborn(1);
+
+   gameaction = ga_warped;
+   ticbuttons[0] = ticbuttons[1] = oldticbuttons[0] = oldticbuttons[1] = 0;
+}
+
+//
+// Take both players' commands for this tic, passing each on to the other
+//
+void I_NetServeTic(void)
+{
+   byte packet[NETMAXPACKET];
+   int  len, peer, stoptime, i;
+   unsigned int nextsend;
+
+   // the players compute theirs now, for the tic netdelay ahead
+   servercons[(nettic + netdelay) % NETBACKUP] = I_NetConsistancy();
+
+   stoptime = I_GetTime() + NETTIMEOUT;
+   nextsend = hal_timer.getTimeMS();
+
+   while(netlinks[0].inlast < nettic || netlinks[1].inlast < nettic)
+   {
+      if(hal_timer.getTimeMS() >= nextsend)
+      {
+         I_NetServeSend();
+         nextsend = hal_timer.getTimeMS() + NETRESENDMS;
+      }
+
+      while((len = hal_net.receiveFrom(packet, sizeof(packet), &peer)) > 0)
+      {
+         if(peer < MAXPLAYERS && packet[0] == NP_TIC)
+            I_NetReadTics(&netlinks[peer], packet, len, netlinks[!peer].inlast);
+      }
+
+      if(netlinks[0].inlast >= nettic && netlinks[1].inlast >= nettic)
+         break;
+      if(I_GetTime() >= stoptime)
+      {
+         I_NetServeLost();
+         return;
+      }
+      hal_timer.delay(1);
+   }
+
+   // pass the tic on at once
+   I_NetServeSend();
+
+   for(i = 0; i < MAXPLAYERS; i++)
+   {
+      const byte *b = netlinks[i].in[nettic % NETBACKUP];
+
+      ticbuttons[i] = NetToLocal((b[0]<<24) + (b[1]<<16) + (b[2]<<8) + b[3]);
+
+      if(b[4] != servercons[nettic % NETBACKUP] && !serverdesync[i])
+      {
+         printf("server: player %i is out of sync at tic %i\n", i, gametic);
+         fflush(stdout);
+         serverdesync[i] = true;
+      }
+   }
+   vblsinframe = netlinks[0].in[nettic % NETBACKUP][5]; // player 0's, as on both sides
+   ++nettic;
+
+   if(serverhashevery && !(gametic % serverhashevery))
+   {
+      printf("server: tic %i state hash %08x\n", gametic, P_StateHash());
+      fflush(stdout);
+   }
+}
+
+//
+// Run a game for two players who connect to this one. Does not return.
+//
+void I_NetServe(void)
+{
+   int p;
+
+   serverport = I_NetPort();
+   netdelay   = I_NetDelay();
+
+   if((p = M_GetArgParameters("-warp", 1)))
+      startmap = emax(atoi(myargv[p]), 1);
+   if((p = M_GetArgParameters("-skill", 1)))
+      startskill = emax(emin(atoi(myargv[p]), sk_nightmare), sk_baby);
+   starttype = M_FindArgument("-deathmatch") ? gt_deathmatch : gt_coop;
+   if((p = M_GetArgParameters("-hashevery", 1)))
+      serverhashevery = emax(atoi(myargv[p]), 0);
+
+   dedicated = nodrawing = true;
+
+   I_NetServeSetup();
+   G_InitNew(startskill, startmap, starttype);
+   G_StartBroadcast();
+   G_RunGame();
+}
+
 // EOF
 
@@ -0,0 +1,218 @@
+/*
+  CALICO
+
+  Allocation counters
+
+  With -alloccount, or while the performance HUD or -trace is on, every
+  allocation and free made through the zone, the graphics cache, elib,
+  C++'s operator new, and SDL is counted, along with the bytes asked for and
+  the time taken, for each allocator. M_AllocFrame closes off each frame's
+  counts, which the HUD shows and the trace records as counters.
+
+  -zeroalloc <frames> makes a -timedemo fail if any allocation is made in a
+  frame after the first <frames>, which catches allocations hidden in paths
+  which run every frame once the level is up and running.
+*/
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "elib/elib.h"
+#include "hal/hal_timer.h"
+#include "m_alloc.h"
+#include "m_trace.h"
+
+// m_argv.h needs keywords.h, which C++ can't include
+extern "C" const char *const *myargv;
+extern "C" int M_GetArgParameters(const char *arg, int count);
+
+struct allocatorcounts_t
+{
+   std::atomic<unsigned int> allocs;
+   std::atomic<unsigned int> frees;
+   std::atomic<unsigned int> bytes;
+   std::atomic<unsigned int> us;
+};
+
+int alloccounting;
+
+static allocatorcounts_t counts[NUMALLOCATORS];  // since startup
+static allocstats_t      lastcounts[NUMALLOCATORS];
+static allocstats_t      framecounts[NUMALLOCATORS]; // the last frame's
+
+static const char *allocnames[NUMALLOCATORS] =
+{
+   "zone",
+   "rcache",
+   "elib",
+   "new",
+   "sdl"
+};
+
+static const char *tracenames[NUMALLOCATORS] =
+{
+   "zone allocs",
+   "rcache allocs",
+   "elib allocs",
+   "new allocs",
+   "sdl allocs"
+};
+
+static int steadyframes = -1; // -zeroalloc
+static int frames;
+static int steadyfailures;    // frames past the steady point which allocated
+
+//
+// Start counting if -alloccount or -zeroalloc were given
+//
+void M_InitAllocCounts(void)
+{
+   int p;
+
+   if((p = M_GetArgParameters("-zeroalloc", 1)))
+   {
+      steadyframes = std::atoi(myargv[p]);
+      M_EnableAllocCounts();
+   }
+   if(M_GetArgParameters("-alloccount", 0) || tracing)
+      M_EnableAllocCounts();
+}
+
+void M_EnableAllocCounts(void)
+{
+   if(hal_timer.getTimeUS)
+      alloccounting = 1;
+}
+
+unsigned int M_AllocBegin(void)
+{
+   return alloccounting ? hal_timer.getTimeUS() : 0;
+}
+
+void M_AllocEnd(allocator_t allocator, size_t bytes, unsigned int start)
+{
+   allocatorcounts_t &c = counts[allocator];
+
+   if(!alloccounting)
+      return;
+
+   c.allocs.fetch_add(1, std::memory_order_relaxed);
+   c.bytes.fetch_add(static_cast<unsigned int>(bytes), std::memory_order_relaxed);
+   c.us.fetch_add(hal_timer.getTimeUS() - start, std::memory_order_relaxed);
+}
+
+void M_FreeEnd(allocator_t allocator, unsigned int start)
+{
+   allocatorcounts_t &c = counts[allocator];
+
+   if(!alloccounting)
+      return;
+
+   c.frees.fetch_add(1, std::memory_order_relaxed);
+   c.us.fetch_add(hal_timer.getTimeUS() - start, std::memory_order_relaxed);
+}
+
+//
+// Take the counts made since the last call as one frame's. Called by
+// MiniLoop after each frame.
+//
+void M_AllocFrame(void)
+{
+   unsigned int allocs = 0;
+
+   if(!alloccounting)
+      return;
+
+   for(int i = 0; i < NUMALLOCATORS; i++)
+   {
+      allocstats_t now =
+      {
+         counts[i].allocs.load(std::memory_order_relaxed),
+         counts[i].frees.load(std::memory_order_relaxed),
+         counts[i].bytes.load(std::memory_order_relaxed),
+         counts[i].us.load(std::memory_order_relaxed)
+      };
+
+      framecounts[i].allocs = now.allocs - lastcounts[i].allocs;
+      framecounts[i].frees  = now.frees  - lastcounts[i].frees;
+      framecounts[i].bytes  = now.bytes  - lastcounts[i].bytes;
+      framecounts[i].us     = now.us     - lastcounts[i].us;
+      lastcounts[i] = now;
+
+      allocs += framecounts[i].allocs;
+      M_TraceCounter(tracenames[i], static_cast<int>(framecounts[i].allocs));
+   }
+
+   if(steadyframes >= 0 && ++frames > steadyframes && allocs)
+   {
+      // the first frame is the one worth looking into
+      if(!steadyfailures++)
+      {
+         std::printf("zeroalloc: frame %d made %u allocations:", frames, allocs);
+         for(int i = 0; i < NUMALLOCATORS; i++)
+            std::printf(" %s %u", allocnames[i], framecounts[i].allocs);
+         std::printf("\n");
+         std::fflush(stdout);
+      }
+   }
+}
+
+void M_GetAllocFrame(allocator_t allocator, allocstats_t *stats)
+{
+   *stats = framecounts[allocator];
+}
+
+const char *M_AllocatorName(allocator_t allocator)
+{
+   return allocnames[allocator];
+}
+
+//
+// How many frames past the -zeroalloc point made allocations
+//
+int M_AllocSteadyFailures(void)
+{
+   return steadyfailures;
+}
+
+//=============================================================================
+//
+// Every C++ allocation goes through here, so that it can be counted
+//
+
+void *operator new(std::size_t size)
+{
+   unsigned int start = M_AllocBegin();
+   void *ptr;
+
+   if(!(ptr = std::malloc(size ? size : 1)))
+      throw std::bad_alloc();
+   M_AllocEnd(ALLOC_NEW, size, start);
+
+   return ptr;
+}
+
+void *operator new[](std::size_t size)
+{
+   return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+   unsigned int start;
+
+   if(!ptr)
+      return;
+
+   start = M_AllocBegin();
+   std::free(ptr);
+   M_FreeEnd(ALLOC_NEW, start);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+   operator delete(ptr);
+}
+
+// EOF
+
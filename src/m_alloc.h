@@ -0,0 +1,53 @@
+/*
+  CALICO
+
+  Allocation counters
+*/
+
+#ifndef M_ALLOC_H__
+#define M_ALLOC_H__
+
+#include <stddef.h>
+
+typedef enum
+{
+   ALLOC_ZONE,   // Z_Malloc
+   ALLOC_RCACHE, // R_CacheAlloc
+   ALLOC_ELIB,   // E_Malloc and the rest of elib/zone.cpp
+   ALLOC_NEW,    // C++ operator new
+   ALLOC_SDL,    // SDL's own allocations
+   NUMALLOCATORS
+} allocator_t;
+
+typedef struct allocstats_s
+{
+   unsigned int allocs;
+   unsigned int frees;
+   unsigned int bytes; // asked for
+   unsigned int us;    // spent allocating and freeing
+} allocstats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int alloccounting; // set while allocations are being counted
+
+void         M_InitAllocCounts(void);
+void         M_EnableAllocCounts(void);
+unsigned int M_AllocBegin(void);
+void         M_AllocEnd(allocator_t allocator, size_t bytes, unsigned int start);
+void         M_FreeEnd(allocator_t allocator, unsigned int start);
+void         M_AllocFrame(void);
+void         M_GetAllocFrame(allocator_t allocator, allocstats_t *stats);
+const char  *M_AllocatorName(allocator_t allocator);
+int          M_AllocSteadyFailures(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+// EOF
+
@@ -0,0 +1,528 @@
+/*
+  CALICO
+
+  Kernel microbenchmarks and the render benchmark
+
+  With -bench, the game times a set of engine kernels on the loaded IWAD,
+  writes the results as JSON to stdout (or to the file given by -benchout),
+  and exits. -benchonly <name> runs just the benchmarks whose names start
+  with name. Each benchmark does a fixed amount of work on fixed data, with
+  any randomness from a fixed seed, and is run BENCHRUNS times; the best and
+  median times per operation are reported, so that a change to a kernel can
+  be compared before and after on the same machine.
+
+  The playsim benchmarks run on the level given by -warp (default 1) at
+  the menu's skill, loaded as a demo would load it.
+
+  -renderbench times the renderer alone. Each map, or only the one given by
+  -warp, is loaded and the view is put at the middle of every subsector
+  (every -benchstep'th with that given), at eye height, looking in
+  -benchangles directions (default 4) evenly spaced from east. Each view is
+  drawn -benchruns times (default 3), and its median time is the one
+  reported. For each map the mean and worst view times are written, with
+  where the worst view is and what it holds, and the most viswalls,
+  visplanes and vissprites any view needed. No tics are run, so the views
+  are the same from one run to the next. With the GL world renderer, the
+  time is that taken to build the GL's work for the frame, not to draw it.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hal/hal_ml.h"
+#include "hal/hal_timer.h"
+#include "doomdef.h"
+#include "m_argv.h"
+#include "m_bench.h"
+#include "p_local.h"
+#include "r_local.h"
+
+#define BENCHRUNS 5
+
+#define MAXRENDERRUNS 32
+
+void    decode(unsigned char *input, unsigned char *output);
+boolean PS_CheckSight(mobj_t *t1, mobj_t *t2);
+void    G_DoLoadLevel(void);
+
+typedef struct bench_s
+{
+   const char *name;
+   int (*run)(void); // returns the operations done
+} bench_t;
+
+static unsigned int benchseed;
+static inpixel_t   *benchflat; // 64x64, from the IWAD's first flat
+
+//
+// A fixed sequence of numbers for each run, unlike M_Random's table
+//
+static unsigned int M_BenchRandom(void)
+{
+   benchseed = benchseed * 1664525u + 1013904223u;
+   return benchseed >> 8;
+}
+
+//=============================================================================
+//
+// Drawers
+//
+
+static int M_BenchColumns(int light)
+{
+   int i, x, yh = renderheight - 1;
+
+   for(i = 0; i < 16; i++)
+   {
+      for(x = 0; x < renderwidth; x++)
+         I_DrawColumn(x, 0, yh, light, x << 12, FRACUNIT / 2, benchflat + ((x & 63) << 6), 64);
+   }
+
+   return 16 * renderwidth;
+}
+
+static int M_BenchSpans(int light)
+{
+   int i, y;
+
+   for(i = 0; i < 16; i++)
+   {
+      for(y = 0; y < renderheight; y++)
+      {
+         I_DrawSpan(y, 0, renderwidth - 1, light, y << 14, y << 15,
+                    FRACUNIT / 3, FRACUNIT / 5, benchflat);
+      }
+   }
+
+   return 16 * renderheight;
+}
+
+static int M_BenchColumnDark(void)   { return M_BenchColumns(0);   }
+static int M_BenchColumnMid(void)    { return M_BenchColumns(128); }
+static int M_BenchColumnBright(void) { return M_BenchColumns(255); }
+static int M_BenchSpanDark(void)     { return M_BenchSpans(0);     }
+static int M_BenchSpanMid(void)      { return M_BenchSpans(128);   }
+static int M_BenchSpanBright(void)   { return M_BenchSpans(255);   }
+
+//=============================================================================
+//
+// Zone and WAD
+//
+
+#define ZONELIVE 64
+
+//
+// Allocate and free blocks of repeatable, mixed sizes, keeping ZONELIVE of
+// them live so the zone fragments as it does in play
+//
+static int M_BenchZone(void)
+{
+   void *live[ZONELIVE];
+   int   i, ops = 20000;
+
+   benchseed = 1;
+   for(i = 0; i < ZONELIVE; i++)
+      live[i] = Z_Malloc(16 + M_BenchRandom() % 4096, PU_STATIC, NULL);
+
+   for(i = 0; i < ops; i++)
+   {
+      int slot = M_BenchRandom() % ZONELIVE;
+
+      Z_Free(live[slot]);
+      live[slot] = Z_Malloc(16 + M_BenchRandom() % 4096, PU_STATIC, NULL);
+   }
+
+   for(i = 0; i < ZONELIVE; i++)
+      Z_Free(live[i]);
+
+   return ops;
+}
+
+//
+// Look up every lump by name
+//
+static int M_BenchLumpNames(void)
+{
+   char name[9];
+   int  i, round;
+
+   name[8] = '\0';
+   for(round = 0; round < 10; round++)
+   {
+      for(i = 0; i < numlumps; i++)
+      {
+         memcpy(name, lumpinfo[i].name, 8);
+         name[0] &= 0x7f; // compression flag
+         W_CheckNumForName(name);
+      }
+   }
+
+   return 10 * numlumps;
+}
+
+//
+// Decode every compressed lump
+//
+static int M_BenchDecode(void)
+{
+   static unsigned char *dest;
+   static int            maxsize;
+   int i, ops = 0;
+
+   for(i = 0; i < numlumps; i++)
+   {
+      int size;
+
+      if(!(lumpinfo[i].name[0] & 0x80))
+         continue;
+
+      size = BIGLONG(lumpinfo[i].size);
+      if(size + 1 > maxsize)
+      {
+         if(!(dest = realloc(dest, size + 1)))
+            I_Error("M_BenchDecode: no memory for lump %i", i);
+         maxsize = size + 1;
+      }
+
+      decode(W_POINTLUMPNUM(i), dest);
+      ++ops;
+   }
+
+   return ops;
+}
+
+//=============================================================================
+//
+// Playsim
+//
+
+//
+// Check sight from every mobj to the player
+//
+static int M_BenchSight(void)
+{
+   mobj_t *mo, *pmo = players[0].mo;
+   int     round, ops = 0;
+
+   for(round = 0; round < 20; round++)
+   {
+      for(mo = mobjhead.next; mo != &mobjhead; mo = mo->next)
+      {
+         if(mo != pmo)
+         {
+            PS_CheckSight(mo, pmo);
+            ++ops;
+         }
+      }
+   }
+
+   return ops;
+}
+
+//
+// Check the positions a step away from every solid mobj in eight
+// directions, which is P_TryMove's collision work without moving anything
+//
+static int M_BenchPosition(void)
+{
+   static const int dx[8] = { 1, 1, 0, -1, -1, -1,  0,  1 };
+   static const int dy[8] = { 0, 1, 1,  1,  0, -1, -1, -1 };
+   mobj_t *mo;
+   int     d, round, ops = 0;
+
+   for(round = 0; round < 10; round++)
+   {
+      for(mo = mobjhead.next; mo != &mobjhead; mo = mo->next)
+      {
+         if(!(mo->flags & MF_SOLID))
+            continue;
+
+         for(d = 0; d < 8; d++)
+         {
+            P_CheckPosition(mo, mo->x + dx[d] * 8 * FRACUNIT, mo->y + dy[d] * 8 * FRACUNIT);
+            ++ops;
+         }
+      }
+   }
+
+   return ops;
+}
+
+//=============================================================================
+//
+// Main
+//
+
+static const bench_t benches[] =
+{
+   { "draw_column_light_0",   M_BenchColumnDark   },
+   { "draw_column_light_128", M_BenchColumnMid    },
+   { "draw_column_light_255", M_BenchColumnBright },
+   { "draw_span_light_0",     M_BenchSpanDark     },
+   { "draw_span_light_128",   M_BenchSpanMid      },
+   { "draw_span_light_255",   M_BenchSpanBright   },
+   { "zone_churn",            M_BenchZone         },
+   { "lump_lookup",           M_BenchLumpNames    },
+   { "lzss_decode",           M_BenchDecode       },
+   { "sight_check",           M_BenchSight        },
+   { "check_position",        M_BenchPosition     }
+};
+
+static int M_CompareTimes(const void *a, const void *b)
+{
+   double x = *(const double *)a, y = *(const double *)b;
+
+   return (x > y) - (x < y);
+}
+
+//
+// Run the benchmarks, write their results, and exit
+//
+void M_Bench(void)
+{
+   const char *only = NULL;
+   FILE       *out  = stdout;
+   int         p, i, r, first = 1, map = 1;
+
+   if(!hal_timer.getTimeUS)
+      I_Error("M_Bench: no microsecond timer");
+
+   if((p = M_GetArgParameters("-benchonly", 1)))
+      only = myargv[p];
+   if((p = M_GetArgParameters("-benchout", 1)) && !(out = fopen(myargv[p], "w")))
+      I_Error("M_Bench: can't write %s", myargv[p]);
+   if((p = M_GetArgParameters("-warp", 1)))
+      map = emax(atoi(myargv[p]), 1);
+
+   benchflat = W_CacheLumpNum(firstflat, PU_STATIC);
+
+   G_InitNew(startskill, map, gt_single);
+   G_DoLoadLevel();
+
+   fprintf(out, "{\n  \"map\": %d,\n  \"runs\": %d,\n  \"benchmarks\": [", map, BENCHRUNS);
+
+   for(i = 0; i < (int)(sizeof(benches) / sizeof(benches[0])); i++)
+   {
+      const bench_t *b = &benches[i];
+      double times[BENCHRUNS];
+      int    ops = 0;
+
+      if(only && strncmp(b->name, only, strlen(only)))
+         continue;
+
+      for(r = 0; r < BENCHRUNS; r++)
+      {
+         unsigned int start = hal_timer.getTimeUS();
+
+         ops = b->run();
+         times[r] = (hal_timer.getTimeUS() - start) * 1000.0 / emax(ops, 1);
+      }
+      qsort(times, BENCHRUNS, sizeof(times[0]), M_CompareTimes);
+
+      fprintf(out, "%s\n    { \"name\": \"%s\", \"ops\": %d, \"best_ns_per_op\": %.2f, \"median_ns_per_op\": %.2f }",
+              first ? "" : ",", b->name, ops, times[0], times[BENCHRUNS / 2]);
+      first = 0;
+   }
+
+   fprintf(out, "\n  ]\n}\n");
+   if(out != stdout)
+      fclose(out);
+   fflush(stdout);
+
+   hal_medialayer.exit();
+}
+
+//=============================================================================
+//
+// Render benchmark
+//
+
+typedef struct benchview_s
+{
+   fixed_t      x, y, z;
+   angle_t      angle;
+   int          subsector;
+   unsigned int us;             // median time to draw
+   int          walls, planes, sprites;
+} benchview_t;
+
+//
+// Move the player to look from a point
+//
+static void M_PlaceView(player_t *player, const benchview_t *view)
+{
+   mobj_t *mo = player->mo;
+
+   P_UnsetThingPosition(mo);
+   mo->x = mo->prevx = view->x;
+   mo->y = mo->prevy = view->y;
+   P_SetThingPosition(mo);
+
+   mo->z     = mo->subsector->sector->floorheight;
+   mo->angle = view->angle;
+   player->viewz = player->prevviewz = view->z;
+}
+
+//
+// Pick the point to look from in a subsector, or return false if there is
+// no room to stand in it
+//
+static boolean M_ViewPoint(int num, benchview_t *view)
+{
+   const subsector_t *ss  = &subsectors[num];
+   const seg_t       *seg = &segs[ss->firstline];
+   const sector_t    *sec = ss->sector;
+   int64_t x = 0, y = 0;
+   int     i;
+
+   if(ss->numlines <= 0 || sec->ceilingheight - sec->floorheight <= 4*FRACUNIT)
+      return false;
+
+   // the average of a convex polygon's corners is inside it
+   for(i = 0; i < ss->numlines; i++, seg++)
+   {
+      x += seg->v1->x;
+      y += seg->v1->y;
+   }
+
+   view->x         = (fixed_t)(x / ss->numlines);
+   view->y         = (fixed_t)(y / ss->numlines);
+   view->z         = emin(sec->floorheight + VIEWHEIGHT, sec->ceilingheight - 4*FRACUNIT);
+   view->subsector = num;
+
+   return true;
+}
+
+//
+// Draw the view runs times and keep its median time and what it held
+//
+static void M_TimeView(benchview_t *view, int runs)
+{
+   double times[MAXRENDERRUNS];
+   int    r, i;
+
+   M_PlaceView(&players[0], view);
+
+   for(r = 0; r < runs; r++)
+   {
+      unsigned int start = hal_timer.getTimeUS();
+
+      R_InvalidateView(mainview); // CALICO: draw it every time
+      R_RenderPlayerView(mainview, &players[0]);
+      R_FinishRefresh();
+      times[r] = hal_timer.getTimeUS() - start;
+   }
+   qsort(times, runs, sizeof(times[0]), M_CompareTimes);
+
+   view->us      = (unsigned int)times[runs / 2];
+   view->walls   = mainview->wallpool.used;
+   view->sprites = mainview->spritepool.used;
+   view->planes  = 0;
+   for(i = 0; i < mainview->numstripes; i++)
+      view->planes += mainview->stripes[i].planepool.used;
+}
+
+//
+// Time every view of one map and write its results
+//
+static void M_RenderBenchMap(FILE *out, int map, int runs, int angles, int step, boolean first)
+{
+   benchview_t view, worst;
+   double      total = 0.0;
+   int         i, a, views = 0;
+   int         maxwalls = 0, maxplanes = 0, maxsprites = 0;
+
+   gamemap = map;
+   G_DoLoadLevel();
+   renderfrac = FRACUNIT;
+
+   worst.us = 0;
+   for(i = 0; i < numsubsectors; i += step)
+   {
+      if(!M_ViewPoint(i, &view))
+         continue;
+
+      for(a = 0; a < angles; a++)
+      {
+         view.angle = (angle_t)((0x100000000ull * a) / angles);
+         M_TimeView(&view, runs);
+
+         total     += view.us;
+         maxwalls   = emax(maxwalls,   view.walls);
+         maxplanes  = emax(maxplanes,  view.planes);
+         maxsprites = emax(maxsprites, view.sprites);
+         if(!views++ || view.us > worst.us)
+            worst = view;
+      }
+   }
+
+   fprintf(out, "%s\n    { \"map\": %d, \"views\": %d", first ? "" : ",", map, views);
+   if(views)
+   {
+      fprintf(out, ", \"mean_us\": %.1f, \"max_walls\": %d, \"max_planes\": %d, \"max_sprites\": %d,\n"
+              "      \"worst\": { \"us\": %u, \"subsector\": %d, \"x\": %d, \"y\": %d, \"z\": %d, \"angle\": %d,"
+              " \"walls\": %d, \"planes\": %d, \"sprites\": %d } }",
+              total / views, maxwalls, maxplanes, maxsprites,
+              worst.us, worst.subsector, worst.x >> FRACBITS, worst.y >> FRACBITS, worst.z >> FRACBITS,
+              (int)(((uint64_t)worst.angle * 360) >> 32), worst.walls, worst.planes, worst.sprites);
+   }
+   else
+      fprintf(out, " }");
+   fflush(out);
+}
+
+//
+// Run the render benchmark on each map, write the results, and exit
+//
+void M_RenderBench(void)
+{
+   FILE   *out = stdout;
+   int     p, map, runs = 3, angles = 4, step = 1, onlymap = 0;
+   boolean first = true;
+   char    name[9];
+
+   if(!hal_timer.getTimeUS)
+      I_Error("M_RenderBench: no microsecond timer");
+
+   if((p = M_GetArgParameters("-benchout", 1)) && !(out = fopen(myargv[p], "w")))
+      I_Error("M_RenderBench: can't write %s", myargv[p]);
+   if((p = M_GetArgParameters("-benchruns", 1)))
+      runs = emin(emax(atoi(myargv[p]), 1), MAXRENDERRUNS);
+   if((p = M_GetArgParameters("-benchangles", 1)))
+      angles = emax(atoi(myargv[p]), 1);
+   if((p = M_GetArgParameters("-benchstep", 1)))
+      step = emax(atoi(myargv[p]), 1);
+   if((p = M_GetArgParameters("-warp", 1)))
+      onlymap = emax(atoi(myargv[p]), 1);
+
+   G_InitNew(startskill, onlymap ? onlymap : 1, gt_single);
+
+   fprintf(out, "{\n  \"runs\": %d,\n  \"angles\": %d,\n  \"step\": %d,\n  \"maps\": [", runs, angles, step);
+
+   for(map = onlymap ? onlymap : 1; map < 100; map++)
+   {
+      sprintf(name, "MAP%02d", map);
+      if(W_CheckNumForName(name) == -1)
+      {
+         if(onlymap)
+            I_Error("M_RenderBench: no %s", name);
+         continue;
+      }
+
+      M_RenderBenchMap(out, map, runs, angles, step, first);
+      first = false;
+
+      if(onlymap)
+         break;
+   }
+
+   fprintf(out, "\n  ]\n}\n");
+   if(out != stdout)
+      fclose(out);
+   fflush(stdout);
+
+   hal_medialayer.exit();
+}
+
+// EOF
+
@@ -0,0 +1,16 @@
+/*
+  CALICO
+
+  Kernel microbenchmarks
+*/
+
+#ifndef M_BENCH_H__
+#define M_BENCH_H__
+
+void M_Bench(void);
+void M_RenderBench(void);
+
+#endif
+
+// EOF
+
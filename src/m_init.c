@@ -0,0 +1,144 @@
+/*
+  CALICO
+
+  Startup stages
+
+  Jag68k_main and D_DoomMain start the game up as tables of stages, each of
+  which names the stages it needs to have run before it. A stage runs as
+  soon as everything it needs has, in table order otherwise, and is timed.
+  M_InitReport sends how long each took, and startup as a whole, out as
+  debug messages, and writes the same to the file given by -startupreport,
+  so that startup time can be tracked from build to build.
+
+  Every stage still runs on the main thread, one after the other. Most touch
+  the zone, which isn't safe to use from two threads at once, and the video
+  stages need the GL context; the graph says which could be overlapped once
+  that changes.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "doomdef.h"
+#include "hal/hal_platform.h"
+#include "hal/hal_timer.h"
+#include "m_argv.h"
+#include "m_init.h"
+
+#define MAXINITSTAGES 32
+
+typedef struct initresult_s
+{
+   const char  *name;
+   unsigned int us;
+} initresult_t;
+
+static initresult_t results[MAXINITSTAGES];
+static int          numresults;
+static unsigned int initstart;
+
+static unsigned int M_InitTime(void)
+{
+   return hal_timer.getTimeUS ? hal_timer.getTimeUS() : hal_timer.getTimeMS() * 1000;
+}
+
+static boolean M_InitStageDone(const char *name)
+{
+   int i;
+
+   for(i = 0; i < numresults; i++)
+   {
+      if(!strcmp(results[i].name, name))
+         return true;
+   }
+
+   return false;
+}
+
+static boolean M_InitStageReady(const initstage_t *stage)
+{
+   int i;
+
+   for(i = 0; i < MAXINITDEPS && stage->after[i]; i++)
+   {
+      if(!M_InitStageDone(stage->after[i]))
+         return false;
+   }
+
+   return true;
+}
+
+//
+// Run every stage in an order which satisfies what each needs first
+//
+void M_RunInitStages(const initstage_t *stages, int count)
+{
+   int left = count;
+
+   if(!initstart)
+      initstart = M_InitTime();
+
+   while(left)
+   {
+      const initstage_t *stage = NULL;
+      unsigned int       start;
+      int                i;
+
+      for(i = 0; i < count && !stage; i++)
+      {
+         if(!M_InitStageDone(stages[i].name) && M_InitStageReady(&stages[i]))
+            stage = &stages[i];
+      }
+      if(!stage)
+         I_Error("M_RunInitStages: no stage can run next");
+      if(numresults == MAXINITSTAGES)
+         I_Error("M_RunInitStages: more than %i stages", MAXINITSTAGES);
+
+      hal_platform.debugMsg(stage->name);
+      hal_platform.debugMsg("\n");
+      start = M_InitTime();
+      stage->init();
+      results[numresults].name = stage->name;
+      results[numresults].us   = M_InitTime() - start;
+      ++numresults;
+      --left;
+   }
+}
+
+static void M_WriteInitReport(FILE *f, unsigned int total)
+{
+   int i;
+
+   for(i = 0; i < numresults; i++)
+      fprintf(f, "%-16s %8.2f ms\n", results[i].name, results[i].us / 1000.0);
+   fprintf(f, "%-16s %8.2f ms\n", "total", total / 1000.0);
+}
+
+//
+// Report the time taken by every stage run so far
+//
+void M_InitReport(void)
+{
+   unsigned int total = M_InitTime() - initstart;
+   char         buf[64];
+   int          i, p;
+   FILE        *f;
+
+   for(i = 0; i < numresults; i++)
+   {
+      snprintf(buf, sizeof(buf), "%s: %.2f ms\n", results[i].name, results[i].us / 1000.0);
+      hal_platform.debugMsg(buf);
+   }
+   snprintf(buf, sizeof(buf), "startup: %.2f ms\n", total / 1000.0);
+   hal_platform.debugMsg(buf);
+
+   if((p = M_GetArgParameters("-startupreport", 1)))
+   {
+      if(!(f = fopen(myargv[p], "w")))
+         I_Error("M_InitReport: can't write %s", myargv[p]);
+      M_WriteInitReport(f, total);
+      fclose(f);
+   }
+}
+
+// EOF
+
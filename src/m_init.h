@@ -0,0 +1,25 @@
+/*
+  CALICO
+
+  Startup stages
+*/
+
+#ifndef M_INIT_H__
+#define M_INIT_H__
+
+#define MAXINITDEPS 4
+
+typedef struct initstage_s
+{
+   const char *name;
+   void      (*init)(void);
+   const char *after[MAXINITDEPS]; // stages which must have run first
+} initstage_t;
+
+void M_RunInitStages(const initstage_t *stages, int count);
+void M_InitReport(void);
+
+#endif
+
+// EOF
+
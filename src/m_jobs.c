@@ -0,0 +1,296 @@
+/*
+  CALICO
+
+  Job pool
+
+  Work which splits into independent pieces, like decoding every compressed
+  lump, drawing the stripes of a view, or checking a tic's sights, is handed
+  to M_RunJobs, which spreads the pieces over one set of worker threads
+  shared by the whole engine. -jobthreads starts them at startup, 0 for one
+  per logical CPU; the renderer and playsim options which split their work,
+  such as -rthreads, add to the same set as they need rather than starting
+  threads of their own, so there are never more workers than the largest of
+  them asks for. Without any of those everything runs on the calling thread
+  in order, just as it did before.
+
+  Batches may be run from any thread, and several at once: the main thread
+  may be checking sights while a render thread draws stripes. Each batch is
+  cut into pieces, which idle workers take from the oldest batch still open
+  as they finish their last. The calling thread always runs the first piece
+  of its own batch itself, then takes what is left of it alongside the
+  workers; it never runs pieces of other batches, so nothing else it is
+  waiting on is held up behind them. M_RunJobs returns once every piece of
+  its batch is done.
+
+  Pieces may run in any order, so a job must write its results to a place
+  of its own, to be gathered up in index order by the caller afterwards. A
+  job must not touch the zone, the graphics or sound resource hives, or the
+  GL. Each piece is recorded under the batch's name with -trace.
+*/
+
+#include <stdlib.h>
+#include "doomdef.h"
+#include "hal/hal_thread.h"
+#include "m_argv.h"
+#include "m_jobs.h"
+#include "m_thread.h"
+#include "m_trace.h"
+
+#define MAXJOBTHREADS 16
+
+// pieces each thread gets of a batch with enough indices, so that workers
+// which finish early can take part of another's share
+#define JOBPIECES 4
+
+typedef struct jobbatch_s
+{
+   const char         *name;
+   jobfunc_t           func;
+   void               *data;
+   int                 count;
+   int                 piece;   // indices taken at a time
+   int                 next;    // first index not yet taken
+   int                 left;    // indices not yet finished
+   hal_semhandle_t     done;    // posted when left reaches 0, if set
+   struct jobbatch_s  *link;    // next open batch
+} jobbatch_t;
+
+static hal_threadhandle_t jobthreads[MAXJOBTHREADS];
+static int                numjobthreads = 1; // including the calling thread
+
+static hal_semhandle_t    joblock;  // guards everything below
+static hal_semhandle_t    jobwake;  // posted once for each piece put up
+static jobbatch_t        *openhead; // batches with pieces not yet taken
+static jobbatch_t        *opentail;
+
+// posted for the batch this thread is waiting on
+static THREADLOCAL hal_semhandle_t jobdone;
+
+//
+// Run one piece of a batch
+//
+static void M_RunPiece(jobbatch_t *batch, int first, int count)
+{
+   unsigned int start = M_TraceBegin();
+   int i;
+
+   for(i = first; i < first + count; i++)
+      batch->func(batch->data, i);
+
+   M_TraceEnd(batch->name, start);
+}
+
+//
+// Take the next piece of a batch, closing it when that is the last.
+// Returns the number of indices taken. The lock must be held.
+//
+static int M_TakePiece(jobbatch_t *batch, int *first)
+{
+   int count = emin(batch->piece, batch->count - batch->next);
+
+   *first = batch->next;
+   batch->next += count;
+
+   if(count && batch->next == batch->count)
+   {
+      // unlink it; it is always found from the head, or its own caller
+      jobbatch_t **link = &openhead, *prev = NULL;
+
+      while(*link != batch)
+      {
+         prev = *link;
+         link = &(*link)->link;
+      }
+      *link = batch->link;
+      if(opentail == batch)
+         opentail = prev;
+   }
+
+   return count;
+}
+
+//
+// Mark a piece of a batch finished. The batch must not be touched again
+// afterwards, unless the caller is the one waiting on it. The lock must be
+// held.
+//
+static void M_FinishPiece(jobbatch_t *batch, int count)
+{
+   if(!(batch->left -= count) && batch->done)
+      hal_threads.semPost(batch->done);
+}
+
+//
+// Worker thread main loop
+//
+static int M_JobWorker(void *data)
+{
+   M_ScheduleThread(THREAD_WORKER);
+
+   while(1)
+   {
+      jobbatch_t *batch;
+      int first, count;
+
+      hal_threads.semWait(jobwake);
+
+      // keep going for as long as anything is open
+      hal_threads.semWait(joblock);
+      while(openhead)
+      {
+         batch = openhead;
+         count = M_TakePiece(batch, &first);
+         hal_threads.semPost(joblock);
+
+         M_RunPiece(batch, first, count);
+
+         hal_threads.semWait(joblock);
+         M_FinishPiece(batch, count);
+      }
+      hal_threads.semPost(joblock);
+   }
+
+   return 0;
+}
+
+//
+// Add one worker to the pool. The lock must be held, or not yet exist.
+//
+static boolean M_AddJobThread(void)
+{
+   if(!joblock)
+   {
+      joblock = hal_threads.createSemaphore(1);
+      jobwake = hal_threads.createSemaphore(0);
+      if(!joblock || !jobwake)
+      {
+         hal_threads.destroySemaphore(joblock);
+         hal_threads.destroySemaphore(jobwake);
+         joblock = jobwake = NULL;
+         return false;
+      }
+   }
+
+   if(!(jobthreads[numjobthreads] = hal_threads.createThread(M_JobWorker, "M_JobWorker", NULL)))
+      return false;
+
+   ++numjobthreads;
+   return true;
+}
+
+//
+// Make sure the pool can run count pieces at once, counting the calling
+// thread, as far as the platform allows. Returns how many it can run, which
+// may be more if something else asked for more. Called from the main thread
+// as each subsystem starts.
+//
+int M_ReserveJobThreads(int count)
+{
+   hal_semhandle_t lock = joblock;
+
+   if(count > MAXJOBTHREADS)
+      count = MAXJOBTHREADS;
+
+   if(count <= numjobthreads || !hal_threads.createThread)
+      return numjobthreads;
+
+   // nothing can be running on the pool before its first worker
+   if(lock)
+      hal_threads.semWait(lock);
+
+   while(numjobthreads < count && M_AddJobThread())
+      ;
+
+   if(lock)
+      hal_threads.semPost(lock);
+
+   return numjobthreads;
+}
+
+//
+// Start the job threads if -jobthreads was given
+//
+void M_InitJobs(void)
+{
+   int p, count;
+
+   if(!(p = M_GetArgParameters("-jobthreads", 1)))
+      return;
+
+   count = atoi(myargv[p]);
+   if(count <= 0)
+      count = hal_threads.getCPUCount ? hal_threads.getCPUCount() : 1;
+
+   D_printf("M_InitJobs: %i\n", M_ReserveJobThreads(count));
+}
+
+//
+// Call func for every index from 0 to count - 1 and wait until all are done
+//
+void M_RunJobs(const char *name, jobfunc_t func, void *data, int count)
+{
+   jobbatch_t batch;
+   int        first, taken, pieces, i;
+
+   if(count <= 0)
+      return;
+
+   batch.name  = name;
+   batch.func  = func;
+   batch.data  = data;
+   batch.count = count;
+   batch.piece = emax(1, count / (numjobthreads * JOBPIECES));
+
+   pieces = (count + batch.piece - 1) / batch.piece;
+   if(numjobthreads == 1 || pieces == 1)
+   {
+      M_RunPiece(&batch, 0, count);
+      return;
+   }
+
+   if(!jobdone && !(jobdone = hal_threads.createSemaphore(0)))
+      I_Error("M_RunJobs: can't wait for %s", name);
+
+   // the first piece is kept back for this thread
+   batch.next = taken = batch.piece;
+   batch.left = count;
+   batch.done = NULL;
+   batch.link = NULL;
+
+   hal_threads.semWait(joblock);
+   if(opentail)
+      opentail->link = &batch;
+   else
+      openhead = &batch;
+   opentail = &batch;
+   hal_threads.semPost(joblock);
+
+   // don't wake threads which would have nothing to do
+   for(i = 1; i < emin(numjobthreads, pieces); i++)
+      hal_threads.semPost(jobwake);
+
+   first = 0;
+   while(1)
+   {
+      M_RunPiece(&batch, first, taken);
+
+      hal_threads.semWait(joblock);
+      M_FinishPiece(&batch, taken);
+      if(!(taken = (batch.next < count) ? M_TakePiece(&batch, &first) : 0))
+         break;
+      hal_threads.semPost(joblock);
+   }
+
+   // wait for whatever the workers still have
+   if(batch.left)
+   {
+      batch.done = jobdone;
+      hal_threads.semPost(joblock);
+      hal_threads.semWait(jobdone);
+   }
+   else
+      hal_threads.semPost(joblock);
+}
+
+// EOF
+
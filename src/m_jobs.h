@@ -0,0 +1,27 @@
+/*
+  CALICO
+
+  Job pool
+*/
+
+#ifndef M_JOBS_H__
+#define M_JOBS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// called once for each index, possibly from several threads at once
+typedef void (*jobfunc_t)(void *data, int index);
+
+void M_InitJobs(void);
+int  M_ReserveJobThreads(int count);
+void M_RunJobs(const char *name, jobfunc_t func, void *data, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+// EOF
@@ -40,6 +40,19 @@ playmode_t currentplaymode;
 menu_t     cursorpos;
 skill_t    playerskill;
 
+// CALICO: what the menu was last drawn showing, and doublebuffergen then
+typedef struct menustate_s
+{
+   int        framegen;
+   int        cursorframe;
+   menu_t     cursorpos;
+   playmode_t playmode;
+   int        map;
+   skill_t    skill;
+} menustate_t;
+
+static menustate_t drawnmenu;
+
 void M_Start(void)
 {
    int i,l;
@@ -201,6 +214,22 @@ void M_Drawer(void)
    int leveltens, levelones;
    int m_doomheight = BIGSHORT(m_doom->height); // CALICO: needs endianness correction
 
+   // CALICO: the framebuffer still holds the menu if none of it has changed
+   if(drawnmenu.framegen == doublebuffergen && drawnmenu.cursorframe == cursorframe &&
+      drawnmenu.cursorpos == cursorpos && drawnmenu.playmode == currentplaymode &&
+      drawnmenu.map == playermap && drawnmenu.skill == playerskill)
+   {
+      UpdateBuffer();
+      return;
+   }
+
+   drawnmenu.framegen    = doublebuffergen;
+   drawnmenu.cursorframe = cursorframe;
+   drawnmenu.cursorpos   = cursorpos;
+   drawnmenu.playmode    = currentplaymode;
+   drawnmenu.map         = playermap;
+   drawnmenu.skill       = playerskill;
+
    // Draw main menu 
    DrawJagobj(m_doom, 100, 2, NULL);
 
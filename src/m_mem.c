@@ -0,0 +1,192 @@
+/*
+  CALICO
+
+  Memory footprint report
+
+  With -memreport, the memory held by each of the larger users is measured
+  after every frame, and on exit the current and peak size of each is
+  printed with the resident size of the whole process. The lumps cached in
+  the zone are part of the zone's figure, and are given separately only to
+  show how much of it they are. After the table comes a list of data held
+  twice over: graphics kept both as a cached lump in the zone and as the
+  GL renderer's copy of the texture, and compressed lumps cached in the
+  zone while the decoded lump cache file holds them as well.
+*/
+
+#include <stdio.h>
+#include "doomdef.h"
+#include "elib/atexit.h"
+#include "gl/gl_render.h"
+#include "hal/hal_platform.h"
+#include "jagcry.h"
+#include "m_argv.h"
+#include "m_mem.h"
+#include "r_local.h"
+#include "s_soundfmt.h"
+#include "w_iwad.h"
+
+typedef enum
+{
+   MEM_IWAD,
+   MEM_ZONE,
+   MEM_LUMPCACHE,
+   MEM_DECODED,
+   MEM_RCACHE,
+   MEM_TEMPBUFFER,
+   MEM_CRYTABLE,
+   MEM_SOUNDS,
+   MEM_TEXTURES,
+   NUMMEMUSERS
+} memuser_t;
+
+static const char *const usernames[NUMMEMUSERS] =
+{
+   "IWAD image",
+   "zone in use",
+   "  lumps cached",
+   "decoded lumps",
+   "graphics cache",
+   "temp buffer",
+   "CRY to RGB table",
+   "float sound samples",
+   "GL texture copies"
+};
+
+static boolean memreport;
+static size_t  current[NUMMEMUSERS];
+static size_t  peak[NUMMEMUSERS];
+
+static size_t texturebytes;
+
+static void M_AddTextureStore(const char *name, unsigned int bytes)
+{
+   texturebytes += bytes;
+}
+
+//
+// Measure everything now
+//
+static void M_MeasureMemory(size_t sizes[NUMMEMUSERS])
+{
+   int i;
+
+   sizes[MEM_IWAD]       = (size_t)W_IWADLength();
+   sizes[MEM_ZONE]       = (size_t)(Z_TotalMemory(mainzone) - Z_FreeMemory(mainzone));
+   sizes[MEM_DECODED]    = (size_t)W_DecodedCacheSize();
+   sizes[MEM_RCACHE]     = (size_t)rcachestats.bytes;
+   sizes[MEM_TEMPBUFFER] = (size_t)I_TempBufferSize();
+   sizes[MEM_CRYTABLE]   = sizeof(CRYToRGB);
+   sizes[MEM_SOUNDS]     = SfxSample_GetCacheBytes();
+
+   sizes[MEM_LUMPCACHE] = 0;
+   for(i = 0; i < numlumps; i++)
+   {
+      if(lumpcache[i])
+         sizes[MEM_LUMPCACHE] += W_LumpLength(i);
+   }
+
+   texturebytes = 0;
+   GL_ForEachTextureStore(M_AddTextureStore);
+   sizes[MEM_TEXTURES] = texturebytes;
+}
+
+//
+// Keep the largest size seen of each
+//
+void M_MemFrame(void)
+{
+   int i;
+
+   if(!memreport)
+      return;
+
+   M_MeasureMemory(current);
+   for(i = 0; i < NUMMEMUSERS; i++)
+   {
+      if(current[i] > peak[i])
+         peak[i] = current[i];
+   }
+}
+
+static unsigned int duplicates;
+static size_t       duplicatebytes;
+
+static void M_DuplicateTexture(const char *name, unsigned int bytes)
+{
+   int lump = W_CheckNumForName(name);
+
+   if(lump < 0 || !lumpcache[lump])
+      return;
+
+   printf("  %-8s %7i bytes in the zone, %7u as a GL texture copy\n", name, W_LumpLength(lump), bytes);
+   ++duplicates;
+   duplicatebytes += W_LumpLength(lump);
+}
+
+//
+// List data held in two places at once
+//
+static void M_PrintDuplicates(void)
+{
+   int i;
+
+   duplicates     = 0;
+   duplicatebytes = 0;
+
+   printf("held twice:\n");
+   GL_ForEachTextureStore(M_DuplicateTexture);
+
+   for(i = 0; i < numlumps; i++)
+   {
+      if(lumpcache[i] && W_DecodedLump(i))
+      {
+         printf("  %-8.8s %7i bytes in the zone and the decoded lump cache\n", lumpinfo[i].name, W_LumpLength(i));
+         ++duplicates;
+         duplicatebytes += W_LumpLength(i);
+      }
+   }
+
+   if(duplicates)
+      printf("  %u in all, %.1f KB could be saved\n", duplicates, duplicatebytes / 1024.0);
+   else
+      printf("  nothing\n");
+}
+
+static void M_PrintMemReport(void)
+{
+   size_t resident = 0, residentpeak = 0;
+   int    i;
+
+   M_MemFrame();
+
+   printf("memory report:\n");
+   printf("  %-20s %10s %10s\n", "", "now KB", "peak KB");
+   for(i = 0; i < NUMMEMUSERS; i++)
+   {
+      printf("  %-20s %10.1f %10.1f%s\n", usernames[i], current[i] / 1024.0, peak[i] / 1024.0,
+             i == MEM_IWAD && W_IWADMapped() ? " (mapped)" : "");
+   }
+   printf("  %-20s %10.1f\n", "zone reserved", Z_TotalMemory(mainzone) / 1024.0);
+
+   if(hal_platform.getProcessMemory)
+      hal_platform.getProcessMemory(&resident, &residentpeak);
+   printf("  %-20s %10.1f %10.1f\n", "process RSS", resident / 1024.0, residentpeak / 1024.0);
+
+   M_PrintDuplicates();
+   fflush(stdout);
+}
+
+//
+// Start measuring if -memreport was given
+//
+void M_InitMemReport(void)
+{
+   if(!M_FindArgument("-memreport"))
+      return;
+
+   memreport = true;
+   E_AtExit(M_PrintMemReport, false);
+}
+
+// EOF
+
@@ -0,0 +1,16 @@
+/*
+  CALICO
+
+  Memory footprint report
+*/
+
+#ifndef M_MEM_H__
+#define M_MEM_H__
+
+void M_InitMemReport(void);
+void M_MemFrame(void);
+
+#endif
+
+// EOF
+
@@ -0,0 +1,273 @@
+/*
+  CALICO
+
+  Performance HUD
+
+  Drawn over the top of the debug screen, above the -heapmap, while enabled
+  by -perfhud or toggled by its key (kb_key_perfhud, F11 by default). It
+  shows a graph of the last HUDFRAMES frames, each column stacking the render
+  phases and the playsim tic under a tick for the time between frames, then
+  the average of each phase and playsim stage, the command lists against the
+  limits the cartridge had, zone use, the graphics cache, GL work, the
+  mixer's DSP load, and each allocator's allocations. Showing the HUD turns the profiler on, which it reads
+  everything from, so a slow machine can be looked into without attaching
+  anything to it.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "doomdef.h"
+#include "gl/gl_render.h"
+#include "hal/hal_timer.h"
+#include "rb/rb_common.h"
+#include "m_alloc.h"
+#include "m_argv.h"
+#include "m_perfhud.h"
+#include "m_prof.h"
+#include "r_local.h"
+
+#define HUDFRAMES  256 // one column of the graph each
+#define HUDGRAPHH  64
+#define HUDTEXTTOP (HUDGRAPHH + 4)
+#define HUDBOTTOM  160 // the -heapmap is drawn below here
+
+#define HUDBACK D_RGBA(0x00, 0x00, 0x00, 0xa0)
+#define HUDTEXT D_RGBA(0xe0, 0xe0, 0xe0, 0xff)
+#define HUDWARN D_RGBA(0xff, 0x50, 0x50, 0xff)
+
+typedef struct hudsegment_s
+{
+   profcounter_t counter;
+   const char   *label;
+   unsigned int  color;
+} hudsegment_t;
+
+// stacked from the bottom of the graph up
+static const hudsegment_t segments[] =
+{
+   { PROF_BSP,         "bsp", D_RGBA(0x40, 0x80, 0xff, 0xff) },
+   { PROF_WALLPREP,    "wal", D_RGBA(0x40, 0xc0, 0xc0, 0xff) },
+   { PROF_SPRITEPREP,  "spp", D_RGBA(0x40, 0xc0, 0x40, 0xff) },
+   { PROF_LATEPREP,    "lat", D_RGBA(0xa0, 0xe0, 0x40, 0xff) },
+   { PROF_CACHE,       "cac", D_RGBA(0xff, 0xff, 0x40, 0xff) },
+   { PROF_SEGCOMMANDS, "seg", D_RGBA(0xff, 0xa0, 0x00, 0xff) },
+   { PROF_DRAWPLANES,  "pln", D_RGBA(0xff, 0x60, 0x20, 0xff) },
+   { PROF_SPRITES,     "spr", D_RGBA(0xff, 0x40, 0xa0, 0xff) },
+   { PROF_UPDATE,      "upd", D_RGBA(0xc0, 0x40, 0xff, 0xff) },
+   { PROF_TIC,         "tic", D_RGBA(0xa0, 0xa0, 0xa0, 0xff) }
+};
+
+#define NUMSEGMENTS (int)(sizeof(segments) / sizeof(*segments))
+
+static const hudsegment_t stages[] =
+{
+   { PROF_PLAYERS,  "ply", HUDTEXT },
+   { PROF_THINKERS, "thk", HUDTEXT },
+   { PROF_SIGHTS,   "sgt", HUDTEXT },
+   { PROF_MOBJBASE, "mob", HUDTEXT },
+   { PROF_MOBJLATE, "mlt", HUDTEXT },
+   { PROF_SPECIALS, "spc", HUDTEXT }
+};
+
+#define NUMSTAGES (int)(sizeof(stages) / sizeof(*stages))
+
+int perfhud;
+
+static unsigned int frameus[HUDFRAMES];               // between frames
+static unsigned int segmentus[HUDFRAMES][NUMSEGMENTS];
+static unsigned int hudframe;                         // frames ever drawn
+static unsigned int lastframetime;
+static rcachestats_t lastcache;
+
+//
+// Turn the HUD on at startup if -perfhud was given
+//
+void M_InitPerfHUD(void)
+{
+   if(M_FindArgument("-perfhud"))
+      M_TogglePerfHUD();
+}
+
+void M_TogglePerfHUD(void)
+{
+   extern void *debugscreenrez;
+
+   if(!hal_timer.getTimeUS)
+      return;
+
+   perfhud = !perfhud;
+   if(perfhud)
+   {
+      M_ProfEnable();
+      M_EnableAllocCounts();
+      hudframe = lastframetime = 0;
+      lastcache = rcachestats;
+   }
+   else
+      GL_ClearTextureResource(debugscreenrez, RB_COLOR_CLEAR);
+}
+
+static void M_HUDFill(int x, int y, int w, int h, unsigned int color)
+{
+   extern uint32_t *debugscreen;
+   uint32_t *dest = debugscreen + (y << 8) + x;
+   int i;
+
+   for(; h > 0; h--, dest += 256)
+   {
+      for(i = 0; i < w; i++)
+         dest[i] = color;
+   }
+}
+
+//
+// Print up to four "<label> <ms>" entries on one line
+//
+static void M_HUDTimes(int y, const hudsegment_t *list, int count)
+{
+   char buf[16];
+   int  i;
+
+   for(i = 0; i < count; i++)
+   {
+      sprintf(buf, "%s%5.2f", list[i].label, M_ProfAverage(list[i].counter) / 1000.0);
+      I_DrawText8((i & 3) * 64, y + (i >> 2) * 8, buf, list[i].color);
+   }
+}
+
+//
+// Take this frame's samples and draw the graph over the last HUDFRAMES
+//
+static void M_HUDGraph(void)
+{
+   unsigned int now = hal_timer.getTimeUS();
+   unsigned int slot = hudframe & (HUDFRAMES - 1);
+   unsigned int maxus = 0, scale = 16; // microseconds per pixel
+   unsigned int n, i;
+   char buf[40];
+   int  j;
+
+   frameus[slot] = lastframetime ? now - lastframetime : 0;
+   lastframetime = now;
+   for(j = 0; j < NUMSEGMENTS; j++)
+      segmentus[slot][j] = M_ProfLast(segments[j].counter);
+   ++hudframe;
+
+   n = hudframe < HUDFRAMES ? hudframe : HUDFRAMES;
+   for(i = 0; i < n; i++)
+   {
+      unsigned int total = 0;
+
+      for(j = 0; j < NUMSEGMENTS; j++)
+         total += segmentus[i][j];
+      maxus = emax(maxus, emax(total, frameus[i]));
+   }
+   while(scale * HUDGRAPHH < maxus)
+      scale *= 2;
+
+   // oldest frame on the left
+   for(i = 0; i < n; i++)
+   {
+      unsigned int f = (hudframe - n + i) & (HUDFRAMES - 1);
+      int y = HUDGRAPHH;
+
+      for(j = 0; j < NUMSEGMENTS && y > 0; j++)
+      {
+         int h = emin((int)(segmentus[f][j] / scale), y);
+
+         y -= h;
+         M_HUDFill(i, y, 1, h, segments[j].color);
+      }
+
+      if(frameus[f])
+         M_HUDFill(i, HUDGRAPHH - emin((int)(frameus[f] / scale), HUDGRAPHH - 1) - 1, 1, 1, RB_COLOR_WHITE);
+   }
+
+   sprintf(buf, "%ims", scale * HUDGRAPHH / 1000);
+   I_DrawText8(256 - 8 * (int)strlen(buf), 0, buf, HUDTEXT);
+
+   sprintf(buf, "frame %6.2f ms %5.1f fps", frameus[slot] / 1000.0,
+           frameus[slot] ? 1000000.0 / frameus[slot] : 0.0);
+   I_DrawText8(0, HUDTEXTTOP, buf, HUDTEXT);
+
+   // stripes in use, where -drawbudget may have changed them
+   if(mainview->numstripes > 1)
+   {
+      sprintf(buf, "s%i/%i", mainview->activestripes, mainview->numstripes);
+      I_DrawText8(256 - 8 * (int)strlen(buf), HUDTEXTTOP, buf, HUDTEXT);
+   }
+}
+
+//
+// Counts of this frame's command lists, against the fixed limits the
+// cartridge had, over which the pools here have had to grow
+//
+static void M_HUDLimit(int x, int y, const char *label, int used, int limit)
+{
+   char buf[24];
+
+   sprintf(buf, "%s%4i/%i", label, used, limit);
+   I_DrawText8(x, y, buf, used > limit ? HUDWARN : HUDTEXT);
+}
+
+void M_DrawPerfHUD(void)
+{
+   extern void *debugscreenrez;
+   glframestats_t  gl;
+   memzone_t      *zone;
+   char            buf[40];
+   int             y, i, planes, zonesize;
+   int             hits, misses;
+
+   M_HUDFill(0, 0, 256, HUDBOTTOM, HUDBACK);
+   M_HUDGraph();
+
+   // render phases in their graph colors, then the playsim stages
+   y = HUDTEXTTOP + 10;
+   M_HUDTimes(y, segments, NUMSEGMENTS);
+   y += 24;
+   M_HUDTimes(y, stages, NUMSTAGES);
+   y += 18;
+
+   planes = 0;
+   for(i = 0; i < mainview->numstripes; i++)
+      planes += mainview->stripes[i].planepool.used;
+   M_HUDLimit(0,   y, "wal", mainview->wallpool.used,   MAXWALLCMDS);
+   M_HUDLimit(88,  y, "pln", planes,                    MAXVISPLANES);
+   M_HUDLimit(168, y, "spr", mainview->spritepool.used, MAXVISSPRITES);
+   y += 8;
+
+   zonesize = 0;
+   for(zone = mainzone; zone; zone = zone->next)
+      zonesize += zone->size;
+   hits   = rcachestats.hits - lastcache.hits;
+   misses = rcachestats.misses - lastcache.misses;
+   lastcache = rcachestats;
+   sprintf(buf, "zone %4i/%iK cache %ih %im", (zonesize - Z_FreeMemory(mainzone)) / 1024,
+           zonesize / 1024, hits, misses);
+   I_DrawText8(0, y, buf, HUDTEXT);
+   y += 8;
+
+   // the GL's figures are for the frame before this one
+   GL_GetFrameStats(&gl);
+   sprintf(buf, "gl %i draws %iK dsp %4.1f%%", gl.drawCalls, gl.uploadBytes / 1024,
+           M_ProfLast(PROF_DSPLOAD) / 10.0);
+   I_DrawText8(0, y, buf, HUDTEXT);
+   y += 8;
+
+   // the last frame's allocations by each allocator
+   I_DrawText8(0, y, "alloc", HUDTEXT);
+   for(i = 0; i < NUMALLOCATORS; i++)
+   {
+      allocstats_t as;
+
+      M_GetAllocFrame(i, &as);
+      sprintf(buf, "%c%i", M_AllocatorName(i)[0], as.allocs);
+      I_DrawText8(48 + i * 40, y, buf, as.allocs ? HUDWARN : HUDTEXT);
+   }
+
+   GL_TextureResourceSetRectUpdated(debugscreenrez, 0, 0, 256, HUDBOTTOM);
+}
+
+// EOF
+
@@ -0,0 +1,27 @@
+/*
+  CALICO
+
+  Performance HUD
+*/
+
+#ifndef M_PERFHUD_H__
+#define M_PERFHUD_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int perfhud;
+
+void M_InitPerfHUD(void);
+void M_TogglePerfHUD(void);
+void M_DrawPerfHUD(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+// EOF
+
@@ -0,0 +1,291 @@
+/*
+  CALICO
+
+  Render and playsim profiler
+
+  With -profile <file>, each render phase and playsim stage, along with
+  lump lookups, is timed against the HAL's microsecond clock, and the GL
+  work of every frame is counted. The last PROFWINDOW samples of every counter
+  are kept, and their min, average, max, and 99th percentile are written to
+  the file on exit and whenever the game is paused. A file name ending in
+  .json is written as JSON; anything else is CSV.
+
+  -timedemo turns profiling on as well, and prints the same statistics to
+  stdout when the demo is over. With -trace, every timed section is also
+  recorded on the timeline.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "doomdef.h"
+#include "elib/atexit.h"
+#include "hal/hal_timer.h"
+#include "m_argv.h"
+#include "m_prof.h"
+#include "m_trace.h"
+
+#define PROFWINDOW 1024 // must be a power of 2
+
+typedef struct profstats_s
+{
+   unsigned int samples[PROFWINDOW]; // microseconds
+   unsigned int count;               // samples ever taken
+} profstats_t;
+
+boolean profiling;
+
+static const char  *proffilename;
+static profstats_t  profstats[NUMPROFCOUNTERS];
+
+static const char *profnames[NUMPROFCOUNTERS] =
+{
+   "frame",
+   "bsp",
+   "wallprep",
+   "spriteprep",
+   "lateprep",
+   "cache",
+   "segcommands",
+   "drawplanes",
+   "sprites",
+   "update",
+   "tic",
+   "players",
+   "thinkers",
+   "sights",
+   "mobjbase",
+   "mobjlate",
+   "specials",
+   "lumplookup",
+   "glstates",
+   "glbinds",
+   "gldraws",
+   "gluploadkb",
+   "presentus",
+   "gpuuploadus",
+   "gpudrawus",
+   "gpupresentus",
+   "sfxstolen",
+   "sfxrejected",
+   "sfxmerged",
+   "audioperiodus",
+   "underruns",
+   "sfxlatencyus",
+   "dsppeak",
+   "dspload",
+   "voices",
+   "setup",
+   "loadblockmap",
+   "loadvertexes",
+   "loadsectors",
+   "loadsidedefs",
+   "loadlinedefs",
+   "loadsubsectors",
+   "loadnodes",
+   "loadsegs",
+   "grouplines",
+   "loadlevelcache",
+   "buildgraphs",
+   "loadthings"
+};
+
+static void M_ProfAtExit(void)
+{
+   M_ProfWrite();
+}
+
+//
+// Turn profiling on if -profile was given
+//
+void M_ProfInit(void)
+{
+   int p;
+
+   if(!(p = M_GetArgParameters("-profile", 1)) || !hal_timer.getTimeUS)
+      return;
+
+   proffilename = myargv[p];
+   profiling    = true;
+   E_AtExit(M_ProfAtExit, false);
+}
+
+//
+// Turn profiling on without a file to write to, for -timedemo
+//
+void M_ProfEnable(void)
+{
+   if(hal_timer.getTimeUS)
+      profiling = true;
+}
+
+//
+// Get the time a profiled section starts at
+//
+unsigned int M_ProfStart(void)
+{
+   return (profiling || tracing) ? hal_timer.getTimeUS() : 0;
+}
+
+//
+// Record the time taken by a profiled section
+//
+void M_ProfEnd(profcounter_t counter, unsigned int start)
+{
+   profstats_t *ps;
+
+   if(tracing)
+      M_TraceEnd(profnames[counter], start);
+   if(!profiling)
+      return;
+
+   ps = &profstats[counter];
+   ps->samples[ps->count & (PROFWINDOW - 1)] = hal_timer.getTimeUS() - start;
+   ++ps->count;
+}
+
+//
+// Record an amount which isn't a time, such as a count of GL calls
+//
+void M_ProfCount(profcounter_t counter, unsigned int value)
+{
+   profstats_t *ps;
+
+   if(!profiling)
+      return;
+
+   ps = &profstats[counter];
+   ps->samples[ps->count & (PROFWINDOW - 1)] = value;
+   ++ps->count;
+}
+
+static int M_CompareSamples(const void *a, const void *b)
+{
+   unsigned int sa = *(const unsigned int *)a, sb = *(const unsigned int *)b;
+
+   return (sa > sb) - (sa < sb);
+}
+
+//
+// Write the statistics of every counter to f
+//
+static void M_ProfWriteStats(FILE *f, boolean json)
+{
+   static unsigned int sorted[PROFWINDOW];
+   int i;
+
+   if(json)
+      fprintf(f, "{\n");
+   else
+      fprintf(f, "counter,samples,min_us,avg_us,max_us,p99_us\n");
+
+   for(i = 0; i < NUMPROFCOUNTERS; i++)
+   {
+      profstats_t *ps = &profstats[i];
+      unsigned int n  = ps->count < PROFWINDOW ? ps->count : PROFWINDOW;
+      unsigned int j, total = 0, min = 0, max = 0, p99 = 0;
+
+      if(n)
+      {
+         memcpy(sorted, ps->samples, n * sizeof(*sorted));
+         qsort(sorted, n, sizeof(*sorted), M_CompareSamples);
+         for(j = 0; j < n; j++)
+            total += sorted[j];
+         min = sorted[0];
+         max = sorted[n - 1];
+         p99 = sorted[(n * 99) / 100];
+      }
+
+      if(json)
+      {
+         fprintf(f, "  \"%s\": { \"samples\": %u, \"min_us\": %u, \"avg_us\": %u, "
+                    "\"max_us\": %u, \"p99_us\": %u }%s\n",
+                 profnames[i], ps->count, min, n ? total / n : 0, max, p99,
+                 i + 1 < NUMPROFCOUNTERS ? "," : "");
+      }
+      else
+      {
+         fprintf(f, "%s,%u,%u,%u,%u,%u\n", profnames[i], ps->count, min,
+                 n ? total / n : 0, max, p99);
+      }
+   }
+
+   if(json)
+      fprintf(f, "}\n");
+}
+
+//
+// Write out the statistics of every counter
+//
+void M_ProfWrite(void)
+{
+   FILE  *f;
+   size_t len;
+
+   if(!profiling || !proffilename || !(f = fopen(proffilename, "w")))
+      return;
+
+   len = strlen(proffilename);
+   M_ProfWriteStats(f, len >= 5 && !strcmp(proffilename + len - 5, ".json"));
+
+   fclose(f);
+}
+
+//
+// Forget every sample taken so far, so that one run can be measured apart
+// from those before it
+//
+void M_ProfReset(void)
+{
+   memset(profstats, 0, sizeof(profstats));
+}
+
+//
+// The average of the samples kept for a counter
+//
+unsigned int M_ProfAverage(profcounter_t counter)
+{
+   const profstats_t *ps = &profstats[counter];
+   unsigned int n = ps->count < PROFWINDOW ? ps->count : PROFWINDOW;
+   unsigned int j, total = 0;
+
+   for(j = 0; j < n; j++)
+      total += ps->samples[j];
+
+   return n ? total / n : 0;
+}
+
+//
+// The latest sample taken for a counter, or 0 if it has none
+//
+unsigned int M_ProfLast(profcounter_t counter)
+{
+   const profstats_t *ps = &profstats[counter];
+
+   return ps->count ? ps->samples[(ps->count - 1) & (PROFWINDOW - 1)] : 0;
+}
+
+//
+// How many samples have ever been taken for a counter, so that a caller can
+// tell whether the latest one is new
+//
+unsigned int M_ProfSamples(profcounter_t counter)
+{
+   return profstats[counter].count;
+}
+
+const char *M_ProfName(profcounter_t counter)
+{
+   return profnames[counter];
+}
+
+//
+// Print the statistics of every counter to stdout as CSV
+//
+void M_ProfPrint(void)
+{
+   if(profiling)
+      M_ProfWriteStats(stdout, false);
+}
+
+// EOF
@@ -0,0 +1,94 @@
+/*
+  CALICO
+
+  Render and playsim profiler
+*/
+
+#ifndef M_PROF_H__
+#define M_PROF_H__
+
+#include "keywords.h"
+
+typedef enum
+{
+   // render phases
+   PROF_FRAME,       // all of R_RenderPlayerView
+   PROF_BSP,         // phase 1
+   PROF_WALLPREP,    // phase 2
+   PROF_SPRITEPREP,  // phase 3
+   PROF_LATEPREP,    // phase 4
+   PROF_CACHE,       // phase 5
+   PROF_SEGCOMMANDS, // phase 6, stripe 0 only
+   PROF_DRAWPLANES,  // phase 7, stripe 0 only
+   PROF_SPRITES,     // phase 8, stripe 0 only
+   PROF_UPDATE,      // phase 9
+
+   // playsim stages
+   PROF_TIC,         // all of P_Ticker
+   PROF_PLAYERS,
+   PROF_THINKERS,
+   PROF_SIGHTS,
+   PROF_MOBJBASE,
+   PROF_MOBJLATE,
+   PROF_SPECIALS,    // specials, respawns, and the status bar
+
+   // other
+   PROF_LUMPLOOKUP,  // W_CheckNumForName
+
+   // GL work per frame, recorded as counts rather than times
+   PROF_GLSTATES,    // state changes
+   PROF_GLBINDS,     // texture binds
+   PROF_GLDRAWS,     // draw calls
+   PROF_GLUPLOADKB,  // texture uploads in kilobytes
+   PROF_PRESENT,     // microseconds since the previous present
+   PROF_GPUUPLOAD,   // GPU microseconds in texture uploads
+   PROF_GPUDRAW,     // GPU microseconds drawing
+   PROF_GPUPRESENT,  // GPU microseconds presenting
+   // sound voice allocation per tic, also counts
+   PROF_SFXSTOLEN,   // voices stolen from other sounds
+   PROF_SFXREJECTED, // sounds too quiet or too unimportant to play
+   PROF_SFXMERGED,   // starts merged into one from the same sector
+   PROF_AUDIOPERIOD, // longest mixer callback interval in microseconds
+   PROF_UNDERRUNS,   // late mixer callbacks
+   PROF_SFXLATENCY,  // microseconds from S_StartSound to output
+   PROF_DSPPEAK,     // most of an audio period spent mixing, in 0.1% units
+   PROF_DSPLOAD,     // average of the same
+   PROF_VOICES,      // most voices mixed at once
+
+   // level setup stages, one sample per level loaded
+   PROF_SETUP,       // all of P_SetupLevel
+   PROF_LOADBLOCKMAP,
+   PROF_LOADVERTEXES,
+   PROF_LOADSECTORS,
+   PROF_LOADSIDEDEFS,
+   PROF_LOADLINEDEFS,
+   PROF_LOADSUBSECTORS,
+   PROF_LOADNODES,
+   PROF_LOADSEGS,
+   PROF_GROUPLINES,
+   PROF_LOADLEVELCACHE, // reading -levelcache, whether or not it was used
+   PROF_BUILDGRAPHS, // block lines, sound graph and sector neighbours
+   PROF_LOADTHINGS,
+
+   NUMPROFCOUNTERS
+} profcounter_t;
+
+extern boolean profiling;
+
+void         M_ProfInit(void);
+void         M_ProfEnable(void);
+unsigned int M_ProfStart(void);
+void         M_ProfEnd(profcounter_t counter, unsigned int start);
+void         M_ProfCount(profcounter_t counter, unsigned int value);
+void         M_ProfWrite(void);
+void         M_ProfPrint(void);
+void         M_ProfReset(void);
+unsigned int M_ProfAverage(profcounter_t counter);
+unsigned int M_ProfLast(profcounter_t counter);
+unsigned int M_ProfSamples(profcounter_t counter);
+const char  *M_ProfName(profcounter_t counter);
+
+#endif
+
+// EOF
+
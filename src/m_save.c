@@ -0,0 +1,237 @@
+/*
+  CALICO
+
+  Background saves
+
+  Files the game keeps up to date, like the emulated EEPROM and the config
+  file, are handed to M_SaveFile as a complete image of their contents. The
+  image is copied and written by a saving thread, so the caller never waits
+  on the disk. A file saved again before its last image was written only
+  has its newest image written, once. Each image goes to a temporary file
+  first, which then replaces the old file whole, so a crash partway through
+  leaves either the old contents or the new ones, never a mixture.
+
+  Without thread support in the HAL, files are written on the spot in the
+  same way. Anything still waiting is written on the way out.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "doomdef.h"
+#include "hal/hal_platform.h"
+#include "hal/hal_thread.h"
+#include "elib/atexit.h"
+#include "m_save.h"
+#include "m_thread.h"
+
+#define MAXSAVES    4
+#define MAXSAVENAME 1024
+
+typedef struct savefile_s
+{
+   char    name[MAXSAVENAME];
+   byte   *data;    // newest image not yet taken by the thread, if any
+   size_t  len;
+} savefile_t;
+
+static savefile_t      savefiles[MAXSAVES];
+static boolean         savebusy;  // the thread is writing an image
+static hal_semhandle_t savelock;
+static hal_semhandle_t savework;  // posted for each image queued
+static hal_semhandle_t savedone;  // posted for each image written
+static hal_threadhandle_t savethread;
+
+//
+// Write an image to a temporary file and put it in place of the old one
+//
+static void M_WriteSave(const char *name, const byte *data, size_t len)
+{
+   char  tmpname[MAXSAVENAME + 4];
+   FILE *f;
+   boolean ok;
+
+   snprintf(tmpname, sizeof(tmpname), "%s.tmp", name);
+
+   if(!(f = fopen(tmpname, "wb")))
+   {
+      hal_platform.debugMsg("M_WriteSave: could not open %s\n", tmpname);
+      return;
+   }
+
+   ok = (fwrite(data, 1, len, f) == len);
+   ok = (fclose(f) == 0) && ok;
+   if(!ok)
+   {
+      hal_platform.debugMsg("M_WriteSave: could not write %s\n", tmpname);
+      remove(tmpname);
+      return;
+   }
+
+   if(hal_platform.replaceFile)
+      ok = hal_platform.replaceFile(tmpname, name);
+   else
+   {
+      remove(name);
+      ok = !rename(tmpname, name);
+   }
+
+   if(!ok)
+      hal_platform.debugMsg("M_WriteSave: could not replace %s\n", name);
+}
+
+//
+// Saving thread main loop
+//
+static int M_SaveThread(void *data)
+{
+   M_ScheduleThread(THREAD_IO);
+
+   while(1)
+   {
+      savefile_t *sf = NULL;
+      byte       *image = NULL;
+      size_t      len = 0;
+      int         i;
+
+      hal_threads.semWait(savework);
+
+      hal_threads.semWait(savelock);
+      for(i = 0; i < MAXSAVES; i++)
+      {
+         if(savefiles[i].data)
+         {
+            sf    = &savefiles[i];
+            image = sf->data;
+            len   = sf->len;
+            sf->data = NULL;
+            savebusy = true;
+            break;
+         }
+      }
+      hal_threads.semPost(savelock);
+
+      // images saved over an unwritten one leave extra posts behind
+      if(!sf)
+         continue;
+
+      M_WriteSave(sf->name, image, len);
+      free(image);
+
+      hal_threads.semWait(savelock);
+      savebusy = false;
+      hal_threads.semPost(savelock);
+      hal_threads.semPost(savedone);
+   }
+
+   return 0;
+}
+
+//
+// Start the saving thread, and make sure everything saved gets written
+// before the program exits
+//
+void M_InitSaves(void)
+{
+   E_AtExit(M_FlushSaves, true);
+
+   if(!hal_threads.createThread)
+      return;
+
+   savelock = hal_threads.createSemaphore(1);
+   savework = hal_threads.createSemaphore(0);
+   savedone = hal_threads.createSemaphore(0);
+
+   if(savelock && savework && savedone &&
+      (savethread = hal_threads.createThread(M_SaveThread, "M_SaveThread", NULL)))
+      return;
+
+   hal_threads.destroySemaphore(savelock);
+   hal_threads.destroySemaphore(savework);
+   hal_threads.destroySemaphore(savedone);
+   savelock = savework = savedone = NULL;
+}
+
+//
+// Save len bytes of data as the new contents of a file. The data is copied,
+// so it may be changed as soon as this returns.
+//
+void M_SaveFile(const char *filename, const void *data, size_t len)
+{
+   savefile_t *sf = NULL;
+   byte       *image, *old;
+   int         i;
+
+   if(!savethread)
+   {
+      M_WriteSave(filename, data, len);
+      return;
+   }
+
+   if(strlen(filename) >= MAXSAVENAME)
+      I_Error("M_SaveFile: file name too long");
+   if(!(image = malloc(len ? len : 1)))
+      I_Error("M_SaveFile: no memory for %u bytes", (unsigned int)len);
+   memcpy(image, data, len);
+
+   hal_threads.semWait(savelock);
+   for(i = 0; i < MAXSAVES && savefiles[i].name[0]; i++)
+   {
+      if(!strcmp(savefiles[i].name, filename))
+      {
+         sf = &savefiles[i];
+         break;
+      }
+   }
+   if(!sf)
+   {
+      if(i == MAXSAVES)
+      {
+         hal_threads.semPost(savelock);
+         I_Error("M_SaveFile: too many files");
+      }
+      sf = &savefiles[i];
+      strcpy(sf->name, filename);
+   }
+
+   // an image not written yet is replaced by this one
+   old      = sf->data;
+   sf->data = image;
+   sf->len  = len;
+   hal_threads.semPost(savelock);
+
+   if(old)
+      free(old);
+   hal_threads.semPost(savework);
+}
+
+//
+// Wait until every file saved so far has been written
+//
+void M_FlushSaves(void)
+{
+   if(!savethread)
+      return;
+
+   while(1)
+   {
+      boolean idle;
+      int     i;
+
+      hal_threads.semWait(savelock);
+      idle = !savebusy;
+      for(i = 0; i < MAXSAVES && idle; i++)
+      {
+         if(savefiles[i].data)
+            idle = false;
+      }
+      hal_threads.semPost(savelock);
+
+      if(idle)
+         break;
+      hal_threads.semWait(savedone);
+   }
+}
+
+// EOF
+
@@ -0,0 +1,27 @@
+/*
+  CALICO
+
+  Background saves
+*/
+
+#ifndef M_SAVE_H__
+#define M_SAVE_H__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void M_InitSaves(void);
+void M_SaveFile(const char *filename, const void *data, size_t len);
+void M_FlushSaves(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+// EOF
+
@@ -0,0 +1,233 @@
+/*
+  CALICO
+
+  Session performance report
+
+  Every session keeps a histogram of how long the game took to run each tic
+  and to produce each frame, from reading the controls to handing the frame
+  over, leaving out the time spent waiting for the next tic. A frame which
+  takes longer than one of the hitch thresholds is counted against each one
+  it passes, and put down to whichever render phase, the playsim, or the
+  rest of the loop took the most time in it. On exit the lot is written as
+  one line of JSON to session.json in the directory calico.cfg is written
+  to, along with what the machine is, for reports from many machines to be
+  gathered up and compared. -nosession turns it off.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "doomdef.h"
+#include "elib/atexit.h"
+#include "gl/gl_render.h"
+#include "hal/hal_platform.h"
+#include "hal/hal_thread.h"
+#include "hal/hal_timer.h"
+#include "m_argv.h"
+#include "m_prof.h"
+#include "m_session.h"
+
+// upper bounds of the histogram bins in milliseconds; the last bin is open
+static const int binms[] = { 1, 2, 4, 8, 12, 16, 20, 25, 33, 50, 66, 100, 150, 250, 500 };
+
+#define NUMBINS (int)(sizeof(binms) / sizeof(*binms) + 1)
+
+static const int hitchms[] = { 33, 66, 100 };
+
+#define NUMHITCHES (int)(sizeof(hitchms) / sizeof(*hitchms))
+
+// what a hitch can be put down to; the last is everything else in the loop
+static const profcounter_t phases[] =
+{
+   PROF_BSP, PROF_WALLPREP, PROF_SPRITEPREP, PROF_LATEPREP, PROF_CACHE,
+   PROF_SEGCOMMANDS, PROF_DRAWPLANES, PROF_SPRITES, PROF_UPDATE, PROF_TIC
+};
+
+#define NUMPHASES (int)(sizeof(phases) / sizeof(*phases))
+
+static boolean      sessionon;
+static unsigned int sessionstart;
+static unsigned int frames, tics;
+static unsigned int framebins[NUMBINS], ticbins[NUMBINS];
+static unsigned int worstframe;                         // microseconds
+static unsigned int hitches[NUMHITCHES];
+static unsigned int hitchphases[NUMHITCHES][NUMPHASES + 1];
+static unsigned int lastsamples[NUMPHASES];             // profiler counts seen
+
+static int M_SessionBin(unsigned int us)
+{
+   int i;
+
+   for(i = 0; i < NUMBINS - 1; i++)
+   {
+      if(us < (unsigned int)binms[i] * 1000)
+         break;
+   }
+
+   return i;
+}
+
+//
+// Which phase took the most of a frame, only counting phases which were
+// timed during it
+//
+static int M_SessionBlame(unsigned int frameus)
+{
+   unsigned int most = 0, rest = frameus;
+   int i, blame = NUMPHASES;
+
+   for(i = 0; i < NUMPHASES; i++)
+   {
+      unsigned int samples = M_ProfSamples(phases[i]);
+      unsigned int us;
+
+      if(samples == lastsamples[i])
+         continue;
+      lastsamples[i] = samples;
+
+      us   = M_ProfLast(phases[i]);
+      rest = rest > us ? rest - us : 0;
+      if(us > most)
+      {
+         most  = us;
+         blame = i;
+      }
+   }
+
+   return rest > most ? NUMPHASES : blame;
+}
+
+static void M_WriteJSONString(FILE *f, const char *s)
+{
+   fputc('"', f);
+   for(; *s; s++)
+   {
+      if(*s == '"' || *s == '\\')
+         fputc('\\', f);
+      if((unsigned char)*s >= ' ')
+         fputc(*s, f);
+   }
+   fputc('"', f);
+}
+
+static void M_WriteBins(FILE *f, const char *name, const unsigned int *bins)
+{
+   int i;
+
+   fprintf(f, ",\"%s\":[", name);
+   for(i = 0; i < NUMBINS; i++)
+      fprintf(f, "%s%u", i ? "," : "", bins[i]);
+   fprintf(f, "]");
+}
+
+static void M_SessionAtExit(void)
+{
+   char  name[1024];
+   FILE *f;
+   int   i, j;
+
+   if(!frames)
+      return;
+
+   snprintf(name, sizeof(name), "%s/session.json", hal_platform.getWriteDirectory());
+   if(!(f = fopen(name, "w")))
+      return;
+
+   fprintf(f, "{\"version\":1,\"seconds\":%u,\"renderer\":",
+           (hal_timer.getTimeUS() - sessionstart) / 1000000);
+   M_WriteJSONString(f, GL_GetRendererName());
+   fprintf(f, ",\"cpus\":%i,\"renderscale\":%i,\"frames\":%u,\"tics\":%u,\"worstframems\":%.1f",
+           hal_threads.getCPUCount ? hal_threads.getCPUCount() : 1, 1 << rendershift,
+           frames, tics, worstframe / 1000.0);
+
+   fprintf(f, ",\"binms\":[");
+   for(i = 0; i < NUMBINS - 1; i++)
+      fprintf(f, "%s%i", i ? "," : "", binms[i]);
+   fprintf(f, "]");
+   M_WriteBins(f, "frame", framebins);
+   M_WriteBins(f, "tic", ticbins);
+
+   fprintf(f, ",\"hitches\":[");
+   for(i = 0; i < NUMHITCHES; i++)
+   {
+      fprintf(f, "%s{\"ms\":%i,\"count\":%u", i ? "," : "", hitchms[i], hitches[i]);
+      for(j = 0; j <= NUMPHASES; j++)
+      {
+         if(hitchphases[i][j])
+            fprintf(f, ",\"%s\":%u", j < NUMPHASES ? M_ProfName(phases[j]) : "other", hitchphases[i][j]);
+      }
+      fprintf(f, "}");
+   }
+   fprintf(f, "]}\n");
+
+   fclose(f);
+}
+
+//
+// Start keeping the report, which needs the profiler for its blame
+//
+void M_InitSession(void)
+{
+   if(M_FindArgument("-nosession") || !hal_timer.getTimeUS || !hal_platform.getWriteDirectory)
+      return;
+
+   M_ProfEnable();
+   sessionon    = true;
+   sessionstart = hal_timer.getTimeUS();
+   E_AtExit(M_SessionAtExit, false);
+}
+
+//
+// Get the time a tic or frame starts at, or 0 if there's no report
+//
+unsigned int M_SessionTime(void)
+{
+   return sessionon ? hal_timer.getTimeUS() : 0;
+}
+
+void M_SessionTic(unsigned int start)
+{
+   if(!sessionon)
+      return;
+
+   ++ticbins[M_SessionBin(hal_timer.getTimeUS() - start)];
+   ++tics;
+}
+
+//
+// Record a frame which started at start
+//
+void M_SessionFrame(unsigned int start)
+{
+   unsigned int us;
+   int i, blame;
+
+   if(!sessionon || !start)
+      return;
+
+   us = hal_timer.getTimeUS() - start;
+   ++framebins[M_SessionBin(us)];
+   ++frames;
+   worstframe = emax(worstframe, us);
+
+   blame = M_SessionBlame(us);
+   for(i = 0; i < NUMHITCHES && us >= (unsigned int)hitchms[i] * 1000; i++)
+   {
+      ++hitches[i];
+      ++hitchphases[i][blame];
+   }
+}
+
+//
+// Forget the phases timed since the last frame, so that the next frame
+// isn't blamed for work done in between, such as loading a level
+//
+void M_SessionBreak(void)
+{
+   int i;
+
+   for(i = 0; i < NUMPHASES; i++)
+      lastsamples[i] = M_ProfSamples(phases[i]);
+}
+
+// EOF
+
@@ -0,0 +1,19 @@
+/*
+  CALICO
+
+  Session performance report
+*/
+
+#ifndef M_SESSION_H__
+#define M_SESSION_H__
+
+void         M_InitSession(void);
+unsigned int M_SessionTime(void);
+void         M_SessionTic(unsigned int start);
+void         M_SessionFrame(unsigned int start);
+void         M_SessionBreak(void);
+
+#endif
+
+// EOF
+
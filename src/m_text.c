@@ -0,0 +1,209 @@
+/*
+  CALICO
+
+  Cached text strings
+
+  Text drawn with the Jaguar's graphic fonts used to go a glyph at a time
+  into the 320x224 framebuffer, so a screen of it cost a software loop per
+  glyph and an upload of the whole framebuffer whenever any of it changed.
+  A textcache_t instead holds a string laid out into its own texture, with
+  the glyphs' sizes read once when the string is laid out, and is drawn as
+  one quad each frame. Callers lay the string out again only when
+  M_TextChanged says its text or position differs from what was cached:
+
+     if(M_TextChanged(&tc, string, x, y))
+     {
+        for(each character)
+           M_AddTextGlyph(glyph, gx, gy);
+     }
+     M_DrawText(&tc);
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "doomdef.h"
+#include "gl/gl_render.h"
+#include "jagcry.h"
+#include "m_text.h"
+
+#define MAXTEXTGLYPHS MAXTEXTLEN
+
+typedef struct textglyph_s
+{
+   jagobj_t *jo;
+   int       x, y;
+   int       width, height;
+} textglyph_t;
+
+// glyphs of the string being laid out, given to the next M_DrawText
+static textglyph_t glyphs[MAXTEXTGLYPHS];
+static int         numglyphs;
+static boolean     layingout;
+
+//
+// Returns true if the string must be laid out again, in which case its
+// glyphs are to be given to M_AddTextGlyph before the next M_DrawText.
+// Strings too long to be kept are laid out every time.
+//
+boolean M_TextChanged(textcache_t *tc, const char *text, int x, int y)
+{
+   size_t len = strlen(text);
+
+   if(len < MAXTEXTLEN && tc->x == x && tc->y == y && !strcmp(tc->text, text))
+      return false;
+
+   if(len < MAXTEXTLEN)
+      memcpy(tc->text, text, len + 1);
+   else
+      tc->text[0] = '\0';
+   tc->x = x;
+   tc->y = y;
+
+   numglyphs = 0;
+   layingout = true;
+   return true;
+}
+
+//
+// Add a glyph at screen position x, y to the string being laid out
+//
+void M_AddTextGlyph(jagobj_t *jo, int x, int y)
+{
+   textglyph_t *g;
+
+   if(numglyphs == MAXTEXTGLYPHS)
+      return;
+
+   g = &glyphs[numglyphs++];
+   g->jo     = jo;
+   g->x      = x;
+   g->y      = y;
+   g->width  = BIGSHORT(jo->width);
+   g->height = BIGSHORT(jo->height);
+}
+
+//
+// Render the laid out glyphs into the cache's texture, which only grows, so
+// that a string changing length does not need a new one each time
+//
+static void M_RenderText(textcache_t *tc)
+{
+   static int serial;
+   int        x1 = 320, y1 = 200, x2 = 0, y2 = 0;
+   int        i, w, h;
+   uint32_t  *store;
+
+   // bounds of the glyphs, clipped to the screen as DrawJagobj does
+   for(i = 0; i < numglyphs; i++)
+   {
+      textglyph_t *g = &glyphs[i];
+
+      if(g->x < x1) x1 = g->x;
+      if(g->y < y1) y1 = g->y;
+      if(g->x + g->width  > x2) x2 = g->x + g->width;
+      if(g->y + g->height > y2) y2 = g->y + g->height;
+   }
+   if(x1 < 0)
+      x1 = 0;
+   if(y1 < 0)
+      y1 = 0;
+   if(x2 > 320)
+      x2 = 320;
+   if(y2 > 200)
+      y2 = 200;
+
+   tc->left = x1;
+   tc->top  = y1;
+   w = x2 - x1;
+   h = y2 - y1;
+
+   if(!(tc->visible = (w > 0 && h > 0)))
+      return;
+
+   if(!tc->rez || w > tc->width || h > tc->height)
+   {
+      char name[16];
+      int  neww = tc->rez && tc->width  > w ? tc->width  : w;
+      int  newh = tc->rez && tc->height > h ? tc->height : h;
+
+      sprintf(name, "text%i", serial++);
+      if(!(tc->rez = GL_NewTextureResource(name, NULL, neww, newh, RES_FRAMEBUFFER, 0)))
+      {
+         tc->visible = false;
+         return;
+      }
+      tc->width  = neww;
+      tc->height = newh;
+   }
+   else
+      GL_ClearTextureResource(tc->rez, 0);
+
+   GL_TextureResourceSetUpdated(tc->rez);
+   store = GL_GetTextureResourceStore(tc->rez);
+
+   for(i = 0; i < numglyphs; i++)
+   {
+      textglyph_t *g = &glyphs[i];
+      int          sx = 0, sy = 0;
+      int          gx = g->x - x1, gy = g->y - y1;
+      int          gw = g->width, gh = g->height;
+      byte        *source;
+      uint32_t    *dest;
+
+      if(gx < 0)
+      {
+         sx = -gx;
+         gw += gx;
+         gx = 0;
+      }
+      if(gy < 0)
+      {
+         sy = -gy;
+         gh += gy;
+         gy = 0;
+      }
+      if(gx + gw > w)
+         gw = w - gx;
+      if(gy + gh > h)
+         gh = h - gy;
+      if(gw < 1 || gh < 1)
+         continue;
+
+      source = g->jo->data + sy * g->width + sx;
+      dest   = store + gy * tc->width + gx;
+      for(; gh; gh--)
+      {
+         int x;
+
+         for(x = 0; x < gw; x++)
+         {
+            if(source[x])
+               dest[x] = CRYToRGB[palette8[source[x]]];
+         }
+         source += g->width;
+         dest   += tc->width;
+      }
+   }
+}
+
+//
+// Draw the string over the framebuffer, first rendering it if it was laid
+// out again
+//
+void M_DrawText(textcache_t *tc)
+{
+   if(layingout)
+   {
+      M_RenderText(tc);
+      layingout = false;
+   }
+
+   if(!tc->rez || !tc->visible)
+      return;
+
+   // the 320x200 game screen sits 8 lines into the 320x224 framebuffer
+   GL_AddLateDrawCommand(tc->rez, tc->left, tc->top + 8, tc->width, tc->height);
+}
+
+// EOF
+
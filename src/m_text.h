@@ -0,0 +1,29 @@
+/*
+  CALICO
+
+  Cached text strings
+*/
+
+#ifndef M_TEXT_H__
+#define M_TEXT_H__
+
+#define MAXTEXTLEN 512
+
+typedef struct textcache_s
+{
+   char  text[MAXTEXTLEN]; // string last laid out
+   int   x, y;             // where it was laid out from
+   int   left, top;        // screen position of the texture
+   int   width, height;    // size of the texture
+   void *rez;              // texture holding the whole string
+   int   visible;          // false if no glyph is on screen
+} textcache_t;
+
+boolean M_TextChanged(textcache_t *tc, const char *text, int x, int y);
+void    M_AddTextGlyph(jagobj_t *jo, int x, int y);
+void    M_DrawText(textcache_t *tc);
+
+#endif
+
+// EOF
+
@@ -0,0 +1,113 @@
+/*
+  CALICO
+
+  Thread scheduling
+
+  Each thread calls M_ScheduleThread with its role when it starts, which
+  sets the priority and core configured for that role. Priorities are -1
+  for low, 0 to leave the thread as the system made it, 1 for high and 2
+  for real-time, which is meant for audio. A core of -1 lets the thread
+  run anywhere; worker threads are given consecutive cores starting from
+  thread_worker_core, so that each has one to itself. thread_timer_ms sets
+  the system timer period for the whole run where the platform has one to
+  set, as Windows does.
+*/
+
+#include <atomic>
+#include "elib/elib.h"
+#include "elib/atexit.h"
+#include "elib/configfile.h"
+#include "hal/hal_platform.h"
+#include "hal/hal_thread.h"
+#include "m_thread.h"
+
+//
+// Config Vars
+//
+
+static int thread_main_priority   = 0;
+static int thread_audio_priority  = 0;
+static int thread_worker_priority = 0;
+static int thread_io_priority     = 0;
+
+static int thread_main_core   = -1;
+static int thread_audio_core  = -1;
+static int thread_worker_core = -1;
+static int thread_io_core     = -1;
+
+// in ms; 0 leaves the system's default
+static int thread_timer_ms = 0;
+
+static cfgrange_t<int> priorityRange = { -1, 2  };
+static cfgrange_t<int> coreRange     = { -1, 63 };
+static cfgrange_t<int> timerRange    = { 0,  16 };
+
+static CfgItem cfgMainPriority  ("thread_main_priority",   &thread_main_priority,   &priorityRange);
+static CfgItem cfgAudioPriority ("thread_audio_priority",  &thread_audio_priority,  &priorityRange);
+static CfgItem cfgWorkerPriority("thread_worker_priority", &thread_worker_priority, &priorityRange);
+static CfgItem cfgIOPriority    ("thread_io_priority",     &thread_io_priority,     &priorityRange);
+static CfgItem cfgMainCore      ("thread_main_core",       &thread_main_core,       &coreRange);
+static CfgItem cfgAudioCore     ("thread_audio_core",      &thread_audio_core,      &coreRange);
+static CfgItem cfgWorkerCore    ("thread_worker_core",     &thread_worker_core,     &coreRange);
+static CfgItem cfgIOCore        ("thread_io_core",         &thread_io_core,         &coreRange);
+static CfgItem cfgTimerMs       ("thread_timer_ms",        &thread_timer_ms,        &timerRange);
+
+static const char *const rolenames[NUMTHREADROLES] = { "main", "audio", "worker", "io" };
+
+// workers started so far, for handing out their cores
+static std::atomic<int> numworkers;
+
+//
+// Put the timer back as it was
+//
+static void M_RestoreTimer(void)
+{
+   hal_platform.setTimerResolution(0);
+}
+
+//
+// Set the calling thread's priority and core for its role
+//
+void M_ScheduleThread(threadrole_t role)
+{
+   static const int *const priorities[NUMTHREADROLES] =
+   {
+      &thread_main_priority, &thread_audio_priority, &thread_worker_priority, &thread_io_priority
+   };
+   static const int *const cores[NUMTHREADROLES] =
+   {
+      &thread_main_core, &thread_audio_core, &thread_worker_core, &thread_io_core
+   };
+   int priority = *priorities[role];
+   int core     = *cores[role];
+
+   if(role == THREAD_WORKER && core >= 0)
+   {
+      int count = hal_threads.getCPUCount ? hal_threads.getCPUCount() : 1;
+
+      core += numworkers.fetch_add(1);
+      if(count > 0)
+         core %= count;
+   }
+
+   if(priority && hal_platform.setThreadPriority && !hal_platform.setThreadPriority(priority))
+      hal_platform.debugMsg("M_ScheduleThread: %s thread kept its priority\n", rolenames[role]);
+
+   if(core >= 0 && hal_platform.setThreadAffinity && !hal_platform.setThreadAffinity(core))
+      hal_platform.debugMsg("M_ScheduleThread: %s thread can't be kept to core %d\n", rolenames[role], core);
+}
+
+//
+// Set the timer period and schedule the main thread
+//
+void M_InitThreads(void)
+{
+   if(thread_timer_ms && hal_platform.setTimerResolution &&
+      hal_platform.setTimerResolution(thread_timer_ms))
+      E_AtExit(M_RestoreTimer, true);
+
+   M_ScheduleThread(THREAD_MAIN);
+}
+
+// EOF
+
@@ -0,0 +1,39 @@
+/*
+  CALICO
+
+  Thread scheduling
+*/
+
+#ifndef M_THREAD_H__
+#define M_THREAD_H__
+
+#ifdef _MSC_VER
+#define THREADLOCAL __declspec(thread)
+#else
+#define THREADLOCAL __thread
+#endif
+
+typedef enum
+{
+   THREAD_MAIN,   // the game loop
+   THREAD_AUDIO,  // the sound mixer's callback
+   THREAD_WORKER, // render, sight and job workers
+   THREAD_IO,     // lump streaming, capture, screenshots and the serial link
+   NUMTHREADROLES
+} threadrole_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void M_InitThreads(void);
+void M_ScheduleThread(threadrole_t role);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+// EOF
+
@@ -0,0 +1,194 @@
+/*
+  CALICO
+
+  Timeline tracer
+
+  With -trace <file>, sections of the main loop, the render phases and
+  playsim stages timed by the profiler, zone allocations, lump cache misses,
+  GL frames, and the audio callback are recorded as they happen, each into a
+  ring of the last TRACEEVENTS events kept for the thread it ran on. The
+  rings are written to the file as Chrome trace event JSON on exit and
+  whenever the game is paused, to be opened in chrome://tracing or Perfetto
+  to see how the threads overlap. Counters, such as each frame's allocations,
+  are recorded the same way. With no -trace, every marker costs a test of
+  one flag.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "doomdef.h"
+#include "elib/atexit.h"
+#include "hal/hal_thread.h"
+#include "hal/hal_timer.h"
+#include "m_argv.h"
+#include "m_thread.h"
+#include "m_trace.h"
+
+#define TRACEEVENTS     65536 // per thread; must be a power of 2
+#define MAXTRACETHREADS 32
+
+typedef struct traceevent_s
+{
+   const char  *name;  // must outlive the trace, as string literals do
+   unsigned int start; // microseconds
+   unsigned int dur;   // or a counter's value
+   boolean      counter;
+} traceevent_t;
+
+typedef struct tracering_s
+{
+   traceevent_t *events;
+   unsigned int  count; // events ever recorded
+} tracering_t;
+
+int tracing;
+
+static const char      *tracefilename;
+static tracering_t      rings[MAXTRACETHREADS];
+static int              numrings;
+static hal_semhandle_t  ringlock;
+
+static THREADLOCAL tracering_t *threadring;
+static THREADLOCAL boolean      threadnoring; // no ring was left for this thread
+
+static void M_TraceAtExit(void)
+{
+   M_TraceWrite();
+}
+
+//
+// Give the calling thread a ring of its own, the first time it records
+//
+static tracering_t *M_TraceClaimRing(void)
+{
+   hal_threads.semWait(ringlock);
+   if(numrings < MAXTRACETHREADS)
+   {
+      tracering_t *ring = &rings[numrings];
+
+      if((ring->events = malloc(TRACEEVENTS * sizeof(*ring->events))))
+      {
+         threadring = ring;
+         ++numrings;
+      }
+   }
+   hal_threads.semPost(ringlock);
+
+   if(!threadring)
+      threadnoring = true;
+
+   return threadring;
+}
+
+//
+// Turn tracing on if -trace was given. The calling thread's ring is the
+// first, and is named as the main thread's.
+//
+void M_TraceInit(void)
+{
+   int p;
+
+   if(!(p = M_GetArgParameters("-trace", 1)) || !hal_timer.getTimeUS)
+      return;
+   if(!hal_threads.createSemaphore || !(ringlock = hal_threads.createSemaphore(1)))
+      return;
+
+   tracefilename = myargv[p];
+   if(!M_TraceClaimRing())
+      I_Error("M_TraceInit: no memory for a trace");
+
+   tracing = true;
+   E_AtExit(M_TraceAtExit, true);
+}
+
+//
+// Get the time a traced section starts at
+//
+unsigned int M_TraceBegin(void)
+{
+   return tracing ? hal_timer.getTimeUS() : 0;
+}
+
+//
+// Record an event into the calling thread's ring
+//
+static void M_TraceEvent(const char *name, unsigned int start, unsigned int dur, boolean counter)
+{
+   tracering_t  *ring;
+   traceevent_t *ev;
+
+   if(threadnoring)
+      return;
+   if(!(ring = threadring) && !(ring = M_TraceClaimRing()))
+      return;
+
+   ev = &ring->events[ring->count & (TRACEEVENTS - 1)];
+   ev->name    = name;
+   ev->start   = start;
+   ev->dur     = dur;
+   ev->counter = counter;
+   ++ring->count;
+}
+
+void M_TraceEnd(const char *name, unsigned int start)
+{
+   if(tracing)
+      M_TraceEvent(name, start, hal_timer.getTimeUS() - start, false);
+}
+
+void M_TraceCounter(const char *name, int value)
+{
+   if(tracing)
+      M_TraceEvent(name, hal_timer.getTimeUS(), (unsigned int)value, true);
+}
+
+//
+// Write every ring out as Chrome trace event JSON. The other threads keep
+// recording while this runs, so the event each is writing at the time may
+// come out torn; every other one is whole.
+//
+void M_TraceWrite(void)
+{
+   FILE   *f;
+   int     i;
+   boolean first = true;
+
+   if(!tracing || !(f = fopen(tracefilename, "w")))
+      return;
+
+   fprintf(f, "{\"traceEvents\":[\n");
+   for(i = 0; i < numrings; i++)
+   {
+      const tracering_t *ring = &rings[i];
+      unsigned int count = ring->count;
+      unsigned int n     = count < TRACEEVENTS ? count : TRACEEVENTS;
+      unsigned int j;
+
+      fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                 "\"args\":{\"name\":\"%s %d\"}}", first ? "" : ",\n", i,
+              i ? "thread" : "main", i);
+      first = false;
+
+      for(j = count - n; j != count; j++)
+      {
+         const traceevent_t *ev = &ring->events[j & (TRACEEVENTS - 1)];
+
+         if(ev->counter)
+         {
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"tid\":%d,\"ts\":%u,\"args\":{\"value\":%d}}",
+                    ev->name, i, ev->start, (int)ev->dur);
+         }
+         else
+         {
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%u,\"dur\":%u}",
+                    ev->name, i, ev->start, ev->dur);
+         }
+      }
+   }
+   fprintf(f, "\n]}\n");
+
+   fclose(f);
+}
+
+// EOF
+
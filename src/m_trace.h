@@ -0,0 +1,29 @@
+/*
+  CALICO
+
+  Timeline tracer
+*/
+
+#ifndef M_TRACE_H__
+#define M_TRACE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int tracing; // an int, as C++ files can't include keywords.h
+
+void         M_TraceInit(void);
+unsigned int M_TraceBegin(void);
+void         M_TraceEnd(const char *name, unsigned int start);
+void         M_TraceCounter(const char *name, int value);
+void         M_TraceWrite(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+// EOF
+
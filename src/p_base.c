@@ -31,22 +31,25 @@
 #include "doomdef.h"
 #include "p_local.h"
 
-static mobj_t      *checkthing, *hitthing;
-static fixed_t      testx, testy;
-static fixed_t      testfloorz, testceilingz, testdropoffz;
-static subsector_t *testsubsec;
-static line_t      *ceilingline;
-static fixed_t      testbbox[4];
-static int          testflags;
-
 // CALICO: current mobj in P_RunMobjBase2
 static mobj_t *currentmobj;
 
+// CALICO: solid things within reach of a move taken in several steps,
+// gathered once by PB_BeginStepQuery and kept in blockmap order per cell
+#define MAXSTEPCELLS  64
+#define MAXSTEPTHINGS 256
+
+static boolean  stepquery;
+static int      stepxl, stepyl, stepwidth, stepheight;
+static int      stepfirst[MAXSTEPCELLS + 1];
+static mobj_t  *stepthings[MAXSTEPTHINGS];
+
 //
 // Check for collision against another mobj in one of the blockmap cells.
 //
-static boolean PB_CheckThing(mobj_t *thing)
+static boolean PB_CheckThing(mobj_t *thing, void *data)
 {
+   movecheck_t *mc = data;
    fixed_t  blockdist;
    int      delta;
    mobj_t  *mo;
@@ -54,16 +57,16 @@ static boolean PB_CheckThing(mobj_t *thing)
    if(!(thing->flags & MF_SOLID))
       return true; // not blocking
 
-   mo = checkthing;
+   mo = mc->thing;
    blockdist = thing->radius + mo->radius;
 
-   delta = thing->x - testx;
+   delta = thing->x - mc->x;
    if(delta < 0)
       delta = -delta;
    if(delta >= blockdist)
       return true; // didn't hit it
 
-   delta = thing->y - testy;
+   delta = thing->y - mc->y;
    if(delta < 0)
       delta = -delta;
    if(delta >= blockdist)
@@ -73,14 +76,14 @@ static boolean PB_CheckThing(mobj_t *thing)
       return true; // don't clip against self
 
    // check for skulls slamming into things
-   if(testflags & MF_SKULLFLY)
+   if(mc->flags & MF_SKULLFLY)
    {
-      hitthing = thing;
+      mc->hitthing = thing;
       return false;
    }
 
    // missiles can hit other things
-   if(testflags & MF_MISSILE)
+   if(mc->flags & MF_MISSILE)
    {
       if(mo->z > thing->z + thing->height)
          return true; // went over
@@ -98,7 +101,7 @@ static boolean PB_CheckThing(mobj_t *thing)
          return !(thing->flags & MF_SOLID); // didn't do any damage
 
       // damage/explode
-      hitthing = thing;
+      mc->hitthing = thing;
       return false;
    }
 
@@ -108,7 +111,7 @@ static boolean PB_CheckThing(mobj_t *thing)
 //
 // Test for a bounding box collision with a linedef.
 //
-static boolean PB_BoxCrossLine(line_t *ld)
+static boolean PB_BoxCrossLine(movecheck_t *mc, line_t *ld)
 {
    fixed_t x1, x2;
    fixed_t lx, ly;
@@ -117,23 +120,23 @@ static boolean PB_BoxCrossLine(line_t *ld)
    boolean side1, side2;
 
    // entirely outside bounding box of line?
-   if(testbbox[BOXRIGHT ] <= ld->bbox[BOXLEFT  ] ||
-      testbbox[BOXLEFT  ] >= ld->bbox[BOXRIGHT ] ||
-      testbbox[BOXTOP   ] <= ld->bbox[BOXBOTTOM] ||
-      testbbox[BOXBOTTOM] >= ld->bbox[BOXTOP   ])
+   if(mc->bbox[BOXRIGHT ] <= ld->bbox[BOXLEFT  ] ||
+      mc->bbox[BOXLEFT  ] >= ld->bbox[BOXRIGHT ] ||
+      mc->bbox[BOXTOP   ] <= ld->bbox[BOXBOTTOM] ||
+      mc->bbox[BOXBOTTOM] >= ld->bbox[BOXTOP   ])
    {
       return false;
    }
 
    if(ld->slopetype == ST_POSITIVE)
    {
-      x1 = testbbox[BOXLEFT ];
-      x2 = testbbox[BOXRIGHT];
+      x1 = mc->bbox[BOXLEFT ];
+      x2 = mc->bbox[BOXRIGHT];
    }
    else
    {
-      x1 = testbbox[BOXRIGHT];
-      x2 = testbbox[BOXLEFT ];
+      x1 = mc->bbox[BOXRIGHT];
+      x2 = mc->bbox[BOXLEFT ];
    }
 
    lx  = ld->v1->x;
@@ -142,9 +145,9 @@ static boolean PB_BoxCrossLine(line_t *ld)
    ldy = (ld->v2->y - ld->v1->y) >> FRACBITS;
 
    dx1 = (x1 - lx) >> FRACBITS;
-   dy1 = (testbbox[BOXTOP] - ly) >> FRACBITS;
+   dy1 = (mc->bbox[BOXTOP] - ly) >> FRACBITS;
    dx2 = (x2 - lx) >> FRACBITS;
-   dy2 = (testbbox[BOXBOTTOM] - ly) >> FRACBITS;
+   dy2 = (mc->bbox[BOXBOTTOM] - ly) >> FRACBITS;
 
    side1 = (ldy * dx1 < dy1 * ldx);
    side2 = (ldy * dx2 < dy2 * ldx);
@@ -153,50 +156,35 @@ static boolean PB_BoxCrossLine(line_t *ld)
 }
 
 //
-// Adjusts testfloorz and testceilingz as lines are contacted.
+// Adjusts mc->floorz and mc->ceilingz as lines are contacted.
 //
-static boolean PB_CheckLine(line_t *ld)
+static boolean PB_CheckLine(movecheck_t *mc, line_t *ld)
 {
    fixed_t   opentop, openbottom, lowfloor;
-   sector_t *front, *back;
 
    // The moving thing's destination position will cross the given line.
    // if this should not be allowed, return false.
    if(!ld->backsector)
       return false; // one-sided line
 
-   if(!(testflags & MF_MISSILE) && (ld->flags & (ML_BLOCKING|ML_BLOCKMONSTERS)))
+   if(!(mc->flags & MF_MISSILE) && (ld->flags & (ML_BLOCKING|ML_BLOCKMONSTERS)))
       return false; // explicitly blocking
 
-   front = ld->frontsector;
-   back  = ld->backsector;
-
-   if(front->ceilingheight < back->ceilingheight)
-      opentop = front->ceilingheight;
-   else
-      opentop = back->ceilingheight;
-
-   if(front->floorheight > back->floorheight)
-   {
-      openbottom = front->floorheight;
-      lowfloor   = back->floorheight;
-   }
-   else
-   {
-      openbottom = back->floorheight;
-      lowfloor   = front->floorheight;
-   }
+   P_CachedLineOpening(ld);
+   opentop    = ld->opentop;
+   openbottom = ld->openbottom;
+   lowfloor   = ld->lowfloor;
 
    // adjust floor/ceiling heights
-   if(opentop < testceilingz)
+   if(opentop < mc->ceilingz)
    {
-      testceilingz = opentop;
-      ceilingline  = ld;
+      mc->ceilingz = opentop;
+      mc->ceilingline  = ld;
    }
-   if(openbottom > testfloorz)
-      testfloorz = openbottom;
-   if(lowfloor < testdropoffz)
-      testdropoffz = lowfloor;
+   if(openbottom > mc->floorz)
+      mc->floorz = openbottom;
+   if(lowfloor < mc->dropoffz)
+      mc->dropoffz = lowfloor;
 
    return true;
 }
@@ -204,11 +192,13 @@ static boolean PB_CheckLine(line_t *ld)
 //
 // Check a thing against a linedef in one of the blockmap cells.
 //
-static boolean PB_CrossCheck(line_t *ld)
+static boolean PB_CrossCheck(line_t *ld, void *data)
 {
-   if(PB_BoxCrossLine(ld))
+   movecheck_t *mc = data;
+
+   if(PB_BoxCrossLine(mc, ld))
    {
-      if(!PB_CheckLine(ld))
+      if(!PB_CheckLine(mc, ld))
          return false;
    }
    return true;
@@ -217,35 +207,37 @@ static boolean PB_CrossCheck(line_t *ld)
 //
 // Check an mobj's position for validity against lines and other mobjs
 //
-static boolean PB_CheckPosition(mobj_t *mo)
+static boolean PB_CheckPosition(movecheck_t *mc)
 {
+   mobj_t *mo = mc->thing;
    int xl, xh, yl, yh, bx, by;
 
-   testflags = mo->flags;
+   mc->flags = mo->flags;
 
-   testbbox[BOXTOP   ] = testy + mo->radius;
-   testbbox[BOXBOTTOM] = testy - mo->radius;
-   testbbox[BOXRIGHT ] = testx + mo->radius;
-   testbbox[BOXLEFT  ] = testx - mo->radius;
+   mc->bbox[BOXTOP   ] = mc->y + mo->radius;
+   mc->bbox[BOXBOTTOM] = mc->y - mo->radius;
+   mc->bbox[BOXRIGHT ] = mc->x + mo->radius;
+   mc->bbox[BOXLEFT  ] = mc->x - mo->radius;
 
    // the base floor / ceiling is from the subsector that contains the point.
    // Any contacted lines the step closer together will adjust them.
-   testsubsec   = R_PointInSubsector(testx, testy);
-   testfloorz   = testdropoffz = testsubsec->sector->floorheight;
-   testceilingz = testsubsec->sector->ceilingheight;
+   mc->newsubsec = R_PointInSubsectorHint(mc->x, mc->y, mo->subsector); // CALICO
+   mc->floorz    = mc->dropoffz = mc->newsubsec->sector->floorheight;
+   mc->ceilingz  = mc->newsubsec->sector->ceilingheight;
 
    ++validcount;
 
-   ceilingline = NULL;
-   hitthing    = NULL;
+   mc->ceilingline = NULL;
+   mc->hitthing    = NULL;
+   mc->blockline   = NULL;
 
    // the bounding box is extended by MAXRADIUS because mobj_ts are grouped into
    // mapblocks based on their origin point, and can overlap into adjacent blocks
    // by up to MAXRADIUS units
-   xl = (testbbox[BOXLEFT  ] - bmaporgx - MAXRADIUS) >> MAPBLOCKSHIFT;
-   xh = (testbbox[BOXRIGHT ] - bmaporgx + MAXRADIUS) >> MAPBLOCKSHIFT;
-   yl = (testbbox[BOXBOTTOM] - bmaporgy - MAXRADIUS) >> MAPBLOCKSHIFT;
-   yh = (testbbox[BOXTOP   ] - bmaporgy + MAXRADIUS) >> MAPBLOCKSHIFT;
+   xl = (mc->bbox[BOXLEFT  ] - bmaporgx - MAXRADIUS) >> MAPBLOCKSHIFT;
+   xh = (mc->bbox[BOXRIGHT ] - bmaporgx + MAXRADIUS) >> MAPBLOCKSHIFT;
+   yl = (mc->bbox[BOXBOTTOM] - bmaporgy - MAXRADIUS) >> MAPBLOCKSHIFT;
+   yh = (mc->bbox[BOXTOP   ] - bmaporgy + MAXRADIUS) >> MAPBLOCKSHIFT;
 
    if(xl < 0)
       xl = 0;
@@ -256,14 +248,24 @@ static boolean PB_CheckPosition(mobj_t *mo)
    if(yh >= bmapheight)
       yh = bmapheight - 1;
 
-   checkthing = mo; // store for PB_CheckThing
    for(bx = xl; bx <= xh; bx++)
    {
       for(by = yl; by <= yh; by++)
       {
-         if(!P_BlockThingsIterator(bx, by, PB_CheckThing))
+         if(stepquery)
+         {
+            int cell = (bx - stepxl) * stepheight + (by - stepyl);
+            int i;
+
+            for(i = stepfirst[cell]; i < stepfirst[cell + 1]; i++)
+            {
+               if(!PB_CheckThing(stepthings[i], mc))
+                  return false;
+            }
+         }
+         else if(!P_BlockThingsIterator(bx, by, PB_CheckThing, mc))
             return false;
-         if(!P_BlockLinesIterator(bx, by, PB_CrossCheck))
+         if(!P_BlockLinesIteratorBox(bx, by, mc->bbox, PB_CrossCheck, mc))
             return false;
       }
    }
@@ -275,34 +277,136 @@ static boolean PB_CheckPosition(mobj_t *mo)
 // Try to move to the new position, and relink the mobj to the new position if
 // successful.
 //
-static boolean PB_TryMove(mobj_t *mo, fixed_t tryx, fixed_t tryy)
+static boolean PB_TryMove(movecheck_t *mc, mobj_t *mo, fixed_t tryx, fixed_t tryy)
 {
-   testx = tryx;
-   testy = tryy;
+   mc->thing      = mo;
+   mc->x          = tryx;
+   mc->y          = tryy;
+   mc->linestamps = NULL;
 
-   if(!PB_CheckPosition(mo))
+   if(!PB_CheckPosition(mc))
       return false; // solid wall or thing
 
-   if(testceilingz - testfloorz < mo->height)
+   if(mc->ceilingz - mc->floorz < mo->height)
       return false; // doesn't fit
-   if(testceilingz - mo->z < mo->height)
+   if(mc->ceilingz - mo->z < mo->height)
       return false; // mobj must lower itself to fit
-   if(testfloorz - mo->z > 24*FRACUNIT)
+   if(mc->floorz - mo->z > 24*FRACUNIT)
       return false; // too big a step up
-   if(!(testflags & (MF_DROPOFF|MF_FLOAT)) && testfloorz - testdropoffz > 24*FRACUNIT)
+   if(!(mc->flags & (MF_DROPOFF|MF_FLOAT)) && mc->floorz - mc->dropoffz > 24*FRACUNIT)
       return false; // don't stand over a dropoff
 
    // the move is ok, so link the thing into its new position
-   P_UnsetThingPosition(mo);
-   mo->floorz   = testfloorz;
-   mo->ceilingz = testceilingz;
-   mo->x        = tryx;
-   mo->y        = tryy;
-   P_SetThingPosition(mo);
+   P_CommitMove(mc);
 
    return true;
 }
 
+//
+// CALICO: gather the things in the cells a stepped move will check which
+// PB_CheckThing could stop it on. A thing which isn't solid, or is out of
+// reach of the mobj anywhere along the move, passes every step, so leaving
+// it out changes nothing but the time taken; the ones kept are checked in
+// the same order as before. The mobj itself is left out, as relinking it
+// on each step would leave the list stale, and it never clips itself.
+//
+static void PB_GatherStepThings(mobj_t *mo, const fixed_t *box)
+{
+   int xl, xh, yl, yh, bx, by, count = 0;
+   fixed_t left, right, bottom, top;
+
+   xl = (box[BOXLEFT  ] - bmaporgx - MAXRADIUS) >> MAPBLOCKSHIFT;
+   xh = (box[BOXRIGHT ] - bmaporgx + MAXRADIUS) >> MAPBLOCKSHIFT;
+   yl = (box[BOXBOTTOM] - bmaporgy - MAXRADIUS) >> MAPBLOCKSHIFT;
+   yh = (box[BOXTOP   ] - bmaporgy + MAXRADIUS) >> MAPBLOCKSHIFT;
+
+   if(xl < 0)
+      xl = 0;
+   if(yl < 0)
+      yl = 0;
+   if(xh >= bmapwidth)
+      xh = bmapwidth - 1;
+   if(yh >= bmapheight)
+      yh = bmapheight - 1;
+
+   if(xh < xl || yh < yl || (xh - xl + 1) * (yh - yl + 1) > MAXSTEPCELLS)
+      return; // the steps will walk the blockmap themselves
+
+   // the range the mobj's origin covers over the whole move
+   left   = box[BOXLEFT  ] + mo->radius;
+   right  = box[BOXRIGHT ] - mo->radius;
+   bottom = box[BOXBOTTOM] + mo->radius;
+   top    = box[BOXTOP   ] - mo->radius;
+
+   stepxl     = xl;
+   stepyl     = yl;
+   stepwidth  = xh - xl + 1;
+   stepheight = yh - yl + 1;
+
+   for(bx = xl; bx <= xh; bx++)
+   {
+      for(by = yl; by <= yh; by++)
+      {
+         mobj_t *thing;
+
+         stepfirst[(bx - xl) * stepheight + (by - yl)] = count;
+
+         for(thing = blocklinks[by * bmapwidth + bx]; thing; thing = thing->bnext)
+         {
+            fixed_t blockdist = thing->radius + mo->radius;
+
+            if(thing == mo || !(thing->flags & MF_SOLID))
+               continue;
+            if(thing->x <= left - blockdist || thing->x >= right + blockdist ||
+               thing->y <= bottom - blockdist || thing->y >= top + blockdist)
+               continue;
+
+            if(count == MAXSTEPTHINGS)
+               return; // too crowded; walk the blockmap
+            stepthings[count++] = thing;
+         }
+      }
+   }
+
+   stepfirst[stepwidth * stepheight] = count;
+   stepquery = true;
+}
+
+//
+// CALICO: start a move query covering every step of a move of dx, dy.
+//
+static void PB_BeginStepQuery(mobj_t *mo, fixed_t dx, fixed_t dy)
+{
+   fixed_t box[4];
+
+   box[BOXTOP   ] = mo->y + mo->radius;
+   box[BOXBOTTOM] = mo->y - mo->radius;
+   box[BOXRIGHT ] = mo->x + mo->radius;
+   box[BOXLEFT  ] = mo->x - mo->radius;
+
+   if(dx > 0)
+      box[BOXRIGHT ] += dx;
+   else
+      box[BOXLEFT  ] += dx;
+
+   if(dy > 0)
+      box[BOXTOP   ] += dy;
+   else
+      box[BOXBOTTOM] += dy;
+
+   P_BeginMoveQuery(box);
+   PB_GatherStepThings(mo, box);
+}
+
+//
+// CALICO: finish a move started by PB_BeginStepQuery, if any
+//
+static void PB_EndStepQuery(void)
+{
+   stepquery = false;
+   P_EndMoveQuery();
+}
+
 #define STOPSPEED 0x1000
 #define FRICTION  0xd240
 
@@ -311,7 +415,8 @@ static boolean PB_TryMove(mobj_t *mo, fixed_t tryx, fixed_t tryy)
 //
 void P_XYMovement(mobj_t *mo)
 {
-   fixed_t xleft, yleft, xuse, yuse;
+   fixed_t     xleft, yleft, xuse, yuse;
+   movecheck_t mc;
 
    xleft = xuse = mo->momx & ~7;
    yleft = yuse = mo->momy & ~7;
@@ -322,42 +427,53 @@ void P_XYMovement(mobj_t *mo)
       yuse >>= 1;
    }
 
+   // CALICO: a move taken in several steps checks mostly the same lines and
+   // things on each one, so gather them first
+   if(xuse != xleft || yuse != yleft)
+      PB_BeginStepQuery(mo, xleft, yleft);
+
    while(xleft || yleft)
    {
       xleft -= xuse;
       yleft -= yuse;
 
-      if(!PB_TryMove(mo, mo->x + xuse, mo->y + yuse))
+      if(!PB_TryMove(&mc, mo, mo->x + xuse, mo->y + yuse))
       {
          // blocked move
 
          // flying skull?
          if(mo->flags & MF_SKULLFLY)
          {
-            P_SetTarget(&mo->extramobj, hitthing);
+            P_SetTarget(&mo->extramobj, mc.hitthing);
             mo->latecall = L_SkullBash;
+            PB_EndStepQuery();
             return;
          }
 
          // explode a missile?
          if(mo->flags & MF_MISSILE)
          {
-            if(ceilingline && ceilingline->backsector && ceilingline->backsector->ceilingpic == -1)
+            if(mc.ceilingline && mc.ceilingline->backsector && mc.ceilingline->backsector->ceilingpic == -1)
             {
                mo->latecall = P_RemoveMobj;
+               PB_EndStepQuery();
                return;
             }
 
-            P_SetTarget(&mo->extramobj, hitthing);
+            P_SetTarget(&mo->extramobj, mc.hitthing);
             mo->latecall = L_MissileHit;
+            PB_EndStepQuery();
             return;
          }
 
          mo->momx = mo->momy = 0;
+         PB_EndStepQuery();
          return;
       }
    }
 
+   PB_EndStepQuery();
+
    // slow down
 
    if(mo->flags & (MF_MISSILE|MF_SKULLFLY))
@@ -530,7 +646,7 @@ void P_RemoveMobjDeferred(mobj_t *mobj)
    {
       // remove from list and free self
       P_UnlinkMobj(mobj);
-      Z_Free(mobj);
+      Z_SlabFree(mobj); // CALICO
    }
 }
 
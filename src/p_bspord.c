@@ -0,0 +1,166 @@
+/*
+  CALICO
+
+  BSP storage order
+
+  With -reorderbsp, the nodes and segs of a level are moved once it is loaded
+  so that the tree walks of the renderer, sight checks and hitscans go
+  through memory in order, instead of in the order the node builder happened
+  to write things out. Nodes are renumbered depth first, counting down from
+  the root, which keeps its number of numnodes - 1: a node's first child
+  comes straight before it, followed by the rest of that child's subtree and
+  then the second child's. Segs are laid out in the order of the subsectors
+  which own them.
+
+  Subsector numbers are left alone, as is the order of each node's children
+  and of each subsector's segs, so every walk visits exactly what it did
+  before, and any tree or seg list which isn't laid out the way this expects
+  is kept as it was loaded.
+*/
+
+#include <stdlib.h>
+#include "doomdef.h"
+#include "m_argv.h"
+#include "p_local.h"
+
+static int *newnodenum; // [numnodes] new number of each node, or -1
+static int  nextnodenum;
+
+//
+// Give bspnum and its subtree their new numbers. Returns false if the tree
+// refers to a node twice or to one which doesn't exist.
+//
+static boolean P_NumberNode(int bspnum)
+{
+   int i;
+
+   if(bspnum & NF_SUBSECTOR)
+      return true;
+
+   if(bspnum >= numnodes || newnodenum[bspnum] != -1)
+      return false;
+
+   newnodenum[bspnum] = nextnodenum--;
+
+   for(i = 0; i < 2; i++)
+   {
+      if(!P_NumberNode(nodes[bspnum].children[i]))
+         return false;
+   }
+
+   return true;
+}
+
+//
+// Renumber the nodes depth first
+//
+static void P_ReorderNodes(void)
+{
+   node_t *old;
+   int     i, j;
+
+   if(numnodes < 2)
+      return;
+
+   if(!(newnodenum = malloc(numnodes * sizeof(*newnodenum))) ||
+      !(old = malloc(numnodes * sizeof(node_t))))
+      I_Error("P_ReorderNodes: no memory for %i nodes", numnodes);
+
+   for(i = 0; i < numnodes; i++)
+      newnodenum[i] = -1;
+   nextnodenum = numnodes - 1;
+
+   if(P_NumberNode(numnodes - 1) && nextnodenum == -1)
+   {
+      D_memcpy(old, nodes, numnodes * sizeof(node_t));
+
+      for(i = 0; i < numnodes; i++)
+      {
+         node_t *no = &nodes[newnodenum[i]];
+
+         *no = old[i];
+         for(j = 0; j < 2; j++)
+         {
+            if(!(no->children[j] & NF_SUBSECTOR))
+               no->children[j] = newnodenum[no->children[j]];
+         }
+      }
+   }
+
+   free(old);
+   free(newnodenum);
+   newnodenum = NULL;
+}
+
+//
+// Lay the segs out in subsector order
+//
+static void P_ReorderSegs(void)
+{
+   seg_t *old;
+   byte  *owned;
+   int    i, next;
+
+   if(!numsegs)
+      return;
+
+   if(!(owned = calloc(numsegs, 1)) || !(old = malloc(numsegs * sizeof(seg_t))))
+      I_Error("P_ReorderSegs: no memory for %i segs", numsegs);
+
+   // every seg must belong to at most one subsector
+   for(i = 0; i < numsubsectors; i++)
+   {
+      const subsector_t *ss = &subsectors[i];
+      int                j;
+
+      if(ss->firstline < 0 || ss->numlines < 0 || ss->firstline + ss->numlines > numsegs)
+         break;
+
+      for(j = ss->firstline; j < ss->firstline + ss->numlines && !owned[j]; j++)
+         owned[j] = 1;
+      if(j < ss->firstline + ss->numlines)
+         break;
+   }
+
+   if(i == numsubsectors)
+   {
+      D_memcpy(old, segs, numsegs * sizeof(seg_t));
+
+      next = 0;
+      for(i = 0; i < numsubsectors; i++)
+      {
+         subsector_t *ss = &subsectors[i];
+
+         D_memcpy(&segs[next], &old[ss->firstline], ss->numlines * sizeof(seg_t));
+         ss->firstline = next;
+         next += ss->numlines;
+      }
+
+      // any the subsectors don't use go at the end, as they were
+      for(i = 0; i < numsegs; i++)
+      {
+         if(!owned[i])
+            segs[next++] = old[i];
+      }
+   }
+
+   free(old);
+   free(owned);
+}
+
+//
+// Reorder the level's nodes and segs if -reorderbsp was given. Called by
+// P_SetupLevel once they are loaded, before anything is built from their
+// numbers.
+//
+void P_ReorderBSP(void)
+{
+   if(!M_FindArgument("-reorderbsp"))
+      return;
+
+   P_ReorderNodes();
+   P_ReorderSegs();
+}
+
+// EOF
+
@@ -11,6 +11,8 @@
 
 ceiling_t *activeceilings[MAXCEILINGS];
 
+static slab_t ceilingslab = { "ceilings", sizeof(ceiling_t), PU_LEVSPEC }; // CALICO
+
 /*================================================================== */
 /* */
 /* T_MoveCeiling */
@@ -28,7 +30,7 @@ void T_MoveCeiling(ceiling_t *ceiling)
       res = T_MovePlane(ceiling->sector,ceiling->speed, ceiling->topheight, false, 1, 
                         ceiling->direction);
       if(!(gametic&7))
-         S_StartSound((mobj_t *)&ceiling->sector->soundorg,sfx_stnmov);
+         P_MoverSound((mobj_t *)&ceiling->sector->soundorg,sfx_stnmov);
       if(res == pastdest)
       {
          switch(ceiling->type)
@@ -49,7 +51,7 @@ void T_MoveCeiling(ceiling_t *ceiling)
       res = T_MovePlane(ceiling->sector, ceiling->speed, ceiling->bottomheight, ceiling->crush, 
                         1, ceiling->direction);
       if(!(gametic&7))
-         S_StartSound((mobj_t *)&ceiling->sector->soundorg,sfx_stnmov);
+         P_MoverSound((mobj_t *)&ceiling->sector->soundorg,sfx_stnmov);
       if(res == pastdest)
       {
          switch(ceiling->type)
@@ -120,7 +122,7 @@ int EV_DoCeiling(line_t *line, ceiling_e type)
       /* new door thinker */
       /* */
       rtn = 1;
-      ceiling = Z_Malloc(sizeof(*ceiling), PU_LEVSPEC, 0);
+      ceiling = Z_SlabAlloc(&ceilingslab);
       P_AddThinker(&ceiling->thinker);
       sec->specialdata = ceiling;
       ceiling->thinker.function = T_MoveCeiling;
@@ -187,6 +189,10 @@ void P_RemoveActiveCeiling(ceiling_t *c)
 {
    int i;
 
+   // CALICO: removed when its mover batch is committed
+   if(P_DeferMoverRemoval())
+      return;
+
    for(i = 0; i < MAXCEILINGS; i++)
    {
       if(activeceilings[i] == c)
@@ -1,5 +1,6 @@
 /* p_change.c */
 
+#include <stdlib.h>
 #include "doomdef.h"
 #include "p_local.h"
 
@@ -19,8 +20,14 @@ SECTOR HEIGHT CHANGING
 ============================================================================== 
 */ 
  
-boolean crushchange;
-boolean nofit;
+// CALICO: the state of one P_ChangeSector, formerly the crushchange and
+// nofit globals
+typedef struct sectorchange_s
+{
+   boolean crushchange;
+   boolean nofit;
+   boolean inbatch; // run from a mover batch; see p_mover.c
+} sectorchange_t;
 
 /*
 ==================
@@ -43,11 +50,25 @@ boolean P_ThingHeightClip(mobj_t *thing)
 
    onfloor = (thing->z == thing->floorz);
 
-   P_CheckPosition (thing, thing->x, thing->y);	
-   /* what about stranding a monster partially off an edge? */
+   // CALICO: a mover batch checks with its own line stamps, and gives up
+   // on things once its mover has to be run again in order
+   if(P_InMoverBatch())
+   {
+      movecheck_t mc;
+
+      if(!P_MoverCheckThing(thing, &mc))
+         return true;
+      thing->floorz   = mc.floorz;
+      thing->ceilingz = mc.ceilingz;
+   }
+   else
+   {
+      P_CheckPosition (thing, thing->x, thing->y);	
+      /* what about stranding a monster partially off an edge? */
 
-   thing->floorz = tmfloorz;
-   thing->ceilingz = tmceilingz;
+      thing->floorz = tmfloorz;
+      thing->ceilingz = tmceilingz;
+   }
 
    if(onfloor)
    {
@@ -76,13 +97,29 @@ boolean P_ThingHeightClip(mobj_t *thing)
 ===============
 */
 
-boolean PIT_ChangeSector(mobj_t *thing)
+boolean PIT_ChangeSector(mobj_t *thing, void *data)
 {
-   mobj_t *mo;
+   sectorchange_t *sc = data;
+   mobj_t         *mo;
 
    if(P_ThingHeightClip(thing))
       return true; /* keep checking */
 
+   // CALICO: a mover batch may only change heights; gibbing, removing or
+   // crushing a thing waits for the mover to be run again in order
+   if(sc->inbatch)
+   {
+      if(thing->health <= 0 || (thing->flags & MF_DROPPED) ||
+         ((thing->flags & MF_SHOOTABLE) && sc->crushchange && !(gametic&3)))
+      {
+         P_SerializeMover();
+         return false;
+      }
+      if(thing->flags & MF_SHOOTABLE)
+         sc->nofit = true;
+      return true;
+   }
+
    /* crunch bodies to giblets */
    if(thing->health <= 0)
    {
@@ -102,8 +139,8 @@ boolean PIT_ChangeSector(mobj_t *thing)
    if(!(thing->flags & MF_SHOOTABLE))
       return true; /* assume it is bloody gibs or something */
 		
-   nofit = true;
-   if(crushchange && !(gametic&3))
+   sc->nofit = true;
+   if(sc->crushchange && !(gametic&3))
    {
       P_DamageMobj(thing, NULL, NULL, 10);
       /* spray blood in a random direction */
@@ -115,6 +152,156 @@ boolean PIT_ChangeSector(mobj_t *thing)
    return true; /* keep checking (crush other things) */
 }
 
+/*
+===============
+=
+= P_BuildSectorNeighbours
+=
+= CALICO: for each sector, list the sectors a thing touching it could be
+= centered in, i.e. those whose bounding boxes come within MAXRADIUS of
+= its own. Built once at level load, after P_GroupLines.
+=
+===============
+*/
+
+static fixed_t   (*sectorbox)[4];  // [numsectors] exact line bounding boxes
+static int        *nearfirst;      // [numsectors+1] offsets into nearlist
+static sector_t  **nearlist;
+
+// sector numbers sorted by the left edges of their boxes, for the sweep
+static int        *sweeporder;
+
+static int P_CompareSectorLefts(const void *a, const void *b)
+{
+   int     ia = *(const int *)a, ib = *(const int *)b;
+   fixed_t la = sectorbox[ia][BOXLEFT], lb = sectorbox[ib][BOXLEFT];
+
+   if(la != lb)
+      return la < lb ? -1 : 1;
+   return ia - ib;
+}
+
+//
+// Visit every pair of near sectors, each sector with itself included, by
+// sweeping along x. Compared in map units, since the boxes widened by
+// MAXRADIUS can run past the fixed-point range at the edges of a map.
+// Counts into nearfirst if fill is false, else fills nearlist.
+//
+static void P_SweepNearSectors(boolean fill)
+{
+   int i, j, a, b;
+   int radius = MAXRADIUS >> FRACBITS;
+
+   for(i = 0; i < numsectors; i++)
+   {
+      a = sweeporder[i];
+      for(j = i; j < numsectors; j++)
+      {
+         b = sweeporder[j];
+         if((sectorbox[b][BOXLEFT] >> FRACBITS) - radius > (sectorbox[a][BOXRIGHT] >> FRACBITS))
+            break; // this and everything after starts too far right
+         if((sectorbox[b][BOXBOTTOM] >> FRACBITS) - radius > (sectorbox[a][BOXTOP   ] >> FRACBITS) ||
+            (sectorbox[b][BOXTOP   ] >> FRACBITS) + radius < (sectorbox[a][BOXBOTTOM] >> FRACBITS))
+            continue;
+
+         if(fill)
+         {
+            nearlist[nearfirst[a]++] = &sectors[b];
+            if(a != b)
+               nearlist[nearfirst[b]++] = &sectors[a];
+         }
+         else
+         {
+            ++nearfirst[a];
+            if(a != b)
+               ++nearfirst[b];
+         }
+      }
+   }
+}
+
+void P_BuildSectorNeighbours(void)
+{
+   int       i, j, total, count;
+   sector_t *sector;
+   line_t   *li;
+
+   sectorbox  = Z_Malloc(numsectors * sizeof(*sectorbox) + 4, PU_LEVEL, 0);
+   nearfirst  = Z_Malloc((numsectors + 1) * sizeof(int), PU_LEVEL, 0);
+   sweeporder = Z_Malloc(numsectors * sizeof(int) + 4, PU_STATIC, 0);
+
+   sector = sectors;
+   for(i = 0; i < numsectors; i++, sector++)
+   {
+      M_ClearBox(sectorbox[i]);
+      for(j = 0; j < sector->linecount; j++)
+      {
+         li = sector->lines[j];
+         M_AddToBox(sectorbox[i], li->v1->x, li->v1->y);
+         M_AddToBox(sectorbox[i], li->v2->x, li->v2->y);
+      }
+      sweeporder[i] = i;
+      nearfirst[i]  = 0;
+   }
+   qsort(sweeporder, numsectors, sizeof(int), P_CompareSectorLefts);
+
+   // count, turn the counts into offsets, then fill; filling moves each
+   // offset on to the start of the next sector's list
+   P_SweepNearSectors(false);
+   total = 0;
+   for(i = 0; i < numsectors; i++)
+   {
+      count        = nearfirst[i];
+      nearfirst[i] = total;
+      total       += count;
+   }
+   nearfirst[numsectors] = total;
+
+   nearlist = Z_Malloc(total * sizeof(sector_t *) + 4, PU_LEVEL, 0);
+   P_SweepNearSectors(true);
+   for(i = numsectors; i > 0; i--)
+      nearfirst[i] = nearfirst[i - 1];
+   nearfirst[0] = 0;
+
+   Z_Free(sweeporder);
+}
+
+/*
+===============
+=
+= P_ChangeNearThings
+=
+= CALICO: recheck only the things whose bounding boxes touch the sector,
+= found through the thing lists of the sectors near it. Things elsewhere
+= in the block box can still have their heights corrected by the
+= original walk (such as objects spawned straddling a ledge, or crowded
+= together), so this is only used when no demo or netgame needs the
+= playsim to match.
+=
+===============
+*/
+
+static void P_ChangeNearThings(sector_t *sector, sectorchange_t *sc)
+{
+   int       secnum = sector - sectors;
+   fixed_t  *box    = sectorbox[secnum];
+   int       i;
+   mobj_t   *mobj, *next;
+
+   for(i = nearfirst[secnum]; i < nearfirst[secnum + 1]; i++)
+   {
+      for(mobj = nearlist[i]->thinglist; mobj; mobj = next)
+      {
+         next = mobj->snext; // may be removed
+         if(mobj->x - mobj->radius > box[BOXRIGHT ] || mobj->x + mobj->radius < box[BOXLEFT  ] ||
+            mobj->y - mobj->radius > box[BOXTOP   ] || mobj->y + mobj->radius < box[BOXBOTTOM])
+            continue;
+         if(!(mobj->flags & MF_NOBLOCKMAP))
+            PIT_ChangeSector(mobj, sc);
+      }
+   }
+}
+
 /*
 ===============
 =
@@ -125,24 +312,40 @@ boolean PIT_ChangeSector(mobj_t *thing)
 
 boolean P_ChangeSector(sector_t *sector, boolean crunch)
 {
+   sectorchange_t sc;
    int x, y;
-   int i;
 
-   /* force next sound to reflood */
-   for(i = 0; i < MAXPLAYERS; i++)
-      players[i].lastsoundsector = NULL;
+   sc.nofit       = false;
+   sc.crushchange = crunch;
+   sc.inbatch     = P_InMoverBatch(); // CALICO
+
+   // CALICO: a mover batch passes these on when it is committed
+   if(sc.inbatch)
+      P_MoverSectorChanged();
+   else
+   {
+      /* force next sound to reflood if this changed where it can go */
+      P_SoundSectorChanged(sector); // CALICO
+      P_ChaseFlowChanged(); // CALICO
+   }
+
+   ++sector->heightgen; // CALICO: drop cached line openings
 
-   nofit = false;
-   crushchange = crunch;
+   // CALICO: touching things only, when nothing needs the exact original
+   if(!demoplayback && !demorecording && netgame == gt_single)
+   {
+      P_ChangeNearThings(sector, &sc);
+      return sc.nofit;
+   }
 
    /* recheck heights for all things near the moving sector */
    for(x = sector->blockbox[BOXLEFT]; x <= sector->blockbox[BOXRIGHT]; x++)
    {
       for(y = sector->blockbox[BOXBOTTOM]; y <= sector->blockbox[BOXTOP]; y++)
-         P_BlockThingsIterator(x, y, PIT_ChangeSector);
+         P_BlockThingsIterator(x, y, PIT_ChangeSector, &sc);
    }
 	
-   return nofit;
+   return sc.nofit;
 }
 
 // EOF
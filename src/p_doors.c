@@ -2,6 +2,8 @@
 #include "p_local.h"
 #include "st_main.h"
 
+static slab_t doorslab = { "doors", sizeof(vldoor_t), PU_LEVSPEC }; // CALICO
+
 /*================================================================== */
 /*================================================================== */
 /* */
@@ -28,11 +30,11 @@ void T_VerticalDoor(vldoor_t *door)
          {
          case normal:
             door->direction = -1; /* time to go back down */
-            S_StartSound((mobj_t *)&door->sector->soundorg,sfx_dorcls);
+            P_MoverSound((mobj_t *)&door->sector->soundorg,sfx_dorcls);
             break;
          case close30ThenOpen:
             door->direction = 1;
-            S_StartSound((mobj_t *)&door->sector->soundorg,sfx_doropn);
+            P_MoverSound((mobj_t *)&door->sector->soundorg,sfx_doropn);
             break;
          default:
             break;
@@ -47,7 +49,7 @@ void T_VerticalDoor(vldoor_t *door)
          case raiseIn5Mins:
             door->direction = 1;
             door->type = normal;
-            S_StartSound((mobj_t *)&door->sector->soundorg,sfx_doropn);
+            P_MoverSound((mobj_t *)&door->sector->soundorg,sfx_doropn);
             break;
          default:
             break;
@@ -76,7 +78,7 @@ void T_VerticalDoor(vldoor_t *door)
       else if(res == crushed)
       {
          door->direction = 1;
-         S_StartSound((mobj_t *)&door->sector->soundorg,sfx_doropn);
+         P_MoverSound((mobj_t *)&door->sector->soundorg,sfx_doropn);
       }
       break;
    case 1: /* UP */
@@ -126,7 +128,7 @@ int EV_DoDoor(line_t *line, vldoor_e  type)
       /* new door thinker */
       /* */
       rtn = 1;
-      door = Z_Malloc (sizeof(*door), PU_LEVSPEC, 0);
+      door = Z_SlabAlloc(&doorslab);
       P_AddThinker (&door->thinker);
       sec->specialdata = door;
       door->thinker.function = T_VerticalDoor;
@@ -289,7 +291,7 @@ void EV_VerticalDoor(line_t *line, mobj_t *thing)
    /* */
    /* new door thinker */
    /* */
-   door = Z_Malloc (sizeof(*door), PU_LEVSPEC, 0);
+   door = Z_SlabAlloc(&doorslab);
    P_AddThinker (&door->thinker);
    sec->specialdata = door;
    door->thinker.function = T_VerticalDoor;
@@ -331,7 +333,7 @@ void P_SpawnDoorCloseIn30(sector_t *sec)
 {
    vldoor_t *door;
 
-   door = Z_Malloc( sizeof(*door), PU_LEVSPEC, 0);
+   door = Z_SlabAlloc(&doorslab);
    P_AddThinker(&door->thinker);
    sec->specialdata = door;
    sec->special = 0;
@@ -352,7 +354,7 @@ void P_SpawnDoorRaiseIn5Mins(sector_t *sec, int secnum)
 {
    vldoor_t *door;
 
-   door = Z_Malloc( sizeof(*door), PU_LEVSPEC, 0);
+   door = Z_SlabAlloc(&doorslab);
    P_AddThinker(&door->thinker);
    sec->specialdata = door;
    sec->special = 0;
@@ -1,6 +1,7 @@
 /* P_enemy.c */
 
 #include "doomdef.h"
+#include "m_argv.h"
 #include "p_local.h"
 
 /*
@@ -165,6 +166,198 @@ boolean P_TryWalk(mobj_t *actor)
    return true;
 }
 
+/*
+===============================================================================
+
+CALICO: chase flow fields
+
+With -chaseflow, each player keeps the number of walkable sector hops from
+every sector to the one they stand in. A monster chasing a player from
+another sector heads for the nearest line that leads one hop closer,
+instead of straight at the player, so it stops probing walls that lie
+between them. It is only a better first guess; P_NewChaseDir still probes
+every direction as before when that fails. Monsters path differently, so
+it is never used for demos or netgames.
+
+===============================================================================
+*/
+
+#define FLOWSTEP   24*FRACUNIT // highest step a monster can walk up or down
+#define FLOWHEIGHT 56*FRACUNIT // smallest opening a monster can walk through
+#define FLOWPUSH   32*FRACUNIT // how far past the line to aim
+
+static boolean    chaseflow;
+static VINT      *flowdist[MAXPLAYERS];   // hops from each sector, -1 if none
+static sector_t  *flowsector[MAXPLAYERS]; // sector flowdist leads to
+static boolean    flowdirty[MAXPLAYERS];
+static sector_t **flowqueue;
+
+//
+// Allocate the fields for a new level
+//
+void P_InitChaseFlow(void)
+{
+   int i;
+
+   chaseflow = M_FindArgument("-chaseflow");
+   if(!chaseflow)
+      return;
+
+   for(i = 0; i < MAXPLAYERS; i++)
+   {
+      flowdist[i]   = Z_Malloc(numsectors * sizeof(VINT) + 4, PU_LEVEL, 0);
+      flowsector[i] = NULL;
+   }
+   flowqueue = Z_Malloc(numsectors * sizeof(sector_t *) + 4, PU_LEVEL, 0);
+}
+
+//
+// Called when a sector's heights change, which may open or close a way
+//
+void P_ChaseFlowChanged(void)
+{
+   int i;
+
+   for(i = 0; i < MAXPLAYERS; i++)
+      flowdirty[i] = true;
+}
+
+//
+// Can a monster walk from one sector into another over the line?
+//
+static boolean P_FlowWalkable(sector_t *from, line_t *li, sector_t *to)
+{
+   fixed_t top, bottom;
+
+   if(li->flags & (ML_BLOCKING|ML_BLOCKMONSTERS))
+      return false;
+
+   if(D_abs(to->floorheight - from->floorheight) > FLOWSTEP)
+      return false;
+
+   top    = (to->ceilingheight < from->ceilingheight) ? to->ceilingheight : from->ceilingheight;
+   bottom = (to->floorheight   > from->floorheight  ) ? to->floorheight   : from->floorheight;
+
+   return (top - bottom >= FLOWHEIGHT);
+}
+
+//
+// Count the hops to sec from every sector which can walk there
+//
+static void P_UpdateChaseFlow(int playernum, sector_t *sec)
+{
+   VINT     *dist = flowdist[playernum];
+   sector_t *cur;
+   int       i, head, tail;
+
+   for(i = 0; i < numsectors; i++)
+      dist[i] = -1;
+
+   head = tail = 0;
+   dist[sec - sectors] = 0;
+   flowqueue[tail++] = sec;
+
+   while(head < tail)
+   {
+      soundedge_t *edge;
+
+      cur  = flowqueue[head++];
+      edge = cur->soundedges;
+      for(i = 0; i < cur->soundedgecount; i++, edge++)
+      {
+         sector_t *other = edge->other;
+
+         if(dist[other - sectors] >= 0 || !P_FlowWalkable(other, edge->line, cur))
+            continue;
+         dist[other - sectors] = dist[cur - sectors] + 1;
+         flowqueue[tail++] = other;
+      }
+   }
+
+   flowsector[playernum] = sec;
+   flowdirty[playernum]  = false;
+}
+
+//
+// Find where actor should head to reach its target, if not straight at it
+//
+static boolean P_ChaseFlowGoal(mobj_t *actor, fixed_t *goalx, fixed_t *goaly)
+{
+   mobj_t      *target = actor->target;
+   sector_t    *sec, *tsec;
+   soundedge_t *edge;
+   line_t      *best;
+   fixed_t      bestdist, dx, dy, len;
+   int          i, playernum;
+   VINT        *dist;
+
+   if(!chaseflow || demoplayback || demorecording || netgame != gt_single)
+      return false;
+   if(!target->player || (actor->flags & (MF_FLOAT|MF_NOCLIP)))
+      return false;
+
+   sec  = actor->subsector->sector;
+   tsec = target->subsector->sector;
+   if(sec == tsec)
+      return false;
+
+   playernum = target->player - players;
+   if(flowsector[playernum] != tsec || flowdirty[playernum])
+      P_UpdateChaseFlow(playernum, tsec);
+
+   dist = flowdist[playernum];
+   if(dist[sec - sectors] <= 0)
+      return false; // no walkable way
+
+   // the nearest line one hop closer
+   best     = NULL;
+   bestdist = D_MAXINT;
+   edge     = sec->soundedges;
+   for(i = 0; i < sec->soundedgecount; i++, edge++)
+   {
+      line_t *li = edge->line;
+      fixed_t d;
+
+      if(dist[edge->other - sectors] != dist[sec - sectors] - 1 ||
+         !P_FlowWalkable(sec, li, edge->other))
+         continue;
+
+      d = P_AproxDistance((li->v1->x >> 1) + (li->v2->x >> 1) - actor->x,
+                          (li->v1->y >> 1) + (li->v2->y >> 1) - actor->y);
+      if(d < bestdist)
+      {
+         bestdist = d;
+         best     = li;
+      }
+   }
+
+   if(!best)
+      return false;
+
+   // aim a little past the middle of the line, on the far side
+   dx  = best->v2->x - best->v1->x;
+   dy  = best->v2->y - best->v1->y;
+   len = P_AproxDistance(dx, dy);
+   if(len < FRACUNIT)
+      return false;
+
+   *goalx = (best->v1->x >> 1) + (best->v2->x >> 1);
+   *goaly = (best->v1->y >> 1) + (best->v2->y >> 1);
+   if(best->frontsector == sec)
+   {
+      // the front is on the right going from v1 to v2
+      *goalx -= FixedMul(dy, FixedDiv(FLOWPUSH, len));
+      *goaly += FixedMul(dx, FixedDiv(FLOWPUSH, len));
+   }
+   else
+   {
+      *goalx += FixedMul(dy, FixedDiv(FLOWPUSH, len));
+      *goaly -= FixedMul(dx, FixedDiv(FLOWPUSH, len));
+   }
+
+   return true;
+}
+
 /*
 ================
 =
@@ -193,8 +386,17 @@ void P_NewChaseDir(mobj_t *actor)
    olddir = actor->movedir;
    turnaround = opposite[olddir];
 
-   deltax = actor->target->x - actor->x;
-   deltay = actor->target->y - actor->y;
+   // CALICO: with -chaseflow, head for the way into the next sector
+   if(P_ChaseFlowGoal(actor, &deltax, &deltay))
+   {
+      deltax -= actor->x;
+      deltay -= actor->y;
+   }
+   else
+   {
+      deltax = actor->target->x - actor->x;
+      deltay = actor->target->y - actor->y;
+   }
 
    if(deltax > 10*FRACUNIT)
       d[1] = DI_EAST;
@@ -521,12 +723,16 @@ void A_SPosAttack(mobj_t *actor)
    A_FaceTarget(actor);
    bangle = actor->angle;
 
+   P_BeginShotFan(actor, bangle, 255<<20, MISSILERANGE); // CALICO
+
    for(i = 0; i < 3; i++)
    {
       angle = bangle + (P_SubRandom()<<20);
       damage = ((P_Random()&7)+1)*3;
       P_LineAttack(actor, angle, MISSILERANGE, D_MAXINT, damage);
    }
+
+   P_EndShotFan();
 }
 
 void A_SpidRefire(mobj_t *actor)
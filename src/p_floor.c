@@ -9,7 +9,7 @@
 /*================================================================== */
 /*================================================================== */
 
-
+slab_t floorslab = { "floors", sizeof(floormove_t), PU_LEVSPEC }; // CALICO
 
 /*================================================================== */
 /* */
@@ -159,7 +159,7 @@ void T_MoveFloor(floormove_t *floor)
    res = T_MovePlane(floor->sector, floor->speed, floor->floordestheight, floor->crush,
                      0, floor->direction);
    if(!(gametic&3))
-      S_StartSound((mobj_t *)&floor->sector->soundorg,sfx_stnmov);
+      P_MoverSound((mobj_t *)&floor->sector->soundorg,sfx_stnmov);
 
    if(res == pastdest)
    {
@@ -217,7 +217,7 @@ int EV_DoFloor(line_t *line,floor_e floortype)
       /* new floor thinker */
       /* */
       rtn = 1;
-      floor = Z_Malloc (sizeof(*floor), PU_LEVSPEC, 0);
+      floor = Z_SlabAlloc(&floorslab);
       P_AddThinker (&floor->thinker);
       sec->specialdata = floor;
       floor->thinker.function = T_MoveFloor;
@@ -368,7 +368,7 @@ int EV_BuildStairs(line_t *line)
       /* */
       rtn = 1;
       height = sec->floorheight + 8*FRACUNIT;
-      floor = Z_Malloc (sizeof(*floor), PU_LEVSPEC, 0);
+      floor = Z_SlabAlloc(&floorslab);
       P_AddThinker (&floor->thinker);
       sec->specialdata = floor;
       floor->thinker.function = T_MoveFloor;
@@ -407,7 +407,7 @@ int EV_BuildStairs(line_t *line)
 					
             sec = tsec;
             secnum = newsecnum;
-            floor = Z_Malloc (sizeof(*floor), PU_LEVSPEC, 0);
+            floor = Z_SlabAlloc(&floorslab);
             P_AddThinker (&floor->thinker);
             sec->specialdata = floor;
             floor->thinker.function = T_MoveFloor;
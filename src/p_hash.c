@@ -0,0 +1,366 @@
+/*
+  CALICO
+
+  Per-tic game state hashes
+
+  With -writehash <file>, every tic of a demo being recorded or played back
+  writes a record of the P_Random index, a hash of all sector heights, and a
+  hash of each mobj's position, momentum, angle, state, health and flags, in
+  list order. With -checkhash <file>, playback compares each tic against such
+  a file and reports the first tic and object which differ, so that a change
+  to the playsim can be shown to leave a demo playing out the same way.
+  Records are big-endian, like demos, so files can be compared between
+  builds on any machine.
+
+  The MIT License (MIT)
+
+  Copyright (c) 2016 James Haley
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "doomdef.h"
+#include "m_argv.h"
+#include "p_local.h"
+
+#define HASHMAGIC   0x48415348 // "HASH"
+#define HASHVERSION 1
+
+// one tic's record: tic, P_Random index, sector hash, mobj count, mobj hashes
+enum
+{
+   HR_TIC,
+   HR_RANDOM,
+   HR_SECTORS,
+   HR_NUMMOBJS,
+   HR_HEADER
+};
+
+extern int prndindex;
+
+static FILE     *writefile;
+static FILE     *checkfile;
+static boolean   checkfailed;
+static int       checkedtics;
+static uint32_t *mobjhashes, *refhashes;
+static int       maxmobjhashes, maxrefhashes;
+
+//
+// FNV-1a, a word at a time as the -timedemo sync check does
+//
+static uint32_t P_HashWord(uint32_t hash, uint32_t v)
+{
+   return (hash ^ v) * 16777619u;
+}
+
+static uint32_t P_HashMobj(const mobj_t *mo)
+{
+   uint32_t hash = 2166136261u;
+
+   hash = P_HashWord(hash, mo->type);
+   hash = P_HashWord(hash, mo->x);
+   hash = P_HashWord(hash, mo->y);
+   hash = P_HashWord(hash, mo->z);
+   hash = P_HashWord(hash, mo->momx);
+   hash = P_HashWord(hash, mo->momy);
+   hash = P_HashWord(hash, mo->momz);
+   hash = P_HashWord(hash, mo->angle);
+   hash = P_HashWord(hash, (uint32_t)(mo->state - states));
+   hash = P_HashWord(hash, mo->tics);
+   hash = P_HashWord(hash, mo->health);
+   hash = P_HashWord(hash, mo->flags);
+
+   return hash;
+}
+
+static uint32_t P_HashSectors(void)
+{
+   uint32_t hash = 2166136261u;
+   int      i;
+
+   for(i = 0; i < numsectors; i++)
+   {
+      hash = P_HashWord(hash, sectors[i].floorheight);
+      hash = P_HashWord(hash, sectors[i].ceilingheight);
+   }
+
+   return hash;
+}
+
+static uint32_t *P_GrowHashes(uint32_t *hashes, int *max, int count)
+{
+   if(count > *max)
+   {
+      int newmax = *max ? *max : 256;
+
+      while(newmax < count)
+         newmax *= 2;
+      if(!(hashes = realloc(hashes, newmax * sizeof(*hashes))))
+         I_Error("P_GrowHashes: no memory for %i hashes", newmax);
+      *max = newmax;
+   }
+
+   return hashes;
+}
+
+static void P_WriteHashWords(const uint32_t *words, int count)
+{
+   int i;
+
+   for(i = 0; i < count; i++)
+   {
+      int v = BIGLONG((int)words[i]);
+
+      if(fwrite(&v, sizeof(v), 1, writefile) != 1)
+      {
+         fclose(writefile); // don't try to finish it on the way out
+         writefile = NULL;
+         I_Error("P_WriteHashWords: error writing state hashes");
+      }
+   }
+}
+
+static boolean P_ReadHashWords(uint32_t *words, int count)
+{
+   int i;
+
+   for(i = 0; i < count; i++)
+   {
+      int v;
+
+      if(fread(&v, sizeof(v), 1, checkfile) != 1)
+         return false;
+      words[i] = (uint32_t)BIGLONG(v);
+   }
+
+   return true;
+}
+
+//
+// Report the first difference and stop checking
+//
+static void P_HashDiverged(const char *what)
+{
+   printf("state hash: tic %i differs: %s\n", gametic, what);
+   fflush(stdout);
+   checkfailed = true;
+}
+
+//
+// Find what differs between this tic and the reference record
+//
+static void P_CheckHashes(const uint32_t *header, int nummobjs)
+{
+   uint32_t ref[HR_HEADER];
+   char     msg[128];
+   int      i, count;
+   mobj_t  *mo;
+
+   if(!P_ReadHashWords(ref, HR_HEADER))
+   {
+      printf("state hash: reference ends before tic %i\n", gametic);
+      fflush(stdout);
+      checkfailed = true;
+      return;
+   }
+
+   count = (int)ref[HR_NUMMOBJS];
+   if(count < 0 || count > 0x100000)
+   {
+      P_HashDiverged("reference file is corrupt");
+      return;
+   }
+   refhashes = P_GrowHashes(refhashes, &maxrefhashes, count);
+   if(!P_ReadHashWords(refhashes, count))
+   {
+      P_HashDiverged("reference file is truncated");
+      return;
+   }
+
+   if(ref[HR_TIC] != header[HR_TIC])
+   {
+      sprintf(msg, "reference record is for tic %i", (int)ref[HR_TIC]);
+      P_HashDiverged(msg);
+      return;
+   }
+
+   // the first mobj to differ is the most useful thing to know
+   for(i = 0, mo = mobjhead.next; i < nummobjs && i < count; i++, mo = mo->next)
+   {
+      if(mobjhashes[i] != refhashes[i])
+      {
+         sprintf(msg, "mobj %i (type %i at %i, %i, %i)", i, (int)mo->type,
+                 mo->x >> FRACBITS, mo->y >> FRACBITS, mo->z >> FRACBITS);
+         P_HashDiverged(msg);
+         return;
+      }
+   }
+
+   if(nummobjs != count)
+   {
+      sprintf(msg, "%i mobjs, reference has %i", nummobjs, count);
+      P_HashDiverged(msg);
+   }
+   else if(ref[HR_SECTORS] != header[HR_SECTORS])
+      P_HashDiverged("sector heights");
+   else if(ref[HR_RANDOM] != header[HR_RANDOM])
+   {
+      sprintf(msg, "P_Random index %i, reference has %i", (int)header[HR_RANDOM], (int)ref[HR_RANDOM]);
+      P_HashDiverged(msg);
+   }
+   else
+      ++checkedtics;
+}
+
+//
+// Start writing hashes to writename and/or checking them against checkname,
+// either of which may be NULL, for the next demo
+//
+void P_OpenStateHash(const char *writename, const char *checkname)
+{
+   int header[2];
+
+   // replaces any files given on the command line
+   if(writefile)
+      fclose(writefile);
+   if(checkfile)
+      fclose(checkfile);
+   writefile = checkfile = NULL;
+
+   checkfailed = false;
+   checkedtics = 0;
+
+   if(writename)
+   {
+      if(!(writefile = fopen(writename, "wb")))
+         I_Error("P_OpenStateHash: can't write %s", writename);
+
+      header[0] = BIGLONG(HASHMAGIC);
+      header[1] = BIGLONG(HASHVERSION);
+      if(fwrite(header, sizeof(header), 1, writefile) != 1)
+         I_Error("P_OpenStateHash: error writing %s", writename);
+   }
+
+   if(checkname)
+   {
+      if(!(checkfile = fopen(checkname, "rb")))
+         I_Error("P_OpenStateHash: can't read %s", checkname);
+
+      if(fread(header, sizeof(header), 1, checkfile) != 1 || BIGLONG(header[0]) != HASHMAGIC)
+         I_Error("P_OpenStateHash: %s is not a state hash file", checkname);
+      if(BIGLONG(header[1]) != HASHVERSION)
+         I_Error("P_OpenStateHash: %s is version %i, not %i", checkname, BIGLONG(header[1]), HASHVERSION);
+   }
+}
+
+//
+// Open the files given by -writehash and -checkhash
+//
+void P_InitStateHash(void)
+{
+   int w = M_GetArgParameters("-writehash", 1);
+   int c = M_GetArgParameters("-checkhash", 1);
+
+   P_OpenStateHash(w ? myargv[w] : NULL, c ? myargv[c] : NULL);
+}
+
+//
+// True if the last demo checked differed from its hashes
+//
+boolean P_StateHashDiverged(void)
+{
+   return checkfailed;
+}
+
+//
+// Hash the state at the end of a demo tic, then write and/or check it
+//
+void P_UpdateStateHash(void)
+{
+   uint32_t header[HR_HEADER];
+   mobj_t  *mo;
+   int      nummobjs;
+
+   if(!writefile && (!checkfile || checkfailed))
+      return;
+   if(!demoplayback && !demorecording)
+      return;
+
+   nummobjs = 0;
+   for(mo = mobjhead.next; mo != &mobjhead; mo = mo->next)
+   {
+      mobjhashes = P_GrowHashes(mobjhashes, &maxmobjhashes, nummobjs + 1);
+      mobjhashes[nummobjs++] = P_HashMobj(mo);
+   }
+
+   header[HR_TIC     ] = gametic;
+   header[HR_RANDOM  ] = prndindex;
+   header[HR_SECTORS ] = P_HashSectors();
+   header[HR_NUMMOBJS] = nummobjs;
+
+   if(writefile)
+   {
+      P_WriteHashWords(header, HR_HEADER);
+      P_WriteHashWords(mobjhashes, nummobjs);
+   }
+
+   if(checkfile && !checkfailed)
+      P_CheckHashes(header, nummobjs);
+}
+
+//
+// One hash of the whole game state, for a dedicated server to publish
+//
+uint32_t P_StateHash(void)
+{
+   uint32_t hash = P_HashWord(P_HashSectors(), prndindex);
+   mobj_t  *mo;
+
+   for(mo = mobjhead.next; mo != &mobjhead; mo = mo->next)
+      hash = P_HashWord(hash, P_HashMobj(mo));
+
+   return hash;
+}
+
+//
+// Close the files at the end of the first demo, so that the title loop's
+// demos are not hashed after it
+//
+void P_EndStateHash(void)
+{
+   if(writefile)
+   {
+      fclose(writefile);
+      writefile = NULL;
+   }
+
+   if(checkfile)
+   {
+      if(!checkfailed)
+         printf("state hash: %i tics match\n", checkedtics);
+      fflush(stdout);
+      fclose(checkfile);
+      checkfile = NULL;
+   }
+}
+
+// EOF
+
@@ -0,0 +1,401 @@
+/*
+  CALICO
+
+  Processed level cache
+
+  With -levelcache, the runtime vertex, sector, side, line, subsector, node
+  and seg arrays of each map are written out after P_GroupLines has filled
+  them in, together with the sector line tables. Later loads of the map read
+  the file back and only relocate its pointers, which are stored as array
+  indices, instead of converting the lumps again. Each file records a hash
+  of the map's lumps and of the IWAD directory, and the sizes of the
+  structures it holds, and is rebuilt whenever they no longer match.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "doomdef.h"
+#include "m_argv.h"
+#include "p_local.h"
+#include "w_iwad.h"
+
+#define LCACHEID      "CLVC"
+#define LCACHEVERSION 1
+
+// arrays held in a cache file
+enum
+{
+   LC_VERTEXES,
+   LC_SECTORS,
+   LC_SIDES,
+   LC_LINES,
+   LC_SUBSECTORS,
+   LC_NODES,
+   LC_SEGS,
+   LC_LINEBUFFER, // the line tables P_GroupLines points sector->lines into
+   LC_NUMARRAYS
+};
+
+typedef struct lcacheheader_s
+{
+   char     id[4];
+   int32_t  version;
+   uint32_t hash;
+   int32_t  pointersize;
+   int32_t  elemsize[LC_NUMARRAYS];
+   int32_t  count[LC_NUMARRAYS];
+   // followed by each array in turn, every one starting 8-byte aligned
+} lcacheheader_t;
+
+typedef struct lcarray_s
+{
+   void  **base;
+   int    *count;
+   size_t  elemsize;
+} lcarray_t;
+
+// a pointer field which is written as an index into another array
+typedef struct lcreloc_s
+{
+   int    array;  // array holding the pointers
+   size_t offset; // of the pointer within each element
+   int    target; // array pointed into
+} lcreloc_t;
+
+static line_t **linebuffer;
+static int      numlinebuffer;
+
+static lcarray_t lcarrays[LC_NUMARRAYS] =
+{
+   { (void **)&vertexes,   &numvertexes,   sizeof(vertex_t)    },
+   { (void **)&sectors,    &numsectors,    sizeof(sector_t)    },
+   { (void **)&sides,      &numsides,      sizeof(side_t)      },
+   { (void **)&lines,      &numlines,      sizeof(line_t)      },
+   { (void **)&subsectors, &numsubsectors, sizeof(subsector_t) },
+   { (void **)&nodes,      &numnodes,      sizeof(node_t)      },
+   { (void **)&segs,       &numsegs,       sizeof(seg_t)       },
+   { (void **)&linebuffer, &numlinebuffer, sizeof(line_t *)    }
+};
+
+// Every other pointer in these structures is still NULL after P_GroupLines.
+static const lcreloc_t lcrelocs[] =
+{
+   { LC_SECTORS,    offsetof(sector_t,    lines),       LC_LINEBUFFER },
+   { LC_SIDES,      offsetof(side_t,      sector),      LC_SECTORS    },
+   { LC_LINES,      offsetof(line_t,      v1),          LC_VERTEXES   },
+   { LC_LINES,      offsetof(line_t,      v2),          LC_VERTEXES   },
+   { LC_LINES,      offsetof(line_t,      frontsector), LC_SECTORS    },
+   { LC_LINES,      offsetof(line_t,      backsector),  LC_SECTORS    },
+   { LC_SUBSECTORS, offsetof(subsector_t, sector),      LC_SECTORS    },
+   { LC_SEGS,       offsetof(seg_t,       v1),          LC_VERTEXES   },
+   { LC_SEGS,       offsetof(seg_t,       v2),          LC_VERTEXES   },
+   { LC_SEGS,       offsetof(seg_t,       sidedef),     LC_SIDES      },
+   { LC_SEGS,       offsetof(seg_t,       linedef),     LC_LINES      },
+   { LC_SEGS,       offsetof(seg_t,       frontsector), LC_SECTORS    },
+   { LC_SEGS,       offsetof(seg_t,       backsector),  LC_SECTORS    },
+   { LC_LINEBUFFER, 0,                                  LC_LINES      }
+};
+
+#define NUMLCRELOCS (sizeof(lcrelocs) / sizeof(lcrelocs[0]))
+
+// map lumps the cached arrays are made from
+static const int lclumps[] =
+{
+   ML_VERTEXES, ML_SECTORS, ML_SIDEDEFS, ML_LINEDEFS, ML_SSECTORS, ML_NODES, ML_SEGS,
+   ML_BLOCKMAP // sector block boxes
+};
+
+#define NUMLCLUMPS (sizeof(lclumps) / sizeof(lclumps[0]))
+
+static char    *lcachename; // file for the map being set up, if caching
+static uint32_t lcachehash;
+
+//
+// FNV-1a over a block of bytes
+//
+static uint32_t P_HashBytes(uint32_t hash, const byte *data, size_t len)
+{
+   size_t i;
+
+   for(i = 0; i < len; i++)
+   {
+      hash ^= data[i];
+      hash *= 16777619u;
+   }
+
+   return hash;
+}
+
+//
+// Hash of the map's lumps and of the IWAD directory. The directory stands in
+// for the texture and flat lists that sides and sectors are numbered from.
+//
+static uint32_t P_HashLevel(int lumpnum)
+{
+   uint32_t hash = 2166136261u;
+   size_t   i;
+
+   hash = P_HashBytes(hash, (const byte *)lumpinfo, numlumps * sizeof(lumpinfo_t));
+   for(i = 0; i < NUMLCLUMPS; i++)
+   {
+      int lump = lumpnum + lclumps[i];
+      hash = P_HashBytes(hash, W_LumpData(lump, I_TempBuffer()), W_LumpLength(lump));
+   }
+
+   return hash;
+}
+
+static size_t P_AlignSize(size_t size)
+{
+   return (size + 7) & ~(size_t)7;
+}
+
+static uintptr_t P_RelocField(const byte *elem, size_t offset)
+{
+   uintptr_t value;
+
+   memcpy(&value, elem + offset, sizeof(value));
+   return value;
+}
+
+//
+// Check a cache file against the map and this build, including that every
+// stored index lies within the array it points into
+//
+static boolean P_CheckLevelCache(const byte *data, long length, uint32_t hash, size_t offsets[])
+{
+   const lcacheheader_t *header = (const lcacheheader_t *)data;
+   size_t                pos    = P_AlignSize(sizeof(*header));
+   size_t                i;
+   int                   j;
+
+   if((size_t)length < sizeof(*header)                ||
+      memcmp(header->id, LCACHEID, 4)                 ||
+      header->version     != LCACHEVERSION            ||
+      header->hash        != hash                     ||
+      header->pointersize != (int32_t)sizeof(void *))
+      return false;
+
+   for(i = 0; i < LC_NUMARRAYS; i++)
+   {
+      if(header->elemsize[i] != (int32_t)lcarrays[i].elemsize || header->count[i] < 0)
+         return false;
+      offsets[i] = pos;
+      pos += P_AlignSize((size_t)header->count[i] * lcarrays[i].elemsize);
+   }
+   if(pos > (size_t)length)
+      return false;
+
+   for(i = 0; i < NUMLCRELOCS; i++)
+   {
+      const lcreloc_t *r    = &lcrelocs[i];
+      const byte      *elem = data + offsets[r->array];
+
+      // a sector with no lines may point just past the end of the tables
+      uintptr_t        last = (uintptr_t)header->count[r->target] + (r->target == LC_LINEBUFFER);
+
+      for(j = 0; j < header->count[r->array]; j++, elem += lcarrays[r->array].elemsize)
+      {
+         if(P_RelocField(elem, r->offset) > last)
+            return false;
+      }
+   }
+
+   return true;
+}
+
+//
+// Read a whole file into memory, or return NULL
+//
+static byte *P_ReadLevelCache(const char *filename, long *length)
+{
+   FILE *f;
+   byte *data;
+
+   if(!(f = fopen(filename, "rb")))
+      return NULL;
+
+   if(fseek(f, 0, SEEK_END) || (*length = ftell(f)) <= 0 || fseek(f, 0, SEEK_SET))
+   {
+      fclose(f);
+      return NULL;
+   }
+
+   if(!(data = malloc(*length)))
+      I_Error("P_ReadLevelCache: no memory for %s", filename);
+
+   if(fread(data, 1, *length, f) != (size_t)*length)
+   {
+      free(data);
+      data = NULL;
+   }
+
+   fclose(f);
+   return data;
+}
+
+//
+// Try to fill in the level's arrays from its cache file. Returns false, and
+// leaves the arrays alone, if caching is off or there is no usable file; if
+// caching is on, P_SaveLevelCache writes a new one once they are built.
+//
+boolean P_LoadLevelCache(int lumpnum)
+{
+   const char *iwadname = W_IWADName();
+   const char *mapname  = lumpinfo[lumpnum].name;
+   size_t      offsets[LC_NUMARRAYS];
+   size_t      i;
+   int         j;
+   long        length;
+   byte       *data;
+
+   free(lcachename);
+   lcachename = NULL;
+
+   if(!M_FindArgument("-levelcache") || !iwadname)
+      return false;
+
+   if(!(lcachename = malloc(strlen(iwadname) + 16)))
+      I_Error("P_LoadLevelCache: no memory for file name");
+   sprintf(lcachename, "%s.%.8s.lvl", iwadname, mapname);
+
+   lcachehash = P_HashLevel(lumpnum);
+   if(!(data = P_ReadLevelCache(lcachename, &length)))
+      return false;
+   if(!P_CheckLevelCache(data, length, lcachehash, offsets))
+   {
+      free(data);
+      return false;
+   }
+
+   // copy the arrays out into the level zone
+   for(i = 0; i < LC_NUMARRAYS; i++)
+   {
+      lcarray_t *a     = &lcarrays[i];
+      size_t     bytes = (size_t)((lcacheheader_t *)data)->count[i] * a->elemsize;
+
+      *a->count = ((lcacheheader_t *)data)->count[i];
+      *a->base  = Z_Malloc(bytes + 4, PU_LEVEL, 0);
+      D_memcpy(*a->base, data + offsets[i], bytes);
+   }
+   free(data);
+
+   // turn indices back into pointers
+   for(i = 0; i < NUMLCRELOCS; i++)
+   {
+      const lcreloc_t *r    = &lcrelocs[i];
+      byte            *elem = *lcarrays[r->array].base;
+      byte            *base = *lcarrays[r->target].base;
+      size_t           size = lcarrays[r->target].elemsize;
+
+      for(j = 0; j < *lcarrays[r->array].count; j++, elem += lcarrays[r->array].elemsize)
+      {
+         uintptr_t index = P_RelocField(elem, r->offset);
+         void     *ptr   = index ? base + (index - 1) * size : NULL;
+         memcpy(elem + r->offset, &ptr, sizeof(ptr));
+      }
+   }
+
+   // P_LoadSideDefs counts texture use for precaching
+   for(j = 0; j < numtextures; j++)
+      textures[j].usecount = 0;
+   for(j = 0; j < numsides; j++)
+   {
+      textures[sides[j].toptexture   ].usecount++;
+      textures[sides[j].bottomtexture].usecount++;
+      textures[sides[j].midtexture   ].usecount++;
+   }
+
+   free(lcachename);
+   lcachename = NULL;
+   D_printf("P_LoadLevelCache: using cached %.8s\n", mapname);
+   return true;
+}
+
+//
+// Write the level's arrays out, if P_LoadLevelCache found no usable cache
+// file for them. Call straight after P_GroupLines.
+//
+void P_SaveLevelCache(void)
+{
+   lcacheheader_t *header;
+   size_t          length, i;
+   size_t          offsets[LC_NUMARRAYS];
+   byte           *data;
+   int             j;
+   FILE           *f;
+
+   if(!lcachename)
+      return;
+
+   linebuffer    = numsectors ? sectors[0].lines : NULL;
+   numlinebuffer = 0;
+   for(j = 0; j < numsectors; j++)
+      numlinebuffer += sectors[j].linecount;
+
+   length = P_AlignSize(sizeof(*header));
+   for(i = 0; i < LC_NUMARRAYS; i++)
+   {
+      offsets[i] = length;
+      length += P_AlignSize((size_t)*lcarrays[i].count * lcarrays[i].elemsize);
+   }
+
+   if(!(data = calloc(1, length)))
+      I_Error("P_SaveLevelCache: no memory for %u bytes", (unsigned int)length);
+
+   header = (lcacheheader_t *)data;
+   memcpy(header->id, LCACHEID, 4);
+   header->version     = LCACHEVERSION;
+   header->hash        = lcachehash;
+   header->pointersize = (int32_t)sizeof(void *);
+   for(i = 0; i < LC_NUMARRAYS; i++)
+   {
+      header->elemsize[i] = (int32_t)lcarrays[i].elemsize;
+      header->count[i]    = *lcarrays[i].count;
+      memcpy(data + offsets[i], *lcarrays[i].base, (size_t)*lcarrays[i].count * lcarrays[i].elemsize);
+   }
+
+   // store pointers as indices plus one, leaving 0 for NULL
+   for(i = 0; i < NUMLCRELOCS; i++)
+   {
+      const lcreloc_t *r    = &lcrelocs[i];
+      byte            *elem = data + offsets[r->array];
+      const byte      *base = *lcarrays[r->target].base;
+      size_t           size = lcarrays[r->target].elemsize;
+
+      for(j = 0; j < *lcarrays[r->array].count; j++, elem += lcarrays[r->array].elemsize)
+      {
+         const byte *ptr;
+         uintptr_t   index;
+
+         memcpy(&ptr, elem + r->offset, sizeof(ptr));
+         index = ptr ? (uintptr_t)((ptr - base) / size) + 1 : 0;
+         memcpy(elem + r->offset, &index, sizeof(index));
+      }
+   }
+
+   // the level still plays if the file can't be written
+   if(!(f = fopen(lcachename, "wb")))
+      D_printf("P_SaveLevelCache: could not create %s\n", lcachename);
+   else
+   {
+      if(fwrite(data, 1, length, f) != length)
+      {
+         fclose(f);
+         remove(lcachename);
+         D_printf("P_SaveLevelCache: could not write %s\n", lcachename);
+      }
+      else
+         fclose(f);
+   }
+
+   free(data);
+   free(lcachename);
+   lcachename = NULL;
+}
+
+// EOF
+
@@ -1,6 +1,54 @@
+#include <stdlib.h>
 #include "doomdef.h"
 #include "p_local.h"
 
+// CALICO
+static slab_t flashslab  = { "flashes", sizeof(lightflash_t), PU_LEVSPEC };
+
+// CALICO: once spawned, a strobe or glow only ever changes its own sector's
+// light and draws no random numbers, so rather than each being dispatched as
+// a thinker, they are all updated in one pass straight after the thinkers.
+// Flashes stay thinkers, as their calls to P_Random have to stay in order
+// with those of the other thinkers.
+static strobe_t *strobes;
+static int       numstrobes, maxstrobes;
+static glow_t   *glows;
+static int       numglows, maxglows;
+
+static void *P_GrowLightEffects(void *effects, int *max, size_t size)
+{
+   int newmax = *max ? *max * 2 : 64;
+
+   if(!(effects = realloc(effects, newmax * size)))
+      I_Error("P_GrowLightEffects: no memory for %i lights", newmax);
+   *max = newmax;
+
+   return effects;
+}
+
+//
+// CALICO: drop the last level's strobes and glows
+//
+void P_ClearLightEffects(void)
+{
+   numstrobes = numglows = 0;
+}
+
+//
+// CALICO: run every strobe and glow for this tic. Glows are only spawned with
+// the level, so any strobe sharing a sector with one was spawned after it,
+// and updates it after it, as it did when both were thinkers.
+//
+void P_RunLightEffects(void)
+{
+   int i;
+
+   for(i = 0; i < numglows; i++)
+      T_Glow(&glows[i]);
+   for(i = 0; i < numstrobes; i++)
+      T_StrobeFlash(&strobes[i]);
+}
+
 /*================================================================== */
 /*================================================================== */
 /* */
@@ -47,7 +95,7 @@ void P_SpawnLightFlash(sector_t *sector)
 
    sector->special = 0; /* nothing special about it during gameplay */
 
-   flash = Z_Malloc(sizeof(*flash), PU_LEVSPEC, 0);
+   flash = Z_SlabAlloc(&flashslab);
    P_AddThinker (&flash->thinker);
    flash->thinker.function = T_LightFlash;
    flash->sector = sector;
@@ -100,12 +148,13 @@ void P_SpawnStrobeFlash(sector_t *sector,int fastOrSlow, int inSync)
 {
    strobe_t *flash;
 
-   flash = Z_Malloc(sizeof(*flash), PU_LEVSPEC, 0);
-   P_AddThinker (&flash->thinker);
+   // CALICO: add to the strobe array
+   if(numstrobes == maxstrobes)
+      strobes = P_GrowLightEffects(strobes, &maxstrobes, sizeof(*strobes));
+   flash = &strobes[numstrobes++];
    flash->sector = sector;
    flash->darktime = fastOrSlow;
    flash->brighttime = STROBEBRIGHT;
-   flash->thinker.function = T_StrobeFlash;
    flash->maxlight = sector->lightlevel;
    flash->minlight = P_FindMinSurroundingLight(sector, sector->lightlevel);
 		
@@ -152,25 +201,20 @@ void EV_TurnTagLightsOff(line_t	*line)
    int       min;
    sector_t *sector;
    sector_t *tsec;
-   line_t   *templine;
 
-   sector = sectors;
-   for(j = 0; j < numsectors; j++, sector++)
+   // CALICO: only visit the tagged sectors
+   j = -1;
+   while((j = P_FindSectorFromLineTag(line, j)) >= 0)
    {
-      if(sector->tag == line->tag)
+      sector = &sectors[j];
+      min = sector->lightlevel;
+      for(i = 0; i < sector->adjacentcount; i++)
       {
-         min = sector->lightlevel;
-         for(i = 0; i < sector->linecount; i++)
-         {
-            templine = sector->lines[i];
-            tsec = getNextSector(templine,sector);
-            if(!tsec)
-               continue;
-            if(tsec->lightlevel < min)
-               min = tsec->lightlevel;
-         }
-         sector->lightlevel = min;
+         tsec = sector->adjacent[i];
+         if(tsec->lightlevel < min)
+            min = tsec->lightlevel;
       }
+      sector->lightlevel = min;
    }
 }
 
@@ -185,32 +229,27 @@ void EV_LightTurnOn(line_t *line, int bright)
    int       j;
    sector_t *sector;
    sector_t *temp;
-   line_t   *templine;
 
-   sector = sectors;
-
-   for (i=0;i<numsectors;i++, sector++)
+   // CALICO: only visit the tagged sectors
+   i = -1;
+   while((i = P_FindSectorFromLineTag(line, i)) >= 0)
    {
-      if(sector->tag == line->tag)
+      sector = &sectors[i];
+
+      /* */
+      /* bright = 0 means to search for highest */
+      /* light level surrounding sector */
+      /* */
+      if(!bright)
       {
-         /* */
-         /* bright = 0 means to search for highest */
-         /* light level surrounding sector */
-         /* */
-         if(!bright)
+         for(j = 0; j < sector->adjacentcount; j++)
          {
-            for(j = 0; j < sector->linecount; j++)
-            {
-               templine = sector->lines[j];
-               temp = getNextSector(templine,sector);
-               if(!temp)
-                  continue;
-               if(temp->lightlevel > bright)
-                  bright = temp->lightlevel;
-            }
+            temp = sector->adjacent[j];
+            if(temp->lightlevel > bright)
+               bright = temp->lightlevel;
          }
-         sector->lightlevel = bright;
       }
+      sector->lightlevel = bright;
    }
 }
 
@@ -246,12 +285,13 @@ void P_SpawnGlowingLight(sector_t *sector)
 {
    glow_t *g;
 
-   g = Z_Malloc( sizeof(*g), PU_LEVSPEC, 0);
-   P_AddThinker(&g->thinker);
+   // CALICO: add to the glow array
+   if(numglows == maxglows)
+      glows = P_GrowLightEffects(glows, &maxglows, sizeof(*glows));
+   g = &glows[numglows++];
    g->sector = sector;
    g->minlight = P_FindMinSurroundingLight(sector,sector->lightlevel);
    g->maxlight = sector->lightlevel;
-   g->thinker.function = T_Glow;
    g->direction = -1;
 
    sector->special = 0;
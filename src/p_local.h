@@ -77,6 +77,8 @@ P_PSPR
 void P_SetupPsprites(player_t *curplayer);
 void P_MovePsprites(player_t *curplayer);
 void P_DropWeapon(player_t *player);
+void P_BuildSoundGraph(void);
+void P_SoundSectorChanged(sector_t *sector);
 
 /*
 ===============================================================================
@@ -87,6 +89,7 @@ P_USER
 */
 
 void P_PlayerThink (player_t *player);
+fixed_t P_PredictTurn(player_t *player, int buttons); // CALICO
 
 /*
 ===============================================================================
@@ -106,6 +109,7 @@ extern int activemobjs;    /* debug count */
 
 mobj_t *P_SpawnMobj(fixed_t x, fixed_t y, fixed_t z, mobjtype_t type);
 void    P_RemoveMobj(mobj_t *th);
+void    P_ReserveMobjs(int count);
 boolean P_SetMobjState(mobj_t *mobj, statenum_t state);
 void    P_MobjThinker(mobj_t *mobj);
 void    P_SpawnPuff(fixed_t x, fixed_t y, fixed_t z);
@@ -136,6 +140,23 @@ P_ENEMY
 
 void A_MissileExplode(mobj_t *mo);
 void A_SkullBash(mobj_t *mo);
+void P_InitChaseFlow(void);
+void P_ChaseFlowChanged(void);
+
+/*
+===============================================================================
+
+P_HASH
+
+===============================================================================
+*/
+
+void     P_InitStateHash(void);
+void     P_OpenStateHash(const char *writename, const char *checkname);
+boolean  P_StateHashDiverged(void);
+void     P_UpdateStateHash(void);
+uint32_t P_StateHash(void);
+void     P_EndStateHash(void);
 
 /*
 ===============================================================================
@@ -163,7 +184,45 @@ extern fixed_t lowfloor;
 void   P_LineOpening(line_t *linedef);
 
 boolean P_BlockLinesIterator(int x, int y, boolean(*func)(line_t*));
-boolean P_BlockThingsIterator(int x, int y, boolean(*func)(mobj_t*));
+void    P_UpdateLineOpening(line_t *ld);
+
+// CALICO: make ld->opentop, openbottom and lowfloor current for a two-sided
+// line. Writes the cache, so only for the playsim thread (not sight checks).
+static inline void P_CachedLineOpening(line_t *ld)
+{
+   if(ld->openfrontgen != ld->frontsector->heightgen || ld->openbackgen != ld->backsector->heightgen)
+      P_UpdateLineOpening(ld);
+}
+boolean P_BlockLinesIteratorBox(int x, int y, const fixed_t *box, boolean(*func)(line_t*, void*), void *data);
+boolean P_BoxLinesIterator(const fixed_t *box, boolean(*func)(line_t*, void*), void *data);
+boolean P_BoxLinesIteratorStamped(const fixed_t *box, boolean(*func)(line_t*, void*), void *data,
+                                  int *stamps, int stamp);
+void    P_BeginMoveQuery(const fixed_t *box);
+void    P_EndMoveQuery(void);
+boolean P_BlockThingsIterator(int x, int y, boolean(*func)(mobj_t*, void*), void *data);
+
+// CALICO: the state of one position check, formerly file-scope statics in
+// p_move.c and p_base.c. A check only reads the map, apart from the cached
+// line openings it brings up to date; P_CommitMove then links the thing
+// into the spot which was checked. A check with its own line stamps leaves
+// the cache and validcount alone, so it can be run off the playsim thread.
+typedef struct movecheck_s
+{
+   mobj_t      *thing;
+   fixed_t      x, y;                       // position being checked
+   int          flags;                      // thing->flags at the start
+   fixed_t      bbox[4];
+   subsector_t *newsubsec;                  // destination subsector
+   fixed_t      floorz, ceilingz, dropoffz; // dropoffz is the lowest point contacted
+   mobj_t      *hitthing;                   // skull/missile target, or special
+   line_t      *blockline;                  // possibly a special to activate
+   line_t      *ceilingline;                // line which lowered ceilingz last
+   int         *linestamps;                 // [numlines], or NULL to use validcount
+   int          stamp;                      // a fresh stamp for linestamps
+} movecheck_t;
+
+boolean P_CheckMovePosition(movecheck_t *mc);
+void    P_CommitMove(const movecheck_t *mc);
 
 extern divline_t trace;
 
@@ -189,15 +248,22 @@ extern mobj_t *movething;
 boolean P_CheckPosition(mobj_t *thing, fixed_t x, fixed_t y);
 boolean P_TryMove(mobj_t *thing, fixed_t x, fixed_t y);
 boolean P_CheckSight(mobj_t *t1, mobj_t *t2);
+void    P_InitSights(void);
 void    P_UseLines(player_t *player);
 
 boolean P_ChangeSector(sector_t *sector, boolean crunch);
+void    P_BuildSectorNeighbours(void);
 
 extern mobj_t *linetarget; /* who got hit (or NULL) */
 fixed_t P_AimLineAttack(mobj_t *t1, angle_t angle, fixed_t distance);
 
 void P_LineAttack(mobj_t *t1, angle_t angle, fixed_t distance, fixed_t slope, int damage);
 
+// CALICO: traces from t1 within spread of angle between these share one walk
+// of the BSP
+void P_BeginShotFan(mobj_t *t1, angle_t angle, angle_t spread, fixed_t distance);
+void P_EndShotFan(void);
+
 void P_RadiusAttack(mobj_t *spot, mobj_t *source, int damage);
 
 /*
@@ -208,13 +274,33 @@ P_SETUP
 ===============================================================================
 */
 
-extern byte     *rejectmatrix;          /* for fast sight rejection */
+extern const byte *rejectmatrix;        /* for fast sight rejection */
 extern short    *blockmaplump;          /* offsets in blockmap are from here */
 extern short    *blockmap;
 extern int       bmapwidth, bmapheight; /* in mapblocks */
 extern fixed_t   bmaporgx, bmaporgy;    /* origin of block map */
 extern mobj_t  **blocklinks;            /* for thing chains */
 
+// CALICO: the blockmap's line lists packed back to back at level load,
+// each entry carrying a copy of its line's bounding box
+typedef struct
+{
+   fixed_t  bbox[4];
+   line_t  *line;
+} blockline_t;
+
+extern blockline_t *blocklines;
+extern int         *blocklinefirst;     /* [bmapwidth*bmapheight+1] start of each block */
+
+void P_BuildBlockLines(void);
+
+// CALICO: processed level cache, for -levelcache
+boolean P_LoadLevelCache(int lumpnum);
+void    P_SaveLevelCache(void);
+
+// CALICO: cache-friendly node and seg order, for -reorderbsp
+void P_ReorderBSP(void);
+
 /*
 ===============================================================================
 
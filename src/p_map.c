@@ -281,6 +281,30 @@ mobj_t *bombsource;
 mobj_t *bombspot;
 int     bombdamage;
 
+// CALICO: things in range of the blast, in the order they are damaged
+#define MAXBOMBED 128
+
+typedef struct bombed_s
+{
+   mobj_t *thing;
+   int     damage;
+} bombed_t;
+
+static bombed_t bombed[MAXBOMBED];
+static int      numbombed;
+
+//
+// CALICO: hurt the things gathered by PIT_RadiusAttack
+//
+static void P_DamageBombed(void)
+{
+   int i, count = numbombed;
+
+   numbombed = 0;
+   for(i = 0; i < count; i++)
+      P_DamageMobj(bombed[i].thing, bombspot, bombsource, bombed[i].damage);
+}
+
 /*
 =================
 =
@@ -290,7 +314,7 @@ int     bombdamage;
 =================
 */
 
-boolean PIT_RadiusAttack (mobj_t *thing)
+boolean PIT_RadiusAttack (mobj_t *thing, void *data)
 {
    fixed_t dx, dy, dist;
 
@@ -306,7 +330,15 @@ boolean PIT_RadiusAttack (mobj_t *thing)
    if(dist >= bombdamage)
       return true;		/* out of range */
    /* FIXME?	if ( P_CheckSight (thing, bombspot) )	// must be in direct path */
-   P_DamageMobj(thing, bombspot, bombsource, bombdamage - dist);
+
+   // CALICO: damage is dealt once the blocks have been walked; it neither
+   // moves things nor changes whether any other is shootable, so they are
+   // hurt in the same order and by the same amounts as before
+   if(numbombed == MAXBOMBED)
+      P_DamageBombed();
+   bombed[numbombed].thing  = thing;
+   bombed[numbombed].damage = bombdamage - dist;
+   ++numbombed;
    return true;
 }
 
@@ -332,12 +364,24 @@ void P_RadiusAttack(mobj_t *spot, mobj_t *source, int damage)
    bombspot = spot;
    bombsource = source;
    bombdamage = damage;
-	
+
+   // CALICO: only walk the blocks which are in the map
+   if(xl < 0)
+      xl = 0;
+   if(yl < 0)
+      yl = 0;
+   if(xh >= bmapwidth)
+      xh = bmapwidth - 1;
+   if(yh >= bmapheight)
+      yh = bmapheight - 1;
+
+   numbombed = 0;
    for(y = yl; y <= yh; y++)
    {
       for(x = xl; x <= xh; x++)
-         P_BlockThingsIterator(x, y, PIT_RadiusAttack);
+         P_BlockThingsIterator(x, y, PIT_RadiusAttack, NULL);
    }
+   P_DamageBombed();
 }
 
 /*============================================================================ */
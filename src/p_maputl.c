@@ -123,13 +123,49 @@ void P_MakeDivline(line_t *li, divline_t *dl)
    dl->dy = li->dy;
 }
 
+/*
+==================
+=
+= P_UpdateLineOpening
+=
+= CALICO: work out the opening of a two-sided line from its sectors and
+= note their generations; see P_CachedLineOpening
+=
+==================
+*/
+
+void P_UpdateLineOpening(line_t *ld)
+{
+   sector_t *front = ld->frontsector;
+   sector_t *back  = ld->backsector;
+
+   if(front->ceilingheight < back->ceilingheight)
+      ld->opentop = front->ceilingheight;
+   else
+      ld->opentop = back->ceilingheight;
+
+   if(front->floorheight > back->floorheight)
+   {
+      ld->openbottom = front->floorheight;
+      ld->lowfloor   = back->floorheight;
+   }
+   else
+   {
+      ld->openbottom = back->floorheight;
+      ld->lowfloor   = front->floorheight;
+   }
+
+   ld->openfrontgen = front->heightgen;
+   ld->openbackgen  = back->heightgen;
+}
+
 /*
 ==================
 =
 = P_LineOpening
 =
 = Sets opentop and openbottom to the window through a two sided line
-= OPTIMIZE: keep this precalculated
+= CALICO: from the line's cached opening
 ==================
 */
 
@@ -138,8 +174,6 @@ fixed_t	lowfloor;
 
 void P_LineOpening (line_t *linedef)
 {
-   sector_t *front, *back;
-
    if(linedef->sidenum[1] == -1)
    {
       /* single sided line */
@@ -147,24 +181,10 @@ void P_LineOpening (line_t *linedef)
       return;
    }
 
-   front = linedef->frontsector;
-   back  = linedef->backsector;
-
-   if(front->ceilingheight < back->ceilingheight)
-      opentop = front->ceilingheight;
-   else
-      opentop = back->ceilingheight;
-
-   if(front->floorheight > back->floorheight)
-   {
-      openbottom = front->floorheight;
-      lowfloor   = back->floorheight;
-   }
-   else
-   {
-      openbottom = back->floorheight;
-      lowfloor   = front->floorheight;
-   }
+   P_CachedLineOpening(linedef);
+   opentop    = linedef->opentop;
+   openbottom = linedef->openbottom;
+   lowfloor   = linedef->lowfloor;
 
    openrange = opentop - openbottom;
 }
@@ -220,6 +240,29 @@ void P_UnsetThingPosition(mobj_t *thing)
    }
 }
 
+/*
+==================
+=
+= P_CommitMove
+=
+= CALICO: moves a thing to the spot a position check passed, taking the
+= floor and ceiling it found
+=
+==================
+*/
+
+void P_CommitMove(const movecheck_t *mc)
+{
+   mobj_t *thing = mc->thing;
+
+   P_UnsetThingPosition(thing);
+   thing->floorz   = mc->floorz;
+   thing->ceilingz = mc->ceilingz;
+   thing->x        = mc->x;
+   thing->y        = mc->y;
+   P_SetThingPosition(thing);
+}
+
 /*
 ===================
 =
@@ -241,7 +284,7 @@ void P_SetThingPosition(mobj_t *thing)
    /* */
    /* link into subsector */
    /* */
-   ss = R_PointInSubsector (thing->x,thing->y);
+   ss = R_PointInSubsectorHint(thing->x, thing->y, thing->subsector); // CALICO
    thing->subsector = ss;
    if(!(thing->flags & MF_NOSECTOR))
    {
@@ -304,19 +347,19 @@ If the function returns false, exit with false without checking anything else.
 
 boolean P_BlockLinesIterator(int x, int y, boolean(*func)(line_t*) )
 {
-   int     offset;
-   short  *list;
-   line_t *ld;
+   int          offset;
+   blockline_t *bl, *end;
+   line_t      *ld;
 
    if(x < 0 || y < 0 || x >= bmapwidth || y >= bmapheight)
       return true;
    offset = y*bmapwidth+x;
 
-   offset = *(blockmap+offset);
-
-   for(list = blockmaplump + offset; *list != -1; list++)
+   // CALICO: from the packed lists
+   end = blocklines + blocklinefirst[offset + 1];
+   for(bl = blocklines + blocklinefirst[offset]; bl != end; bl++)
    {
-      ld = &lines[*list];
+      ld = bl->line;
       if(ld->validcount == validcount)
          continue; /* line has already been checked */
       ld->validcount = validcount;
@@ -328,6 +371,263 @@ boolean P_BlockLinesIterator(int x, int y, boolean(*func)(line_t*) )
    return true; /* everything was checked */
 }
 
+// CALICO: lines gathered by P_BeginMoveQuery
+#define MAXQUERYBLOCKS 64
+#define MAXQUERYLINES  1024
+
+static boolean      queryactive;
+static fixed_t      querybox[4];
+static int          queryxl, queryyl, querywidth, queryheight;
+static int          queryfirst[MAXQUERYBLOCKS + 1];
+static blockline_t *querylines[MAXQUERYLINES];
+
+//
+// CALICO: true if a walk has passed ld already, marking it if not. A walk
+// with its own stamps uses them instead of line_t::validcount.
+//
+static inline boolean P_LinePassed(line_t *ld, int *stamps, int stamp)
+{
+   if(stamps)
+   {
+      int *mark = &stamps[ld - lines];
+
+      if(*mark == stamp)
+         return true;
+      *mark = stamp;
+      return false;
+   }
+
+   if(ld->validcount == validcount)
+      return true;
+   ld->validcount = validcount;
+   return false;
+}
+
+static boolean P_BlockLinesWalkBox(int x, int y, const fixed_t *box, boolean(*func)(line_t*, void*),
+                                   void *data, int *stamps, int stamp)
+{
+   int          offset;
+   blockline_t *bl, *end;
+   blockline_t **ql, **qend;
+   line_t      *ld;
+
+   if(x < 0 || y < 0 || x >= bmapwidth || y >= bmapheight)
+      return true;
+
+   // the move query already holds this block's lines which touch the box
+   if(queryactive &&
+      x >= queryxl && x < queryxl + querywidth &&
+      y >= queryyl && y < queryyl + queryheight &&
+      box[BOXLEFT  ] >= querybox[BOXLEFT  ] && box[BOXRIGHT] <= querybox[BOXRIGHT] &&
+      box[BOXBOTTOM] >= querybox[BOXBOTTOM] && box[BOXTOP  ] <= querybox[BOXTOP  ])
+   {
+      offset = (x - queryxl) * queryheight + (y - queryyl);
+      qend = querylines + queryfirst[offset + 1];
+      for(ql = querylines + queryfirst[offset]; ql != qend; ql++)
+      {
+         bl = *ql;
+         if(box[BOXRIGHT] < bl->bbox[BOXLEFT  ] || box[BOXLEFT  ] > bl->bbox[BOXRIGHT] ||
+            box[BOXTOP  ] < bl->bbox[BOXBOTTOM] || box[BOXBOTTOM] > bl->bbox[BOXTOP  ])
+            continue;
+
+         ld = bl->line;
+         if(P_LinePassed(ld, stamps, stamp))
+            continue;
+
+         if(!func(ld, data))
+            return false;
+      }
+      return true;
+   }
+
+   offset = y*bmapwidth+x;
+
+   end = blocklines + blocklinefirst[offset + 1];
+   for(bl = blocklines + blocklinefirst[offset]; bl != end; bl++)
+   {
+      if(box[BOXRIGHT] < bl->bbox[BOXLEFT  ] || box[BOXLEFT  ] > bl->bbox[BOXRIGHT] ||
+         box[BOXTOP  ] < bl->bbox[BOXBOTTOM] || box[BOXBOTTOM] > bl->bbox[BOXTOP  ])
+         continue;
+
+      ld = bl->line;
+      if(P_LinePassed(ld, stamps, stamp))
+         continue;
+
+      if(!func(ld, data))
+         return false;
+   }
+
+   return true;
+}
+
+/*
+==================
+=
+= P_BlockLinesIteratorBox
+=
+= CALICO: as P_BlockLinesIterator, but lines whose bounding boxes lie
+= wholly outside box are passed over from the packed copy. Only for
+= functions which would do nothing with such a line; they aren't marked
+= with validcount, which is safe because they are passed over the same
+= way in every other block. data is passed on to func.
+=
+==================
+*/
+
+boolean P_BlockLinesIteratorBox(int x, int y, const fixed_t *box, boolean(*func)(line_t*, void*), void *data)
+{
+   return P_BlockLinesWalkBox(x, y, box, func, data, NULL, 0);
+}
+
+static boolean P_BoxLinesWalk(const fixed_t *box, boolean(*func)(line_t*, void*), void *data,
+                              int *stamps, int stamp)
+{
+   int xl, xh, yl, yh, bx, by;
+
+   xl = (box[BOXLEFT  ] - bmaporgx) >> MAPBLOCKSHIFT;
+   xh = (box[BOXRIGHT ] - bmaporgx) >> MAPBLOCKSHIFT;
+   yl = (box[BOXBOTTOM] - bmaporgy) >> MAPBLOCKSHIFT;
+   yh = (box[BOXTOP   ] - bmaporgy) >> MAPBLOCKSHIFT;
+
+   if(xl < 0)
+      xl = 0;
+   if(yl < 0)
+      yl = 0;
+   if(xh >= bmapwidth)
+      xh = bmapwidth - 1;
+   if(yh >= bmapheight)
+      yh = bmapheight - 1;
+
+   if(!stamps)
+      ++validcount;
+
+   for(bx = xl; bx <= xh; bx++)
+   {
+      for(by = yl; by <= yh; by++)
+      {
+         if(!P_BlockLinesWalkBox(bx, by, box, func, data, stamps, stamp))
+            return false;
+      }
+   }
+
+   return true;
+}
+
+/*
+==================
+=
+= P_BoxLinesIterator
+=
+= CALICO: calls func once for each line near the box, in the same order as
+= walking its mapblocks with P_BlockLinesIteratorBox. Increments validcount
+= itself.
+=
+==================
+*/
+
+boolean P_BoxLinesIterator(const fixed_t *box, boolean(*func)(line_t*, void*), void *data)
+{
+   return P_BoxLinesWalk(box, func, data, NULL, 0);
+}
+
+/*
+==================
+=
+= P_BoxLinesIteratorStamped
+=
+= CALICO: as P_BoxLinesIterator, but lines are marked in stamps, one per
+= line, with a stamp the caller has not used before, so that walks can be
+= made off the playsim thread.
+=
+==================
+*/
+
+boolean P_BoxLinesIteratorStamped(const fixed_t *box, boolean(*func)(line_t*, void*), void *data,
+                                  int *stamps, int stamp)
+{
+   return P_BoxLinesWalk(box, func, data, stamps, stamp);
+}
+
+/*
+==================
+=
+= P_BeginMoveQuery
+=
+= CALICO: gathers the lines in each mapblock that touch box, which should
+= cover everything one mobj's movement will check this tic. Until
+= P_EndMoveQuery, P_BlockLinesIteratorBox walks these shorter lists for any
+= box inside it, visiting the same lines in the same order. Lines never
+= move, so nothing done during the movement can make the lists stale. If
+= the box is too big for the query, the full lists are used as before.
+=
+==================
+*/
+
+void P_BeginMoveQuery(const fixed_t *box)
+{
+   int          xl, xh, yl, yh, bx, by;
+   int          count, block;
+   blockline_t *bl, *end;
+
+   queryactive = false;
+
+   xl = (box[BOXLEFT  ] - bmaporgx) >> MAPBLOCKSHIFT;
+   xh = (box[BOXRIGHT ] - bmaporgx) >> MAPBLOCKSHIFT;
+   yl = (box[BOXBOTTOM] - bmaporgy) >> MAPBLOCKSHIFT;
+   yh = (box[BOXTOP   ] - bmaporgy) >> MAPBLOCKSHIFT;
+
+   if(xl < 0)
+      xl = 0;
+   if(yl < 0)
+      yl = 0;
+   if(xh >= bmapwidth)
+      xh = bmapwidth - 1;
+   if(yh >= bmapheight)
+      yh = bmapheight - 1;
+
+   if(xh < xl || yh < yl || (xh - xl + 1) * (yh - yl + 1) > MAXQUERYBLOCKS)
+      return;
+
+   count = 0;
+   block = 0;
+   for(bx = xl; bx <= xh; bx++)
+   {
+      for(by = yl; by <= yh; by++)
+      {
+         int offset = by*bmapwidth+bx;
+
+         queryfirst[block++] = count;
+
+         end = blocklines + blocklinefirst[offset + 1];
+         for(bl = blocklines + blocklinefirst[offset]; bl != end; bl++)
+         {
+            if(box[BOXRIGHT] < bl->bbox[BOXLEFT  ] || box[BOXLEFT  ] > bl->bbox[BOXRIGHT] ||
+               box[BOXTOP  ] < bl->bbox[BOXBOTTOM] || box[BOXBOTTOM] > bl->bbox[BOXTOP  ])
+               continue;
+            if(count == MAXQUERYLINES)
+               return;
+            querylines[count++] = bl;
+         }
+      }
+   }
+   queryfirst[block] = count;
+
+   querybox[BOXTOP   ] = box[BOXTOP   ];
+   querybox[BOXBOTTOM] = box[BOXBOTTOM];
+   querybox[BOXLEFT  ] = box[BOXLEFT  ];
+   querybox[BOXRIGHT ] = box[BOXRIGHT ];
+   queryxl     = xl;
+   queryyl     = yl;
+   querywidth  = xh - xl + 1;
+   queryheight = yh - yl + 1;
+   queryactive = true;
+}
+
+void P_EndMoveQuery(void)
+{
+   queryactive = false;
+}
+
 /*
 ==================
 =
@@ -336,7 +636,7 @@ boolean P_BlockLinesIterator(int x, int y, boolean(*func)(line_t*) )
 ==================
 */
 
-boolean P_BlockThingsIterator(int x, int y, boolean(*func)(mobj_t*))
+boolean P_BlockThingsIterator(int x, int y, boolean(*func)(mobj_t*, void*), void *data)
 {
    mobj_t *mobj;
 
@@ -345,8 +645,8 @@ boolean P_BlockThingsIterator(int x, int y, boolean(*func)(mobj_t*))
 
    for(mobj = blocklinks[y * bmapwidth + x]; mobj; mobj = mobj->bnext)
    {
-      if(!func(mobj))
-         return false;	
+      if(!func(mobj, data))
+         return false;
    }
 
    return true;
@@ -15,6 +15,17 @@ mapthing_t itemrespawnque[ITEMQUESIZE];
 int itemrespawntime[ITEMQUESIZE];
 int iquehead, iquetail;
 
+static slab_t mobjslab = { "mobjs", sizeof(mobj_t), PU_LEVEL }; // CALICO
+
+//
+// CALICO: take the mobjs for a level's things from the zone in one block,
+// so they are laid out in the order they are spawned
+//
+void P_ReserveMobjs(int count)
+{
+   Z_SlabReserve(&mobjslab, count);
+}
+
 //
 // Remove an mobj from the world sim.
 //
@@ -45,6 +56,9 @@ void P_RemoveMobj(mobj_t *mobj)
    P_SetTarget(&mobj->target,    NULL);
    P_SetTarget(&mobj->extramobj, NULL);
 
+   // CALICO: sounds stop following it
+   S_RemoveOrigin(mobj);
+
    // CALICO: do not unlink or free yet; set to deferred removal
    mobj->latecall = P_RemoveMobjDeferred;
 }
@@ -131,6 +145,10 @@ boolean P_SetMobjState(mobj_t *mobj, statenum_t state)
    mobj->sprite = st->sprite;
    mobj->frame  = st->frame;
 
+   // CALICO: have the next state's graphics loaded before they are drawn
+   if(streaming && st->nextstate != S_NULL)
+      R_PrefetchSprite(states[st->nextstate].sprite, states[st->nextstate].frame);
+
    if(st->action) // call action functions when the state is set
       st->action(mobj);	
 
@@ -155,6 +173,8 @@ void P_ExplodeMissile (mobj_t *mo)
       S_StartSound(mo, mo->info->deathsound);
 }
 
+static VINT spawncount; // CALICO: for P_SpawnMobj
+
 //
 // Allocate a new mobj_t, populate it with its initial state, attach it to its
 // proper position in the game world, and set it running.
@@ -165,7 +185,7 @@ mobj_t *P_SpawnMobj(fixed_t x, fixed_t y, fixed_t z, mobjtype_t type)
    state_t    *st;
    mobjinfo_t *info;
 
-   mobj = Z_Malloc(sizeof(*mobj), PU_LEVEL, NULL);
+   mobj = Z_SlabAlloc(&mobjslab);
 
    D_memset(mobj, 0, sizeof(*mobj));
    info = &mobjinfo[type];
@@ -179,6 +199,7 @@ mobj_t *P_SpawnMobj(fixed_t x, fixed_t y, fixed_t z, mobjtype_t type)
    mobj->flags = info->flags;
    mobj->health = info->spawnhealth;
    mobj->reactiontime = info->reactiontime;
+   mobj->lookcount = spawncount++; // CALICO: spreads out -staggerlook phases
 	
    // do not set the state with P_SetMobjState, because action routines can't
    // be called yet
@@ -200,6 +221,9 @@ mobj_t *P_SpawnMobj(fixed_t x, fixed_t y, fixed_t z, mobjtype_t type)
       mobj->z = mobj->ceilingz - mobj->info->height;
    else 
       mobj->z = z;
+
+   // CALICO: don't slide in from anywhere when drawn between tics
+   R_ResetMobjInterpolation(mobj);
   
    // link into the mobj list
    P_LinkMobj(mobj);
@@ -245,6 +269,8 @@ void P_SpawnPlayer(mapthing_t *mthing)
    p->extralight    = 0;
    p->fixedcolormap = 0;
    p->viewheight    = VIEWHEIGHT;
+   p->viewz         = mobj->z + VIEWHEIGHT; // CALICO: only the renderer reads this before the first think
+   R_ResetMobjInterpolation(mobj);
    P_SetupPsprites(p); // setup gun psprite
 	
    if(netgame == gt_deathmatch)
@@ -267,9 +293,12 @@ void P_SpawnMapThing(mapthing_t *mthing)
    // count deathmatch start positions
    if(mthing->type == 11)
    {
-      if(deathmatch_p < &deathmatchstarts[10])
+      // CALICO: only count the starts there is room for
+      if(deathmatch_p < &deathmatchstarts[MAXDMSTARTS])
+      {
          D_memcpy(deathmatch_p, mthing, sizeof(*mthing));
-      deathmatch_p++;
+         deathmatch_p++;
+      }
       return;
    }
 	
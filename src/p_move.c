@@ -34,65 +34,61 @@ extern mobj_t  *tmthing;
 extern fixed_t  tmx, tmy;
 extern boolean  checkposonly;
 
+// CALICO: results of the last P_TryMove2, copied out of its movecheck_t
 boolean  trymove2;   // result from P_TryMove2
 boolean  floatok;    // if true, move would be ok if within tmfloorz - tmceilingz
 fixed_t  tmfloorz;   // current floor z for P_TryMove2
 fixed_t  tmceilingz; // current ceiling z for P_TryMove2
+fixed_t  tmdropoffz; // lowest point contacted
 mobj_t  *movething;  // skull/missile target, or special
 line_t  *blockline;  // possibly a special to activate
 
-static fixed_t oldx, oldy;
-static fixed_t tmbbox[4];
-static int     tmflags;
-static fixed_t tmdropoffz; // lowest point contacted
-
-static subsector_t *newsubsec; // destination subsector
-
 //
 // Check a single mobj in one of the contacted blockmap cells.
 //
-boolean PIT_CheckThing(mobj_t *thing)
+static boolean PIT_CheckThing(mobj_t *thing, void *data)
 {
+   movecheck_t *mc = data;
    fixed_t blockdist;
    int     delta;
 
    if(!(thing->flags & (MF_SOLID|MF_SPECIAL|MF_SHOOTABLE)))
       return true;
 
-   blockdist = thing->radius + tmthing->radius;
+   blockdist = thing->radius + mc->thing->radius;
    
-   delta = thing->x - tmx;
+   delta = thing->x - mc->x;
    if(delta < 0)
       delta = -delta;
    if(delta >= blockdist)
       return true; // didn't hit it
 
-   delta = thing->y - tmy;
+   delta = thing->y - mc->y;
    if(delta < 0)
       delta = -delta;
    if(delta >= blockdist)
       return true; // didn't hit it
 
-   if(thing == tmthing)
+   if(thing == mc->thing)
       return true; // don't clip against self
 
    // check for skulls slamming into things
-   if(tmthing->flags & MF_SKULLFLY)
+   if(mc->thing->flags & MF_SKULLFLY)
    {
-      movething = thing;
+      mc->hitthing = thing;
       return false; // stop moving
    }
 
    // missiles can hit other things
-   if(tmthing->flags & MF_MISSILE)
+   if(mc->thing->flags & MF_MISSILE)
    {
-      if(tmthing->z > thing->z + thing->height)
+      if(mc->thing->z > thing->z + thing->height)
          return true; // went overhead
-      if(tmthing->z + tmthing->height < thing->z)
+      if(mc->thing->z + mc->thing->height < thing->z)
          return true; // went underneath
-      if(tmthing->target->type == thing->type) // don't hit same species as originator
+      if(mc->thing->target->type == thing->type) // don't hit same species as originator
       {
-         if(thing == tmthing->target) // don't hit originator
+         if(thing == mc->thing->target) // don't hit originator
             return true;
          if(thing->type != MT_PLAYER) // let players missile each other
             return false; // explode, but do no damage
@@ -101,14 +97,14 @@ boolean PIT_CheckThing(mobj_t *thing)
          return !(thing->flags & MF_SOLID); // didn't do any damage
 
       // damage/explode
-      movething = thing;
+      mc->hitthing = thing;
       return false; // don't traverse any more
    }
 
    // check for special pickup
-   if((thing->flags & MF_SPECIAL) && (tmflags & MF_PICKUP))
+   if((thing->flags & MF_SPECIAL) && (mc->flags & MF_PICKUP))
    {
-      movething = thing;
+      mc->hitthing = thing;
       return true;
    }
 
@@ -118,33 +114,33 @@ boolean PIT_CheckThing(mobj_t *thing)
 //
 // Check if the thing intersects a linedef
 //
-static boolean PM_BoxCrossLine(line_t *ld)
+static boolean PM_BoxCrossLine(movecheck_t *mc, line_t *ld)
 {
    fixed_t x1, x2, y1, y2;
    fixed_t lx, ly, ldx, ldy;
    fixed_t dx1, dx2, dy1, dy2;
    boolean side1, side2;
 
-   if(tmbbox[BOXRIGHT ] <= ld->bbox[BOXLEFT  ] ||
-      tmbbox[BOXLEFT  ] >= ld->bbox[BOXRIGHT ] ||
-      tmbbox[BOXTOP   ] <= ld->bbox[BOXBOTTOM] ||
-      tmbbox[BOXBOTTOM] >= ld->bbox[BOXTOP   ])
+   if(mc->bbox[BOXRIGHT ] <= ld->bbox[BOXLEFT  ] ||
+      mc->bbox[BOXLEFT  ] >= ld->bbox[BOXRIGHT ] ||
+      mc->bbox[BOXTOP   ] <= ld->bbox[BOXBOTTOM] ||
+      mc->bbox[BOXBOTTOM] >= ld->bbox[BOXTOP   ])
    {
       return false; // bounding boxes don't intersect
    }
 
-   y1 = tmbbox[BOXTOP   ];
-   y2 = tmbbox[BOXBOTTOM];
+   y1 = mc->bbox[BOXTOP   ];
+   y2 = mc->bbox[BOXBOTTOM];
 
    if(ld->slopetype == ST_POSITIVE)
    {
-      x1 = tmbbox[BOXLEFT ];
-      x2 = tmbbox[BOXRIGHT];
+      x1 = mc->bbox[BOXLEFT ];
+      x2 = mc->bbox[BOXRIGHT];
    }
    else
    {
-      x1 = tmbbox[BOXRIGHT];
-      x2 = tmbbox[BOXLEFT ];
+      x1 = mc->bbox[BOXRIGHT];
+      x2 = mc->bbox[BOXLEFT ];
    }
 
    lx  = ld->v1->x;
@@ -164,9 +160,32 @@ static boolean PM_BoxCrossLine(line_t *ld)
 }
 
 //
-// Adjusts tmfloorz and tmceilingz as lines are contacted.
+// CALICO: the opening of a two-sided line, as P_UpdateLineOpening works it
+// out, for checks off the playsim thread which mustn't write the cache
 //
-static boolean PIT_CheckLine(line_t *ld)
+static void PM_LineOpening(const line_t *ld, fixed_t *top, fixed_t *bottom, fixed_t *low)
+{
+   const sector_t *front = ld->frontsector;
+   const sector_t *back  = ld->backsector;
+
+   *top = (front->ceilingheight < back->ceilingheight) ? front->ceilingheight : back->ceilingheight;
+
+   if(front->floorheight > back->floorheight)
+   {
+      *bottom = front->floorheight;
+      *low    = back->floorheight;
+   }
+   else
+   {
+      *bottom = back->floorheight;
+      *low    = front->floorheight;
+   }
+}
+
+//
+// Adjusts mc->floorz and mc->ceilingz as lines are contacted.
+//
+static boolean PIT_CheckLine(movecheck_t *mc, line_t *ld)
 {
    fixed_t   opentop, openbottom, lowfloor;
    sector_t *front, *back;
@@ -176,11 +195,11 @@ static boolean PIT_CheckLine(line_t *ld)
    if(!ld->backsector)
       return false; // one-sided line
 
-   if(!(tmthing->flags & MF_MISSILE))
+   if(!(mc->thing->flags & MF_MISSILE))
    {
       if(ld->flags & ML_BLOCKING)
          return false; // explicitly blocking everything
-      if(!tmthing->player && (ld->flags & ML_BLOCKMONSTERS))
+      if(!mc->thing->player && (ld->flags & ML_BLOCKMONSTERS))
          return false; // block monsters only
    }
 
@@ -190,33 +209,27 @@ static boolean PIT_CheckLine(line_t *ld)
    if(front->ceilingheight == front->floorheight ||
       back->ceilingheight == back->floorheight)
    {
-      blockline = ld;
+      mc->blockline = ld;
       return false; // probably a closed door
    }
 
-   if(front->ceilingheight < back->ceilingheight)
-      opentop = front->ceilingheight;
-   else
-      opentop = back->ceilingheight;
-
-   if(front->floorheight > back->floorheight)
-   {
-      openbottom = front->floorheight;
-      lowfloor   = back->floorheight;
-   }
+   if(mc->linestamps)
+      PM_LineOpening(ld, &opentop, &openbottom, &lowfloor); // CALICO
    else
    {
-      openbottom = back->floorheight;
-      lowfloor   = front->floorheight;
+      P_CachedLineOpening(ld);
+      opentop    = ld->opentop;
+      openbottom = ld->openbottom;
+      lowfloor   = ld->lowfloor;
    }
 
    // adjust floor/ceiling heights
-   if(opentop < tmceilingz)
-      tmceilingz = opentop;
-   if(openbottom > tmfloorz)
-      tmfloorz = openbottom;
-   if(lowfloor < tmdropoffz)
-      tmdropoffz = lowfloor;
+   if(opentop < mc->ceilingz)
+      mc->ceilingz = opentop;
+   if(openbottom > mc->floorz)
+      mc->floorz = openbottom;
+   if(lowfloor < mc->dropoffz)
+      mc->dropoffz = lowfloor;
 
    return true;
 }
@@ -224,11 +237,13 @@ static boolean PIT_CheckLine(line_t *ld)
 //
 // Check a single linedef in a blockmap cell.
 //
-static boolean PM_CrossCheck(line_t *ld)
+static boolean PM_CrossCheck(line_t *ld, void *data)
 {
-   if(PM_BoxCrossLine(ld))
+   movecheck_t *mc = data;
+
+   if(PM_BoxCrossLine(mc, ld))
    {
-      if(!PIT_CheckLine(ld))
+      if(!PIT_CheckLine(mc, ld))
          return false;
    }
    return true;
@@ -237,43 +252,38 @@ static boolean PM_CrossCheck(line_t *ld)
 //
 // This is purely informative, nothing is modified (except things picked up)
 //
-static void PM_CheckPosition()
+static boolean PM_CheckPosition(movecheck_t *mc)
 {
    int xl, xh, yl, yh, bx, by;
 
-   tmflags = tmthing->flags;
+   mc->flags = mc->thing->flags;
 
-   tmbbox[BOXTOP   ] = tmy + tmthing->radius;
-   tmbbox[BOXBOTTOM] = tmy - tmthing->radius;
-   tmbbox[BOXRIGHT ] = tmx + tmthing->radius;
-   tmbbox[BOXLEFT  ] = tmx - tmthing->radius;
+   mc->bbox[BOXTOP   ] = mc->y + mc->thing->radius;
+   mc->bbox[BOXBOTTOM] = mc->y - mc->thing->radius;
+   mc->bbox[BOXRIGHT ] = mc->x + mc->thing->radius;
+   mc->bbox[BOXLEFT  ] = mc->x - mc->thing->radius;
 
-   newsubsec = R_PointInSubsector(tmx, tmy);
+   mc->newsubsec = R_PointInSubsectorHint(mc->x, mc->y, mc->thing->subsector); // CALICO
 
    // the base floor/ceiling is from the subsector that contains the point.
    // Any contacted lines the step closer together will adjust them.
-   tmfloorz   = tmdropoffz = newsubsec->sector->floorheight;
-   tmceilingz = newsubsec->sector->ceilingheight;
-
-   ++validcount;
+   mc->floorz   = mc->dropoffz = mc->newsubsec->sector->floorheight;
+   mc->ceilingz = mc->newsubsec->sector->ceilingheight;
 
-   movething = NULL;
-   blockline = NULL;
+   mc->hitthing  = NULL;
+   mc->blockline = NULL;
 
-   if(tmflags & MF_NOCLIP) // thing has no clipping?
-   {
-      trymove2 = true;
-      return;
-   }
+   if(mc->flags & MF_NOCLIP) // thing has no clipping?
+      return true;
 
    // Check things first, possibly picking things up.
    // The bounding box is extended by MAXRADIUS because mobj_ts are grouped
    // into mapblocks based on their origin point, and can overlap into adjacent
    // blocks by up to MAXRADIUS units.
-   xl = (tmbbox[BOXLEFT  ] - bmaporgx - MAXRADIUS) >> MAPBLOCKSHIFT;
-   xh = (tmbbox[BOXRIGHT ] - bmaporgx + MAXRADIUS) >> MAPBLOCKSHIFT;
-   yl = (tmbbox[BOXBOTTOM] - bmaporgy - MAXRADIUS) >> MAPBLOCKSHIFT;
-   yh = (tmbbox[BOXTOP   ] - bmaporgy + MAXRADIUS) >> MAPBLOCKSHIFT;
+   xl = (mc->bbox[BOXLEFT  ] - bmaporgx - MAXRADIUS) >> MAPBLOCKSHIFT;
+   xh = (mc->bbox[BOXRIGHT ] - bmaporgx + MAXRADIUS) >> MAPBLOCKSHIFT;
+   yl = (mc->bbox[BOXBOTTOM] - bmaporgy - MAXRADIUS) >> MAPBLOCKSHIFT;
+   yh = (mc->bbox[BOXTOP   ] - bmaporgy + MAXRADIUS) >> MAPBLOCKSHIFT;
 
    if(xl < 0)
       xl = 0;
@@ -289,42 +299,56 @@ static void PM_CheckPosition()
    {
       for(by = yl; by <= yh; by++)
       {
-         if(!P_BlockThingsIterator(bx, by, PIT_CheckThing))
-         {
-            trymove2 = false;
-            return;
-         }
+         if(!P_BlockThingsIterator(bx, by, PIT_CheckThing, mc))
+            return false;
       }
    }
 
    // check lines
-   xl = (tmbbox[BOXLEFT  ] - bmaporgx) >> MAPBLOCKSHIFT;
-   xh = (tmbbox[BOXRIGHT ] - bmaporgx) >> MAPBLOCKSHIFT;
-   yl = (tmbbox[BOXBOTTOM] - bmaporgy) >> MAPBLOCKSHIFT;
-   yh = (tmbbox[BOXTOP   ] - bmaporgy) >> MAPBLOCKSHIFT;
-
-   if(xl < 0)
-      xl = 0;
-   if(yl < 0)
-      yl = 0;
-   if(xh >= bmapwidth)
-      xh = bmapwidth - 1;
-   if(yh >= bmapheight)
-      yh = bmapheight - 1;
-
-   for(bx = xl; bx <= xh; bx++)
+   if(mc->linestamps)
    {
-      for(by = yl; by <= yh; by++)
-      {
-         if(!P_BlockLinesIterator(bx, by, PM_CrossCheck))
-         {
-            trymove2 = false;
-            return;
-         }
-      }
+      if(!P_BoxLinesIteratorStamped(mc->bbox, PM_CrossCheck, mc, mc->linestamps, mc->stamp))
+         return false;
    }
+   else if(!P_BoxLinesIterator(mc->bbox, PM_CrossCheck, mc))
+      return false;
 
-   trymove2 = true;
+   return true;
+}
+
+//
+// CALICO: check mc->thing at mc->x, mc->y as P_CheckPosition does, but
+// without the P_TryMove2 globals
+//
+boolean P_CheckMovePosition(movecheck_t *mc)
+{
+   return PM_CheckPosition(mc);
+}
+
+//
+// CALICO: true if a thing which passed PM_CheckPosition fits in the space
+// that was found, setting *fits if it would with a change of height alone
+//
+static boolean PM_CheckFit(const movecheck_t *mc, boolean *fits)
+{
+   mobj_t *thing = mc->thing;
+
+   *fits = false;
+
+   if(thing->flags & MF_NOCLIP)
+      return true;
+
+   if(mc->ceilingz - mc->floorz < thing->height)
+      return false; // doesn't fit
+   *fits = true;
+   if(!(thing->flags & MF_TELEPORT) && mc->ceilingz - thing->z < thing->height)
+      return false; // mobj must lower itself to fit
+   if(!(thing->flags & MF_TELEPORT) && mc->floorz - thing->z > 24*FRACUNIT)
+      return false; // too big a step up
+   if(!(thing->flags & (MF_DROPOFF|MF_FLOAT)) && mc->floorz - mc->dropoffz > 24*FRACUNIT)
+      return false; // don't stand over a dropoff
+
+   return true;
 }
 
 //
@@ -333,47 +357,29 @@ static void PM_CheckPosition()
 //
 void P_TryMove2(void)
 {
-   trymove2 = false;
-   floatok  = false;
+   movecheck_t mc;
+   boolean     ok;
 
-   oldx = tmthing->x;
-   oldy = tmthing->y;
+   mc.thing      = tmthing;
+   mc.x          = tmx;
+   mc.y          = tmy;
+   mc.linestamps = NULL;
 
-   PM_CheckPosition();
+   ok       = PM_CheckPosition(&mc);
+   floatok  = false;
 
    if(checkposonly)
-   {
       checkposonly = false;
-      return;
-   }
-
-   if(!trymove2)
-      return;
-
-   if(!(tmthing->flags & MF_NOCLIP))
-   {
-      trymove2 = false;
-
-      if(tmceilingz - tmfloorz < tmthing->height)
-         return; // doesn't fit
-      floatok = true;
-      if(!(tmthing->flags & MF_TELEPORT) && tmceilingz - tmthing->z < tmthing->height)
-         return; // mobj must lower itself to fit
-      if(!(tmthing->flags & MF_TELEPORT) && tmfloorz - tmthing->z > 24*FRACUNIT)
-         return; // too big a step up
-      if(!(tmthing->flags & (MF_DROPOFF|MF_FLOAT)) && tmfloorz - tmdropoffz > 24*FRACUNIT)
-         return; // don't stand over a dropoff
-   }
-
-   // the move is ok, so link the thing into its new position.
-   P_UnsetThingPosition(tmthing);
-   tmthing->floorz   = tmfloorz;
-   tmthing->ceilingz = tmceilingz;
-   tmthing->x        = tmx;
-   tmthing->y        = tmy;
-   P_SetThingPosition(tmthing);
-
-   trymove2 = true;
+   else if(ok && (ok = PM_CheckFit(&mc, &floatok)))
+      P_CommitMove(&mc); // the move is ok, so link the thing into its new position
+
+   // CALICO: hand the results back
+   trymove2   = ok;
+   tmfloorz   = mc.floorz;
+   tmceilingz = mc.ceilingz;
+   tmdropoffz = mc.dropoffz;
+   movething  = mc.hitthing;
+   blockline  = mc.blockline;
 }
 
 // EOF
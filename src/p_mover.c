@@ -0,0 +1,500 @@
+/*
+  CALICO
+
+  Sector mover batches
+
+  With -moverthreads, each run of floor, ceiling, door and plat thinkers
+  met in P_RunThinkers is split into batches of movers whose sectors are
+  too far apart for the things they move to touch the same lines or
+  things. A batch is shared out in jobs, and then committed in thinker
+  order. A mover in a batch may only
+  change its own sector, its own thinker and the heights of things in
+  reach of it; its sounds, active list removal and sound flood and chase
+  flow changes are held back until the commit. A mover which would
+  gib, remove or crush a thing, or otherwise do more than that, is put
+  back as it was and run again on the main thread when the commit reaches
+  it, so the level comes out exactly as a serial pass would leave it and
+  demos stay in sync. -moverthreads 0 selects one share per logical CPU.
+
+  The MIT License (MIT)
+
+  Copyright (c) 2016 James Haley
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "doomdef.h"
+#include "hal/hal_thread.h"
+#include "m_argv.h"
+#include "m_jobs.h"
+#include "m_thread.h"
+#include "p_local.h"
+
+#define MAXMOVERTHREADS 8
+#define MAXBATCHMOVERS  256
+#define MAXMOVERSOUNDS  4    // a mover starts two at most in one tic
+#define MAXMOVERCLIPS   1024 // things re-clipped by one worker in a batch
+
+typedef union moversave_u
+{
+   floormove_t floor;
+   ceiling_t   ceiling;
+   vldoor_t    door;
+   plat_t      plat;
+} moversave_t;
+
+// a thing's heights before a mover re-clipped it
+typedef struct moverclip_s
+{
+   mobj_t  *thing;
+   fixed_t  floorz, ceilingz, z;
+} moverclip_t;
+
+typedef struct moverjob_s
+{
+   thinker_t   *thinker;
+   think_t      function; // at the start of the batch
+   sector_t    *sector;
+   int          box[4];   // blockbox widened by movermargin
+
+   // the mover and its sector as they were, to put back
+   moversave_t  saved;
+   size_t       size;
+   fixed_t      floorheight, ceilingheight;
+   VINT         floorpic, special;
+   void        *specialdata;
+   int          firstclip, numclips; // in its worker's clips
+
+   // held back for the commit
+   mobj_t      *soundorigins[MAXMOVERSOUNDS];
+   int          sounds[MAXMOVERSOUNDS];
+   int          numsounds;
+   boolean      removeactive; // P_RemoveActiveCeiling or P_RemoveActivePlat
+   boolean      changed;      // P_ChangeSector was called
+   boolean      serial;       // has to be run again in order
+} moverjob_t;
+
+typedef struct moverworker_s
+{
+   int                num;
+   moverjob_t        *job;       // being run
+   int               *linestamps;
+   int                numstamps; // size of linestamps
+   int                stamp;
+   moverclip_t        clips[MAXMOVERCLIPS];
+   int                numclips;
+} moverworker_t;
+
+static moverworker_t moverworkers[MAXMOVERTHREADS];
+static int           nummoverthreads; // 0 if batches are off
+static int           movermargin;     // in mapblocks
+
+static moverjob_t    batch[MAXBATCHMOVERS];
+static int           batchsize;
+
+// the share running on this thread, if it is in a batch
+static THREADLOCAL moverworker_t *moverworker;
+
+//
+// The sector a thinker moves, if it is a mover which can be batched
+//
+static sector_t *MB_MoverSector(thinker_t *thinker, size_t *size)
+{
+   if(thinker->function == (think_t)T_MoveFloor)
+   {
+      *size = sizeof(floormove_t);
+      return ((floormove_t *)thinker)->sector;
+   }
+   if(thinker->function == (think_t)T_MoveCeiling)
+   {
+      *size = sizeof(ceiling_t);
+      return ((ceiling_t *)thinker)->sector;
+   }
+   if(thinker->function == (think_t)T_VerticalDoor)
+   {
+      *size = sizeof(vldoor_t);
+      return ((vldoor_t *)thinker)->sector;
+   }
+   if(thinker->function == (think_t)T_PlatRaise)
+   {
+      *size = sizeof(plat_t);
+      return ((plat_t *)thinker)->sector;
+   }
+
+   return NULL;
+}
+
+//
+// Run a range of the batch's movers
+//
+static void MB_RunShare(moverworker_t *worker)
+{
+   int i;
+
+   moverworker = worker;
+
+   for(i = worker->num; i < batchsize; i += nummoverthreads)
+   {
+      moverjob_t *job = &batch[i];
+
+      D_memcpy(&job->saved, job->thinker, job->size);
+      job->floorheight   = job->sector->floorheight;
+      job->ceilingheight = job->sector->ceilingheight;
+      job->floorpic      = job->sector->floorpic;
+      job->special       = job->sector->special;
+      job->specialdata   = job->sector->specialdata;
+      job->firstclip     = worker->numclips;
+      job->numsounds     = 0;
+      job->removeactive  = false;
+      job->changed       = false;
+      job->serial        = false;
+
+      worker->job = job;
+      job->function(job->thinker);
+      job->numclips = worker->numclips - job->firstclip;
+   }
+
+   worker->job = NULL;
+   moverworker = NULL;
+}
+
+static void MB_MoverJob(void *data, int index)
+{
+   MB_RunShare(&moverworkers[index]);
+}
+
+//
+// Turn on mover batches if -moverthreads was given
+//
+void P_InitMovers(void)
+{
+   int i, p, count, reach;
+   int maxradius = 0;
+
+   if(!(p = M_GetArgParameters("-moverthreads", 1)))
+      return;
+
+   count = atoi(myargv[p]);
+   if(count <= 0)
+      count = hal_threads.getCPUCount ? hal_threads.getCPUCount() : 1;
+   if(count > MAXMOVERTHREADS)
+      count = MAXMOVERTHREADS;
+
+   // a re-clipped thing is linked in a block its mover's change visits,
+   // and its position check reaches radius + MAXRADIUS further; two movers
+   // are kept apart by twice the margin, which must cover that
+   for(i = 0; i < NUMMOBJTYPES; i++)
+   {
+      if(mobjinfo[i].radius > maxradius)
+         maxradius = mobjinfo[i].radius;
+   }
+   reach       = (maxradius + MAXRADIUS + MAPBLOCKSIZE - 1) >> MAPBLOCKSHIFT;
+   movermargin = (reach + 1) / 2;
+
+   // no more shares than the job pool can run at once
+   nummoverthreads = emin(count, M_ReserveJobThreads(count));
+   for(i = 0; i < nummoverthreads; i++)
+      moverworkers[i].num = i;
+   D_printf("P_InitMovers: %i\n", nummoverthreads);
+}
+
+//
+// How many thinkers from the start of run are movers which can be batched;
+// always 0 without -moverthreads
+//
+int P_MoverRunLength(thinker_t **run, int count)
+{
+   size_t size;
+   int    i;
+
+   if(!nummoverthreads)
+      return 0;
+
+   for(i = 0; i < count; i++)
+   {
+      if(!MB_MoverSector(run[i], &size))
+         break;
+   }
+
+   return i;
+}
+
+//
+// Make sure every worker has line stamps for the current level. Stamps left
+// from an earlier level are always behind the worker's current stamp.
+//
+static void MB_ReserveStamps(void)
+{
+   int i;
+
+   for(i = 0; i < nummoverthreads; i++)
+   {
+      moverworker_t *worker = &moverworkers[i];
+
+      if(worker->numstamps >= numlines)
+         continue;
+
+      free(worker->linestamps);
+      if(!(worker->linestamps = calloc(numlines, sizeof(int))))
+         I_Error("MB_ReserveStamps: no memory for %i lines", numlines);
+      worker->numstamps = numlines;
+      worker->stamp     = 0;
+   }
+}
+
+//
+// Put a mover, its sector and the things it re-clipped back as they were
+//
+static void MB_Restore(moverjob_t *job)
+{
+   moverworker_t *worker = &moverworkers[(job - batch) % nummoverthreads];
+   int i;
+
+   // newest first, for things clipped more than once
+   for(i = job->firstclip + job->numclips - 1; i >= job->firstclip; i--)
+   {
+      moverclip_t *clip = &worker->clips[i];
+
+      clip->thing->floorz   = clip->floorz;
+      clip->thing->ceilingz = clip->ceilingz;
+      clip->thing->z        = clip->z;
+   }
+
+   D_memcpy(job->thinker, &job->saved, job->size);
+   job->sector->floorheight   = job->floorheight;
+   job->sector->ceilingheight = job->ceilingheight;
+   job->sector->floorpic      = job->floorpic;
+   job->sector->special       = job->special;
+   job->sector->specialdata   = job->specialdata;
+}
+
+//
+// Do what a mover held back, or run it again if it has to be
+//
+static void MB_Commit(moverjob_t *job)
+{
+   int i;
+
+   if(job->serial)
+   {
+      MB_Restore(job);
+      job->function(job->thinker);
+      return;
+   }
+
+   for(i = 0; i < job->numsounds; i++)
+      S_StartSound(job->soundorigins[i], job->sounds[i]);
+
+   if(job->removeactive)
+   {
+      if(job->function == (think_t)T_MoveCeiling)
+         P_RemoveActiveCeiling((ceiling_t *)job->thinker);
+      else
+         P_RemoveActivePlat((plat_t *)job->thinker);
+   }
+
+   if(job->changed)
+   {
+      P_SoundSectorChanged(job->sector);
+      P_ChaseFlowChanged();
+   }
+}
+
+//
+// Run the gathered batch across the mover threads and commit it in order
+//
+static void MB_RunBatch(void)
+{
+   int i;
+
+   if(batchsize == 1)
+      batch[0].function(batch[0].thinker); // nothing to run alongside
+   else if(batchsize > 1)
+   {
+      MB_ReserveStamps();
+
+      for(i = 0; i < nummoverthreads; i++)
+         moverworkers[i].numclips = 0;
+
+      M_RunJobs("movers", MB_MoverJob, NULL, nummoverthreads);
+
+      for(i = 0; i < batchsize; i++)
+         MB_Commit(&batch[i]);
+   }
+
+   batchsize = 0;
+}
+
+//
+// True if a mover's widened box overlaps any already in the batch
+//
+static boolean MB_Overlaps(const int *box)
+{
+   int i;
+
+   for(i = 0; i < batchsize; i++)
+   {
+      const int *other = batch[i].box;
+
+      if(box[BOXLEFT  ] <= other[BOXRIGHT] && box[BOXRIGHT] >= other[BOXLEFT  ] &&
+         box[BOXBOTTOM] <= other[BOXTOP  ] && box[BOXTOP  ] >= other[BOXBOTTOM])
+         return true;
+   }
+
+   return false;
+}
+
+//
+// Run a run of movers counted by P_MoverRunLength, as batches, in order
+//
+void P_RunMoverBatches(thinker_t **run, int count)
+{
+   int i;
+
+   batchsize = 0;
+
+   for(i = 0; i < count; i++)
+   {
+      moverjob_t *job;
+      sector_t   *sector;
+      size_t      size;
+      int         box[4];
+
+      sector = MB_MoverSector(run[i], &size);
+      box[BOXLEFT  ] = sector->blockbox[BOXLEFT  ] - movermargin;
+      box[BOXRIGHT ] = sector->blockbox[BOXRIGHT ] + movermargin;
+      box[BOXBOTTOM] = sector->blockbox[BOXBOTTOM] - movermargin;
+      box[BOXTOP   ] = sector->blockbox[BOXTOP   ] + movermargin;
+
+      if(batchsize == MAXBATCHMOVERS || MB_Overlaps(box))
+         MB_RunBatch();
+
+      job = &batch[batchsize++];
+      job->thinker  = run[i];
+      job->function = run[i]->function;
+      job->sector   = sector;
+      job->size     = size;
+      D_memcpy(job->box, box, sizeof(box));
+   }
+
+   MB_RunBatch();
+}
+
+//
+// True on a thread running a mover in a batch
+//
+boolean P_InMoverBatch(void)
+{
+   return moverworker != NULL;
+}
+
+//
+// Keep a thing's heights so its mover can be put back, then check its
+// position with the worker's line stamps. False once the mover has to be
+// run again in order, when nothing more should be done to it.
+//
+boolean P_MoverCheckThing(mobj_t *thing, movecheck_t *mc)
+{
+   moverworker_t *worker = moverworker;
+   moverclip_t   *clip;
+
+   if(worker->job->serial)
+      return false;
+
+   if(worker->numclips == MAXMOVERCLIPS)
+   {
+      worker->job->serial = true;
+      return false;
+   }
+
+   clip = &worker->clips[worker->numclips++];
+   clip->thing    = thing;
+   clip->floorz   = thing->floorz;
+   clip->ceilingz = thing->ceilingz;
+   clip->z        = thing->z;
+
+   mc->thing      = thing;
+   mc->x          = thing->x;
+   mc->y          = thing->y;
+   mc->linestamps = worker->linestamps;
+   mc->stamp      = ++worker->stamp;
+   P_CheckMovePosition(mc);
+
+   return true;
+}
+
+//
+// The mover's sector changed height; its sound lines and the chase flow
+// are brought up to date by the commit
+//
+void P_MoverSectorChanged(void)
+{
+   moverworker->job->changed = true;
+}
+
+//
+// The mover has to be run again in order
+//
+void P_SerializeMover(void)
+{
+   moverworker->job->serial = true;
+}
+
+//
+// True if the caller is a mover in a batch, whose active list entry will
+// be removed by the commit instead
+//
+boolean P_DeferMoverRemoval(void)
+{
+   if(!moverworker)
+      return false;
+
+   moverworker->job->removeactive = true;
+   return true;
+}
+
+//
+// Start a mover's sound, or hold it for the commit in a batch
+//
+void P_MoverSound(mobj_t *origin, int sound_id)
+{
+   moverjob_t *job;
+
+   if(!moverworker)
+   {
+      S_StartSound(origin, sound_id);
+      return;
+   }
+
+   job = moverworker->job;
+   if(job->numsounds == MAXMOVERSOUNDS)
+   {
+      job->serial = true;
+      return;
+   }
+
+   job->soundorigins[job->numsounds] = origin;
+   job->sounds[job->numsounds]       = sound_id;
+   ++job->numsounds;
+}
+
+// EOF
+
@@ -11,6 +11,8 @@
 
 plat_t *activeplats[MAXPLATS];
 
+static slab_t platslab = { "plats", sizeof(plat_t), PU_LEVSPEC }; // CALICO
+
 /*================================================================== */
 /* */
 /* Move a plat up and down */
@@ -28,20 +30,20 @@ void T_PlatRaise(plat_t	*plat)
       if(plat->type == raiseAndChange || plat->type == raiseToNearestAndChange)
       {
          if(!(gametic&7))
-            S_StartSound((mobj_t *)&plat->sector->soundorg,sfx_stnmov);
+            P_MoverSound((mobj_t *)&plat->sector->soundorg,sfx_stnmov);
       }
 
       if(res == crushed && (!plat->crush))
       {
          plat->count = plat->wait;
          plat->status = down;
-         S_StartSound((mobj_t *)&plat->sector->soundorg,sfx_pstart);
+         P_MoverSound((mobj_t *)&plat->sector->soundorg,sfx_pstart);
       }
       else if (res == pastdest)
       {
          plat->count = plat->wait;
          plat->status = waiting;
-         S_StartSound((mobj_t *)&plat->sector->soundorg,sfx_pstop);
+         P_MoverSound((mobj_t *)&plat->sector->soundorg,sfx_pstop);
          switch(plat->type)
          {
          case downWaitUpStay:
@@ -61,7 +63,7 @@ void T_PlatRaise(plat_t	*plat)
       {
          plat->count = plat->wait;
          plat->status = waiting;
-         S_StartSound((mobj_t *)&plat->sector->soundorg,sfx_pstop);
+         P_MoverSound((mobj_t *)&plat->sector->soundorg,sfx_pstop);
       }
       break;
    case	waiting:
@@ -71,7 +73,7 @@ void T_PlatRaise(plat_t	*plat)
             plat->status = up;
          else
             plat->status = down;
-         S_StartSound((mobj_t *)&plat->sector->soundorg,sfx_pstart);
+         P_MoverSound((mobj_t *)&plat->sector->soundorg,sfx_pstart);
       }
       break;
    case	in_stasis:
@@ -117,7 +119,7 @@ int EV_DoPlat(line_t *line,plattype_e type,int amount)
       /* Find lowest & highest floors around sector */
       /* */
       rtn = 1;
-      plat = Z_Malloc( sizeof(*plat), PU_LEVSPEC, 0);
+      plat = Z_SlabAlloc(&platslab);
       P_AddThinker(&plat->thinker);
 
       plat->type = type;
@@ -222,6 +224,10 @@ void P_AddActivePlat(plat_t *plat)
 void P_RemoveActivePlat(plat_t *plat)
 {
    int i;
+
+   // CALICO: removed when its mover batch is committed
+   if(P_DeferMoverRemoval())
+      return;
    for(i = 0; i < MAXPLATS; i++)
    {
       if(plat == activeplats[i])
@@ -26,43 +26,188 @@ mobj_t   *soundtarget;
 sector_t *na_sec;
 int       na_secnum;
 
+// CALICO: sectors waiting to be flooded, one slot per sector
+static sector_t **soundqueue;
+
+/*
+=================
+=
+= P_SoundLineOpen
+=
+= Sound passes a two-sided line unless it is closed like a shut door
+=
+=================
+*/
+
+static boolean P_SoundLineOpen(line_t *line)
+{
+   sector_t *front = line->frontsector;
+   sector_t *back  = line->backsector;
+
+   return !(front->floorheight >= back->ceilingheight || front->ceilingheight <= back->floorheight);
+}
+
+/*
+=================
+=
+= P_BuildSoundGraph
+=
+= CALICO: gather each sector's two-sided lines into a compact edge list at
+= level load, so a flood never touches one-sided lines or works out which
+= side it came from.
+=
+=================
+*/
+
+void P_BuildSoundGraph(void)
+{
+   int          i, j, total;
+   sector_t    *sector;
+   line_t      *li;
+   soundedge_t *edge;
+
+   total = 0;
+   li = lines;
+   for(i = 0; i < numlines; i++, li++)
+   {
+      if(li->backsector && li->backsector != li->frontsector)
+         total += 2;
+      if(li->backsector)
+         li->soundopen = P_SoundLineOpen(li);
+   }
+
+   edge = Z_Malloc(total * sizeof(soundedge_t) + 4, PU_LEVEL, 0);
+   soundqueue = Z_Malloc(numsectors * sizeof(sector_t *) + 4, PU_LEVEL, 0);
+
+   sector = sectors;
+   for(i = 0; i < numsectors; i++, sector++)
+   {
+      sector->soundedges     = edge;
+      sector->soundedgecount = 0;
+      for(j = 0; j < sector->linecount; j++)
+      {
+         li = sector->lines[j];
+         if(!li->backsector || li->backsector == li->frontsector)
+            continue; // single sided, or leads back here
+         edge->line  = li;
+         edge->other = (li->frontsector == sector) ? li->backsector : li->frontsector;
+         ++edge;
+         ++sector->soundedgecount;
+      }
+   }
+}
+
+/*
+=================
+=
+= P_SoundSectorChanged
+=
+= CALICO: called when a sector's heights change. Noise only needs to be
+= reflooded when one of its lines opened or closed; other players'
+= floods can overwrite a sector's soundtarget in the meantime, though, so
+= netgames always reflood as the original did.
+=
+=================
+*/
+
+void P_SoundSectorChanged(sector_t *sector)
+{
+   int          i;
+   boolean      changed = (netgame != gt_single);
+   soundedge_t *edge    = sector->soundedges;
+
+   for(i = 0; i < sector->soundedgecount; i++, edge++)
+   {
+      VINT open = P_SoundLineOpen(edge->line);
+      if(edge->line->soundopen != open)
+      {
+         edge->line->soundopen = open;
+         changed = true;
+      }
+   }
+
+   if(changed)
+   {
+      for(i = 0; i < MAXPLAYERS; i++)
+         players[i].lastsoundsector = NULL;
+   }
+}
+
+/*
+=================
+=
+= P_RecursiveSound
+=
+= CALICO: a breadth-first flood over the sound graph. The sectors
+= reachable without crossing a sound-blocking line are found first, then
+= those one blocking line further, which leaves every sector marked the
+= same as the original recursion did.
+=
+=================
+*/
+
+static void P_MarkSound(sector_t *sec, int soundblocks, int *tail)
+{
+   sec->validcount     = validcount;
+   sec->soundtraversed = soundblocks+1;
+   sec->soundtarget    = soundtarget;
+   soundqueue[(*tail)++] = sec;
+}
+
 void P_RecursiveSound(sector_t *sec, int soundblocks)
 {
-   int       i;
-   line_t   *check;
-   sector_t *other;
-   sector_t *front, *back;
+   int          i, head, tail, firstblocked;
+   soundedge_t *edge;
 
    na_sec    = sec; /* DEBUG */
    na_secnum = sec-sectors;
 
-   /* wake up all monsters in this sector */
-   if(sec->validcount == validcount && sec->soundtraversed <= soundblocks+1)
-      return;		/* already flooded */
-   sec->validcount = validcount;
-   sec->soundtraversed = soundblocks+1;
-   sec->soundtarget = soundtarget;
-	
-   for(i = 0; i < sec->linecount; i++)
+   head = tail = 0;
+   P_MarkSound(sec, soundblocks, &tail);
+
+   // pass 1 floods through open lines without sound blocking
+   while(head < tail)
    {
-      check = sec->lines[i];
-      back  = check->backsector;
-      if(!back)
-         continue; /* single sided */
-      front = check->frontsector;
-      if(front->floorheight >= back->ceilingheight || front->ceilingheight <= back->floorheight)
-         continue; /* closed door */
-      if(front == sec)
-         other = back;
-      else
-         other = front;
-      if(check->flags & ML_SOUNDBLOCK)
+      sec  = soundqueue[head++];
+      edge = sec->soundedges;
+      for(i = 0; i < sec->soundedgecount; i++, edge++)
       {
-         if(!soundblocks)
-            P_RecursiveSound(other, 1);
+         if(edge->other->validcount == validcount || (edge->line->flags & ML_SOUNDBLOCK))
+            continue;
+         if(P_SoundLineOpen(edge->line))
+            P_MarkSound(edge->other, soundblocks, &tail);
+      }
+   }
+
+   if(soundblocks)
+      return; // can't cross a blocking line twice
+
+   // pass 2 crosses one blocking line out of the pass 1 sectors, then
+   // floods on through unblocked lines from there
+   firstblocked = tail;
+   for(head = 0; head < firstblocked; head++)
+   {
+      sec  = soundqueue[head];
+      edge = sec->soundedges;
+      for(i = 0; i < sec->soundedgecount; i++, edge++)
+      {
+         if(edge->other->validcount == validcount || !(edge->line->flags & ML_SOUNDBLOCK))
+            continue;
+         if(P_SoundLineOpen(edge->line))
+            P_MarkSound(edge->other, 1, &tail);
+      }
+   }
+   while(head < tail)
+   {
+      sec  = soundqueue[head++];
+      edge = sec->soundedges;
+      for(i = 0; i < sec->soundedgecount; i++, edge++)
+      {
+         if(edge->other->validcount == validcount || (edge->line->flags & ML_SOUNDBLOCK))
+            continue;
+         if(P_SoundLineOpen(edge->line))
+            P_MarkSound(edge->other, 1, &tail);
       }
-      else
-         P_RecursiveSound(other, soundblocks);
    }
 }
 
@@ -662,6 +807,9 @@ void A_FireShotgun (player_t *player, pspdef_t *psp)
    player->ammo[weaponinfo[player->readyweapon].ammo]--;
    P_SetPsprite(player,ps_flash,weaponinfo[player->readyweapon].flashstate);
 
+   // CALICO: the aim and every pellet lie within 255<<18 of the player's angle
+   P_BeginShotFan(player->mo, player->mo->angle, 255<<18, MISSILERANGE);
+
    slope = P_AimLineAttack (player->mo, player->mo->angle, MISSILERANGE);
 
    /* shotgun pellets all go at a fixed slope */
@@ -672,6 +820,8 @@ void A_FireShotgun (player_t *player, pspdef_t *psp)
       angle += P_SubRandom()<<18;
       P_LineAttack(player->mo, angle, MISSILERANGE, slope, damage);
    }
+
+   P_EndShotFan();
 }
 
 /* 
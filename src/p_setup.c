@@ -1,6 +1,8 @@
 /* P_main.c */
 
 #include "doomdef.h"
+#include "m_argv.h"
+#include "m_prof.h"
 #include "p_local.h"
 
 void P_SpawnMapThing(mapthing_t *mthing);
@@ -20,12 +22,14 @@ line_t      *lines;
 int          numsides;
 side_t      *sides;
 short       *blockmaplump; // offsets in blockmap are from here
+blockline_t *blocklines;     // CALICO: packed line lists
+int         *blocklinefirst;
 short       *blockmap;
 int          bmapwidth, bmapheight; // in mapblocks
 fixed_t      bmaporgx, bmaporgy;    // origin of block map
 mobj_t     **blocklinks;            // for thing chains
-byte        *rejectmatrix;          // for fast sight rejection
-mapthing_t   deathmatchstarts[10], *deathmatch_p;
+const byte  *rejectmatrix;          // for fast sight rejection
+mapthing_t   deathmatchstarts[MAXDMSTARTS], *deathmatch_p;
 mapthing_t   playerstarts[MAXPLAYERS];
 
 /*
@@ -38,15 +42,14 @@ mapthing_t   playerstarts[MAXPLAYERS];
 
 void P_LoadVertexes(int lump)
 {
-   byte        *data;
+   const byte  *data;
    int          i;
    mapvertex_t *ml;
    vertex_t    *li;
 
    numvertexes = W_LumpLength(lump) / sizeof(mapvertex_t);
    vertexes    = Z_Malloc(numvertexes * sizeof(vertex_t), PU_LEVEL, 0);
-   data = I_TempBuffer();
-   W_ReadLump(lump, data);
+   data = W_LumpData(lump, I_TempBuffer()); // CALICO: used in place if possible
    
    ml = (mapvertex_t *)data;
    li = vertexes;
@@ -67,18 +70,17 @@ void P_LoadVertexes(int lump)
 
 void P_LoadSegs(int lump)
 {
-   byte     *data;
-   int       i;
-   mapseg_t *ml;
-   seg_t    *li;
-   line_t   *ldef;
-   int       linedef, side;
+   const byte *data;
+   int         i;
+   mapseg_t   *ml;
+   seg_t      *li;
+   line_t     *ldef;
+   int         linedef, side;
 
    numsegs = W_LumpLength(lump) / sizeof(mapseg_t);
    segs    = Z_Malloc(numsegs * sizeof(seg_t), PU_LEVEL, 0);
    D_memset(segs, 0, numsegs * sizeof(seg_t));
-   data = I_TempBuffer();
-   W_ReadLump(lump, data);
+   data = W_LumpData(lump, I_TempBuffer()); // CALICO: used in place if possible
 
    ml = (mapseg_t *)data;
    li = segs;
@@ -117,15 +119,14 @@ void P_LoadSegs(int lump)
 
 void P_LoadSubsectors(int lump)
 {
-   byte *data;
+   const byte *data;
    int   i;
    mapsubsector_t *ms;
    subsector_t    *ss;
 
    numsubsectors = W_LumpLength(lump) / sizeof(mapsubsector_t);
    subsectors    = Z_Malloc(numsubsectors * sizeof(subsector_t), PU_LEVEL, 0);
-   data = I_TempBuffer();
-   W_ReadLump(lump, data);
+   data = W_LumpData(lump, I_TempBuffer()); // CALICO: used in place if possible
 
    ms = (mapsubsector_t *)data;
    D_memset (subsectors,0, numsubsectors * sizeof(subsector_t));
@@ -147,7 +148,7 @@ void P_LoadSubsectors(int lump)
 
 void P_LoadSectors(int lump)
 {
-   byte *data;
+   const byte *data;
    int   i;
    mapsector_t *ms;
    sector_t    *ss;
@@ -155,8 +156,7 @@ void P_LoadSectors(int lump)
    numsectors = W_LumpLength(lump) / sizeof(mapsector_t);
    sectors    = Z_Malloc(numsectors * sizeof(sector_t), PU_LEVEL, 0);
    D_memset(sectors, 0, numsectors * sizeof(sector_t));
-   data = I_TempBuffer();
-   W_ReadLump(lump, data);
+   data = W_LumpData(lump, I_TempBuffer()); // CALICO: used in place if possible
 
    ms = (mapsector_t *)data;
    ss = sectors;
@@ -191,15 +191,14 @@ void P_LoadSectors(int lump)
 
 void P_LoadNodes(int lump)
 {
-   byte *data;
+   const byte *data;
    int   i, j, k;
    mapnode_t *mn;
    node_t    *no;
 
    numnodes = W_LumpLength(lump) / sizeof(mapnode_t);
    nodes    = Z_Malloc(numnodes * sizeof(node_t), PU_LEVEL, 0);
-   data     = I_TempBuffer();
-   W_ReadLump(lump, data);
+   data     = W_LumpData(lump, I_TempBuffer()); // CALICO: used in place if possible
 
    mn = (mapnode_t *)data;
    no = nodes;
@@ -238,6 +237,9 @@ void P_LoadThings(int lump)
    W_ReadLump(lump, data);
    numthings = W_LumpLength(lump) / sizeof(mapthing_t);
 
+   // CALICO: room for all of them at once, and the deathmatch players
+   P_ReserveMobjs(numthings + MAXPLAYERS);
+
    mt = (mapthing_t *)data;
    for(i = 0; i < numthings; i++, mt++)
    {
@@ -261,7 +263,7 @@ void P_LoadThings(int lump)
 
 void P_LoadLineDefs(int lump)
 {
-   byte *data;
+   const byte *data;
    int   i;
    maplinedef_t *mld;
    line_t       *ld;
@@ -270,8 +272,7 @@ void P_LoadLineDefs(int lump)
    numlines = W_LumpLength(lump) / sizeof(maplinedef_t);
    lines    = Z_Malloc(numlines * sizeof(line_t), PU_LEVEL, 0);
    D_memset(lines, 0, numlines * sizeof(line_t));
-   data     = I_TempBuffer();
-   W_ReadLump(lump, data);
+   data     = W_LumpData(lump, I_TempBuffer()); // CALICO: used in place if possible
 
    mld = (maplinedef_t *)data;
    ld = lines;
@@ -331,6 +332,8 @@ void P_LoadLineDefs(int lump)
          ld->backsector = sides[ld->sidenum[1]].sector;
       else
          ld->backsector = 0;
+
+      ld->openfrontgen = ld->openbackgen = -1; // CALICO: no opening cached yet
    }
 }
 
@@ -344,7 +347,7 @@ void P_LoadLineDefs(int lump)
 
 void P_LoadSideDefs(int lump)
 {
-   byte *data;
+   const byte *data;
    int   i;
    mapsidedef_t *msd;
    side_t       *sd;
@@ -355,8 +358,7 @@ void P_LoadSideDefs(int lump)
    numsides = W_LumpLength(lump) / sizeof(mapsidedef_t);
    sides    = Z_Malloc(numsides * sizeof(side_t), PU_LEVEL, 0);
    D_memset(sides, 0, numsides * sizeof(side_t));
-   data     = I_TempBuffer();
-   W_ReadLump(lump, data);
+   data     = W_LumpData(lump, I_TempBuffer()); // CALICO: used in place if possible
 
    msd = (mapsidedef_t *)data;
    sd  = sides;
@@ -386,13 +388,18 @@ void P_LoadSideDefs(int lump)
 void P_LoadBlockMap(int lump)
 {
    int count;
+#ifdef __BIG_ENDIAN__
    int i;
+#endif
 
    blockmaplump = W_CacheLumpNum(lump, PU_LEVEL);
    blockmap = blockmaplump + 4;
+#ifdef __BIG_ENDIAN__
    count = W_LumpLength(lump) / 2;
    for(i = 0; i < count; i++)
       blockmaplump[i] = LITTLESHORT(blockmaplump[i]);
+#endif
+   // CALICO: little-endian hosts use the lump as it is
 
    bmaporgx   = blockmaplump[0] << FRACBITS;
    bmaporgy   = blockmaplump[1] << FRACBITS;
@@ -405,6 +412,63 @@ void P_LoadBlockMap(int lump)
    D_memset(blocklinks, 0, count);
 }
 
+//
+// CALICO: offsets and line numbers in the lump are read unsigned, which
+// gives larger maps than the Jaguar's twice the room
+//
+static unsigned short *P_BlockList(int block)
+{
+   return (unsigned short *)blockmaplump + (unsigned short)blockmap[block];
+}
+
+/*
+=================
+=
+= P_BuildBlockLines
+=
+= CALICO: copy every block's line list out of the lump into one array,
+= with each line's bounding box alongside so the iterators can reject
+= lines without touching the line_t. Needs the lines loaded.
+=
+= Nothing else reads the lump's lists.
+=
+=================
+*/
+
+void P_BuildBlockLines(void)
+{
+   int             i, numblocks, total;
+   unsigned short *list;
+   blockline_t    *bl;
+
+   numblocks = bmapwidth * bmapheight;
+   blocklinefirst = Z_Malloc((numblocks + 1) * sizeof(int), PU_LEVEL, 0);
+
+   total = 0;
+   for(i = 0; i < numblocks; i++)
+   {
+      for(list = P_BlockList(i); *list != 0xffff; list++)
+      {
+         if(*list >= numlines)
+            I_Error("P_BuildBlockLines: bad line %d in block %d", *list, i);
+         ++total;
+      }
+   }
+
+   blocklines = Z_Malloc(total * sizeof(blockline_t) + 4, PU_LEVEL, 0);
+   bl = blocklines;
+   for(i = 0; i < numblocks; i++)
+   {
+      blocklinefirst[i] = bl - blocklines;
+      for(list = P_BlockList(i); *list != 0xffff; list++, bl++)
+      {
+         bl->line = &lines[*list];
+         D_memcpy(bl->bbox, bl->line->bbox, sizeof(bl->bbox));
+      }
+   }
+   blocklinefirst[numblocks] = total;
+}
+
 /*
 =================
 =
@@ -418,13 +482,14 @@ void P_LoadBlockMap(int lump)
 void P_GroupLines(void)
 {
    line_t      **linebuffer;
-   int           i, j, total;
+   int           i, total;
    sector_t     *sector;
    subsector_t  *ss;
    seg_t        *seg;
    int           block;
    line_t       *li;
-   fixed_t       bbox[4];
+   fixed_t     (*bboxes)[4];
+   fixed_t      *bbox;
 
    // look up sector number for each subsector
    ss = subsectors;
@@ -449,24 +514,40 @@ void P_GroupLines(void)
    }
 
    // build line tables for each sector
-   linebuffer = Z_Malloc(total * 4, PU_LEVEL, 0);
+   // CALICO: in one pass over the lines rather than one per sector; the
+   // tables fill in line order as before
+   linebuffer = Z_Malloc(total * sizeof(line_t *), PU_LEVEL, 0);
+   bboxes     = Z_Malloc(numsectors * sizeof(*bboxes) + 4, PU_STATIC, 0);
    sector = sectors;
    for(i = 0; i < numsectors; i++, sector++)
    {
-      M_ClearBox(bbox);
       sector->lines = linebuffer;
-      li = lines;
-      for(j = 0; j < numlines; j++, li++)
+      linebuffer += sector->linecount;
+      sector->linecount = 0;
+      M_ClearBox(bboxes[i]);
+   }
+
+   li = lines;
+   for(i = 0; i < numlines; i++, li++)
+   {
+      sector = li->frontsector;
+      sector->lines[sector->linecount++] = li;
+      M_AddToBox(bboxes[sector - sectors], li->v1->x, li->v1->y);
+      M_AddToBox(bboxes[sector - sectors], li->v2->x, li->v2->y);
+
+      if(li->backsector && li->backsector != li->frontsector)
       {
-         if(li->frontsector == sector || li->backsector == sector)
-         {
-            *linebuffer++ = li;
-            M_AddToBox(bbox, li->v1->x, li->v1->y);
-            M_AddToBox(bbox, li->v2->x, li->v2->y);
-         }
+         sector = li->backsector;
+         sector->lines[sector->linecount++] = li;
+         M_AddToBox(bboxes[sector - sectors], li->v1->x, li->v1->y);
+         M_AddToBox(bboxes[sector - sectors], li->v2->x, li->v2->y);
       }
-      if(linebuffer - sector->lines != sector->linecount)
-         I_Error("P_GroupLines: miscounted");
+   }
+
+   sector = sectors;
+   for(i = 0; i < numsectors; i++, sector++)
+   {
+      bbox = bboxes[i];
 
       // set the degenmobj_t to the middle of the bounding box
       sector->soundorg.x = (bbox[BOXRIGHT] + bbox[BOXLEFT  ]) / 2;
@@ -489,6 +570,8 @@ void P_GroupLines(void)
       block = block < 0 ? 0 : block;
       sector->blockbox[BOXLEFT] = block;
    }
+
+   Z_Free(bboxes);
 }
 
 //=============================================================================
@@ -527,6 +610,10 @@ void P_SetupLevel(int map, skill_t skill)
    int          lumpnum;
    mobj_t      *mobj;
    extern int   cy;
+   unsigned int setupstart, start; // CALICO: for -profile
+   boolean      cached;
+
+   setupstart = M_ProfStart();
 
    M_ClearRandom();
 
@@ -539,11 +626,13 @@ void P_SetupLevel(int map, skill_t skill)
       players[i].killcount = players[i].secretcount = players[i].itemcount = 0;
 
    Z_CheckHeap(mainzone);
-   Z_CheckHeap(refzone);
+   R_PrintCacheStats(); // CALICO
+   Z_PrintZoneStats(mainzone); // CALICO
 
    Z_FreeTags(mainzone);
 
    P_InitThinkers();
+   P_ClearLightEffects(); // CALICO
 
    //
    // look for a regular (development) map first
@@ -558,21 +647,72 @@ void P_SetupLevel(int map, skill_t skill)
    lumpnum = W_GetNumForName(lumpname);
 
    // note: most of this ordering is important
+   start = M_ProfStart();
    P_LoadBlockMap(lumpnum+ML_BLOCKMAP);
-   P_LoadVertexes(lumpnum+ML_VERTEXES);
-   P_LoadSectors(lumpnum+ML_SECTORS);
-   P_LoadSideDefs(lumpnum+ML_SIDEDEFS);
-   P_LoadLineDefs(lumpnum+ML_LINEDEFS);
-   P_LoadSubsectors(lumpnum+ML_SSECTORS);
-   P_LoadNodes(lumpnum+ML_NODES);
-   P_LoadSegs(lumpnum+ML_SEGS);
+   M_ProfEnd(PROF_LOADBLOCKMAP, start);
+
+   // CALICO: everything up to P_GroupLines may come from the level cache
+   start = M_ProfStart();
+   cached = P_LoadLevelCache(lumpnum);
+   M_ProfEnd(PROF_LOADLEVELCACHE, start);
 
-   rejectmatrix = W_CacheLumpNum(lumpnum + ML_REJECT, PU_LEVEL);
+   if(!cached)
+   {
+      start = M_ProfStart();
+      P_LoadVertexes(lumpnum+ML_VERTEXES);
+      M_ProfEnd(PROF_LOADVERTEXES, start);
 
-   P_GroupLines();
+      start = M_ProfStart();
+      P_LoadSectors(lumpnum+ML_SECTORS);
+      M_ProfEnd(PROF_LOADSECTORS, start);
+
+      start = M_ProfStart();
+      P_LoadSideDefs(lumpnum+ML_SIDEDEFS);
+      M_ProfEnd(PROF_LOADSIDEDEFS, start);
+
+      start = M_ProfStart();
+      P_LoadLineDefs(lumpnum+ML_LINEDEFS);
+      M_ProfEnd(PROF_LOADLINEDEFS, start);
+
+      start = M_ProfStart();
+      P_LoadSubsectors(lumpnum+ML_SSECTORS);
+      M_ProfEnd(PROF_LOADSUBSECTORS, start);
+
+      start = M_ProfStart();
+      P_LoadNodes(lumpnum+ML_NODES);
+      M_ProfEnd(PROF_LOADNODES, start);
+
+      start = M_ProfStart();
+      P_LoadSegs(lumpnum+ML_SEGS);
+      M_ProfEnd(PROF_LOADSEGS, start);
+
+      start = M_ProfStart();
+      P_GroupLines();
+      M_ProfEnd(PROF_GROUPLINES, start);
+
+      P_SaveLevelCache();
+   }
+
+   P_ReorderBSP(); // CALICO
+
+   rejectmatrix = W_CacheLumpNumConst(lumpnum + ML_REJECT, PU_LEVEL); // CALICO
+   R_InitPVS(); // CALICO
+
+   start = M_ProfStart();
+   P_BuildBlockLines(); // CALICO
+   P_BuildSoundGraph(); // CALICO
+   P_BuildSectorNeighbours(); // CALICO
+   P_InitTagLists(); // CALICO
+   P_BuildAdjacentSectors(); // CALICO
+   P_InitChaseFlow(); // CALICO
+   R_InitSubsectorHulls(); // CALICO
+   M_ProfEnd(PROF_BUILDGRAPHS, start);
 
    deathmatch_p = deathmatchstarts;
+   start = M_ProfStart();
    P_LoadThings(lumpnum + ML_THINGS);
+   P_InitTeleportDests(); // CALICO
+   M_ProfEnd(PROF_LOADTHINGS, start);
 
    //
    // if deathmatch, randomly spawn the active players
@@ -596,10 +736,77 @@ void P_SetupLevel(int map, skill_t skill)
    P_SpawnSpecials();
    ST_InitEveryLevel();
 
+   // CALICO: decode the level's graphics now rather than during play
+   W_BeginWorkingSet(lumpnum);
+   if(!M_FindArgument("-noprecache"))
+      R_PrecacheLevel();
+   R_PinAnimations(); // CALICO: keep every frame of animated flats
+
    cy = 4;
 
    iquehead = iquetail = 0;
    gamepaused = false;
+
+   M_ProfEnd(PROF_SETUP, setupstart);
+}
+
+//
+// CALICO: start streaming in what a map will need while something else is on
+// screen, such as the intermission before it, so that R_PrecacheLevel finds
+// it already loaded. That is the map's working set, if it has one, and then
+// the graphics its sides and sectors name. The level itself is built into
+// the zone and the playsim's globals, which only the main thread may touch,
+// so that is still left to P_SetupLevel.
+//
+void P_PreloadLevel(int map)
+{
+   char               lumpname[8];
+   int                lumpnum, i, j, count;
+   const mapsidedef_t *msd;
+   const mapsector_t  *ms;
+
+   if(!W_CanStream() || M_FindArgument("-noprecache"))
+      return;
+
+   lumpname[0] = 'M';
+   lumpname[1] = 'A';
+   lumpname[2] = 'P';
+   lumpname[3] = '0' + map / 10;
+   lumpname[4] = '0' + map % 10;
+   lumpname[5] = 0;
+
+   if((lumpnum = W_CheckNumForName(lumpname)) == -1)
+      return;
+
+   W_PreloadWorkingSet(lumpnum);
+
+   count = W_LumpLength(lumpnum + ML_SIDEDEFS) / sizeof(mapsidedef_t);
+   msd   = W_LumpData(lumpnum + ML_SIDEDEFS, I_TempBuffer());
+   for(i = 0; i < count; i++, msd++)
+   {
+      const char *names[3] = { msd->toptexture, msd->bottomtexture, msd->midtexture };
+
+      for(j = 0; j < 3; j++)
+      {
+         int tex = R_CheckTextureNumForName(names[j]);
+
+         if(tex > 0 && textures[tex].lumpnum != -1)
+            W_QueuePrefetch(WS_GRAPHIC, textures[tex].lumpnum);
+      }
+   }
+
+   count = W_LumpLength(lumpnum + ML_SECTORS) / sizeof(mapsector_t);
+   ms    = W_LumpData(lumpnum + ML_SECTORS, I_TempBuffer());
+   for(i = 0; i < count; i++, ms++)
+   {
+      int flat;
+
+      if((flat = R_CheckFlatNumForName(ms->floorpic)) != -1)
+         W_QueuePrefetch(WS_GRAPHIC, firstflat + flat);
+      if(D_strncasecmp(ms->ceilingpic, "F_SKY1", 6) &&
+         (flat = R_CheckFlatNumForName(ms->ceilingpic)) != -1)
+         W_QueuePrefetch(WS_GRAPHIC, firstflat + flat);
+   }
 }
 
 /*
@@ -614,6 +821,9 @@ void P_Init(void)
 {
    P_InitSwitchList();
    P_InitPicAnims();
+   P_InitSights(); // CALICO
+   P_InitMovers(); // CALICO
+   P_InitStateHash(); // CALICO
    pausepic = W_CacheLumpName("PAUSED", PU_STATIC);
 }
 
@@ -26,6 +26,7 @@
   SOFTWARE.
 */
 
+#include <stdint.h>
 #include "doomdef.h"
 #include "p_local.h"
 
@@ -47,15 +48,49 @@ fixed_t  shootx, shooty, shootz; // location for puff/blood
 // tracing.  If no thing is targeted along the entire range, the first line
 // that blocks the midpoint of the shootdiv will be hit.
 
-static fixed_t   aimmidslope;              // for detecting first wall hit
-static divline_t shootdiv;
-static fixed_t   shootx2, shooty2;
-static fixed_t   firstlinefrac;
-static int       shootdivpositive;
-static int       ssx1, ssy1, ssx2, ssy2;
+// CALICO: removed type punning by bringing back intercept_t
+typedef struct intercept_s
+{
+   union ptr_u
+   {
+      mobj_t  *mo;
+      line_t  *line;
+   } d;
+   fixed_t frac;
+   boolean isaline;
+} intercept_t;
 
-static line_t thingline;
-static vertex_t tv1, tv2;
+//
+// CALICO: the state of one line attack, formerly file-scope statics, as
+// sighttrace_t is for sight checks. P_Shoot2 copies the attack into one of
+// these and its results back out, so that nothing but line validcounts is
+// shared between traces.
+//
+typedef struct shottrace_s
+{
+   // the attack
+   mobj_t     *shooter;
+   angle_t     attackangle;
+   fixed_t     attackrange;
+   fixed_t     aimtopslope, aimbottomslope; // narrowed as openings are passed
+
+   // the trace
+   fixed_t     aimmidslope;                 // for detecting first wall hit
+   divline_t   shootdiv;
+   fixed_t     shootx2, shooty2;
+   fixed_t     firstlinefrac;
+   int         shootdivpositive;
+   int         ssx1, ssy1, ssx2, ssy2;
+   line_t      thingline;
+   vertex_t    tv1, tv2;
+   intercept_t old_intercept;
+
+   // what it hit
+   line_t     *shootline;
+   mobj_t     *shootmobj;
+   fixed_t     shootslope;
+   fixed_t     shootx, shooty, shootz;
+} shottrace_t;
 
 //
 // First checks the endpoints of the line to make sure that they cross the
@@ -65,7 +100,7 @@ static vertex_t tv1, tv2;
 // the intersection occurs at.  If 0 < intercept < 1.0, the line will block
 // the sight.
 //
-static fixed_t PA_SightCrossLine(line_t *line)
+static fixed_t PA_SightCrossLine(shottrace_t *tr, line_t *line)
 {
    fixed_t s1, s2;
    fixed_t p1x, p1y, p2x, p2y, p3x, p3y, p4x, p4y, dx, dy, ndx, ndy;
@@ -77,10 +112,10 @@ static fixed_t PA_SightCrossLine(line_t *line)
    p2y = line->v2->y / FRACUNIT;
 
    // p3, p4 are sight endpoints
-   p3x = ssx1;
-   p3y = ssy1;
-   p4x = ssx2;
-   p4y = ssy2;
+   p3x = tr->ssx1;
+   p3y = tr->ssy1;
+   p4x = tr->ssx2;
+   p4y = tr->ssy2;
 
    dx  = p2x - p3x;
    dy  = p2y - p3y;
@@ -110,82 +145,58 @@ static fixed_t PA_SightCrossLine(line_t *line)
    return FixedDiv(s1, (s1 + s2));
 }
 
-// CALICO: removed type punning by bringing back intercept_t
-typedef struct intercept_s
-{
-   union ptr_u
-   {
-      mobj_t  *mo;
-      line_t  *line;
-   } d;
-   fixed_t frac;
-   boolean isaline;
-} intercept_t;
-
-static intercept_t old_intercept;
-
 //
 // Handle shooting a line.
 //
-static boolean PA_ShootLine(line_t *li, fixed_t interceptfrac)
+static boolean PA_ShootLine(shottrace_t *tr, line_t *li, fixed_t interceptfrac)
 {
    fixed_t   slope;
    fixed_t   dist;
-   sector_t *front, *back;
    fixed_t   opentop, openbottom;
 
    if(!(li->flags & ML_TWOSIDED))
    {
-      if(!shootline)
+      if(!tr->shootline)
       {
-         shootline = li;
-         firstlinefrac = interceptfrac;
+         tr->shootline = li;
+         tr->firstlinefrac = interceptfrac;
       }
-      old_intercept.frac = 0; // don't shoot anything past this
+      tr->old_intercept.frac = 0; // don't shoot anything past this
       return false;
    }
 
    // crosses a two-sided line
-   front = li->frontsector;
-   back  = li->backsector;
-
-   if(front->ceilingheight < back->ceilingheight)
-      opentop = front->ceilingheight;
-   else
-      opentop = back->ceilingheight;
-
-   if(front->floorheight > back->floorheight)
-      openbottom = front->floorheight;
-   else
-      openbottom = back->floorheight;
+   P_CachedLineOpening(li);
+   opentop    = li->opentop;
+   openbottom = li->openbottom;
 
-   dist = FixedMul(attackrange, interceptfrac);
+   dist = FixedMul(tr->attackrange, interceptfrac);
 
    if(li->frontsector->floorheight != li->backsector->floorheight)
    {
-      slope = FixedDiv(openbottom - shootz, dist);
-      if(slope >= aimmidslope && !shootline)
+      slope = FixedDiv(openbottom - tr->shootz, dist);
+      if(slope >= tr->aimmidslope && !tr->shootline)
       {
-         shootline = li;
-         firstlinefrac = interceptfrac;
+         tr->shootline = li;
+         tr->firstlinefrac = interceptfrac;
       }
-      if(slope > aimbottomslope)
-         aimbottomslope = slope;
+      if(slope > tr->aimbottomslope)
+         tr->aimbottomslope = slope;
    }
 
    if(li->frontsector->ceilingheight != li->backsector->ceilingheight)
    {
-      slope = FixedDiv(opentop - shootz, dist);
-      if(slope <= aimmidslope && !shootline)
+      slope = FixedDiv(opentop - tr->shootz, dist);
+      if(slope <= tr->aimmidslope && !tr->shootline)
       {
-         shootline = li;
-         firstlinefrac = interceptfrac;
+         tr->shootline = li;
+         tr->firstlinefrac = interceptfrac;
       }
-      if(slope < aimtopslope)
-         aimtopslope = slope;
+      if(slope < tr->aimtopslope)
+         tr->aimtopslope = slope;
    }
 
-   if(aimtopslope <= aimbottomslope)
+   if(tr->aimtopslope <= tr->aimbottomslope)
       return false;
 
    return true;
@@ -194,43 +205,43 @@ static boolean PA_ShootLine(line_t *li, fixed_t interceptfrac)
 //
 // Handle shooting a thing.
 //
-static boolean PA_ShootThing(mobj_t *th, fixed_t interceptfrac)
+static boolean PA_ShootThing(shottrace_t *tr, mobj_t *th, fixed_t interceptfrac)
 {
    fixed_t frac, dist;
    fixed_t thingaimtopslope, thingaimbottomslope;
 
-   if(th == shooter)
+   if(th == tr->shooter)
       return true; // can't shoot self
 
    if(!(th->flags & MF_SHOOTABLE))
       return true; // corpse or something
 
    // check angles to see if the thing can be aimed at
-   dist = FixedMul(attackrange, interceptfrac);
+   dist = FixedMul(tr->attackrange, interceptfrac);
    
-   thingaimtopslope = FixedDiv(th->z + th->height - shootz, dist);
-   if(thingaimtopslope < aimbottomslope)
+   thingaimtopslope = FixedDiv(th->z + th->height - tr->shootz, dist);
+   if(thingaimtopslope < tr->aimbottomslope)
       return true; // shot over the thing
 
-   thingaimbottomslope = FixedDiv(th->z - shootz, dist);
-   if(thingaimbottomslope > aimtopslope)
+   thingaimbottomslope = FixedDiv(th->z - tr->shootz, dist);
+   if(thingaimbottomslope > tr->aimtopslope)
       return true; // shot under the thing
 
    // this thing can be hit!
-   if(thingaimtopslope > aimtopslope)
-      thingaimtopslope = aimtopslope;
-   if(thingaimbottomslope < aimbottomslope)
-      thingaimbottomslope = aimbottomslope;
+   if(thingaimtopslope > tr->aimtopslope)
+      thingaimtopslope = tr->aimtopslope;
+   if(thingaimbottomslope < tr->aimbottomslope)
+      thingaimbottomslope = tr->aimbottomslope;
 
    // shoot midway in the visible part of the thing
-   shootslope = (thingaimtopslope + thingaimbottomslope) / 2;
-   shootmobj  = th;
+   tr->shootslope = (thingaimtopslope + thingaimbottomslope) / 2;
+   tr->shootmobj  = th;
 
    // position a bit closer
-   frac   = interceptfrac - FixedDiv(10*FRACUNIT, attackrange);
-   shootx = shootdiv.x + FixedMul(shootdiv.dx, frac);
-   shooty = shootdiv.y + FixedMul(shootdiv.dy, frac);
-   shootz = shootz + FixedMul(shootslope, FixedMul(frac, attackrange));
+   frac   = interceptfrac - FixedDiv(10*FRACUNIT, tr->attackrange);
+   tr->shootx = tr->shootdiv.x + FixedMul(tr->shootdiv.dx, frac);
+   tr->shooty = tr->shootdiv.y + FixedMul(tr->shootdiv.dy, frac);
+   tr->shootz = tr->shootz + FixedMul(tr->shootslope, FixedMul(frac, tr->attackrange));
 
    return false; // don't go any further
 }
@@ -238,14 +249,14 @@ static boolean PA_ShootThing(mobj_t *th, fixed_t interceptfrac)
 //
 // Process an intercept
 //
-static boolean PA_DoIntercept(intercept_t *in)
+static boolean PA_DoIntercept(shottrace_t *tr, intercept_t *in)
 {
    intercept_t temp;
 
-   if(old_intercept.frac < in->frac)
+   if(tr->old_intercept.frac < in->frac)
    {
-      temp = old_intercept;
-      old_intercept = *in;
+      temp = tr->old_intercept;
+      tr->old_intercept = *in;
       *in = temp;
    }
 
@@ -253,15 +264,15 @@ static boolean PA_DoIntercept(intercept_t *in)
       return true;
 
    if(in->isaline)
-      return PA_ShootLine(in->d.line, in->frac);
+      return PA_ShootLine(tr, in->d.line, in->frac);
    else
-      return PA_ShootThing(in->d.mo, in->frac);
+      return PA_ShootThing(tr, in->d.mo, in->frac);
 }
 
 //
 // Returns true if strace crosses the given subsector successfuly
 //
-static boolean PA_CrossSubsector(int bspnum)
+static boolean PA_CrossSubsector(shottrace_t *tr, int bspnum)
 {
    seg_t   *seg;
    line_t  *line;
@@ -272,10 +283,6 @@ static boolean PA_CrossSubsector(int bspnum)
    subsector_t *sub = &subsectors[bspnum];
    intercept_t  in;
 
-   // CALICO: removed type punning
-   thingline.v1 = &tv1;
-   thingline.v2 = &tv2;
-
    // check things
    for(thing = sub->sector->thinglist; thing; thing = thing->snext)
    {
@@ -283,22 +290,22 @@ static boolean PA_CrossSubsector(int bspnum)
          continue;
 
       // check a corner to corner cross-section for hit
-      if(shootdivpositive)
+      if(tr->shootdivpositive)
       {
-         thingline.v1->x = thing->x - thing->radius;
-         thingline.v1->y = thing->y + thing->radius;
-         thingline.v2->x = thing->x + thing->radius;
-         thingline.v2->y = thing->y - thing->radius;
+         tr->thingline.v1->x = thing->x - thing->radius;
+         tr->thingline.v1->y = thing->y + thing->radius;
+         tr->thingline.v2->x = thing->x + thing->radius;
+         tr->thingline.v2->y = thing->y - thing->radius;
       }
       else
       {
-         thingline.v1->x = thing->x - thing->radius;
-         thingline.v1->y = thing->y - thing->radius;
-         thingline.v2->x = thing->x + thing->radius;
-         thingline.v2->y = thing->y + thing->radius;
+         tr->thingline.v1->x = thing->x - thing->radius;
+         tr->thingline.v1->y = thing->y - thing->radius;
+         tr->thingline.v2->x = thing->x + thing->radius;
+         tr->thingline.v2->y = thing->y + thing->radius;
       }
 
-      frac = PA_SightCrossLine(&thingline);
+      frac = PA_SightCrossLine(tr, &tr->thingline);
 
       if(frac < 0 || frac > FRACUNIT)
          continue;
@@ -307,7 +314,7 @@ static boolean PA_CrossSubsector(int bspnum)
       in.isaline = false;
       in.frac    = frac;
 
-      if(!PA_DoIntercept(&in))
+      if(!PA_DoIntercept(tr, &in))
          return false;
    }
 
@@ -323,7 +330,7 @@ static boolean PA_CrossSubsector(int bspnum)
          continue; // already checked other side
       line->validcount = validcount;
 
-      frac = PA_SightCrossLine(line);
+      frac = PA_SightCrossLine(tr, line);
 
       if(frac < 0 || frac > FRACUNIT)
          continue;
@@ -332,7 +339,7 @@ static boolean PA_CrossSubsector(int bspnum)
       in.isaline = true;
       in.frac    = frac;
 
-      if(!PA_DoIntercept(&in))
+      if(!PA_DoIntercept(tr, &in))
          return false;
    }
 
@@ -342,7 +349,7 @@ static boolean PA_CrossSubsector(int bspnum)
 //
 // Walk the BSP tree to follow the trace.
 //
-static boolean PA_CrossBSPNode(int bspnum)
+static boolean PA_CrossBSPNode(shottrace_t *tr, int bspnum)
 {
    node_t *bsp;
    int side;
@@ -351,9 +358,9 @@ static boolean PA_CrossBSPNode(int bspnum)
    if(bspnum & NF_SUBSECTOR)
    {
       if(bspnum == -1) // CALICO: case not originally handled here
-         return PA_CrossSubsector(0);
+         return PA_CrossSubsector(tr, 0);
       else
-         return PA_CrossSubsector(bspnum & ~NF_SUBSECTOR);
+         return PA_CrossSubsector(tr, bspnum & ~NF_SUBSECTOR);
    }
 
    bsp = &nodes[bspnum];
@@ -363,82 +370,317 @@ static boolean PA_CrossBSPNode(int bspnum)
    div.y  = bsp->y;
    div.dx = bsp->dx;
    div.dy = bsp->dy;
-   side = P_PointOnDivlineSide(shootdiv.x, shootdiv.y, &div);
+   side = P_PointOnDivlineSide(tr->shootdiv.x, tr->shootdiv.y, &div);
 
    // cross the starting side
-   if(!PA_CrossBSPNode(bsp->children[side]))
+   if(!PA_CrossBSPNode(tr, bsp->children[side]))
       return false;
 
    // the partition plane is crossed here
-   if(side == P_PointOnDivlineSide(shootx2, shooty2, &div))
+   if(side == P_PointOnDivlineSide(tr->shootx2, tr->shooty2, &div))
       return true; // the line doesn't touch the other side
    
    // cross the ending side
-   return PA_CrossBSPNode(bsp->children[side^1]);
+   return PA_CrossBSPNode(tr, bsp->children[side^1]);
 }
 
 //
-// Main function to trace a line attack.
+// CALICO: shot fans. Every pellet of a shotgun blast starts at the same
+// point, so the side of each node that the trace starts on is the same for
+// all of them. P_BeginShotFan walks the BSP once for every ray within the
+// fan and records the order in which PA_CrossBSPNode would visit it as a
+// list of steps: subsectors to cross, and nodes whose far side is only
+// crossed by rays which end there. Far sides that no ray in the fan can
+// reach are left out altogether. Each pellet then runs through the list
+// instead of the tree, visiting the same subsectors in the same order, so
+// that the outcome of every shot is unchanged.
 //
-void P_Shoot2(void)
+typedef struct fanstep_s
+{
+   int num;  // subsector number, or node number if side >= 0
+   int side; // side of the node the fan starts on, -1 for a subsector
+   int skip; // steps in the node's far side
+} fanstep_t;
+
+#define NUMFANPOINTS 4
+
+static fanstep_t *fansteps; // PU_LEVEL
+static int        numfansteps;
+static boolean    fanactive;
+static mobj_t    *fanshooter;
+static fixed_t    fanx, fany, fanrange;
+static angle_t    fanangle, fanspread;
+static fixed_t    fanpoints[NUMFANPOINTS][2]; // hull around every ray in the fan
+
+//
+// True if every point within the fan's hull is certain to be on the given
+// side of the node, as P_PointOnDivlineSide would decide it
+//
+static boolean PA_FanOnSide(divline_t *div, int side)
+{
+   int64_t cross[NUMFANPOINTS], margin;
+   fixed_t maxdx = 0, maxdy = 0;
+   int     i;
+
+   // axis-aligned lines are decided by a single comparison
+   if(!div->dx || !div->dy)
+   {
+      for(i = 0; i < NUMFANPOINTS; i++)
+      {
+         if(P_PointOnDivlineSide(fanpoints[i][0], fanpoints[i][1], div) != side)
+            return false;
+      }
+      return true;
+   }
+
+   for(i = 0; i < NUMFANPOINTS; i++)
+   {
+      fixed_t dx = fanpoints[i][0] - div->x;
+      fixed_t dy = fanpoints[i][1] - div->y;
+
+      cross[i] = (int64_t)div->dy * dx - (int64_t)dy * div->dx;
+      if(D_abs(dx) > maxdx)
+         maxdx = D_abs(dx);
+      if(D_abs(dy) > maxdy)
+         maxdy = D_abs(dy);
+   }
+
+   // the most P_PointOnDivlineSide's truncated products can be off by
+   margin = ((int64_t)D_abs(div->dx) + D_abs(div->dy) + maxdx + maxdy) * 256 + ((int64_t)8 << 32);
+
+   for(i = 0; i < NUMFANPOINTS; i++)
+   {
+      if(side ? cross[i] > -margin : cross[i] < margin)
+         return false;
+   }
+
+   return true;
+}
+
+//
+// Record the steps for a subtree
+//
+static void PA_BuildShotFan(int bspnum)
 {
-   mobj_t  *t1;
-   angle_t  angle;
+   node_t   *bsp;
+   int       side, test;
+   divline_t div;
+
+   if(bspnum & NF_SUBSECTOR)
+   {
+      fansteps[numfansteps].num  = (bspnum == -1) ? 0 : bspnum & ~NF_SUBSECTOR;
+      fansteps[numfansteps].side = -1;
+      ++numfansteps;
+      return;
+   }
+
+   bsp = &nodes[bspnum];
+
+   div.x  = bsp->x;
+   div.y  = bsp->y;
+   div.dx = bsp->dx;
+   div.dy = bsp->dy;
+   side = P_PointOnDivlineSide(fanx, fany, &div);
+
+   PA_BuildShotFan(bsp->children[side]);
+
+   if(PA_FanOnSide(&div, side))
+      return; // no ray in the fan reaches the other side
+
+   test = numfansteps++;
+   fansteps[test].num  = bspnum;
+   fansteps[test].side = side;
+   PA_BuildShotFan(bsp->children[side^1]);
+   fansteps[test].skip = numfansteps - test - 1;
+}
+
+//
+// Get ready for several traces from t1 within spread of angle and up to
+// distance long. Fans wider than ANG45 either way are traced normally.
+//
+void P_BeginShotFan(mobj_t *t1, angle_t angle, angle_t spread, fixed_t distance)
+{
+   angle_t edges[NUMFANPOINTS - 1];
+   fixed_t reach;
+   int     i;
+
+   fanactive = false;
+   if(spread > ANG45)
+      return;
+
+   if(!fansteps)
+   {
+      int size = (numnodes + numsubsectors + 1) * sizeof(*fansteps);
+      fansteps = Z_Malloc(size, PU_LEVEL, (void **)&fansteps);
+   }
+
+   fanshooter = t1;
+   fanx       = t1->x;
+   fany       = t1->y;
+   fanrange   = distance;
+   fanangle   = angle;
+   fanspread  = spread;
+
+   // the hull runs out past the arc the traces end on, with room for
+   // rounding of their angles and lengths
+   reach    = ((distance >> FRACBITS) * 9 / 8 + 2) * FRACUNIT;
+   edges[0] = angle - spread - (2 << ANGLETOFINESHIFT);
+   edges[1] = angle;
+   edges[2] = angle + spread + (2 << ANGLETOFINESHIFT);
+
+   fanpoints[0][0] = fanx;
+   fanpoints[0][1] = fany;
+   for(i = 0; i < NUMFANPOINTS - 1; i++)
+   {
+      fanpoints[i + 1][0] = fanx + (reach >> FRACBITS) * finecosine[edges[i] >> ANGLETOFINESHIFT];
+      fanpoints[i + 1][1] = fany + (reach >> FRACBITS) * finesine[edges[i] >> ANGLETOFINESHIFT];
+   }
+
+   numfansteps = 0;
+   PA_BuildShotFan(numnodes - 1);
+   fanactive = true;
+}
+
+void P_EndShotFan(void)
+{
+   fanactive = false;
+}
 
-   t1        = shooter;
-   shootline = NULL;
-   shootmobj = NULL;
-   angle     = attackangle >> ANGLETOFINESHIFT;
+//
+// True if the trace being set up is part of the current fan
+//
+static boolean PA_InShotFan(shottrace_t *tr)
+{
+   return fanactive && fansteps      &&
+      tr->shooter == fanshooter          &&
+      tr->shooter->x == fanx             &&
+      tr->shooter->y == fany             &&
+      tr->attackrange <= fanrange        &&
+      tr->attackangle - fanangle + fanspread <= fanspread * 2;
+}
 
-   shootdiv.x  = t1->x;
-   shootdiv.y  = t1->y;
-   shootx2     = t1->x + (attackrange >> FRACBITS) * finecosine[angle];
-   shooty2     = t1->y + (attackrange >> FRACBITS) * finesine[angle];
-   shootdiv.dx = shootx2 - shootdiv.x;
-   shootdiv.dy = shooty2 - shootdiv.y;
-   shootz      = t1->z + (t1->height >> 1) + 8*FRACUNIT;
+//
+// Follow the trace through the fan's steps
+//
+static void PA_CrossShotFan(shottrace_t *tr)
+{
+   fanstep_t *step = fansteps, *end = fansteps + numfansteps;
+   node_t    *bsp;
+   divline_t  div;
 
-   shootdivpositive = (shootdiv.dx ^ shootdiv.dy) > 0;
+   while(step < end)
+   {
+      if(step->side < 0)
+      {
+         if(!PA_CrossSubsector(tr, step->num))
+            return;
+      }
+      else
+      {
+         bsp    = &nodes[step->num];
+         div.x  = bsp->x;
+         div.y  = bsp->y;
+         div.dx = bsp->dx;
+         div.dy = bsp->dy;
+
+         // the line doesn't touch the other side
+         if(step->side == P_PointOnDivlineSide(tr->shootx2, tr->shooty2, &div))
+            step += step->skip;
+      }
 
-   ssx1 = shootdiv.x / FRACUNIT;
-   ssy1 = shootdiv.y / FRACUNIT;
-   ssx2 = shootx2    / FRACUNIT;
-   ssy2 = shooty2    / FRACUNIT;
+      ++step;
+   }
+}
+
+//
+// Main function to trace a line attack.
+//
+void P_Shoot2(void)
+{
+   shottrace_t tr;
+   mobj_t     *t1;
+   angle_t     angle;
+
+   // CALICO: take the attack into the trace
+   tr.shooter        = shooter;
+   tr.attackangle    = attackangle;
+   tr.attackrange    = attackrange;
+   tr.aimtopslope    = aimtopslope;
+   tr.aimbottomslope = aimbottomslope;
+
+   t1           = tr.shooter;
+   tr.shootline = NULL;
+   tr.shootmobj = NULL;
+   tr.shootslope = 0;
+   angle        = tr.attackangle >> ANGLETOFINESHIFT;
+
+   tr.shootdiv.x  = t1->x;
+   tr.shootdiv.y  = t1->y;
+   tr.shootx2     = t1->x + (tr.attackrange >> FRACBITS) * finecosine[angle];
+   tr.shooty2     = t1->y + (tr.attackrange >> FRACBITS) * finesine[angle];
+   tr.shootdiv.dx = tr.shootx2 - tr.shootdiv.x;
+   tr.shootdiv.dy = tr.shooty2 - tr.shootdiv.y;
+   tr.shootx      = shootx;
+   tr.shooty      = shooty;
+   tr.shootz      = t1->z + (t1->height >> 1) + 8*FRACUNIT;
+
+   tr.shootdivpositive = (tr.shootdiv.dx ^ tr.shootdiv.dy) > 0;
+
+   tr.ssx1 = tr.shootdiv.x / FRACUNIT;
+   tr.ssy1 = tr.shootdiv.y / FRACUNIT;
+   tr.ssx2 = tr.shootx2    / FRACUNIT;
+   tr.ssy2 = tr.shooty2    / FRACUNIT;
+
+   tr.aimmidslope   = (tr.aimtopslope + tr.aimbottomslope) / 2;
+   tr.firstlinefrac = 0;
 
-   aimmidslope = (aimtopslope + aimbottomslope) / 2;
+   // CALICO: removed type punning
+   tr.thingline.v1 = &tr.tv1;
+   tr.thingline.v2 = &tr.tv2;
 
    // cross everything
-   old_intercept.d.line  = NULL;
-   old_intercept.frac    = 0;
-   old_intercept.isaline = false;
+   tr.old_intercept.d.line  = NULL;
+   tr.old_intercept.frac    = 0;
+   tr.old_intercept.isaline = false;
 
-   PA_CrossBSPNode(numnodes - 1);
+   if(PA_InShotFan(&tr))
+      PA_CrossShotFan(&tr);
+   else
+      PA_CrossBSPNode(&tr, numnodes - 1);
 
    // check the last intercept if needed
-   if(!shootmobj)
+   if(!tr.shootmobj)
    {
       intercept_t in;
       in.d.mo    = NULL;
       in.isaline = false;
       in.frac    = FRACUNIT;
-      PA_DoIntercept(&in);
+      PA_DoIntercept(&tr, &in);
    }
 
    // post-process
-   if(shootmobj)
-      return;
-
-   if(!shootline)
-      return;
+   if(!tr.shootmobj && tr.shootline)
+   {
+      // calculate the intercept point for the first line hit
 
-   // calculate the intercept point for the first line hit
+      // position a bit closer
+      tr.firstlinefrac -= FixedDiv(4*FRACUNIT, tr.attackrange);
 
-   // position a bit closer
-   firstlinefrac -= FixedDiv(4*FRACUNIT, attackrange);
+      tr.shootx  = tr.shootdiv.x + FixedMul(tr.shootdiv.dx, tr.firstlinefrac);
+      tr.shooty  = tr.shootdiv.y + FixedMul(tr.shootdiv.dy, tr.firstlinefrac);
+      tr.shootz += FixedMul(tr.aimmidslope, FixedMul(tr.firstlinefrac, tr.attackrange));
+   }
 
-   shootx  = shootdiv.x + FixedMul(shootdiv.dx, firstlinefrac);
-   shooty  = shootdiv.y + FixedMul(shootdiv.dy, firstlinefrac);
-   shootz += FixedMul(aimmidslope, FixedMul(firstlinefrac, attackrange));
+   // CALICO: hand the results back
+   aimtopslope    = tr.aimtopslope;
+   aimbottomslope = tr.aimbottomslope;
+   shootline      = tr.shootline;
+   shootmobj      = tr.shootmobj;
+   shootx         = tr.shootx;
+   shooty         = tr.shooty;
+   shootz         = tr.shootz;
+   if(tr.shootmobj)
+      shootslope = tr.shootslope;
 }
 
 // EOF
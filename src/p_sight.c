@@ -26,14 +26,27 @@
   SOFTWARE.
 */
 
+#include <stdlib.h>
 #include "doomdef.h"
+#include "hal/hal_thread.h"
+#include "m_argv.h"
+#include "m_jobs.h"
 #include "p_local.h"
 
-static fixed_t sightzstart;           // eye z of looker
-static fixed_t topslope, bottomslope; // slopes to top and bottom of target
-
-static divline_t strace;  // from t1 to t2
-static fixed_t t2x, t2y;
+//
+// CALICO: the state of one sight check, formerly file-scope statics, so that
+// several checks can be run at once. A check which has its own line stamps
+// uses them instead of line_t::validcount.
+//
+typedef struct sighttrace_s
+{
+   fixed_t   sightzstart;           // eye z of looker
+   fixed_t   topslope, bottomslope; // slopes to top and bottom of target
+   divline_t strace;                // from t1 to t2
+   fixed_t   t2x, t2y;
+   int      *linestamps;            // [numlines], or NULL
+   int       stamp;
+} sighttrace_t;
 
 //
 // Returns side 0 (front), 1 (back), or 2 (on).
@@ -115,7 +128,7 @@ fixed_t P_InterceptVector2(divline_t *v2, divline_t *v1)
 =================
 */
 
-static boolean PS_CrossSubsector(int num)
+static boolean PS_CrossSubsector(sighttrace_t *st, int num)
 {
    seg_t       *seg;
    line_t      *line;
@@ -144,15 +157,25 @@ static boolean PS_CrossSubsector(int num)
       line = seg->linedef;
 
       // allready checked other side?
-      if(line->validcount == validcount)
-         continue;
+      if(st->linestamps)
+      {
+         int *stamp = &st->linestamps[line - lines];
 
-      line->validcount = validcount;
+         if(*stamp == st->stamp)
+            continue;
+         *stamp = st->stamp;
+      }
+      else
+      {
+         if(line->validcount == validcount)
+            continue;
+         line->validcount = validcount;
+      }
 
       v1 = line->v1;
       v2 = line->v2;
-      s1 = P_DivlineSide(v1->x, v1->y, &strace);
-      s2 = P_DivlineSide(v2->x, v2->y, &strace);
+      s1 = P_DivlineSide(v1->x, v1->y, &st->strace);
+      s2 = P_DivlineSide(v2->x, v2->y, &st->strace);
 
       // line isn't crossed?
       if (s1 == s2)
@@ -162,8 +185,8 @@ static boolean PS_CrossSubsector(int num)
       divl.y = v1->y;
       divl.dx = v2->x - v1->x;
       divl.dy = v2->y - v1->y;
-      s1 = P_DivlineSide (strace.x, strace.y, &divl);
-      s2 = P_DivlineSide (t2x, t2y, &divl);
+      s1 = P_DivlineSide (st->strace.x, st->strace.y, &divl);
+      s2 = P_DivlineSide (st->t2x, st->t2y, &divl);
 
       // line isn't crossed?
       if (s1 == s2)
@@ -199,23 +222,23 @@ static boolean PS_CrossSubsector(int num)
       if(openbottom >= opentop)
          return false; // stop
 
-      frac = P_InterceptVector2(&strace, &divl);
+      frac = P_InterceptVector2(&st->strace, &divl);
 
       if(front->floorheight != back->floorheight)
       {
-         slope = FixedDiv(openbottom - sightzstart , frac);
-         if(slope > bottomslope)
-            bottomslope = slope;
+         slope = FixedDiv(openbottom - st->sightzstart , frac);
+         if(slope > st->bottomslope)
+            st->bottomslope = slope;
       }
 
       if(front->ceilingheight != back->ceilingheight)
       {
-         slope = FixedDiv (opentop - sightzstart , frac);
-         if(slope < topslope)
-            topslope = slope;
+         slope = FixedDiv (opentop - st->sightzstart , frac);
+         if(slope < st->topslope)
+            st->topslope = slope;
       }
 
-      if(topslope <= bottomslope)
+      if(st->topslope <= st->bottomslope)
          return false;    // stop
    }
 
@@ -226,7 +249,7 @@ static boolean PS_CrossSubsector(int num)
 //
 // Returns true if strace crosses the given node successfuly
 //
-static boolean PS_CrossBSPNode(int bspnum)
+static boolean PS_CrossBSPNode(sighttrace_t *st, int bspnum)
 {
    node_t *bsp;
    int side;
@@ -234,34 +257,34 @@ static boolean PS_CrossBSPNode(int bspnum)
    if(bspnum & NF_SUBSECTOR)
    {
       if(bspnum == -1)
-         return PS_CrossSubsector(0);
+         return PS_CrossSubsector(st, 0);
       else
-         return PS_CrossSubsector(bspnum & ~NF_SUBSECTOR);
+         return PS_CrossSubsector(st, bspnum & ~NF_SUBSECTOR);
    }
 
    bsp = &nodes[bspnum];
 
    // decide which side the start point is on
-   side = P_DivlineSide(strace.x, strace.y, (divline_t *)bsp);
+   side = P_DivlineSide(st->strace.x, st->strace.y, (divline_t *)bsp);
    if(side == 2)
       side = 0;
 
    // cross the starting side
-   if(!PS_CrossBSPNode(bsp->children[side]))
+   if(!PS_CrossBSPNode(st, bsp->children[side]))
       return false;
 
    // the partition plane is crossed here
-   if(side == P_DivlineSide(t2x, t2y, (divline_t *)bsp))
+   if(side == P_DivlineSide(st->t2x, st->t2y, (divline_t *)bsp))
       return true; // the line doesn't touch the other side
 
    // cross the ending side
-   return PS_CrossBSPNode(bsp->children[side^1]);
+   return PS_CrossBSPNode(st, bsp->children[side^1]);
 }
 
 //
 // Returns true if a straight line between t1 and t2 is unobstructed
 //
-boolean PS_CheckSight(mobj_t *t1, mobj_t *t2)
+static boolean PS_CheckSightTrace(sighttrace_t *st, mobj_t *t1, mobj_t *t2)
 {
    int s1, s2;
    int pnum, bytenum, bitnum;
@@ -279,21 +302,332 @@ boolean PS_CheckSight(mobj_t *t1, mobj_t *t2)
    }
 
    // look from eyes of t1 to any part of t2
-   ++validcount;
+   if(st->linestamps)
+      ++st->stamp;
+   else
+      ++validcount;
 
-   sightzstart = t1->z + t1->height - (t1->height >> 2);
-   topslope    = (t2->z + t2->height) - sightzstart;
-   bottomslope = (t2->z) - sightzstart;
+   st->sightzstart = t1->z + t1->height - (t1->height >> 2);
+   st->topslope    = (t2->z + t2->height) - st->sightzstart;
+   st->bottomslope = (t2->z) - st->sightzstart;
 
    // make sure it never lies exactly on a vertex coordinate
-   strace.x = (t1->x & ~0x1ffff) | 0x10000;
-   strace.y = (t1->y & ~0x1ffff) | 0x10000;
-   t2x = (t2->x & ~0x1ffff) | 0x10000;
-   t2y = (t2->y & ~0x1ffff) | 0x10000;
-   strace.dx = t2x - strace.x;
-   strace.dy = t2y - strace.y;
-
-   return PS_CrossBSPNode(numnodes-1);
+   st->strace.x = (t1->x & ~0x1ffff) | 0x10000;
+   st->strace.y = (t1->y & ~0x1ffff) | 0x10000;
+   st->t2x = (t2->x & ~0x1ffff) | 0x10000;
+   st->t2y = (t2->y & ~0x1ffff) | 0x10000;
+   st->strace.dx = st->t2x - st->strace.x;
+   st->strace.dy = st->t2y - st->strace.y;
+
+   return PS_CrossBSPNode(st, numnodes-1);
+}
+
+boolean PS_CheckSight(mobj_t *t1, mobj_t *t2)
+{
+   static sighttrace_t st; // marks lines with validcount
+
+   return PS_CheckSightTrace(&st, t1, t2);
+}
+
+//
+// CALICO: sight results for the current P_CheckSights2 pass. Nothing in the
+// level moves while it runs, so a check with the same inputs as an earlier
+// one in the pass must have the same result. Those inputs are both
+// subsectors, which decide the REJECT lookup, along with the endpoints after
+// the snapping done by PS_CheckSightTrace and the heights used for the
+// slopes. Looking only at the subsectors would let neighbouring monsters
+// share results they would not have got on their own, so every input is
+// part of the key; the subsector pair picks the hash chain.
+//
+#define SIGHTHASHSIZE 256 // must be a power of two
+
+typedef struct sightkey_s
+{
+   subsector_t *ss1, *ss2;
+   fixed_t      x1, y1, x2, y2;
+   fixed_t      eyez, bottomz, topz;
+} sightkey_t;
+
+typedef struct sightentry_s
+{
+   sightkey_t key;
+   int        value; // the result, or the query that will decide it
+   int        next;  // in the hash chain, or -1
+} sightentry_t;
+
+static sightentry_t *sightentries;
+static int           numsightentries, maxsightentries;
+static int           sighthash[SIGHTHASHSIZE];
+
+static void PS_ClearSightCache(void)
+{
+   int i;
+
+   for(i = 0; i < SIGHTHASHSIZE; i++)
+      sighthash[i] = -1;
+   numsightentries = 0;
+}
+
+static void PS_SightKey(sightkey_t *key, mobj_t *t1, mobj_t *t2)
+{
+   key->ss1     = t1->subsector;
+   key->ss2     = t2->subsector;
+   key->x1      = (t1->x & ~0x1ffff) | 0x10000;
+   key->y1      = (t1->y & ~0x1ffff) | 0x10000;
+   key->x2      = (t2->x & ~0x1ffff) | 0x10000;
+   key->y2      = (t2->y & ~0x1ffff) | 0x10000;
+   key->eyez    = t1->z + t1->height - (t1->height >> 2);
+   key->bottomz = t2->z;
+   key->topz    = t2->z + t2->height;
+}
+
+static int PS_SightHash(sightkey_t *key)
+{
+   unsigned int h = (unsigned int)(key->ss1 - subsectors) * 31 + (unsigned int)(key->ss2 - subsectors);
+
+   return (h ^ (h >> 8)) & (SIGHTHASHSIZE - 1);
+}
+
+static boolean PS_SameSightKey(sightkey_t *a, sightkey_t *b)
+{
+   return a->ss1 == b->ss1 && a->ss2 == b->ss2 &&
+      a->x1 == b->x1 && a->y1 == b->y1 && a->x2 == b->x2 && a->y2 == b->y2 &&
+      a->eyez == b->eyez && a->bottomz == b->bottomz && a->topz == b->topz;
+}
+
+//
+// Find an earlier check with the same inputs, or NULL
+//
+static sightentry_t *PS_FindSight(sightkey_t *key)
+{
+   int i;
+
+   for(i = sighthash[PS_SightHash(key)]; i != -1; i = sightentries[i].next)
+   {
+      if(PS_SameSightKey(&sightentries[i].key, key))
+         return &sightentries[i];
+   }
+
+   return NULL;
+}
+
+static void PS_AddSight(sightkey_t *key, int value)
+{
+   sightentry_t *entry;
+   int           hash = PS_SightHash(key);
+
+   if(numsightentries == maxsightentries)
+   {
+      int newmax = maxsightentries ? maxsightentries * 2 : 256;
+
+      if(!(entry = realloc(sightentries, newmax * sizeof(*sightentries))))
+         I_Error("PS_AddSight: no memory for %i sight results", newmax);
+      sightentries    = entry;
+      maxsightentries = newmax;
+   }
+
+   entry        = &sightentries[numsightentries];
+   entry->key   = *key;
+   entry->value = value;
+   entry->next  = sighthash[hash];
+   sighthash[hash] = numsightentries++;
+}
+
+//
+// CALICO: with -sightthreads, the sight checks for a tic are gathered up and
+// split into that many shares, run as jobs. A check only reads the level,
+// and each share stamps lines in its own array, so the checks can run in
+// any order; the results are then applied to the mobjs in list order.
+// -sightthreads 0 selects one share per logical CPU.
+//
+#define MAXSIGHTTHREADS 8
+
+typedef struct sightworker_s
+{
+   sighttrace_t       trace;
+   int                numstamps; // size of trace.linestamps
+   int                first, last; // queries to check, last exclusive
+} sightworker_t;
+
+static sightworker_t sightworkers[MAXSIGHTTHREADS];
+static int           numsightthreads = 1;
+static boolean       staggerlook; // CALICO: -staggerlook, see PS_PassOverLook
+
+// distinct checks, and the mobjs waiting on each
+static mobj_t **sightqueries;
+static byte    *sightresults;
+static int      numsightqueries, maxsightqueries;
+static mobj_t **sightmobjs;
+static int     *sightmobjquery;
+static int      numsightmobjs, maxsightmobjs;
+
+//
+// Check a range of the gathered queries
+//
+static void PS_CheckQueries(sightworker_t *worker)
+{
+   int i;
+
+   for(i = worker->first; i < worker->last; i++)
+   {
+      mobj_t *mobj = sightqueries[i];
+      sightresults[i] = PS_CheckSightTrace(&worker->trace, mobj, mobj->target);
+   }
+}
+
+static void PS_SightJob(void *data, int index)
+{
+   PS_CheckQueries(&sightworkers[index]);
+}
+
+//
+// Split sight checking into shares if -sightthreads was given
+//
+void P_InitSights(void)
+{
+   int p, count;
+
+   staggerlook = M_FindArgument("-staggerlook");
+
+   if(!(p = M_GetArgParameters("-sightthreads", 1)))
+      return;
+
+   count = atoi(myargv[p]);
+   if(count <= 0)
+      count = hal_threads.getCPUCount ? hal_threads.getCPUCount() : 1;
+   if(count > MAXSIGHTTHREADS)
+      count = MAXSIGHTTHREADS;
+
+   // no more shares than the job pool can run at once
+   numsightthreads = emin(count, M_ReserveJobThreads(count));
+   D_printf("P_InitSights: %i\n", numsightthreads);
+}
+
+//
+// Make sure every worker has line stamps for the current level. Stamps left
+// from an earlier level are always behind the worker's current stamp.
+//
+static void PS_ReserveStamps(void)
+{
+   int i;
+
+   for(i = 0; i < numsightthreads; i++)
+   {
+      sightworker_t *worker = &sightworkers[i];
+
+      if(worker->numstamps >= numlines)
+         continue;
+
+      free(worker->trace.linestamps);
+      if(!(worker->trace.linestamps = calloc(numlines, sizeof(int))))
+         I_Error("PS_ReserveStamps: no memory for %i lines", numlines);
+      worker->numstamps   = numlines;
+      worker->trace.stamp = 0;
+   }
+}
+
+//
+// Check the gathered queries across all of the sight threads
+//
+static void PS_CheckGatheredSights(void)
+{
+   int i;
+
+   PS_ReserveStamps();
+
+   for(i = 0; i < numsightthreads; i++)
+   {
+      sightworkers[i].first = (numsightqueries *  i     ) / numsightthreads;
+      sightworkers[i].last  = (numsightqueries * (i + 1)) / numsightthreads;
+   }
+
+   M_RunJobs("sights", PS_SightJob, NULL, numsightthreads);
+
+   for(i = 0; i < numsightmobjs; i++)
+   {
+      if(sightresults[sightmobjquery[i]])
+         sightmobjs[i]->flags |= MF_SEETARGET;
+   }
+}
+
+//
+// Add a mobj to the queries for this tic
+//
+static void PS_GatherSight(mobj_t *mobj, sightkey_t *key)
+{
+   sightentry_t *entry;
+   int           query;
+
+   if((entry = PS_FindSight(key)))
+      query = entry->value;
+   else
+   {
+      if(numsightqueries == maxsightqueries)
+      {
+         int      newmax  = maxsightqueries ? maxsightqueries * 2 : 256;
+         mobj_t **queries = realloc(sightqueries, newmax * sizeof(*sightqueries));
+         byte    *results = realloc(sightresults, newmax * sizeof(*sightresults));
+
+         if(queries)
+            sightqueries = queries;
+         if(results)
+            sightresults = results;
+         if(!queries || !results)
+            I_Error("PS_GatherSight: no memory for %i sight checks", newmax);
+         maxsightqueries = newmax;
+      }
+
+      query = numsightqueries++;
+      sightqueries[query] = mobj;
+      PS_AddSight(key, query);
+   }
+
+   if(numsightmobjs == maxsightmobjs)
+   {
+      int      newmax  = maxsightmobjs ? maxsightmobjs * 2 : 256;
+      mobj_t **mobjs   = realloc(sightmobjs, newmax * sizeof(*sightmobjs));
+      int     *queries = realloc(sightmobjquery, newmax * sizeof(*sightmobjquery));
+
+      if(mobjs)
+         sightmobjs = mobjs;
+      if(queries)
+         sightmobjquery = queries;
+      if(!mobjs || !queries)
+         I_Error("PS_GatherSight: no memory for %i sight checks", newmax);
+      maxsightmobjs = newmax;
+   }
+
+   sightmobjs[numsightmobjs]     = mobj;
+   sightmobjquery[numsightmobjs] = query;
+   ++numsightmobjs;
+}
+
+//
+// CALICO: with -staggerlook, a monster waiting in A_Look which hasn't heard
+// anything and isn't in its target's sector only has its sight checked on
+// one look in LOOKSTAGGER, at a phase set when it spawned. This bounds the
+// cost of maps full of sleeping monsters, but they wake later than they
+// would have, so it is never used for demos or netgames.
+//
+#define LOOKSTAGGER 4 // must be a power of 2
+
+void A_Look(mobj_t *actor);
+
+static boolean PS_PassOverLook(mobj_t *mobj)
+{
+   sector_t *sec;
+
+   if(!staggerlook || demoplayback || demorecording || netgame != gt_single)
+      return false;
+
+   if(mobj->state->action != A_Look)
+      return false;
+
+   sec = mobj->subsector->sector;
+   if(sec->soundtarget || mobj->target->subsector->sector == sec)
+      return false;
+
+   return (++mobj->lookcount & (LOOKSTAGGER - 1)) != 0;
 }
 
 //
@@ -302,7 +636,13 @@ boolean PS_CheckSight(mobj_t *t1, mobj_t *t2)
 //
 void P_CheckSights2(void)
 {
-   mobj_t *mobj;
+   mobj_t       *mobj;
+   sightkey_t    key;
+   sightentry_t *entry;
+   boolean       seen;
+
+   numsightqueries = numsightmobjs = 0;
+   PS_ClearSightCache();
 
    for(mobj = mobjhead.next; mobj != &mobjhead; mobj = mobj->next)
    {
@@ -324,10 +664,32 @@ void P_CheckSights2(void)
       if(!mobj->target)
          continue;
 
-      if(PS_CheckSight(mobj, mobj->target))
+      if(PS_PassOverLook(mobj))
+         continue;
+
+      // CALICO: reuse the result of an identical check
+      PS_SightKey(&key, mobj, mobj->target);
+
+      if(numsightthreads > 1)
+      {
+         PS_GatherSight(mobj, &key); // checked below
+         continue;
+      }
+
+      if((entry = PS_FindSight(&key)))
+         seen = entry->value;
+      else
+      {
+         seen = PS_CheckSight(mobj, mobj->target);
+         PS_AddSight(&key, seen);
+      }
+
+      if(seen)
          mobj->flags |= MF_SEETARGET;
    }
+
+   if(numsightmobjs)
+      PS_CheckGatheredSights();
 }
 
 // EOF
-
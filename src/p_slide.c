@@ -149,10 +149,9 @@ blockmove:
 //
 // Check a linedef during wall sliding motion.
 //
-static boolean SL_CheckLine(line_t *ld)
+static boolean SL_CheckLine(line_t *ld, void *data)
 {
    fixed_t   opentop, openbottom;
-   sector_t *front, *back;
    int       side1;
    vertex_t *vtmp;
 
@@ -169,21 +168,13 @@ static boolean SL_CheckLine(line_t *ld)
    if(!ld->backsector || (ld->flags & ML_BLOCKING))
       goto findfrac;
 
-   front = ld->frontsector;
-   back  = ld->backsector;
-
-   if(front->floorheight > back->floorheight)
-      openbottom = front->floorheight;
-   else
-      openbottom = back->floorheight;
+   P_CachedLineOpening(ld);
+   openbottom = ld->openbottom;
 
    if(openbottom - slidething->z > 24*FRACUNIT)
       goto findfrac; // too big a step up
 
-   if(front->ceilingheight < back->ceilingheight)
-      opentop = front->ceilingheight;
-   else
-      opentop = back->ceilingheight;
+   opentop = ld->opentop;
 
    if(opentop - openbottom >= 56*FRACUNIT)
       return true; // the line doesn't block movement
@@ -223,8 +214,6 @@ findfrac:
 //
 fixed_t P_CompletableFrac(fixed_t dx, fixed_t dy)
 {
-   int xl, xh, yl, yh, bx, by;
-
    blockfrac = FRACUNIT;
    slidedx = dx;
    slidedy = dy;
@@ -244,28 +233,8 @@ fixed_t P_CompletableFrac(fixed_t dx, fixed_t dy)
    else
       endbox[BOXBOTTOM] += dy;
 
-   ++validcount;
-
    // check lines
-   xl = (endbox[BOXLEFT  ] - bmaporgx) >> MAPBLOCKSHIFT;
-   xh = (endbox[BOXRIGHT ] - bmaporgx) >> MAPBLOCKSHIFT;
-   yl = (endbox[BOXBOTTOM] - bmaporgy) >> MAPBLOCKSHIFT;
-   yh = (endbox[BOXTOP   ] - bmaporgy) >> MAPBLOCKSHIFT;
-
-   if(xl < 0)
-      xl = 0;
-   if(yl < 0)
-      yl = 0;
-   if(xh >= bmapwidth)
-      xh = bmapwidth - 1;
-   if(yh >= bmapheight)
-      yh = bmapheight - 1;
-
-   for(bx = xl; bx <= xh; bx++)
-   {
-      for(by = yl; by <= yh; by++)
-         P_BlockLinesIterator(bx, by, SL_CheckLine);
-   }
+   P_BoxLinesIterator(endbox, SL_CheckLine, NULL);
 
    // examine results
    if(blockfrac < 0x1000)
@@ -299,106 +268,103 @@ static int SL_PointOnSide2(fixed_t x1, fixed_t y1,
    return ((dist < 0) ? SIDE_BACK : SIDE_FRONT);
 }
 
-static void SL_CheckSpecialLines(void)
+//
+// Check a line for being a special crossed by the move.
+//
+static boolean SL_CheckSpecialLine(line_t *ld, void *data)
 {
    fixed_t x1 = slidething->x;
    fixed_t y1 = slidething->y;
    fixed_t x2 = slidex;
    fixed_t y2 = slidey;
-
-   fixed_t bx, by, xl, xh, yl, yh;
-   fixed_t bxl, bxh, byl, byh;
    fixed_t x3, y3, x4, y4;
    int side1, side2;
 
+   if(!ld->special)
+      return true;
+
+   x3 = ld->v1->x;
+   y3 = ld->v1->y;
+   x4 = ld->v2->x;
+   y4 = ld->v2->y;
+
+   side1 = SL_PointOnSide2(x1, y1, x3, y3, x4, y4);
+   side2 = SL_PointOnSide2(x2, y2, x3, y3, x4, y4);
+
+   if(side1 == side2)
+      return true; // move doesn't cross line
+
+   side1 = SL_PointOnSide2(x3, y3, x1, y1, x2, y2);
+   side2 = SL_PointOnSide2(x4, y4, x1, y1, x2, y2);
+
+   if(side1 == side2)
+      return true; // line doesn't cross move
+
+   specialline = ld;
+   return false;
+}
+
+static void SL_CheckSpecialLines(void)
+{
+   fixed_t x1 = slidething->x;
+   fixed_t y1 = slidething->y;
+   fixed_t x2 = slidex;
+   fixed_t y2 = slidey;
+   fixed_t movebox[4];
+
    if(x1 < x2)
    {
-      xl = x1;
-      xh = x2;
+      movebox[BOXLEFT ] = x1;
+      movebox[BOXRIGHT] = x2;
    }
    else
    {
-      xl = x2;
-      xh = x1;
+      movebox[BOXLEFT ] = x2;
+      movebox[BOXRIGHT] = x1;
    }
 
    if(y1 < y2)
    {
-      yl = y1;
-      yh = y2;
+      movebox[BOXBOTTOM] = y1;
+      movebox[BOXTOP   ] = y2;
    }
    else
    {
-      yl = y2;
-      yh = y1;
+      movebox[BOXBOTTOM] = y2;
+      movebox[BOXTOP   ] = y1;
    }
 
-   bxl = (xl - bmaporgx) >> MAPBLOCKSHIFT;
-   bxh = (xh - bmaporgx) >> MAPBLOCKSHIFT;
-   byl = (yl - bmaporgy) >> MAPBLOCKSHIFT;
-   byh = (yh - bmaporgy) >> MAPBLOCKSHIFT;
-
-   if(bxl < 0)
-      bxl = 0;
-   if(byl < 0)
-      byl = 0;
-   if(bxh >= bmapwidth)
-      bxh = bmapwidth - 1;
-   if(byh >= bmapheight)
-      byh = bmapheight - 1;
-
    specialline = NULL;
-   ++validcount;
+   P_BoxLinesIterator(movebox, SL_CheckSpecialLine, NULL);
+}
 
-   for(bx = bxl; bx <= bxh; bx++)
-   {
-      for(by = byl; by <= byh; by++)
-      {
-         short  *list;
-         line_t *ld;
-         int offset = by * bmapwidth + bx;
-         offset = *(blockmap + offset);
-         
-         for(list = blockmaplump + offset; *list != -1; list++)
-         {
-            ld = &lines[*list];
-            if(!ld->special)
-               continue;
-            if(ld->validcount == validcount)
-               continue; // already checked
-            
-            ld->validcount = validcount;
-
-            if(xh < ld->bbox[BOXLEFT  ] ||
-               xl > ld->bbox[BOXRIGHT ] ||
-               yh < ld->bbox[BOXBOTTOM] ||
-               yl > ld->bbox[BOXTOP   ])
-            {
-               continue;
-            }
-
-            x3 = ld->v1->x;
-            y3 = ld->v1->y;
-            x4 = ld->v2->x;
-            y4 = ld->v2->y;
-
-            side1 = SL_PointOnSide2(x1, y1, x3, y3, x4, y4);
-            side2 = SL_PointOnSide2(x2, y2, x3, y3, x4, y4);
-
-            if(side1 == side2)
-               continue; // move doesn't cross line
-
-            side1 = SL_PointOnSide2(x3, y3, x1, y1, x2, y2);
-            side2 = SL_PointOnSide2(x4, y4, x1, y1, x2, y2);
-
-            if(side1 == side2)
-               continue; // line doesn't cross move
-
-            specialline = ld;
-            return;
-         }
-      }
-   }
+//
+// CALICO: start a move query covering everything P_PlayerMove can check for
+// mo this tic: every slide bump, the crossed special lines, and the final
+// or stairstep P_TryMove. stepx and stepy bound the stairstep move.
+//
+void P_BeginSlideQuery(mobj_t *mo, fixed_t stepx, fixed_t stepy)
+{
+   fixed_t reach, stepreach, pad;
+   fixed_t box[4];
+
+   // a slide never travels further along an axis than the move's length
+   reach     = D_abs(mo->momx) + D_abs(mo->momy);
+   stepreach = D_abs(stepx) + D_abs(stepy);
+   if(stepreach > reach)
+      reach = stepreach;
+
+   pad = CLIPRADIUS * FRACUNIT;
+   if(mo->radius > pad)
+      pad = mo->radius;
+   pad += reach;
+
+   box[BOXTOP   ] = mo->y + pad;
+   box[BOXBOTTOM] = mo->y - pad;
+   box[BOXRIGHT ] = mo->x + pad;
+   box[BOXLEFT  ] = mo->x - pad;
+
+   P_BeginMoveQuery(box);
 }
 
 //
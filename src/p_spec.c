@@ -101,6 +101,49 @@ sector_t *getNextSector(line_t *line, sector_t *sec)
    return line->frontsector;
 }
 
+/*================================================================== */
+/* */
+/* CALICO: list the sectors getNextSector finds across each sector's */
+/* lines, once each, so that the searches of the surrounding sectors */
+/* below don't revisit a neighbour for every line they share */
+/* */
+/*================================================================== */
+void P_BuildAdjacentSectors(void)
+{
+   int        i, j, k, total;
+   sector_t  *sector, *other;
+   sector_t **list;
+
+   total = 0;
+   sector = sectors;
+   for(i = 0; i < numsectors; i++, sector++)
+      total += sector->linecount;
+
+   list = Z_Malloc(total * sizeof(sector_t *) + 4, PU_LEVEL, 0);
+
+   sector = sectors;
+   for(i = 0; i < numsectors; i++, sector++)
+   {
+      sector->adjacent      = list;
+      sector->adjacentcount = 0;
+      for(j = 0; j < sector->linecount; j++)
+      {
+         if(!(other = getNextSector(sector->lines[j], sector)))
+            continue;
+
+         // sectors seldom have more than a handful of neighbours
+         for(k = 0; k < sector->adjacentcount; k++)
+         {
+            if(sector->adjacent[k] == other)
+               break;
+         }
+         if(k == sector->adjacentcount)
+            sector->adjacent[sector->adjacentcount++] = other;
+      }
+      list += sector->adjacentcount;
+   }
+}
+
 /*================================================================== */
 /* */
 /* FIND LOWEST FLOOR HEIGHT IN SURROUNDING SECTORS */
@@ -109,16 +152,12 @@ sector_t *getNextSector(line_t *line, sector_t *sec)
 fixed_t	P_FindLowestFloorSurrounding(sector_t *sec)
 {
    int       i;
-   line_t   *check;
    sector_t *other;
    fixed_t   floor = sec->floorheight;
 
-   for(i = 0; i < sec->linecount; i++)
+   for(i = 0; i < sec->adjacentcount; i++) // CALICO: each neighbour once
    {
-      check = sec->lines[i];
-      other = getNextSector(check,sec);
-      if(!other)
-         continue;
+      other = sec->adjacent[i];
       if(other->floorheight < floor)
          floor = other->floorheight;
    }
@@ -133,16 +172,12 @@ fixed_t	P_FindLowestFloorSurrounding(sector_t *sec)
 fixed_t	P_FindHighestFloorSurrounding(sector_t *sec)
 {
    int       i;
-   line_t   *check;
    sector_t *other;
    fixed_t   floor = -500*FRACUNIT;
 
-   for(i = 0; i < sec->linecount; i++)
+   for(i = 0; i < sec->adjacentcount; i++) // CALICO: each neighbour once
    {
-      check = sec->lines[i];
-      other = getNextSector(check, sec);
-      if(!other)
-         continue;			
+      other = sec->adjacent[i];
       if(other->floorheight > floor)
          floor = other->floorheight;
    }
@@ -157,34 +192,20 @@ fixed_t	P_FindHighestFloorSurrounding(sector_t *sec)
 fixed_t	P_FindNextHighestFloor(sector_t *sec,int currentheight)
 {
    int       i;
-   int       h;
-   int       min;
-   line_t   *check;
    sector_t *other;
-   fixed_t   height = currentheight;
-   fixed_t   heightlist[20]; /* 20 adjoining sectors max! */
+   fixed_t   min = D_MAXINT;
 
-   for(i = 0, h = 0; i < sec->linecount; i++)
-   {
-      check = sec->lines[i];
-      other = getNextSector(check,sec);
-      if(!other)
-         continue;
-      if(other->floorheight > height)
-         heightlist[h++] = other->floorheight;
-   }
-	
-   /* */
-   /* Find lowest height in list */
-   /* */
-   min = heightlist[0];
-   for(i = 1; i < h; i++)
+   // CALICO: take the lowest of the higher floors as they are found, from
+   // each neighbour once, instead of from a list which could overflow; if
+   // none are higher, stay at currentheight rather than read an unset value
+   for(i = 0; i < sec->adjacentcount; i++)
    {
-      if(heightlist[i] < min)
-         min = heightlist[i];
+      other = sec->adjacent[i];
+      if(other->floorheight > currentheight && other->floorheight < min)
+         min = other->floorheight;
    }
 
-   return min;
+   return (min == D_MAXINT) ? currentheight : min;
 }
 
 /*================================================================== */
@@ -195,16 +216,12 @@ fixed_t	P_FindNextHighestFloor(sector_t *sec,int currentheight)
 fixed_t	P_FindLowestCeilingSurrounding(sector_t *sec)
 {
    int       i;
-   line_t   *check;
    sector_t *other;
    fixed_t   height = D_MAXINT;
 
-   for(i = 0; i < sec->linecount; i++)
+   for(i = 0; i < sec->adjacentcount; i++) // CALICO: each neighbour once
    {
-      check = sec->lines[i];
-      other = getNextSector(check, sec);
-      if(!other)
-         continue;
+      other = sec->adjacent[i];
       if(other->ceilingheight < height)
          height = other->ceilingheight;
    }
@@ -219,16 +236,12 @@ fixed_t	P_FindLowestCeilingSurrounding(sector_t *sec)
 fixed_t	P_FindHighestCeilingSurrounding(sector_t *sec)
 {
    int       i;
-   line_t   *check;
    sector_t *other;
    fixed_t   height = 0;
 
-   for(i = 0; i < sec->linecount; i++)
+   for(i = 0; i < sec->adjacentcount; i++) // CALICO: each neighbour once
    {
-      check = sec->lines[i];
-      other = getNextSector(check,sec);
-      if(!other)
-         continue;
+      other = sec->adjacent[i];
       if(other->ceilingheight > height)
          height = other->ceilingheight;
    }
@@ -240,16 +253,51 @@ fixed_t	P_FindHighestCeilingSurrounding(sector_t *sec)
 /* RETURN NEXT SECTOR # THAT LINE TAG REFERS TO */
 /* */
 /*================================================================== */
-int P_FindSectorFromLineTag(line_t *line, int start)
+
+// CALICO: the sectors with each tag are chained in sector order from a hash
+// of the tag, so that a line's activation only visits the sectors it could
+// affect, and in the same order as the original scan
+static int *tagfirst; // [numsectors] first sector of each hash chain
+static int *tagnext;  // [numsectors] next sector on the same chain
+
+static int P_TagHash(int tag)
 {
-   int i;
+   return (int)((unsigned int)tag % (unsigned int)numsectors);
+}
 
-   for(i = start+1; i < numsectors; i++)
+//
+// CALICO: build the tag chains, after the sectors are loaded
+//
+void P_InitTagLists(void)
+{
+   int i, h;
+
+   tagfirst = Z_Malloc(numsectors * sizeof(int) + 4, PU_LEVEL, 0);
+   tagnext  = Z_Malloc(numsectors * sizeof(int) + 4, PU_LEVEL, 0);
+
+   for(i = 0; i < numsectors; i++)
+      tagfirst[i] = -1;
+
+   // pushing from the last sector down leaves each chain in sector order
+   for(i = numsectors - 1; i >= 0; i--)
    {
-      if (sectors[i].tag == line->tag)
-         return i;
+      h = P_TagHash(sectors[i].tag);
+      tagnext[i]  = tagfirst[h];
+      tagfirst[h] = i;
    }
-   return -1;
+}
+
+int P_FindSectorFromLineTag(line_t *line, int start)
+{
+   int i;
+
+   // CALICO: follow the tag's chain rather than scanning every sector
+   i = (start < 0) ? tagfirst[P_TagHash(line->tag)] : tagnext[start];
+
+   while(i >= 0 && sectors[i].tag != line->tag)
+      i = tagnext[i];
+
+   return i;
 }
 
 /*================================================================== */
@@ -261,16 +309,12 @@ int P_FindMinSurroundingLight(sector_t *sector,int max)
 {
    int       i;
    int       min;
-   line_t   *line;
    sector_t *check;
 
    min = max;
-   for(i = 0; i < sector->linecount; i++)
+   for(i = 0; i < sector->adjacentcount; i++) // CALICO: each neighbour once
    {
-      line = sector->lines[i];
-      check = getNextSector(line, sector);
-      if(!check)
-         continue;
+      check = sector->adjacent[i];
       if(check->lightlevel < min)
          min = check->lightlevel;
    }
@@ -697,6 +741,7 @@ void P_UpdateSpecials(void)
             }
             S_StartSound((mobj_t *)&buttonlist[i].soundorg, sfx_swtchn);
             D_memset(&buttonlist[i], 0, sizeof(button_t));
+            buttonsbusy &= ~(1u << i); // CALICO
          }
       }
    }
@@ -738,7 +783,7 @@ int EV_DoDonut(line_t *line)
          /* */
          /* Spawn rising slime */
          /* */
-         floor = Z_Malloc (sizeof(*floor), PU_LEVSPEC, 0);
+         floor = Z_SlabAlloc(&floorslab);
          P_AddThinker (&floor->thinker);
          s2->specialdata = floor;
          floor->thinker.function = T_MoveFloor;
@@ -754,7 +799,7 @@ int EV_DoDonut(line_t *line)
          /* */
          /* Spawn lowering donut-hole */
          /* */
-         floor = Z_Malloc (sizeof(*floor), PU_LEVSPEC, 0);
+         floor = Z_SlabAlloc(&floorslab);
          P_AddThinker (&floor->thinker);
          s1->specialdata = floor;
          floor->thinker.function = T_MoveFloor;
@@ -860,6 +905,7 @@ void P_SpawnSpecials(void)
       activeplats[i] = NULL;
    for(i = 0; i < MAXBUTTONS; i++)
       D_memset(&buttonlist[i], 0, sizeof(button_t));
+   buttonsbusy = 0; // CALICO
 }
 
 // EOF
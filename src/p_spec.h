@@ -72,9 +72,11 @@ fixed_t P_FindHighestFloorSurrounding(sector_t *sec);
 fixed_t P_FindNextHighestFloor(sector_t *sec, int currentheight);
 fixed_t P_FindLowestCeilingSurrounding(sector_t *sec);
 fixed_t P_FindHighestCeilingSurrounding(sector_t *sec);
+void    P_InitTagLists(void); // CALICO
 int     P_FindSectorFromLineTag(line_t *line,int start);
 int     P_FindMinSurroundingLight(sector_t *sector,int max);
 sector_t *getNextSector(line_t *line,sector_t *sec);
+void      P_BuildAdjacentSectors(void); // CALICO
 
 /* */
 /* SPECIAL */
@@ -99,9 +101,10 @@ typedef struct
    int        mintime;
 } lightflash_t;
 
+// CALICO: strobes and glows are not thinkers, but kept in arrays which
+// P_RunLightEffects goes through once a tic
 typedef struct
 {
-   thinker_t  thinker;
    sector_t  *sector;
    int        count;
    int        minlight;
@@ -112,7 +115,6 @@ typedef struct
 
 typedef struct
 {
-   thinker_t  thinker;
    sector_t  *sector;
    int        minlight;
    int        maxlight;
@@ -133,6 +135,8 @@ void EV_TurnTagLightsOff(line_t	*line);
 void EV_LightTurnOn(line_t *line, int bright);
 void T_Glow(glow_t *g);
 void P_SpawnGlowingLight(sector_t *sector);
+void P_ClearLightEffects(void); // CALICO
+void P_RunLightEffects(void);   // CALICO
 
 /*
 ===============================================================================
@@ -168,6 +172,7 @@ typedef struct
 #define BUTTONTIME  15 /* 1 second */
 
 extern button_t buttonlist[MAXBUTTONS];	
+extern unsigned int buttonsbusy; // CALICO
 
 void P_ChangeSwitchTexture(line_t *line,int useAgain);
 void P_InitSwitchList(void);
@@ -353,6 +358,7 @@ result_e T_MovePlane(sector_t *sector, fixed_t speed, fixed_t dest, boolean crus
 int  EV_BuildStairs(line_t *line);
 int  EV_DoFloor(line_t *line,floor_e floortype);
 void T_MoveFloor(floormove_t *floor);
+extern slab_t floorslab; // CALICO
 
 /*
 ===============================================================================
@@ -362,7 +368,27 @@ P_TELEPT
 ===============================================================================
 */
 
-int EV_Teleport(line_t *line, mobj_t *thing);
+void P_InitTeleportDests(void); // CALICO
+int  EV_Teleport(line_t *line, mobj_t *thing);
+
+/*
+===============================================================================
+
+P_MOVER
+
+===============================================================================
+*/
+
+// CALICO: sector mover batches
+void    P_InitMovers(void);
+int     P_MoverRunLength(thinker_t **run, int count);
+void    P_RunMoverBatches(thinker_t **run, int count);
+boolean P_InMoverBatch(void);
+boolean P_MoverCheckThing(mobj_t *thing, movecheck_t *mc);
+void    P_MoverSectorChanged(void);
+void    P_SerializeMover(void);
+boolean P_DeferMoverRemoval(void);
+void    P_MoverSound(mobj_t *origin, int sound_id);
 
 #endif
 
@@ -1,3 +1,6 @@
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 #include "doomdef.h"
 #include "p_local.h"
 
@@ -21,6 +24,37 @@ int      switchlist[MAXSWITCHES * 2];
 int      numswitches;
 button_t buttonlist[MAXBUTTONS];
 
+// CALICO: for each texture, the first index in switchlist holding it, or -1
+// if it isn't a switch; the texture it changes to is at the index ^ 1
+static int *switchslot;
+
+// CALICO: bit i is set while buttonlist[i] is counting down
+unsigned int buttonsbusy;
+
+//
+// CALICO: index of the lowest set bit of a nonzero word
+//
+static inline int P_LowestBit(unsigned int bits)
+{
+#if defined(_MSC_VER)
+   unsigned long i;
+
+   _BitScanForward(&i, (unsigned long)bits);
+   return (int)i;
+#elif defined(__GNUC__)
+   return __builtin_ctz(bits);
+#else
+   int i = 0;
+
+   while(!(bits & 1))
+   {
+      bits >>= 1;
+      ++i;
+   }
+   return i;
+#endif
+}
+
 /*
 ===============
 =
@@ -50,6 +84,24 @@ void P_InitSwitchList(void)
    }
 	
    switchlist[index] = -1;
+
+   // CALICO: index the textures, keeping the first entry for each as the
+   // scan through switchlist would find
+   switchslot = Z_Malloc(numtextures * sizeof(int) + 4, PU_STATIC, 0);
+   for(i = 0; i < numtextures; i++)
+      switchslot[i] = -1;
+   for(i = index - 1; i >= 0; i--)
+      switchslot[switchlist[i]] = i;
+}
+
+//
+// CALICO: the switchlist index of a side's texture, or -1
+//
+static int P_SwitchSlot(int texture)
+{
+   if(texture < 0 || texture >= numtextures)
+      return -1;
+   return switchslot[texture];
 }
 
 /*================================================================== */
@@ -62,20 +114,18 @@ void P_StartButton(line_t *line, bwhere_e w, int texture, int time)
 {
    int i;
 
-   for(i = 0; i < MAXBUTTONS; i++)
-   {
-      if(!buttonlist[i].btimer)
-      {
-         buttonlist[i].line = line;
-         buttonlist[i].where = w;
-         buttonlist[i].btexture = texture;
-         buttonlist[i].btimer = time;
-         buttonlist[i].soundorg = (mobj_t *)&line->frontsector->soundorg;
-         return;
-      }
-   }
-		
-   I_Error("P_StartButton: no button slots left!");
+   // CALICO: take the lowest free slot straight from the busy mask
+   if(buttonsbusy == (1u << MAXBUTTONS) - 1)
+      I_Error("P_StartButton: no button slots left!");
+
+   i = P_LowestBit(~buttonsbusy);
+   buttonsbusy |= 1u << i;
+
+   buttonlist[i].line = line;
+   buttonlist[i].where = w;
+   buttonlist[i].btexture = texture;
+   buttonlist[i].btimer = time;
+   buttonlist[i].soundorg = (mobj_t *)&line->frontsector->soundorg;
 }
 
 /*================================================================== */
@@ -89,7 +139,7 @@ void P_ChangeSwitchTexture(line_t *line, int useAgain)
    int texTop;
    int texMid;
    int texBot;
-   int i;
+   int i, slotTop, slotMid, slotBot;
    int sound;
 
    if(!useAgain)
@@ -103,32 +153,36 @@ void P_ChangeSwitchTexture(line_t *line, int useAgain)
    if(line->special == 11)		/* EXIT SWITCH? */
       sound = sfx_swtchx;
 	
-   for (i = 0;i < numswitches*2;i++)
+   // CALICO: look the textures up rather than scanning switchlist; the
+   // scan stopped at the first index matching any of them, trying top, then
+   // middle, then bottom at each, which the lowest slot reproduces
+   slotTop = P_SwitchSlot(texTop);
+   slotMid = P_SwitchSlot(texMid);
+   slotBot = P_SwitchSlot(texBot);
+
+   if(slotTop >= 0 && (slotMid < 0 || slotTop <= slotMid) && (slotBot < 0 || slotTop <= slotBot))
    {
-      if(switchlist[i] == texTop)
-      {
-         S_StartSound(buttonlist->soundorg,sound);
-         sides[line->sidenum[0]].toptexture = switchlist[i^1];
-         if(useAgain)
-            P_StartButton(line,top,switchlist[i],BUTTONTIME);
-         return;
-      }
-      else if(switchlist[i] == texMid)
-      {
-         S_StartSound(buttonlist->soundorg,sound);
-         sides[line->sidenum[0]].midtexture = switchlist[i^1];
-         if(useAgain)
-            P_StartButton(line, middle,switchlist[i],BUTTONTIME);
-         return;
-      }
-      else if(switchlist[i] == texBot)
-      {
-         S_StartSound(buttonlist->soundorg,sound);
-         sides[line->sidenum[0]].bottomtexture = switchlist[i^1];
-         if(useAgain)
-            P_StartButton(line, bottom,switchlist[i],BUTTONTIME);
-         return;
-      }
+      i = slotTop;
+      S_StartSound(buttonlist->soundorg,sound);
+      sides[line->sidenum[0]].toptexture = switchlist[i^1];
+      if(useAgain)
+         P_StartButton(line,top,switchlist[i],BUTTONTIME);
+   }
+   else if(slotMid >= 0 && (slotBot < 0 || slotMid <= slotBot))
+   {
+      i = slotMid;
+      S_StartSound(buttonlist->soundorg,sound);
+      sides[line->sidenum[0]].midtexture = switchlist[i^1];
+      if(useAgain)
+         P_StartButton(line, middle,switchlist[i],BUTTONTIME);
+   }
+   else if(slotBot >= 0)
+   {
+      i = slotBot;
+      S_StartSound(buttonlist->soundorg,sound);
+      sides[line->sidenum[0]].bottomtexture = switchlist[i^1];
+      if(useAgain)
+         P_StartButton(line, bottom,switchlist[i],BUTTONTIME);
    }
 }
 
@@ -46,14 +46,58 @@ void P_Telefrag(mobj_t *thing, fixed_t x, fixed_t y)
 /* */
 /*================================================================== */
 
+// CALICO: the teleport destinations in each sector, in mobj list order, so a
+// teleport only looks at the destinations in the sectors its line is tagged to
+static int     *teledestfirst; // [numsectors+1] offsets into teledests
+static mobj_t **teledests;
+
+//
+// CALICO: index the destinations, once the level's things are spawned
+//
+void P_InitTeleportDests(void)
+{
+   int     i, total, count;
+   mobj_t *m;
+
+   teledestfirst = Z_Malloc((numsectors + 1) * sizeof(int), PU_LEVEL, 0);
+   for(i = 0; i <= numsectors; i++)
+      teledestfirst[i] = 0;
+
+   // count, turn the counts into offsets, then fill
+   for(m = mobjhead.next; m != &mobjhead; m = m->next)
+   {
+      if(m->type == MT_TELEPORTMAN)
+         ++teledestfirst[m->subsector->sector - sectors];
+   }
+
+   total = 0;
+   for(i = 0; i < numsectors; i++)
+   {
+      count            = teledestfirst[i];
+      teledestfirst[i] = total;
+      total           += count;
+   }
+   teledestfirst[numsectors] = total;
+
+   teledests = Z_Malloc(total * sizeof(mobj_t *) + 4, PU_LEVEL, 0);
+   for(m = mobjhead.next; m != &mobjhead; m = m->next)
+   {
+      if(m->type == MT_TELEPORTMAN)
+         teledests[teledestfirst[m->subsector->sector - sectors]++] = m;
+   }
+
+   // filling moved each offset on to the start of the next sector's list
+   for(i = numsectors; i > 0; i--)
+      teledestfirst[i] = teledestfirst[i - 1];
+   teledestfirst[0] = 0;
+}
+
 int EV_Teleport( line_t *line,mobj_t *thing )
 {
-   int      i;
-   int      tag;
+   int      i, j;
    boolean  flag;
    mobj_t   *m,*fog;
    unsigned int	an;
-   sector_t *sector;
    fixed_t   oldx, oldy, oldz;
    int       side;
 	
@@ -65,48 +109,43 @@ int EV_Teleport( line_t *line,mobj_t *thing )
    if(side == 1) /* don't teleport if hit back of line, */
       return 0;  /* so you can get out of teleporter */
 	
-   tag = line->tag;
-   for(i = 0; i < numsectors; i++)
+   // CALICO: look through the tagged sectors' destinations only
+   i = -1;
+   while((i = P_FindSectorFromLineTag(line, i)) >= 0)
    {
-      if (sectors[ i ].tag == tag )
+      for(j = teledestfirst[i]; j < teledestfirst[i + 1]; j++)
       {
-         for(m = mobjhead.next; m != &mobjhead; m = m->next)
-         {
-            // CALICO: skip removed mobjs
-            if(m->latecall == P_RemoveMobjDeferred)
-               continue;
-
-            if(m->type != MT_TELEPORTMAN)
-               continue; // not a teleportman
-
-            sector = m->subsector->sector;
-            if(sector-sectors != i )
-               continue; // wrong sector
-
-            oldx = thing->x;
-            oldy = thing->y;
-            oldz = thing->z;
-            thing->flags |= MF_TELEPORT;
-            P_Telefrag(thing, m->x, m->y);
-            flag = P_TryMove (thing, m->x, m->y);
-            thing->flags &= ~MF_TELEPORT;
-            if(!flag)
-               return 0; /* move is blocked */
-            thing->z = thing->floorz;
-            
-            /* spawn teleport fog at source and destination */
-            fog = P_SpawnMobj (oldx, oldy, oldz, MT_TFOG);
-            S_StartSound(fog, sfx_telept);
-            an  = m->angle >> ANGLETOFINESHIFT;
-            fog = P_SpawnMobj (m->x+20*finecosine[an], m->y+20*finesine[an], thing->z, MT_TFOG);
-            S_StartSound(fog, sfx_telept);
-            if(thing->player)
-               thing->reactiontime = 18;	/* don't move for a bit */
-            thing->angle = m->angle;
-            thing->momx = thing->momy = thing->momz = 0;
-            return 1;
-         }	
-      }
+         m = teledests[j];
+
+         // CALICO: skip removed mobjs
+         if(m->latecall == P_RemoveMobjDeferred)
+            continue;
+
+         oldx = thing->x;
+         oldy = thing->y;
+         oldz = thing->z;
+         thing->flags |= MF_TELEPORT;
+         P_Telefrag(thing, m->x, m->y);
+         flag = P_TryMove (thing, m->x, m->y);
+         thing->flags &= ~MF_TELEPORT;
+         if(!flag)
+            return 0; /* move is blocked */
+         thing->z = thing->floorz;
+         
+         /* spawn teleport fog at source and destination */
+         fog = P_SpawnMobj (oldx, oldy, oldz, MT_TFOG);
+         S_StartSound(fog, sfx_telept);
+         an  = m->angle >> ANGLETOFINESHIFT;
+         fog = P_SpawnMobj (m->x+20*finecosine[an], m->y+20*finesine[an], thing->z, MT_TFOG);
+         S_StartSound(fog, sfx_telept);
+         if(thing->player)
+            thing->reactiontime = 18;	/* don't move for a bit */
+         thing->angle = m->angle;
+         thing->momx = thing->momy = thing->momz = 0;
+         R_ResetMobjInterpolation(thing); // CALICO: don't slide across the map
+         R_PrefetchSprite(thing->sprite, thing->frame); // CALICO: likely never seen yet
+         return 1;
+      }	
    }
    return 0;
 }
@@ -1,15 +1,19 @@
 
+#include <stdlib.h>
 #include "hal/hal_input.h"
 #include "gl/gl_render.h"
 #include "rb/rb_common.h"
 #include "doomdef.h"
 #include "jagcry.h"
+#include "m_prof.h"
+#include "m_trace.h"
 #include "p_local.h"
 
 int playertics, thinkertics, sighttics, basetics, latetics;
 int tictics;
 
 boolean   gamepaused;
+int       worldtic; // CALICO: bumped for each tic the playsim runs
 jagobj_t *pausepic;
 
 /*
@@ -17,7 +21,7 @@ jagobj_t *pausepic;
 
 THINKERS
 
-All thinkers should be allocated by Z_Malloc so they can be operated on uniformly.
+All thinkers should be allocated by Z_SlabAlloc so they can be operated on uniformly.
 The actual structures will vary in size, but the first element must be thinker_t.
 
 Mobjs are similar to thinkers, but kept seperate for more optimal list
@@ -30,6 +34,11 @@ mobj_t    mobjhead;       // head and tail of mobj list
 int       activethinkers; // debug count
 int       activemobjs;    // debug count
 
+// CALICO: thinkers are run from an array in the order they were added,
+// rather than by following the list through the zone
+static thinker_t **thinkers;
+static int         numthinkers, maxthinkers;
+
 /*
 ===============
 =
@@ -42,6 +51,7 @@ void P_InitThinkers(void)
 {
    thinkercap.prev = thinkercap.next = &thinkercap;
    mobjhead.next   = mobjhead.prev   = &mobjhead;
+   numthinkers     = 0;
 }
 
 /*
@@ -60,6 +70,18 @@ void P_AddThinker(thinker_t *thinker)
    thinker->next = &thinkercap;
    thinker->prev = thinkercap.prev;
    thinkercap.prev = thinker;
+
+   if(numthinkers == maxthinkers)
+   {
+      int         newmax = maxthinkers ? maxthinkers * 2 : 256;
+      thinker_t **array;
+
+      if(!(array = realloc(thinkers, newmax * sizeof(*thinkers))))
+         I_Error("P_AddThinker: no memory for %i thinkers", newmax);
+      thinkers    = array;
+      maxthinkers = newmax;
+   }
+   thinkers[numthinkers++] = thinker;
 }
 
 /*
@@ -84,35 +106,53 @@ void P_RemoveThinker(thinker_t *thinker)
 =
 = P_RunThinkers
 =
+= CALICO: removed thinkers are freed and the survivors packed down in the
+= same walk, so the order never changes. A thinker added while running is
+= appended past the walk and still runs this tic, as it did on the list.
+= Runs of sector movers may be handed to P_RunMoverBatches.
+=
 ===============
 */
 
 void P_RunThinkers(void)
 {
    thinker_t *currentthinker;
+   int        i, j, count, run;
 
    activethinkers = 0;
 
-   currentthinker = thinkercap.next;
-   while(currentthinker != &thinkercap)
+   count = 0;
+   for(i = 0; i < numthinkers; i++)
    {
+      currentthinker = thinkers[i];
+
       if(currentthinker->function == (think_t)-1) // CALICO_FIXME: non-portable
       {
          // time to remove it
          currentthinker->next->prev = currentthinker->prev;
          currentthinker->prev->next = currentthinker->next;
-         Z_Free(currentthinker);
+         Z_SlabFree(currentthinker); // CALICO
+         continue;
       }
-      else
+
+      thinkers[count++] = currentthinker;
+      if(currentthinker->function)
       {
-         if(currentthinker->function)
+         if((run = P_MoverRunLength(thinkers + i, numthinkers - i)) > 1)
          {
-            currentthinker->function(currentthinker);
+            // CALICO: none of the run can be removed yet, so it packs down whole
+            for(j = 1; j < run; j++)
+               thinkers[count++] = thinkers[i + j];
+            P_RunMoverBatches(thinkers + count - run, run);
+            activethinkers += run;
+            i += run - 1;
+            continue;
          }
-         activethinkers++;
+         currentthinker->function(currentthinker);
       }
-      currentthinker = currentthinker->next;
+      activethinkers++;
    }
+   numthinkers = count;
 }
 
 //=============================================================================
@@ -191,7 +231,14 @@ void P_CheckCheats(void)
       oldbuttons = oldticbuttons[i];
 
       if((buttons & BT_PAUSE) && !(oldbuttons & BT_PAUSE))
+      {
          gamepaused ^= 1;
+         if(gamepaused)
+         {
+            M_ProfWrite();  // CALICO: snapshot the -profile statistics
+            M_TraceWrite(); // CALICO: and the -trace timeline
+         }
+      }
    }
 
    if(netgame)
@@ -259,11 +306,11 @@ int ticphase;
 
 int P_Ticker(void)
 {
-   //int       start;
-   //int       ticstart;
+   unsigned int start;    // CALICO: timed for -profile
+   unsigned int ticstart;
    player_t *pl;
 
-   //ticstart = samplecount;
+   ticstart = M_ProfStart();
 
    while(!I_RefreshLatched())
       ; // wait for refresh to latch all needed data before running the next tick
@@ -271,6 +318,9 @@ int P_Ticker(void)
    gameaction = ga_nothing;
 
    gametic++;
+
+   // CALICO: frames drawn during this tic start from here
+   R_SaveInterpolation();
  
    //
    // check for pause and cheats
@@ -289,10 +339,12 @@ int P_Ticker(void)
    if(gamepaused)
       return 0;
 
+   ++worldtic; // CALICO: the view may now differ from the last one drawn
+
    //
    // run player actions
    //
-   //start = samplecount;
+   start = M_ProfStart();
    for(playernum = 0, pl = players; playernum < MAXPLAYERS; playernum++, pl++)
    {
       if(playeringame[playernum])
@@ -304,31 +356,36 @@ int P_Ticker(void)
       }
    }
 
-   //playertics = samplecount - start;
+   M_ProfEnd(PROF_PLAYERS, start);
 
-   //start = samplecount;
+   start = M_ProfStart();
    P_RunThinkers();
-   //thinkertics = samplecount - start;
+   P_RunLightEffects(); // CALICO
+   M_ProfEnd(PROF_THINKERS, start);
 
-   //start = samplecount;
+   start = M_ProfStart();
    P_CheckSights();
-   //sighttics = samplecount - start;
+   M_ProfEnd(PROF_SIGHTS, start);
 
-   //start = samplecount;
+   start = M_ProfStart();
    P_RunMobjBase();
-   //basetics = samplecount - start;
+   M_ProfEnd(PROF_MOBJBASE, start);
 
-   //start = samplecount;
+   start = M_ProfStart();
    P_RunMobjLate();
-   //latetics = samplecount - start;
+   M_ProfEnd(PROF_MOBJLATE, start);
 
+   start = M_ProfStart();
    P_UpdateSpecials();
 
    P_RespawnSpecials();
 
    ST_Ticker(); // update status bar
+   M_ProfEnd(PROF_SPECIALS, start);
+
+   P_UpdateStateHash(); // CALICO: -writehash and -checkhash
 
-   //tictics = samplecount - ticstart;
+   M_ProfEnd(PROF_TIC, ticstart);
 
    return gameaction; // may have been set to ga_died, ga_completed, or ga_secretexit
 }
@@ -438,6 +495,7 @@ void P_Drawer(void)
    {
       O_Drawer();
       refreshdrawn = false;
+      R_InvalidateView(mainview); // CALICO
    }
    else if(players[consoleplayer].automapflags & AF_ACTIVE)
    {
@@ -445,18 +503,31 @@ void P_Drawer(void)
       AM_Drawer();
       I_Update();
       refreshdrawn = true;
+      R_InvalidateView(mainview); // CALICO: the automap is drawn over it
    }
    else
    {
       if(gamepaused && refreshdrawn)     // CALICO: do this here
          DrawPlaque(pausepic, "paused");
       ST_Drawer();
-      R_RenderPlayerView();
+      R_RenderPlayerView(mainview, &players[displayplayer]);
       refreshdrawn = true;
       // assume part of the refresh is now running parallel with main code
    }
 } 
  
+//
+// CALICO: Draw the 3D view again between tics. The automap, options screen,
+// and pause plaque are only drawn when a tic has run.
+//
+void P_DrawInterpolated(void)
+{
+   if(gamepaused || (players[consoleplayer].automapflags & (AF_ACTIVE|AF_OPTIONSACTIVE)))
+      return;
+
+   R_RenderPlayerView(mainview, &players[displayplayer]);
+}
+
 extern int ticremainder[2];
 
 void P_Start(void)
@@ -466,12 +537,14 @@ void P_Start(void)
 
    players[0].automapflags = 0;
    players[1].automapflags = 0;
+   R_InvalidateView(mainview); // CALICO
    ticremainder[0] = ticremainder[1] = 0;
    M_ClearRandom();
 }
 
 void P_Stop(void)
 {
+   W_EndWorkingSet(); // CALICO
    Z_FreeTags(mainzone);
 }
 
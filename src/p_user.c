@@ -26,6 +26,7 @@ extern	fixed_t slidex, slidey;
 extern	line_t *specialline;
 
 void P_SlideMove();
+void P_BeginSlideQuery(mobj_t *mo, fixed_t stepx, fixed_t stepy);
 
 void P_PlayerMove(mobj_t *mo)
 {
@@ -34,6 +35,9 @@ void P_PlayerMove(mobj_t *mo)
    momx = vblsinframe*(mo->momx>>2);
    momy = vblsinframe*(mo->momy>>2);
 
+   // CALICO: gather the lines near the whole move once
+   P_BeginSlideQuery(mo, momx, momy);
+
    slidething = mo;
 	
    P_SlideMove ();
@@ -73,6 +77,7 @@ stairstep:
    mo->momx = mo->momy = 0;
 
 dospecial:
+   P_EndMoveQuery();
    if(specialline)
       P_CrossSpecialLine(specialline, mo);
 }
@@ -220,6 +225,66 @@ void P_PlayerMobjThink(mobj_t *mobj)
 
 /*============================================================================= */
 
+//
+// CALICO: how many tics turning has been held for, split from P_BuildMove
+//
+static int P_TurnHeld(int turnheld, int buttons, int oldbuttons)
+{
+   if((buttons & BT_LEFT) && (oldbuttons & BT_LEFT))
+      turnheld++; 
+   else if((buttons & BT_RIGHT) && (oldbuttons & BT_RIGHT))
+      turnheld++; 
+   else 
+      turnheld = 0; 
+
+   if(turnheld >= SLOWTURNTICS)
+      turnheld = SLOWTURNTICS-1;
+
+   return turnheld;
+}
+
+//
+// CALICO: the turn a tic gives for buttons when not strafing, split from
+// P_BuildMove
+//
+static fixed_t P_ButtonTurn(int buttons, int turnheld)
+{
+   fixed_t turn = 0;
+   int     speed = (buttons & BT_SPEED) > 0;
+
+   if(speed && !(buttons&(BT_UP|BT_DOWN)))
+   {
+      if(buttons & BT_RIGHT) 
+         turn = -((fastangleturn[turnheld]*vblsinframe)<<15); 
+      if(buttons & BT_LEFT) 
+         turn = (fastangleturn[turnheld]*vblsinframe)<<15; 
+   }
+   else
+   {
+      if(buttons & BT_RIGHT) 
+         turn = -angleturn[turnheld]<<17; 
+      if(buttons & BT_LEFT) 
+         turn = angleturn[turnheld]<<17; 
+   }
+
+   return turn;
+}
+
+//
+// CALICO: the turn the console player's next tic would make if buttons are
+// still held when it runs. Used to turn the view ahead of the game with
+// -latelatch, so it must not change anything.
+//
+fixed_t P_PredictTurn(player_t *player, int buttons)
+{
+   if(player->playerstate != PST_LIVE || player->mo->reactiontime ||
+      (player->mo->flags & MF_JUSTATTACKED) || (buttons & BT_STRAFE))
+      return 0;
+
+   // the tic will see the buttons it was last given as its old buttons
+   return P_ButtonTurn(buttons, P_TurnHeld(player->turnheld, buttons, ticbuttons[consoleplayer]));
+}
+
 /* 
 ==================== 
 = 
@@ -244,15 +309,7 @@ void P_BuildMove(player_t *player)
    /*  */
    /* use two stage accelerative turning on the joypad  */
    /*  */
-   if((buttons & BT_LEFT) && (oldbuttons & BT_LEFT))
-      player->turnheld++; 
-   else if((buttons & BT_RIGHT) && (oldbuttons & BT_RIGHT))
-      player->turnheld++; 
-   else 
-      player->turnheld = 0; 
-
-   if(player->turnheld >= SLOWTURNTICS)
-      player->turnheld = SLOWTURNTICS-1;
+   player->turnheld = P_TurnHeld(player->turnheld, buttons, oldbuttons); // CALICO
  
    player->forwardmove = player->sidemove = player->angleturn = 0;
 
@@ -264,22 +321,7 @@ void P_BuildMove(player_t *player)
          player->sidemove = -sidemove[speed]; 
    } 
    else 
-   { 
-      if(speed && !(buttons&(BT_UP|BT_DOWN)))
-      {
-         if(buttons & BT_RIGHT) 
-            player->angleturn = -((fastangleturn[player->turnheld]*vblsinframe)<<15); 
-         if(buttons & BT_LEFT) 
-            player->angleturn = (fastangleturn[player->turnheld]*vblsinframe)<<15; 
-      }
-      else
-      {
-         if(buttons & BT_RIGHT) 
-            player->angleturn = -angleturn[player->turnheld]<<17; 
-         if(buttons & BT_LEFT) 
-            player->angleturn = angleturn[player->turnheld]<<17; 
-      }
-   } 
+      player->angleturn = P_ButtonTurn(buttons, player->turnheld); // CALICO
 
    if(buttons & BT_UP) 
       player->forwardmove = forwardmove[speed]; 
@@ -28,8 +28,18 @@
 
 #if defined(__unix__) || defined(__linux__) || defined(__APPLE__)
 
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <termios.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 
 #include "../elib/elib.h"
 #include "../elib/misc.h"
@@ -164,6 +174,219 @@ static void POSIX_SetIcon()
    // FIXME: Not implemented
 }
 
+//
+// Map a whole file into memory for reading. The mapping lasts until exit.
+//
+static const void *POSIX_MapFile(const char *filename, long *length)
+{
+   struct stat sbuf;
+   void *data;
+   int   fd;
+
+   if((fd = open(filename, O_RDONLY)) < 0)
+      return nullptr;
+
+   if(fstat(fd, &sbuf) || sbuf.st_size <= 0)
+   {
+      close(fd);
+      return nullptr;
+   }
+
+   data = mmap(nullptr, size_t(sbuf.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd); // the mapping keeps its own reference
+
+   if(data == MAP_FAILED)
+      return nullptr;
+
+   *length = long(sbuf.st_size);
+   return data;
+}
+
+//
+// Open a serial port as a raw 8N1 line at the given rate
+//
+static hal_serialhandle_t POSIX_OpenSerial(const char *device, int baud)
+{
+   struct termios tio;
+   speed_t speed;
+   int     fd;
+
+   switch(baud)
+   {
+   case 9600:   speed = B9600;   break;
+   case 19200:  speed = B19200;  break;
+   case 38400:  speed = B38400;  break;
+   case 57600:  speed = B57600;  break;
+   case 115200: speed = B115200; break;
+   default:
+      return nullptr;
+   }
+
+   if((fd = open(device, O_RDWR | O_NOCTTY)) < 0)
+      return nullptr;
+
+   if(tcgetattr(fd, &tio))
+   {
+      close(fd);
+      return nullptr;
+   }
+
+   cfmakeraw(&tio);
+   cfsetispeed(&tio, speed);
+   cfsetospeed(&tio, speed);
+   tio.c_cflag |= CLOCAL | CREAD;
+   tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+   tio.c_cc[VMIN]  = 0; // reads return what is there; poll does the waiting
+   tio.c_cc[VTIME] = 0;
+
+   if(tcsetattr(fd, TCSANOW, &tio))
+   {
+      close(fd);
+      return nullptr;
+   }
+   tcflush(fd, TCIOFLUSH);
+
+   // keep the descriptor plus one, so that 0 is not mistaken for no port
+   return reinterpret_cast<hal_serialhandle_t>(intptr_t(fd) + 1);
+}
+
+static int POSIX_SerialFD(hal_serialhandle_t port)
+{
+   return int(reinterpret_cast<intptr_t>(port) - 1);
+}
+
+static void POSIX_CloseSerial(hal_serialhandle_t port)
+{
+   close(POSIX_SerialFD(port));
+}
+
+static int POSIX_ReadSerial(hal_serialhandle_t port, void *buf, int maxlen)
+{
+   struct pollfd pfd;
+   ssize_t len;
+
+   pfd.fd      = POSIX_SerialFD(port);
+   pfd.events  = POLLIN;
+   pfd.revents = 0;
+
+   if(poll(&pfd, 1, 1) <= 0)
+      return 0;
+   if(pfd.revents & (POLLERR | POLLHUP))
+      return -1;
+
+   len = read(pfd.fd, buf, size_t(maxlen));
+   return len < 0 ? -1 : int(len);
+}
+
+static int POSIX_WriteSerial(hal_serialhandle_t port, const void *buf, int len)
+{
+   ssize_t written = write(POSIX_SerialFD(port), buf, size_t(len));
+   return written < 0 ? -1 : int(written);
+}
+
+//
+// Set the calling thread's priority. Real-time threads use SCHED_FIFO, which
+// needs CAP_SYS_NICE or an RLIMIT_RTPRIO grant; without one they fall back
+// to the highest nice value the process may take.
+//
+static int POSIX_SetThreadPriority(int priority)
+{
+   static const int nicevalues[] = { 5, 0, -10 }; // low, normal, high
+   sched_param param;
+
+   if(priority == HAL_PRIORITY_REALTIME)
+   {
+      param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+      if(!pthread_setschedparam(pthread_self(), SCHED_FIFO, &param))
+         return 1;
+      priority = HAL_PRIORITY_HIGH;
+   }
+   else
+   {
+      param.sched_priority = 0;
+      pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+   }
+
+   if(priority < HAL_PRIORITY_LOW || priority > HAL_PRIORITY_HIGH)
+      return 0;
+
+#ifdef __linux__
+   // Linux gives each thread its own nice value
+   id_t tid = id_t(syscall(SYS_gettid));
+   return !setpriority(PRIO_PROCESS, tid, nicevalues[priority - HAL_PRIORITY_LOW]);
+#else
+   return priority == HAL_PRIORITY_NORMAL;
+#endif
+}
+
+//
+// Pin the calling thread to one logical CPU. Only Linux supports this; other
+// systems treat affinity as a hint at most.
+//
+static int POSIX_SetThreadAffinity(int core)
+{
+#ifdef __linux__
+   cpu_set_t set;
+
+   if(core < 0 || core >= CPU_SETSIZE)
+      return 0;
+
+   CPU_ZERO(&set);
+   CPU_SET(core, &set);
+   return !pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+   return 0;
+#endif
+}
+
+//
+// Get the resident set size of the process. The current size is only known
+// on Linux; ru_maxrss is in KB there but in bytes on macOS.
+//
+static void POSIX_GetProcessMemory(size_t *resident, size_t *peak)
+{
+   rusage usage;
+
+   *resident = *peak = 0;
+
+#ifdef __linux__
+   if(FILE *f = fopen("/proc/self/statm", "r"))
+   {
+      unsigned long size, pages;
+      if(fscanf(f, "%lu %lu", &size, &pages) == 2)
+         *resident = size_t(pages) * size_t(sysconf(_SC_PAGESIZE));
+      fclose(f);
+   }
+#endif
+
+   if(!getrusage(RUSAGE_SELF, &usage))
+   {
+#ifdef __APPLE__
+      *peak = size_t(usage.ru_maxrss);
+#else
+      *peak = size_t(usage.ru_maxrss) * 1024;
+#endif
+   }
+}
+
+//
+// Replace a file with a newly-written one. rename does it in one step; the
+// new contents are synced first so they are on the disk by the time the
+// old ones are gone.
+//
+static int POSIX_ReplaceFile(const char *tmpname, const char *filename)
+{
+   int fd;
+
+   if((fd = open(tmpname, O_RDONLY)) >= 0)
+   {
+      fsync(fd);
+      close(fd);
+   }
+
+   return !rename(tmpname, filename);
+}
+
 //
 // Populate the HAL platform interface with POSIX implementation function pointers
 //
@@ -174,6 +397,15 @@ void POSIX_InitHAL(void)
    hal_platform.fatalError        = POSIX_FatalError;
    hal_platform.getWriteDirectory = POSIX_GetWriteDirectory;
    hal_platform.setIcon           = POSIX_SetIcon;
+   hal_platform.mapFile           = POSIX_MapFile;
+   hal_platform.openSerial        = POSIX_OpenSerial;
+   hal_platform.closeSerial       = POSIX_CloseSerial;
+   hal_platform.readSerial        = POSIX_ReadSerial;
+   hal_platform.writeSerial       = POSIX_WriteSerial;
+   hal_platform.setThreadPriority = POSIX_SetThreadPriority;
+   hal_platform.setThreadAffinity = POSIX_SetThreadAffinity;
+   hal_platform.getProcessMemory  = POSIX_GetProcessMemory;
+   hal_platform.replaceFile       = POSIX_ReplaceFile;
 }
 
 #endif
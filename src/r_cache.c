@@ -0,0 +1,202 @@
+/*
+  CALICO
+
+  Decoded graphics cache
+
+  Wall textures, flats, and sprites are decoded to CRY on first use and kept
+  here, replacing the original refzone allocator. Blocks are kept in order of
+  the last frame that used them, and when the cache is over its byte budget
+  the least recently used are evicted first.
+
+  A block is pinned for the rest of the frame whenever it is touched, and may
+  also be pinned explicitly for as long as something outside the frame needs
+  it. Pinned blocks are never evicted; if everything is pinned, the cache is
+  allowed to go over budget rather than free data which is still in use.
+*/
+
+#include <stdlib.h>
+#include "doomdef.h"
+#include "m_alloc.h"
+#include "m_argv.h"
+#include "r_local.h"
+
+#define DEFAULTCACHESIZE (4*1024*1024)
+
+typedef struct rcacheblock_s
+{
+   struct rcacheblock_s *prev, *next; // most recently used first
+   void **user;     // cleared when the block is evicted
+   int    size;     // including this header
+   int    frame;    // last frame the block was touched
+   int    pincount; // explicit pins
+} rcacheblock_t;
+
+static rcacheblock_t cachehead = { &cachehead, &cachehead };
+static int           cachebudget = DEFAULTCACHESIZE;
+
+// bytes in blocks touched during framebytesframe
+static int framebytes, framebytesframe;
+
+rcachestats_t rcachestats;
+
+#define R_CacheBlock(data) ((rcacheblock_t *)((byte *)(data) - sizeof(rcacheblock_t)))
+
+static void R_UnlinkCacheBlock(rcacheblock_t *block)
+{
+   block->prev->next = block->next;
+   block->next->prev = block->prev;
+}
+
+static void R_LinkCacheBlock(rcacheblock_t *block)
+{
+   block->next = cachehead.next;
+   block->prev = &cachehead;
+   cachehead.next->prev = block;
+   cachehead.next = block;
+}
+
+static void R_CountFrameBytes(int size)
+{
+   if(framebytesframe != framecount)
+   {
+      framebytesframe = framecount;
+      framebytes = 0;
+   }
+   framebytes += size;
+}
+
+//
+// Set the cache budget. -cachesize gives it in kilobytes.
+//
+void R_InitCache(void)
+{
+   int p;
+
+   if((p = M_GetArgParameters("-cachesize", 1)))
+   {
+      int kb = atoi(myargv[p]);
+      if(kb > 0)
+         cachebudget = kb * 1024;
+   }
+
+   D_printf("R_InitCache: %i KB\n", cachebudget / 1024);
+}
+
+//
+// Evict least recently used blocks until size more bytes will fit in the
+// budget, or nothing else can be evicted
+//
+static void R_MakeCacheRoom(int size)
+{
+   rcacheblock_t *block = cachehead.prev, *prev;
+   unsigned int   start;
+
+   while(block != &cachehead && rcachestats.bytes + size > cachebudget)
+   {
+      prev = block->prev;
+
+      if(block->frame != framecount && !block->pincount)
+      {
+         R_UnlinkCacheBlock(block);
+         *block->user = NULL;
+         rcachestats.bytes -= block->size;
+         ++rcachestats.evictions;
+         start = M_AllocBegin();
+         free(block);
+         M_FreeEnd(ALLOC_RCACHE, start);
+      }
+
+      block = prev;
+   }
+}
+
+//
+// Allocate size bytes for user, which is set to the new data. The block is
+// pinned for the current frame.
+//
+void *R_CacheAlloc(int size, void **user)
+{
+   rcacheblock_t *block;
+   unsigned int   start;
+
+   size += sizeof(rcacheblock_t);
+
+   R_MakeCacheRoom(size);
+
+   start = M_AllocBegin();
+   if(!(block = malloc(size)))
+      I_Error("R_CacheAlloc: no memory for %i bytes", size);
+   M_AllocEnd(ALLOC_RCACHE, size, start);
+
+   block->user     = user;
+   block->size     = size;
+   block->frame    = framecount;
+   block->pincount = 0;
+   R_LinkCacheBlock(block);
+   R_CountFrameBytes(size);
+
+   ++rcachestats.misses;
+   rcachestats.bytes += size;
+   if(rcachestats.bytes > rcachestats.highwater)
+      rcachestats.highwater = rcachestats.bytes;
+
+   *user = block + 1;
+   return *user;
+}
+
+//
+// Mark cached data as used by the current frame
+//
+void R_CacheTouch(void *data)
+{
+   rcacheblock_t *block = R_CacheBlock(data);
+
+   ++rcachestats.hits;
+
+   if(block->frame != framecount)
+   {
+      block->frame = framecount;
+      R_UnlinkCacheBlock(block);
+      R_LinkCacheBlock(block);
+      R_CountFrameBytes(block->size);
+   }
+}
+
+//
+// Keep cached data from being evicted until a matching R_CacheUnpin
+//
+void R_CachePin(void *data)
+{
+   ++R_CacheBlock(data)->pincount;
+}
+
+void R_CacheUnpin(void *data)
+{
+   rcacheblock_t *block = R_CacheBlock(data);
+
+   if(block->pincount > 0)
+      --block->pincount;
+}
+
+//
+// Return how many more bytes can be cached before the current frame's own
+// data would put the cache over budget
+//
+int R_CacheRoom(void)
+{
+   R_CountFrameBytes(0);
+   return cachebudget - framebytes;
+}
+
+//
+// Report the cache counters
+//
+void R_PrintCacheStats(void)
+{
+   D_printf("R_Cache: %i hits, %i misses, %i evictions, %i/%i KB (peak %i KB)\n",
+            rcachestats.hits, rcachestats.misses, rcachestats.evictions,
+            rcachestats.bytes / 1024, cachebudget / 1024, rcachestats.highwater / 1024);
+}
+
+// EOF
+
@@ -0,0 +1,51 @@
+/*
+  CALICO
+
+  Software renderer configuration
+
+  Mipmapping of distant flats and wall textures is kept in the config file
+  and latched when the renderer starts, since the smaller levels are made
+  as graphics are decoded. Shadow drawing of spectres may be turned on; the
+  Jaguar drew them like any other sprite. Wall columns which would come out
+  the same as the one beside them can be copied rather than drawn again.
+*/
+
+#include "elib/elib.h"
+#include "elib/configfile.h"
+
+//
+// Config Vars
+//
+
+// draw distant flats and walls from smaller copies of their graphics
+static bool render_mipmaps = true;
+
+static CfgItem cfgRenderMipmaps("render_mipmaps", &render_mipmaps);
+
+// darken what is behind MF_SHADOW things instead of drawing their sprites
+static bool render_shadows = false;
+
+static CfgItem cfgRenderShadows("render_shadows", &render_shadows);
+
+// copy a wall column from its neighbour when it would draw the same pixels
+static bool render_dupcolumns = true;
+
+static CfgItem cfgRenderDupColumns("render_dupcolumns", &render_dupcolumns);
+
+extern "C" int R_ConfigMipmaps(void)
+{
+   return render_mipmaps;
+}
+
+extern "C" int R_ConfigShadows(void)
+{
+   return render_shadows;
+}
+
+extern "C" int R_ConfigDupColumns(void)
+{
+   return render_dupcolumns;
+}
+
+// EOF
+
@@ -1,5 +1,6 @@
 /* R_data.c */
 
+#include <string.h>
 #include "doomdef.h"
 #include "r_local.h"
 #include "p_local.h"
@@ -14,6 +15,91 @@ int *texturetranslation; // for global animation
 
 texture_t *skytexturep;
 
+// CALICO: textures and flats hashed by name, each chain holding the lowest
+// numbered first so that a lookup finds what the original scan found
+typedef struct namehash_s
+{
+   int *first; // [mask + 1] first entry in each chain, or -1
+   int *next;  // [count] next entry in the same chain, or -1
+   int  mask;
+} namehash_t;
+
+static namehash_t texturehash, flathash;
+
+//
+// CALICO: a name as eight bytes padded with zeroes; lump names also have
+// their compression bit taken off
+//
+static void R_NameKey(const char *name, char key[8], int charmask)
+{
+   int i;
+
+   D_memset(key, 0, 8);
+   for(i = 0; i < 8 && (name[i] & charmask); i++)
+      key[i] = name[i] & charmask;
+}
+
+static unsigned int R_HashNameKey(const char key[8])
+{
+   unsigned int hash = 0;
+   int i;
+
+   for(i = 0; i < 8 && key[i]; i++)
+      hash = hash * 31 + (unsigned char)key[i];
+
+   return hash;
+}
+
+//
+// CALICO: index count names, found stride bytes apart from names
+//
+static void R_InitNameHash(namehash_t *hash, const char *names, size_t stride,
+                           int count, int charmask)
+{
+   int          i, size = 1;
+   unsigned int h;
+   char         key[8];
+
+   while(size < count)
+      size <<= 1;
+
+   hash->first = Z_Malloc(size * sizeof(int), PU_STATIC, 0);
+   hash->next  = Z_Malloc(count * sizeof(int) + 4, PU_STATIC, 0);
+   hash->mask  = size - 1;
+
+   for(i = 0; i < size; i++)
+      hash->first[i] = -1;
+
+   // pushing the last entry first leaves the lowest at the front
+   for(i = count - 1; i >= 0; i--)
+   {
+      R_NameKey(names + i * stride, key, charmask);
+      h = R_HashNameKey(key) & hash->mask;
+      hash->next[i]  = hash->first[h];
+      hash->first[h] = i;
+   }
+}
+
+//
+// CALICO: find the lowest numbered entry with the given upper-case name
+//
+static int R_FindName(const namehash_t *hash, const char *names, size_t stride,
+                      int charmask, const char *name)
+{
+   char key[8], entrykey[8];
+   int  i;
+
+   R_NameKey(name, key, 0xff);
+   for(i = hash->first[R_HashNameKey(key) & hash->mask]; i != -1; i = hash->next[i])
+   {
+      R_NameKey(names + i * stride, entrykey, charmask);
+      if(!memcmp(key, entrykey, 8))
+         return i;
+   }
+
+   return -1;
+}
+
 //============================================================================
 
 /*
@@ -72,6 +158,9 @@ void R_InitTextures(void)
    texturetranslation = Z_Malloc((numtextures+1)*4, PU_STATIC, 0);
    for(i = 0; i < numtextures; i++)
       texturetranslation[i] = i;
+
+   // CALICO: index the names for R_CheckTextureNumForName
+   R_InitNameHash(&texturehash, textures[0].name, sizeof(texture_t), numtextures, 0xff);
 }
 
 /*
@@ -94,6 +183,9 @@ void R_InitFlats(void)
    flattranslation = Z_Malloc((numflats+1)*4, PU_STATIC, 0);
    for(i = 0; i < numflats; i++)
       flattranslation[i] = i;
+
+   // CALICO: index the names for R_FlatNumForName
+   R_InitNameHash(&flathash, lumpinfo[firstflat].name, sizeof(lumpinfo_t), numflats, 0x7f);
 }
 
 
@@ -111,6 +203,7 @@ void R_InitData(void)
 {
    R_InitTextures();
    R_InitFlats();
+   R_InitMipmaps(); // CALICO
 }
 
 //=============================================================================
@@ -118,15 +211,16 @@ void R_InitData(void)
 /*
 ================
 =
-= R_FlatNumForName
+= R_CheckFlatNumForName
+=
+= CALICO: split from R_FlatNumForName; returns -1 if there is no such flat
 =
 ================
 */
 
-int R_FlatNumForName(const char *name)
+int R_CheckFlatNumForName(const char *name)
 {
    int         i, c;
-   lumpinfo_t *lump_p;
    char        name8[8];
 
    // CALICO: eliminated packing hack
@@ -140,12 +234,25 @@ int R_FlatNumForName(const char *name)
       name8[i] = c;
    }
 
-   lump_p = &lumpinfo[firstflat];
-   for(i = 0; i < numflats; i++, lump_p++)
-   {
-      if(!W_strncasecmp(lump_p->name, name8, sizeof(name8)))
-         return i;
-   }
+   // CALICO: look in the name's hash chain rather than scanning every flat
+   return R_FindName(&flathash, lumpinfo[firstflat].name, sizeof(lumpinfo_t), 0x7f, name8);
+}
+
+/*
+================
+=
+= R_FlatNumForName
+=
+================
+*/
+
+int R_FlatNumForName(const char *name)
+{
+   int i;
+
+   i = R_CheckFlatNumForName(name);
+   if(i != -1)
+      return i;
 
    // CALICO: don't print more than 8 characters
    I_Error("R_FlatNumForName: %.8s not found", name);
@@ -164,7 +271,6 @@ int R_CheckTextureNumForName(const char *name)
 {
    int        i, c;
    char       temp[8];
-   texture_t *texture_p;
 
    if(name[0] == '-') // no texture marker
       return 0;
@@ -180,13 +286,10 @@ int R_CheckTextureNumForName(const char *name)
       temp[i] = c;
    }
 
-   texture_p = textures;
-
-   for(i = 0; i < numtextures; i++, texture_p++)
-   {
-      if(!D_strncasecmp(texture_p->name, temp, sizeof(temp)))
-         return i;
-   }
+   // CALICO: look in the name's hash chain rather than scanning every texture
+   i = R_FindName(&texturehash, textures[0].name, sizeof(texture_t), 0xff, temp);
+   if(i != -1)
+      return i;
 
    return 0; /* FIXME -1; */
 }
@@ -0,0 +1,585 @@
+/*
+  CALICO
+
+  Hardware renderer
+
+  With hardware_render set in the config file, the GL draws the view in
+  place of phases 6 through 8. The walls, flats, and sprites found by phases
+  1 through 5 are handed over as polygons in map space, textured with their
+  CRY graphics, which the GL uploads once and keeps. The software renderer
+  is still the reference; lighting and screen shading follow its rules, but
+  are worked out for each pixel instead of for each column or row.
+
+  Flats need the outline of every subsector, which the map doesn't hold. It
+  is cut out of the BSP the first time each level is drawn.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gl/gl_world.h"
+#include "doomdef.h"
+#include "r_local.h"
+
+// rate at which light falls off with depth, as in phases 6 and 7
+#define WALLLIGHTK 141 // 22 * 8 * 512 / 640
+#define FLATLIGHTK 128 // 1 << SLOPEBITS
+
+#define NUMSKYSTRIPS 16
+#define SKYROWSTEP   (FRACUNIT + 7281) // sky rows per view row, as in phase 6
+
+#define MAXPOLYVERTS 64       // more than any subsector will need
+#define POLYEXTENT   131072.0 // further than any map reaches
+
+// convex outline of a subsector, in map units
+typedef struct sspoly_s
+{
+   int numverts;
+   int firstvert; // into sspolyverts
+} sspoly_t;
+
+static sspoly_t *sspolys;     // [numsubsectors], PU_LEVEL
+static float    *sspolyverts; // x, y pairs, PU_LEVEL
+
+// outlines as they are cut
+static float *cutverts;
+static int    numcutverts, maxcutverts;
+
+// scratch space for converting graphics
+static unsigned int *texels;
+static int           maxtexels;
+
+#define MAPUNITS(f) ((double)(f) / FRACUNIT)
+#define RADIANS(a)  ((double)(a) * (3.14159265358979323846 / ANG180))
+
+//=============================================================================
+//
+// Subsector outlines
+//
+
+//
+// Clip a polygon to the front of the line through (x, y) along (dx, dy),
+// which is the side seen by R_PointOnSide as 0. Returns the number of
+// vertices left.
+//
+static int R_ClipPoly(const double *in, int count, double *out,
+                      double x, double y, double dx, double dy)
+{
+   int i, n = 0;
+
+   for(i = 0; i < count; i++)
+   {
+      const double *a = &in[i * 2];
+      const double *b = &in[((i + 1) % count) * 2];
+      double sa = dx * (a[1] - y) - dy * (a[0] - x);
+      double sb = dx * (b[1] - y) - dy * (b[0] - x);
+
+      if(sa <= 0 && n < MAXPOLYVERTS)
+      {
+         out[n * 2 + 0] = a[0];
+         out[n * 2 + 1] = a[1];
+         ++n;
+      }
+
+      if(((sa < 0 && sb > 0) || (sa > 0 && sb < 0)) && n < MAXPOLYVERTS)
+      {
+         double t = sa / (sa - sb);
+
+         out[n * 2 + 0] = a[0] + t * (b[0] - a[0]);
+         out[n * 2 + 1] = a[1] + t * (b[1] - a[1]);
+         ++n;
+      }
+   }
+
+   return n;
+}
+
+//
+// Trim the part of the map a subsector lies in down to its segs, and keep it
+//
+static void R_FinishOutline(int num, const double *poly, int count)
+{
+   double       buf[2][MAXPOLYVERTS * 2];
+   subsector_t *ss = &subsectors[num];
+   seg_t       *seg = &segs[ss->firstline];
+   int          i, cur = 0;
+
+   memcpy(buf[0], poly, count * 2 * sizeof(double));
+
+   // the subsector is in front of each of its segs
+   for(i = 0; i < ss->numlines && count >= 3; i++, seg++)
+   {
+      double x = MAPUNITS(seg->v1->x), y = MAPUNITS(seg->v1->y);
+
+      count = R_ClipPoly(buf[cur], count, buf[cur ^ 1], x, y,
+                         MAPUNITS(seg->v2->x) - x, MAPUNITS(seg->v2->y) - y);
+      cur ^= 1;
+   }
+
+   if(count < 3)
+      return;
+
+   if(numcutverts + count > maxcutverts)
+   {
+      maxcutverts = (numcutverts + count) * 2;
+      if(!(cutverts = realloc(cutverts, maxcutverts * 2 * sizeof(float))))
+         I_Error("R_FinishOutline: no memory for %i vertices", maxcutverts);
+   }
+
+   sspolys[num].numverts  = count;
+   sspolys[num].firstvert = numcutverts;
+   for(i = 0; i < count * 2; i++)
+      cutverts[numcutverts * 2 + i] = (float)buf[cur][i];
+   numcutverts += count;
+}
+
+//
+// Cut the part of the map covered by a BSP child into its subsectors
+//
+static void R_CutOutlines(int bspnum, const double *poly, int count)
+{
+   double  sub[MAXPOLYVERTS * 2];
+   node_t *node;
+   double  x, y, dx, dy;
+   int     n;
+
+   if(count < 3)
+      return;
+
+   if(bspnum & NF_SUBSECTOR)
+   {
+      R_FinishOutline(bspnum == -1 ? 0 : bspnum & ~NF_SUBSECTOR, poly, count);
+      return;
+   }
+
+   node = &nodes[bspnum];
+   x  = MAPUNITS(node->x);
+   y  = MAPUNITS(node->y);
+   dx = MAPUNITS(node->dx);
+   dy = MAPUNITS(node->dy);
+
+   // the back is in front of the reversed partition line
+   n = R_ClipPoly(poly, count, sub, x, y, dx, dy);
+   R_CutOutlines(node->children[0], sub, n);
+   n = R_ClipPoly(poly, count, sub, x, y, -dx, -dy);
+   R_CutOutlines(node->children[1], sub, n);
+}
+
+//
+// Build the outline of every subsector in the level
+//
+static void R_BuildOutlines(void)
+{
+   static const double world[] =
+   {
+      -POLYEXTENT, -POLYEXTENT,
+      -POLYEXTENT,  POLYEXTENT,
+       POLYEXTENT,  POLYEXTENT,
+       POLYEXTENT, -POLYEXTENT
+   };
+
+   sspolys = Z_Malloc(numsubsectors * sizeof(*sspolys), PU_LEVEL, (void **)&sspolys);
+   D_memset(sspolys, 0, numsubsectors * sizeof(*sspolys));
+
+   numcutverts = 0;
+   R_CutOutlines(numnodes - 1, world, 4);
+
+   sspolyverts = Z_Malloc((numcutverts ? numcutverts : 1) * 2 * sizeof(float), PU_LEVEL,
+                          (void **)&sspolyverts);
+   D_memcpy(sspolyverts, cutverts, numcutverts * 2 * sizeof(float));
+
+   // the cut outlines are only needed until the next level
+   free(cutverts);
+   cutverts    = NULL;
+   maxcutverts = 0;
+}
+
+//=============================================================================
+//
+// Textures
+//
+
+//
+// Get room to convert a graphic of count texels
+//
+static unsigned int *R_TexelBuffer(int count)
+{
+   if(count > maxtexels)
+   {
+      maxtexels = count;
+      if(!(texels = realloc(texels, maxtexels * sizeof(*texels))))
+         I_Error("R_TexelBuffer: no memory for %i texels", maxtexels);
+   }
+
+   return texels;
+}
+
+//
+// Hand a wall texture to the GL, if it doesn't have it yet
+//
+static void R_WallTexture(texture_t *tex)
+{
+   unsigned int *out;
+   pixel_t      *data;
+   int           x, y;
+
+   if(GL_HasWorldTexture(tex->lumpnum))
+      return;
+
+   data = R_LoadPixels(tex->lumpnum);
+   out  = R_TexelBuffer(tex->width * tex->height);
+
+   // textures are stored by column
+   for(x = 0; x < tex->width; x++)
+   {
+      for(y = 0; y < tex->height; y++)
+         out[y * tex->width + x] = 0xff000000u | R_TexelCRY(data, x * tex->height + y);
+   }
+
+   GL_NewWorldTexture(tex->lumpnum, out, tex->width, tex->height);
+}
+
+//
+// Hand a flat to the GL, if it doesn't have it yet
+//
+static void R_FlatTexture(int lump)
+{
+   unsigned int *out;
+   pixel_t      *data;
+   int           i;
+
+   if(GL_HasWorldTexture(lump))
+      return;
+
+   data = R_LoadPixels(lump);
+   out  = R_TexelBuffer(64 * 64);
+
+   for(i = 0; i < 64 * 64; i++)
+      out[i] = 0xff000000u | R_TexelCRY(data, i);
+
+   GL_NewWorldTexture(lump, out, 64, 64);
+}
+
+//
+// Hand a sprite patch to the GL, if it doesn't have it yet. Anywhere not
+// covered by a post is transparent.
+//
+static void R_SpriteTexture(int lump)
+{
+   patch_t       *patch;
+   spriteposts_t *sp;
+   pixel_t       *data;
+   unsigned int  *out;
+   int            height, x, i, y;
+
+   if(GL_HasWorldTexture(lump))
+      return;
+
+   // column pixel data is in the next lump
+   data   = R_LoadPixels(lump + 1);
+   sp     = R_SpritePosts(lump);
+   patch  = (patch_t *)(wadfileptr + BIGLONG(lumpinfo[lump].filepos));
+   height = BIGSHORT(patch->height);
+   out    = R_TexelBuffer(sp->width * height);
+   D_memset(out, 0, sp->width * height * sizeof(*out));
+
+   for(x = 0; x < sp->width; x++)
+   {
+      spritepost_t *post = sp->posts + sp->columns[x].firstpost;
+
+      for(i = 0; i < sp->columns[x].numposts; i++, post++)
+      {
+         for(y = 0; y < post->length && post->topdelta + y < height; y++)
+            out[(post->topdelta + y) * sp->width + x] = 0xff000000u | R_TexelCRY(data, post->dataofs + y);
+      }
+   }
+
+   GL_NewWorldTexture(lump, out, sp->width, height);
+}
+
+//=============================================================================
+//
+// Surfaces
+//
+
+//
+// Lowest light a surface of the given light level falls off to
+//
+static int R_LightMin(int light)
+{
+   int lightmin = light - (255 - light) * 2;
+
+   return lightmin < 0 ? 0 : lightmin;
+}
+
+//
+// Hand over one part of a wall, from z1 up to z2 in fixed point, with
+// texture row 0 at texturemid
+//
+static void R_AddWallPart(rview_t *rv, viswall_t *wall, texture_t *tex,
+                          fixed_t z1, fixed_t z2, fixed_t texturemid)
+{
+   seg_t       *seg = wall->seg;
+   glworldvtx_t v[4];
+   double       x1 = MAPUNITS(seg->v1->x), y1 = MAPUNITS(seg->v1->y);
+   double       x2 = MAPUNITS(seg->v2->x), y2 = MAPUNITS(seg->v2->y);
+   double       u1 = MAPUNITS(wall->offset);
+   double       u2 = u1 + sqrt((x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1));
+   double       vtop = MAPUNITS(texturemid + rv->viewz - z2);
+   double       vbottom = vtop + MAPUNITS(z2 - z1);
+
+   if(z2 <= z1)
+      return;
+
+   R_WallTexture(tex);
+
+   v[0].x = v[1].x = (float)x1;
+   v[0].y = v[1].y = (float)y1;
+   v[2].x = v[3].x = (float)x2;
+   v[2].y = v[3].y = (float)y2;
+   v[0].z = v[3].z = (float)MAPUNITS(z1);
+   v[1].z = v[2].z = (float)MAPUNITS(z2);
+   v[0].u = v[1].u = (float)u1;
+   v[2].u = v[3].u = (float)u2;
+   v[0].v = v[3].v = (float)vbottom;
+   v[1].v = v[2].v = (float)vtop;
+
+   GL_AddWorldSurface(GLWS_WORLD, tex->lumpnum, v, 4, wall->seglightlevel,
+                      R_LightMin(wall->seglightlevel), WALLLIGHTK);
+}
+
+//
+// Hand over the upper and lower, or middle, textures of every wall
+//
+static void R_AddWalls(rview_t *rv)
+{
+   viswall_t *wall;
+
+   for(wall = rv->viswalls; wall < rv->lastwallcmd; wall++)
+   {
+      // a seg split up by closer walls is only drawn once
+      if(wall > rv->viswalls && wall[-1].seg == wall->seg)
+         continue;
+
+      if(wall->actionbits & AC_TOPTEXTURE)
+      {
+         R_AddWallPart(rv, wall, wall->t_texture,
+                       wall->t_bottomheight * (1 << FIXEDTOHEIGHT) + rv->viewz,
+                       wall->t_topheight    * (1 << FIXEDTOHEIGHT) + rv->viewz,
+                       wall->t_texturemid);
+      }
+
+      if(wall->actionbits & AC_BOTTOMTEXTURE)
+      {
+         R_AddWallPart(rv, wall, wall->b_texture,
+                       wall->b_bottomheight * (1 << FIXEDTOHEIGHT) + rv->viewz,
+                       wall->b_topheight    * (1 << FIXEDTOHEIGHT) + rv->viewz,
+                       wall->b_texturemid);
+      }
+   }
+}
+
+//
+// Hand over the floor and ceiling of every subsector which can be seen from
+// the side they face. Sky ceilings only mask off what's behind them.
+//
+static boolean R_AddFlats(rview_t *rv)
+{
+   glworldvtx_t   v[MAXPOLYVERTS];
+   subsector_t  **ssp;
+   boolean        sky = false;
+   int            i;
+
+   for(ssp = rv->vissubsectors; ssp < rv->lastvissubsector; ssp++)
+   {
+      sspoly_t *poly   = &sspolys[*ssp - subsectors];
+      sector_t *sector = (*ssp)->sector;
+      float    *pv     = &sspolyverts[poly->firstvert * 2];
+      int       light  = sector->lightlevel;
+
+      if(poly->numverts < 3)
+         continue;
+
+      for(i = 0; i < poly->numverts; i++)
+      {
+         v[i].x = pv[i * 2 + 0];
+         v[i].y = pv[i * 2 + 1];
+         v[i].u =  v[i].x;
+         v[i].v = -v[i].y;
+      }
+
+      if(sector->floorheight < rv->viewz)
+      {
+         int lump = firstflat + flattranslation[sector->floorpic];
+
+         R_FlatTexture(lump);
+         for(i = 0; i < poly->numverts; i++)
+            v[i].z = (float)MAPUNITS(sector->floorheight);
+         GL_AddWorldSurface(GLWS_WORLD, lump, v, poly->numverts,
+                            light, R_LightMin(light), FLATLIGHTK);
+      }
+
+      if(sector->ceilingheight > rv->viewz || sector->ceilingpic == -1)
+      {
+         for(i = 0; i < poly->numverts; i++)
+            v[i].z = (float)MAPUNITS(sector->ceilingheight);
+
+         if(sector->ceilingpic == -1)
+         {
+            GL_AddWorldSurface(GLWS_SKYMASK, -1, v, poly->numverts, 0, 0, 0);
+            sky = true;
+         }
+         else
+         {
+            int lump = firstflat + flattranslation[sector->ceilingpic];
+
+            R_FlatTexture(lump);
+            GL_AddWorldSurface(GLWS_WORLD, lump, v, poly->numverts,
+                               light, R_LightMin(light), FLATLIGHTK);
+         }
+      }
+   }
+
+   return sky;
+}
+
+//
+// Hand over the sky behind the view, in strips short enough that the way its
+// columns follow the view angle can be drawn as straight lines
+//
+static void R_AddSky(rview_t *rv)
+{
+   glworldvtx_t v[4];
+   const double toview = 1.0 / (1 << rendershift);
+   const double skyv   = (double)SKYROWSTEP / FRACUNIT;
+   int          i;
+
+   R_WallTexture(skytexturep);
+
+   for(i = 0; i < NUMSKYSTRIPS; i++)
+   {
+      int    xl = renderwidth *  i      / NUMSKYSTRIPS;
+      int    xr = renderwidth * (i + 1) / NUMSKYSTRIPS;
+      double ub = (double)(angle_t)(rv->viewangle + xtoviewangle[0]);
+
+      // stay on the same side of the seam for the whole view
+      double ul = ub + (double)(int)(xtoviewangle[xl] - xtoviewangle[0]);
+      double ur = ub + (double)(int)(xtoviewangle[xr] - xtoviewangle[0]);
+
+      v[0].x = v[1].x = (float)(xl * toview);
+      v[2].x = v[3].x = (float)(xr * toview);
+      v[0].y = v[3].y = 0.0f;
+      v[1].y = v[2].y = (float)(renderheight * toview);
+      v[0].z = v[1].z = v[2].z = v[3].z = 0.0f;
+      v[0].u = v[1].u = (float)(ul / (1 << ANGLETOSKYSHIFT));
+      v[2].u = v[3].u = (float)(ur / (1 << ANGLETOSKYSHIFT));
+      v[0].v = v[3].v = 0.0f;
+      v[1].v = v[2].v = (float)(renderheight * toview * skyv);
+
+      GL_AddWorldSurface(GLWS_SKY, skytexturep->lumpnum, v, 4, 255, 255, 0);
+   }
+}
+
+//
+// Hand over every thing's sprite as a flat billboard facing the view
+//
+static void R_AddSprites(rview_t *rv)
+{
+   glworldvtx_t v[4];
+   vissprite_t *spr;
+   double       rx = MAPUNITS(rv->viewsin), ry = -MAPUNITS(rv->viewcos); // view right
+
+   for(spr = rv->vissprites; spr < rv->lastsprite_p; spr++)
+   {
+      double left, right, top, bottom, width;
+      int    light;
+
+      // off the sides of the view?
+      if(!spr->patch)
+         continue;
+
+      R_SpriteTexture(spr->patchnum);
+
+      width  = BIGSHORT(spr->patch->width);
+      left   = -BIGSHORT(spr->patch->leftoffset);
+      right  = left + width;
+      top    = MAPUNITS(spr->gzt);
+      bottom = top - BIGSHORT(spr->patch->height);
+
+      v[0].x = v[1].x = (float)(MAPUNITS(spr->gx) + rx * left);
+      v[0].y = v[1].y = (float)(MAPUNITS(spr->gy) + ry * left);
+      v[2].x = v[3].x = (float)(MAPUNITS(spr->gx) + rx * right);
+      v[2].y = v[3].y = (float)(MAPUNITS(spr->gy) + ry * right);
+      v[0].z = v[3].z = (float)bottom;
+      v[1].z = v[2].z = (float)top;
+      v[0].u = v[1].u = (float)(spr->xiscale < 0 ? width : 0.0);
+      v[2].u = v[3].u = (float)(spr->xiscale < 0 ? 0.0 : width);
+      v[0].v = v[3].v = (float)(top - bottom);
+      v[1].v = v[2].v = 0.0f;
+
+      // there is no shadow draw here; shadows become the darkest sprites
+      light = spr->colormap < 0 ? 0 : spr->colormap;
+
+      GL_AddWorldSurface(GLWS_WORLD, spr->patchnum, v, 4, light, light, 0);
+   }
+}
+
+//
+// Hand over the player's weapon sprites where phase 4 placed them
+//
+static void R_AddPSprites(rview_t *rv)
+{
+   glworldvtx_t v[4];
+   vissprite_t *spr;
+   const double toview = 1.0 / (1 << rendershift);
+
+   for(spr = rv->lastsprite_p; spr < rv->vissprite_p; spr++)
+   {
+      double left, right, top;
+
+      if(spr->x1 > spr->x2)
+         continue;
+
+      R_SpriteTexture(spr->patchnum);
+
+      left  = spr->x1 * toview;
+      right = (spr->x2 + 1) * toview;
+      top   = SCREENHEIGHT / 2 - MAPUNITS(spr->texturemid);
+
+      v[0].x = v[1].x = (float)left;
+      v[2].x = v[3].x = (float)right;
+      v[0].y = v[3].y = (float)(top + BIGSHORT(spr->patch->height));
+      v[1].y = v[2].y = (float)top;
+      v[0].z = v[1].z = v[2].z = v[3].z = 0.0f;
+      v[0].u = v[1].u = 0.0f;
+      v[2].u = v[3].u = (float)(right - left);
+      v[0].v = v[3].v = (float)BIGSHORT(spr->patch->height);
+      v[1].v = v[2].v = 0.0f;
+
+      GL_AddWorldSurface(GLWS_OVERLAY, spr->patchnum, v, 4, spr->colormap, spr->colormap, 0);
+   }
+}
+
+//
+// Hand the view to the GL in place of phases 6 through 8
+//
+void R_RenderHardware(rview_t *rv)
+{
+   if(!sspolys || !sspolyverts)
+      R_BuildOutlines();
+
+   GL_BeginWorld((float)MAPUNITS(rv->viewx), (float)MAPUNITS(rv->viewy),
+                 (float)MAPUNITS(rv->viewz), (float)RADIANS(rv->viewangle));
+
+   R_AddWalls(rv);
+
+   // the sky is only drawn if some sky ceiling can be seen
+   if(R_AddFlats(rv))
+      R_AddSky(rv);
+
+   R_AddSprites(rv);
+   R_AddPSprites(rv);
+}
+
+// EOF
+
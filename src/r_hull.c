@@ -0,0 +1,335 @@
+/*
+  CALICO
+
+  Subsector hulls
+
+  A point is in a subsector when R_PointOnSide puts it on the subsector's
+  side of every partition line on the way down to it from the root node,
+  so finding a subsector costs one side test per level of the tree. Most
+  of those lines are far from the subsector and follow from the few which
+  actually bound it. When a level is set up, each subsector keeps just the
+  partitions which can't be shown to follow from the others, and a thing
+  which is still inside its last subsector is found by testing those.
+
+  The tests made are still R_PointOnSide, so a hinted lookup gives the
+  same subsector as a full descent. A partition is only dropped if every
+  point which passes the rest also passes it, allowing for R_PointOnSide
+  comparing truncated map units against partitions and whole fixed_t
+  values against axis-aligned ones, and leaving a unit to spare for the
+  floating point used to check.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include "doomdef.h"
+#include "r_local.h"
+
+// partitions kept for each subsector; subsectors deeper than MAXHULLDEPTH
+// in the tree are always found by descent
+#define MAXHULLDEPTH 64
+#define MAXHULLVERTS (4 + MAXHULLDEPTH + 1)
+
+typedef struct hull_s
+{
+   int first; // into hullplanes
+   int count; // -1 if there is no hull
+} hull_t;
+
+// a side of a partition as g(x, y) = a*x + b*y + c, in map units, which is
+// positive on the side R_PointOnSide picks
+typedef struct hullplane_s
+{
+   double a, b, c;
+} hullplane_t;
+
+typedef struct hullvert_s
+{
+   double x, y;
+} hullvert_t;
+
+static hull_t  *hulls;      // [numsubsectors], PU_LEVEL
+static int     *hullplanes; // node << 1 | side, deepest first; PU_LEVEL
+static fixed_t  hullbox[4]; // points outside are always found by descent
+
+// level build state
+static int     *buildplanes;
+static int      numbuildplanes, maxbuildplanes;
+static int      hullpath[MAXHULLDEPTH];
+static byte    *exactnode;  // [numnodes]; side tests are exact half-planes
+static double   polybox[4]; // region the checks are made over
+
+//
+// Get the side of a node's partition which R_PointOnSide returns as side.
+// Returns false for a partition of no length, which is always side 0.
+//
+static boolean R_HullPlane(const node_t *node, int side, hullplane_t *p)
+{
+   double ndx = node->dx >> FRACBITS;
+   double ndy = node->dy >> FRACBITS;
+   double nx  = node->x  >> FRACBITS;
+   double ny  = node->y  >> FRACBITS;
+
+   if(!node->dx && !node->dy)
+      return false;
+
+   // axis-aligned partitions only depend on which side they point to
+   if(!node->dx || !node->dy)
+   {
+      ndx = (node->dx > 0) - (node->dx < 0);
+      ndy = (node->dy > 0) - (node->dy < 0);
+   }
+
+   p->a =  ndy;
+   p->b = -ndx;
+   p->c = ndx * ny - ndy * nx;
+
+   if(side)
+   {
+      p->a = -p->a;
+      p->b = -p->b;
+      p->c = -p->c;
+   }
+
+   return true;
+}
+
+static double R_HullValue(const hullplane_t *p, const hullvert_t *v)
+{
+   return p->a * v->x + p->b * v->y + p->c;
+}
+
+//
+// Cut a convex polygon down to where g(x, y) >= min
+//
+static int R_ClipHull(const hullvert_t *in, int count, hullvert_t *out,
+                      const hullplane_t *p, double min)
+{
+   int i, n = 0;
+
+   for(i = 0; i < count; i++)
+   {
+      const hullvert_t *v1 = &in[i];
+      const hullvert_t *v2 = &in[(i + 1) % count];
+      double g1 = R_HullValue(p, v1) - min;
+      double g2 = R_HullValue(p, v2) - min;
+
+      if(g1 >= 0)
+         out[n++] = *v1;
+      if((g1 >= 0) != (g2 >= 0))
+      {
+         double t = g1 / (g1 - g2);
+
+         out[n].x = v1->x + (v2->x - v1->x) * t;
+         out[n].y = v1->y + (v2->y - v1->y) * t;
+         ++n;
+      }
+   }
+
+   return n;
+}
+
+//
+// True if the partition at hullpath[drop] follows from the others still
+// in keep. Any point passing an exact side test is within a unit of a
+// point on the line's side of it in both x and y, so the others are each
+// widened by that much before taking the region they leave.
+//
+static boolean R_HullRedundant(int depth, const boolean *keep, int drop)
+{
+   hullvert_t  verts[2][MAXHULLVERTS];
+   hullplane_t p;
+   int i, n = 4, cur = 0;
+   int node = hullpath[drop] >> 1, side = hullpath[drop] & 1;
+
+   if(!R_HullPlane(&nodes[node], side, &p))
+      return !side; // no length: every point is on side 0
+   if(!exactnode[node])
+      return false;
+
+   verts[0][0].x = polybox[BOXLEFT ]; verts[0][0].y = polybox[BOXBOTTOM];
+   verts[0][1].x = polybox[BOXRIGHT]; verts[0][1].y = polybox[BOXBOTTOM];
+   verts[0][2].x = polybox[BOXRIGHT]; verts[0][2].y = polybox[BOXTOP   ];
+   verts[0][3].x = polybox[BOXLEFT ]; verts[0][3].y = polybox[BOXTOP   ];
+
+   for(i = 0; i < depth && n; i++)
+   {
+      hullplane_t q;
+      int qnode = hullpath[i] >> 1;
+
+      if(i == drop || !keep[i] || !exactnode[qnode])
+         continue;
+      if(!R_HullPlane(&nodes[qnode], hullpath[i] & 1, &q))
+         continue;
+
+      n = R_ClipHull(verts[cur], n, verts[cur ^ 1], &q,
+                     -(fabs(q.a) + fabs(q.b)) - 1.0);
+      cur ^= 1;
+   }
+
+   if(n < 3)
+      return false; // too thin to be sure of
+
+   // it follows if the whole region is far enough inside it for the point
+   // R_PointOnSide actually tests to be inside as well
+   for(i = 0; i < n; i++)
+   {
+      if(R_HullValue(&p, &verts[cur][i]) < fabs(p.a) + fabs(p.b) + 1.0)
+         return false;
+   }
+
+   return true;
+}
+
+//
+// Keep the partitions bounding a subsector reached through hullpath
+//
+static void R_BuildHull(int num, int depth)
+{
+   boolean keep[MAXHULLDEPTH];
+   int i;
+
+   hulls[num].first = numbuildplanes;
+   hulls[num].count = -1;
+
+   if(depth > MAXHULLDEPTH)
+      return;
+
+   for(i = 0; i < depth; i++)
+      keep[i] = true;
+
+   // the deepest partitions are the nearest, so the likeliest to be kept
+   for(i = 0; i < depth; i++)
+   {
+      if(R_HullRedundant(depth, keep, i))
+         keep[i] = false;
+   }
+
+   hulls[num].count = 0;
+   for(i = depth - 1; i >= 0; i--)
+   {
+      if(!keep[i])
+         continue;
+
+      if(numbuildplanes == maxbuildplanes)
+      {
+         maxbuildplanes = maxbuildplanes ? maxbuildplanes * 2 : 1024;
+         if(!(buildplanes = realloc(buildplanes, maxbuildplanes * sizeof(int))))
+            I_Error("R_BuildHull: no memory for %i partitions", maxbuildplanes);
+      }
+      buildplanes[numbuildplanes++] = hullpath[i];
+      ++hulls[num].count;
+   }
+}
+
+//
+// Walk the tree, building the hull of each subsector reached
+//
+static void R_HullNode(int bspnum, int depth)
+{
+   int side;
+
+   if(bspnum & NF_SUBSECTOR)
+   {
+      R_BuildHull(bspnum == -1 ? 0 : bspnum & ~NF_SUBSECTOR, depth);
+      return;
+   }
+
+   for(side = 0; side < 2; side++)
+   {
+      if(depth < MAXHULLDEPTH)
+         hullpath[depth] = (bspnum << 1) | side;
+      R_HullNode(nodes[bspnum].children[side], depth + 1);
+   }
+}
+
+//
+// Build the hulls for a new level. Lookups outside the level's vertices
+// and nodes, or on a level too big for the side tests to be exact
+// half-planes everywhere in it, always descend.
+//
+void R_InitSubsectorHulls(void)
+{
+   fixed_t box[4];
+   double  width, height;
+   int     i;
+
+   hulls = NULL;
+   if(!numnodes || !numvertexes)
+      return;
+
+   M_ClearBox(box);
+   for(i = 0; i < numvertexes; i++)
+      M_AddToBox(box, vertexes[i].x, vertexes[i].y);
+   for(i = 0; i < numnodes; i++)
+      M_AddToBox(box, nodes[i].x, nodes[i].y);
+
+   hullbox[BOXLEFT  ] = box[BOXLEFT  ] - FRACUNIT;
+   hullbox[BOXRIGHT ] = box[BOXRIGHT ] + FRACUNIT;
+   hullbox[BOXBOTTOM] = box[BOXBOTTOM] - FRACUNIT;
+   hullbox[BOXTOP   ] = box[BOXTOP   ] + FRACUNIT;
+
+   // a lattice point from a lookup inside hullbox may be a unit further out
+   polybox[BOXLEFT  ] = (hullbox[BOXLEFT  ] >> FRACBITS) - 1.0;
+   polybox[BOXRIGHT ] = (hullbox[BOXRIGHT ] >> FRACBITS) + 1.0;
+   polybox[BOXBOTTOM] = (hullbox[BOXBOTTOM] >> FRACBITS) - 1.0;
+   polybox[BOXTOP   ] = (hullbox[BOXTOP   ] >> FRACBITS) + 1.0;
+
+   // x - node->x must not overflow in R_PointOnSide
+   width  = polybox[BOXRIGHT] - polybox[BOXLEFT  ];
+   height = polybox[BOXTOP  ] - polybox[BOXBOTTOM];
+   if(width >= 32767.0 || height >= 32767.0)
+      return;
+
+   // nor may either product of a partition and an offset
+   if(!(exactnode = malloc(numnodes)))
+      I_Error("R_InitSubsectorHulls: no memory for %i nodes", numnodes);
+   for(i = 0; i < numnodes; i++)
+   {
+      double ndx = abs(nodes[i].dx >> FRACBITS);
+      double ndy = abs(nodes[i].dy >> FRACBITS);
+
+      exactnode[i] = (ndy * width < 2147483647.0 && ndx * height < 2147483647.0);
+   }
+
+   hulls = Z_Malloc(numsubsectors * sizeof(*hulls), PU_LEVEL, 0);
+   numbuildplanes = 0;
+   R_HullNode(numnodes - 1, 0);
+
+   hullplanes = Z_Malloc((numbuildplanes + 1) * sizeof(int), PU_LEVEL, 0);
+   D_memcpy(hullplanes, buildplanes, numbuildplanes * sizeof(int));
+
+   free(exactnode);
+   exactnode = NULL;
+   free(buildplanes);
+   buildplanes = NULL;
+   maxbuildplanes = 0;
+}
+
+//
+// Find the subsector a point is in, starting with the guess that it is
+// still in hint, which may be NULL. Always gives the same result as
+// R_PointInSubsector.
+//
+struct subsector_s *R_PointInSubsectorHint(fixed_t x, fixed_t y, struct subsector_s *hint)
+{
+   unsigned int num = (unsigned int)(hint - subsectors);
+
+   if(hint && hulls && num < (unsigned int)numsubsectors && hulls[num].count >= 0 &&
+      x >= hullbox[BOXLEFT  ] && x <= hullbox[BOXRIGHT] &&
+      y >= hullbox[BOXBOTTOM] && y <= hullbox[BOXTOP  ])
+   {
+      const int *plane = hullplanes + hulls[num].first;
+      const int *end   = plane + hulls[num].count;
+
+      while(plane != end && R_PointOnSide(x, y, &nodes[*plane >> 1]) == (*plane & 1))
+         ++plane;
+
+      if(plane == end)
+         return hint;
+   }
+
+   return R_PointInSubsector(x, y);
+}
+
+// EOF
+
@@ -0,0 +1,125 @@
+/*
+  CALICO
+
+  Renderer interpolation
+
+  The game still runs at a fixed 15 tics per second, but with -uncapped the
+  view is also drawn between tics. Those frames show the view, mobjs and
+  sector heights part of the way from where they were at the start of the
+  last tic to where they are now. The game's own state is only changed while
+  a frame is being drawn, and is put back before the next tic runs, so demos
+  and net games play out exactly as they would otherwise.
+
+  With -latelatch as well, the console player's view is instead turned on
+  from where it is now by the buttons held as each frame is drawn, so that
+  turning shows up a tic sooner. The game still only turns the player when
+  the next tic runs, from the buttons read then.
+*/
+
+#include "doomdef.h"
+#include "p_local.h"
+
+boolean interpolate;
+boolean latelatch;
+fixed_t renderfrac = FRACUNIT; // FRACUNIT draws everything where it is now
+
+//
+// Remember where everything is at the start of a tic
+//
+void R_SaveInterpolation(void)
+{
+   int       i;
+   mobj_t   *mo;
+   sector_t *sec;
+   player_t *player;
+
+   for(mo = mobjhead.next; mo != &mobjhead; mo = mo->next)
+   {
+      mo->prevx = mo->x;
+      mo->prevy = mo->y;
+      mo->prevz = mo->z;
+   }
+
+   for(i = 0, sec = sectors; i < numsectors; i++, sec++)
+   {
+      sec->prevfloorheight   = sec->floorheight;
+      sec->prevceilingheight = sec->ceilingheight;
+   }
+
+   for(i = 0, player = players; i < MAXPLAYERS; i++, player++)
+   {
+      if(playeringame[i] && player->mo)
+      {
+         player->prevviewz     = player->viewz;
+         player->prevviewangle = player->mo->angle;
+      }
+   }
+}
+
+//
+// Draw an mobj where it is now, rather than sliding it there from where it
+// was at the start of the tic. Used when mobjs are spawned or teleported.
+//
+void R_ResetMobjInterpolation(mobj_t *mo)
+{
+   mo->prevx = mo->x;
+   mo->prevy = mo->y;
+   mo->prevz = mo->z;
+
+   if(mo->player && mo->player->mo == mo)
+   {
+      // viewz is not recalculated until the player next thinks
+      mo->player->prevviewz     = mo->z + mo->player->viewheight;
+      mo->player->prevviewangle = mo->angle;
+   }
+}
+
+//
+// Get the angle to draw a player's view from
+//
+angle_t R_ViewAngle(player_t *player)
+{
+   if(latelatch && renderfrac != FRACUNIT && player == &players[consoleplayer] &&
+      !demoplayback && !gamepaused)
+   {
+      fixed_t turn = P_PredictTurn(player, I_LatchControls());
+      return player->mo->angle + (angle_t)FixedMul(turn, renderfrac);
+   }
+
+   return R_LerpAngle(player->prevviewangle, player->mo->angle);
+}
+
+//
+// Move the sectors to their interpolated heights for the frame being drawn
+//
+void R_InterpolateSectors(void)
+{
+   int i;
+   sector_t *sec;
+
+   for(i = 0, sec = sectors; i < numsectors; i++, sec++)
+   {
+      sec->backfloorheight   = sec->floorheight;
+      sec->backceilingheight = sec->ceilingheight;
+      sec->floorheight       = R_LerpFixed(sec->prevfloorheight,   sec->floorheight);
+      sec->ceilingheight     = R_LerpFixed(sec->prevceilingheight, sec->ceilingheight);
+   }
+}
+
+//
+// Put the sectors back at their actual heights
+//
+void R_RestoreSectors(void)
+{
+   int i;
+   sector_t *sec;
+
+   for(i = 0, sec = sectors; i < numsectors; i++, sec++)
+   {
+      sec->floorheight   = sec->backfloorheight;
+      sec->ceilingheight = sec->backceilingheight;
+   }
+}
+
+// EOF
+
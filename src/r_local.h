@@ -8,11 +8,12 @@
 // proper screen size would be 160*100, stretched to 224 is 2.2 scale
 #define STRETCH (22*FRACUNIT/10)
 
-#define CENTERX     (SCREENWIDTH/2)
-#define CENTERY     (SCREENHEIGHT/2)
-#define CENTERXFRAC (SCREENWIDTH/2*FRACUNIT)
-#define CENTERYFRAC (SCREENHEIGHT/2*FRACUNIT)
-#define PROJECTION  CENTERXFRAC
+// CALICO: these follow the render size
+#define CENTERX     (renderwidth/2)
+#define CENTERY     (renderheight/2)
+#define CENTERXFRAC (renderwidth/2*FRACUNIT)
+#define CENTERYFRAC (renderheight/2*FRACUNIT)
+#define PROJECTION  ((SCREENWIDTH/2*FRACUNIT) << rendershift) // not widened
 
 #define PSPRITEXSCALE  FRACUNIT
 #define PSPRITEYSCALE  FRACUNIT
@@ -51,8 +52,9 @@ typedef struct
 } vertex_t;
 
 struct line_s;
+struct soundedge_s;
 
-typedef struct
+typedef struct sector_s
 {
    fixed_t floorheight, ceilingheight;
    VINT    floorpic, ceilingpic;        // if ceilingpic == -1,draw sky
@@ -66,10 +68,24 @@ typedef struct
    degenmobj_t soundorg;                // for any sounds played by the sector
 
    int     validcount;                  // if == validcount, already checked
+   int     heightgen;                   // CALICO: bumped by P_ChangeSector
    mobj_t *thinglist;                   // list of mobjs in sector
    void   *specialdata;                 // thinker_t for reversable actions
    VINT    linecount;
    struct line_s **lines;               // [linecount] size
+
+   // CALICO: two-sided lines to other sectors, for noise propagation
+   VINT                soundedgecount;
+   struct soundedge_s *soundedges;      // [soundedgecount] size
+
+   // CALICO: the sectors getNextSector finds across the lines, each once
+   VINT              adjacentcount;
+   struct sector_s **adjacent;          // [adjacentcount] size
+
+   // CALICO: heights at the start of the tic, and the actual heights while
+   // an interpolated frame is being drawn
+   fixed_t prevfloorheight, prevceilingheight;
+   fixed_t backfloorheight, backceilingheight;
 } sector_t;
 
 typedef struct
@@ -101,8 +117,21 @@ typedef struct line_s
    int          validcount;               // if == validcount, already checked
    void        *specialdata;              // thinker_t for reversable actions
    int          fineangle;                // to get sine / cosine for sliding
+   VINT         soundopen;                // CALICO: open to sound at the last height change
+
+   // CALICO: cached opening of a two-sided line, current while both
+   // sectors' heightgens match those it was worked out at
+   fixed_t      opentop, openbottom, lowfloor;
+   int          openfrontgen, openbackgen;
 } line_t;
 
+// CALICO: one connection in the sector graph noise floods through
+typedef struct soundedge_s
+{
+   sector_t *other; // sector on the far side
+   line_t   *line;  // two-sided line between them
+} soundedge_t;
+
 typedef struct subsector_s
 {
    sector_t *sector;
@@ -136,7 +165,7 @@ typedef struct
    pixel_t *data;     // cached data to draw from
    int      lumpnum;
    int      usecount; // for precaching
-   int      pad;
+   int      miplevels; // CALICO: smaller levels after the pixels; see r_mipmap.c
 } texture_t;
 
 /*
@@ -203,10 +232,10 @@ extern side_t      *sides;
 //=============================================================================
 
 int  R_PointOnSide(int x, int y, node_t *node);
-int  SlopeDiv(unsigned int num, unsigned int den);
-void R_RenderBSPNode(int bspnum);
+void R_RenderBSPNode(rview_t *rv, int bspnum);
 void R_InitData(void);
-void R_InitSpriteDefs(char **namelist);
+// CALICO: there is no R_InitSpriteDefs; sprite frames are looked up from the
+// tables in sprinfo.c, which sprgen generates along with the WAD
 
 // to get a global angle from cartesian coordinates, the coordinates are
 // flipped until they are in the first octant of the coordinate system, then
@@ -219,8 +248,18 @@ void R_InitSpriteDefs(char **namelist);
 
 extern int tantoangle[SLOPERANGE+1];
 
-extern unsigned short yslope[SCREENHEIGHT];   // 6.10 frac
-extern unsigned short distscale[SCREENWIDTH]; // 1.15 frac
+// CALICO: inline for R_PointToAngle and R_PointToAngle2
+static inline int SlopeDiv(unsigned int num, unsigned int den)
+{
+   unsigned ans;
+   if(den < 512)
+      return SLOPERANGE;
+   ans = (num<<3) / (den>>8);
+   return ans <= SLOPERANGE ? ans : SLOPERANGE;
+}
+
+extern unsigned short *yslope;    // 6.10 frac, [renderheight]
+extern unsigned short *distscale; // 1.15 frac, [renderwidth]
 
 #define HEIGHTBITS 6
 #define SCALEBITS  9
@@ -228,33 +267,38 @@ extern unsigned short distscale[SCREENWIDTH]; // 1.15 frac
 #define FIXEDTOSCALE  (FRACBITS-SCALEBITS)
 #define FIXEDTOHEIGHT (FRACBITS-HEIGHTBITS)
 
-// CALICO
-#define OPENMARK 0xff00
-
-extern fixed_t viewx, viewy, viewz;
-extern angle_t viewangle;
-extern fixed_t viewcos, viewsin;
-
-extern player_t *viewplayer;
-extern boolean   fixedcolormap;
-extern int       extralight;
+// CALICO: openings are packed as top << OPENSHIFT | bottom, which leaves room
+// for heights beyond 255
+#define OPENSHIFT 16
+#define OPENMASK  0xffff
+#define OPENMARK  0xffff0000u
 
 extern angle_t clipangle, doubleclipangle;
 
 // The viewangletox[viewangle + FINEANGLES/4] lookup maps the visible view
 // angles  to screen X coordinates, flattening the arc to a flat projection
 // plane.  There will be many angles mapped to the same X.
-extern int viewangletox[FINEANGLES/2];
+extern int *viewangletox; // [FINEANGLES/2]
 
 // The xtoviewangleangle[] table maps a screen pixel to the lowest viewangle
 // that maps back to x ranges from clipangle to -clipangle
-extern angle_t xtoviewangle[SCREENWIDTH+1];
+extern angle_t *xtoviewangle; // [renderwidth+1]
+
+// CALICO: the tables above are built for the render size by R_InitViewTables
 
 extern fixed_t finetangent[FINEANGLES/2];
 
-extern int validcount;
+extern int validcount; // CALICO: the renderer keeps its own; see rview_t
 extern int framecount;
 
+// CALICO: interpolation between the start of the tic and now; see r_interp.c
+#define R_LerpFixed(prev, cur) ((prev) + FixedMul((cur) - (prev), renderfrac))
+#define R_LerpAngle(prev, cur) ((prev) + (angle_t)FixedMul((int)((cur) - (prev)), renderfrac))
+
+void R_InterpolateSectors(void);
+angle_t R_ViewAngle(player_t *player);
+void R_RestoreSectors(void);
+
 extern int phasetime[9];
 
 //
@@ -272,6 +316,20 @@ extern int *texturetranslation; // for global animation
 
 extern int firstflat, numflats;
 
+//
+// CALICO: r_mipmap.c
+//
+#define MAXMIPLEVELS  4 // levels a wall texture can have after its full size
+#define FLATMIPLEVELS 3 // levels every flat has, each repeated over 64x64
+
+extern boolean r_mipmaps;
+
+void R_InitMipmaps(void);
+int  R_MipOffset(int width, int height, int level);
+int  R_MipPixels(int lumpnum);
+void R_BuildMipmaps(int lumpnum, pixel_t *data);
+int  R_MipLevel(fixed_t step, int maxlevel);
+
 /*
 ==============================================================================
 
@@ -319,8 +377,8 @@ typedef struct
    int           floornewheight;
    int           ceilingheight;
    int           ceilingnewheight;
-   byte         *topsil;
-   byte         *bottomsil;
+   unsigned short *topsil;    // CALICO: widened for heights beyond 255
+   unsigned short *bottomsil;
    //unsigned int  scalefrac;
    fixed_t scalefrac;
    //unsigned int  scale2;
@@ -336,8 +394,55 @@ typedef struct
    int           ceilingpicnum; // ceilingpic # - CALICO: avoid type ambiguity w/extra field
 } viswall_t;
 
+//
+// CALICO: render command pools, which are reset each frame and grown between
+// frames whenever one runs out of room. See r_pool.c.
+//
+typedef struct rpool_s
+{
+   const char *name;
+   void       *base;
+   size_t      size;      // size of one element
+   int         capacity;  // number of elements allocated
+   int         used;      // elements asked for this frame, including any dropped
+   int         highwater; // most elements asked for in any one frame
+} rpool_t;
+
+void    R_InitPool(rpool_t *pool, const char *name, size_t size, int capacity);
+boolean R_ReservePool(rpool_t *pool, int count);
+void   *R_PoolAlloc(rpool_t *pool, int count);
+boolean R_PoolFull(const rpool_t *pool);
+void    R_ResetPool(rpool_t *pool);
+
+// initial pool sizes
 #define MAXWALLCMDS 128
-extern  viswall_t viswalls[MAXWALLCMDS], *lastwallcmd;
+
+//
+// CALICO: a sprite patch's posts, in native byte order, as built by
+// R_SpritePosts. Each column lists its opaque runs from top to bottom.
+//
+typedef struct spritepost_s
+{
+   byte           topdelta;
+   byte           length;
+   unsigned short dataofs;  // into the sprite's pixels
+} spritepost_t;
+
+typedef struct spritecolumn_s
+{
+   unsigned short firstpost;
+   unsigned short numposts;
+} spritecolumn_t;
+
+typedef struct spriteposts_s
+{
+   int             width;
+   spritecolumn_t *columns; // [width]
+   spritepost_t   *posts;
+} spriteposts_t;
+
+spriteposts_t *R_SpritePosts(int lumpnum);
+pixel_t       *R_LoadPixels(int lumpnum);
 
 // A vissprite_t is a thing that will be drawn during a refresh
 typedef struct vissprite_s
@@ -356,30 +461,211 @@ typedef struct vissprite_s
 
    // CALICO: avoid type punning for patch
    int      patchnum;
+
+   spriteposts_t *posts; // CALICO: patch's posts, ready to draw
 } vissprite_t;
 
 #define MAXVISSPRITES 128
-extern vissprite_t vissprites[MAXVISSPRITES], *lastsprite_p, *vissprite_p;
-
-#define MAXOPENINGS SCREENWIDTH*64
-extern unsigned short openings[MAXOPENINGS], *lastopening;
-
+#define MAXOPENINGS (SCREENWIDTH*128) // scaled by the render size
 #define MAXVISSSEC 256
-extern subsector_t *vissubsectors[MAXVISSSEC], **lastvissubsector;
 
-typedef struct
+typedef struct visplane_s
 {
    fixed_t        height;
    pixel_t       *picnum;
    int            lightlevel;
    int            minx, maxx;
-   int            pad1;              // leave pads for [minx-1]/[maxx+1]
-   unsigned short open[SCREENWIDTH]; // top<<8 | bottom
+   int            pad1;                 // leave pads for [minx-1]/[maxx+1]
+   unsigned int   open[MAXRENDERWIDTH]; // top<<OPENSHIFT | bottom
    int            pad2;
+
+   // CALICO: next plane with the same hash, in order of creation
+   struct visplane_s *hashnext;
 } visplane_t;
 
 #define MAXVISPLANES 64
-extern visplane_t visplanes[MAXVISPLANES], *lastvisplane;
+
+// CALICO: open[] is only valid from minx to maxx; all other columns are open
+#define R_PlaneOpen(pl, x) \
+   ((x) < (pl)->minx || (x) > (pl)->maxx || (pl)->open[x] == OPENMARK)
+
+#define PLANEHASHSIZE 64 // must be a power of two
+
+//
+// CALICO: phases 6 through 8 draw the screen as a set of vertical stripes,
+// each of which can be handed off to its own thread.
+//
+#define MAXRSTRIPES 8
+
+typedef struct rstripe_s
+{
+   rview_t    *view;          // the view this stripe is part of
+   int         x1, x2;        // inclusive column range
+   rpool_t     planepool;     // private visplanes
+   visplane_t *visplanes;     // [0] is never drawn; it takes overflow
+   visplane_t *lastvisplane;
+   visplane_t *planehash[PLANEHASHSIZE]; // first plane in each hash chain
+   visplane_t *planetail[PLANEHASHSIZE]; // last plane in each hash chain
+   int        *spanbuffer;    // span commands for R_PlaneLoop
+   int         spanstart[MAXRENDERHEIGHT];
+} rstripe_t;
+
+//
+// CALICO: render context. The view, its command lists, and the state each
+// phase keeps while drawing it all live here rather than in globals, so that
+// separate views can be drawn at the same time. Each view has its own
+// stripes and worker threads. The graphics cache and the zone are still
+// shared, so only phases 6 through 8 of separate views may overlap.
+//
+
+// phase 1 keeps a bit for each column, set once a solid wall covers it
+#define SOLIDWORDS ((MAXRENDERWIDTH + 63) / 64)
+
+// sprite clipping indexes walls in bins of WALLBINWIDTH columns
+#define WALLBINSHIFT 4
+#define WALLBINWIDTH (1 << WALLBINSHIFT)
+#define MAXWALLBINS  ((MAXRENDERWIDTH + WALLBINWIDTH - 1) >> WALLBINSHIFT)
+
+// CALICO: what a view has worked out about a vertex this frame, valid
+// where the stamp matches the view's validcount
+typedef struct rvertex_s
+{
+   int     anglestamp;
+   angle_t angle;      // R_PointToAngle
+   int     diststamp;
+   fixed_t dist;       // R_PointToDist
+} rvertex_t;
+
+// CALICO: a sector's flats as late prep found them this frame, valid where
+// the stamp matches the view's validcount
+typedef struct rsectorpics_s
+{
+   int      stamp;
+   pixel_t *floorpic;
+   pixel_t *ceilingpic; // unused for sky
+} rsectorpics_t;
+
+// CALICO: everything a frame is drawn from besides the level itself, which
+// can only change when the playsim runs a tic
+typedef struct rviewkey_s
+{
+   fixed_t x, y, z;
+   angle_t angle;
+   int     extralight;
+   boolean fixedcolormap;
+   int     shadepixel;
+   fixed_t renderfrac;
+   int     worldtic;
+} rviewkey_t;
+
+struct rview_s
+{
+   // view point, set up by R_Setup
+   fixed_t   viewx, viewy, viewz;
+   angle_t   viewangle;
+   fixed_t   viewcos, viewsin;
+   player_t *viewplayer;
+   boolean   fixedcolormap;
+   int       extralight;
+
+   // CALICO: what the framebuffer was last drawn from, if it still holds it
+   rviewkey_t lastkey;
+   boolean    lastvalid;
+
+   // sectors whose things have been added this frame hold validcount
+   int  validcount;
+   int *sectorvalid;     // [numsectors], PU_LEVEL
+
+   // segs share their vertexes, so each is only worked out once a frame
+   rvertex_t *vertcache; // [numvertexes], PU_LEVEL
+
+   // phase 1
+   uint64_t     solidcols[SOLIDWORDS];
+   int          opencols;  // columns not yet covered by a solid wall
+   seg_t       *curline;
+   angle_t      lineangle1;
+   sector_t    *frontsector;
+   byte        *pvsnodes;  // [numnodes], PU_LEVEL; see R_InitPVS
+   int          pvssector;
+
+   // phase 4
+   rsectorpics_t *sectorpics; // [numsectors], PU_LEVEL
+   boolean cacheneeded;
+   boolean skyvisible; // CALICO: some wall has sky above it
+   fixed_t hyp;
+   angle_t normalangle;
+
+   // command lists, reset by R_Setup
+   rpool_t         subsectorpool;
+   subsector_t   **vissubsectors, **lastvissubsector;
+   rpool_t         wallpool;
+   viswall_t      *viswalls, *lastwallcmd;
+   rpool_t         spritepool;
+   vissprite_t    *vissprites, *lastsprite_p, *vissprite_p;
+   rpool_t         openingpool;
+   unsigned short *openings, *lastopening;
+
+   // columns are only ever touched by the stripe which owns them, so the
+   // stripes can share these
+   unsigned int clipbounds[MAXRENDERWIDTH];     // phase 6
+   int          skycolumns[MAXRENDERWIDTH];     // phase 6, sky texture column
+   unsigned int spropening[MAXRENDERWIDTH + 1]; // phase 8
+
+   // phase 8, shared by all stripes
+   rpool_t       sortpool;
+   vissprite_t **sortedsprites;  // mobj sprites in back-to-front order
+   int           numsortedsprites;
+   rpool_t       wallbinpool;
+   viswall_t   **wallbins;       // NULL if the index is not usable
+   int           wallbinstart[MAXWALLBINS + 1]; // wallbins[] offset of each bin
+
+   // phases 6 through 8
+   rstripe_t        *stripes;
+   int               numstripes;
+   int               activestripes; // in use, fewer with -drawbudget
+   unsigned int      budgetus;      // drawing time over the budget window
+   int               budgetframes;
+   struct rworker_s *renderer;  // runs all stripes with -pipeline, or NULL
+   boolean           rendering; // renderer is drawing a frame
+};
+
+void R_InitView(rview_t *rv);
+
+//
+// CALICO: decoded graphics cache; see r_cache.c
+//
+typedef struct rcachestats_s
+{
+   int hits;      // touches of data already cached
+   int misses;    // data which had to be decoded
+   int evictions;
+   int bytes;     // in use, including block headers
+   int highwater; // most bytes in use at once
+} rcachestats_t;
+
+extern rcachestats_t rcachestats;
+
+void  R_InitCache(void);
+void *R_CacheAlloc(int size, void **user);
+void  R_CacheTouch(void *data);
+void  R_CachePin(void *data);
+void  R_CacheUnpin(void *data);
+int   R_CacheRoom(void);
+void  R_PrintCacheStats(void);
+
+void R_InitStripes(rview_t *rv);
+void R_RenderStripes(rview_t *rv);
+boolean R_BeginStripes(rview_t *rv);
+void R_FinishStripes(rview_t *rv);
+void R_SkyPrep(rview_t *rv);
+void R_SegCommands(rstripe_t *stripe);
+void R_DrawPlanes(rstripe_t *stripe);
+void R_SortSprites(rview_t *rv);
+void R_IndexWalls(rview_t *rv);
+void R_Sprites(rstripe_t *stripe);
+
+// CALICO: drawing with the GL in place of phases 6 through 8; see r_hardware.c
+void R_RenderHardware(rview_t *rv);
 
 #endif // __R_LOCAL__
 
@@ -1,46 +1,24 @@
 /* r_main.c */
 
+#include <stdlib.h>
 #include "gl/gl_render.h"
+#include "gl/gl_world.h"
 #include "doomdef.h"
+#include "m_prof.h"
 #include "r_local.h"
 
-//=====================================
-
-// subsectors
-subsector_t *vissubsectors[MAXVISSSEC], **lastvissubsector;
-
-// walls
-viswall_t viswalls[MAXWALLCMDS], *lastwallcmd;
-
-// planes
-visplane_t visplanes[MAXVISPLANES], *lastvisplane;
-
-// sprites
-vissprite_t vissprites[MAXVISSPRITES], *lastsprite_p, *vissprite_p;
-
-// openings / misc refresh memory
-unsigned short openings[MAXOPENINGS], *lastopening;
-
-//=====================================
-
 boolean phase1completed;
 
 pixel_t *workingscreen;
 
+// CALICO: the view drawn by R_RenderPlayerView; see r_local.h
+static rview_t mainviewdata;
+rview_t *mainview = &mainviewdata;
 
-fixed_t   viewx, viewy, viewz;
-angle_t   viewangle;
-fixed_t   viewcos, viewsin;
-player_t *viewplayer;
-
-int validcount = 1; // increment every time a check is made 
+int validcount = 1; // increment every time a check is made; CALICO: playsim only
 int framecount;     // incremented every frame
 
-
-boolean fixedcolormap;
-
 int lightlevel; // fixed light level
-int extralight; // bumped light from gun blasts
 
 //
 // sky mapping
@@ -52,6 +30,12 @@ int skytexture;
 // precalculated math
 //
 angle_t clipangle, doubleclipangle;
+
+// CALICO: view tables for the render size
+int            *viewangletox;
+angle_t        *xtoviewangle;
+unsigned short *yslope;
+unsigned short *distscale;
 fixed_t *finecosine = &finesine[FINEANGLES/4];
 
 /*
@@ -62,17 +46,6 @@ fixed_t *finecosine = &finesine[FINEANGLES/4];
 ===============================================================================
 */
 
-extern int tantoangle[SLOPERANGE+1];
-
-int SlopeDiv(unsigned int num, unsigned int den)
-{
-   unsigned ans;
-   if(den < 512)
-      return SLOPERANGE;
-   ans = (num<<3) / (den>>8);
-   return ans <= SLOPERANGE ? ans : SLOPERANGE;
-}
-
 angle_t R_PointToAngle2(fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2)
 {
    int x;
@@ -196,6 +169,93 @@ struct subsector_s *R_PointInSubsector(fixed_t x, fixed_t y)
 
 //=============================================================================
 
+//
+// CALICO: Build the view tables for a width x height view with the given
+// horizontal focal length, the same way the Jaguar tables were built. At
+// 160x180 with the original focal length this gives exactly the tables the
+// original shipped with, so every render size comes from here. A view wider
+// than the playfield with the same focal length sees more to either side,
+// rather than being stretched.
+//
+static void R_BuildViewTables(int width, int height, fixed_t focallength)
+{
+   int i, x, t;
+   fixed_t centerxfrac = width/2*FRACUNIT;
+   int     yproj = 22*8 * height / SCREENHEIGHT;
+
+   viewangletox = malloc(FINEANGLES/2 * sizeof(*viewangletox));
+   xtoviewangle = malloc((width + 1) * sizeof(*xtoviewangle));
+   yslope       = malloc(height * sizeof(*yslope));
+   distscale    = malloc(width * sizeof(*distscale));
+
+   if(!viewangletox || !xtoviewangle || !yslope || !distscale)
+      I_Error("R_BuildViewTables: no memory for %ix%i", width, height);
+
+   // use tangent table to generate viewangletox
+   for(i = 0; i < FINEANGLES/2; i++)
+   {
+      if(finetangent[i] > FRACUNIT*2)
+         t = -1;
+      else if(finetangent[i] < -FRACUNIT*2)
+         t = width + 1;
+      else
+      {
+         t = FixedMul(finetangent[i], focallength);
+         t = (centerxfrac - t + FRACUNIT - 1) >> FRACBITS;
+         if(t < -1)
+            t = -1;
+         else if(t > width + 1)
+            t = width + 1;
+      }
+      viewangletox[i] = t;
+   }
+
+   // scan viewangletox to generate xtoviewangle, the smallest view angle
+   // that maps to each x
+   for(x = 0; x <= width; x++)
+   {
+      i = 0;
+      while(viewangletox[i] > x)
+         i++;
+      xtoviewangle[x] = (i << ANGLETOFINESHIFT) - ANG90;
+   }
+
+   // take out the fencepost cases from viewangletox
+   for(i = 0; i < FINEANGLES/2; i++)
+   {
+      if(viewangletox[i] == -1)
+         viewangletox[i] = 0;
+      else if(viewangletox[i] == width + 1)
+         viewangletox[i] = width;
+   }
+
+   // distance from the view plane for each row, in 6.10
+   for(i = 0; i < height; i++)
+   {
+      int dy2 = D_abs(2*i - height + 1);
+      int ys  = dy2 ? (yproj * 1024 * 2 - 1) / dy2 : 0xffff;
+
+      yslope[i] = ys > 0xffff ? 0xffff : ys;
+   }
+
+   // distance correction for each column, in 1.15
+   for(x = 0; x < width; x++)
+   {
+      fixed_t cosadj = D_abs(finecosine[xtoviewangle[x] >> ANGLETOFINESHIFT]);
+      distscale[x] = FixedDiv(FRACUNIT, cosadj) >> 1;
+   }
+}
+
+//
+// CALICO: Set up the view tables for the render size. FIELDOFVIEW spans the
+// playfield; a widened view keeps its focal length.
+//
+static void R_InitViewTables(void)
+{
+   R_BuildViewTables(renderwidth, renderheight, 
+                     FixedDiv(PROJECTION, finetangent[FINEANGLES/4 + FIELDOFVIEW/2]));
+}
+
 /*
 ==============
 =
@@ -210,11 +270,36 @@ void R_Init(void)
    R_InitData();
    D_printf("Done\n");
 
+   R_InitCache();
+
+   R_InitViewTables();
+
    clipangle = xtoviewangle[0];
    doubleclipangle = clipangle*2;
 
    framecount = 0;
-   viewplayer = &players[0];
+
+   R_InitView(mainview);
+}
+
+//
+// CALICO: set up a render context. Views are never freed.
+//
+void R_InitView(rview_t *rv)
+{
+   D_memset(rv, 0, sizeof(*rv));
+
+   rv->viewplayer = &players[0];
+   rv->pvssector  = -1;
+
+   R_InitPool(&rv->subsectorpool, "vissubsectors", sizeof(*rv->vissubsectors), MAXVISSSEC);
+   R_InitPool(&rv->wallpool,      "viswalls",      sizeof(*rv->viswalls),      MAXWALLCMDS);
+   R_InitPool(&rv->spritepool,    "vissprites",    sizeof(*rv->vissprites),    MAXVISSPRITES);
+   R_InitPool(&rv->openingpool,   "openings",      sizeof(*rv->openings),      MAXOPENINGS * renderwidth / SCREENWIDTH);
+   R_InitPool(&rv->sortpool,      "sortedsprites", sizeof(*rv->sortedsprites), MAXVISSPRITES * 2);
+   R_InitPool(&rv->wallbinpool,   "wallbins",      sizeof(*rv->wallbins),      MAXWALLCMDS);
+
+   R_InitStripes(rv);
 }
 
 //============================================================================= 
@@ -258,6 +343,17 @@ void R_DebugScreen(void)
 
 int shadepixel;
 
+//
+// CALICO: true if a frame drawn from a would be the same as one drawn from b
+//
+static boolean R_SameViewKey(const rviewkey_t *a, const rviewkey_t *b)
+{
+   return a->x == b->x && a->y == b->y && a->z == b->z && a->angle == b->angle &&
+          a->extralight == b->extralight && a->fixedcolormap == b->fixedcolormap &&
+          a->shadepixel == b->shadepixel && a->renderfrac == b->renderfrac &&
+          a->worldtic == b->worldtic;
+}
+
 /*
 ==================
 =
@@ -266,11 +362,11 @@ int shadepixel;
 ==================
 */
 
-void R_Setup(void)
+boolean R_Setup(rview_t *rv, player_t *player)
 {
    int damagecount, bonuscount;
-   player_t *player;
    int shadex, shadey, shadei;
+   rviewkey_t key;
 
 #if 0
    //
@@ -283,23 +379,17 @@ void R_Setup(void)
    *(int *)0xf0226c = *(int *)0xf02268 = 0; // pattern compare
 #endif
 
-   // CALICO: framebuffer is modified
-   GL_FramebufferSetUpdated(FB_160);
+   rv->viewplayer = player;
+   rv->viewx = R_LerpFixed(player->mo->prevx, player->mo->x);
+   rv->viewy = R_LerpFixed(player->mo->prevy, player->mo->y);
+   rv->viewz = R_LerpFixed(player->prevviewz, player->viewz);
+   rv->viewangle = R_ViewAngle(player);
 
-   framecount++;
-   validcount++;
+   rv->viewsin = finesine[rv->viewangle>>ANGLETOFINESHIFT];
+   rv->viewcos = finecosine[rv->viewangle>>ANGLETOFINESHIFT];
 
-   viewplayer = player = &players[displayplayer];
-   viewx = player->mo->x;
-   viewy = player->mo->y;
-   viewz = player->viewz;
-   viewangle = player->mo->angle;
-
-   viewsin = finesine[viewangle>>ANGLETOFINESHIFT];
-   viewcos = finecosine[viewangle>>ANGLETOFINESHIFT];
-
-   extralight = player->extralight << 6;
-   fixedcolormap = player->fixedcolormap;
+   rv->extralight = player->extralight << 6;
+   rv->fixedcolormap = player->fixedcolormap;
 
    //
    // calc shadepixel
@@ -354,28 +444,67 @@ void R_Setup(void)
 
    shadepixel = ((shadex<<12)&0xf000) + ((shadey<<8)&0xf00) + (shadei&0xff);
 
+   // CALICO: a CRY framebuffer is shaded on the GPU, as it is decoded
+   GL_SetFramebufferShade(FB_160, shadepixel);
+
+   // CALICO: if the view and the level are as they were when the framebuffer
+   // was last drawn, as while paused, it already holds this frame
+   key.x             = rv->viewx;
+   key.y             = rv->viewy;
+   key.z             = rv->viewz;
+   key.angle         = rv->viewangle;
+   key.extralight    = rv->extralight;
+   key.fixedcolormap = rv->fixedcolormap;
+   key.shadepixel    = shadepixel;
+   key.renderfrac    = gamepaused ? FRACUNIT : renderfrac; // paused tics save every position
+   key.worldtic      = worldtic;
+
+   if(rv->lastvalid && !GL_WorldAvailable() && R_SameViewKey(&key, &rv->lastkey))
+      return false;
+
+   // the GL draws its own view, and leaves nothing in the framebuffer
+   rv->lastkey   = key;
+   rv->lastvalid = !GL_WorldAvailable();
+
+   // CALICO: framebuffer is modified
+   GL_FramebufferSetUpdated(FB_160);
+
+   framecount++;
+   rv->validcount++;
+
    //
    // plane filling
    //
-   lastvisplane = visplanes+1;       // visplanes[0] is left empty
-   lastwallcmd = viswalls;           // no walls added yet 
-   lastvissubsector = vissubsectors; // no subsectors visible yet
+   R_ResetPool(&rv->wallpool);
+   R_ResetPool(&rv->subsectorpool);
+   rv->lastwallcmd = rv->viswalls = rv->wallpool.base;                // no walls added yet 
+   rv->lastvissubsector = rv->vissubsectors = rv->subsectorpool.base; // no subsectors visible yet
 
    //
    // clear sprites
    //
-   vissprite_p = vissprites;
-   lastopening = openings;
+   R_ResetPool(&rv->spritepool);
+   R_ResetPool(&rv->openingpool);
+   rv->vissprite_p = rv->vissprites = rv->spritepool.base;
+   rv->lastopening = rv->openings = rv->openingpool.base;
+
+   return true;
+}
+
+//
+// CALICO: make the next frame of a view be drawn, whether or not it looks
+// unchanged, as when something else has drawn over its framebuffer
+//
+void R_InvalidateView(rview_t *rv)
+{
+   rv->lastvalid = false;
 }
 
-void    R_BSP(void);
-void    R_WallPrep(void);
-void    R_SpritePrep(void);
-boolean R_LatePrep(void);
-void    R_Cache(void);
-void    R_SegCommands(void);
-void    R_DrawPlanes(void);
-void    R_Sprites(void);
+void    R_BSP(rview_t *rv);
+void    R_WallPrep(rview_t *rv);
+void    R_SpritePrep(rview_t *rv);
+boolean R_LatePrep(rview_t *rv);
+void    R_Cache(rview_t *rv);
 void    R_Update(void);
 
 /*
@@ -399,26 +528,113 @@ extern int ref8_start;
 
 extern boolean debugscreenactive;
 
-void R_RenderPlayerView(void)
+// CALICO: a view left drawing on its render thread, see R_FinishRefresh
+static rview_t     *pendingview;
+static unsigned int pendingframestart;
+
+//
+// CALICO: wait for a frame whose phases 6 through 8 were left running on the
+// next game tic, then send it to the screen. Does nothing if no frame is
+// outstanding.
+//
+void R_FinishRefresh(void)
 {
+   unsigned int start;
+
+   if(!pendingview)
+      return;
+
+   R_FinishStripes(pendingview);
+   pendingview = NULL;
+
+   start = M_ProfStart();
+   R_Update();
+   M_ProfEnd(PROF_UPDATE, start);
+
+   M_ProfEnd(PROF_FRAME, pendingframestart);
+}
+
+//
+// CALICO: draw player's view of the world into rv
+//
+void R_RenderPlayerView(rview_t *rv, player_t *player)
+{
+   unsigned int framestart, start; // CALICO: for -profile
+   boolean      cache;
+
+   // CALICO: the view can't be set up again while it is still being drawn
+   R_FinishRefresh();
+
    //
    // initial setup
    //
    if(debugscreenactive)
       R_DebugScreen();
 
-   R_Setup();
+   framestart = M_ProfStart();
+
+   // CALICO: nothing to draw if the framebuffer already holds this frame
+   if(!R_Setup(rv, player))
+   {
+      start = M_ProfStart();
+      R_Update();
+      M_ProfEnd(PROF_UPDATE, start);
+
+      M_ProfEnd(PROF_FRAME, framestart);
+      return;
+   }
+
+   // CALICO: sectors are only moved for frames drawn between tics
+   if(renderfrac != FRACUNIT)
+      R_InterpolateSectors();
+
+   start = M_ProfStart();
+   R_BSP(rv);
+   M_ProfEnd(PROF_BSP, start);
+
+   start = M_ProfStart();
+   R_WallPrep(rv);
+   M_ProfEnd(PROF_WALLPREP, start);
+
+   start = M_ProfStart();
+   R_SpritePrep(rv);
+   M_ProfEnd(PROF_SPRITEPREP, start);
 
-   R_BSP();
-   R_WallPrep();
-   R_SpritePrep();
    // the rest of the refresh can be run in parallel with the next game tic
-   if(R_LatePrep())
-      R_Cache();
-   R_SegCommands();
-   R_DrawPlanes();
-   R_Sprites();
+   start = M_ProfStart();
+   cache = R_LatePrep(rv);
+   M_ProfEnd(PROF_LATEPREP, start);
+   if(cache)
+   {
+      start = M_ProfStart();
+      R_Cache(rv);
+      M_ProfEnd(PROF_CACHE, start);
+   }
+
+   // CALICO: phases 6 through 8, or the GL in their place
+   if(GL_WorldAvailable())
+      R_RenderHardware(rv);
+   else if(R_BeginStripes(rv))
+   {
+      // -pipeline: the stripes draw while the next tic runs, and the frame
+      // goes to the screen when the refresh is next waited for
+      if(renderfrac != FRACUNIT)
+         R_RestoreSectors();
+      pendingview       = rv;
+      pendingframestart = framestart;
+      return;
+   }
+   else
+      R_RenderStripes(rv);
+
+   if(renderfrac != FRACUNIT)
+      R_RestoreSectors();
+
+   start = M_ProfStart();
    R_Update();
+   M_ProfEnd(PROF_UPDATE, start);
+
+   M_ProfEnd(PROF_FRAME, framestart);
 }
 
 // EOF
@@ -0,0 +1,242 @@
+/*
+  CALICO
+
+  Renderer mipmaps
+
+  With render_mipmaps set, flats and wall textures are decoded with a chain
+  of smaller levels after their pixels, each half the size of the one before
+  it, and distant spans and columns are drawn from the level nearest to one
+  texel per pixel. Those touch far fewer texels, so they stay in the cache
+  and no longer shimmer as the view moves.
+
+  Wall texture levels follow on in the same column-major layout as the full
+  size pixels. The span drawers only address 64x64 flats, so each smaller
+  flat level is repeated over a whole 64x64 square instead; a span drawn
+  from it with its coordinates shifted down by the level lands on the right
+  texel without the drawers knowing.
+
+  Texels are averaged in CRY a component at a time. The C and R components
+  index a grid of hues, which the average of texels as alike as those in
+  one texture follows closely enough.
+*/
+
+#include "doomdef.h"
+#include "jagcry.h"
+#include "r_local.h"
+
+#define FLATSIZE 64
+
+boolean r_mipmaps;       // latched from render_mipmaps by R_InitMipmaps
+static int *lumptexture; // [numlumps] texture number + 1 of each lump, or 0
+
+extern int R_ConfigMipmaps(void);
+
+//
+// Number of levels after the full size one which a texture can have
+//
+static int R_CountMipLevels(int width, int height)
+{
+   int levels = 0;
+
+   if(width < 1 || height < 1 || (width & (width - 1)) || (height & (height - 1)))
+      return 0; // the column drawers can't step through odd sized levels
+
+   while(levels < MAXMIPLEVELS && (width >> (levels + 1)) && (height >> (levels + 1)))
+      ++levels;
+
+   return levels;
+}
+
+//
+// Pixels in the levels of a width by height texture before the given one
+//
+int R_MipOffset(int width, int height, int level)
+{
+   int i, offset = 0;
+
+   for(i = 0; i < level; i++)
+      offset += (width >> i) * (height >> i);
+
+   return offset;
+}
+
+//
+// Work out which textures can have mipmaps. Called once the textures and
+// flats are known.
+//
+void R_InitMipmaps(void)
+{
+   int i;
+
+   // palette indices can't be averaged, so compact pixels have no levels
+   if(!(r_mipmaps = (R_ConfigMipmaps() && !compactpixels)))
+      return;
+
+   lumptexture = Z_Malloc(numlumps * sizeof(*lumptexture), PU_STATIC, NULL);
+   D_memset(lumptexture, 0, numlumps * sizeof(*lumptexture));
+
+   for(i = 0; i < numtextures; i++)
+   {
+      texture_t *tex  = &textures[i];
+      int        lump = tex->lumpnum;
+
+      // the pixels must be exactly the texture, as the levels follow them
+      if(!lump || BIGLONG(lumpinfo[lump].size) != tex->width * tex->height)
+         continue;
+
+      if(lumptexture[lump])
+      {
+         // another texture drawing from the same lump shares its levels
+         texture_t *first = &textures[lumptexture[lump] - 1];
+
+         if(first->width == tex->width && first->height == tex->height)
+            tex->miplevels = first->miplevels;
+         continue;
+      }
+
+      if((tex->miplevels = R_CountMipLevels(tex->width, tex->height)))
+         lumptexture[lump] = i + 1;
+   }
+}
+
+static inline boolean R_IsFlat(int lumpnum)
+{
+   return lumpnum >= firstflat && lumpnum < firstflat + numflats;
+}
+
+//
+// Pixels to allocate after a lump's own for its mipmaps
+//
+int R_MipPixels(int lumpnum)
+{
+   texture_t *tex;
+
+   if(!r_mipmaps)
+      return 0;
+
+   // flats are always drawn as 64x64, whatever the lump holds
+   if(R_IsFlat(lumpnum))
+      return FLATMIPLEVELS * FLATSIZE * FLATSIZE;
+
+   if(!lumptexture[lumpnum])
+      return 0;
+
+   tex = &textures[lumptexture[lumpnum] - 1];
+   return R_MipOffset(tex->width, tex->height, tex->miplevels + 1) - tex->width * tex->height;
+}
+
+//
+// Average four CRY texels
+//
+static pixel_t R_AverageCRY(pixel_t a, pixel_t b, pixel_t c, pixel_t d)
+{
+   int cc = (a & CRY_CMASK) + (b & CRY_CMASK) + (c & CRY_CMASK) + (d & CRY_CMASK);
+   int cr = (a & CRY_RMASK) + (b & CRY_RMASK) + (c & CRY_RMASK) + (d & CRY_RMASK);
+   int cy = (a & CRY_YMASK) + (b & CRY_YMASK) + (c & CRY_YMASK) + (d & CRY_YMASK);
+
+   cc = ((cc + (2 << CRY_CSHIFT)) >> 2) & CRY_CMASK;
+   cr = ((cr + (2 << CRY_RSHIFT)) >> 2) & CRY_RMASK;
+   cy = ((cy + (2 << CRY_YSHIFT)) >> 2) & CRY_YMASK;
+
+   return (pixel_t)(cc | cr | cy);
+}
+
+//
+// Halve w columns of h texels each, stored one column after another, into
+// w/2 columns of h/2
+//
+static void R_HalveTexels(const pixel_t *src, pixel_t *dest, int w, int h)
+{
+   int x, y;
+
+   for(x = 0; x < w / 2; x++)
+   {
+      const pixel_t *c0 = src + (x * 2) * h;
+      const pixel_t *c1 = c0 + h;
+
+      for(y = 0; y < h / 2; y++)
+         *dest++ = R_AverageCRY(c0[y*2], c0[y*2 + 1], c1[y*2], c1[y*2 + 1]);
+   }
+}
+
+//
+// Build the levels of a flat, each repeated over a 64x64 square. Flats are
+// stored by rows rather than columns, which makes no difference to halving.
+//
+static void R_BuildFlatMipmaps(pixel_t *data)
+{
+   pixel_t  levels[2][(FLATSIZE / 2) * (FLATSIZE / 2)];
+   pixel_t *src = data;
+   int      level, size = FLATSIZE;
+
+   for(level = 1; level <= FLATMIPLEVELS; level++)
+   {
+      pixel_t *mip  = levels[level & 1];
+      pixel_t *dest = data + level * FLATSIZE * FLATSIZE;
+      int      x, y;
+
+      R_HalveTexels(src, mip, size, size);
+      size /= 2;
+
+      for(y = 0; y < FLATSIZE; y++)
+      {
+         for(x = 0; x < FLATSIZE; x++)
+            *dest++ = mip[(y & (size - 1)) * size + (x & (size - 1))];
+      }
+      src = mip;
+   }
+}
+
+//
+// Build every level after a texture's full size pixels. Safe to call from
+// any thread, as it touches only the pixels given to it.
+//
+void R_BuildMipmaps(int lumpnum, pixel_t *data)
+{
+   texture_t *tex;
+   int        level, w, h;
+
+   if(!r_mipmaps)
+      return;
+
+   if(R_IsFlat(lumpnum))
+   {
+      R_BuildFlatMipmaps(data);
+      return;
+   }
+
+   if(!lumptexture[lumpnum])
+      return;
+
+   tex = &textures[lumptexture[lumpnum] - 1];
+   w   = tex->width;
+   h   = tex->height;
+   for(level = 1; level <= tex->miplevels; level++)
+   {
+      pixel_t *src = data;
+
+      data += w * h;
+      R_HalveTexels(src, data, w, h);
+      w /= 2;
+      h /= 2;
+   }
+}
+
+//
+// The level to draw from when stepping 'step' texels per pixel
+//
+int R_MipLevel(fixed_t step, int maxlevel)
+{
+   int level = 0;
+
+   if(step < 0)
+      step = -step;
+
+   while(level < maxlevel && (step >> (level + 1)) >= FRACUNIT)
+      ++level;
+
+   return level;
+}
+
+// EOF
+
@@ -4,22 +4,13 @@
   Renderer phase 1 - BSP traversal
 */
 
+#include <stdint.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 #include "doomdef.h"
-#include "r_local.h"
-
-typedef struct cliprange_s
-{
-   int first;
-   int last;
-} cliprange_t;
-
-#define MAXSEGS 32
-
-cliprange_t *newend;
-cliprange_t  solidsegs[MAXSEGS];
-seg_t       *curline;
-angle_t      lineangle1;
-sector_t    *frontsector;
+#include "m_argv.h"
+#include "p_local.h"
 
 //
 // To get a global angle from Cartesian coordinates, the coordinates are
@@ -27,10 +18,10 @@ sector_t    *frontsector;
 // then the y (<= x) is scaled and divided by x to get a tangent (slope)
 // value which is looked up in the tantoangle table.
 //
-angle_t R_PointToAngle(fixed_t x, fixed_t y)
+angle_t R_PointToAngle(rview_t *rv, fixed_t x, fixed_t y)
 {
-   x -= viewx;
-   y -= viewy;
+   x -= rv->viewx;
+   y -= rv->viewy;
 
    if(!x && !y)
       return 0;
@@ -79,6 +70,79 @@ angle_t R_PointToAngle(fixed_t x, fixed_t y)
    return 0;
 }
 
+//
+// CALICO: Columns covered by solid walls are kept as a bitmask rather than
+// the original list of ranges, so clipping a seg takes a word at a time and
+// never has to shift entries up and down. Columns past the right edge are
+// set, so that searches stop there.
+//
+#define SOLIDSET   0
+#define SOLIDCLEAR (~UINT64_C(0))
+
+//
+// Index of the lowest set bit of a nonzero word
+//
+static inline int R_LowestBit(uint64_t bits)
+{
+#if defined(_MSC_VER)
+   unsigned long i;
+
+   if(_BitScanForward(&i, (unsigned long)bits))
+      return (int)i;
+   _BitScanForward(&i, (unsigned long)(bits >> 32));
+   return (int)i + 32;
+#elif defined(__GNUC__)
+   return __builtin_ctzll(bits);
+#else
+   int i = 0;
+
+   while(!(bits & 1))
+   {
+      bits >>= 1;
+      ++i;
+   }
+   return i;
+#endif
+}
+
+//
+// Find the first column from x to last which is set, or with SOLIDCLEAR the
+// first which is clear. Returns last + 1 if there is none.
+//
+static inline int R_NextColumn(const uint64_t *cols, int x, int last, uint64_t invert)
+{
+   int      w    = x >> 6;
+   uint64_t bits;
+
+   if(x > last)
+      return last + 1;
+
+   bits = (cols[w] ^ invert) & (~UINT64_C(0) << (x & 63));
+   while(!bits)
+   {
+      if((++w << 6) > last)
+         return last + 1;
+      bits = cols[w] ^ invert;
+   }
+
+   x = (w << 6) + R_LowestBit(bits);
+   return x > last ? last + 1 : x;
+}
+
+//
+// Set the columns from first to last
+//
+static void R_SetColumns(uint64_t *cols, int first, int last)
+{
+   int      w     = first >> 6;
+   int      lastw = last  >> 6;
+   uint64_t mask  = ~UINT64_C(0) << (first & 63);
+
+   for(; w < lastw; w++, mask = ~UINT64_C(0))
+      cols[w] |= mask;
+   cols[w] |= mask & (~UINT64_C(0) >> (63 - (last & 63)));
+}
+
 static int checkcoord[12][4] =
 {
    { 3, 0, 2, 1 },
@@ -99,7 +163,7 @@ static int checkcoord[12][4] =
 // Checks BSP node/subtree bounding box. Returns true if some part of the bbox
 // might be visible.
 //
-boolean R_CheckBBox(fixed_t bspcoord[4])
+boolean R_CheckBBox(rview_t *rv, fixed_t bspcoord[4])
 {
    int boxx;
    int boxy;
@@ -109,21 +173,19 @@ boolean R_CheckBBox(fixed_t bspcoord[4])
 
    angle_t angle1, angle2, span, tspan;
 
-   cliprange_t *start;
-
    int sx1, sx2;
 
    // find the corners of the box that define the edges from current viewpoint
-   if(viewx <= bspcoord[BOXLEFT])
+   if(rv->viewx <= bspcoord[BOXLEFT])
       boxx = 0;
-   else if(viewx < bspcoord[BOXRIGHT])
+   else if(rv->viewx < bspcoord[BOXRIGHT])
       boxx = 1;
    else
       boxx = 2;
 
-   if(viewy >= bspcoord[BOXTOP])
+   if(rv->viewy >= bspcoord[BOXTOP])
       boxy = 0;
-   else if(viewy > bspcoord[BOXBOTTOM])
+   else if(rv->viewy > bspcoord[BOXBOTTOM])
       boxy = 1;
    else
       boxy = 2;
@@ -132,14 +194,18 @@ boolean R_CheckBBox(fixed_t bspcoord[4])
    if(boxpos == 5)
       return true;
 
+   // CALICO: nothing more can be seen once solid walls cover the view
+   if(!rv->opencols)
+      return false;
+
    x1 = bspcoord[checkcoord[boxpos][0]];
    y1 = bspcoord[checkcoord[boxpos][1]];
    x2 = bspcoord[checkcoord[boxpos][2]];
    y2 = bspcoord[checkcoord[boxpos][3]];
 
    // check clip list for an open space
-   angle1 = R_PointToAngle(x1, y1) - viewangle;
-   angle2 = R_PointToAngle(x2, y2) - viewangle;
+   angle1 = R_PointToAngle(rv, x1, y1) - rv->viewangle;
+   angle2 = R_PointToAngle(rv, x2, y2) - rv->viewangle;
 
    span = angle1 - angle2;
 
@@ -183,167 +249,89 @@ boolean R_CheckBBox(fixed_t bspcoord[4])
       return false;
    --sx2;
 
-   start = solidsegs;
-   while(start->last < sx2)
-      ++start;
-
-   // does the clippost contain the new span?
-   if(sx1 >= start->first && sx2 <= start->last)
-      return false;
-
-   return true;
+   // CALICO: is every column of the span already solid?
+   return R_NextColumn(rv->solidcols, sx1, sx2, SOLIDCLEAR) <= sx2;
 }
 
 //
 // Store information about the clipped seg range into the viswall array.
 //
-void R_StoreWallRange(int start, int stop)
+void R_StoreWallRange(rview_t *rv, int start, int stop)
 {
    viswall_t *rw;
 
-   rw = lastwallcmd++;
+   // CALICO: out of wall commands for this frame
+   if(!(rw = R_PoolAlloc(&rv->wallpool, 1)))
+      return;
+   rv->lastwallcmd = rw + 1;
 
-   rw->seg    = curline;
+   rw->seg    = rv->curline;
    rw->start  = start;
    rw->stop   = stop;
-   rw->angle1 = lineangle1;
+   rw->angle1 = rv->lineangle1;
 }
 
 //
 // Clips the given range of columns, but does not include it in the clip list.
 // Does handle windows, e.g., linedefs with upper and lower textures.
 //
-void R_ClipPassWallSegment(fixed_t first, fixed_t last)
+void R_ClipPassWallSegment(rview_t *rv, fixed_t first, fixed_t last)
 {
-   fixed_t      scratch;
-   cliprange_t *start;
-
-   // find the first range that touches the range (adjacent pixels are touching)
-   scratch = first - 1;
-   start   = solidsegs;
-   while(start->last < scratch)
-      ++start;
-
-   // cut up the seg around solid pieces
-   if(first < start->first)
-   {
-      if(last < start->first - 1)
-      {
-         // post is entirely visible (above start)
-         R_StoreWallRange(first, last);
-         return;
-      }
-
-      // there is a fragment above *start
-      R_StoreWallRange(first, start->first - 1);
-   }
-
-   // bottom contained in start?
-   if(last <= start->last)
-      return;
+   int stop;
 
-   while(last >= (start+1)->first - 1)
+   // store each run of open columns in the range
+   while((first = R_NextColumn(rv->solidcols, first, last, SOLIDCLEAR)) <= last)
    {
-      // there is a fragment between two posts.
-      R_StoreWallRange(start->last + 1, (start+1)->first - 1);
-      ++start;
-
-      if(last <= start->last)
-         return;
+      stop = R_NextColumn(rv->solidcols, first, last, SOLIDSET);
+      R_StoreWallRange(rv, first, stop - 1);
+      first = stop;
    }
-
-   // there is a fragment after *next
-   R_StoreWallRange(start->last + 1, last);
 }
 
-void R_ClipSolidWallSegment(fixed_t first, fixed_t last)
+void R_ClipSolidWallSegment(rview_t *rv, fixed_t first, fixed_t last)
 {
-   fixed_t      scratch;
-   cliprange_t *start, *next;
+   int stop;
 
-   // find the first range that touches the range (adjacent pixels are touching)
-   scratch = first - 1;
-   start   = solidsegs;
-   while(start->last < scratch)
-      ++start;
-
-   // add visible pieces and close up holes
-   if(first < start->first)
+   // store each run of open columns in the range, and close it up
+   while((first = R_NextColumn(rv->solidcols, first, last, SOLIDCLEAR)) <= last)
    {
-      if(last < start->first - 1)
-      {
-         // post is entirely visible (above start)
-         R_StoreWallRange(first, last);
-         next = newend;
-         ++newend;
-
-         while(next != start)
-         {
-            *next = *(next - 1);
-            --next;
-         }
-
-         next->first = first;
-         next->last  = last;
-         return;
-      }
-
-      // there is a fragment above *start
-      R_StoreWallRange(first, start->first - 1);
-
-      // now adjust the clip size
-      start->first = first;
+      stop = R_NextColumn(rv->solidcols, first, last, SOLIDSET);
+      R_StoreWallRange(rv, first, stop - 1);
+      R_SetColumns(rv->solidcols, first, stop - 1);
+      rv->opencols -= stop - first;
+      first = stop;
    }
+}
 
-   // bottom contained in start?
-   if(last <= start->last)
-      return;
+//
+// CALICO: R_PointToAngle of a vertex, worked out once a frame
+//
+static angle_t R_VertexAngle(rview_t *rv, vertex_t *v)
+{
+   rvertex_t *rvert = &rv->vertcache[v - vertexes];
 
-   next = start;
-   while(last >= (next + 1)->first - 1)
+   if(rvert->anglestamp != rv->validcount)
    {
-      // there is a fragment between two posts
-      R_StoreWallRange(next->last + 1, (next + 1)->first - 1);
-      ++next;
-      
-      if(last <= next->last)
-      {
-         // bottom is contained in next, adjust the clip size
-         start->last = next->last;
-         goto crunch;
-      }
+      rvert->anglestamp = rv->validcount;
+      rvert->angle      = R_PointToAngle(rv, v->x, v->y);
    }
 
-   // there is a fragment after *next
-   R_StoreWallRange(next->last + 1, last);
-   // adjust the clip size
-   start->last = last;
-
-   // remove start+1 to next from the clip list, because start now covers
-   // their area
-crunch:
-   if(next == start) // post just extended past the bottom of one post
-      return;
-
-   while(next++ != newend)
-      *++start = *next;
-
-   newend = start + 1;
+   return rvert->angle;
 }
 
 //
 // Clips the given segment and adds any visible pieces to the line list.
 //
-void R_AddLine(seg_t *line)
+void R_AddLine(rview_t *rv, seg_t *line)
 {
    angle_t angle1, angle2, span, tspan;
    fixed_t x1, x2;
    sector_t *backsector;
 
-   curline = line;
+   rv->curline = line;
 
-   angle1 = R_PointToAngle(line->v1->x, line->v1->y);
-   angle2 = R_PointToAngle(line->v2->x, line->v2->y);
+   angle1 = R_VertexAngle(rv, line->v1);
+   angle2 = R_VertexAngle(rv, line->v2);
 
    // clip to view edges
    span = angle1 - angle2;
@@ -351,9 +339,9 @@ void R_AddLine(seg_t *line)
    if(span >= ANG180)
       return;
 
-   lineangle1 = angle1;
-   angle1 -= viewangle;
-   angle2 -= viewangle;
+   rv->lineangle1 = angle1;
+   angle1 -= rv->viewangle;
+   angle2 -= rv->viewangle;
 
    tspan = angle1 + clipangle;
    if(tspan > doubleclipangle)
@@ -390,96 +378,212 @@ void R_AddLine(seg_t *line)
    backsector = line->backsector;
 
    if(!backsector || 
-      backsector->ceilingheight <= frontsector->floorheight ||
-      backsector->floorheight   >= frontsector->ceilingheight)
+      backsector->ceilingheight <= rv->frontsector->floorheight ||
+      backsector->floorheight   >= rv->frontsector->ceilingheight)
       goto clipsolid;
 
-   if(backsector->ceilingheight != frontsector->ceilingheight ||
-      backsector->floorheight   != frontsector->floorheight)
+   if(backsector->ceilingheight != rv->frontsector->ceilingheight ||
+      backsector->floorheight   != rv->frontsector->floorheight)
       goto clippass;
 
    // reject empty lines used for triggers and special events
-   if(backsector->ceilingpic == frontsector->ceilingpic &&
-      backsector->floorpic   == frontsector->floorpic   &&
-      backsector->lightlevel == frontsector->lightlevel &&
-      curline->sidedef->midtexture == 0)
+   if(backsector->ceilingpic == rv->frontsector->ceilingpic &&
+      backsector->floorpic   == rv->frontsector->floorpic   &&
+      backsector->lightlevel == rv->frontsector->lightlevel &&
+      rv->curline->sidedef->midtexture == 0)
       return;
 
 clippass:
-   R_ClipPassWallSegment(x1, x2);
+   R_ClipPassWallSegment(rv, x1, x2);
    return;
 
 clipsolid:
-   R_ClipSolidWallSegment(x1, x2);
+   R_ClipSolidWallSegment(rv, x1, x2);
 }
 
 //
 // Determine floor/ceiling planes, add sprites of things in sector,
 // draw one or more segments.
 //
-void R_Subsector(int num)
+void R_Subsector(rview_t *rv, int num)
 {
    subsector_t *sub = &subsectors[num];
+   subsector_t **vis;
    seg_t       *line, *stopline;
    int          count;
    
-   frontsector = sub->sector;
+   rv->frontsector = sub->sector;
    
-   *lastvissubsector = sub;
-   ++lastvissubsector;
+   // CALICO: if out of room, only this subsector's things go undrawn
+   if((vis = R_PoolAlloc(&rv->subsectorpool, 1)))
+   {
+      *vis = sub;
+      rv->lastvissubsector = vis + 1;
+   }
 
    line     = &segs[sub->firstline];
    count    = sub->numlines;
    stopline = line + count;
 
    while(line != stopline)
-      R_AddLine(line++);
+      R_AddLine(rv, line++);
+}
+
+//
+// CALICO: optional culling of BSP subtrees with the REJECT lump. For the
+// sector the view is in, pvsnodes marks each node whose subtree holds at
+// least one subsector that REJECT doesn't rule out, so whole subtrees can be
+// skipped without any bbox math. It is only rebuilt when the view moves into
+// another sector.
+//
+static boolean rejectcull;
+
+//
+// Set up REJECT culling for a new level if -rejectcull was given. Each view
+// allocates its marks on its first frame in the level.
+//
+void R_InitPVS(void)
+{
+   rejectcull = (M_FindArgument("-rejectcull") && numnodes > 0);
 }
 
 //
-// Recursively descend through the BSP, classifying nodes according to the
-// player's point of view, and render subsectors in view.
+// True if REJECT doesn't rule out seeing the subsector from pvssector
 //
-void R_RenderBSPNode(int bspnum)
+static boolean R_SubsectorInPVS(rview_t *rv, int num)
 {
-   node_t *bsp;
-   int     side;
+   int pnum = rv->pvssector * numsectors + (subsectors[num].sector - sectors);
+
+   return !(rejectmatrix[pnum >> 3] & (1 << (pnum & 7)));
+}
+
+//
+// Mark the nodes of a subtree for pvssector, returning true if any of it may
+// be visible
+//
+static boolean R_MarkPVSNode(rview_t *rv, int bspnum)
+{
+   boolean visible;
+
+   if(bspnum & NF_SUBSECTOR)
+      return R_SubsectorInPVS(rv, bspnum == -1 ? 0 : bspnum & ~NF_SUBSECTOR);
+
+   visible  = R_MarkPVSNode(rv, nodes[bspnum].children[0]);
+   visible |= R_MarkPVSNode(rv, nodes[bspnum].children[1]);
+
+   return (rv->pvsnodes[bspnum] = visible);
+}
+
+//
+// True if some part of a BSP child may be visible from pvssector
+//
+static boolean R_ChildInPVS(rview_t *rv, int bspnum)
+{
+   if(!rv->pvsnodes)
+      return true;
 
-   if(bspnum & NF_SUBSECTOR) // reached a subsector leaf?
+   if(bspnum & NF_SUBSECTOR)
+      return R_SubsectorInPVS(rv, bspnum == -1 ? 0 : bspnum & ~NF_SUBSECTOR);
+
+   return rv->pvsnodes[bspnum];
+}
+
+#define MAXBSPSTACK 64
+
+typedef struct bspback_s
+{
+   node_t *node;
+   int     side; // back side, relative to the view point
+} bspback_t;
+
+//
+// Descend through the BSP, classifying nodes according to the player's point
+// of view, and render subsectors in view.
+// CALICO: walks the tree with an explicit stack of back sides still to be
+// checked rather than recursing on every node.
+//
+void R_RenderBSPNode(rview_t *rv, int bspnum)
+{
+   bspback_t  stack[MAXBSPSTACK];
+   bspback_t *sp = stack;
+   node_t    *bsp;
+   int        side;
+
+   while(1)
    {
-      if(bspnum == -1)
-         R_Subsector(0);
-      else
-         R_Subsector(bspnum & ~NF_SUBSECTOR);
-      return;
-   }
+      // walk down the front sides to a subsector, remembering the back sides
+      while(!(bspnum & NF_SUBSECTOR) && sp != stack + MAXBSPSTACK)
+      {
+         bsp = &nodes[bspnum];
+
+         // decide which side the view point is on
+         side = R_PointOnSide(rv->viewx, rv->viewy, bsp);
 
-   bsp = &nodes[bspnum];
+         sp->node = bsp;
+         sp->side = side ^ 1;
+         ++sp;
 
-   // decide which side the view point is on
-   side = R_PointOnSide(viewx, viewy, bsp);
+         bspnum = bsp->children[side];
+      }
 
-   // recursively render front space
-   R_RenderBSPNode(bsp->children[side]);
+      if(!(bspnum & NF_SUBSECTOR))
+         R_RenderBSPNode(rv, bspnum); // deeper than the stack; start another
+      else if(bspnum == -1)
+         R_Subsector(rv, 0);
+      else
+         R_Subsector(rv, bspnum & ~NF_SUBSECTOR);
 
-   // possibly divide back space
-   if(R_CheckBBox(bsp->bbox[side^1]))
-      R_RenderBSPNode(bsp->children[side^1]);
+      // back up to the nearest back space which may be visible now that
+      // everything in front of it has been clipped
+      do
+      {
+         if(sp == stack)
+            return;
+         --sp;
+         bspnum = sp->node->children[sp->side];
+      }
+      while(!R_ChildInPVS(rv, bspnum) || !R_CheckBBox(rv, sp->node->bbox[sp->side]));
+   }
 }
 
 //
-// Kick off the rendering process by initializing the solidsegs array and then
+// Kick off the rendering process by initializing the solid columns and then
 // starting the BSP traversal.
 //
-void R_BSP(void)
+void R_BSP(rview_t *rv)
 {
-   solidsegs[0].first = -2;
-   solidsegs[0].last  = -1;
-   solidsegs[1].first = SCREENWIDTH;
-   solidsegs[1].last  = SCREENWIDTH+1;
-   newend = &solidsegs[2];
+   // CALICO: everything is open, up to the right edge
+   D_memset(rv->solidcols, 0, sizeof(rv->solidcols));
+   if(renderwidth < SOLIDWORDS * 64)
+      R_SetColumns(rv->solidcols, renderwidth, SOLIDWORDS * 64 - 1);
+   rv->opencols = renderwidth;
+
+   // CALICO: the vertex cache goes with the level, and starts out stale
+   if(!rv->vertcache)
+   {
+      rv->vertcache = Z_Malloc(numvertexes * sizeof(rvertex_t), PU_LEVEL, (void **)&rv->vertcache);
+      D_memset(rv->vertcache, 0, numvertexes * sizeof(rvertex_t));
+   }
+
+   // CALICO: rebuild the REJECT culling marks if the view changed sectors;
+   // they go with the level, so they are freed along with it
+   if(rejectcull && !rv->pvsnodes)
+   {
+      rv->pvsnodes  = Z_Malloc(numnodes, PU_LEVEL, (void **)&rv->pvsnodes);
+      rv->pvssector = -1;
+   }
+   if(rv->pvsnodes)
+   {
+      int sector = R_PointInSubsector(rv->viewx, rv->viewy)->sector - sectors;
+
+      if(sector != rv->pvssector)
+      {
+         rv->pvssector = sector;
+         R_MarkPVSNode(rv, numnodes - 1);
+      }
+   }
 
-   R_RenderBSPNode(numnodes - 1);
+   R_RenderBSPNode(rv, numnodes - 1);
 }
 
 // EOF
@@ -9,9 +9,9 @@
 
 static sector_t emptysector = { 0, 0, -2, -2, -2 };
 
-void R_WallPrep(void)
+void R_WallPrep(rview_t *rv)
 {
-   viswall_t *segl = viswalls;
+   viswall_t *segl = rv->viswalls;
    seg_t     *seg;
    line_t    *li;
    side_t    *si;
@@ -25,19 +25,23 @@ void R_WallPrep(void)
    boolean    skyhack;
    unsigned int actionbits;
 
-   while(segl < lastwallcmd)
+   while(segl < rv->lastwallcmd)
    {
       seg = segl->seg;
       li  = seg->linedef;
       si  = seg->sidedef;
 
-      li->flags |= ML_MAPPED; // mark as seen
+      if(!(li->flags & ML_MAPPED))
+      {
+         li->flags |= ML_MAPPED; // mark as seen
+         ++mappedlines;          // CALICO: the GL automap's lines are now out of date
+      }
 
       front_sector    = seg->frontsector;
       f_ceilingpic    = front_sector->ceilingpic;
       f_lightlevel    = front_sector->lightlevel;
-      f_floorheight   = front_sector->floorheight   - viewz;
-      f_ceilingheight = front_sector->ceilingheight - viewz;
+      f_floorheight   = front_sector->floorheight   - rv->viewz;
+      f_ceilingheight = front_sector->ceilingheight - rv->viewz;
 
       segl->floorpicnum   = flattranslation[front_sector->floorpic];
       segl->ceilingpicnum = (f_ceilingpic == -1) ? -1 : flattranslation[f_ceilingpic];
@@ -47,8 +51,8 @@ void R_WallPrep(void)
          back_sector = &emptysector;
       b_ceilingpic    = back_sector->ceilingpic;
       b_lightlevel    = back_sector->lightlevel;
-      b_floorheight   = back_sector->floorheight   - viewz;
-      b_ceilingheight = back_sector->ceilingheight - viewz;
+      b_floorheight   = back_sector->floorheight   - rv->viewz;
+      b_ceilingheight = back_sector->ceilingheight - rv->viewz;
 
       t_texturemid = b_texturemid = 0;
       actionbits = 0;
@@ -146,18 +150,23 @@ void R_WallPrep(void)
          else
          {
             int width;
+            unsigned short *sil;
 
             // get width of opening
-            // note this is halved because openings are treated like bytes 
-            // everywhere despite using short storage
-            width = (rw_stopx - rw_x + 1) / 2; 
+            // CALICO: the original halved this and treated the shorts as
+            // bytes; each column now gets a whole short
+            width = rw_stopx - rw_x;
 
             if((b_floorheight > 0 && b_floorheight > f_floorheight) ||
                (f_floorheight < 0 && f_floorheight > b_floorheight))
             {
-               actionbits |= AC_BOTTOMSIL; // set bottom mask
-               segl->bottomsil = (byte *)lastopening - rw_x;
-               lastopening += width;
+               // CALICO: if out of openings, the sil is left off for this frame
+               if((sil = R_PoolAlloc(&rv->openingpool, width)))
+               {
+                  actionbits |= AC_BOTTOMSIL; // set bottom mask
+                  segl->bottomsil = sil - rw_x;
+                  rv->lastopening = sil + width;
+               }
             }
 
             if(!skyhack)
@@ -165,9 +174,12 @@ void R_WallPrep(void)
                if((b_ceilingheight <= 0 && b_ceilingheight < f_ceilingheight) ||
                   (f_ceilingheight >  0 && b_ceilingheight > f_ceilingheight))
                {
-                  actionbits |= AC_TOPSIL; // set top mask
-                  segl->topsil = (byte *)lastopening - rw_x;
-                  lastopening += width;
+                  if((sil = R_PoolAlloc(&rv->openingpool, width)))
+                  {
+                     actionbits |= AC_TOPSIL; // set top mask
+                     segl->topsil = sil - rw_x;
+                     rv->lastopening = sil + width;
+                  }
                }
             }
          }
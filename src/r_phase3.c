@@ -7,14 +7,72 @@
 #include "doomdef.h"
 #include "r_local.h"
 
+extern int R_ConfigShadows(void);
+
+// CALICO: a thing which may be in view, with its position relative to it
+typedef struct thingview_s
+{
+   mobj_t *thing;
+   fixed_t x, y, z;  // where it is at this point in the tic
+   fixed_t tx, tz;   // across and into the view
+} thingview_t;
+
+// things tested against the view at once
+#define THINGBATCH 64
+
+//
+// CALICO: Test a sector's things against the view in one pass, before any
+// of them is looked at further. Things behind the view plane or too far off
+// to the side are dropped here; the rest are stored in batch with where they
+// are in view. Starts at *thing and leaves it at the first thing not yet
+// tested. Returns the number stored.
+//
+static int R_CullThings(rview_t *rv, mobj_t **thing, thingview_t *batch)
+{
+   const fixed_t viewx = rv->viewx, viewy = rv->viewy;
+   const fixed_t viewcos = rv->viewcos, viewsin = rv->viewsin;
+   mobj_t *mo = *thing;
+   int     count = 0;
+
+   for(; mo && count < THINGBATCH; mo = mo->snext)
+   {
+      // draw the thing where it is at this point in the tic
+      fixed_t x    = R_LerpFixed(mo->prevx, mo->x);
+      fixed_t y    = R_LerpFixed(mo->prevy, mo->y);
+      fixed_t tr_x = x - viewx;
+      fixed_t tr_y = y - viewy;
+      fixed_t tz, tx;
+
+      // behind view plane?
+      tz = FixedMul(tr_x, viewcos) + FixedMul(tr_y, viewsin);
+      if(tz < MINZ)
+         continue;
+
+      // too far off the side?
+      tx = FixedMul(tr_x, viewsin) - FixedMul(tr_y, viewcos);
+      if(tx > (tz << 2) || tx < -(tz << 2))
+         continue;
+
+      batch[count].thing = mo;
+      batch[count].x     = x;
+      batch[count].y     = y;
+      batch[count].z     = R_LerpFixed(mo->prevz, mo->z);
+      batch[count].tx    = tx;
+      batch[count].tz    = tz;
+      ++count;
+   }
+
+   *thing = mo;
+   return count;
+}
+
 //
 // Project vissprite for potentially visible actor
 //
-static void R_PrepMobj(mobj_t *thing)
+static void R_PrepMobj(rview_t *rv, const thingview_t *tv)
 {
-   fixed_t tr_x, tr_y;
-   fixed_t gxt, gyt;
-   fixed_t tx, tz;
+   mobj_t *thing = tv->thing;
+   fixed_t tx = tv->tx, tz = tv->tz;
    fixed_t xscale;
 
    spritedef_t   *sprdef;
@@ -26,25 +84,11 @@ static void R_PrepMobj(mobj_t *thing)
    int          lump;
    vissprite_t *vis;
 
-   // transform origin relative to viewpoint
-   tr_x = thing->x - viewx;
-   tr_y = thing->y - viewy;
-
-   gxt =  FixedMul(tr_x, viewcos);
-   gyt = -FixedMul(tr_y, viewsin);
-   tz  = gxt - gyt;
+   fixed_t      thingx = tv->x;
+   fixed_t      thingy = tv->y;
+   fixed_t      thingz = tv->z;
 
-   // thing is behind view plane?
-   if(tz < MINZ)
-      return;
-
-   gxt = -FixedMul(tr_x, viewsin);
-   gyt =  FixedMul(tr_y, viewcos);
-   tx  = -(gyt + gxt);
-
-   // too far off the side?
-   if(tx > (tz << 2) || tx < -(tz<<2))
-      return;
+   // CALICO: R_CullThings has already dropped things out of view
 
    // check sprite for validity
    if(thing->sprite < 0 || thing->sprite >= NUMSPRITES)
@@ -61,7 +105,7 @@ static void R_PrepMobj(mobj_t *thing)
    if(sprframe->rotate)
    {
       // select proper rotation depending on player's view point
-      ang  = R_PointToAngle2(viewx, viewy, thing->x, thing->y);
+      ang  = R_PointToAngle2(rv->viewx, rv->viewy, thingx, thingy);
       rot  = (ang - thing->angle + (unsigned int)(ANG45 / 2)*9) >> 29;
       lump = sprframe->lump[rot];
       flip = (boolean)(sprframe->flip[rot]);
@@ -74,15 +118,15 @@ static void R_PrepMobj(mobj_t *thing)
    }
 
    // get a new vissprite
-   if(vissprite_p == vissprites + MAXVISSPRITES)
+   if(!(vis = R_PoolAlloc(&rv->spritepool, 1)))
       return; // too many visible sprites already
-   vis = vissprite_p++;
+   rv->vissprite_p = vis + 1;
 
    vis->patchnum = lump; // CALICO: store to patchnum, not patch (number vs pointer)
    vis->x1       = tx;
-   vis->gx       = thing->x;
-   vis->gy       = thing->y;
-   vis->gz       = thing->z;
+   vis->gx       = thingx;
+   vis->gy       = thingy;
+   vis->gz       = thingz;
    vis->xscale   = xscale = FixedDiv(PROJECTION, tz);
    vis->yscale   = FixedMul(xscale, STRETCH);
    vis->yiscale  = FixedDiv(FRACUNIT, vis->yscale); // CALICO_FIXME: -1 in GAS... test w/o.
@@ -96,12 +140,16 @@ static void R_PrepMobj(mobj_t *thing)
       vis->colormap = 255;
    else
       vis->colormap = thing->subsector->sector->lightlevel;
+
+   // CALICO: MF_SHADOW things (spectres) may be drawn as shadows
+   if((thing->flags & MF_SHADOW) && R_ConfigShadows())
+      vis->colormap = -1;
 }
 
 //
 // Project player weapon sprite
 //
-static void R_PrepPSprite(pspdef_t *psp)
+static void R_PrepPSprite(rview_t *rv, pspdef_t *psp)
 {
    spritedef_t   *sprdef;
    spriteframe_t *sprframe;
@@ -112,9 +160,9 @@ static void R_PrepPSprite(pspdef_t *psp)
    sprframe = &sprdef->spriteframes[psp->state->frame & FF_FRAMEMASK];
    lump     = sprframe->lump[0];
 
-   if(vissprite_p == vissprites + MAXVISSPRITES)
+   if(!(vis = R_PoolAlloc(&rv->spritepool, 1)))
       return; // out of vissprites
-   vis = vissprite_p++;
+   rv->vissprite_p = vis + 1;
 
    vis->patchnum = lump; // CALICO: use patchnum here, not patch pointer
    vis->x1 = psp->sx / FRACUNIT;
@@ -123,45 +171,64 @@ static void R_PrepPSprite(pspdef_t *psp)
    if(psp->state->frame & FF_FULLBRIGHT)
       vis->colormap = 255;
    else
-      vis->colormap = viewplayer->mo->subsector->sector->lightlevel;
+      vis->colormap = rv->viewplayer->mo->subsector->sector->lightlevel;
 }
 
 //
 // Process actors in all visible subsectors
 //
-void R_SpritePrep(void)
+void R_SpritePrep(rview_t *rv)
 {
-   subsector_t **ssp = vissubsectors;
+   subsector_t **ssp = rv->vissubsectors;
    pspdef_t     *psp;
+   thingview_t   batch[THINGBATCH];
    int i;
 
-   while(ssp < lastvissubsector)
+   // CALICO: sectors are marked in the view's own array rather than in
+   // sector_t, which the playsim and any other view also use
+   if(!rv->sectorvalid)
+   {
+      rv->sectorvalid = Z_Malloc(numsectors * sizeof(int), PU_LEVEL, (void **)&rv->sectorvalid);
+      D_memset(rv->sectorvalid, 0, numsectors * sizeof(int));
+   }
+
+   while(ssp < rv->lastvissubsector)
    {
       subsector_t *ss = *ssp;
-      sector_t    *se = ss->sector;
+      int         *valid = &rv->sectorvalid[ss->sector - sectors];
 
-      if(se->validcount != validcount) // not already processed?
+      if(*valid != rv->validcount) // not already processed?
       {
-         mobj_t *thing = se->thinglist;
-         se->validcount = validcount;  // mark it as processed
+         mobj_t *thing = ss->sector->thinglist;
+         *valid = rv->validcount;  // mark it as processed
 
-         while(thing) // walk sector thing list
+         // CALICO: walk sector thing list a batch at a time; once the
+         // vissprites have run out, survivors are only counted, so that
+         // the pool grows to fit them next frame
+         while(thing)
          {
-            R_PrepMobj(thing);
-            thing = thing->snext;
+            int n = R_CullThings(rv, &thing, batch);
+
+            if(R_PoolFull(&rv->spritepool))
+               R_PoolAlloc(&rv->spritepool, n);
+            else
+            {
+               for(i = 0; i < n; i++)
+                  R_PrepMobj(rv, &batch[i]);
+            }
          }
       }
       ++ssp;
    }
 
    // remember end of actor vissprites
-   lastsprite_p = vissprite_p;
+   rv->lastsprite_p = rv->vissprite_p;
 
    // draw player weapon sprites
-   for(i = 0, psp = viewplayer->psprites; i < NUMPSPRITES; i++, psp++)
+   for(i = 0, psp = rv->viewplayer->psprites; i < NUMPSPRITES; i++, psp++)
    {
       if(psp->state)
-         R_PrepPSprite(psp);
+         R_PrepPSprite(rv, psp);
    }
 }
 
@@ -7,26 +7,26 @@
 #include "doomdef.h"
 #include "r_local.h"
 
-static boolean cacheneeded;
-static fixed_t hyp;
-angle_t normalangle;
-
 //
 // Check if texture is loaded; return if so, flag for cache if not
 //
-static void *R_CheckPixels(int lumpnum)
+static void *R_CheckPixels(rview_t *rv, int lumpnum)
 {
    void *lumpdata = lumpcache[lumpnum];
+
+   W_TouchWorkingSet(WS_GRAPHIC, lumpnum); // CALICO: for -worksets
    
    if(lumpdata)
    {
+      // CALICO: it may still be being decoded by the streaming thread
+      W_WaitStream(lumpnum);
+
       // touch this graphic resource with the current frame number so that it 
       // will not be immediately purged again during the same frame
-      memblock_t *memblock = (memblock_t *)((byte *)lumpdata - sizeof(memblock_t));
-      memblock->lockframe = framecount;
+      R_CacheTouch(lumpdata); // CALICO: now kept in the graphics cache
    }
    else
-      cacheneeded = true; // phase 5 will need to be executed to cache graphics
+      rv->cacheneeded = true; // phase 5 will need to be executed to cache graphics
    
    return lumpdata;
 }
@@ -34,13 +34,13 @@ static void *R_CheckPixels(int lumpnum)
 //
 // Get distance to point in 3D projection
 //
-static fixed_t R_PointToDist(fixed_t x, fixed_t y)
+static fixed_t R_PointToDist(rview_t *rv, fixed_t x, fixed_t y)
 {
    int angle;
    fixed_t dx, dy, temp;
    
-   dx = D_abs(x - viewx);
-   dy = D_abs(y - viewy);
+   dx = D_abs(x - rv->viewx);
+   dy = D_abs(y - rv->viewy);
    
    if(dy > dx)
    {
@@ -55,10 +55,26 @@ static fixed_t R_PointToDist(fixed_t x, fixed_t y)
    return FixedDiv(dx, finesine[angle]);
 }
 
+//
+// CALICO: R_PointToDist of a vertex, worked out once a frame
+//
+static fixed_t R_VertexDist(rview_t *rv, vertex_t *v)
+{
+   rvertex_t *rvert = &rv->vertcache[v - vertexes];
+
+   if(rvert->diststamp != rv->validcount)
+   {
+      rvert->diststamp = rv->validcount;
+      rvert->dist      = R_PointToDist(rv, v->x, v->y);
+   }
+
+   return rvert->dist;
+}
+
 //
 // Convert angle and distance within view frustum to texture scale factor.
 //
-static fixed_t R_ScaleFromGlobalAngle(fixed_t rw_distance, angle_t visangle)
+static fixed_t R_ScaleFromGlobalAngle(rview_t *rv, fixed_t rw_distance, angle_t visangle)
 {
    angle_t anglea, angleb;
    fixed_t num, den;
@@ -66,12 +82,12 @@ static fixed_t R_ScaleFromGlobalAngle(fixed_t rw_distance, angle_t visangle)
 
    visangle += ANG90;
    
-   anglea = visangle - viewangle;
+   anglea = visangle - rv->viewangle;
    sinea  = finesine[anglea >> ANGLETOFINESHIFT];
-   angleb = visangle - normalangle;
+   angleb = visangle - rv->normalangle;
    sineb  = finesine[angleb >> ANGLETOFINESHIFT];
    
-   num = sineb * 22 * 8;
+   num = sineb * (22 * 8 << rendershift); // CALICO: scale with the render size
    den = FixedMul(rw_distance, sinea);
 
    return FixedDiv(num, den);
@@ -80,12 +96,12 @@ static fixed_t R_ScaleFromGlobalAngle(fixed_t rw_distance, angle_t visangle)
 //
 // Setup texture calculations for lines with upper and lower textures
 //
-static void R_SetupCalc(viswall_t *wc)
+static void R_SetupCalc(rview_t *rv, viswall_t *wc)
 {
    fixed_t sineval, rw_offset;
    angle_t offsetangle;
 
-   offsetangle = normalangle - wc->angle1;
+   offsetangle = rv->normalangle - wc->angle1;
 
    if(offsetangle > ANG180)
       offsetangle = 0 - offsetangle;
@@ -94,19 +110,19 @@ static void R_SetupCalc(viswall_t *wc)
       offsetangle = ANG90;
 
    sineval = finesine[offsetangle >> ANGLETOFINESHIFT];
-   rw_offset = FixedMul(hyp, sineval);
+   rw_offset = FixedMul(rv->hyp, sineval);
 
-   if(normalangle - wc->angle1 < ANG180)
+   if(rv->normalangle - wc->angle1 < ANG180)
       rw_offset = -rw_offset;
 
    wc->offset += rw_offset;
-   wc->centerangle = ANG90 + viewangle - normalangle;
+   wc->centerangle = ANG90 + rv->viewangle - rv->normalangle;
 }
 
 //
 // Late prep for viswalls
 //
-static void R_FinishWallPrep(viswall_t *wc)
+static void R_FinishWallPrep(rview_t *rv, viswall_t *wc)
 {
    unsigned int fw_actionbits = wc->actionbits;
    texture_t   *fw_texture;
@@ -114,40 +130,54 @@ static void R_FinishWallPrep(viswall_t *wc)
    seg_t       *seg = wc->seg;
    fixed_t      sineval, rw_distance;
    fixed_t      scalefrac, scale2;
+   rsectorpics_t *pics;
    
    // has top or middle texture?
    if(fw_actionbits & AC_TOPTEXTURE)
    {
       fw_texture = wc->t_texture;
-      fw_texture->data = R_CheckPixels(fw_texture->lumpnum);
+      fw_texture->data = R_CheckPixels(rv, fw_texture->lumpnum);
    }
    
    // has bottom texture?
    if(fw_actionbits & AC_BOTTOMTEXTURE)
    {
       fw_texture = wc->b_texture;
-      fw_texture->data = R_CheckPixels(fw_texture->lumpnum);
+      fw_texture->data = R_CheckPixels(rv, fw_texture->lumpnum);
    }
    
-   // get floor texture
-   wc->floorpic = R_CheckPixels(firstflat + wc->floorpicnum); // CALICO: use floorpicnum field here
-   
-   // is there sky at this wall?
-   if(wc->ceilingpicnum == -1) // CALICO: likewise for ceilingpicnum
-   {
-      // cache skytexture if needed
-      skytexturep->data = R_CheckPixels(skytexturep->lumpnum);
-   }
-   else
+   // CALICO: the flats are those of the seg's front sector, so they are
+   // only looked up for the first of its walls each frame
+   pics = &rv->sectorpics[seg->frontsector - sectors];
+   if(pics->stamp != rv->validcount)
    {
-      // normal ceilingpic
-      wc->ceilingpic = R_CheckPixels(firstflat + wc->ceilingpicnum);
+      pics->stamp = rv->validcount;
+
+      // get floor texture
+      pics->floorpic = R_CheckPixels(rv, firstflat + wc->floorpicnum); // CALICO: use floorpicnum field here
+
+      // is there sky at this wall?
+      if(wc->ceilingpicnum == -1) // CALICO: likewise for ceilingpicnum
+      {
+         // cache skytexture if needed
+         skytexturep->data = R_CheckPixels(rv, skytexturep->lumpnum);
+         rv->skyvisible = true; // CALICO
+      }
+      else
+      {
+         // normal ceilingpic
+         pics->ceilingpic = R_CheckPixels(rv, firstflat + wc->ceilingpicnum);
+      }
    }
+
+   wc->floorpic = pics->floorpic;
+   if(wc->ceilingpicnum != -1)
+      wc->ceilingpic = pics->ceilingpic;
    
    // this is essentially R_StoreWallRange
    // calculate rw_distance for scale calculation
-   normalangle = seg->angle + ANG90;
-   offsetangle = normalangle - wc->angle1;
+   rv->normalangle = seg->angle + ANG90;
+   offsetangle = rv->normalangle - wc->angle1;
 
    if((int)offsetangle < 0)
       offsetangle = 0 - offsetangle;
@@ -156,16 +186,16 @@ static void R_FinishWallPrep(viswall_t *wc)
       offsetangle = ANG90;
    
    distangle = ANG90 - offsetangle;
-   hyp = R_PointToDist(seg->v1->x, seg->v1->y);
+   rv->hyp = R_VertexDist(rv, seg->v1);
    sineval = finesine[distangle >> ANGLETOFINESHIFT];
-   wc->distance = rw_distance = FixedMul(hyp, sineval);
+   wc->distance = rw_distance = FixedMul(rv->hyp, sineval);
    
    scalefrac = scale2 = wc->scalefrac =
-      R_ScaleFromGlobalAngle(rw_distance, viewangle + xtoviewangle[wc->start]);
+      R_ScaleFromGlobalAngle(rv, rw_distance, rv->viewangle + xtoviewangle[wc->start]);
 
    if(wc->stop > wc->start)
    {
-      scale2 = R_ScaleFromGlobalAngle(rw_distance, viewangle + xtoviewangle[wc->stop]);
+      scale2 = R_ScaleFromGlobalAngle(rv, rw_distance, rv->viewangle + xtoviewangle[wc->stop]);
       wc->scalestep = (int)(scale2 - scalefrac) / (int)(wc->stop - wc->start);
    }
 
@@ -175,14 +205,14 @@ static void R_FinishWallPrep(viswall_t *wc)
    if(wc->actionbits & (AC_TOPTEXTURE|AC_BOTTOMTEXTURE))
    {
       wc->actionbits |= AC_CALCTEXTURE; // set to calculate texture info
-      R_SetupCalc(wc);                  // do calc setup
+      R_SetupCalc(rv, wc);                  // do calc setup
    }
 }
 
 //
 // Late prep for vissprites
 //
-static void R_FinishSprite(vissprite_t *vis)
+static void R_FinishSprite(rview_t *rv, vissprite_t *vis)
 {
    int      lump;
    byte    *patch;
@@ -193,9 +223,10 @@ static void R_FinishSprite(vissprite_t *vis)
    lump  = vis->patchnum;                                // CALICO: use patchnum to avoid type punning
    patch = wadfileptr + BIGLONG(lumpinfo[lump].filepos); // CALICO: requires endianness correction
    vis->patch = (patch_t *)patch;
+   vis->posts = R_SpritePosts(lump); // CALICO
   
    // column pixel data is in the next lump
-   vis->pixels = R_CheckPixels(lump + 1);
+   vis->pixels = R_CheckPixels(rv, lump + 1);
 
    tx = vis->x1;
    xscale = vis->xscale;
@@ -205,7 +236,7 @@ static void R_FinishSprite(vissprite_t *vis)
    x1  = (CENTERXFRAC + FixedMul(tx, xscale)) / FRACUNIT;
 
    // off the right side?
-   if(x1 > SCREENWIDTH)
+   if(x1 > renderwidth)
    {
       vis->patch = NULL;
       return;
@@ -223,9 +254,9 @@ static void R_FinishSprite(vissprite_t *vis)
 
    // store information in vissprite
    vis->gzt = vis->gz + ((fixed_t)BIGSHORT(vis->patch->topoffset) << FRACBITS);
-   vis->texturemid = vis->gzt - viewz;
+   vis->texturemid = vis->gzt - rv->viewz;
    vis->x1 = x1 < 0 ? 0 : x1;
-   vis->x2 = x2 >= SCREENWIDTH ? SCREENWIDTH - 1 : x2;
+   vis->x2 = x2 >= renderwidth ? renderwidth - 1 : x2;
    
    if(vis->xiscale < 0)
       vis->startfrac = ((fixed_t)BIGSHORT(vis->patch->width) << FRACBITS) - 1;
@@ -239,7 +270,7 @@ static void R_FinishSprite(vissprite_t *vis)
 //
 // Late prep for player psprites
 //
-static void R_FinishPSprite(vissprite_t *vis)
+static void R_FinishPSprite(rview_t *rv, vissprite_t *vis)
 {
    fixed_t  topoffset;
    int      x1, x2;
@@ -250,9 +281,10 @@ static void R_FinishPSprite(vissprite_t *vis)
    lump  = vis->patchnum;                                // CALICO: use patchnum to avoid type punning
    patch = wadfileptr + BIGLONG(lumpinfo[lump].filepos); // CALICO: requires endianness correction throughout
    vis->patch = (patch_t *)patch;
+   vis->posts = R_SpritePosts(lump); // CALICO
 
    // column pixel data is in the next lump
-   vis->pixels = R_CheckPixels(lump + 1);
+   vis->pixels = R_CheckPixels(rv, lump + 1);
 
    topoffset = (fixed_t)BIGSHORT(vis->patch->topoffset) << FRACBITS;
    vis->texturemid = 100*FRACUNIT - (vis->texturemid - topoffset);
@@ -272,36 +304,49 @@ static void R_FinishPSprite(vissprite_t *vis)
    // store information in vissprite
    vis->x1 = x1 < 0 ? 0 : x1;
    vis->x2 = x2 >= 160 ? 160 - 1 : x2;
-   vis->xscale = FRACUNIT;
-   vis->yscale = FRACUNIT;
-   vis->yiscale = FRACUNIT;
-   vis->xiscale = FRACUNIT;
+
+   // CALICO: psprites are positioned in 160-wide units and scaled up to the
+   // render size, in the middle of a widened view
+   vis->x1 = (vis->x1 << rendershift) + renderxoffset;
+   vis->x2 = ((vis->x2 + 1) << rendershift) - 1 + renderxoffset;
+   vis->xscale = FRACUNIT << rendershift;
+   vis->yscale = FRACUNIT << rendershift;
+   vis->yiscale = FRACUNIT >> rendershift;
+   vis->xiscale = FRACUNIT >> rendershift;
    vis->startfrac = 0;
 }
 
 //
 // Start late prep rendering stage
 //
-boolean R_LatePrep(void)
+boolean R_LatePrep(rview_t *rv)
 {
    viswall_t   *wall;
    vissprite_t *spr;
    
-   cacheneeded = false;   
+   rv->cacheneeded = false;   
+   rv->skyvisible  = false; // CALICO
+
+   // CALICO: flats found for each sector this frame go with the level
+   if(!rv->sectorpics)
+   {
+      rv->sectorpics = Z_Malloc(numsectors * sizeof(rsectorpics_t), PU_LEVEL, (void **)&rv->sectorpics);
+      D_memset(rv->sectorpics, 0, numsectors * sizeof(rsectorpics_t));
+   }
    
    // finish viswalls
-   for(wall = viswalls; wall < lastwallcmd; wall++)
-      R_FinishWallPrep(wall);
+   for(wall = rv->viswalls; wall < rv->lastwallcmd; wall++)
+      R_FinishWallPrep(rv, wall);
 
    // finish actor sprites   
-   for(spr = vissprites; spr < lastsprite_p; spr++)
-      R_FinishSprite(spr);
+   for(spr = rv->vissprites; spr < rv->lastsprite_p; spr++)
+      R_FinishSprite(rv, spr);
    
    // finish player psprites
-   for(; spr < vissprite_p; spr++)
-      R_FinishPSprite(spr);
+   for(; spr < rv->vissprite_p; spr++)
+      R_FinishPSprite(rv, spr);
    
-   return cacheneeded;
+   return rv->cacheneeded;
 }
 
 // EOF
@@ -4,11 +4,15 @@
   Renderer phase 5 - Graphics caching
 */
 
+#include <stdlib.h>
+#include <string.h>
 #include "doomdef.h"
-#include "r_local.h"
+#include "m_jobs.h"
+#include "p_local.h"
 
 // Doom palette to CRY lookup (hardcoded for efficiency on the Jag ASIC?)
-static pixel_t vgatojag[] =
+// CALICO: also used by the drawers to translate compact pixels
+pixel_t vgatojag[256] =
 {
        1, 51487, 55319, 30795, 30975, 30747, 30739, 30731, 30727, 43831, 44075, 48415, 53015, 47183, 47175, 51263, 
    38655, 38647, 42995, 42731, 42727, 42719, 46811, 46803, 46795, 46535, 46527, 46523, 46515, 50607, 50599, 50339, 
@@ -28,110 +32,13 @@ static pixel_t vgatojag[] =
       83,    71,    59,    47,    35,    23,    11,     1, 30975, 30975, 29951, 28927, 28879, 32927, 32879, 42663
 };
 
-#define MINFRAGMENT 64
-
-static void *R_Malloc(int size, void **user)
-{
-   int extra;
-   memblock_t *start, *rover, *base, *newblock;
-  
-   //
-   // scan through the block list looking for the first free block
-   // of sufficient size, throwing out any purgable blocks along the way
-   //
-   size += sizeof(memblock_t); // account for size of block header
-   size = (size + 7) & ~7;     // phrase align everything
-
-   start = base = refzone->rover;
-
-   while(base->user || base->size < size)
-   {
-      if(base->user)
-         rover = base;
-      else
-         rover = base->next;
-
-      if(!rover)
-         goto backtostart;
-
-      if(rover->user && rover->lockframe == framecount)
-      {
-         // hit an in use block, so move base past it
-         base = rover->next;
-         if(!base)
-         {
-backtostart:
-            base = &refzone->blocklist;
-         }
-
-         // CALICO_FIXME: if this actually runs out of RAM, it will loop forever.
-         // CALICO_FIXME: also, if it frees something the game still needs, it may crash!
-         if(base == start) // scanned all the way around the list
-            ++framecount;  // increment framecount to try again
-         continue;
-      }
-
-      // nullify user if valid
-      // CALICO_FIXME: non-portable pointer comparison
-      if(rover->user > (void **)1024)
-         *rover->user = NULL;
-
-      //
-      // free the rover block (adding the size to base)
-      //
-      rover->id   = 0;
-      rover->user = NULL; // mark as free
-
-      if(base != rover)
-      { 
-         // merge with base
-         base->size += rover->size;
-         base->next = rover->next;
-         if(rover->next)
-            rover->next->prev = base;
-      }
-   }
-
-   //
-   // found a block big enough
-   //
-   extra = base->size - size;
-   if(extra > MINFRAGMENT)
-   {
-      // there will be a free fragment after the allocated block
-      newblock = (memblock_t *)((byte *)base + size);
-      newblock->size = extra;
-      newblock->user = (void **)1; // free block - CALICO_FIXME: non-portable... idiom...
-      newblock->lockframe = 0;
-      newblock->tag = 0;
-      newblock->prev = base;
-      newblock->next = base->next;
-      if(newblock->next)
-         newblock->next->prev = newblock;
-      base->next = newblock;
-      base->size = size;
-   }
-
-   base->user = user; // mark as an in use block
-   base->lockframe = framecount; // mark as in use for this frame
-   base->id = ZONEID;
-   base->tag = PU_CACHE;
-
-   refzone->rover = base->next; // next allocation will start looking here
-   if(!refzone->rover)
-      refzone->rover = &refzone->blocklist;
-
-   *user = (void *)((byte *)base + sizeof(memblock_t));
-   
-   return (void *)((byte *)base + sizeof(memblock_t));
-}
-
 #define LENSHIFT 4 // this must be log2(LOOKAHEAD_SIZE)
 
 //
 // Decompress an lzss-compressed lump
+// CALICO: the original decoder, kept as the reference for -checklzss
 //
-static void R_decode(byte *input, pixel_t *output)
+static void R_decode_ref(byte *input, pixel_t *output)
 {
    int getidbyte = 0;
    int len;
@@ -166,47 +73,303 @@ static void R_decode(byte *input, pixel_t *output)
    }
 }
 
+//
+// CALICO: as for decode in w_wad.c, handle a group of eight codes per idbyte,
+// translate a group of eight literals without testing each flag, and copy
+// back-references which do not overlap their own output with memcpy.
+//
+static void R_decode(byte *input, pixel_t *output)
+{
+   int len;
+   int pos;
+   int idbyte;
+   int bit;
+   pixel_t *source;
+
+   while(1)
+   {
+      idbyte = *input++;
+
+      // eight literals
+      if(!idbyte)
+      {
+         output[0] = vgatojag[input[0]];
+         output[1] = vgatojag[input[1]];
+         output[2] = vgatojag[input[2]];
+         output[3] = vgatojag[input[3]];
+         output[4] = vgatojag[input[4]];
+         output[5] = vgatojag[input[5]];
+         output[6] = vgatojag[input[6]];
+         output[7] = vgatojag[input[7]];
+         output += 8;
+         input  += 8;
+         continue;
+      }
+
+      for(bit = 0; bit < 8; bit++, idbyte >>= 1)
+      {
+         if(!(idbyte & 1))
+         {
+            *output++ = vgatojag[*input++];
+            continue;
+         }
+
+         pos = ((input[0] << LENSHIFT) | (input[1] >> LENSHIFT)) + 1;
+         len = (input[1] & 0xf) + 1;
+         input += 2;
+         if(len == 1)
+            return;
+
+         source = output - pos;
+         if(pos >= len)
+         {
+            memcpy(output, source, len * sizeof(pixel_t));
+            output += len;
+         }
+         else
+         {
+            // the copy reads its own output; must go a pixel at a time
+            pixel_t *end = output + len;
+            while(output < end)
+               *output++ = *source++;
+         }
+      }
+   }
+}
+
+//
+// CALICO: decode every compressed lump with both the fast and the original
+// graphics decoder and stop on the first difference. Run with -checklzss.
+//
+void R_CheckDecode(void)
+{
+   int i, size, checked = 0;
+   pixel_t *fast, *ref;
+   lumpinfo_t *l;
+
+   for(i = 0, l = lumpinfo; i < numlumps; i++, l++)
+   {
+      byte *src;
+
+      if(!(l->name[0] & 0x80))
+         continue;
+
+      size = BIGLONG(l->size) * sizeof(pixel_t);
+      src  = wadfileptr + BIGLONG(l->filepos);
+      fast = malloc(size + sizeof(pixel_t));
+      ref  = malloc(size + sizeof(pixel_t));
+      if(!fast || !ref)
+         I_Error("R_CheckDecode: no memory for lump %i", i);
+
+      R_decode(src, fast);
+      R_decode_ref(src, ref);
+      if(memcmp(fast, ref, size))
+         I_Error("R_CheckDecode: lump %i decodes differently", i);
+
+      free(fast);
+      free(ref);
+      ++checked;
+   }
+
+   D_printf("R_CheckDecode: %i lumps ok\n", checked);
+}
+
+// CALICO: post tables built from sprite patches, kept in the graphics cache
+static spriteposts_t *spriteposts[MAXLUMPS];
+
+//
+// CALICO: Get the posts of a sprite patch, building them on first use. The
+// patch's big-endian column headers are walked once here rather than every
+// time a column is drawn.
+//
+spriteposts_t *R_SpritePosts(int lumpnum)
+{
+   patch_t        *patch;
+   column_t       *column;
+   spriteposts_t  *sp;
+   spritepost_t   *post;
+   int             i, width, numposts = 0;
+
+   if((sp = spriteposts[lumpnum]))
+   {
+      R_CacheTouch(sp);
+      return sp;
+   }
+
+   patch = (patch_t *)(wadfileptr + BIGLONG(lumpinfo[lumpnum].filepos));
+   width = BIGSHORT(patch->width);
+
+   for(i = 0; i < width; i++)
+   {
+      column = (column_t *)((byte *)patch + BIGSHORT(patch->columnofs[i]));
+      for(; column->topdelta != 0xff; column++)
+         ++numposts;
+   }
+
+   sp = R_CacheAlloc(sizeof(*sp) + width * sizeof(spritecolumn_t) + numposts * sizeof(spritepost_t),
+                     (void **)&spriteposts[lumpnum]);
+   sp->width   = width;
+   sp->columns = (spritecolumn_t *)(sp + 1);
+   sp->posts   = post = (spritepost_t *)(sp->columns + width);
+
+   for(i = 0; i < width; i++)
+   {
+      column = (column_t *)((byte *)patch + BIGSHORT(patch->columnofs[i]));
+      sp->columns[i].firstpost = (unsigned short)(post - sp->posts);
+
+      for(; column->topdelta != 0xff; column++, post++)
+      {
+         post->topdelta = column->topdelta;
+         post->length   = column->length;
+         post->dataofs  = BIGSHORT(column->dataofs);
+      }
+
+      sp->columns[i].numposts = (unsigned short)(post - sp->posts - sp->columns[i].firstpost);
+   }
+
+   return sp;
+}
+
+//
+// CALICO: bytes a graphic takes up once decoded, with room for its mipmaps
+//
+static int R_PixelsSize(int lumpnum)
+{
+   // compact pixels are the lump as it is, and never have mipmaps
+   if(compactpixels)
+      return BIGLONG(lumpinfo[lumpnum].size);
+
+   // doubled lump size, as translates from 8-bit paletted to 16-bit CRY
+   // while decompressing
+   return (BIGLONG(lumpinfo[lumpnum].size) + R_MipPixels(lumpnum)) * (int)sizeof(pixel_t);
+}
+
+//
+// CALICO: allocate room in the graphics cache for a lump's decoded pixels,
+// split from R_LoadPixels so that several lumps can be decoded at once
+//
+static pixel_t *R_AllocPixels(int lumpnum)
+{
+   // CALICO: taken from the decoded graphics cache instead of the refzone
+   return R_CacheAlloc(R_PixelsSize(lumpnum), &lumpcache[lumpnum]);
+}
+
+//
+// CALICO: decode a lump into pixels allocated by R_AllocPixels. Touches
+// nothing shared, so it is safe to run on a job or streaming thread.
+//
+static void R_DecodePixels(int lumpnum, void *dest)
+{
+   lumpinfo_t *info  = &lumpinfo[lumpnum];
+   pixel_t    *rdest = dest;
+   byte       *decoded;
+
+   // CALICO: compact pixels are only decompressed
+   if(compactpixels)
+   {
+      W_ReadLump(lumpnum, dest);
+      return;
+   }
+
+   // decompress
+   // CALICO: or only translate, if the lump cache already holds it decoded
+   if((decoded = W_DecodedLump(lumpnum)))
+   {
+      int count = BIGLONG(info->size); // CALICO: endianness correction required
+      int i;
+
+      for(i = 0; i < count; i++)
+         rdest[i] = vgatojag[decoded[i]];
+   }
+   else
+      R_decode(wadfileptr + BIGLONG(info->filepos), rdest); // CALICO: ditto
+
+   R_BuildMipmaps(lumpnum, rdest); // CALICO
+}
+
 //
 // Load and decode a compressed graphic resource and store it in the lumpcache
+// CALICO: also used by the hardware renderer
 //
-static pixel_t *R_LoadPixels(int lumpnum)
+pixel_t *R_LoadPixels(int lumpnum)
 {
-   void       *rdest;
-   byte       *rsrc;
-   lumpinfo_t *info;
-   int         count;
+   pixel_t *rdest;
 
    // already cached?
+   // CALICO: or on its way from the streaming thread
    rdest = lumpcache[lumpnum];
    if(rdest != NULL)
+   {
+      W_WaitStream(lumpnum);
       return rdest;
+   }
 
-   info  = &lumpinfo[lumpnum];
-   count = BIGLONG(info->size); // CALICO: endianness correction required
+   rdest = R_AllocPixels(lumpnum);
+   R_DecodePixels(lumpnum, rdest);
 
-   // allocate at doubled lump size, as translates from 8-bit paletted to 
-   // 16-bit CRY while decompressing
-   rdest = R_Malloc(count * 2, &lumpcache[lumpnum]);
-   rsrc  = wadfileptr + BIGLONG(info->filepos); // CALICO: ditto
+   return rdest;
+}
 
-   // decompress
-   R_decode(rsrc, rdest);
+//
+// CALICO: streamed graphics are pinned until they are decoded
+//
+static void R_FinishPixels(int lumpnum, void *dest, int data)
+{
+   R_CacheUnpin(dest);
+}
+
+//
+// CALICO: start decoding a graphic on the streaming thread if it isn't
+// already loaded, and there is room for it in the cache
+//
+void R_PrefetchPixels(int lumpnum)
+{
+   pixel_t *rdest;
 
-   lumpcache[lumpnum] = rdest;
+   if(lumpcache[lumpnum] || !W_CanStream() || R_PixelsSize(lumpnum) > R_CacheRoom())
+      return;
 
-   return rdest;
+   rdest = R_AllocPixels(lumpnum);
+   R_CachePin(rdest);
+   W_StreamLump(lumpnum, rdest, R_DecodePixels, R_FinishPixels, 0);
+}
+
+//
+// CALICO: prefetch hint for a sprite frame which something is about to show,
+// such as the next state of a mobj, or a monster which has just teleported
+// in. Every rotation is fetched, since the view it will be seen from is not
+// known yet.
+//
+void R_PrefetchSprite(int sprite, int frame)
+{
+   spriteframe_t *sprframe;
+   int            i;
+
+   if(!streaming)
+      return;
+
+   frame &= FF_FRAMEMASK;
+   if(frame >= sprites[sprite].numframes)
+      return;
+
+   sprframe = &sprites[sprite].spriteframes[frame];
+   for(i = 0; i < (sprframe->rotate ? 8 : 1); i++)
+   {
+      // column pixel data is in the lump after the patch
+      R_PrefetchPixels(sprframe->lump[i] + 1);
+   }
 }
 
 //
 // Cache all graphics needed to render the current frame
 //
-void R_Cache(void)
+void R_Cache(rview_t *rv)
 {
    viswall_t   *wall;
    vissprite_t *spr;
 
-   wall = viswalls;
-   while(wall < lastwallcmd)
+   wall = rv->viswalls;
+   while(wall < rv->lastwallcmd)
    {
       // load upper or middle texture if needed
       if(wall->actionbits & AC_TOPTEXTURE)
@@ -240,8 +403,8 @@ void R_Cache(void)
       ++wall;
    }
 
-   spr = vissprites;
-   while(spr < vissprite_p)
+   spr = rv->vissprites;
+   while(spr < rv->vissprite_p)
    {
       if(spr->pixels == NULL)
          spr->pixels = R_LoadPixels(spr->patchnum + 1);
@@ -250,5 +413,261 @@ void R_Cache(void)
    }
 }
 
+//=============================================================================
+//
+// CALICO: level precaching
+//
+
+typedef struct precache_s
+{
+   int  lumps;   // graphics decoded
+   int  bytes;   // cache memory they take up
+   int  skipped; // graphics left to be loaded on first use
+   int *queue;   // lumps allocated but not yet decoded, lumps long
+} precache_t;
+
+//
+// Job to decode one queued graphic
+//
+static void R_PrecacheJob(void *data, int index)
+{
+   int lumpnum = ((precache_t *)data)->queue[index];
+
+   R_DecodePixels(lumpnum, lumpcache[lumpnum]);
+}
+
+//
+// Make room for one graphic, unless it would crowd out the ones already
+// loaded, and queue it to be decoded
+//
+static void R_PrecacheLump(precache_t *pc, int lumpnum)
+{
+   int size;
+
+   // keep anything the last level left behind which this one needs
+   if(lumpcache[lumpnum])
+   {
+      R_CacheTouch(lumpcache[lumpnum]);
+      return;
+   }
+
+   size = R_PixelsSize(lumpnum);
+   if(size > R_CacheRoom())
+   {
+      ++pc->skipped;
+      return;
+   }
+
+   R_AllocPixels(lumpnum);
+   pc->queue[pc->lumps++] = lumpnum;
+   pc->bytes += size;
+}
+
+//
+// CALICO: true if a flat animation is seen in the level. P_UpdateSpecials
+// only retranslates an animation's last flat, so only sectors using that
+// one show it.
+//
+static boolean R_AnimationUsed(const anim_t *anim)
+{
+   int       i;
+   sector_t *sec;
+
+   if(anim->istexture)
+      return false; // only flats are animated
+
+   for(i = 0, sec = sectors; i < numsectors; i++, sec++)
+   {
+      if(sec->floorpic == anim->picnum || sec->ceilingpic == anim->picnum)
+         return true;
+   }
+
+   return false;
+}
+
+//
+// Mark the sprites used by a state and every state which follows it
+//
+static void R_MarkStateSprites(int statenum, byte *statesseen, boolean *spritesused)
+{
+   while(statenum != S_NULL && !statesseen[statenum])
+   {
+      statesseen[statenum] = 1;
+      spritesused[states[statenum].sprite] = true;
+      statenum = states[statenum].nextstate;
+   }
+}
+
+//
+// Decode the wall textures, flats, and sprites used by the level before the
+// first frame is drawn, so that they are not first loaded mid-frame by
+// R_Cache. Anything that will not fit alongside what is already loaded is
+// left for R_Cache. Nothing here is pinned beyond the current frame, so it
+// may all be evicted as usual once the level is running. Room is made for
+// everything first, and then it is all decoded at once on the job threads.
+//
+void R_PrecacheLevel(void)
+{
+   precache_t  pc;
+   int         i, j, k;
+   byte        statesseen[NUMSTATES];
+   boolean     spritesused[NUMSPRITES];
+   boolean     typesused[NUMMOBJTYPES];
+   mobj_t     *mo;
+   sector_t   *sec;
+   anim_t     *anim;
+
+   D_memset(&pc, 0, sizeof(pc));
+   if(!(pc.queue = malloc(numlumps * sizeof(*pc.queue))))
+      I_Error("R_PrecacheLevel: no memory for %i lumps", numlumps);
+
+   // start a new frame so that graphics from the last level can be evicted
+   ++framecount;
+
+   // what was used the last time the level was played comes first, in the
+   // order it was needed, unless the streaming thread is to fetch it
+   if(!streaming)
+   {
+      j = 0;
+      while((i = W_WorkingSetGraphic(&j)) != -1)
+         R_PrecacheLump(&pc, i);
+   }
+
+   // wall textures, which P_LoadSideDefs has counted
+   for(i = 0; i < numtextures; i++)
+   {
+      if(textures[i].usecount)
+         R_PrecacheLump(&pc, textures[i].lumpnum);
+   }
+
+   if(skytexturep)
+      R_PrecacheLump(&pc, skytexturep->lumpnum);
+
+   // flats
+   for(i = 0, sec = sectors; i < numsectors; i++, sec++)
+   {
+      R_PrecacheLump(&pc, firstflat + sec->floorpic);
+      if(sec->ceilingpic != -1)
+         R_PrecacheLump(&pc, firstflat + sec->ceilingpic);
+   }
+
+   // every frame of the animated flats, which R_PinAnimations then keeps
+   for(anim = anims; anim < lastanim; anim++)
+   {
+      if(!R_AnimationUsed(anim))
+         continue;
+      for(j = anim->basepic; j <= anim->picnum; j++)
+         R_PrecacheLump(&pc, firstflat + j);
+   }
+
+   // sprites for every state which the spawned things, and the weapons the
+   // players have, can reach
+   D_memset(statesseen,  0, sizeof(statesseen));
+   D_memset(spritesused, 0, sizeof(spritesused));
+   D_memset(typesused,   0, sizeof(typesused));
+
+   for(mo = mobjhead.next; mo != &mobjhead; mo = mo->next)
+      typesused[mo->type] = true;
+
+   for(i = 0; i < NUMMOBJTYPES; i++)
+   {
+      mobjinfo_t *info = &mobjinfo[i];
+
+      if(!typesused[i])
+         continue;
+
+      R_MarkStateSprites(info->spawnstate,   statesseen, spritesused);
+      R_MarkStateSprites(info->seestate,     statesseen, spritesused);
+      R_MarkStateSprites(info->painstate,    statesseen, spritesused);
+      R_MarkStateSprites(info->meleestate,   statesseen, spritesused);
+      R_MarkStateSprites(info->missilestate, statesseen, spritesused);
+      R_MarkStateSprites(info->deathstate,   statesseen, spritesused);
+      R_MarkStateSprites(info->xdeathstate,  statesseen, spritesused);
+   }
+
+   for(i = 0; i < MAXPLAYERS; i++)
+   {
+      if(!playeringame[i])
+         continue;
+
+      for(j = 0; j < NUMWEAPONS; j++)
+      {
+         weaponinfo_t *winfo = &weaponinfo[j];
+
+         if(!players[i].weaponowned[j])
+            continue;
+
+         R_MarkStateSprites(winfo->upstate,    statesseen, spritesused);
+         R_MarkStateSprites(winfo->downstate,  statesseen, spritesused);
+         R_MarkStateSprites(winfo->readystate, statesseen, spritesused);
+         R_MarkStateSprites(winfo->atkstate,   statesseen, spritesused);
+         R_MarkStateSprites(winfo->flashstate, statesseen, spritesused);
+      }
+   }
+
+   for(i = 0; i < NUMSPRITES; i++)
+   {
+      spritedef_t *sprdef = &sprites[i];
+
+      if(!spritesused[i])
+         continue;
+
+      for(j = 0; j < sprdef->numframes; j++)
+      {
+         spriteframe_t *sprframe = &sprdef->spriteframes[j];
+
+         for(k = 0; k < (sprframe->rotate ? 8 : 1); k++)
+         {
+            // column pixel data is in the lump after the patch
+            R_PrecacheLump(&pc, sprframe->lump[k] + 1);
+         }
+      }
+   }
+
+   M_RunJobs("precache", R_PrecacheJob, &pc, pc.lumps);
+   free(pc.queue);
+
+   D_printf("R_PrecacheLevel: %i graphics, %i bytes, %i skipped\n", pc.lumps, pc.bytes, pc.skipped);
+}
+
+//
+// CALICO: load every frame of the flat animations the level shows, and pin
+// them all until the next level. Each frame is only on screen for four tics
+// in every cycle, which otherwise leaves it to be evicted in between and
+// decoded again when P_UpdateSpecials comes back around to it.
+//
+static int *animpins;
+static int  numanimpins, maxanimpins;
+
+void R_PinAnimations(void)
+{
+   int     i;
+   anim_t *anim;
+
+   // the last level's frames are still cached, as they were pinned
+   for(i = 0; i < numanimpins; i++)
+      R_CacheUnpin(lumpcache[animpins[i]]);
+   numanimpins = 0;
+
+   for(anim = anims; anim < lastanim; anim++)
+   {
+      if(!R_AnimationUsed(anim))
+         continue;
+
+      for(i = firstflat + anim->basepic; i <= firstflat + anim->picnum; i++)
+      {
+         if(numanimpins == maxanimpins)
+         {
+            maxanimpins = maxanimpins ? maxanimpins * 2 : 32;
+            if(!(animpins = realloc(animpins, maxanimpins * sizeof(*animpins))))
+               I_Error("R_PinAnimations: no memory for %i frames", maxanimpins);
+         }
+
+         R_CachePin(R_LoadPixels(i));
+         animpins[numanimpins++] = i;
+      }
+   }
+}
+
 // EOF
 
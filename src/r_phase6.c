@@ -4,6 +4,7 @@
   Renderer phase 6 - Seg Loop 
 */
 
+#include <stdint.h>
 #include "r_local.h"
 
 typedef struct drawtex_s
@@ -14,92 +15,188 @@ typedef struct drawtex_s
    int      topheight;
    int      bottomheight;
    int      texturemid;
+   int      miplevels; // CALICO
+   int      mipoffsets[MAXMIPLEVELS + 1]; // CALICO: R_MipOffset of each level
+
+   // CALICO: the last column drawn, which the next may be copied from
+   int      lastx, lasttop, lastbottom, lastlight, lastfrac, lastiscale;
+   pixel_t *lastsrc;
 } drawtex_t;
 
-static drawtex_t toptex;
-static drawtex_t bottomtex;
+//
+// CALICO: seg loop state, formerly file-scope statics. Each column stripe
+// gets its own copy so that stripes can be rendered by separate threads.
+//
+typedef struct segdraw_s
+{
+   drawtex_t  toptex;
+   drawtex_t  bottomtex;
+   int        lightmin, lightmax, lightsub, lightcoef;
+   int        floorclipx, ceilingclipx, x, scale, iscale, texturecol, texturelight;
+   rstripe_t *stripe;
+
+   // CALICO: per-column values for the wall being drawn, worked out for all
+   // of its columns in the stripe before any are drawn
+   int        scales[MAXRENDERWIDTH];
+   int        iscales[MAXRENDERWIDTH];
+   int        texturecols[MAXRENDERWIDTH];
+   int        texturelights[MAXRENDERWIDTH];
+   int        miplevels[MAXRENDERWIDTH]; // R_MipLevel up to MAXMIPLEVELS
+
+   // CALICO: columns may be copied from their neighbours; see R_DrawTexture
+   boolean    dupcolumns;
+} segdraw_t;
+
+extern int R_ConfigDupColumns(void);
+
+//
+// CALICO: hash a visplane key
+//
+static inline unsigned int R_PlaneHash(fixed_t height, pixel_t *picnum, int lightlevel)
+{
+   unsigned int h = (unsigned int)(height >> FRACBITS) * 31;
+
+   h ^= (unsigned int)((uintptr_t)picnum >> 4);
+   h ^= (unsigned int)lightlevel * 7;
 
-static int clipbounds[SCREENWIDTH];
-static int lightmin, lightmax, lightsub, lightcoef;
-static int floorclipx, ceilingclipx, x, scale, iscale, texturecol, texturelight;
+   return (h ^ (h >> 8)) & (PLANEHASHSIZE - 1);
+}
 
 //
 // Check for a matching visplane in the visplanes array, or set up a new one
 // if no compatible match can be found.
 //
-static visplane_t *R_FindPlane(visplane_t *check, fixed_t height, pixel_t *picnum, 
-                               int lightlevel, int start, int stop)
+// CALICO: candidates come from a hash chain rather than a scan of every plane,
+// and only the columns a plane covers are marked in its open[] array. As in
+// the original, planes before check are not considered.
+//
+static visplane_t *R_FindPlane(rstripe_t *stripe, visplane_t *check, fixed_t height, 
+                               pixel_t *picnum, int lightlevel, int start, int stop)
 {
+   unsigned int hash = R_PlaneHash(height, picnum, lightlevel);
+   visplane_t  *pl;
    int i;
 
-   while(check < lastvisplane)
+   for(pl = stripe->planehash[hash]; pl; pl = pl->hashnext)
    {
-      if(height == check->height && // same plane as before?
-         picnum == check->picnum &&
-         lightlevel == check->lightlevel)
+      if(pl < check)
+         continue;
+
+      if(height == pl->height && // same plane as before?
+         picnum == pl->picnum &&
+         lightlevel == pl->lightlevel)
       {
-         if(check->open[start] == OPENMARK)
+         if(R_PlaneOpen(pl, start))
          {
             // found a plane, so adjust bounds and return it
-            if(start < check->minx) // in range of the plane?
-               check->minx = start; // mark the new edge
-            if(stop > check->maxx)
-               check->maxx = stop;  // mark the new edge
+            if(start < pl->minx) // in range of the plane?
+            {
+               for(i = start; i < pl->minx; i++)
+                  pl->open[i] = OPENMARK;
+               pl->minx = start; // mark the new edge
+            }
+            if(stop > pl->maxx)
+            {
+               for(i = pl->maxx + 1; i <= stop; i++)
+                  pl->open[i] = OPENMARK;
+               pl->maxx = stop;  // mark the new edge
+            }
 
-            return check; // use the same one as before
+            return pl; // use the same one as before
          }
       }
-      ++check;
    }
 
    // make a new plane
-   check = lastvisplane;
-   ++lastvisplane;
+   // CALICO: when out of visplanes, columns go to the one which is never drawn
+   if(!(check = R_PoolAlloc(&stripe->planepool, 1)))
+      return stripe->visplanes;
+   stripe->lastvisplane = check + 1;
 
    check->height = height;
    check->picnum = picnum;
    check->lightlevel = lightlevel;
    check->minx = start;
    check->maxx = stop;
+   check->hashnext = NULL;
 
-   for(i = 0; i < SCREENWIDTH/4; i++)
-   {
-      check->open[i*4  ] = OPENMARK;
-      check->open[i*4+1] = OPENMARK;
-      check->open[i*4+2] = OPENMARK;
-      check->open[i*4+3] = OPENMARK;
-   }
+   for(i = start; i <= stop; i++)
+      check->open[i] = OPENMARK;
+
+   if(stripe->planetail[hash])
+      stripe->planetail[hash]->hashnext = check;
+   else
+      stripe->planehash[hash] = check;
+   stripe->planetail[hash] = check;
 
    return check;
 }
 
+//
+// CALICO: draw a column of a wall texture, or copy it from the column just
+// drawn to the left if that one had all the same parameters and so came
+// out the same. This is common for distant walls at high render sizes. The
+// pixels copied must still be the ones drawn for that column, so "after",
+// the wall's piece drawn below this one in each column, must not have
+// overlapped them.
+//
+static void R_TextureColumn(segdraw_t *sd, drawtex_t *tex, const drawtex_t *after,
+                            int top, int bottom, fixed_t frac, fixed_t iscale, 
+                            pixel_t *src, int height)
+{
+   int x = sd->x;
+
+   if(sd->dupcolumns && tex->lastx == x - 1 && tex->lasttop == top && 
+      tex->lastbottom == bottom && tex->lastlight == sd->texturelight && 
+      tex->lastfrac == frac && tex->lastiscale == iscale && tex->lastsrc == src &&
+      (!after || after->lastx != x - 1 || after->lasttop > bottom))
+   {
+      I_CopyColumn(x, x - 1, top, bottom);
+   }
+   else if(height & (height - 1)) // height is not a power-of-2?
+      I_DrawColumnNPO2(x, top, bottom, sd->texturelight, frac, iscale, src, height);
+   else
+      I_DrawColumn(x, top, bottom, sd->texturelight, frac, iscale, src, height);
+
+   tex->lastx      = x;
+   tex->lasttop    = top;
+   tex->lastbottom = bottom;
+   tex->lastlight  = sd->texturelight;
+   tex->lastfrac   = frac;
+   tex->lastiscale = iscale;
+   tex->lastsrc    = src;
+}
+
 //
 // Render a wall texture as columns
 //
-static void R_DrawTexture(drawtex_t *tex)
+static void R_DrawTexture(segdraw_t *sd, drawtex_t *tex, const drawtex_t *after, int miplevel)
 {
    int top, bottom, colnum, frac;
    pixel_t *src;
 
-   top = CENTERY - ((scale * tex->topheight) / (1 << (HEIGHTBITS + SCALEBITS)));
+   top = CENTERY - ((sd->scale * tex->topheight) / (1 << (HEIGHTBITS + SCALEBITS)));
 
-   if(top <= ceilingclipx)
-      top = ceilingclipx + 1;
+   if(top <= sd->ceilingclipx)
+      top = sd->ceilingclipx + 1;
 
-   bottom = CENTERY - 1 - ((scale * tex->bottomheight) / (1 << (HEIGHTBITS + SCALEBITS)));
+   bottom = CENTERY - 1 - ((sd->scale * tex->bottomheight) / (1 << (HEIGHTBITS + SCALEBITS)));
 
-   if(bottom >= floorclipx)
-      bottom = floorclipx - 1;
+   if(bottom >= sd->floorclipx)
+      bottom = sd->floorclipx - 1;
 
    // column has no length?
    if(top > bottom)
+   {
+      tex->lastx = -1; // CALICO: nothing here to copy
       return;
+   }
 
-   colnum = texturecol;
-   frac = tex->texturemid - (CENTERY - top) * iscale;
+   colnum = sd->texturecol;
+   frac = tex->texturemid - (CENTERY - top) * sd->iscale;
 
    // DEBUG: fixes green pixels in MAP01...
-   frac += (iscale + (iscale >> 5) + (iscale >> 6));
+   frac += (sd->iscale + (sd->iscale >> 5) + (sd->iscale >> 6));
 
    while(frac < 0)
    {
@@ -111,73 +208,149 @@ static void R_DrawTexture(drawtex_t *tex)
    // colnum = colnum - tex->width * (colnum / tex->width)
    colnum &= (tex->width - 1);
 
+   // CALICO: distant columns are drawn from a mipmap, where there are any;
+   // the level's column, rows, and step are all the full size ones halved
+   // once for each level down
+   if(tex->miplevels)
+   {
+      int level = miplevel < tex->miplevels ? miplevel : tex->miplevels;
+
+      if(level)
+      {
+         int height = tex->height >> level;
+
+         src = R_TexelAddr(tex->data, tex->mipoffsets[level] + (colnum >> level) * height);
+         R_TextureColumn(sd, tex, after, top, bottom, frac >> level, sd->iscale >> level, 
+                         src, height);
+         return;
+      }
+   }
+
    // CALICO: Jaguar-specific GPU blitter input calculation starts here.
    // We invoke a software column drawer instead.
-   src = tex->data + colnum * tex->height;
-   if(tex->height & (tex->height - 1)) // height is not a power-of-2?
-      I_DrawColumnNPO2(x, top, bottom, texturelight, frac, iscale, src, tex->height);
+   src = R_TexelAddr(tex->data, colnum * tex->height);
+   R_TextureColumn(sd, tex, after, top, bottom, frac, sd->iscale, src, tex->height);
+}
+
+//
+// CALICO: work out the scale, and for textured walls the texture column and
+// light, of count columns of a wall starting at x. Each is a simple loop over
+// the columns rather than being interleaved with the drawing, so the
+// compiler can keep them tight or vectorize them.
+//
+static void R_WallColumns(segdraw_t *sd, viswall_t *segl, int x, int count)
+{
+   int i, scalefrac = segl->scalefrac + (x - segl->start) * segl->scalestep;
+   int *scales = sd->scales;
+
+   for(i = 0; i < count; i++)
+   {
+      int scale = (scalefrac + i * segl->scalestep) / (1 << FIXEDTOSCALE);
+      scales[i] = (scale >= 0x7fff) ? 0x7fff : scale; // fix the scale to maximum
+   }
+
+   if(!(segl->actionbits & AC_CALCTEXTURE))
+      return;
+
+   for(i = 0; i < count; i++)
+      sd->iscales[i] = (1 << (FRACBITS+SCALEBITS)) / scales[i];
+
+   // CALICO: the mipmap level for the step, which each texture drawn in the
+   // column then limits to the levels it has
+   if(r_mipmaps)
+   {
+      for(i = 0; i < count; i++)
+         sd->miplevels[i] = R_MipLevel(sd->iscales[i], MAXMIPLEVELS);
+   }
    else
-      I_DrawColumn(x, top, bottom, texturelight, frac, iscale, src, tex->height);
+   {
+      for(i = 0; i < count; i++)
+         sd->miplevels[i] = 0;
+   }
+
+   // calculate texture offset
+   for(i = 0; i < count; i++)
+   {
+      fixed_t r = FixedMul(segl->distance, 
+                           finetangent[(segl->centerangle + xtoviewangle[x + i]) >> ANGLETOFINESHIFT]);
+      sd->texturecols[i] = (segl->offset - r) / FRACUNIT;
+   }
+
+   // calc light level
+   // CALICO: light by the 1x scale so that it doesn't change with the render size
+   for(i = 0; i < count; i++)
+   {
+      int light = (((scales[i] >> rendershift) * sd->lightcoef) / FRACUNIT) - sd->lightsub;
+      if(light < sd->lightmin)
+         light = sd->lightmin;
+      if(light > sd->lightmax)
+         light = sd->lightmax;
+
+      // convert to a hardware value
+      sd->texturelights[i] = -((255 - light) << 14) & 0xffffff;
+   }
 }
 
 //
 // Main seg clipping loop
 //
-static void R_SegLoop(viswall_t *segl)
+static void R_SegLoop(segdraw_t *sd, viswall_t *segl)
 {
-   int scalefrac, low, high, top, bottom;
+   int low, high, top, bottom, stop, startx;
    visplane_t *ceiling, *floor;
+   rstripe_t  *stripe = sd->stripe;
+   rview_t    *rv = stripe->view;
+
+   // CALICO: clip the seg to the stripe being drawn
+   sd->x = segl->start;
+   stop  = segl->stop;
+   if(sd->x < stripe->x1)
+      sd->x = stripe->x1;
+   if(stop > stripe->x2)
+      stop = stripe->x2;
+   if(sd->x > stop)
+      return;
 
-   x = segl->start;
-   scalefrac = segl->scalefrac;
+   startx = sd->x;
+   R_WallColumns(sd, segl, startx, stop - startx + 1);
 
    // force R_FindPlane for both planes
-   floor = ceiling = visplanes;
+   floor = ceiling = stripe->visplanes;
 
    do
    {
-      scale = scalefrac / (1 << FIXEDTOSCALE);
-      scalefrac += segl->scalestep;
+      int x = sd->x;
 
-      if(scale >= 0x7fff)
-         scale = 0x7fff; // fix the scale to maximum
+      sd->scale = sd->scales[x - startx];
 
       //
       // get ceilingclipx and floorclipx from clipbounds
       //
-      floorclipx   = clipbounds[x] & 0x00ff;
-      ceilingclipx = ((clipbounds[x] & 0xff00) >> 8) - 1;
+      sd->floorclipx   = rv->clipbounds[x] & OPENMASK;
+      sd->ceilingclipx = (int)(rv->clipbounds[x] >> OPENSHIFT) - 1;
 
       //
       // texture only stuff
       //
       if(segl->actionbits & AC_CALCTEXTURE)
       {
-         // calculate texture offset
-         fixed_t r = FixedMul(segl->distance, 
-                              finetangent[(segl->centerangle + xtoviewangle[x]) >> ANGLETOFINESHIFT]);
-
-         // other texture drawing info
-         texturecol = (segl->offset - r) / FRACUNIT;
-         iscale = (1 << (FRACBITS+SCALEBITS)) / scale;
-
-         // calc light level
-         texturelight = ((scale * lightcoef) / FRACUNIT) - lightsub;
-         if(texturelight < lightmin)
-            texturelight = lightmin;
-         if(texturelight > lightmax)
-            texturelight = lightmax;
-
-         // convert to a hardware value
-         texturelight = -((255 - texturelight) << 14) & 0xffffff;
+         // CALICO: offset, scale, and light were found by R_WallColumns
+         sd->texturecol   = sd->texturecols[x - startx];
+         sd->iscale       = sd->iscales[x - startx];
+         sd->texturelight = sd->texturelights[x - startx];
 
          //
          // draw textures
+         // CALICO: both pieces share the column's mipmap level
          //
          if(segl->actionbits & AC_TOPTEXTURE)
-            R_DrawTexture(&toptex);
+         {
+            R_DrawTexture(sd, &sd->toptex, 
+                          (segl->actionbits & AC_BOTTOMTEXTURE) ? &sd->bottomtex : NULL,
+                          sd->miplevels[x - startx]);
+         }
          if(segl->actionbits & AC_BOTTOMTEXTURE)
-            R_DrawTexture(&bottomtex);
+            R_DrawTexture(sd, &sd->bottomtex, NULL, sd->miplevels[x - startx]);
       }
 
       //
@@ -185,20 +358,20 @@ static void R_SegLoop(viswall_t *segl)
       //
       if(segl->actionbits & AC_ADDFLOOR)
       {
-         top = CENTERY - ((scale * segl->floorheight) / (1 << (HEIGHTBITS + SCALEBITS)));
-         if(top <= ceilingclipx)
-            top = ceilingclipx + 1;
+         top = CENTERY - ((sd->scale * segl->floorheight) / (1 << (HEIGHTBITS + SCALEBITS)));
+         if(top <= sd->ceilingclipx)
+            top = sd->ceilingclipx + 1;
          
-         bottom = floorclipx - 1;
+         bottom = sd->floorclipx - 1;
          
          if(top <= bottom)
          {
             if(floor->open[x] != OPENMARK)
             {
-               floor = R_FindPlane(floor + 1, segl->floorheight, segl->floorpic, 
-                                   segl->seglightlevel, x, segl->stop);
+               floor = R_FindPlane(stripe, floor + 1, segl->floorheight, segl->floorpic, 
+                                   segl->seglightlevel, x, stop);
             }
-            floor->open[x] = (unsigned short)((top << 8) + bottom);
+            floor->open[x] = ((unsigned int)top << OPENSHIFT) + bottom;
          }
       }
 
@@ -207,37 +380,37 @@ static void R_SegLoop(viswall_t *segl)
       //
       if(segl->actionbits & AC_ADDCEILING)
       {
-         top = ceilingclipx + 1;
+         top = sd->ceilingclipx + 1;
 
-         bottom = CENTERY - 1 - ((scale * segl->ceilingheight) / (1 << (HEIGHTBITS + SCALEBITS)));
-         if(bottom >= floorclipx)
-            bottom = floorclipx - 1;
+         bottom = CENTERY - 1 - ((sd->scale * segl->ceilingheight) / (1 << (HEIGHTBITS + SCALEBITS)));
+         if(bottom >= sd->floorclipx)
+            bottom = sd->floorclipx - 1;
          
          if(top <= bottom)
          {
             if(ceiling->open[x] != OPENMARK)
             {
-               ceiling = R_FindPlane(ceiling + 1, segl->ceilingheight, segl->ceilingpic, 
-                                     segl->seglightlevel, x, segl->stop);
+               ceiling = R_FindPlane(stripe, ceiling + 1, segl->ceilingheight, segl->ceilingpic, 
+                                     segl->seglightlevel, x, stop);
             }
-            ceiling->open[x] = (unsigned short)((top << 8) + bottom);
+            ceiling->open[x] = ((unsigned int)top << OPENSHIFT) + bottom;
          }
       }
 
       //
       // calc high and low
       //
-      low = CENTERY - ((scale * segl->floornewheight) / (1 << (HEIGHTBITS + SCALEBITS)));
+      low = CENTERY - ((sd->scale * segl->floornewheight) / (1 << (HEIGHTBITS + SCALEBITS)));
       if(low < 0)
          low = 0;
-      if(low > floorclipx)
-         low = floorclipx;
+      if(low > sd->floorclipx)
+         low = sd->floorclipx;
 
-      high = CENTERY - 1 - ((scale * segl->ceilingnewheight) / (1 << (HEIGHTBITS + SCALEBITS)));
-      if(high > SCREENHEIGHT - 1)
-         high = SCREENHEIGHT - 1;
-      if(high < ceilingclipx)
-         high = ceilingclipx;
+      high = CENTERY - 1 - ((sd->scale * segl->ceilingnewheight) / (1 << (HEIGHTBITS + SCALEBITS)));
+      if(high > renderheight - 1)
+         high = renderheight - 1;
+      if(high < sd->ceilingclipx)
+         high = sd->ceilingclipx;
 
       // bottom sprite clip sil
       if(segl->actionbits & AC_BOTTOMSIL)
@@ -250,18 +423,18 @@ static void R_SegLoop(viswall_t *segl)
       // sky mapping
       if(segl->actionbits & AC_ADDSKY)
       {
-         top = ceilingclipx + 1;
-         bottom = (CENTERY - ((scale * segl->ceilingheight) / (1 << (HEIGHTBITS + SCALEBITS)))) - 1;
+         top = sd->ceilingclipx + 1;
+         bottom = (CENTERY - ((sd->scale * segl->ceilingheight) / (1 << (HEIGHTBITS + SCALEBITS)))) - 1;
          
-         if(bottom >= floorclipx)
-            bottom = floorclipx - 1;
+         if(bottom >= sd->floorclipx)
+            bottom = sd->floorclipx - 1;
          
          if(top <= bottom)
          {
-            // CALICO: draw sky column
-            int colnum = ((viewangle + xtoviewangle[x]) >> ANGLETOSKYSHIFT) & 0xff;
-            pixel_t *data = skytexturep->data + colnum * skytexturep->height;
-            I_DrawColumn(x, top, bottom, 0, (top * 18204) << 2,  FRACUNIT + 7281, data, 128);
+            // CALICO: draw sky column, from the column found by R_SkyPrep
+            // CALICO: sky steps are scaled down with the render size
+            I_DrawSkyColumn(x, top, bottom, rv->skycolumns[x], ((top * 18204) << 2) >> rendershift, 
+                            (FRACUNIT + 7281) >> rendershift);
          }
       }
 
@@ -269,31 +442,69 @@ static void R_SegLoop(viswall_t *segl)
       {
          // rewrite clipbounds
          if(segl->actionbits & AC_NEWFLOOR)
-            floorclipx = low;
+            sd->floorclipx = low;
          if(segl->actionbits & AC_NEWCEILING)
-            ceilingclipx = high;
+            sd->ceilingclipx = high;
 
-         clipbounds[x] = ((ceilingclipx + 1) << 8) + floorclipx;
+         rv->clipbounds[x] = ((unsigned int)(sd->ceilingclipx + 1) << OPENSHIFT) + sd->floorclipx;
       }
    }
-   while(++x <= segl->stop);
+   while(++sd->x <= stop);
+}
+
+//
+// CALICO: find the sky texture column of each screen column once per frame,
+// before the stripes are drawn, rather than in every wall with sky above it
+//
+void R_SkyPrep(rview_t *rv)
+{
+   int x;
+
+   if(!rv->skyvisible || !skytexturep->data)
+      return;
+
+   I_SetupSky(skytexturep->data, skytexturep->lumpnum, skytexturep->height);
+
+   for(x = 0; x < renderwidth; x++)
+      rv->skycolumns[x] = ((rv->viewangle + xtoviewangle[x]) >> ANGLETOSKYSHIFT) & 0xff;
+}
+
+//
+// CALICO: set up one of a wall's textures for the seg loop
+//
+static void R_SetDrawTexture(drawtex_t *dt, texture_t *tex, int topheight, int bottomheight,
+                             int texturemid)
+{
+   int level;
+
+   dt->topheight    = topheight;
+   dt->bottomheight = bottomheight;
+   dt->texturemid   = texturemid;
+   dt->width        = tex->width;
+   dt->height       = tex->height;
+   dt->data         = tex->data;
+   dt->miplevels    = tex->miplevels;
+   dt->lastx        = -1;
+
+   for(level = 1; level <= tex->miplevels; level++)
+      dt->mipoffsets[level] = R_MipOffset(tex->width, tex->height, level);
 }
 
-void R_SegCommands(void)
+//
+// CALICO: draw all wall commands within a single column stripe
+//
+void R_SegCommands(rstripe_t *stripe)
 {
    int i;
-   int *clip;
+   rview_t   *rv = stripe->view;
    viswall_t *segl;
+   segdraw_t  sd;
+
+   sd.stripe = stripe;
 
    // initialize the clipbounds array
-   clip = clipbounds;
-   for(i = 0; i < SCREENWIDTH / 4; i++)
-   {
-      *clip++ = SCREENHEIGHT;
-      *clip++ = SCREENHEIGHT;
-      *clip++ = SCREENHEIGHT;
-      *clip++ = SCREENHEIGHT;
-   }
+   for(i = stripe->x1; i <= stripe->x2; i++)
+      rv->clipbounds[i] = renderheight;
 
    /*
    ; setup blitter
@@ -306,43 +517,42 @@ void R_SegCommands(void)
    store r1,(r0)        *r0 = r1;
    */
   
-   segl = viswalls;
-   while(segl < lastwallcmd)
+   segl = rv->viswalls;
+   while(segl < rv->lastwallcmd)
    {
-      lightmin = segl->seglightlevel - (255 - segl->seglightlevel) * 2;
-      if(lightmin < 0)
-         lightmin = 0;
+      // CALICO: skip walls which lie entirely outside of this stripe
+      if(segl->stop < stripe->x1 || segl->start > stripe->x2)
+      {
+         ++segl;
+         continue;
+      }
 
-      lightmax = segl->seglightlevel;
+      sd.lightmin = segl->seglightlevel - (255 - segl->seglightlevel) * 2;
+      if(sd.lightmin < 0)
+         sd.lightmin = 0;
+
+      sd.lightmax = segl->seglightlevel;
       
-      lightsub  = 160 * (lightmax - lightmin) / (800 - 160);
-      lightcoef = ((lightmax - lightmin) << FRACBITS) / (800 - 160);
+      sd.lightsub  = 160 * (sd.lightmax - sd.lightmin) / (800 - 160);
+      sd.lightcoef = ((sd.lightmax - sd.lightmin) << FRACBITS) / (800 - 160);
 
       if(segl->actionbits & AC_TOPTEXTURE)
       {
-         texture_t *tex = segl->t_texture;
-
-         toptex.topheight    = segl->t_topheight;
-         toptex.bottomheight = segl->t_bottomheight;
-         toptex.texturemid   = segl->t_texturemid;
-         toptex.width        = tex->width;
-         toptex.height       = tex->height;
-         toptex.data         = tex->data;
+         R_SetDrawTexture(&sd.toptex, segl->t_texture, segl->t_topheight, 
+                          segl->t_bottomheight, segl->t_texturemid);
       }
 
       if(segl->actionbits & AC_BOTTOMTEXTURE)
       {
-         texture_t *tex = segl->b_texture;
-
-         bottomtex.topheight    = segl->b_topheight;
-         bottomtex.bottomheight = segl->b_bottomheight;
-         bottomtex.texturemid   = segl->b_texturemid;
-         bottomtex.width        = tex->width;
-         bottomtex.height       = tex->height;
-         bottomtex.data         = tex->data;
+         R_SetDrawTexture(&sd.bottomtex, segl->b_texture, segl->b_topheight, 
+                          segl->b_bottomheight, segl->b_texturemid);
       }
 
-      R_SegLoop(segl);
+      // CALICO: sky is drawn over a column after its textures, so a column
+      // beneath the sky may not be what was drawn for the wall
+      sd.dupcolumns = !(segl->actionbits & AC_ADDSKY) && R_ConfigDupColumns();
+
+      R_SegLoop(&sd, segl);
 
       ++segl;
    }
@@ -6,68 +6,139 @@
 
 #include "r_local.h"
 
-static fixed_t planeheight;
-static angle_t planeangle;
-static fixed_t planex, planey;
-static int     plane_lightcoef, plane_lightsub;
-static int     plane_lightmin, plane_lightmax;
+// CALICO: SSE2 is only used where every CPU the build can run on has it
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CALICO_SIMD_X86
+#include <emmintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define CALICO_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(__GNUC__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#define TARGET_SSE2
+#endif
 
-static fixed_t basexscale, baseyscale;
+//
+// CALICO: plane drawing state, formerly file-scope statics. Each column
+// stripe gets its own copy so that stripes can be rendered by separate threads.
+//
+typedef struct planedraw_s
+{
+   fixed_t    planeheight;
+   angle_t    planeangle;
+   fixed_t    planex, planey;
+   int        plane_lightcoef, plane_lightsub;
+   int        plane_lightmin, plane_lightmax;
+   fixed_t    basexscale, baseyscale;
+   int       *pl_stopfp;
+   int       *pl_fp;
+   pixel_t   *ds_source;
+   rstripe_t *stripe;
+
+   // CALICO: distance, steps, and light only depend on the row and on the
+   // plane's height and light level, so they are worked out once per row for
+   // each height and light in turn, and shared by every plane that matches
+   int          planelight;
+   fixed_t      rowheight[MAXRENDERHEIGHT]; // -1 if the row is not set up
+   int          rowlightlevel[MAXRENDERHEIGHT];
+   fixed_t      rowdistance[MAXRENDERHEIGHT];
+   fixed_t      rowxstep[MAXRENDERHEIGHT];
+   fixed_t      rowystep[MAXRENDERHEIGHT];
+   int          rowlight[MAXRENDERHEIGHT];
+   int          rowmip[MAXRENDERHEIGHT];    // mipmap level of the flat
+} planedraw_t;
 
-static int *pl_stopfp;
-static int *pl_fp;
+//
+// CALICO: span commands are packed as x2 << 20 | y << 10 | x, which is wide
+// enough for the largest render size; the original used 16:8:8.
+//
+#define R_SpanCommand(x2, y, x) (((x2) << 20) | ((y) << 10) | (x))
+#define R_SpanX2(parm)          ((parm) >> 20)
+#define R_SpanY(parm)           (((parm) >> 10) & 0x3ff)
+#define R_SpanX(parm)           ((parm) & 0x3ff)
 
-static int spanstart[/*SCREENHEIGHT*/256];
-static pixel_t *ds_source;
+//
+// CALICO: work out the parts of a span which are the same all along row y of
+// the current plane
+//
+static void R_SetupPlaneRow(planedraw_t *pd, int y)
+{
+   fixed_t distance;
+   int     light;
+
+   distance = (pd->planeheight * yslope[y]) >> 12;
+
+   pd->rowdistance[y] = distance;
+   pd->rowxstep[y]    = (distance * pd->basexscale) >> 4;   
+   pd->rowystep[y]    = (pd->baseyscale * distance) >> 4;
+
+   // CALICO: the steps give the texels a pixel covers, to choose a mipmap by
+   if(r_mipmaps)
+   {
+      fixed_t step = D_abs(pd->rowxstep[y]) > D_abs(pd->rowystep[y]) ? 
+                     pd->rowxstep[y] : pd->rowystep[y];
+      pd->rowmip[y] = R_MipLevel(step, FLATMIPLEVELS);
+   }
+   else
+      pd->rowmip[y] = 0;
+
+   light = pd->plane_lightcoef / distance;
+
+   // finish light calculations
+   light -= pd->plane_lightsub;
+   if(light > pd->plane_lightmax)
+      light = pd->plane_lightmax;
+   if(light < pd->plane_lightmin)
+      light = pd->plane_lightmin;
+
+   // transform to hardware value
+   pd->rowlight[y]      = -((255 - light) << 14) & 0xffffff;
+   pd->rowheight[y]     = pd->planeheight;
+   pd->rowlightlevel[y] = pd->planelight;
+}
 
 //
 // Render the horizontal spans determined by R_PlaneLoop
 //
-static void R_MapPlane(void)
+static void R_MapPlane(planedraw_t *pd)
 {
    int x, y, x2, parm;
-   int remaining;
-   fixed_t distance, length, xfrac, yfrac, xstep, ystep;
+   int remaining, mip;
+   fixed_t length, xfrac, yfrac;
    angle_t angle;
-   int light;
 
    do
    {
-      --pl_fp;
-      parm = *pl_fp;
-      x2 = parm >> FRACBITS;
-      y  = (parm >> 8) & 0xff;
-      x  = parm & 0xff;
+      --pd->pl_fp;
+      parm = *pd->pl_fp;
+      x2 = R_SpanX2(parm);
+      y  = R_SpanY(parm);
+      x  = R_SpanX(parm);
       remaining = x2 - x + 1;
 
       if(!remaining)
          continue; // nothing to draw (shouldn't happen)
 
-      distance = (planeheight * yslope[y]) >> 12;
-      length   = (distance * distscale[x]) >> 14;
-      angle    = (planeangle + xtoviewangle[x]) >> ANGLETOFINESHIFT;
-      
-      xfrac = planex + (((finecosine[angle] >> 1) * length) >> 4);
-      yfrac = planey - (((  finesine[angle] >> 1) * length) >> 4);
-   
-      xstep = (distance * basexscale) >> 4;   
-   
-      light = plane_lightcoef / distance;
-
-      ystep = (baseyscale * distance) >> 4;
-
-      // finish light calculations
-      light -= plane_lightsub;
-      if(light > plane_lightmax)
-         light = plane_lightmax;
-      if(light < plane_lightmin)
-         light = plane_lightmin;
+      if(pd->rowheight[y] != pd->planeheight || pd->rowlightlevel[y] != pd->planelight)
+         R_SetupPlaneRow(pd, y);
 
-      // transform to hardware value
-      light = -((255 - light) << 14) & 0xffffff;
+      length = (pd->rowdistance[y] * distscale[x]) >> 14;
+      angle  = (pd->planeangle + xtoviewangle[x]) >> ANGLETOFINESHIFT;
+      
+      xfrac = pd->planex + (((finecosine[angle] >> 1) * length) >> 4);
+      yfrac = pd->planey - (((  finesine[angle] >> 1) * length) >> 4);
 
-      // CALICO: invoke I_DrawSpan here.
-      I_DrawSpan(y, x, x2, light, xfrac, yfrac, xstep, ystep, ds_source);
+      // CALICO: invoke I_DrawSpan here, from the flat's mipmap for the row;
+      // level 0 is the flat itself
+      mip = pd->rowmip[y];
+      I_DrawSpan(y, x, x2, pd->rowlight[y], xfrac >> mip, yfrac >> mip, 
+                 pd->rowxstep[y] >> mip, pd->rowystep[y] >> mip, 
+                 R_TexelAddr(pd->ds_source, mip * (64 * 64)));
 
       // Jag-specific blitter setup (equivalent to R_MakeSpans/R_DrawSpan)
       /*
@@ -230,17 +301,80 @@ static void R_MapPlane(void)
       mp_linedone:
       */
    }
-   while(pl_fp != pl_stopfp);
+   while(pd->pl_fp != pd->pl_stopfp);
+}
+
+//
+// CALICO: find the first column from x up to stopx whose opening is not
+// value, or stopx if there is none. Planes are mostly long runs of columns
+// with the same opening, and wide gaps of OPENMARK, neither of which start
+// or end a span, so these are compared four columns at a time.
+//
+#ifdef CALICO_SIMD_X86
+TARGET_SSE2 static int R_SkipSameOpen(const unsigned int *open, int x, int stopx, unsigned int value)
+{
+   __m128i v = _mm_set1_epi32((int)value);
+
+   for(; x + 4 <= stopx; x += 4)
+   {
+      __m128i cols = _mm_loadu_si128((const __m128i *)(open + x));
+      int     same = _mm_movemask_epi8(_mm_cmpeq_epi32(cols, v));
+
+      if(same != 0xffff)
+      {
+         while(open[x] == value)
+            ++x;
+         return x;
+      }
+   }
+
+   while(x < stopx && open[x] == value)
+      ++x;
+
+   return x;
 }
+#elif defined(CALICO_SIMD_NEON)
+static int R_SkipSameOpen(const unsigned int *open, int x, int stopx, unsigned int value)
+{
+   uint32x4_t v = vdupq_n_u32(value);
+
+   for(; x + 4 <= stopx; x += 4)
+   {
+      uint32x4_t same = vceqq_u32(vld1q_u32(open + x), v);
+      uint32x2_t both = vand_u32(vget_low_u32(same), vget_high_u32(same));
+
+      if((vget_lane_u32(both, 0) & vget_lane_u32(both, 1)) != 0xffffffffu)
+      {
+         while(open[x] == value)
+            ++x;
+         return x;
+      }
+   }
+
+   while(x < stopx && open[x] == value)
+      ++x;
+
+   return x;
+}
+#else
+static int R_SkipSameOpen(const unsigned int *open, int x, int stopx, unsigned int value)
+{
+   while(x < stopx && open[x] == value)
+      ++x;
+
+   return x;
+}
+#endif
 
 //
 // Determine the horizontal spans of a single visplane
 //
-static void R_PlaneLoop(visplane_t *pl)
+static void R_PlaneLoop(planedraw_t *pd, visplane_t *pl)
 {
    int pl_x, pl_stopx;
-   unsigned short *pl_openptr;
-   unsigned short t1, t2, b1, b2, pl_oldtop, pl_oldbottom;
+   unsigned int *pl_openptr;
+   unsigned int  t1, t2, b1, b2, pl_oldtop, pl_oldbottom, pl_oldopen;
+   int *spanstart = pd->stripe->spanstart;
 
    pl_x       = pl->minx;
    pl_stopx   = pl->maxx;
@@ -251,21 +385,35 @@ static void R_PlaneLoop(visplane_t *pl)
 
    pl_stopx += 2;
 
-   // CALICO: use the temp buffer, as the native stack cannot be pushed/popped here
-   pl_stopfp = (int *)(I_TempBuffer());
-   pl_fp = pl_stopfp;
+   // CALICO: use the stripe's span buffer, as the native stack cannot be pushed/popped here
+   pd->pl_stopfp = pd->stripe->spanbuffer;
+   pd->pl_fp = pd->pl_stopfp;
 
    pl_openptr = &pl->open[pl_x - 1];
 
    t1 = *pl_openptr++;
-   b1 = t1 & 0xff;
-   t1 >>= 8;
+   pl_oldopen = t1;
+   b1 = t1 & OPENMASK;
+   t1 >>= OPENSHIFT;
    t2 = *pl_openptr;
    
    do
    {
-      b2 = t2 & 0xff;
-      t2 >>= 8;
+      // CALICO: a column opened the same as the last one neither starts nor
+      // ends any spans, so go straight to the next one which differs; t1 and
+      // b1 still hold the opening of the column before it
+      if(t2 == pl_oldopen)
+      {
+         pl_x = R_SkipSameOpen(pl->open, pl_x + 1, pl_stopx, t2);
+         if(pl_x == pl_stopx)
+            break;
+         pl_openptr = &pl->open[pl_x];
+         t2 = *pl_openptr;
+      }
+      pl_oldopen = t2;
+
+      b2 = t2 & OPENMASK;
+      t2 >>= OPENSHIFT;
 
       pl_oldtop = t2;
       pl_oldbottom = b2;
@@ -277,7 +425,7 @@ static void R_PlaneLoop(visplane_t *pl)
       {
          while(t1 < t2 && t1 <= b1)
          {
-            *pl_fp++ = ((pl_x - 1) << FRACBITS) | (t1 << 8) | spanstart[t1];
+            *pd->pl_fp++ = R_SpanCommand(pl_x - 1, t1, spanstart[t1]);
             ++t1;
          }
          
@@ -294,7 +442,7 @@ static void R_PlaneLoop(visplane_t *pl)
       {
          while(b1 > b2 && b1 >= t1)
          {
-            *pl_fp++ = ((pl_x - 1) << FRACBITS) | (b1 << 8) | spanstart[b1];
+            *pd->pl_fp++ = R_SpanCommand(pl_x - 1, b1, spanstart[b1]);
             --b1;
          }
 
@@ -314,26 +462,30 @@ static void R_PlaneLoop(visplane_t *pl)
    while(pl_x != pl_stopx);
 
    // all done calculating, so execute the plane commands
-   if(pl_fp != pl_stopfp)
-      R_MapPlane();
+   if(pd->pl_fp != pd->pl_stopfp)
+      R_MapPlane(pd);
 }
 
 //
-// Render all visplanes
+// Render all visplanes belonging to a column stripe
 //
-void R_DrawPlanes(void)
+void R_DrawPlanes(rstripe_t *stripe)
 {
    angle_t angle;
    visplane_t *pl;
+   planedraw_t pd;
+
+   pd.stripe = stripe;
+   D_memset(pd.rowheight, -1, sizeof(pd.rowheight));
 
-   planex =  viewx;
-   planey = -viewy;
+   pd.planex =  stripe->view->viewx;
+   pd.planey = -stripe->view->viewy;
 
-   planeangle = viewangle;
-   angle = (planeangle - ANG90) >> ANGLETOFINESHIFT;
+   pd.planeangle = stripe->view->viewangle;
+   angle = (pd.planeangle - ANG90) >> ANGLETOFINESHIFT;
 
-   basexscale =  (finecosine[angle] / (SCREENWIDTH / 2));
-   baseyscale = -(  finesine[angle] / (SCREENWIDTH / 2));
+   pd.basexscale =  (finecosine[angle] / (PROJECTION / FRACUNIT));
+   pd.baseyscale = -(  finesine[angle] / (PROJECTION / FRACUNIT));
 
    // Jag-specific setup
    /*
@@ -346,29 +498,29 @@ void R_DrawPlanes(void)
    store r1,(r0)                         *r0 = r1
    */
 
-   pl = visplanes + 1;
-   while(pl < lastvisplane)
+   pl = stripe->visplanes + 1;
+   while(pl < stripe->lastvisplane)
    {
       if(pl->minx <= pl->maxx)
       {
          int light;
 
-         ds_source = pl->picnum;
+         pd.ds_source = pl->picnum;
 
-         planeheight = D_abs(pl->height);
+         pd.planeheight = D_abs(pl->height);
 
-         light = pl->lightlevel;
-         plane_lightmin = light - ((255 - light) << 1);
-         if(plane_lightmin < 0)
-            plane_lightmin = 0;
-         plane_lightmax  = light;
-         plane_lightsub  = ((light - plane_lightmin) * 160) / 640;
-         plane_lightcoef = (light - plane_lightmin) << SLOPEBITS;
+         light = pd.planelight = pl->lightlevel;
+         pd.plane_lightmin = light - ((255 - light) << 1);
+         if(pd.plane_lightmin < 0)
+            pd.plane_lightmin = 0;
+         pd.plane_lightmax  = light;
+         pd.plane_lightsub  = ((light - pd.plane_lightmin) * 160) / 640;
+         pd.plane_lightcoef = (light - pd.plane_lightmin) << SLOPEBITS;
 
          pl->open[pl->maxx + 1] = OPENMARK;
          pl->open[pl->minx - 1] = OPENMARK;
 
-         R_PlaneLoop(pl);
+         R_PlaneLoop(&pd, pl);
       }
 
       ++pl;
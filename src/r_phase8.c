@@ -4,17 +4,20 @@
   Renderer phase 8 - Sprites
 */
 
+#include <stdint.h>
 #include "r_local.h"
 
-static int spropening[SCREENWIDTH + 1];
+// one byte of a vissprite's xscale, with the sign flipped so that keys compare
+// as unsigned
+#define R_SpriteSortKey(vis, shift) \
+   ((((uint32_t)(vis)->xscale ^ 0x80000000u) >> (shift)) & 0xff)
 
-static void R_DrawVisSprite(vissprite_t *vis)
+static void R_DrawVisSprite(rstripe_t *stripe, vissprite_t *vis)
 {
-   patch_t *patch;
+   rview_t *rv = stripe->view;
    fixed_t  iscale, xfrac, spryscale, sprtop, fracstep;
    int light, x, stopx;
 
-   patch     = vis->patch;
    iscale    = vis->yiscale;
    xfrac     = vis->startfrac;
    spryscale = vis->yscale;
@@ -27,16 +30,29 @@ static void R_DrawVisSprite(vissprite_t *vis)
 
    stopx    = vis->x2 + 1;
    fracstep = vis->xiscale;
+
+   // CALICO: clip to the stripe being drawn
+   x = vis->x1;
+   if(x < stripe->x1)
+   {
+      xfrac += (stripe->x1 - x) * fracstep;
+      x = stripe->x1;
+   }
+   if(stopx > stripe->x2 + 1)
+      stopx = stripe->x2 + 1;
    
-   for(x = vis->x1; x < stopx; x++, xfrac += fracstep)
+   for(; x < stopx; x++, xfrac += fracstep)
    {
-      column_t *column = (column_t *)((byte *)patch + BIGSHORT(patch->columnofs[xfrac>>FRACBITS]));
-      int topclip      = spropening[x] >> 8;
-      int bottomclip   = (spropening[x] & 0xff) - 1;
+      // CALICO: posts come from the sprite's native post table
+      spritecolumn_t *sc  = &vis->posts->columns[xfrac>>FRACBITS];
+      spritepost_t *column = vis->posts->posts + sc->firstpost;
+      spritepost_t *end    = column + sc->numposts;
+      int topclip          = rv->spropening[x] >> OPENSHIFT;
+      int bottomclip       = (rv->spropening[x] & OPENMASK) - 1;
 
       // column loop
       // a post record has four bytes: topdelta length pixelofs*2
-      for(; column->topdelta != 0xff; column++)
+      for(; column != end; column++)
       {
          int top    = ((column->topdelta * spryscale) << 8) + sprtop;
          int bottom = ((column->length   * spryscale) << 8) + top;
@@ -48,6 +64,10 @@ static void R_DrawVisSprite(vissprite_t *vis)
          bottom -= 1;
          bottom /= FRACUNIT;
 
+         // CALICO: posts run down the column, so the rest are clipped too
+         if(top > bottomclip)
+            break;
+
          // clip to bottom
          if(bottom > bottomclip)
             bottom = bottomclip;
@@ -66,8 +86,11 @@ static void R_DrawVisSprite(vissprite_t *vis)
          if(!count)
             continue;
 
-         // CALICO: invoke column drawer
-         I_DrawColumn(x, top, bottom, light, frac, iscale, vis->pixels + BIGSHORT(column->dataofs), 128);
+         // CALICO: invoke column drawer; shadows only darken what is there
+         if(vis->colormap < 0)
+            I_DrawShadowColumn(x, top, bottom);
+         else
+            I_DrawColumn(x, top, bottom, light, frac, iscale, R_TexelAddr(vis->pixels, column->dataofs), 128);
       }
    }
 }
@@ -101,172 +124,302 @@ static boolean R_SegBehindPoint(viswall_t *viswall, int dx, int dy)
 }
 
 //
-// Clip a sprite to the openings created by walls
+// Clip the columns x1 to x2 of a sprite to the opening created by one wall
 //
-static void R_ClipVisSprite(vissprite_t *vis)
+static void R_ClipSpriteToWall(rview_t *rv, vissprite_t *vis, viswall_t *ds, int x1, int x2)
 {
-   int     x;          // r15
-   int     x1;         // FP+5
-   int     x2;         // r22
-   fixed_t gz;         // FP+8
-   int     gzt;        // FP+9
-   int     scalefrac;  // FP+3
-   int     r1;         // FP+7
-   int     r2;         // r18
-   int     silhouette; // FP+4
-   byte   *topsil;     // FP+6
-   byte   *bottomsil;  // r21
-   int     opening;    // r16
-   int     top;        // r19
-   int     bottom;     // r20
-   
-   viswall_t *ds;      // r17
+   int             x;          // r15
+   int             scalefrac;  // FP+3
+   int             r1;         // FP+7
+   int             r2;         // r18
+   int             silhouette; // FP+4
+   unsigned short *topsil;     // FP+6
+   unsigned short *bottomsil;  // r21
+   unsigned int    opening;    // r16
+   int             top;        // r19
+   int             bottom;     // r20
 
-   x1  = vis->x1;
-   x2  = vis->x2;
-   gz  = (vis->gz  - viewz) / (1 << 10);
-   gzt = (vis->gzt - viewz) / (1 << 10);
-   
    scalefrac = vis->yscale;
-   
-   x = vis->x1;
 
-   while(x <= x2)
+   if(ds->start > x2 || ds->stop < x1 ||                            // does not intersect
+      (ds->scalefrac < scalefrac && ds->scale2 < scalefrac) ||      // is completely behind
+      !(ds->actionbits & (AC_TOPSIL | AC_BOTTOMSIL | AC_SOLIDSIL))) // does not clip sprites
    {
-      spropening[x] = SCREENHEIGHT;
-      ++x;
+      return;
    }
-   
-   ds = lastwallcmd;
-   do
-   {
-      --ds;
-
-      if(ds->start > x2 || ds->stop < x1 ||                            // does not intersect
-         (ds->scalefrac < scalefrac && ds->scale2 < scalefrac) ||      // is completely behind
-         !(ds->actionbits & (AC_TOPSIL | AC_BOTTOMSIL | AC_SOLIDSIL))) // does not clip sprites
-      {
-         continue;
-      }
 
-      if(ds->scalefrac <= scalefrac || ds->scale2 <= scalefrac)
-      {
-         if(R_SegBehindPoint(ds, vis->gx, vis->gy))
-            continue;
-      }
+   if(ds->scalefrac <= scalefrac || ds->scale2 <= scalefrac)
+   {
+      if(R_SegBehindPoint(ds, vis->gx, vis->gy))
+         return;
+   }
 
-      r1 = ds->start < x1 ? x1 : ds->start;
-      r2 = ds->stop  > x2 ? x2 : ds->stop;
+   r1 = ds->start < x1 ? x1 : ds->start;
+   r2 = ds->stop  > x2 ? x2 : ds->stop;
 
-      silhouette = (ds->actionbits & (AC_TOPSIL | AC_BOTTOMSIL | AC_SOLIDSIL));
+   silhouette = (ds->actionbits & (AC_TOPSIL | AC_BOTTOMSIL | AC_SOLIDSIL));
 
-      if(silhouette == AC_SOLIDSIL)
+   if(silhouette == AC_SOLIDSIL)
+   {
+      x = r1;
+      while(x <= r2)
       {
-         x = r1;
-         while(x <= r2)
-         {
-            spropening[x] = (SCREENHEIGHT << 8);
-            ++x;
-         }
-         continue;
+         rv->spropening[x] = ((unsigned int)renderheight << OPENSHIFT);
+         ++x;
       }
+      return;
+   }
 
-      topsil    = ds->topsil;
-      bottomsil = ds->bottomsil;
+   topsil    = ds->topsil;
+   bottomsil = ds->bottomsil;
 
-      if(silhouette == AC_BOTTOMSIL)
+   if(silhouette == AC_BOTTOMSIL)
+   {
+      x = r1;
+      while(x <= r2)
       {
-         x = r1;
-         while(x <= r2)
-         {
-            opening = spropening[x];
-            if((opening & 0xff) == SCREENHEIGHT)
-               spropening[x] = (opening & OPENMARK) + bottomsil[x];
-            ++x;
-         }
+         opening = rv->spropening[x];
+         if((opening & OPENMASK) == renderheight)
+            rv->spropening[x] = (opening & OPENMARK) + bottomsil[x];
+         ++x;
       }
-      else if(silhouette == AC_TOPSIL)
+   }
+   else if(silhouette == AC_TOPSIL)
+   {
+      x = r1;
+      while(x <= r2)
       {
-         x = r1;
-         while(x <= r2)
-         {
-            opening = spropening[x];
-            if(!(opening & OPENMARK))
-               spropening[x] = (topsil[x] << 8) + (opening & 0xff);
-            ++x;
-         }
+         opening = rv->spropening[x];
+         if(!(opening & OPENMARK))
+            rv->spropening[x] = ((unsigned int)topsil[x] << OPENSHIFT) + (opening & OPENMASK);
+         ++x;
       }
-      else if(silhouette == (AC_TOPSIL | AC_BOTTOMSIL))
+   }
+   else if(silhouette == (AC_TOPSIL | AC_BOTTOMSIL))
+   {
+      x = r1;
+      while(x <= r2)
       {
-         x = r1;
-         while(x <= r2)
-         {
-            top    = spropening[x];
-            bottom = top & 0xff;
-            top >>= 8;
-            if(bottom == SCREENHEIGHT)
-               bottom = bottomsil[x];
-            if(top == 0)
-               top = topsil[x];
-            spropening[x] = (top << 8) + bottom;
-            ++x;
-         }
+         top    = rv->spropening[x];
+         bottom = top & OPENMASK;
+         top >>= OPENSHIFT;
+         if(bottom == renderheight)
+            bottom = bottomsil[x];
+         if(top == 0)
+            top = topsil[x];
+         rv->spropening[x] = ((unsigned int)top << OPENSHIFT) + bottom;
+         ++x;
       }
    }
-   while(ds != viswalls);
 }
 
 //
-// Render all sprites
+// CALICO: Index the walls which clip sprites by the screen columns they
+// cover, so that a sprite only has to be checked against the walls in its
+// own columns. The screen is split into bins of WALLBINWIDTH columns, and
+// each bin lists its walls from last to first, the order in which the
+// original checked them all. Built once per frame after late prep.
 //
-void R_Sprites(void)
+void R_IndexWalls(rview_t *rv)
 {
-   ptrdiff_t i = 0, count = lastsprite_p - vissprites;
-   vissprite_t *best = NULL;
+   int        fill[MAXWALLBINS];
+   int        b, numbins, total = 0;
+   viswall_t *ds;
 
-   // draw mobj sprites
-   while(i < count)
+   numbins = (renderwidth + WALLBINWIDTH - 1) >> WALLBINSHIFT;
+   D_memset(fill, 0, sizeof(fill));
+
+   for(ds = rv->viswalls; ds < rv->lastwallcmd; ds++)
    {
-      fixed_t bestscale = D_MAXINT;
-      vissprite_t *ds = vissprites;
+      if(!(ds->actionbits & (AC_TOPSIL | AC_BOTTOMSIL | AC_SOLIDSIL)))
+         continue;
+      for(b = ds->start >> WALLBINSHIFT; b <= ds->stop >> WALLBINSHIFT; b++)
+         ++fill[b];
+      total += (ds->stop >> WALLBINSHIFT) - (ds->start >> WALLBINSHIFT) + 1;
+   }
 
-      while(ds != lastsprite_p)
-      {
-         if(ds->xscale < bestscale)
-         {
-            bestscale = ds->xscale;
-            best = ds;
-         }
-         ++ds;
-      }
+   // nothing else points into the index, so it can grow right away
+   if(!R_ReservePool(&rv->wallbinpool, total ? total : 1))
+   {
+      rv->wallbins = NULL; // sprites will check every wall instead
+      return;
+   }
+   rv->wallbins = rv->wallbinpool.base;
+
+   rv->wallbinstart[0] = 0;
+   for(b = 0; b < numbins; b++)
+   {
+      rv->wallbinstart[b + 1] = rv->wallbinstart[b] + fill[b];
+      fill[b] = rv->wallbinstart[b];
+   }
+
+   for(ds = rv->lastwallcmd; ds != rv->viswalls; )
+   {
+      --ds;
+      if(!(ds->actionbits & (AC_TOPSIL | AC_BOTTOMSIL | AC_SOLIDSIL)))
+         continue;
+      for(b = ds->start >> WALLBINSHIFT; b <= ds->stop >> WALLBINSHIFT; b++)
+         rv->wallbins[fill[b]++] = ds;
+   }
+}
+
+//
+// Clip a sprite to the openings created by walls
+//
+// CALICO: each column's opening only depends on the walls covering that
+// column, so the columns are clipped one wall bin at a time, against the
+// walls listed for that bin.
+//
+static void R_ClipVisSprite(rstripe_t *stripe, vissprite_t *vis)
+{
+   rview_t        *rv = stripe->view;
+   int             x;          // r15
+   int             x1;         // FP+5
+   int             x2;         // r22
+   int             b;
+   viswall_t      *ds;         // r17
+
+   x1  = vis->x1;
+   x2  = vis->x2;
+
+   // CALICO: clip to the stripe being drawn
+   if(x1 < stripe->x1)
+      x1 = stripe->x1;
+   if(x2 > stripe->x2)
+      x2 = stripe->x2;
+
+   x = x1;
+
+   while(x <= x2)
+   {
+      rv->spropening[x] = renderheight;
+      ++x;
+   }
+
+   if(!rv->wallbins)
+   {
+      for(ds = rv->lastwallcmd; ds != rv->viswalls; )
+         R_ClipSpriteToWall(rv, vis, --ds, x1, x2);
+      return;
+   }
+
+   for(b = x1 >> WALLBINSHIFT; b <= x2 >> WALLBINSHIFT; b++)
+   {
+      int bx1 = b << WALLBINSHIFT, bx2 = bx1 + WALLBINWIDTH - 1, i;
 
-      if(best->patch != NULL)
+      if(bx1 < x1)
+         bx1 = x1;
+      if(bx2 > x2)
+         bx2 = x2;
+
+      for(i = rv->wallbinstart[b]; i < rv->wallbinstart[b + 1]; i++)
+         R_ClipSpriteToWall(rv, vis, rv->wallbins[i], bx1, bx2);
+   }
+}
+
+//
+// CALICO: Determine the drawing order of the mobj sprites. This must be done
+// once, before any stripe begins drawing.
+//
+// Sprites are drawn from smallest to largest scale. The original picked
+// each one with a scan of the whole list; this is a stable radix sort on
+// xscale instead, so ties are still drawn in the order they were added, and
+// xscale is left intact.
+//
+void R_SortSprites(rview_t *rv)
+{
+   ptrdiff_t     i, count = rv->lastsprite_p - rv->vissprites;
+   vissprite_t **src, **dst, **tmp;
+   int           shift, counts[256];
+
+   rv->numsortedsprites = 0;
+
+   // CALICO: nothing else points into the sort list, so it can grow right away;
+   // the second half is scratch space for the sort
+   if(!R_ReservePool(&rv->sortpool, (int)count * 2))
+      count = rv->sortpool.capacity / 2;
+
+   src = rv->sortpool.base;
+   dst = src + count;
+
+   for(i = 0; i < count; i++)
+      src[i] = &rv->vissprites[i];
+
+   for(shift = 0; shift < 32; shift += 8)
+   {
+      int total = 0;
+
+      D_memset(counts, 0, sizeof(counts));
+
+      for(i = 0; i < count; i++)
+         ++counts[R_SpriteSortKey(src[i], shift)];
+
+      for(i = 0; i < 256; i++)
       {
-         R_ClipVisSprite(best);
-         R_DrawVisSprite(best);
+         int n = counts[i];
+         counts[i] = total;
+         total += n;
       }
 
-      best->xscale = D_MAXINT;
+      for(i = 0; i < count; i++)
+         dst[counts[R_SpriteSortKey(src[i], shift)]++] = src[i];
 
-      ++i;
+      tmp = src;
+      src = dst;
+      dst = tmp;
+   }
+
+   // after an even number of passes the result is back in the first half
+   rv->sortedsprites = src;
+
+   for(i = 0; i < count; i++)
+   {
+      if(src[i]->patch != NULL)
+         rv->sortedsprites[rv->numsortedsprites++] = src[i];
+   }
+}
+
+//
+// Render all sprites within a column stripe
+//
+void R_Sprites(rstripe_t *stripe)
+{
+   rview_t *rv = stripe->view;
+   int i;
+   vissprite_t *spr;
+
+   // draw mobj sprites
+   for(i = 0; i < rv->numsortedsprites; i++)
+   {
+      spr = rv->sortedsprites[i];
+
+      if(spr->x2 < stripe->x1 || spr->x1 > stripe->x2)
+         continue;
+
+      R_ClipVisSprite(stripe, spr);
+      R_DrawVisSprite(stripe, spr);
    }
 
    // draw psprites
-   while(lastsprite_p < vissprite_p)
+   for(spr = rv->lastsprite_p; spr < rv->vissprite_p; spr++)
    {
-      ptrdiff_t stopx = lastsprite_p->x2 + 1;
-      i = lastsprite_p->x1;
-      
+      int x1 = spr->x1, x2 = spr->x2;
+
+      if(x1 < stripe->x1)
+         x1 = stripe->x1;
+      if(x2 > stripe->x2)
+         x2 = stripe->x2;
+      if(x1 > x2)
+         continue;
+
       // clear out the clipping array across the range of the psprite
-      while(i < stopx)
+      while(x1 <= x2)
       {
-         spropening[i] = SCREENHEIGHT;
-         ++i;
+         rv->spropening[x1] = renderheight;
+         ++x1;
       }
 
-      R_DrawVisSprite(lastsprite_p);
-      
-      ++lastsprite_p;
+      R_DrawVisSprite(stripe, spr);
    }
 }
 
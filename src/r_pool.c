@@ -0,0 +1,98 @@
+/*
+  CALICO
+
+  Renderer command pools
+
+  Walls, planes, sprites, openings and visible subsectors are taken from
+  pools which are reset at the start of each frame. A pool never moves while
+  a frame is being built, since the renderer holds pointers into it; any
+  demand beyond its capacity is counted and dropped, and the pool is grown
+  to fit before the next frame starts.
+*/
+
+#include <stdlib.h>
+#include "doomdef.h"
+#include "r_local.h"
+
+//
+// Set up a pool with room for capacity elements of the given size
+//
+void R_InitPool(rpool_t *pool, const char *name, size_t size, int capacity)
+{
+   pool->name      = name;
+   pool->size      = size;
+   pool->capacity  = 0;
+   pool->used      = 0;
+   pool->highwater = 0;
+   pool->base      = NULL;
+
+   if(!R_ReservePool(pool, capacity))
+      I_Error("R_InitPool: no memory for %s", name);
+}
+
+//
+// Make sure the pool can hold count elements, growing it if needed.
+// This moves the pool, so it must only be done between frames or before
+// anything has been taken from it. Returns false if memory is exhausted.
+//
+boolean R_ReservePool(rpool_t *pool, int count)
+{
+   int   capacity = pool->capacity ? pool->capacity : 1;
+   void *base;
+
+   if(count <= pool->capacity)
+      return true;
+
+   while(capacity < count)
+      capacity *= 2;
+
+   if(!(base = realloc(pool->base, capacity * pool->size)))
+      return false;
+
+   if(pool->base)
+      D_printf("R_ReservePool: %s grown to %i\n", pool->name, capacity);
+
+   pool->base     = base;
+   pool->capacity = capacity;
+   return true;
+}
+
+//
+// Take count contiguous elements from the pool. Returns NULL if they won't
+// fit this frame, in which case the caller must do without.
+//
+void *R_PoolAlloc(rpool_t *pool, int count)
+{
+   int start = pool->used;
+
+   pool->used += count;
+   if(pool->used > pool->highwater)
+      pool->highwater = pool->used;
+
+   if(pool->used > pool->capacity)
+      return NULL;
+
+   return (byte *)pool->base + start * pool->size;
+}
+
+//
+// True if nothing more can be taken from the pool this frame
+//
+boolean R_PoolFull(const rpool_t *pool)
+{
+   return pool->used >= pool->capacity;
+}
+
+//
+// Begin a new frame, growing the pool if the last one overflowed it.
+//
+void R_ResetPool(rpool_t *pool)
+{
+   if(pool->used > pool->capacity && !R_ReservePool(pool, pool->used))
+      D_printf("R_ResetPool: no memory to grow %s\n", pool->name);
+
+   pool->used = 0;
+}
+
+// EOF
+
@@ -0,0 +1,300 @@
+/*
+  CALICO
+
+  Renderer phases 6 through 8 - column stripe dispatch
+
+  The screen is divided into vertical stripes, each of which is independently
+  run through the seg loop, visplane, and sprite phases. With -rthreads on
+  the command line, the stripes are run as jobs on the engine's job pool;
+  stripe 0 is always drawn on the thread drawing the view. Every view has
+  its own stripes.
+
+  With -pipeline, a view also gets a render thread which runs all of the
+  stripes while the main thread goes on to the next game tic. Everything the
+  stripes read has been latched into the view by the earlier phases, and the
+  graphics they draw from stay pinned in the cache for the rest of the frame,
+  so the playsim is free to move on underneath them.
+
+  With -drawbudget <ms>, only as many of the stripes are used as it takes to
+  keep these phases within the budget. Every BUDGETFRAMES frames the average
+  is checked: over the budget, another stripe is brought in; well enough
+  under it that the view would still fit with one fewer, one is dropped and
+  its job thread left idle for the rest of the game to use. Hardware which can
+  draw the view on one thread then does so, while slower hardware uses all
+  it has.
+*/
+
+#include <stdlib.h>
+#include "hal/hal_thread.h"
+#include "hal/hal_timer.h"
+#include "jagcry.h"
+#include "m_argv.h"
+#include "m_jobs.h"
+#include "m_prof.h"
+#include "m_thread.h"
+#include "r_local.h"
+
+typedef struct rworker_s
+{
+   rstripe_t          *stripe;
+   hal_semhandle_t     start; // posted by the main thread to begin a frame
+   hal_semhandle_t     done;  // posted by the renderer when the frame is drawn
+   hal_threadhandle_t  thread;
+} rworker_t;
+
+// span commands per stripe at 1x; the original used the 64K temp buffer
+#define SPANBUFFERSIZE (0x10000 / sizeof(int))
+
+// frames averaged between changes to the number of stripes in use
+#define BUDGETFRAMES 16
+
+static unsigned int drawbudget; // -drawbudget, in microseconds; 0 if none
+
+//
+// Run all stripe-local phases
+//
+static void R_DrawStripe(rstripe_t *stripe)
+{
+   unsigned int start;
+
+   // only the main view's first stripe is profiled
+   if(stripe != mainview->stripes)
+   {
+      R_SegCommands(stripe);
+      R_DrawPlanes(stripe);
+      R_Sprites(stripe);
+      return;
+   }
+
+   start = M_ProfStart();
+   R_SegCommands(stripe);
+   M_ProfEnd(PROF_SEGCOMMANDS, start);
+
+   start = M_ProfStart();
+   R_DrawPlanes(stripe);
+   M_ProfEnd(PROF_DRAWPLANES, start);
+
+   start = M_ProfStart();
+   R_Sprites(stripe);
+   M_ProfEnd(PROF_SPRITES, start);
+}
+
+static void R_StripeJob(void *data, int index)
+{
+   R_DrawStripe(&((rview_t *)data)->stripes[index]);
+}
+
+//
+// Render thread main loop; the worker's stripe is the view's first
+//
+static int R_PipelineWorker(void *data)
+{
+   rworker_t *worker = data;
+
+   M_ScheduleThread(THREAD_WORKER);
+
+   while(1)
+   {
+      hal_threads.semWait(worker->start);
+      R_RenderStripes(worker->stripe->view);
+      hal_threads.semPost(worker->done);
+   }
+
+   return 0;
+}
+
+//
+// Start the view's render thread for -pipeline; the view is drawn on the
+// calling thread if this fails.
+//
+static void R_StartPipeline(rview_t *rv)
+{
+   rworker_t *worker;
+
+   if(!(worker = calloc(1, sizeof(*worker))))
+      return;
+
+   worker->stripe = &rv->stripes[0];
+   worker->start  = hal_threads.createSemaphore(0);
+   worker->done   = hal_threads.createSemaphore(0);
+
+   if(worker->start && worker->done)
+   {
+      if((worker->thread = hal_threads.createThread(R_PipelineWorker, "R_PipelineWorker", worker)))
+      {
+         rv->renderer = worker;
+         return;
+      }
+   }
+
+   hal_threads.destroySemaphore(worker->start);
+   hal_threads.destroySemaphore(worker->done);
+   free(worker);
+}
+
+//
+// Divide the view's columns among its first count stripes
+//
+static void R_SetActiveStripes(rview_t *rv, int count)
+{
+   int i;
+
+   rv->activestripes = count;
+
+   for(i = 0; i < count; i++)
+   {
+      rv->stripes[i].x1 = (renderwidth *  i     ) / count;
+      rv->stripes[i].x2 = (renderwidth * (i + 1)) / count - 1;
+   }
+}
+
+//
+// Add up the time taken to draw the stripes, and use more or fewer of them
+// at the end of each window to stay within -drawbudget
+//
+static void R_BudgetStripes(rview_t *rv, unsigned int us)
+{
+   unsigned int average;
+   int          count = rv->activestripes;
+
+   rv->budgetus += us;
+   if(++rv->budgetframes < BUDGETFRAMES)
+      return;
+
+   average = rv->budgetus / rv->budgetframes;
+   rv->budgetus = 0;
+   rv->budgetframes = 0;
+
+   // the estimate for one fewer supposes all of the time splits evenly
+   if(average > drawbudget && count < rv->numstripes)
+      ++count;
+   else if(count > 1 && (uint64_t)average * count / (count - 1) < drawbudget * 3ull / 4)
+      --count;
+
+   if(count != rv->activestripes)
+   {
+      R_SetActiveStripes(rv, count);
+      if(rv == mainview)
+         D_printf("R_BudgetStripes: %i stripes for %.2f ms\n", count, average / 1000.0);
+   }
+}
+
+//
+// Decide how many stripes to use, with the job pool able to run them all.
+// -rthreads 0 selects one stripe per logical CPU.
+//
+void R_InitStripes(rview_t *rv)
+{
+   int i, p, count = 1;
+
+   if((p = M_GetArgParameters("-rthreads", 1)))
+   {
+      count = atoi(myargv[p]);
+      if(count <= 0)
+         count = hal_threads.getCPUCount ? hal_threads.getCPUCount() : 1;
+   }
+
+   if(count < 1)
+      count = 1;
+   if(count > MAXRSTRIPES)
+      count = MAXRSTRIPES;
+
+   // 1 if there is no thread support in the HAL
+   count = emin(count, M_ReserveJobThreads(count));
+
+   if(!(rv->stripes = calloc(count, sizeof(*rv->stripes))))
+      I_Error("R_InitStripes: no memory for %i stripes", count);
+
+   rv->numstripes = count;
+
+   for(i = 0; i < rv->numstripes; i++)
+   {
+      rstripe_t *stripe = &rv->stripes[i];
+
+      // the number of spans grows with the area of the view
+      stripe->spanbuffer = malloc((SPANBUFFERSIZE << rendershift) * renderwidth / SCREENWIDTH * sizeof(int));
+      if(!stripe->spanbuffer)
+         I_Error("R_InitStripes: no memory for span buffer %i", i);
+
+      stripe->view = rv;
+      R_InitPool(&stripe->planepool, "visplanes", sizeof(visplane_t), MAXVISPLANES);
+   }
+
+   R_SetActiveStripes(rv, rv->numstripes);
+
+   if((p = M_GetArgParameters("-drawbudget", 1)) && hal_timer.getTimeUS)
+      drawbudget = (unsigned int)(atof(myargv[p]) * 1000.0);
+
+   if(M_FindArgument("-pipeline") && hal_threads.createThread)
+      R_StartPipeline(rv);
+
+   D_printf("R_InitStripes: %i%s\n", rv->numstripes, rv->renderer ? ", pipelined" : "");
+}
+
+//
+// Draw walls, planes, and sprites for all stripes, in parallel if worker
+// threads are available, and return once the whole screen is finished.
+//
+void R_RenderStripes(rview_t *rv)
+{
+   unsigned int start = drawbudget ? hal_timer.getTimeUS() : 0;
+   int i;
+
+   // drop stale pre-lit tables before any stripe starts drawing
+   CRY_AgeLitTables();
+
+   for(i = 0; i < rv->numstripes; i++)
+   {
+      rstripe_t *stripe = &rv->stripes[i];
+
+      R_ResetPool(&stripe->planepool);
+      stripe->visplanes    = R_PoolAlloc(&stripe->planepool, 1); // [0] is left empty
+      stripe->lastvisplane = stripe->visplanes + 1;
+
+      // [0] must never look like an open column
+      D_memset(stripe->visplanes, 0, sizeof(visplane_t));
+      D_memset(stripe->planehash, 0, sizeof(stripe->planehash));
+      D_memset(stripe->planetail, 0, sizeof(stripe->planetail));
+   }
+
+   // sprite ordering, the wall index and the sky columns are shared by all
+   // stripes
+   R_SortSprites(rv);
+   R_IndexWalls(rv);
+   R_SkyPrep(rv);
+
+   M_RunJobs("stripes", R_StripeJob, rv, rv->activestripes);
+
+   // CALICO: no stripe is being drawn, so they can be laid out again
+   if(drawbudget && rv->numstripes > 1)
+      R_BudgetStripes(rv, hal_timer.getTimeUS() - start);
+}
+
+//
+// Start drawing the view's stripes on its render thread. Returns false if
+// the view has no render thread, in which case nothing has been drawn.
+//
+boolean R_BeginStripes(rview_t *rv)
+{
+   if(!rv->renderer)
+      return false;
+
+   rv->rendering = true;
+   hal_threads.semPost(rv->renderer->start);
+   return true;
+}
+
+//
+// Wait for a frame started by R_BeginStripes to be finished.
+//
+void R_FinishStripes(rview_t *rv)
+{
+   if(!rv->rendering)
+      return;
+
+   hal_threads.semWait(rv->renderer->done);
+   rv->rendering = false;
+}
+
+// EOF
+
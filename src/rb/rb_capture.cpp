@@ -0,0 +1,628 @@
+/*
+  CALICO
+
+  Video and audio capture
+
+  With -capture, every frame shown is read back and written out from a
+  background thread, as a Y4M stream if the name ends in .y4m or starts with
+  a |, which pipes it to the command that follows, or otherwise as raw
+  top-down RGB. Frames are read into a ring of PBOs and only mapped once
+  their fences have passed, so the GPU is seldom waited on. Video is
+  written at a fixed rate, set by -capturefps, by repeating or dropping
+  frames shown, so that it keeps time with audio captured from the mixer
+  into the 16-bit stereo WAV file named by -captureaudio.
+
+  The MIT License (MIT)
+
+  Copyright (C) 2016 James Haley
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifdef USE_SDL2
+#include "SDL_opengl.h"
+#else
+#error Need include for opengl.h
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "../elib/elib.h"
+#include "../elib/atexit.h"
+#include "../elib/compare.h"
+#include "../elib/qstring.h"
+#include "../hal/hal_platform.h"
+#include "../hal/hal_thread.h"
+#include "../hal/hal_timer.h"
+#include "../hal/hal_video.h"
+#include "../m_thread.h"
+#include "rb_capture.h"
+#include "rb_main.h"
+#include "valloc.h"
+
+#ifdef _WIN32
+#define popen  _popen
+#define pclose _pclose
+#define PIPEMODE "wb"
+#else
+#define PIPEMODE "w"
+#endif
+
+#define NUMCAPTUREPBOS  3          // frames being read back at once
+#define MAXQUEUEDFRAMES 8          // frames waiting for the writer
+#define AUDIORINGSIZE   (1 << 17)  // samples of each channel held for the writer
+
+struct captureframe_t
+{
+   captureframe_t *next;
+   rbbyte         *pixels; // RGBA, bottom row first
+   unsigned int    repeat; // times written, to keep to the frame rate
+};
+
+static bool capturing;
+
+// output
+static FILE        *videofile;
+static bool         videopipe;
+static bool         videoy4m;
+static FILE        *audiofile;
+static uint32_t     audiobytes;
+static int          audiorate;
+static int          capturefps;
+static unsigned int capturewidth, captureheight;
+static bool         capturebegun;
+static unsigned int capturestart; // time of the first frame, in ms
+static unsigned int framesdue;    // frames written or on their way
+
+// read back ring
+static GLuint       pbos[NUMCAPTUREPBOS];
+static GLsync       fences[NUMCAPTUREPBOS];
+static unsigned int repeats[NUMCAPTUREPBOS];
+static int          ringfirst, ringcount;
+
+// handed to the writing thread
+static captureframe_t     *queuedframes;
+static int                 numqueued;
+static bool                stopwriting;
+static hal_semhandle_t     capturelock; // guards the queue and the audio ring
+static hal_semhandle_t     capturework; // posted for every frame or audio block
+static hal_threadhandle_t  capturethread;
+
+static int16_t      audioring[AUDIORINGSIZE * 2];
+static unsigned int audiohead, audiotail; // samples put in and taken out
+
+// buffer object and sync function pointers
+static bool captureProcsLoaded;
+static bool use_capture_pbo;
+static bool use_capture_sync;
+static PFNGLGENBUFFERSARBPROC    pglGenBuffersARB    = nullptr;
+static PFNGLDELETEBUFFERSARBPROC pglDeleteBuffersARB = nullptr;
+static PFNGLBINDBUFFERARBPROC    pglBindBufferARB    = nullptr;
+static PFNGLBUFFERDATAARBPROC    pglBufferDataARB    = nullptr;
+static PFNGLMAPBUFFERARBPROC     pglMapBufferARB     = nullptr;
+static PFNGLUNMAPBUFFERARBPROC   pglUnmapBufferARB   = nullptr;
+static PFNGLFENCESYNCPROC        pglFenceSync        = nullptr;
+static PFNGLCLIENTWAITSYNCPROC   pglClientWaitSync   = nullptr;
+static PFNGLDELETESYNCPROC       pglDeleteSync       = nullptr;
+
+#define GETPROC(ptr, name) \
+   ptr = reinterpret_cast<decltype(ptr)>(hal_video.getGLProcAddress(name)); \
+   extension_ok = (extension_ok && ptr != nullptr)
+
+//
+// Frames being read back go with the context; time is kept by repeating
+// the next one
+//
+VALLOCATION(capturePBOs)
+{
+   for(int i = 0; i < ringcount; i++)
+      framesdue -= repeats[(ringfirst + i) % NUMCAPTUREPBOS];
+
+   captureProcsLoaded = false;
+   std::memset(pbos,   0, sizeof(pbos));
+   std::memset(fences, 0, sizeof(fences));
+   ringfirst = ringcount = 0;
+}
+
+static void RB_loadCaptureProcs()
+{
+   if(captureProcsLoaded)
+      return;
+
+   auto extensions   = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+   bool extension_ok = true;
+
+   use_capture_pbo = use_capture_sync = false;
+   if(std::strstr(extensions, "GL_ARB_pixel_buffer_object"))
+   {
+      GETPROC(pglGenBuffersARB,    "glGenBuffersARB");
+      GETPROC(pglDeleteBuffersARB, "glDeleteBuffersARB");
+      GETPROC(pglBindBufferARB,    "glBindBufferARB");
+      GETPROC(pglBufferDataARB,    "glBufferDataARB");
+      GETPROC(pglMapBufferARB,     "glMapBufferARB");
+      GETPROC(pglUnmapBufferARB,   "glUnmapBufferARB");
+      use_capture_pbo = extension_ok;
+   }
+   if(use_capture_pbo && std::strstr(extensions, "GL_ARB_sync"))
+   {
+      GETPROC(pglFenceSync,      "glFenceSync");
+      GETPROC(pglClientWaitSync, "glClientWaitSync");
+      GETPROC(pglDeleteSync,     "glDeleteSync");
+      use_capture_sync = extension_ok;
+   }
+
+   captureProcsLoaded = true;
+}
+
+//=============================================================================
+//
+// Writing thread
+//
+
+static void RB_putLE16(rbbyte *dest, unsigned int value)
+{
+   dest[0] = rbbyte(value);
+   dest[1] = rbbyte(value >> 8);
+}
+
+static void RB_putLE32(rbbyte *dest, uint32_t value)
+{
+   RB_putLE16(dest,     value & 0xFFFF);
+   RB_putLE16(dest + 2, value >> 16);
+}
+
+//
+// Write the WAV header for the audio written so far
+//
+static void RB_writeWAVHeader()
+{
+   rbbyte header[44];
+
+   std::memcpy(header, "RIFF", 4);
+   RB_putLE32(header + 4, 36 + audiobytes);
+   std::memcpy(header + 8, "WAVEfmt ", 8);
+   RB_putLE32(header + 16, 16);
+   RB_putLE16(header + 20, 1);             // PCM
+   RB_putLE16(header + 22, 2);             // stereo
+   RB_putLE32(header + 24, audiorate);
+   RB_putLE32(header + 28, audiorate * 4); // bytes per second
+   RB_putLE16(header + 32, 4);             // bytes per sample frame
+   RB_putLE16(header + 34, 16);
+   std::memcpy(header + 36, "data", 4);
+   RB_putLE32(header + 40, audiobytes);
+
+   std::fseek(audiofile, 0, SEEK_SET);
+   std::fwrite(header, sizeof(header), 1, audiofile);
+   std::fseek(audiofile, 0, SEEK_END);
+}
+
+//
+// Write out whatever audio the mixer has left in the ring
+//
+static void RB_drainAudio()
+{
+   unsigned int head, tail;
+
+   hal_threads.semWait(capturelock);
+   head = audiohead;
+   tail = audiotail;
+   hal_threads.semPost(capturelock);
+
+   while(tail != head)
+   {
+      unsigned int start = tail % AUDIORINGSIZE;
+      unsigned int count = emin(head - tail, AUDIORINGSIZE - start);
+
+      std::fwrite(&audioring[start * 2], 4, count, audiofile);
+      audiobytes += count * 4;
+      tail       += count;
+   }
+
+   hal_threads.semWait(capturelock);
+   audiotail = tail;
+   hal_threads.semPost(capturelock);
+}
+
+//
+// Convert a frame to the output format and write it as many times as it
+// is due
+//
+static void RB_writeFrame(const captureframe_t *frame)
+{
+   static rbbyte *out;
+   static size_t  outsize;
+   const unsigned int w = capturewidth, h = captureheight;
+   const size_t   size  = size_t(w) * h * 3;
+
+   if(outsize < size)
+   {
+      efree(out);
+      out     = emalloc(rbbyte, size);
+      outsize = size;
+   }
+
+   for(unsigned int y = 0; y < h; y++)
+   {
+      const rbbyte *src = frame->pixels + size_t(h - 1 - y) * w * 4;
+
+      if(videoy4m)
+      {
+         // planar 4:4:4 BT.601
+         rbbyte *py = out + size_t(y) * w;
+         rbbyte *pu = py + size_t(w) * h;
+         rbbyte *pv = pu + size_t(w) * h;
+
+         for(unsigned int x = 0; x < w; x++, src += 4)
+         {
+            int r = src[0], g = src[1], b = src[2];
+            *py++ = rbbyte((( 66 * r + 129 * g +  25 * b + 128) >> 8) +  16);
+            *pu++ = rbbyte(((-38 * r -  74 * g + 112 * b + 128) >> 8) + 128);
+            *pv++ = rbbyte(((112 * r -  94 * g -  18 * b + 128) >> 8) + 128);
+         }
+      }
+      else
+      {
+         rbbyte *dest = out + size_t(y) * w * 3;
+
+         for(unsigned int x = 0; x < w; x++, src += 4)
+         {
+            *dest++ = src[0];
+            *dest++ = src[1];
+            *dest++ = src[2];
+         }
+      }
+   }
+
+   for(unsigned int i = 0; i < frame->repeat; i++)
+   {
+      if(videoy4m)
+         std::fputs("FRAME\n", videofile);
+      std::fwrite(out, size, 1, videofile);
+   }
+}
+
+//
+// Capture writing thread main loop
+//
+static int RB_CaptureThread(void *data)
+{
+   M_ScheduleThread(THREAD_IO);
+
+   while(1)
+   {
+      captureframe_t *frame;
+      bool            stop;
+
+      hal_threads.semWait(capturework);
+
+      hal_threads.semWait(capturelock);
+      if((frame = queuedframes))
+      {
+         queuedframes = frame->next;
+         --numqueued;
+      }
+      stop = (stopwriting && !queuedframes);
+      hal_threads.semPost(capturelock);
+
+      if(audiofile)
+         RB_drainAudio();
+
+      if(frame)
+      {
+         RB_writeFrame(frame);
+         efree(frame->pixels);
+         efree(frame);
+      }
+
+      if(stop)
+         break;
+   }
+
+   return 0;
+}
+
+//
+// Hand a frame to the writing thread. If it has fallen too far behind, the
+// frame is dropped, and the next one written in its place.
+//
+static void RB_queueFrame(rbbyte *pixels, unsigned int repeat)
+{
+   static bool warned;
+   captureframe_t *frame, **tail;
+
+   hal_threads.semWait(capturelock);
+   if(numqueued >= MAXQUEUEDFRAMES)
+   {
+      hal_threads.semPost(capturelock);
+      efree(pixels);
+      framesdue -= repeat;
+      if(!warned)
+      {
+         hal_platform.debugMsg("RB_queueFrame: capture can't keep up, dropping frames\n");
+         warned = true;
+      }
+      return;
+   }
+
+   frame = estructalloc(captureframe_t, 1);
+   frame->pixels = pixels;
+   frame->repeat = repeat;
+   for(tail = &queuedframes; *tail; tail = &(*tail)->next)
+      ;
+   *tail = frame;
+   ++numqueued;
+   hal_threads.semPost(capturelock);
+   hal_threads.semPost(capturework);
+}
+
+//
+// Finish writing everything and close the files
+//
+static void RB_stopCapture()
+{
+   if(!capturing)
+      return;
+   capturing = false;
+
+   // frames still being read back are lost, as the GL may be gone by now
+   hal_threads.semWait(capturelock);
+   stopwriting = true;
+   hal_threads.semPost(capturelock);
+   hal_threads.semPost(capturework);
+   hal_threads.waitThread(capturethread);
+
+   if(videofile)
+   {
+      if(videopipe)
+         pclose(videofile);
+      else
+         std::fclose(videofile);
+      videofile = nullptr;
+   }
+   if(audiofile)
+   {
+      RB_writeWAVHeader();
+      std::fclose(audiofile);
+      audiofile = nullptr;
+   }
+}
+
+static void RB_captureAtExit()
+{
+   RB_stopCapture();
+}
+
+//=============================================================================
+//
+// Main thread interface
+//
+
+//
+// Start capturing video to the file or pipe named by video, and audio to the
+// WAV file named by audio, either of which may be null. Video is written at
+// fps frames a second, or 30 if fps is 0 or less.
+//
+void RB_StartCapture(const char *video, const char *audio, int fps)
+{
+   if(capturing || !hal_threads.createThread)
+      return;
+
+   if(video)
+   {
+      size_t len = std::strlen(video);
+
+      if((videopipe = (video[0] == '|')))
+         videofile = popen(video + 1, PIPEMODE);
+      else
+         videofile = std::fopen(video, "wb");
+
+      videoy4m = videopipe || (len >= 4 && !qstring(video + len - 4).strCaseCmp(".y4m"));
+      if(!videofile)
+         hal_platform.debugMsg("RB_StartCapture: could not open %s\n", video);
+   }
+   if(audio)
+   {
+      if((audiofile = std::fopen(audio, "wb")))
+         RB_writeWAVHeader(); // filled in when capture stops
+      else
+         hal_platform.debugMsg("RB_StartCapture: could not open %s\n", audio);
+   }
+   if(!videofile && !audiofile)
+      return;
+
+   capturefps  = (fps > 0) ? fps : 30;
+   capturelock = hal_threads.createSemaphore(1);
+   capturework = hal_threads.createSemaphore(0);
+   if(!capturelock || !capturework ||
+      !(capturethread = hal_threads.createThread(RB_CaptureThread, "RB_CaptureThread", nullptr)))
+   {
+      hal_platform.fatalError("RB_StartCapture: could not start the capture thread");
+   }
+
+   capturing = true;
+   E_AtExit(RB_captureAtExit, true);
+}
+
+//
+// Copy a finished read back out of the oldest PBO in the ring
+//
+static void RB_retireFrame()
+{
+   const int     slot = ringfirst;
+   const size_t  size = size_t(capturewidth) * captureheight * 4;
+   rbbyte       *pixels = nullptr;
+   void         *ptr;
+
+   if(fences[slot])
+   {
+      pglClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(-1));
+      pglDeleteSync(fences[slot]);
+      fences[slot] = nullptr;
+   }
+
+   pglBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, pbos[slot]);
+   if((ptr = pglMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB)))
+   {
+      pixels = emalloc(rbbyte, size);
+      std::memcpy(pixels, ptr, size);
+      pglUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+   }
+   pglBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+   ringfirst = (ringfirst + 1) % NUMCAPTUREPBOS;
+   --ringcount;
+
+   if(pixels)
+      RB_queueFrame(pixels, repeats[slot]);
+   else
+      framesdue -= repeats[slot];
+}
+
+//
+// Check whether the oldest read back has finished without waiting for it.
+// Without fences, it is taken once the ring is full.
+//
+static bool RB_oldestFrameReady()
+{
+   GLsync fence = fences[ringfirst];
+
+   if(!fence)
+      return ringcount == NUMCAPTUREPBOS;
+
+   return pglClientWaitSync(fence, 0, 0) != GL_TIMEOUT_EXPIRED;
+}
+
+//
+// Call once the frame is finished, before it is shown
+//
+void RB_EndFrameCapture(void)
+{
+   unsigned int now, due, repeat;
+   int w = 0, h = 0;
+
+   if(!capturing || !videofile)
+      return;
+
+   hal_video.getWindowSize(&w, &h);
+   now = hal_timer.getTimeMS();
+   if(!capturebegun)
+   {
+      capturebegun  = true;
+      capturewidth  = unsigned(w);
+      captureheight = unsigned(h);
+      capturestart  = now;
+      if(videoy4m)
+      {
+         std::fprintf(videofile, "YUV4MPEG2 W%u H%u F%d:1 Ip A1:1 C444\n", 
+                      capturewidth, captureheight, capturefps);
+      }
+   }
+   else if(unsigned(w) != capturewidth || unsigned(h) != captureheight)
+   {
+      hal_platform.debugMsg("RB_EndFrameCapture: window size changed, stopping capture\n");
+      RB_stopCapture();
+      return;
+   }
+
+   RB_loadCaptureProcs();
+
+   // take back what the GPU has finished
+   while(ringcount && RB_oldestFrameReady())
+      RB_retireFrame();
+
+   // write this frame as often as needed to catch up with the clock
+   due = (now - capturestart) * unsigned(capturefps) / 1000 + 1;
+   if(due <= framesdue)
+      return;
+   repeat    = due - framesdue;
+   framesdue = due;
+
+   RB_SetReadBuffer(RB_GLBUFFER_BACK);
+
+   if(use_capture_pbo)
+   {
+      int slot;
+
+      if(ringcount == NUMCAPTUREPBOS)
+         RB_retireFrame();
+
+      slot = (ringfirst + ringcount) % NUMCAPTUREPBOS;
+      if(!pbos[slot])
+      {
+         pglGenBuffersARB(1, &pbos[slot]);
+         pglBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, pbos[slot]);
+         pglBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB, GLsizeiptr(w) * h * 4, nullptr, GL_STREAM_READ_ARB);
+      }
+      else
+         pglBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, pbos[slot]);
+
+      glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+      pglBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+      if(use_capture_sync)
+         fences[slot] = pglFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      repeats[slot] = repeat;
+      ++ringcount;
+   }
+   else
+   {
+      rbbyte *pixels = emalloc(rbbyte, size_t(w) * h * 4);
+
+      glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+      RB_queueFrame(pixels, repeat);
+   }
+}
+
+//
+// Called from the mixer with count 16-bit stereo sample frames played at
+// rate. Anything which doesn't fit in the ring is dropped.
+//
+void RB_CaptureAudio(const int16_t *samples, unsigned int count, int rate)
+{
+   unsigned int head, room;
+
+   if(!capturing || !audiofile)
+      return;
+
+   audiorate = rate;
+
+   hal_threads.semWait(capturelock);
+   head = audiohead;
+   room = AUDIORINGSIZE - (head - audiotail);
+   hal_threads.semPost(capturelock);
+
+   count = emin(count, room);
+   for(unsigned int i = 0; i < count; )
+   {
+      unsigned int start = (head + i) % AUDIORINGSIZE;
+      unsigned int n     = emin(count - i, AUDIORINGSIZE - start);
+
+      std::memcpy(&audioring[start * 2], samples + i * 2, n * 4);
+      i += n;
+   }
+
+   hal_threads.semWait(capturelock);
+   audiohead = head + count;
+   hal_threads.semPost(capturelock);
+   hal_threads.semPost(capturework);
+}
+
+// EOF
@@ -33,9 +33,23 @@
 #error Need include for opengl.h
 #endif
 
+#include <cstddef>
+#include <cstring>
+#include "../elib/configfile.h"
 #include "../hal/hal_platform.h"
+#include "../hal/hal_video.h"
 #include "rb_draw.h"
 
+//=============================================================================
+//
+// Config Vars
+//
+
+// stream vertices and indices through buffer objects where the GL has them
+static bool rb_vertex_buffers = true;
+
+static CfgItem cfgVertexBuffers("vertex_buffers", &rb_vertex_buffers);
+
 //=============================================================================
 //
 // Locals
@@ -47,34 +61,178 @@
 static uint16_t indexcnt = 0;
 static uint16_t drawIndices[MAXINDICES];
 
+// starting size of each stream; a bigger draw grows its stream to fit
+#define VERTEXSTREAMSIZE (1024 * 1024)
+#define INDEXSTREAMSIZE  (256 * 1024)
+
+//
+// A buffer object written front to back, which is orphaned when it fills so
+// the driver can give it new storage rather than wait for the GPU to finish
+// with what's already in it
+//
+struct rbStream_t
+{
+   GLenum     target;
+   GLuint     buffer;
+   GLsizeiptr size;
+   GLsizeiptr used;
+};
+
+static rbStream_t vertexStream = { GL_ARRAY_BUFFER_ARB,         0, 0, 0 };
+static rbStream_t indexStream  = { GL_ELEMENT_ARRAY_BUFFER_ARB, 0, 0, 0 };
+static GLuint     drawVAO;
+static bool       use_vertex_buffers;
+static vtx_t     *prevpointer; // client arrays last pointed at
+
+// buffer object and vertex array object function pointers
+static PFNGLGENBUFFERSARBPROC     pglGenBuffersARB     = nullptr;
+static PFNGLBINDBUFFERARBPROC     pglBindBufferARB     = nullptr;
+static PFNGLBUFFERDATAARBPROC     pglBufferDataARB     = nullptr;
+static PFNGLMAPBUFFERRANGEPROC    pglMapBufferRange    = nullptr;
+static PFNGLUNMAPBUFFERARBPROC    pglUnmapBufferARB    = nullptr;
+static PFNGLGENVERTEXARRAYSPROC   pglGenVertexArrays   = nullptr;
+static PFNGLBINDVERTEXARRAYPROC   pglBindVertexArray   = nullptr;
+
+#define GETPROC(ptr, name) \
+   ptr = reinterpret_cast<decltype(ptr)>(hal_video.getGLProcAddress(name)); \
+   extension_ok = (extension_ok && ptr != nullptr)
+
+//
+// Look up the buffer procedures for the current context and create the
+// streams. Buffer objects need GL_ARB_map_buffer_range to be written without
+// stalling, and a vertex array object is made where the GL has them, since a
+// core or ES context can't draw without one.
+//
+static void RB_loadDrawProcs()
+{
+   auto extensions   = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+   bool extension_ok = true;
+
+   use_vertex_buffers = false;
+   if(!rb_vertex_buffers || !extensions ||
+      !std::strstr(extensions, "GL_ARB_vertex_buffer_object") ||
+      !std::strstr(extensions, "GL_ARB_map_buffer_range"))
+      return;
+
+   GETPROC(pglGenBuffersARB,  "glGenBuffersARB");
+   GETPROC(pglBindBufferARB,  "glBindBufferARB");
+   GETPROC(pglBufferDataARB,  "glBufferDataARB");
+   GETPROC(pglMapBufferRange, "glMapBufferRange");
+   GETPROC(pglUnmapBufferARB, "glUnmapBufferARB");
+   if(!extension_ok)
+      return;
+
+   if(std::strstr(extensions, "GL_ARB_vertex_array_object"))
+   {
+      GETPROC(pglGenVertexArrays, "glGenVertexArrays");
+      GETPROC(pglBindVertexArray, "glBindVertexArray");
+      if(extension_ok)
+      {
+         pglGenVertexArrays(1, &drawVAO);
+         pglBindVertexArray(drawVAO);
+      }
+      extension_ok = true;
+   }
+
+   pglGenBuffersARB(1, &vertexStream.buffer);
+   pglGenBuffersARB(1, &indexStream.buffer);
+   if(!vertexStream.buffer || !indexStream.buffer)
+      return;
+
+   // the element binding is part of the vertex array object, so it stays
+   pglBindBufferARB(GL_ARRAY_BUFFER_ARB,         vertexStream.buffer);
+   pglBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, indexStream.buffer);
+
+   use_vertex_buffers = true;
+   hal_platform.debugMsg("RB_loadDrawProcs: streaming vertices through buffer objects%s\n",
+                         drawVAO ? " and a vertex array object" : "");
+}
+
+//
+// Copy size bytes into the stream and return where they went in it
+//
+static GLsizeiptr RB_streamData(rbStream_t &stream, const void *data, GLsizeiptr size)
+{
+   GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+
+   if(stream.used + size > stream.size)
+   {
+      GLsizeiptr newsize = stream.size ? stream.size :
+         (stream.target == GL_ARRAY_BUFFER_ARB ? VERTEXSTREAMSIZE : INDEXSTREAMSIZE);
+
+      while(newsize < size)
+         newsize *= 2;
+
+      pglBufferDataARB(stream.target, newsize, nullptr, GL_STREAM_DRAW_ARB);
+      stream.size = newsize;
+      stream.used = 0;
+   }
+
+   GLsizeiptr offset = stream.used;
+   void      *dest   = pglMapBufferRange(stream.target, offset, size, access);
+
+   if(dest)
+   {
+      std::memcpy(dest, data, size_t(size));
+      pglUnmapBufferARB(stream.target);
+   }
+
+   // keep draws on a 16-byte boundary
+   stream.used = (offset + size + 15) & ~GLsizeiptr(15);
+   return offset;
+}
+
 //=============================================================================
 //
 // Code
 //
 
 //
-// Sets the pointer to the vertex data on the
-// client side. A better approach would to use
-// vertex buffer objects instead so everything
-// can be done on the GPU side.
-//
-// Having witness numerous issues with ATI cards
-// and seeing how vertex data will always be
-// changing/moving, I just don't see it being worth
-// while to support it
+// Set up drawing for a new context, enabling the vertex arrays every draw
+// uses in the vertex array object if there is one. What the last context
+// had went with it.
 //
-void RB_BindDrawPointers(vtx_t *vtx)
+void RB_InitDrawState()
 {
-   static vtx_t *prevpointer = nullptr;
+   drawVAO             = 0;
+   vertexStream.buffer = indexStream.buffer = 0;
+   vertexStream.size   = indexStream.size   = 0;
+   vertexStream.used   = indexStream.used   = 0;
+   prevpointer         = nullptr;
+   RB_loadDrawProcs();
 
-   if(prevpointer == vtx)
-      return;
+   glEnableClientState(GL_VERTEX_ARRAY);
+   glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+   glEnableClientState(GL_COLOR_ARRAY);
+}
 
-   prevpointer = vtx;
+//
+// Point the draws which follow at count vertices. A GL with buffer objects
+// has the vertices copied into the vertex stream, since the arrays they
+// come from are rewritten between draws; otherwise they are read from the
+// client side when drawn.
+//
+void RB_BindDrawPointers(vtx_t *vtx, int count)
+{
+   const char *base;
+
+   if(use_vertex_buffers)
+   {
+      base = reinterpret_cast<const char *>(
+         RB_streamData(vertexStream, vtx, GLsizeiptr(count) * sizeof(vtx_t)));
+      prevpointer = nullptr;
+   }
+   else
+   {
+      if(prevpointer == vtx)
+         return;
+      prevpointer = vtx;
+      base = reinterpret_cast<const char *>(vtx);
+   }
 
-   glTexCoordPointer(2, GL_FLOAT,         sizeof(vtx_t), vtx->txcoords);
-   glVertexPointer  (3, GL_FLOAT,         sizeof(vtx_t), vtx->coords);
-   glColorPointer   (4, GL_UNSIGNED_BYTE, sizeof(vtx_t), vtx->colors);
+   glTexCoordPointer(2, GL_FLOAT,         sizeof(vtx_t), base + offsetof(vtx_t, txcoords));
+   glVertexPointer  (3, GL_FLOAT,         sizeof(vtx_t), base + offsetof(vtx_t, coords));
+   glColorPointer   (4, GL_UNSIGNED_BYTE, sizeof(vtx_t), base + offsetof(vtx_t, colors));
 }
 
 //
@@ -113,7 +271,14 @@ void RB_AddLine(uint16_t v0, uint16_t v1)
 //
 void RB_DrawElements(int mode)
 {
-   glDrawElements(mode, indexcnt, GL_UNSIGNED_SHORT, drawIndices);
+   if(use_vertex_buffers)
+   {
+      GLsizeiptr offset = RB_streamData(indexStream, drawIndices, indexcnt * sizeof(uint16_t));
+      glDrawElements(mode, indexcnt, GL_UNSIGNED_SHORT, reinterpret_cast<const GLvoid *>(offset));
+   }
+   else
+      glDrawElements(mode, indexcnt, GL_UNSIGNED_SHORT, drawIndices);
+   ++rbStats.drawCalls;
 }
 
 //
@@ -124,5 +289,15 @@ void RB_ResetElements()
    indexcnt = 0;
 }
 
+//
+// Draw count vertices from the bound draw pointers in order, starting at
+// first, without going through the draw indices
+//
+void RB_DrawArrays(int mode, int first, int count)
+{
+   glDrawArrays(mode, first, count);
+   ++rbStats.drawCalls;
+}
+
 // EOF
 
@@ -34,25 +34,13 @@
 #include "rb_main.h"
 #include "rb_texture.h"
 
-void RB_BindDrawPointers(vtx_t *vtx);
+void RB_InitDrawState();
+void RB_BindDrawPointers(vtx_t *vtx, int count);
 void RB_AddTriangle(uint16_t v0, uint16_t v1, uint16_t v2);
 void RB_AddLine(uint16_t v0, uint16_t v1);
 void RB_DrawElements(int mode);
 void RB_ResetElements();
-
-//
-// Draw a simple quad in immediate mode.
-//
-static inline void RB_DrawVtxQuadImmediate(vtx_t *v)
-{
-   glBegin(GL_QUADS);
-   glColor4ubv(v[0].colors);
-   glTexCoord2fv(v[0].txcoords); glVertex3fv(v[0].coords);
-   glTexCoord2fv(v[1].txcoords); glVertex3fv(v[1].coords);
-   glTexCoord2fv(v[3].txcoords); glVertex3fv(v[3].coords);
-   glTexCoord2fv(v[2].txcoords); glVertex3fv(v[2].coords);
-   glEnd();
-}
+void RB_DrawArrays(int mode, int first, int count);
 
 //
 // Set a group of one or more vertices' color components.
@@ -35,6 +35,9 @@
 
 #include <cstdlib>
 #include <cstring>
+#include "../hal/hal_platform.h"
+#include "../hal/hal_video.h"
+#include "rb_draw.h"
 #include "rb_main.h"
 #include "rb_texture.h"
 #include "valloc.h"
@@ -55,6 +58,9 @@ __declspec(dllexport) unsigned long NvOptimusEnablement = 1u;
 // GL global state cache
 rbState_t rbState;
 
+// GL work counters
+rbStats_t rbStats;
+
 static rbTexture whiteTexture;
 
 //
@@ -82,6 +88,133 @@ VALLOCATION(whiteTexture)
    whiteTexture.abandonTexture();
 }
 
+//
+// GPU timing
+//
+
+#define RB_GPUTIMERFRAMES 4 // frames of queries which may be in flight
+
+struct rbGPUFrame_t
+{
+   GLuint queries[RB_NUMGPUMARKS];
+   bool   marked[RB_NUMGPUMARKS];
+};
+
+static bool         use_timer_query;
+static rbGPUFrame_t gpuFrames[RB_GPUTIMERFRAMES];
+static int          gpuFrameNum; // frame being marked
+static rbGPUTimes_t gpuTimes;    // of the newest frame read back
+
+static PFNGLGENQUERIESPROC          pglGenQueries          = nullptr;
+static PFNGLGETQUERYOBJECTIVPROC    pglGetQueryObjectiv    = nullptr;
+static PFNGLQUERYCOUNTERPROC        pglQueryCounter        = nullptr;
+static PFNGLGETQUERYOBJECTUI64VPROC pglGetQueryObjectui64v = nullptr;
+
+#define GETPROC(ptr, name) \
+   ptr = reinterpret_cast<decltype(ptr)>(hal_video.getGLProcAddress(name)); \
+   extension_ok = (extension_ok && ptr != nullptr)
+
+//
+// Look up the timer query procedures for a new context and make its queries;
+// those of any old context went with it.
+//
+static void RB_initGPUTimer()
+{
+   auto extensions   = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+   bool extension_ok = true;
+
+   std::memset(gpuFrames, 0, sizeof(gpuFrames));
+   std::memset(&gpuTimes, 0, sizeof(gpuTimes));
+   gpuFrameNum = 0;
+
+   use_timer_query = false;
+   if(!extensions || !std::strstr(extensions, "GL_ARB_timer_query"))
+      return;
+
+   GETPROC(pglGenQueries,          "glGenQueries");
+   GETPROC(pglGetQueryObjectiv,    "glGetQueryObjectiv");
+   GETPROC(pglQueryCounter,        "glQueryCounter");
+   GETPROC(pglGetQueryObjectui64v, "glGetQueryObjectui64v");
+   if(!extension_ok)
+      return;
+
+   for(rbGPUFrame_t &frame : gpuFrames)
+      pglGenQueries(RB_NUMGPUMARKS, frame.queries);
+
+   use_timer_query = true;
+   hal_platform.debugMsg("Successfully loaded GL_ARB_timer_query\n");
+}
+
+//
+// Read back a frame's timestamps if the GL has all of them yet, without
+// waiting for it to.
+//
+static bool RB_readGPUFrame(const rbGPUFrame_t &frame)
+{
+   GLuint64 stamps[RB_NUMGPUMARKS];
+
+   for(int i = 0; i < RB_NUMGPUMARKS; i++)
+   {
+      GLint available = 0;
+
+      if(!frame.marked[i])
+         return false;
+      pglGetQueryObjectiv(frame.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+      if(!available)
+         return false;
+   }
+
+   for(int i = 0; i < RB_NUMGPUMARKS; i++)
+      pglGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &stamps[i]);
+
+   gpuTimes.uploadUS  = unsigned((stamps[RB_GPUMARK_DRAW   ] - stamps[RB_GPUMARK_UPLOAD ]) / 1000);
+   gpuTimes.drawUS    = unsigned((stamps[RB_GPUMARK_PRESENT] - stamps[RB_GPUMARK_DRAW   ]) / 1000);
+   gpuTimes.presentUS = unsigned((stamps[RB_GPUMARK_END    ] - stamps[RB_GPUMARK_PRESENT]) / 1000);
+   return true;
+}
+
+//
+// Have the GPU note the time it reaches this point in the frame. Only the
+// first mark of each kind in a frame counts, and marking the end moves on to
+// the next frame, reading back any earlier ones which have finished.
+//
+void RB_MarkGPUTime(rbGPUMark_e mark)
+{
+   if(!use_timer_query)
+      return;
+
+   rbGPUFrame_t &frame = gpuFrames[gpuFrameNum];
+   if(frame.marked[mark])
+      return;
+
+   pglQueryCounter(frame.queries[mark], GL_TIMESTAMP);
+   frame.marked[mark] = true;
+
+   if(mark != RB_GPUMARK_END)
+      return;
+
+   // oldest first, so that the newest results are the ones kept
+   for(int i = 1; i <= RB_GPUTIMERFRAMES; i++)
+   {
+      rbGPUFrame_t &done = gpuFrames[(gpuFrameNum + i) % RB_GPUTIMERFRAMES];
+      if(RB_readGPUFrame(done))
+         std::memset(done.marked, 0, sizeof(done.marked));
+   }
+
+   // a frame still not back by the time its queries come round is dropped
+   gpuFrameNum = (gpuFrameNum + 1) % RB_GPUTIMERFRAMES;
+   std::memset(gpuFrames[gpuFrameNum].marked, 0, sizeof(gpuFrames[gpuFrameNum].marked));
+}
+
+//
+// Get the GPU times of the newest frame read back; all zero if the GL can't
+// time frames.
+//
+void RB_GetGPUTimes(rbGPUTimes_t *times)
+{
+   *times = gpuTimes;
+}
+
 //
 // Resets the OpenGL state
 //
@@ -108,9 +241,19 @@ void RB_InitDefaultState()
    RB_SetCull(RB_GLCULL_BACK);
    RB_SetBlend(RB_GLSRC_SRC_ALPHA, RB_GLDST_ONE_MINUS_SRC_ALPHA);
 
-   glEnableClientState(GL_VERTEX_ARRAY);
-   glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-   glEnableClientState(GL_COLOR_ARRAY);
+   RB_InitDrawState();
+   RB_initGPUTimer();
+}
+
+//
+// Hand back the counters of the frame just finished, if last is non-null,
+// and start counting again
+//
+void RB_ResetStats(rbStats_t *last)
+{
+   if(last)
+      *last = rbStats;
+   std::memset(&rbStats, 0, sizeof(rbStats));
 }
 
 //
@@ -194,12 +337,14 @@ void RB_SetState(int bits, bool bEnable)
    {
       glEnable(stateFlag);
       rbState.glStateBits |= (1 << bits);
+      ++rbStats.stateChanges;
    }
    // if state was already unset then don't unset it again
    else if(!bEnable && (rbState.glStateBits & (1 << bits)))
    {
       glDisable(stateFlag);
       rbState.glStateBits &= ~(1 << bits);
+      ++rbStats.stateChanges;
    }
 }
 
@@ -290,6 +435,7 @@ void RB_SetBlend(rbSrcBlend_e src, rbDstBlend_e dest)
    }
 
    glBlendFunc(glSrc, glDst);
+   ++rbStats.stateChanges;
 
    rbState.blendSrc  = src;
    rbState.blendDest = dest;
@@ -321,6 +467,7 @@ void RB_SetCull(rbCullType_e type)
    }
 
    glCullFace(cullType);
+   ++rbStats.stateChanges;
    rbState.cullType = type;
 }
 
@@ -346,6 +493,7 @@ void RB_SetReadBuffer(rbBufferType_e state)
    }
 
    glReadBuffer(glState);
+   ++rbStats.stateChanges;
    rbState.readBuffer = state;
 }
 
@@ -361,6 +509,7 @@ void RB_SetScissorRect(const rbScissor_t &rect)
       return;
 
    glScissor(rect.x, rect.y, rect.width, rect.height);
+   ++rbStats.stateChanges;
 
    rbState.scissorRect.x      = rect.x;
    rbState.scissorRect.y      = rect.y;
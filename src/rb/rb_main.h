@@ -151,7 +151,45 @@ struct rbState_t
 
 extern rbState_t rbState;
 
+//
+// GL work done since the counters were last reset, once a frame
+//
+struct rbStats_t
+{
+   unsigned int stateChanges; // enables, blend, cull, scissor, programs...
+   unsigned int textureBinds;
+   unsigned int drawCalls;
+   unsigned int uploadBytes;  // texture data sent, including through PBOs
+};
+
+extern rbStats_t rbStats;
+
+//
+// Points in a frame at which the GPU's clock is read
+//
+typedef enum
+{
+   RB_GPUMARK_UPLOAD,  // before the frame's texture uploads
+   RB_GPUMARK_DRAW,    // before its draw commands
+   RB_GPUMARK_PRESENT, // before the buffers are swapped
+   RB_GPUMARK_END,     // after
+   RB_NUMGPUMARKS
+} rbGPUMark_e;
+
+//
+// GPU time taken between the marks of a finished frame
+//
+struct rbGPUTimes_t
+{
+   unsigned int uploadUS;
+   unsigned int drawUS;
+   unsigned int presentUS;
+};
+
 void RB_InitDefaultState();
+void RB_ResetStats(rbStats_t *last);
+void RB_MarkGPUTime(rbGPUMark_e mark);
+void RB_GetGPUTimes(rbGPUTimes_t *times);
 
 rbTexture *RB_GetWhiteTexture();
 
@@ -0,0 +1,495 @@
+/*
+  CALICO
+
+  OpenGL screenshots
+
+  The back buffer is read into a pixel pack buffer just before it is shown,
+  and only mapped a frame or more later, once a fence says the copy is done,
+  so the frame never waits on the GPU. The pixels are then handed to a
+  background thread which encodes the PNG and writes the file. Without PBOs
+  the read is done at once, and without threads so is the writing.
+
+  The MIT License (MIT)
+
+  Copyright (C) 2016 James Haley
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifdef USE_SDL2
+#include "SDL_opengl.h"
+#else
+#error Need include for opengl.h
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "../elib/elib.h"
+#include "../elib/compare.h"
+#include "../elib/qstring.h"
+#include "../hal/hal_platform.h"
+#include "../hal/hal_thread.h"
+#include "../hal/hal_video.h"
+#include "../m_thread.h"
+#include "rb_main.h"
+#include "rb_screenshot.h"
+#include "valloc.h"
+
+#define MAXSHOTFRAMES 4 // frames to wait for a fence before mapping anyway
+
+struct screenshot_t
+{
+   screenshot_t *next;
+   GLuint        pbo;
+   GLsync        fence;
+   int           frames;        // ends of frame seen since the read started
+   unsigned int  width, height;
+   rbbyte       *pixels;        // RGBA, bottom row first
+};
+
+static bool          shotRequested;
+static screenshot_t *pendingShots; // being read back by the GPU
+
+// handed to the writing thread
+static screenshot_t       *writeShots;
+static hal_semhandle_t     shotlock; // guards writeShots
+static hal_semhandle_t     shotwork; // posted for every screenshot to write
+static hal_threadhandle_t  shotthread;
+static bool                shotthreadTried;
+
+// buffer object and sync function pointers
+static bool shotProcsLoaded;
+static bool use_pack_pbo;
+static bool use_shot_sync;
+static PFNGLGENBUFFERSARBPROC    pglGenBuffersARB    = nullptr;
+static PFNGLDELETEBUFFERSARBPROC pglDeleteBuffersARB = nullptr;
+static PFNGLBINDBUFFERARBPROC    pglBindBufferARB    = nullptr;
+static PFNGLBUFFERDATAARBPROC    pglBufferDataARB    = nullptr;
+static PFNGLMAPBUFFERARBPROC     pglMapBufferARB     = nullptr;
+static PFNGLUNMAPBUFFERARBPROC   pglUnmapBufferARB   = nullptr;
+static PFNGLFENCESYNCPROC        pglFenceSync        = nullptr;
+static PFNGLCLIENTWAITSYNCPROC   pglClientWaitSync   = nullptr;
+static PFNGLDELETESYNCPROC       pglDeleteSync       = nullptr;
+
+#define GETPROC(ptr, name) \
+   ptr = reinterpret_cast<decltype(ptr)>(hal_video.getGLProcAddress(name)); \
+   extension_ok = (extension_ok && ptr != nullptr)
+
+//
+// Reads still in flight go with the context
+//
+VALLOCATION(screenshots)
+{
+   shotProcsLoaded = false;
+
+   while(pendingShots)
+   {
+      screenshot_t *next = pendingShots->next;
+      efree(pendingShots);
+      pendingShots = next;
+   }
+}
+
+static void RB_loadShotProcs()
+{
+   if(shotProcsLoaded)
+      return;
+
+   auto extensions   = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+   bool extension_ok = true;
+
+   use_pack_pbo = use_shot_sync = false;
+   if(std::strstr(extensions, "GL_ARB_pixel_buffer_object"))
+   {
+      GETPROC(pglGenBuffersARB,    "glGenBuffersARB");
+      GETPROC(pglDeleteBuffersARB, "glDeleteBuffersARB");
+      GETPROC(pglBindBufferARB,    "glBindBufferARB");
+      GETPROC(pglBufferDataARB,    "glBufferDataARB");
+      GETPROC(pglMapBufferARB,     "glMapBufferARB");
+      GETPROC(pglUnmapBufferARB,   "glUnmapBufferARB");
+      use_pack_pbo = extension_ok;
+   }
+   if(use_pack_pbo && std::strstr(extensions, "GL_ARB_sync"))
+   {
+      GETPROC(pglFenceSync,      "glFenceSync");
+      GETPROC(pglClientWaitSync, "glClientWaitSync");
+      GETPROC(pglDeleteSync,     "glDeleteSync");
+      use_shot_sync = extension_ok;
+   }
+
+   shotProcsLoaded = true;
+}
+
+//=============================================================================
+//
+// PNG writing
+//
+
+static uint32_t crcTable[256];
+
+static void RB_initCRCTable()
+{
+   for(uint32_t n = 0; n < 256; n++)
+   {
+      uint32_t c = n;
+      for(int k = 0; k < 8; k++)
+         c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      crcTable[n] = c;
+   }
+}
+
+static uint32_t RB_crc(uint32_t crc, const rbbyte *data, size_t len)
+{
+   crc = ~crc;
+   while(len--)
+      crc = crcTable[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+   return ~crc;
+}
+
+static void RB_putBE32(rbbyte *dest, uint32_t value)
+{
+   dest[0] = rbbyte(value >> 24);
+   dest[1] = rbbyte(value >> 16);
+   dest[2] = rbbyte(value >>  8);
+   dest[3] = rbbyte(value);
+}
+
+//
+// Write one chunk, where data is preceded by 4 free bytes for the type
+//
+static bool RB_writeChunk(FILE *f, const char *type, rbbyte *data, size_t len)
+{
+   rbbyte lenbytes[4], crcbytes[4];
+
+   std::memcpy(data, type, 4);
+   RB_putBE32(lenbytes, uint32_t(len));
+   RB_putBE32(crcbytes, RB_crc(0, data, len + 4));
+
+   return std::fwrite(lenbytes, 4, 1, f) == 1 &&
+          std::fwrite(data, len + 4, 1, f) == 1 &&
+          std::fwrite(crcbytes, 4, 1, f) == 1;
+}
+
+//
+// Encode the screenshot as an RGB PNG. Its image data is kept in stored
+// deflate blocks, which need no compressor, at the cost of a larger file.
+//
+static bool RB_writePNG(FILE *f, const screenshot_t *shot)
+{
+   static const rbbyte signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+   const size_t rowbytes = 1 + size_t(shot->width) * 3;
+   const size_t rawbytes = rowbytes * shot->height;
+   const size_t numblocks = (rawbytes + 0xFFFE) / 0xFFFF;
+   const size_t idatlen  = 2 + rawbytes + 5 * numblocks + 4;
+   rbbyte  ihdr[4 + 13];
+   rbbyte  iend[4];
+   rbbyte *idat, *out, *raw;
+   uint32_t s1 = 1, s2 = 0;
+   bool    res;
+
+   if(!(idat = static_cast<rbbyte *>(std::malloc(4 + idatlen + rawbytes))))
+      return false;
+
+   // unfiltered rows, top first, without alpha
+   raw = idat + 4 + idatlen;
+   for(unsigned int y = 0; y < shot->height; y++)
+   {
+      const rbbyte *src  = shot->pixels + size_t(shot->height - 1 - y) * shot->width * 4;
+      rbbyte       *dest = raw + y * rowbytes;
+
+      *dest++ = 0;
+      for(unsigned int x = 0; x < shot->width; x++, src += 4)
+      {
+         *dest++ = src[0];
+         *dest++ = src[1];
+         *dest++ = src[2];
+      }
+   }
+
+   // zlib stream of stored blocks
+   out = idat + 4;
+   *out++ = 0x78;
+   *out++ = 0x01;
+   for(size_t done = 0; done < rawbytes; )
+   {
+      size_t len = emin(rawbytes - done, size_t(0xFFFF));
+
+      *out++ = (done + len == rawbytes) ? 1 : 0;
+      *out++ = rbbyte(len);
+      *out++ = rbbyte(len >> 8);
+      *out++ = rbbyte(~len);
+      *out++ = rbbyte(~len >> 8);
+      std::memcpy(out, raw + done, len);
+      out  += len;
+
+      for(size_t i = 0; i < len; i++)
+      {
+         s1 = (s1 + raw[done + i]) % 65521;
+         s2 = (s2 + s1) % 65521;
+      }
+      done += len;
+   }
+   RB_putBE32(out, (s2 << 16) | s1);
+
+   RB_putBE32(ihdr + 4, shot->width);
+   RB_putBE32(ihdr + 8, shot->height);
+   ihdr[12] = 8; // bits per component
+   ihdr[13] = 2; // RGB
+   ihdr[14] = ihdr[15] = ihdr[16] = 0;
+
+   res = std::fwrite(signature, sizeof(signature), 1, f) == 1 &&
+         RB_writeChunk(f, "IHDR", ihdr, 13) &&
+         RB_writeChunk(f, "IDAT", idat, idatlen) &&
+         RB_writeChunk(f, "IEND", iend, 0);
+
+   std::free(idat);
+   return res;
+}
+
+//
+// Write a screenshot out to the next unused calicoNNNN.png in the write
+// directory, then free it
+//
+static void RB_saveScreenshot(screenshot_t *shot)
+{
+   static int shotnum;
+   FILE *f = nullptr;
+
+   for(; shotnum < 10000 && !f; shotnum++)
+   {
+      char    name[16];
+      qstring path(hal_platform.getWriteDirectory());
+
+      std::snprintf(name, sizeof(name), "calico%04d.png", shotnum);
+      path.pathConcatenate(name);
+
+      if((f = std::fopen(path.constPtr(), "rb")))
+      {
+         std::fclose(f);
+         f = nullptr;
+         continue;
+      }
+
+      if((f = std::fopen(path.constPtr(), "wb")))
+      {
+         if(!RB_writePNG(f, shot))
+            hal_platform.debugMsg("RB_saveScreenshot: could not write %s\n", path.constPtr());
+         std::fclose(f);
+      }
+   }
+
+   efree(shot->pixels);
+   efree(shot);
+}
+
+//
+// Screenshot writing thread main loop
+//
+static int RB_ScreenshotThread(void *data)
+{
+   M_ScheduleThread(THREAD_IO);
+
+   while(1)
+   {
+      screenshot_t *shot;
+
+      hal_threads.semWait(shotwork);
+
+      hal_threads.semWait(shotlock);
+      if((shot = writeShots))
+         writeShots = shot->next;
+      hal_threads.semPost(shotlock);
+
+      if(shot)
+         RB_saveScreenshot(shot);
+   }
+
+   return 0;
+}
+
+//
+// Hand a screenshot whose pixels are in memory to the writing thread, or
+// write it now if there isn't one
+//
+static void RB_queueWrite(screenshot_t *shot)
+{
+   if(!shotthreadTried)
+   {
+      shotthreadTried = true;
+      if(hal_threads.createThread)
+      {
+         shotlock = hal_threads.createSemaphore(1);
+         shotwork = hal_threads.createSemaphore(0);
+         if(!shotlock || !shotwork ||
+            !(shotthread = hal_threads.createThread(RB_ScreenshotThread, "RB_ScreenshotThread", nullptr)))
+         {
+            hal_threads.destroySemaphore(shotlock);
+            hal_threads.destroySemaphore(shotwork);
+            shotlock = shotwork = nullptr;
+         }
+      }
+   }
+
+   if(!shotthread)
+   {
+      RB_saveScreenshot(shot);
+      return;
+   }
+
+   // the thread takes them first in, first out
+   hal_threads.semWait(shotlock);
+   screenshot_t **tail = &writeShots;
+   while(*tail)
+      tail = &(*tail)->next;
+   shot->next = nullptr;
+   *tail = shot;
+   hal_threads.semPost(shotlock);
+   hal_threads.semPost(shotwork);
+}
+
+//=============================================================================
+//
+// Capture
+//
+
+//
+// Start reading back the finished frame in the back buffer
+//
+static void RB_captureScreenshot()
+{
+   int w = 0, h = 0;
+   screenshot_t *shot;
+
+   hal_video.getWindowSize(&w, &h);
+   if(w <= 0 || h <= 0)
+      return;
+
+   RB_loadShotProcs();
+   if(!crcTable[1])
+      RB_initCRCTable();
+
+   shot = estructalloc(screenshot_t, 1);
+   shot->width  = unsigned(w);
+   shot->height = unsigned(h);
+
+   RB_SetReadBuffer(RB_GLBUFFER_BACK);
+
+   if(use_pack_pbo)
+   {
+      pglGenBuffersARB(1, &shot->pbo);
+      pglBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, shot->pbo);
+      pglBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB, GLsizeiptr(w) * h * 4, nullptr, GL_STREAM_READ_ARB);
+      glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+      pglBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+      if(use_shot_sync)
+         shot->fence = pglFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+      shot->next   = pendingShots;
+      pendingShots = shot;
+   }
+   else
+   {
+      shot->pixels = emalloc(rbbyte, size_t(w) * h * 4);
+      glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, shot->pixels);
+      RB_queueWrite(shot);
+   }
+}
+
+//
+// Check whether the GPU has finished reading back a screenshot. Without
+// fences, a frame is assumed to be enough.
+//
+static bool RB_shotReady(screenshot_t *shot)
+{
+   if(shot->frames >= MAXSHOTFRAMES)
+      return true;
+   if(!shot->fence)
+      return shot->frames >= 1;
+
+   return pglClientWaitSync(shot->fence, 0, 0) != GL_TIMEOUT_EXPIRED;
+}
+
+//
+// Take every finished read back out of its PBO
+//
+static void RB_retireScreenshots()
+{
+   screenshot_t **link = &pendingShots;
+
+   while(*link)
+   {
+      screenshot_t *shot = *link;
+
+      ++shot->frames;
+      if(!RB_shotReady(shot))
+      {
+         link = &shot->next;
+         continue;
+      }
+      *link = shot->next;
+
+      const size_t size = size_t(shot->width) * shot->height * 4;
+      void *ptr;
+
+      pglBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, shot->pbo);
+      if((ptr = pglMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB)))
+      {
+         shot->pixels = emalloc(rbbyte, size);
+         std::memcpy(shot->pixels, ptr, size);
+         pglUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+      }
+      pglBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+      pglDeleteBuffersARB(1, &shot->pbo);
+      if(shot->fence)
+         pglDeleteSync(shot->fence);
+
+      if(shot->pixels)
+         RB_queueWrite(shot);
+      else
+         efree(shot);
+   }
+}
+
+//
+// Ask for the next frame to be saved as a screenshot
+//
+void RB_RequestScreenshot()
+{
+   shotRequested = true;
+}
+
+//
+// Call once the frame is finished, before it is shown
+//
+void RB_EndFrameScreenshots()
+{
+   if(pendingShots)
+      RB_retireScreenshots();
+
+   if(shotRequested)
+   {
+      shotRequested = false;
+      RB_captureScreenshot();
+   }
+}
+
+// EOF
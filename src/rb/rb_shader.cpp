@@ -0,0 +1,367 @@
+/*
+  CALICO
+
+  OpenGL renderer CRY decoding
+
+  The 3D view may be kept as 16-bit CRY, as the Jaguar drew it, and turned
+  into RGB while it is drawn rather than by the software drawers. Its texture
+  is uploaded as luminance-alpha, which puts the Y byte of each pixel in the
+  luminance and the C and R nybbles in the alpha, and a fragment program
+  looks the pair up in a 256x256 texture holding the whole CRY to RGB table.
+  Screen shading is added to the CRY components first, exactly as the
+  software drawers' I_BlendCRY does it.
+
+  The MIT License (MIT)
+
+  Copyright (C) 2016 James Haley
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifdef USE_SDL2
+#include "SDL_opengl.h"
+#else
+#error Need include for opengl.h
+#endif
+
+#include "../hal/hal_platform.h"
+#include "../hal/hal_video.h"
+#include "rb_main.h"
+#include "rb_shader.h"
+#include "rb_texture.h"
+#include "valloc.h"
+
+// GL 2.0 function pointers
+static PFNGLCREATESHADERPROC       pglCreateShader       = nullptr;
+static PFNGLDELETESHADERPROC       pglDeleteShader       = nullptr;
+static PFNGLSHADERSOURCEPROC       pglShaderSource       = nullptr;
+static PFNGLCOMPILESHADERPROC      pglCompileShader      = nullptr;
+static PFNGLGETSHADERIVPROC        pglGetShaderiv        = nullptr;
+static PFNGLCREATEPROGRAMPROC      pglCreateProgram      = nullptr;
+static PFNGLDELETEPROGRAMPROC      pglDeleteProgram      = nullptr;
+static PFNGLATTACHSHADERPROC       pglAttachShader       = nullptr;
+static PFNGLLINKPROGRAMPROC        pglLinkProgram        = nullptr;
+static PFNGLGETPROGRAMIVPROC       pglGetProgramiv       = nullptr;
+static PFNGLUSEPROGRAMPROC         pglUseProgram         = nullptr;
+static PFNGLGETUNIFORMLOCATIONPROC pglGetUniformLocation = nullptr;
+static PFNGLUNIFORM1IPROC          pglUniform1i          = nullptr;
+static PFNGLUNIFORM3FPROC          pglUniform3f          = nullptr;
+static PFNGLACTIVETEXTUREPROC      pglActiveTexture      = nullptr;
+
+#define GETPROC(ptr, name) \
+   ptr = reinterpret_cast<decltype(ptr)>(hal_video.getGLProcAddress(name)); \
+   extension_ok = (extension_ok && ptr != nullptr)
+
+static const char *cryVertexSource =
+   "void main()\n"
+   "{\n"
+   "   gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+   "   gl_FrontColor  = gl_Color;\n"
+   "   gl_Position    = ftransform();\n"
+   "}\n";
+
+// the shaded Y byte selects the column of the table and the CR byte its row
+static const char *cryFragmentSource =
+   "uniform sampler2D cry;\n"
+   "uniform sampler2D table;\n"
+   "uniform vec3 shade;\n" // added to C, R, and Y
+   "void main()\n"
+   "{\n"
+   "   vec2 ycr = floor(texture2D(cry, gl_TexCoord[0].st).ra * 255.0 + 0.5);\n"
+   "   vec3 cry = vec3(floor(ycr.y / 16.0), mod(ycr.y, 16.0), ycr.x) + shade;\n"
+   "   cry = clamp(cry, vec3(0.0), vec3(15.0, 15.0, 255.0));\n"
+   "   vec2 at = vec2(cry.z, cry.x * 16.0 + cry.y);\n"
+   "   gl_FragColor = texture2D(table, (at + 0.5) / 256.0) * gl_Color;\n"
+   "}\n";
+
+// world surfaces are lit by view depth as the Jaguar's drawers light them;
+// the vertex color carries the light level, its minimum, and the distance
+// coefficient, and texels with no coverage are dropped
+static const char *worldVertexSource =
+   "varying float depth;\n"
+   "void main()\n"
+   "{\n"
+   "   gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+   "   gl_FrontColor  = gl_Color;\n"
+   "   depth          = -(gl_ModelViewMatrix * gl_Vertex).z;\n"
+   "   gl_Position    = ftransform();\n"
+   "}\n";
+
+static const char *worldFragmentSource =
+   "uniform sampler2D cry;\n"
+   "uniform sampler2D table;\n"
+   "uniform vec3 shade;\n"
+   "varying float depth;\n"
+   "void main()\n"
+   "{\n"
+   "   vec4 texel = texture2D(cry, gl_TexCoord[0].st);\n"
+   "   if(texel.a < 0.5)\n"
+   "      discard;\n"
+   "   vec3 lit = floor(gl_Color.rgb * 255.0 + 0.5);\n"
+   "   float light = floor(clamp((lit.x - lit.y) * (lit.z / max(depth, 1.0) - 0.25), lit.y, lit.x));\n"
+   "   vec2 ycr = floor(texel.rg * 255.0 + 0.5);\n"
+   "   float y = max(floor(ycr.x - (255.0 - light) / 4.0), 0.0);\n"
+   "   vec3 cry = vec3(floor(ycr.y / 16.0), mod(ycr.y, 16.0), y) + shade;\n"
+   "   cry = clamp(cry, vec3(0.0), vec3(15.0, 15.0, 255.0));\n"
+   "   vec2 at = vec2(cry.z, cry.x * 16.0 + cry.y);\n"
+   "   gl_FragColor = texture2D(table, (at + 0.5) / 256.0);\n"
+   "}\n";
+
+static const uint32_t *cryRGB;     // table given to RB_InitCRYDecode
+static bool            cryLoaded;  // already tried in this context
+static GLuint          cryProgram;
+static GLint           cryShade;   // location of the shade uniform
+static GLuint          worldProgram;
+static GLint           worldShade;
+static rbTexture       cryTable;
+static GLuint          curProgram; // program in use
+static GLuint          curTable;   // texture bound to unit 1
+
+//
+// Programs and table are lost along with the context
+//
+VALLOCATION(cryProgram)
+{
+   cryLoaded    = false;
+   cryProgram   = 0;
+   curProgram   = 0;
+   curTable     = 0;
+   worldProgram = 0;
+   cryTable.abandonTexture();
+}
+
+//
+// Compile one stage of the program. Returns 0 on failure.
+//
+static GLuint RB_compileShader(GLenum type, const char *source)
+{
+   GLuint shader = pglCreateShader(type);
+   GLint  status = GL_FALSE;
+
+   if(!shader)
+      return 0;
+
+   pglShaderSource(shader, 1, &source, nullptr);
+   pglCompileShader(shader);
+   pglGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+
+   if(status != GL_TRUE)
+   {
+      pglDeleteShader(shader);
+      return 0;
+   }
+
+   return shader;
+}
+
+//
+// Link a program from vertex and fragment source, and point its samplers at
+// the CRY texture on unit 0 and the table on unit 1. Returns 0 on failure.
+//
+static GLuint RB_buildProgram(const char *vsource, const char *fsource)
+{
+   GLuint vs = RB_compileShader(GL_VERTEX_SHADER,   vsource);
+   GLuint fs = RB_compileShader(GL_FRAGMENT_SHADER, fsource);
+   GLuint program = 0;
+   GLint  status  = GL_FALSE;
+
+   if(vs && fs && (program = pglCreateProgram()))
+   {
+      pglAttachShader(program, vs);
+      pglAttachShader(program, fs);
+      pglLinkProgram(program);
+      pglGetProgramiv(program, GL_LINK_STATUS, &status);
+   }
+
+   // the program keeps what it needs of its stages
+   if(vs)
+      pglDeleteShader(vs);
+   if(fs)
+      pglDeleteShader(fs);
+
+   if(status != GL_TRUE)
+   {
+      if(program)
+         pglDeleteProgram(program);
+      return 0;
+   }
+
+   pglUseProgram(program);
+   pglUniform1i(pglGetUniformLocation(program, "cry"),   0);
+   pglUniform1i(pglGetUniformLocation(program, "table"), 1);
+   pglUseProgram(0);
+   curProgram = 0;
+
+   return program;
+}
+
+//
+// Look up the shader procedures and build the programs and the table texture
+// for the current context, if it hasn't been tried yet. Returns false if
+// CRY can't be decoded in this context.
+//
+static bool RB_loadCRYDecode()
+{
+   if(cryLoaded)
+      return (cryProgram != 0);
+
+   // even if this fails, don't try again until the context changes
+   cryLoaded = true;
+
+   bool extension_ok = true;
+   GETPROC(pglCreateShader,       "glCreateShader");
+   GETPROC(pglDeleteShader,       "glDeleteShader");
+   GETPROC(pglShaderSource,       "glShaderSource");
+   GETPROC(pglCompileShader,      "glCompileShader");
+   GETPROC(pglGetShaderiv,        "glGetShaderiv");
+   GETPROC(pglCreateProgram,      "glCreateProgram");
+   GETPROC(pglDeleteProgram,      "glDeleteProgram");
+   GETPROC(pglAttachShader,       "glAttachShader");
+   GETPROC(pglLinkProgram,        "glLinkProgram");
+   GETPROC(pglGetProgramiv,       "glGetProgramiv");
+   GETPROC(pglUseProgram,         "glUseProgram");
+   GETPROC(pglGetUniformLocation, "glGetUniformLocation");
+   GETPROC(pglUniform1i,          "glUniform1i");
+   GETPROC(pglUniform3f,          "glUniform3f");
+   GETPROC(pglActiveTexture,      "glActiveTexture");
+
+   if(!extension_ok || !cryRGB)
+      return false;
+
+   if(!(cryProgram = RB_buildProgram(cryVertexSource, cryFragmentSource)))
+   {
+      hal_platform.debugMsg("RB_InitCRYDecode: could not build CRY decoding program\n");
+      return false;
+   }
+   cryShade = pglGetUniformLocation(cryProgram, "shade");
+
+   // the world program is only needed by the hardware renderer
+   if((worldProgram = RB_buildProgram(worldVertexSource, worldFragmentSource)))
+      worldShade = pglGetUniformLocation(worldProgram, "shade");
+   else
+      hal_platform.debugMsg("RB_InitCRYDecode: could not build world program\n");
+
+   // the table is indexed exactly, so it must never be filtered
+   cryTable.init(rbTexture::TCR_RGBA, 256, 256);
+   cryTable.upload(const_cast<uint32_t *>(cryRGB), rbTexture::TC_CLAMP, rbTexture::TF_NEAREST);
+
+   return true;
+}
+
+//
+// Bind the table and make program current with the given screen shading
+//
+static void RB_beginProgram(GLuint program, GLint shadeloc, int sc, int sr, int sy)
+{
+   // nothing else uses unit 1, so the table only needs binding once
+   if(curTable != cryTable.getTextureID())
+   {
+      curTable = cryTable.getTextureID();
+      pglActiveTexture(GL_TEXTURE1);
+      glBindTexture(GL_TEXTURE_2D, curTable);
+      pglActiveTexture(GL_TEXTURE0);
+      ++rbStats.textureBinds;
+   }
+   if(curProgram != program)
+   {
+      pglUseProgram(program);
+      curProgram = program;
+      ++rbStats.stateChanges;
+   }
+   pglUniform3f(shadeloc, GLfloat(sc), GLfloat(sr), GLfloat(sy));
+}
+
+//
+// Prepare to decode CRY textures through table, which holds the RGBA color
+// of every CRY value. Returns false if the GL can't do it, in which case
+// CRY must be converted in software.
+//
+bool RB_InitCRYDecode(const uint32_t *table)
+{
+   if(cryRGB != table)
+   {
+      cryRGB    = table;
+      cryLoaded = false;
+   }
+
+   if(!RB_loadCRYDecode())
+      return false;
+
+   hal_platform.debugMsg("RB_InitCRYDecode: decoding CRY on the GPU\n");
+   return true;
+}
+
+//
+// Start drawing with the bound texture decoded from CRY, with the signed
+// screen shading components sc, sr, and sy added to every pixel. Returns
+// false if the program could not be rebuilt after a change of context.
+//
+bool RB_BeginCRYDecode(int sc, int sr, int sy)
+{
+   if(!RB_loadCRYDecode())
+      return false;
+
+   RB_beginProgram(cryProgram, cryShade, sc, sr, sy);
+   return true;
+}
+
+//
+// Prepare to draw world surfaces, whose textures hold the Y and CR bytes of
+// CRY texels in red and green and their coverage in alpha, decoded through
+// table. Returns false if the GL can't do it.
+//
+bool RB_InitWorldDecode(const uint32_t *table)
+{
+   if(cryRGB != table)
+   {
+      cryRGB    = table;
+      cryLoaded = false;
+   }
+
+   return RB_loadCRYDecode() && worldProgram != 0;
+}
+
+//
+// Start drawing world surfaces with the bound texture, lit by the vertex
+// colors and shaded as for RB_BeginCRYDecode. Returns false if the program
+// could not be rebuilt after a change of context. End with RB_EndCRYDecode.
+//
+bool RB_BeginWorldDecode(int sc, int sr, int sy)
+{
+   if(!RB_loadCRYDecode() || !worldProgram)
+      return false;
+
+   RB_beginProgram(worldProgram, worldShade, sc, sr, sy);
+   return true;
+}
+
+//
+// Return to fixed function drawing
+//
+void RB_EndCRYDecode()
+{
+   if(curProgram)
+   {
+      pglUseProgram(0);
+      curProgram = 0;
+      ++rbStats.stateChanges;
+   }
+}
+
+// EOF
@@ -64,6 +64,14 @@ static PFNGLBUFFERDATAARBPROC    pglBufferDataARB    = nullptr;
 static PFNGLMAPBUFFERARBPROC     pglMapBufferARB     = nullptr;
 static PFNGLUNMAPBUFFERARBPROC   pglUnmapBufferARB   = nullptr;
 
+// persistent mapping extension function pointers
+static bool use_persistent_pbo;
+static PFNGLBUFFERSTORAGEPROC    pglBufferStorage    = nullptr;
+static PFNGLMAPBUFFERRANGEPROC   pglMapBufferRange   = nullptr;
+static PFNGLFENCESYNCPROC        pglFenceSync        = nullptr;
+static PFNGLCLIENTWAITSYNCPROC   pglClientWaitSync   = nullptr;
+static PFNGLDELETESYNCPROC       pglDeleteSync       = nullptr;
+
 #define GETPROC(ptr, name) \
    ptr = reinterpret_cast<decltype(ptr)>(hal_video.getGLProcAddress(name)); \
    extension_ok = (extension_ok && ptr != nullptr)
@@ -102,11 +110,143 @@ static void RB_loadPBOExtension()
    else
       use_arb_pbo = false;
 
+   // persistently mapped buffers need both buffer storage and fences
+   use_persistent_pbo = false;
+   if(use_arb_pbo && 
+      std::strstr(extensions, "GL_ARB_buffer_storage") &&
+      std::strstr(extensions, "GL_ARB_sync"))
+   {
+      extension_ok = true;
+      GETPROC(pglBufferStorage,  "glBufferStorage");
+      GETPROC(pglMapBufferRange, "glMapBufferRange");
+      GETPROC(pglFenceSync,      "glFenceSync");
+      GETPROC(pglClientWaitSync, "glClientWaitSync");
+      GETPROC(pglDeleteSync,     "glDeleteSync");
+
+      use_persistent_pbo = extension_ok;
+      if(use_persistent_pbo)
+         hal_platform.debugMsg("Successfully loaded GL_ARB_buffer_storage\n");
+   }
+
    // even if load fails, still set this, so we don't try to load it constantly
    // on a machine where it is not supported.
    arb_pbo_loaded = true;
 }
 
+//
+// Immutable storage
+//
+
+// textures given their storage once, so the driver needn't allow for them
+// being respecified at another size or format later
+static bool tex_storage_loaded;
+static bool use_tex_storage;
+static PFNGLTEXSTORAGE2DPROC pglTexStorage2D = nullptr;
+
+VALLOCATION(tex_storage_loaded)
+{
+   tex_storage_loaded = false;
+}
+
+static void RB_loadTexStorageExtension()
+{
+   if(tex_storage_loaded)
+      return;
+
+   auto extensions   = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+   bool extension_ok = true;
+
+   use_tex_storage = false;
+   if(extensions && std::strstr(extensions, "GL_ARB_texture_storage"))
+   {
+      GETPROC(pglTexStorage2D, "glTexStorage2D");
+
+      use_tex_storage = extension_ok;
+      if(use_tex_storage)
+         hal_platform.debugMsg("Successfully loaded GL_ARB_texture_storage\n");
+   }
+
+   tex_storage_loaded = true;
+}
+
+//
+// Render targets
+//
+
+// framebuffer object, drawn into in place of the window when a texture is
+// attached to it
+static bool   fbo_loaded;
+static bool   use_fbo;
+static GLuint targetFBO;
+static PFNGLGENFRAMEBUFFERSPROC        pglGenFramebuffers        = nullptr;
+static PFNGLBINDFRAMEBUFFERPROC        pglBindFramebuffer        = nullptr;
+static PFNGLFRAMEBUFFERTEXTURE2DPROC   pglFramebufferTexture2D   = nullptr;
+static PFNGLCHECKFRAMEBUFFERSTATUSPROC pglCheckFramebufferStatus = nullptr;
+
+VALLOCATION(targetFBO)
+{
+   fbo_loaded = false;
+   use_fbo    = false;
+   targetFBO  = 0;
+}
+
+static void RB_loadFBOExtension()
+{
+   if(fbo_loaded)
+      return;
+
+   auto extensions   = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+   bool extension_ok = true;
+
+   use_fbo = false;
+   if(extensions && std::strstr(extensions, "GL_ARB_framebuffer_object"))
+   {
+      GETPROC(pglGenFramebuffers,        "glGenFramebuffers");
+      GETPROC(pglBindFramebuffer,        "glBindFramebuffer");
+      GETPROC(pglFramebufferTexture2D,   "glFramebufferTexture2D");
+      GETPROC(pglCheckFramebufferStatus, "glCheckFramebufferStatus");
+
+      use_fbo = extension_ok;
+      if(use_fbo)
+         hal_platform.debugMsg("Successfully loaded GL_ARB_framebuffer_object\n");
+   }
+
+   fbo_loaded = true;
+}
+
+//
+// Draw into tex, which must have been uploaded, instead of the window; or
+// back into the window if tex is null. Returns false if tex can't be drawn
+// into, in which case drawing is left going to the window.
+//
+bool RB_SetRenderTarget(rbTexture *tex)
+{
+   RB_loadFBOExtension();
+
+   if(!use_fbo)
+      return !tex;
+
+   if(!tex)
+   {
+      pglBindFramebuffer(GL_FRAMEBUFFER, 0);
+      return true;
+   }
+
+   if(!targetFBO)
+      pglGenFramebuffers(1, &targetFBO);
+   if(!targetFBO || !tex->getTextureID())
+      return false;
+
+   pglBindFramebuffer(GL_FRAMEBUFFER, targetFBO);
+   pglFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex->getTextureID(), 0);
+   if(pglCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+   {
+      pglBindFramebuffer(GL_FRAMEBUFFER, 0);
+      return false;
+   }
+
+   return true;
+}
 
 //
 // Get next higher power of two, which will be a suitable texture
@@ -134,8 +274,14 @@ unsigned int RB_MakeTextureDimension(unsigned int i)
 rbTexture::rbTexture()
    : width(0), height(0), clampMode(TC_CLAMP), filterMode(TF_NEAREST), 
      colorMode(TCR_RGBA), texid(0), streaming(false), pboid(0), 
-     dirtypbo(false)
+     dirtypbo(false), immutable(false), ringnext(0)
 {
+   for(int i = 0; i < RB_NUMSTREAMPBOS; i++)
+   {
+      ringids[i]    = 0;
+      ringmaps[i]   = nullptr;
+      ringfences[i] = nullptr;
+   }
 }
 
 //
@@ -151,12 +297,25 @@ rbTexture::rbTexture(rbTexture &&other)
    colorMode  = other.colorMode;
    streaming  = other.streaming;
    dirtypbo   = other.dirtypbo;
+   immutable  = other.immutable;
 
    // move texture and pbo IDs to the target object
    texid = other.texid;
    pboid = other.pboid;
    other.texid = 0;
    other.pboid = 0;
+   other.immutable = false;
+
+   ringnext = other.ringnext;
+   for(int i = 0; i < RB_NUMSTREAMPBOS; i++)
+   {
+      ringids[i]    = other.ringids[i];
+      ringmaps[i]   = other.ringmaps[i];
+      ringfences[i] = other.ringfences[i];
+      other.ringids[i]    = 0;
+      other.ringmaps[i]   = nullptr;
+      other.ringfences[i] = nullptr;
+   }
 }
 
 //
@@ -186,12 +345,12 @@ void rbTexture::init(texColorMode_t color, unsigned int w, unsigned int h)
 //
 // Setup width/height and PBO for streaming texture upload
 //
-void rbTexture::initStreaming(unsigned int w, unsigned int h)
+void rbTexture::initStreaming(texColorMode_t color, unsigned int w, unsigned int h)
 {
    // make sure PBO extension is loaded
    RB_loadPBOExtension();
 
-   colorMode  = TCR_BGRA;
+   colorMode  = color;
    width      = w;
    height     = h;
    streaming  = true;
@@ -261,6 +420,42 @@ void rbTexture::changeTexParameters(texClampMode_t clamp, texFilterMode_t filter
    setTexParameters();
 }
 
+static inline GLenum RB_glTexForTCR(rbTexture::texColorMode_t tcm)
+{
+   return 
+      ((tcm == rbTexture::TCR_BGRA)     ? GL_BGRA :
+       (tcm == rbTexture::TCR_RGBA)     ? GL_RGBA : 
+       (tcm == rbTexture::TCR_LUMALPHA) ? GL_LUMINANCE_ALPHA :
+       GL_RGB);
+}
+
+static inline GLint RB_glIntFormatForTCR(rbTexture::texColorMode_t tcm)
+{
+   return
+      ((tcm == rbTexture::TCR_RGB)      ? GL_RGB8 :
+       (tcm == rbTexture::TCR_LUMALPHA) ? GL_LUMINANCE8_ALPHA8 :
+       GL_RGBA8);
+}
+
+//
+// Size in bytes of one pixel of the texture's image data
+//
+unsigned int rbTexture::pixelSize() const
+{
+   return
+      ((colorMode == TCR_RGB)      ? 3 :
+       (colorMode == TCR_LUMALPHA) ? 2 :
+       4);
+}
+
+//
+// Size in bytes of the texture's image data
+//
+unsigned int rbTexture::dataSize() const
+{
+   return width * height * pixelSize();
+}
+
 //
 // Bind this texture if it is not the current globally bound texture.
 //
@@ -277,12 +472,13 @@ void rbTexture::bind(bool forDraw)
       return;
 
    glBindTexture(GL_TEXTURE_2D, tid);
+   ++rbStats.textureBinds;
 
    // streaming texture may need to update from its PBO
    if(needsUpdate)
    {
       pglBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, pboid);
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_BGRA, GL_UNSIGNED_BYTE, 0);
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, RB_glTexForTCR(colorMode), GL_UNSIGNED_BYTE, 0);
       dirtypbo = false;
       pglBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
    }
@@ -298,6 +494,7 @@ void rbTexture::Unbind()
 {
    rbState.currentTexture = 0;
    glBindTexture(GL_TEXTURE_2D, 0);
+   ++rbStats.textureBinds;
 }
 
 //
@@ -313,6 +510,7 @@ void rbTexture::deleteTexture()
 
    glDeleteTextures(1, &this->texid);
    this->texid = 0;
+   this->immutable = false;
 }
 
 //
@@ -320,11 +518,26 @@ void rbTexture::deleteTexture()
 //
 void rbTexture::deletePBO()
 {
-   if(!use_arb_pbo || this->pboid == 0)
+   if(!use_arb_pbo)
       return;
 
-   pglDeleteBuffersARB(1, &this->pboid);
-   this->pboid = 0;
+   if(this->pboid)
+   {
+      pglDeleteBuffersARB(1, &this->pboid);
+      this->pboid = 0;
+   }
+
+   for(int i = 0; i < RB_NUMSTREAMPBOS; i++)
+   {
+      // deleting a buffer also unmaps it
+      if(this->ringids[i])
+         pglDeleteBuffersARB(1, &this->ringids[i]);
+      if(this->ringfences[i])
+         pglDeleteSync(static_cast<GLsync>(this->ringfences[i]));
+      this->ringids[i]    = 0;
+      this->ringmaps[i]   = nullptr;
+      this->ringfences[i] = nullptr;
+   }
 }
 
 //
@@ -336,18 +549,18 @@ void rbTexture::abandonTexture()
 {
    this->texid = 0;
    this->pboid = 0;
-}
 
-static inline GLenum RB_glTexForTCR(rbTexture::texColorMode_t tcm)
-{
-   return 
-      ((tcm == rbTexture::TCR_BGRA) ? GL_BGRA :
-       (tcm == rbTexture::TCR_RGBA) ? GL_RGBA : 
-       GL_RGB);
+   for(int i = 0; i < RB_NUMSTREAMPBOS; i++)
+   {
+      this->ringids[i]    = 0;
+      this->ringmaps[i]   = nullptr;
+      this->ringfences[i] = nullptr;
+   }
 }
 
 //
-// Create a GL texture and upload image data to it.
+// Create a GL texture and upload image data to it. With no data, the
+// texture is only given storage, such as to be drawn into.
 //
 void rbTexture::upload(void *data, texClampMode_t clamp, texFilterMode_t filter)
 {
@@ -363,12 +576,12 @@ void rbTexture::upload(void *data, texClampMode_t clamp, texFilterMode_t filter)
 
    glGenTextures(1, &this->texid);
 
-   // if streaming, create PBO
+   // if streaming, create PBO, or a ring of them if they can stay mapped
    if(streaming)
    {
       // ensure extension is loaded
       RB_loadPBOExtension();
-      if(use_arb_pbo)
+      if(use_arb_pbo && !(use_persistent_pbo && createRing()))
          pglGenBuffersARB(1, &this->pboid);
    }
 
@@ -380,19 +593,35 @@ void rbTexture::upload(void *data, texClampMode_t clamp, texFilterMode_t filter)
 
    bind(false);
 
+   // give the texture its storage, then fill it in
+   RB_loadTexStorageExtension();
+   if(use_tex_storage && this->colorMode != TCR_LUMALPHA)
+   {
+      pglTexStorage2D(GL_TEXTURE_2D, 1, RB_glIntFormatForTCR(this->colorMode),
+                      this->width, this->height);
+      this->immutable = true;
+   }
+   else
+   {
+      glTexImage2D(GL_TEXTURE_2D, 0, RB_glIntFormatForTCR(this->colorMode), this->width,
+                   this->height, 0, RB_glTexForTCR(this->colorMode), GL_UNSIGNED_BYTE, nullptr);
+   }
+
    if(data)
    {
       void *src = data;
 
+      rbStats.uploadBytes += dataSize();
+
       if(use_arb_pbo && pboid)
       {
          // streaming textures should upload to PBO
          GLvoid *ptr;
          pglBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, pboid);
-         pglBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, width*height*4, 0, GL_STREAM_DRAW_ARB);
+         pglBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, dataSize(), 0, GL_STREAM_DRAW_ARB);
          if((ptr = pglMapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB)))
          {
-            std::memcpy(ptr, src, width*height*4);
+            std::memcpy(ptr, src, dataSize());
             dirtypbo = true;
             pglUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
          }
@@ -400,13 +629,13 @@ void rbTexture::upload(void *data, texClampMode_t clamp, texFilterMode_t filter)
       }
       else
       {
-         glTexImage2D(
+         glTexSubImage2D(
             GL_TEXTURE_2D,
             0,
-            (this->colorMode == TCR_RGB) ? GL_RGB8 : GL_RGBA8,
+            0,
+            0,
             this->width,
             this->height,
-            0,
             RB_glTexForTCR(this->colorMode),
             GL_UNSIGNED_BYTE,
             src
@@ -420,6 +649,66 @@ void rbTexture::upload(void *data, texClampMode_t clamp, texFilterMode_t filter)
    Unbind();
 }
 
+//
+// Create the persistently mapped PBOs for a streaming texture. Returns false
+// if any of them can't be created.
+//
+bool rbTexture::createRing()
+{
+   const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+   const GLsizeiptr size  = GLsizeiptr(dataSize());
+
+   for(int i = 0; i < RB_NUMSTREAMPBOS; i++)
+   {
+      pglGenBuffersARB(1, &ringids[i]);
+      pglBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, ringids[i]);
+      pglBufferStorage(GL_PIXEL_UNPACK_BUFFER_ARB, size, nullptr, flags);
+      ringmaps[i] = pglMapBufferRange(GL_PIXEL_UNPACK_BUFFER_ARB, 0, size, flags);
+      pglBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+
+      if(!ringids[i] || !ringmaps[i])
+      {
+         deletePBO();
+         return false;
+      }
+   }
+
+   ringnext = 0;
+   return true;
+}
+
+//
+// Upload new contents through the next PBO in the ring. The GPU is never
+// waited on; if it is still reading that PBO from RB_NUMSTREAMPBOS updates
+// ago, returns false so that an ordinary update is done instead.
+//
+bool rbTexture::updateRing(void *data)
+{
+   const int slot = ringnext;
+
+   if(ringfences[slot])
+   {
+      GLsync fence = static_cast<GLsync>(ringfences[slot]);
+
+      if(pglClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+         return false;
+
+      pglDeleteSync(fence);
+      ringfences[slot] = nullptr;
+   }
+
+   std::memcpy(ringmaps[slot], data, dataSize());
+
+   pglBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, ringids[slot]);
+   glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, 
+                   RB_glTexForTCR(this->colorMode), GL_UNSIGNED_BYTE, 0);
+   pglBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+
+   ringfences[slot] = pglFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+   ringnext = (slot + 1) % RB_NUMSTREAMPBOS;
+   return true;
+}
+
 //
 // Upload new contents to an existing texture.
 //
@@ -430,6 +719,11 @@ void rbTexture::update(void *data)
 
    bind(false);
 
+   rbStats.uploadBytes += dataSize();
+
+   if(ringids[0] && updateRing(data))
+      return;
+
    void *src = data;
 
    if(use_arb_pbo && pboid)
@@ -437,10 +731,10 @@ void rbTexture::update(void *data)
       // streaming textures should update to PBO
       GLvoid *ptr;
       pglBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, pboid);
-      pglBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, width*height*4, 0, GL_STREAM_DRAW_ARB);
+      pglBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, dataSize(), 0, GL_STREAM_DRAW_ARB);
       if((ptr = pglMapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB)))
       {
-         std::memcpy(ptr, src, width*height*4);
+         std::memcpy(ptr, src, dataSize());
          dirtypbo = true;
          pglUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
       }
@@ -462,6 +756,32 @@ void rbTexture::update(void *data)
    }
 }
 
+//
+// Upload new contents to part of an existing texture. Not for streaming
+// textures, whose PBO always holds the whole image.
+//
+void rbTexture::updateRect(void *data, unsigned int x, unsigned int y, unsigned int w, unsigned int h)
+{
+   if(this->texid == 0)
+      return;
+
+   bind(false);
+
+   rbStats.uploadBytes += w * h * pixelSize();
+
+   glTexSubImage2D(
+      GL_TEXTURE_2D,
+      0,
+      x,
+      y,
+      w,
+      h,
+      RB_glTexForTCR(this->colorMode),
+      GL_UNSIGNED_BYTE,
+      data
+   );
+}
+
 //
 // Populate an rbTexture instance with data from the framebuffer.
 //
@@ -489,6 +809,9 @@ void rbTexture::fromFrameBuffer()
       this->width  = usw;
       this->height = ush;
    }
+   // immutable storage can't be respecified by the copy
+   if(this->immutable)
+      deleteTexture();
    if(!this->texid)
       glGenTextures(1, &this->texid);
    
@@ -498,51 +821,5 @@ void rbTexture::fromFrameBuffer()
    setTexParameters();
 }
 
-// CALICO_TODO: screenshot routine
-#if 0
-//
-// Write out the texture as a PNG file.
-//
-bool rbTexture::writePNG(const char *filename)
-{
-   GLint width, height, intfmt;
-   GLint numbytes = 0;
-   rbbyte *pixels;
-   bool res;
-
-   if(this->texid == 0)
-      return false;
-
-   bind();
-   glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPONENTS, &intfmt);
-   glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH,      &width);
-   glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT,     &height);
-
-   switch(intfmt)
-   {
-   case GL_RGB8:
-      numbytes = width * height * 3;
-      break;
-   case GL_RGBA8:
-      numbytes = width * height * 4;
-      break;
-   default: // not supported for PNG write
-      return false;
-   }
-
-   if(!numbytes)
-      return false;
-
-   pixels = emalloc(rbbyte, numbytes);
-   glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-
-   res = WritePNGFile(filename, reinterpret_cast<uint32_t *>(pixels), width, height);
-
-   efree(pixels);
-
-   return res;
-}
-#endif
-
 // EOF
 
@@ -34,6 +34,9 @@
 
 unsigned int RB_MakeTextureDimension(unsigned int i);
 
+// persistently mapped PBOs each streaming texture cycles through
+#define RB_NUMSTREAMPBOS 3
+
 //
 // Texture class
 //
@@ -60,7 +63,8 @@ public:
    typedef enum {
       TCR_RGB     = 0,
       TCR_RGBA,
-      TCR_BGRA
+      TCR_BGRA,
+      TCR_LUMALPHA  // two bytes per texel, such as 16-bit CRY
    } texColorMode_t;
 
 protected:
@@ -75,8 +79,19 @@ protected:
    bool            streaming;
    dtexture        pboid;
    bool            dirtypbo;
+   bool            immutable; // storage from glTexStorage2D
+
+   // buffer storage ring, used for streaming textures when available
+   dtexture        ringids[RB_NUMSTREAMPBOS];
+   void           *ringmaps[RB_NUMSTREAMPBOS];
+   void           *ringfences[RB_NUMSTREAMPBOS];
+   int             ringnext;
 
    void deletePBO();
+   unsigned int pixelSize() const;
+   unsigned int dataSize() const;
+   bool createRing();
+   bool updateRing(void *data);
 
 public:
    rbTexture();
@@ -84,7 +99,7 @@ public:
    ~rbTexture();
 
    void init(texColorMode_t colorMode, unsigned int w, unsigned int h);
-   void initStreaming(unsigned int w, unsigned int h);
+   void initStreaming(texColorMode_t colorMode, unsigned int w, unsigned int h);
    void setTexParameters();
    void changeTexParameters(texClampMode_t clamp, texFilterMode_t filter);
    void bind(bool forDraw = true);
@@ -92,13 +107,9 @@ public:
    void abandonTexture();
    void upload(void *data, texClampMode_t clamp, texFilterMode_t filter);
    void update(void *data);
+   void updateRect(void *data, unsigned int x, unsigned int y, unsigned int w, unsigned int h);
    void fromFrameBuffer();
 
-   // CALICO_TODO: screenshot function
-#if 0
-   bool writePNG(const char *filename);
-#endif
-
    static void Unbind();
 
    unsigned int    getWidth()      const { return width;      }
@@ -109,6 +120,8 @@ public:
    dtexture        getTextureID()  const { return texid;      }
 };
 
+bool RB_SetRenderTarget(rbTexture *tex);
+
 extern bool rb_linear_filtering;
 
 #endif
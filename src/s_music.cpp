@@ -0,0 +1,775 @@
+/*
+  CALICO
+
+  Music sequencer
+
+  Plays music lumps with the instrument patches, replacing the sequencer
+  which ran on the Jaguar's DSP. Songs are read as a stream of MIDI events
+  (delta time, then a channel or meta message), optionally inside a
+  standard MThd/MTrk wrapper; the percussion patches map onto the General
+  MIDI drum notes. The sequencer runs inside the mixer callback: events are
+  applied on the exact output frame they fall on, and a fixed voice count
+  and event limit per buffer keep its cost bounded.
+
+  The MIT License (MIT)
+
+  Copyright (c) 2017 James Haley
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <atomic>
+
+#include "elib/elib.h"
+#include "elib/binary.h"
+#include "elib/compare.h"
+#include "hal/hal_sfx.h"
+
+#include "s_music.h"
+
+//=============================================================================
+//
+// Instrument Patches
+//
+
+// patches 0-127 are melodic programs; 128 and up are percussion by note
+#define NUMPATCHES 256
+#define PERCPATCH  128
+
+// bits of the info field in the patch header (see sound.h)
+#define PATCH_PERCUSSION 1
+#define PATCH_LOOPING    2
+
+// native rate of the 8-bit patch data, as for sound effects
+#define PATCHRATE 11025
+
+// original size of binary sfx_t structure (see soundst.h)
+#define PATCHHEADERSIZE 28
+
+struct muspatch_t
+{
+   const byte   *data;      // 8-bit unsigned PCM, in the WAD
+   unsigned int  samples;   // number of samples
+   unsigned int  loopstart; // loop points, if looping
+   unsigned int  loopend;
+   unsigned int  info;      // PATCH_* flags
+   int           unity;     // note which plays at the native rate
+};
+
+// written by S_MusicSetPatch before any song starts; read-only afterward
+static muspatch_t patches[NUMPATCHES];
+
+//=============================================================================
+//
+// Sequencer State
+//
+// Everything from here to the request queue belongs to the audio callback.
+//
+
+// voices which can sound at once; matches the original music_channels
+#define MUSVOICES 10
+
+#define MIDICHANNELS  16
+#define PERCCHANNEL   9
+
+// most events applied in one buffer; the rest wait for the next
+#define MAXEVENTSPERBUFFER 256
+
+// time for a released note to fade out, in seconds
+#define RELEASETIME 0.02f
+
+// MIDI defaults
+#define DEFAULTDIVISION 96
+#define DEFAULTTEMPO    500000 // microseconds per quarter note
+
+struct musvoice_t
+{
+   const muspatch_t *patch;   // null if free
+   int               channel; // MIDI channel
+   int               note;
+   int               velocity;
+   uint64_t          pos;     // 32.32 position in the patch
+   uint64_t          step;    // 32.32 step per output frame
+   float             env;     // envelope, 1 until released
+   bool              released;
+   unsigned int      age;     // for stealing the oldest voice
+};
+
+struct muschannel_t
+{
+   int program;
+   int volume;    // 0-127
+   int pan;       // 0-127, 64 is center
+   int pitchbend; // -8192 to 8191
+};
+
+struct musstate_t
+{
+   const byte  *data;      // lump
+   const byte  *trackstart;
+   const byte  *trackend;
+   const byte  *rover;
+   bool         loop;
+   bool         playing;
+   int          running;   // running status byte
+   unsigned int division;  // ticks per quarter note
+   double       framespertick;
+   double       eventframe; // frame of the next event
+   uint64_t     frame;      // current output frame
+   unsigned int voiceage;
+
+   muschannel_t channels[MIDICHANNELS];
+   musvoice_t   voices[MUSVOICES];
+};
+
+static musstate_t mus;
+
+// output sample rate, fetched once at init
+static int musrate = 44100;
+
+// music volume, 0-255; written by the game thread
+static std::atomic<int> musvolume(128);
+
+//
+// Read a MIDI variable-length quantity.
+//
+static unsigned int S_readVarLen(const byte *&rover, const byte *end)
+{
+   unsigned int value = 0;
+
+   for(int i = 0; i < 4 && rover < end; i++)
+   {
+      byte b = *rover++;
+      value = (value << 7) | (b & 0x7f);
+      if(!(b & 0x80))
+         break;
+   }
+
+   return value;
+}
+
+//
+// Set the tempo in microseconds per quarter note.
+//
+static void S_setTempo(unsigned int tempo)
+{
+   mus.framespertick = (double)tempo * musrate / (1000000.0 * mus.division);
+}
+
+//
+// Reset the channels to their MIDI defaults.
+//
+static void S_resetChannels()
+{
+   for(muschannel_t &ch : mus.channels)
+   {
+      ch.program   = 0;
+      ch.volume    = 100;
+      ch.pan       = 64;
+      ch.pitchbend = 0;
+   }
+}
+
+//
+// Work out the step through a voice's patch for its note and the channel's
+// pitch bend, which covers two semitones either way.
+//
+static void S_setVoiceStep(musvoice_t &v)
+{
+   double semitones = 0.0;
+
+   if(!(v.patch->info & PATCH_PERCUSSION))
+   {
+      semitones = v.note - v.patch->unity;
+      semitones += mus.channels[v.channel].pitchbend * (2.0 / 8192.0);
+   }
+
+   double ratio = std::pow(2.0, semitones / 12.0) * PATCHRATE / musrate;
+   v.step = (uint64_t)(ratio * 4294967296.0);
+}
+
+//
+// Start a note on a free voice, or steal one: released voices go first,
+// then the oldest.
+//
+static void S_noteOn(int channel, int note, int velocity)
+{
+   const muspatch_t *patch;
+
+   if(channel == PERCCHANNEL)
+      patch = &patches[PERCPATCH + note];
+   else
+      patch = &patches[mus.channels[channel].program];
+
+   if(!patch->data)
+      return;
+
+   musvoice_t *voice = nullptr;
+   for(musvoice_t &v : mus.voices)
+   {
+      if(!v.patch)
+      {
+         voice = &v;
+         break;
+      }
+      if(!voice || (v.released && !voice->released) ||
+         (v.released == voice->released && v.age < voice->age))
+         voice = &v;
+   }
+
+   voice->patch    = patch;
+   voice->channel  = channel;
+   voice->note     = note;
+   voice->velocity = velocity;
+   voice->pos      = 0;
+   voice->env      = 1.0f;
+   voice->released = false;
+   voice->age      = mus.voiceage++;
+   S_setVoiceStep(*voice);
+}
+
+//
+// Release a note. Percussion always plays out; other patches fade.
+//
+static void S_noteOff(int channel, int note)
+{
+   for(musvoice_t &v : mus.voices)
+   {
+      if(v.patch && v.channel == channel && v.note == note && !v.released &&
+         !(v.patch->info & PATCH_PERCUSSION))
+         v.released = true;
+   }
+}
+
+//
+// Release every note, or on a reset, silence them outright.
+//
+static void S_allNotesOff(int channel, bool cut)
+{
+   for(musvoice_t &v : mus.voices)
+   {
+      if(v.patch && (channel < 0 || v.channel == channel))
+      {
+         if(cut)
+            v.patch = nullptr;
+         else
+            v.released = true;
+      }
+   }
+}
+
+//
+// Go back to the start of the track.
+//
+static void S_rewindSong()
+{
+   mus.rover   = mus.trackstart;
+   mus.running = 0;
+   S_setTempo(DEFAULTTEMPO);
+   S_resetChannels();
+
+   // the track opens with the delta time of its first event
+   mus.eventframe = (double)mus.frame + S_readVarLen(mus.rover, mus.trackend) * mus.framespertick;
+}
+
+//
+// Begin playing a song lump.
+//
+static void S_beginSong(const byte *data, size_t len, bool loop)
+{
+   mus.data       = data;
+   mus.trackstart = data;
+   mus.trackend   = data + len;
+   mus.division   = DEFAULTDIVISION;
+   mus.loop       = loop;
+   mus.playing    = true;
+
+   // standard MIDI wrapper: take the division from the header and play the
+   // first track
+   if(len >= 14 && !memcmp(data, "MThd", 4))
+   {
+      const byte  *rover   = data + 8;
+      unsigned int hdrlen  = read32_be(data + 4, unsigned int);
+      unsigned int division = read16_be(rover + 4, unsigned int);
+
+      if(!(division & 0x8000) && division)
+         mus.division = division;
+
+      rover = data + 8 + hdrlen;
+      mus.trackend = mus.trackstart = nullptr;
+      while(rover + 8 <= data + len)
+      {
+         unsigned int chunklen = read32_be(rover + 4, unsigned int);
+         if(!memcmp(rover, "MTrk", 4))
+         {
+            mus.trackstart = rover + 8;
+            mus.trackend   = rover + 8 + emin<size_t>(chunklen, size_t(data + len - (rover + 8)));
+            break;
+         }
+         if(chunklen > size_t(data + len - (rover + 8)))
+            break;
+         rover += 8 + chunklen;
+      }
+
+      if(!mus.trackstart)
+      {
+         mus.playing = false;
+         return;
+      }
+   }
+
+   S_allNotesOff(-1, true);
+   S_rewindSong();
+}
+
+//
+// Reached the end of the track: start over or stop.
+//
+static void S_endOfTrack()
+{
+   S_allNotesOff(-1, false);
+
+   if(mus.loop)
+      S_rewindSong();
+   else
+      mus.playing = false;
+}
+
+//
+// Apply the event at the rover, then read the delta time to the next one.
+//
+static void S_runEvent()
+{
+   const byte *end = mus.trackend;
+   int status, channel;
+
+   if(mus.rover >= end)
+   {
+      S_endOfTrack();
+      return;
+   }
+
+   status = *mus.rover;
+   if(status & 0x80)
+      ++mus.rover;
+   else if(mus.running)
+      status = mus.running; // running status
+   else
+   {
+      S_endOfTrack(); // not a MIDI stream
+      return;
+   }
+
+   // data bytes may run off the end of a broken lump; read them as zero
+   auto next = [&]() -> int { return mus.rover < end ? *mus.rover++ & 0x7f : 0; };
+
+   channel = status & 0x0f;
+
+   switch(status & 0xf0)
+   {
+   case 0x80:
+      {
+         int note = next();
+         next();
+         S_noteOff(channel, note);
+      }
+      break;
+   case 0x90:
+      {
+         int note = next(), velocity = next();
+         if(velocity)
+            S_noteOn(channel, note, velocity);
+         else
+            S_noteOff(channel, note);
+      }
+      break;
+   case 0xa0:
+      next();
+      next();
+      break;
+   case 0xb0:
+      {
+         int controller = next(), value = next();
+         switch(controller)
+         {
+         case 7:
+            mus.channels[channel].volume = value;
+            break;
+         case 10:
+            mus.channels[channel].pan = value;
+            break;
+         case 120: // all sound off
+            S_allNotesOff(channel, true);
+            break;
+         case 121: // reset controllers
+            mus.channels[channel].volume    = 100;
+            mus.channels[channel].pan       = 64;
+            mus.channels[channel].pitchbend = 0;
+            break;
+         case 123: // all notes off
+            S_allNotesOff(channel, false);
+            break;
+         }
+      }
+      break;
+   case 0xc0:
+      mus.channels[channel].program = next();
+      break;
+   case 0xd0:
+      next();
+      break;
+   case 0xe0:
+      {
+         int lsb = next(), msb = next();
+         mus.channels[channel].pitchbend = ((msb << 7) | lsb) - 8192;
+         for(musvoice_t &v : mus.voices)
+         {
+            if(v.patch && v.channel == channel)
+               S_setVoiceStep(v);
+         }
+      }
+      break;
+   default: // system messages
+      if(status == 0xff)
+      {
+         int          type = mus.rover < end ? *mus.rover++ : 0x2f;
+         unsigned int len  = S_readVarLen(mus.rover, end);
+
+         if(len > size_t(end - mus.rover))
+            len = unsigned(end - mus.rover);
+
+         if(type == 0x2f) // end of track
+         {
+            S_endOfTrack();
+            return;
+         }
+         if(type == 0x51 && len == 3) // tempo
+            S_setTempo((mus.rover[0] << 16) | (mus.rover[1] << 8) | mus.rover[2]);
+
+         mus.rover += len;
+      }
+      else if(status == 0xf0 || status == 0xf7) // sysex
+      {
+         unsigned int len = S_readVarLen(mus.rover, end);
+         mus.rover += emin<size_t>(len, size_t(end - mus.rover));
+      }
+      break;
+   }
+
+   if(status < 0xf0)
+      mus.running = status;
+
+   mus.eventframe += S_readVarLen(mus.rover, end) * mus.framespertick;
+}
+
+//
+// Mix the active voices into count frames of the stereo buffer.
+//
+static void S_renderVoices(float *out, int count, float master)
+{
+   const float releasestep = 1.0f / (RELEASETIME * musrate);
+
+   for(musvoice_t &v : mus.voices)
+   {
+      if(!v.patch)
+         continue;
+
+      const muspatch_t   *patch = v.patch;
+      const muschannel_t &ch    = mus.channels[v.channel];
+
+      float gain  = master * (v.velocity / 127.0f) * (ch.volume / 127.0f) * (1.0f / 128.0f);
+      float lgain = gain * emin(1.0f, (127 - ch.pan) / 63.0f);
+      float rgain = gain * emin(1.0f, ch.pan / 64.0f);
+
+      bool         looping = (patch->info & PATCH_LOOPING) && patch->loopend > patch->loopstart;
+      uint64_t     loopend = uint64_t(patch->loopend) << 32;
+      uint64_t     looplen = uint64_t(patch->loopend - patch->loopstart) << 32;
+      uint64_t     last    = uint64_t(patch->samples - 1) << 32;
+      float       *dest    = out;
+
+      for(int i = 0; i < count; i++, dest += 2)
+      {
+         if(looping)
+         {
+            while(v.pos >= loopend)
+               v.pos -= looplen;
+         }
+         else if(v.pos >= last)
+         {
+            v.patch = nullptr;
+            break;
+         }
+
+         unsigned int idx  = unsigned(v.pos >> 32);
+         float        frac = (v.pos & 0xffffffffu) * (1.0f / 4294967296.0f);
+         float        s0   = float(patch->data[idx]) - 128.0f;
+         float        s1   = float(patch->data[emin(idx + 1, patch->samples - 1)]) - 128.0f;
+         float        s    = (s0 + (s1 - s0) * frac) * v.env;
+
+         dest[0] += s * lgain;
+         dest[1] += s * rgain;
+
+         v.pos += v.step;
+
+         if(v.released && (v.env -= releasestep) <= 0.0f)
+         {
+            v.patch = nullptr;
+            break;
+         }
+      }
+   }
+}
+
+//=============================================================================
+//
+// Request Queue
+//
+// The game thread hands songs to the audio callback through a small
+// single-producer/single-consumer ring, as the mixer does for sound effects.
+//
+
+enum musreqtype_t
+{
+   MUSREQ_START,
+   MUSREQ_STOP
+};
+
+struct musrequest_t
+{
+   musreqtype_t  type;
+   const byte   *data;
+   size_t        len;
+   bool          loop;
+};
+
+// must be a power of two
+#define REQRINGSIZE 8
+
+static musrequest_t              reqring[REQRINGSIZE];
+static std::atomic<unsigned int> reqhead;   // written by the game thread
+static std::atomic<unsigned int> reqtail;   // written by the audio callback
+static std::atomic<bool>         songheld;  // audio callback holds a song lump
+
+//
+// Apply pending requests. Called only from the audio callback.
+//
+static void S_runRequests()
+{
+   unsigned int tail = reqtail.load(std::memory_order_relaxed);
+   unsigned int head = reqhead.load(std::memory_order_acquire);
+
+   if(tail == head)
+      return;
+
+   for(; tail != head; tail++)
+   {
+      const musrequest_t &req = reqring[tail & (REQRINGSIZE - 1)];
+
+      if(req.type == MUSREQ_START)
+         S_beginSong(req.data, req.len, req.loop);
+      else
+      {
+         S_allNotesOff(-1, false);
+         mus.playing = false;
+         mus.data    = nullptr;
+      }
+   }
+
+   // voices only point at patches, so the lump is free once nothing plays it
+   if(!mus.playing)
+      mus.data = nullptr;
+
+   songheld.store(mus.data != nullptr, std::memory_order_relaxed);
+   reqtail.store(tail, std::memory_order_release);
+}
+
+//
+// Post a request to the audio callback. Returns false if the ring is full.
+//
+static bool S_postRequest(const musrequest_t &req)
+{
+   unsigned int head = reqhead.load(std::memory_order_relaxed);
+
+   if(head - reqtail.load(std::memory_order_acquire) >= REQRINGSIZE)
+      return false;
+
+   reqring[head & (REQRINGSIZE - 1)] = req;
+   reqhead.store(head + 1, std::memory_order_release);
+   return true;
+}
+
+//=============================================================================
+//
+// Rendering
+//
+
+//
+// Count the voices still sounding.
+//
+static int S_countVoices()
+{
+   int count = 0;
+
+   for(const musvoice_t &v : mus.voices)
+   {
+      if(v.patch)
+         ++count;
+   }
+
+   return count;
+}
+
+//
+// Renderer called by the mixer with each buffer of interleaved stereo.
+// Returns the number of voices left sounding.
+//
+static int S_renderMusic(float *buffer, int frames)
+{
+   S_runRequests();
+
+   if(!mus.playing)
+   {
+      // let released notes finish fading after a stop
+      S_renderVoices(buffer, frames, musvolume.load(std::memory_order_relaxed) / 255.0f);
+      mus.frame += frames;
+      return S_countVoices();
+   }
+
+   float master = musvolume.load(std::memory_order_relaxed) / 255.0f;
+   int   events = 0;
+
+   while(frames > 0)
+   {
+      // apply everything due on this frame
+      while(mus.playing && mus.eventframe < (double)mus.frame + 1.0 && events < MAXEVENTSPERBUFFER)
+      {
+         S_runEvent();
+         ++events;
+      }
+
+      // render up to the next event or the end of the buffer
+      int count = frames;
+      if(mus.playing && events < MAXEVENTSPERBUFFER)
+      {
+         double until = std::ceil(mus.eventframe - (double)mus.frame);
+         if(until < count)
+            count = emax(1, int(until));
+      }
+
+      S_renderVoices(buffer, count, master);
+      buffer    += count * 2;
+      frames    -= count;
+      mus.frame += count;
+   }
+
+   return S_countVoices();
+}
+
+//=============================================================================
+//
+// External Interface
+//
+
+//
+// Hook the sequencer into the mixer.
+//
+void S_MusicInit(void)
+{
+   if(!hal_sound.isInit() || !hal_sound.setMusicRenderer)
+      return;
+
+   musrate = hal_sound.getSampleRate();
+   hal_sound.setMusicRenderer(S_renderMusic);
+}
+
+//
+// Register an instrument patch. Patches which fail the same checks as sound
+// effect samples are left silent.
+//
+void S_MusicSetPatch(int instnum, const void *data, size_t len)
+{
+   if(instnum < 0 || instnum >= NUMPATCHES || len <= PATCHHEADERSIZE)
+      return;
+
+   const byte  *rover     = static_cast<const byte *>(data);
+   unsigned int samples   = read32_be(rover +  0, unsigned int);
+   unsigned int loopstart = read32_be(rover +  4, unsigned int);
+   unsigned int loopend   = read32_be(rover +  8, unsigned int);
+
+   if(samples != len - PATCHHEADERSIZE || samples < 4)
+      return;
+
+   muspatch_t &patch = patches[instnum];
+   patch.data      = rover + PATCHHEADERSIZE;
+   patch.samples   = samples;
+   patch.info      = read32_be(rover + 12, unsigned int);
+   patch.unity     = read32_be(rover + 16, int);
+   patch.loopstart = loopstart;
+   patch.loopend   = loopend;
+
+   // only trust loop points which lie inside the sample
+   if(loopstart >= samples || loopend > samples || loopstart >= loopend)
+      patch.info &= ~PATCH_LOOPING;
+}
+
+//
+// Start playing a song. The lump must stay valid until S_MusicIdle returns
+// true after the song is stopped.
+//
+void S_MusicStart(const void *data, size_t len, int looping)
+{
+   musrequest_t req = { MUSREQ_START, static_cast<const byte *>(data), len, looping != 0 };
+
+   if(hal_sound.isInit())
+      S_postRequest(req);
+}
+
+//
+// Stop the current song, letting its notes fade out.
+//
+void S_MusicStop(void)
+{
+   musrequest_t req = { MUSREQ_STOP, nullptr, 0, false };
+
+   if(hal_sound.isInit())
+      S_postRequest(req);
+}
+
+//
+// Set the music volume, 0-255.
+//
+void S_MusicSetVolume(int volume)
+{
+   musvolume.store(volume, std::memory_order_relaxed);
+}
+
+//
+// True once the audio callback has taken every request and no longer
+// reads any song lump.
+//
+int S_MusicIdle(void)
+{
+   if(!hal_sound.isInit())
+      return 1;
+
+   return reqtail.load(std::memory_order_acquire) == reqhead.load(std::memory_order_relaxed) &&
+          !songheld.load(std::memory_order_relaxed);
+}
+
+// EOF
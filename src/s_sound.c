@@ -1,14 +1,24 @@
 /* s_sound.c */
 
-#include "hal/hal_sfx.h" // CALICO
-#include "s_soundfmt.h"  // CALICO
+#include "hal/hal_sfx.h"   // CALICO
+#include "hal/hal_timer.h" // CALICO
+#include "s_music.h"       // CALICO
+#include "s_soundfmt.h"    // CALICO
 #include "doomdef.h"
+#include "r_local.h"       // CALICO
 #include "m_argv.h"
 #include "music.h"
+#include "m_prof.h"  // CALICO
 
 #define EXTERN_BUFFER_SIZE (EXTERNALQUADS*32/2)
 
 sfxchannel_t sfxchannels[SFXCHANNELS];
+int          numsfxchannels = 4; // CALICO: set from the HAL by S_Init
+
+// CALICO: voice allocation counters, reset by S_UpdateSounds
+int sfxstolen;
+int sfxrejected;
+int sfxmerged;
 
 boolean channelschanged; // set by S_StartSound to signal update to remix speculative samples
 
@@ -42,10 +52,34 @@ int musictics = 0;
 
 #define S_abs(x) ((x) < 0 ? -(x) : (x))
 
+// CALICO: a stopped song's memory, freed once the sequencer lets go of it
+static unsigned char *music_retired;
+
 // CALICO: additional options
 boolean nosfx;
 boolean nomusic;
 
+//
+// CALICO: sounds started during a tic are queued, and given channels by
+// S_UpdateSounds once the tic is over. A sound started again from the same
+// sector before then, as when a pack of monsters sees the player at once,
+// is merged into the one already queued, which keeps its place but takes
+// the origin of whichever start was the loudest.
+//
+#define MAXQUEUEDSOUNDS 32
+
+typedef struct sfxstart_s
+{
+   mobj_t   *origin;   // only compared once it may have been removed
+   sector_t *sector;   // where origin was when started, or NULL
+   int       sound_id;
+   int       vol, sep, halvol;
+   boolean   positional;
+} sfxstart_t;
+
+static sfxstart_t sfxqueue[MAXQUEUEDSOUNDS];
+static int        numsfxqueued;
+
 /*
 ==================
 =
@@ -68,19 +102,39 @@ void S_Init(void)
    if(!nosfx || !nomusic)
       hal_sound.initSound();
 
+   // CALICO: use as many channels as the HAL provides
+   if(hal_sound.getNumChannels)
+   {
+      numsfxchannels = hal_sound.getNumChannels();
+      if(numsfxchannels > SFXCHANNELS)
+         numsfxchannels = SFXCHANNELS;
+   }
+
    // SFX
    if(!nosfx)
    {
+      // CALICO: gather the sound effects to be registered all in one
+      // batch; each is converted to the output format when first played
+      static sfxload_t loads[NUMSFX];
+      static int       loadsfx[NUMSFX];
+      int              numloads = 0;
+
       for(i = 1; i < NUMSFX ; i++)
       {
          l = W_CheckNumForName(S_sfx[i].name);
          if(l != -1)
          {
             S_sfx[i].md_data = W_POINTLUMPNUM(l);
-            // CALICO: convert to output format
-            S_sfx[i].sample  = SfxSample_LoadFromData(S_sfx[i].name, W_POINTLUMPNUM(l), W_LumpLength(l));
+            loads[numloads].tag  = S_sfx[i].name;
+            loads[numloads].data = W_POINTLUMPNUM(l);
+            loads[numloads].len  = W_LumpLength(l);
+            loadsfx[numloads++]  = i;
          }
       }
+
+      SfxSample_LoadMany(loads, numloads);
+      for(i = 0; i < numloads; i++)
+         S_sfx[loadsfx[i]].sample = loads[i].sample;
    }
 
    // MUSIC
@@ -97,9 +151,12 @@ void S_Init(void)
              + (lumpinfo[lump].name[3]-'0')
              + (lumpinfo[lump].name[0] == 'P' ? 128 : 0);
          instruments[instnum] = (sfx_t *)(W_POINTLUMPNUM(lump)); // CALICO: endianness
-         // CALICO-TODO: also load as SfxSample
+         S_MusicSetPatch(instnum, W_POINTLUMPNUM(lump), W_LumpLength(lump)); // CALICO
          lump++;
       }
+
+      // CALICO: play music through the mixer
+      S_MusicInit();
  
       // hack test
 
@@ -129,6 +186,7 @@ void S_Clear(void)
    // CALICO
    for(i = 0; i < SFXCHANNELS; i++)
       sfxchannels[i].handle = -1;
+   numsfxqueued = 0;
 
    hal_sound.stopAllChannels();
 }
@@ -137,6 +195,18 @@ void S_RestartSounds(void)
 {
 }
 
+//
+// CALICO: convert a sound effect to the output format ahead of its first
+// S_StartSound
+//
+void S_PrefetchSound(int sound_id)
+{
+   if(nosfx || sound_id <= 0 || sound_id >= NUMSFX || !S_sfx[sound_id].sample)
+      return;
+
+   SfxSample_GetSamples(S_sfx[sound_id].sample);
+}
+
 /*
 ==================
 =
@@ -145,19 +215,51 @@ void S_RestartSounds(void)
 ==================
 */
 
+// CALICO: largest stereo separation either side of center
+#define S_STEREO_SWING (96*FRACUNIT)
+
+//
+// CALICO: work out the volume (0-127) and stereo separation (0-255, 128 is
+// center) of a sound at origin for the console player. Returns false if it
+// is too far away to hear.
+//
+static boolean S_Spatialize(mobj_t *origin, int *vol, int *sep)
+{
+   player_t *player = &players[consoleplayer];
+   int       dist_approx;
+   int       dx, dy;
+   angle_t   angle;
+
+   if(!origin || origin == player->mo)
+   {
+      *vol = 127;
+      *sep = 128;
+      return true;
+   }
+
+   dx = S_abs(origin->x - player->mo->x);
+   dy = S_abs(origin->y - player->mo->y);
+   dist_approx = dx + dy - ((dx < dy ? dx : dy) >> 1);
+   *vol = dist_approx >> 20;
+   if(*vol > 127)
+      return false;        // too far away
+   *vol = 127 - *vol;
+
+   angle = R_PointToAngle2(player->mo->x, player->mo->y, origin->x, origin->y) - player->mo->angle;
+   *sep = 128 - (FixedMul(S_STEREO_SWING, finesine[angle >> ANGLETOFINESHIFT]) >> FRACBITS);
+   return true;
+}
+
 void S_StartSound(mobj_t *origin, int sound_id)
 {
-   sfxchannel_t *channel, *newchannel;
-   int        i;
-   int        dist_approx;
-   player_t  *player;
-   int        dx, dy;
-   short      vol;
-   sfxinfo_t *sfx;
-   float     *sampledata; // CALICO
-   size_t     samplelen;  // CALICO
-
-   if(nosfx) // CALICO
+   sfxstart_t *start;
+   sector_t   *sector;
+   int         i;
+   int         halvol;     // CALICO
+   int         vol, sep;   // CALICO
+   player_t   *player;
+
+   if(nosfx || demoseeking) // CALICO: nothing is heard while -seek runs
       return;
 
    //
@@ -165,30 +267,79 @@ void S_StartSound(mobj_t *origin, int sound_id)
    //
    player = &players[consoleplayer];
 
-   if(!origin || origin == player->mo)
-      vol = 127;
-   else
+   if(!S_Spatialize(origin, &vol, &sep))
    {
-      dx = S_abs(origin->x - player->mo->x);
-      dy = S_abs(origin->y - player->mo->y);
-      dist_approx = dx + dy - ((dx < dy ? dx : dy) >> 1);
-      vol = dist_approx >> 20;
-      if(vol > 127)
-         return;        // too far away
-      vol = 127 - vol;
+      ++sfxrejected; // CALICO
+      return;        // too far away
    }
 
-   // Get sound effect data pointer
-   sfx = &S_sfx[sound_id];
+   // CALICO: reject sounds that would mix at zero volume before they take
+   // a channel from anything
+   halvol = vol * sfxvolume / 255;
+   if(halvol <= 0)
+   {
+      ++sfxrejected;
+      return;
+   }
 
    // CALICO: check for valid sample
-   if(!sfx->sample)
+   if(!S_sfx[sound_id].sample)
       return;
 
+   W_TouchWorkingSet(WS_SOUND, sound_id); // CALICO
+
+   // CALICO: merge with the same sound already queued from this sector
+   sector = (origin && origin->subsector) ? origin->subsector->sector : NULL;
+   for(start = sfxqueue, i = 0; i < numsfxqueued; i++, start++)
+   {
+      if(start->sound_id == sound_id && start->sector == sector)
+         break;
+   }
+
+   if(i < numsfxqueued)
+   {
+      ++sfxmerged;
+      if(halvol <= start->halvol)
+         return;
+   }
+   else
+   {
+      // a full queue can only come from something starting sounds in a
+      // loop; what it has already is heard
+      if(numsfxqueued == MAXQUEUEDSOUNDS)
+      {
+         ++sfxrejected;
+         return;
+      }
+      start = &sfxqueue[numsfxqueued++];
+      start->sound_id = sound_id;
+      start->sector   = sector;
+   }
+
+   start->origin     = origin;
+   start->vol        = vol;
+   start->sep        = sep;
+   start->halvol     = halvol;
+   start->positional = (origin && origin != player->mo);
+}
+
+//
+// CALICO: give a queued sound a channel and start it, as S_StartSound did
+// straight away before sounds were queued
+//
+static void S_StartQueued(const sfxstart_t *start)
+{
+   sfxchannel_t *channel, *newchannel;
+   mobj_t       *origin = start->origin;
+   sfxinfo_t    *sfx    = &S_sfx[start->sound_id];
+   float        *sampledata;
+   size_t        samplelen;
+   int           i;
+
    newchannel = NULL;
 
    // reject sounds started at the same instant and singular sounds
-   for(channel = sfxchannels, i = 0; i < SFXCHANNELS; i++, channel++)
+   for(channel = sfxchannels, i = 0; i < numsfxchannels; i++, channel++)
    {
       if(channel->sfx == sfx)
       {
@@ -222,21 +373,31 @@ void S_StartSound(mobj_t *origin, int sound_id)
 
    // if there weren't any dead channels, try to kill an equal or lower
    // priority channel
+   // CALICO: steal the lowest priority one, and of those the quietest, which
+   // is the farthest away
 
    if(!newchannel)
    {
-      for(channel = sfxchannels, i = 0; i < SFXCHANNELS; i++, channel++)
+      for(channel = sfxchannels, i = 0; i < numsfxchannels; i++, channel++)
       {
-         if(channel->sfx->priority >= sfx->priority)
+         if(channel->sfx->priority < sfx->priority)
+            continue;
+         if(!newchannel || channel->sfx->priority > newchannel->sfx->priority ||
+            (channel->sfx->priority == newchannel->sfx->priority &&
+             channel->volume < newchannel->volume))
          {
-            hal_sound.stopSound(channel->handle);
             newchannel = channel;
-            break;
          }
       }
 
       if(!newchannel)
+      {
+         ++sfxrejected; // CALICO
          return;        // couldn't override a channel
+      }
+
+      hal_sound.stopSound(newchannel->handle);
+      ++sfxstolen; // CALICO
    }
 
    //
@@ -247,12 +408,99 @@ void S_StartSound(mobj_t *origin, int sound_id)
    newchannel->startquad = finalquad;
    newchannel->stopquad  = finalquad + (sfx->md_data->samples / 4);
    newchannel->source    = (int *)&sfx->md_data->data;
-   newchannel->volume    = vol * (short)sfxvolume;
+   newchannel->volume    = start->vol * (short)sfxvolume;
 
    // CALICO: start sound through HAL
    sampledata = SfxSample_GetSamples(sfx->sample);
    samplelen  = SfxSample_GetNumSamples(sfx->sample);
-   newchannel->handle = hal_sound.startSound(sampledata, samplelen, newchannel->volume / 255, HAL_FALSE);
+   newchannel->handle = hal_sound.startSound(sampledata, samplelen, start->halvol, HAL_FALSE);
+
+   // CALICO: set stereo separation, and track moving sources each tic
+   newchannel->halvol     = start->halvol;
+   newchannel->sep        = start->sep;
+   newchannel->positional = start->positional;
+   if(newchannel->handle >= 0 && hal_sound.setSoundParams)
+      hal_sound.setSoundParams(newchannel->handle, start->halvol, start->sep);
+}
+
+//
+// CALICO: start everything queued this tic, in the order it was first
+// queued, and pass it all to the mixer together
+//
+static void S_FlushSounds(void)
+{
+   int i;
+
+   if(!numsfxqueued)
+      return;
+
+   if(hal_sound.batchCommands)
+      hal_sound.batchCommands(HAL_TRUE);
+
+   for(i = 0; i < numsfxqueued; i++)
+      S_StartQueued(&sfxqueue[i]);
+   numsfxqueued = 0;
+
+   if(hal_sound.batchCommands)
+      hal_sound.batchCommands(HAL_FALSE);
+}
+
+//
+// CALICO: stop tracking a source which is being removed. Its sounds carry
+// on where they were last heard.
+//
+void S_RemoveOrigin(mobj_t *origin)
+{
+   sfxchannel_t *channel;
+   int           i;
+
+   for(channel = sfxchannels, i = 0; i < numsfxchannels; i++, channel++)
+   {
+      if(channel->origin == origin)
+         channel->positional = false;
+   }
+
+   for(i = 0; i < numsfxqueued; i++)
+   {
+      if(sfxqueue[i].origin == origin)
+         sfxqueue[i].positional = false;
+   }
+}
+
+//
+// CALICO: move the sounds of every tracked source in one pass, sending the
+// HAL only the volumes and separations which changed.
+//
+static void S_UpdatePositions(void)
+{
+   sfxchannel_t *channel;
+   int           i, vol, sep, halvol;
+
+   if(!hal_sound.setSoundParams)
+      return;
+
+   for(channel = sfxchannels, i = 0; i < numsfxchannels; i++, channel++)
+   {
+      if(!channel->positional || channel->handle < 0)
+         continue;
+
+      if(!hal_sound.isSamplePlaying(channel->handle))
+      {
+         channel->positional = false;
+         continue;
+      }
+
+      if(!S_Spatialize(channel->origin, &vol, &sep))
+         vol = 0;
+      halvol = vol * sfxvolume / 255;
+
+      if(halvol != channel->halvol || sep != channel->sep)
+      {
+         hal_sound.setSoundParams(channel->handle, halvol, sep);
+         channel->halvol = halvol;
+         channel->sep    = sep;
+      }
+   }
 }
 
 /*
@@ -268,6 +516,39 @@ extern int music_dspcode;
 
 void S_UpdateSounds(void)
 {
+   // CALICO: pass on the music volume and free any stopped song
+   S_MusicSetVolume(musicvolume);
+   if(music_retired && S_MusicIdle())
+   {
+      Z_Free(music_retired);
+      music_retired = NULL;
+   }
+
+   // CALICO: record and reset the voice allocation counters
+   M_ProfCount(PROF_SFXSTOLEN,   sfxstolen);
+   M_ProfCount(PROF_SFXREJECTED, sfxrejected);
+   M_ProfCount(PROF_SFXMERGED,   sfxmerged);
+   sfxstolen = sfxrejected = sfxmerged = 0;
+
+   // CALICO: and the output timing
+   if(profiling && hal_sound.getStats)
+   {
+      hal_soundstats_t stats;
+
+      hal_sound.getStats(&stats);
+      if(stats.callbackInterval)
+         M_ProfCount(PROF_AUDIOPERIOD, stats.callbackInterval);
+      M_ProfCount(PROF_UNDERRUNS, stats.underruns);
+      if(stats.startLatency)
+         M_ProfCount(PROF_SFXLATENCY, stats.startLatency);
+      if(stats.dspLoadPeak || stats.dspLoadAvg)
+      {
+         M_ProfCount(PROF_DSPPEAK, stats.dspLoadPeak);
+         M_ProfCount(PROF_DSPLOAD, stats.dspLoadAvg);
+      }
+      M_ProfCount(PROF_VOICES, stats.voicesPeak);
+   }
+
    //
    // if sound was just turned off, clear out the buffer
    //
@@ -290,6 +571,9 @@ void S_UpdateSounds(void)
       oldsfxvolume = sfxvolume;
    }
 
+   S_FlushSounds();     // CALICO
+   S_UpdatePositions(); // CALICO
+
    // CALICO_TODO: non-portable
 #if 0
    int st;
@@ -327,6 +611,10 @@ void S_StartSong(int music_id, int looping)
    if(nomusic) // CALICO
       return;
 
+   // CALICO: don't leak a song which is still playing
+   if(music_memory)
+      S_StopSong();
+
    musictime = 0;
    samples_per_midiclock = 0;
    lump = W_GetNumForName(S_music[music_id].name);
@@ -334,6 +622,8 @@ void S_StartSong(int music_id, int looping)
    music_start  = looping ? music : 0;
    music_end    = (unsigned char *)music + BIGLONG(lumpinfo[lump].size); // CALICO: endianness
 
+   // CALICO: hand the song to the sequencer
+   S_MusicStart(music, music_end - music, looping);
 }
 
 void S_StopSong(void)
@@ -341,7 +631,20 @@ void S_StopSong(void)
    if(nomusic) // CALICO
       return;
 
-   Z_Free(music_memory);
+   // CALICO: the sequencer may still be reading the song, so its memory
+   // is only freed once it has stopped
+   if(!music_memory)
+      return;
+
+   S_MusicStop();
+   if(music_retired)
+   {
+      while(!S_MusicIdle())
+         hal_timer.delay(1);
+      Z_Free(music_retired);
+   }
+   music_retired = music_memory;
+   music_memory  = 0;
    music = 0; // prevent the DSP from running
    
    // CALICO: Jag-specific.
@@ -26,35 +26,77 @@
   SOFTWARE.
 */
 
+#include <math.h>
 #include "elib/elib.h"
 #include "elib/binary.h"
 #include "elib/compare.h"
+#include "elib/configfile.h"
+#include "elib/dllist.h"
 #include "gl/resource.h"
 #include "hal/hal_sfx.h"
+#include "hal/hal_timer.h"
 
 #include "s_soundfmt.h"
 
+// budget for converted sample data in kilobytes; 0 for no limit
+static int s_samplecache = 4096;
+static cfgrange_t<int> sampleCacheRange = { 0, 1024*1024 };
+static CfgItem cfgSSampleCache("s_samplecache", &s_samplecache, &sampleCacheRange);
+
+// rate conversion: 0 = linear interpolation, 1 = band-limited polyphase
+static int s_resampler = 1;
+static cfgrange_t<int> resamplerRange = { 0, 1 };
+static CfgItem cfgSResampler("s_resampler", &s_resampler, &resamplerRange);
+
 //=============================================================================
 //
 // SfxSample class
 //
+// Samples keep a pointer to their native 8-bit data in the WAD and are only
+// converted to floating point at the output rate when first played. This
+// is the only rate conversion sound effects go through, so the mixer always
+// plays them at a unit step. The converted data is held in a cache which is
+// trimmed least-recently-played first once it goes over s_samplecache.
+//
 
 class SfxSample : public Resource
 {
 protected:
-   size_t m_numsamples;                 // length of sample array
-   std::unique_ptr<float []> m_samples; // sample data
+   const byte   *m_native;               // native 8-bit unsigned PCM
+   size_t        m_numnative;            // length of native data
+   unsigned int  m_samplerate;           // native sample rate
+   size_t        m_numsamples;           // length of converted sample array
+   std::unique_ptr<float []> m_samples;  // converted data, if cached
+   unsigned int  m_lastplay;             // time of last play in ms
+   DLListItem<SfxSample> m_cachelinks;   // links in the cache while converted
+
+   static DLListItem<SfxSample> *CacheHead;
+   static size_t                 CacheBytes;
+
+   void convert();
 
 public:
-   SfxSample(const char *tag, size_t numsamples, float *data)
-      : Resource(tag), m_numsamples(numsamples), m_samples(data)
+   SfxSample(const char *tag, const byte *native, size_t numnative,
+             unsigned int samplerate, size_t numsamples)
+      : Resource(tag), m_native(native), m_numnative(numnative),
+        m_samplerate(samplerate), m_numsamples(numsamples), m_samples(),
+        m_lastplay(0), m_cachelinks()
    {
    }
 
-   size_t  getNumSamples() const { return m_numsamples;    }
-   float  *getSamples()    const { return m_samples.get(); }
+   virtual ~SfxSample() { evict(); }
+
+   size_t getNumSamples() const { return m_numsamples; }
+   float *getSamples();
+   void   evict();
+
+   static void   TrimCache(size_t needed);
+   static size_t GetCacheBytes() { return CacheBytes; }
 };
 
+DLListItem<SfxSample> *SfxSample::CacheHead;
+size_t                 SfxSample::CacheBytes;
+
 //=============================================================================
 //
 // Sample Manager
@@ -137,39 +179,151 @@ static size_t S_alenForSample(const sounddata_t &sd, int targetsamplerate)
    return (size_t)(((uint64_t)sd.samplecount * targetsamplerate) / sd.samplerate);
 }
 
+static inline float S_sampleU8(byte b)
+{
+   return static_cast<float>(eclamp(b * 2.0 / 255.0 - 1.0, -1.0, 1.0));
+}
+
 //
-// Convert unsigned 8-bit PCM to floating point.
+// Linear interpolation between neighbouring source samples.
 //
-static void S_convertPCMU8(sounddata_t &sd, int targetsamplerate)
+static void S_resampleLinear(sounddata_t &sd, int targetsamplerate)
 {
-   sd.alen = S_alenForSample(sd, targetsamplerate);
-   sd.data = new float [sd.alen];
+   size_t i;
+   float *dest = sd.data;
+   byte  *src  = sd.samplestart;
 
-   if(sd.alen != sd.samplecount)
+   unsigned int step = (sd.samplerate << 16) / targetsamplerate;
+   unsigned int stepremainder = 0, j = 0;
+
+   // do linear filtering operation
+   for(i = 0; i < sd.alen && j < sd.samplecount - 1; i++)
    {
-      size_t i;
-      float *dest = sd.data;
-      byte  *src  = sd.samplestart;
+      double d = (((unsigned int)src[j  ] * (0x10000 - stepremainder)) +
+         ((unsigned int)src[j+1] * stepremainder));
+      d /= 65536.0;
+      dest[i] = static_cast<float>(eclamp(d * 2.0 / 255.0 - 1.0, -1.0, 1.0));
+
+      stepremainder += step;
+      j += (stepremainder >> 16);
+
+      stepremainder &= 0xffff;
+   }
+   // fill remainder (if any) with final sample byte
+   for(; i < sd.alen; i++)
+      dest[i] = S_sampleU8(src[j]);
+}
+
+//
+// Polyphase filter bank: a Blackman-windowed sinc low-passed below the
+// lower of the two Nyquist frequencies, tabulated at SRC_PHASES fractional
+// positions between source samples. Each output sample takes the phase
+// nearest its true position, so conversion is SRC_TAPS multiply-adds.
+//
+
+#define SRC_TAPS   16  // filter taps per output sample
+#define SRC_PHASES 256 // fractional positions between source samples
+
+static std::unique_ptr<float []> srcFilter;
+static unsigned int srcFilterFrom, srcFilterTo;
 
-      unsigned int step = (sd.samplerate << 16) / targetsamplerate;
-      unsigned int stepremainder = 0, j = 0;
+static const float *S_polyphaseFilter(unsigned int from, unsigned int to)
+{
+   if(srcFilter && srcFilterFrom == from && srcFilterTo == to)
+      return srcFilter.get();
+
+   const double pi     = 3.14159265358979323846;
+   const double cutoff = 0.9 * emin(1.0, double(to) / from);
 
-      // do linear filtering operation
-      for(i = 0; i < sd.alen && j < sd.samplecount - 1; i++)
+   srcFilter.reset(new float [SRC_PHASES * SRC_TAPS]);
+   srcFilterFrom = from;
+   srcFilterTo   = to;
+
+   for(int phase = 0; phase < SRC_PHASES; phase++)
+   {
+      float *row = srcFilter.get() + phase * SRC_TAPS;
+      double sum = 0.0;
+
+      for(int k = 0; k < SRC_TAPS; k++)
       {
-         double d = (((unsigned int)src[j  ] * (0x10000 - stepremainder)) +
-            ((unsigned int)src[j+1] * stepremainder));
-         d /= 65536.0;
-         dest[i] = static_cast<float>(eclamp(d * 2.0 / 255.0 - 1.0, -1.0, 1.0));
+         // distance of this tap from the output position, in source samples
+         double t = (k - SRC_TAPS/2 + 1) - double(phase) / SRC_PHASES;
+         double u = t / (SRC_TAPS/2);
+         double x = pi * cutoff * t;
+         double h = (x == 0.0) ? cutoff : cutoff * sin(x) / x;
+         double w = (fabs(u) >= 1.0) ? 0.0 : 0.42 + 0.5 * cos(pi * u) + 0.08 * cos(2.0 * pi * u);
+
+         row[k] = float(h * w);
+         sum   += row[k];
+      }
+
+      // unity gain at DC for every phase
+      for(int k = 0; k < SRC_TAPS; k++)
+         row[k] = float(row[k] / sum);
+   }
+
+   return srcFilter.get();
+}
 
-         stepremainder += step;
-         j += (stepremainder >> 16);
+//
+// Band-limited conversion through the polyphase filter bank. Taps falling
+// off either end of the sample read silence.
+//
+static void S_resamplePolyphase(sounddata_t &sd, int targetsamplerate)
+{
+   const unsigned int to     = unsigned(targetsamplerate);
+   const float       *filter = S_polyphaseFilter(sd.samplerate, to);
+   const byte        *src    = sd.samplestart;
+   std::unique_ptr<float []> in(new float [sd.samplecount + SRC_TAPS]);
+
+   // float copy of the source padded with SRC_TAPS/2 silent samples before
+   // and after, so the filter never needs a bounds check
+   float *pad = in.get() + SRC_TAPS/2;
+   for(int k = 0; k < SRC_TAPS/2; k++)
+      pad[-SRC_TAPS/2 + k] = pad[sd.samplecount + k] = 0.0f;
+   for(size_t j = 0; j < sd.samplecount; j++)
+      pad[j] = S_sampleU8(src[j]);
+
+   for(size_t i = 0; i < sd.alen; i++)
+   {
+      // exact source position of this output sample
+      uint64_t     pos   = uint64_t(i) * sd.samplerate;
+      size_t       j     = size_t(pos / to);
+      unsigned int phase = unsigned(((pos % to) * SRC_PHASES + to / 2) / to);
 
-         stepremainder &= 0xffff;
+      if(phase == SRC_PHASES)
+      {
+         ++j;
+         phase = 0;
       }
-      // fill remainder (if any) with final sample byte
-      for(; i < sd.alen; i++)
-         dest[i] = static_cast<float>(eclamp(src[j] * 2.0 / 255.0 - 1.0, -1.0, 1.0));
+      if(j >= sd.samplecount)
+         j = sd.samplecount - 1;
+
+      const float *row = filter + phase * SRC_TAPS;
+      const float *x   = pad + j - SRC_TAPS/2 + 1;
+      float        acc = 0.0f;
+
+      for(int k = 0; k < SRC_TAPS; k++)
+         acc += x[k] * row[k];
+
+      sd.data[i] = eclamp(acc, -1.0f, 1.0f);
+   }
+}
+
+//
+// Convert unsigned 8-bit PCM to floating point at the target rate.
+//
+static void S_convertPCMU8(sounddata_t &sd, int targetsamplerate)
+{
+   sd.alen = S_alenForSample(sd, targetsamplerate);
+   sd.data = new float [sd.alen];
+
+   if(sd.alen != sd.samplecount)
+   {
+      if(s_resampler)
+         S_resamplePolyphase(sd, targetsamplerate);
+      else
+         S_resampleLinear(sd, targetsamplerate);
    }
    else
    {
@@ -178,30 +332,98 @@ static void S_convertPCMU8(sounddata_t &sd, int targetsamplerate)
       byte  *src  = sd.samplestart;
 
       for(size_t i = 0; i < sd.alen; i++)
-         dest[i] = static_cast<float>(eclamp(src[i] * 2.0 / 255.0 - 1.0, -1.0, 1.0));
+         dest[i] = S_sampleU8(src[i]);
    }
 }
 
+//=============================================================================
+//
+// Sample Cache
+//
+
 //
-// Internal conversion routine
+// Convert the native data into the cache, making room for it first.
 //
-static bool S_LoadFromDataInt(sounddata_t &sd, byte *data, size_t len)
+void SfxSample::convert()
 {
-   // check format
-   if(!S_isJaguarSample(data, len, sd))
-      return false;
+   edefstructvar(sounddata_t, sd);
+   size_t bytes = m_numsamples * sizeof(float);
+
+   TrimCache(bytes);
 
-   // load based on returned sample format
-   switch(sd.fmt)
+   sd.samplerate  = m_samplerate;
+   sd.samplecount = m_numnative;
+   sd.samplestart = const_cast<byte *>(m_native);
+   sd.fmt         = S_FMT_U8;
+   S_convertPCMU8(sd, hal_sound.getSampleRate());
+
+   m_samples.reset(sd.data);
+   m_numsamples = sd.alen;
+   m_cachelinks.insert(this, &CacheHead);
+   CacheBytes += bytes;
+}
+
+//
+// Get the converted sample data, converting it now if it isn't cached.
+// Marks the sample as just played.
+//
+float *SfxSample::getSamples()
+{
+   if(!m_samples)
+      convert();
+
+   m_lastplay = hal_timer.getTimeMS();
+   return m_samples.get();
+}
+
+//
+// Drop the converted data, if any.
+//
+void SfxSample::evict()
+{
+   if(!m_samples)
+      return;
+
+   CacheBytes -= m_numsamples * sizeof(float);
+   m_samples.reset();
+   m_cachelinks.remove();
+}
+
+//
+// Evict least recently played samples until there is room for needed more
+// bytes. Sound effects don't loop, so a sample whose full length has passed
+// since it was last played can't still be in use by the mixer; anything
+// more recent is left alone, and the cache runs over budget instead.
+//
+void SfxSample::TrimCache(size_t needed)
+{
+   if(!s_samplecache)
+      return;
+
+   const size_t       limit = size_t(s_samplecache) * 1024;
+   const unsigned int now   = hal_timer.getTimeMS();
+   const unsigned int rate  = unsigned(hal_sound.getSampleRate());
+
+   while(CacheHead && CacheBytes + needed > limit)
    {
-   case S_FMT_U8:
-      S_convertPCMU8(sd, hal_sound.getSampleRate());
-      break;
-   default: // unsupported PCM format
-      return false;
-   }
+      SfxSample *victim = nullptr;
 
-   return true;
+      for(DLListItem<SfxSample> *item = CacheHead; item; item = item->dllNext)
+      {
+         SfxSample   *sfx    = item->dllObject;
+         unsigned int length = unsigned(uint64_t(sfx->m_numsamples) * 1000 / rate) + 100;
+
+         if(now - sfx->m_lastplay <= length)
+            continue; // may still be playing
+         if(!victim || now - sfx->m_lastplay > now - victim->m_lastplay)
+            victim = sfx;
+      }
+
+      if(!victim)
+         break;
+
+      victim->evict();
+   }
 }
 
 //=============================================================================
@@ -209,6 +431,17 @@ static bool S_LoadFromDataInt(sounddata_t &sd, byte *data, size_t len)
 // External Interface
 //
 
+//
+// Create a sample for data which passed S_isJaguarSample.
+//
+static SfxSample *S_newSample(const char *tag, const sounddata_t &sd)
+{
+   SfxSample *sfx = new SfxSample(tag, sd.samplestart, sd.samplecount, sd.samplerate,
+                                  S_alenForSample(sd, hal_sound.getSampleRate()));
+   gSoundManager.addResource(sfx);
+   return sfx;
+}
+
 PSFXSAMPLE SfxSample_LoadFromData(const char *tag, void *data, size_t len)
 {
    SfxSample *ret = nullptr;
@@ -217,16 +450,23 @@ PSFXSAMPLE SfxSample_LoadFromData(const char *tag, void *data, size_t len)
    {
       edefstructvar(sounddata_t, sd);
 
-      if(S_LoadFromDataInt(sd, static_cast<byte *>(data), len))
-      {
-         ret = new SfxSample(tag, sd.alen, sd.data);
-         gSoundManager.addResource(ret);
-      }
+      if(S_isJaguarSample(static_cast<byte *>(data), len, sd) && sd.fmt == S_FMT_U8)
+         ret = S_newSample(tag, sd);
    }
 
    return ret;
 }
 
+//
+// Load a batch of samples at once. Only the formats are checked here; the
+// conversion of each sample waits until it is first played.
+//
+void SfxSample_LoadMany(sfxload_t *loads, int count)
+{
+   for(int i = 0; i < count; i++)
+      loads[i].sample = SfxSample_LoadFromData(loads[i].tag, loads[i].data, loads[i].len);
+}
+
 PSFXSAMPLE SfxSample_FindByTag(const char *tag)
 {
    return gSoundManager.findResourceType<SfxSample>(tag);
@@ -237,10 +477,14 @@ size_t SfxSample_GetNumSamples(PCSFXSAMPLE sfx)
    return sfx->getNumSamples();
 }
 
-float *SfxSample_GetSamples(PCSFXSAMPLE sfx)
+float *SfxSample_GetSamples(PSFXSAMPLE sfx)
 {
    return sfx->getSamples();
 }
 
-// EOF
+size_t SfxSample_GetCacheBytes(void)
+{
+   return SfxSample::GetCacheBytes();
+}
 
+// EOF
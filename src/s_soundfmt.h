@@ -41,14 +41,25 @@ typedef struct SfxSample const *PCSFXSAMPLE;
 
 #endif
 
+// one sample for SfxSample_LoadMany
+typedef struct sfxload_s
+{
+   const char *tag;
+   void       *data;
+   size_t      len;
+   PSFXSAMPLE  sample; // set by the load, or null if data is not a sample
+} sfxload_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 PSFXSAMPLE SfxSample_LoadFromData(const char *tag, void *data, size_t len);
+void       SfxSample_LoadMany(sfxload_t *loads, int count);
 PSFXSAMPLE SfxSample_FindByTag(const char *tag);
 size_t     SfxSample_GetNumSamples(PCSFXSAMPLE sfx);
-float     *SfxSample_GetSamples(PCSFXSAMPLE sfx);
+float     *SfxSample_GetSamples(PSFXSAMPLE sfx); // converts on first use
+size_t     SfxSample_GetCacheBytes(void);        // converted samples held
 
 #ifdef __cplusplus
 }
@@ -32,12 +32,16 @@
 #include "../hal/hal_types.h"
 #include "../hal/hal_input.h"
 #include "../hal/hal_ml.h"
+#include "../hal/hal_net.h"
 #include "../hal/hal_sfx.h"
+#include "../hal/hal_thread.h"
 #include "../hal/hal_timer.h"
 #include "../hal/hal_video.h"
 #include "sdl_init.h"
 #include "sdl_input.h"
+#include "sdl_net.h"
 #include "sdl_sound.h"
+#include "sdl_thread.h"
 #include "sdl_timer.h"
 #include "sdl_video.h"
 
@@ -47,11 +51,12 @@
 void SDL2_InitHAL(void)
 {
    // Basic interface
-   hal_medialayer.init      = SDL2_Init;
-   hal_medialayer.exit      = SDL2_Exit;
-   hal_medialayer.error     = SDL2_Error;
-   hal_medialayer.msgbox    = SDL2_MsgBox;
-   hal_medialayer.isExiting = SDL2_IsExiting;
+   hal_medialayer.init           = SDL2_Init;
+   hal_medialayer.exit           = SDL2_Exit;
+   hal_medialayer.error          = SDL2_Error;
+   hal_medialayer.msgbox         = SDL2_MsgBox;
+   hal_medialayer.isExiting      = SDL2_IsExiting;
+   hal_medialayer.getCPUFeatures = SDL2_GetCPUFeatures;
 
    // Video functions
    hal_video.initVideo            = SDL2_InitVideo;
@@ -65,6 +70,7 @@ void SDL2_InitHAL(void)
    hal_video.transformHeight      = SDL2_TransformHeight;
    hal_video.toggleGLSwap         = SDL2_ToggleGLSwap;
    hal_video.endFrame             = SDL2_EndFrame;
+   hal_video.getPresentInterval   = SDL2_GetPresentInterval;
    hal_video.isFullScreen         = SDL2_IsFullScreen;
    hal_video.getCurrentDisplay    = SDL2_GetCurrentDisplay;
    hal_video.getWindowFlags       = SDL2_GetWindowFlags;
@@ -79,6 +85,7 @@ void SDL2_InitHAL(void)
    hal_appstate.updateGrab           = SDL2_UpdateGrab;
    hal_appstate.updateFocus          = SDL2_UpdateFocus;
    hal_appstate.setGrabState         = SDL2_SetGrabState;
+   hal_appstate.getBackgroundState   = SDL2_GetBackgroundState;
 
    // Input
    hal_input.initInput     = SDL2_InitInput;
@@ -86,20 +93,53 @@ void SDL2_InitHAL(void)
    hal_input.resetInput    = SDL2_ResetInput;
 
    // Sound
-   hal_sound.initSound       = SDL2Sfx_MixerInit;
-   hal_sound.isInit          = SDL2Sfx_IsInit;
-   hal_sound.startSound      = SDL2Sfx_StartSound;
-   hal_sound.stopSound       = SDL2Sfx_StopSound;
-   hal_sound.isSamplePlaying = SDL2Sfx_IsSamplePlaying;
-   hal_sound.isSampleAtStart = SDL2Sfx_IsSampleAtStart;
-   hal_sound.stopAllChannels = SDL2Sfx_StopAllChannels;
-   hal_sound.updateEQParams  = SDL2Sfx_UpdateEQParams;
-   hal_sound.getSampleRate   = SDL2Sfx_GetSampleRate;
+   hal_sound.initSound        = SDL2Sfx_MixerInit;
+   hal_sound.isInit           = SDL2Sfx_IsInit;
+   hal_sound.startSound       = SDL2Sfx_StartSound;
+   hal_sound.stopSound        = SDL2Sfx_StopSound;
+   hal_sound.setSoundParams   = SDL2Sfx_SetSoundParams;
+   hal_sound.isSamplePlaying  = SDL2Sfx_IsSamplePlaying;
+   hal_sound.isSampleAtStart  = SDL2Sfx_IsSampleAtStart;
+   hal_sound.stopAllChannels  = SDL2Sfx_StopAllChannels;
+   hal_sound.updateEQParams   = SDL2Sfx_UpdateEQParams;
+   hal_sound.getSampleRate    = SDL2Sfx_GetSampleRate;
+   hal_sound.getNumChannels   = SDL2Sfx_GetNumChannels;
+   hal_sound.setMusicRenderer = SDL2Sfx_SetMusicRenderer;
+   hal_sound.getStats         = SDL2Sfx_GetStats;
+   hal_sound.holdLoops        = SDL2Sfx_HoldLoops;
+   hal_sound.batchCommands    = SDL2Sfx_BatchCommands;
 
    // Timer
-   hal_timer.delay     = SDL2_Delay;
-   hal_timer.getTime   = SDL2_GetTime;
-   hal_timer.getTimeMS = SDL2_GetTimeMS;
+   hal_timer.delay        = SDL2_Delay;
+   hal_timer.getTime      = SDL2_GetTime;
+   hal_timer.getTimeMS    = SDL2_GetTimeMS;
+   hal_timer.getTimeUS    = SDL2_GetTimeUS;
+   hal_timer.getTimeNS    = SDL2_GetTimeNS;
+   hal_timer.sleepUntilNS = SDL2_SleepUntilNS;
+
+   // Threads
+   hal_threads.createThread     = SDL2_CreateThread;
+   hal_threads.waitThread       = SDL2_WaitThread;
+   hal_threads.createSemaphore  = SDL2_CreateSemaphore;
+   hal_threads.destroySemaphore = SDL2_DestroySemaphore;
+   hal_threads.semPost          = SDL2_SemPost;
+   hal_threads.semWait          = SDL2_SemWait;
+   hal_threads.getCPUCount      = SDL2_GetCPUCount;
+
+   // Network
+   hal_net.open        = SDL2_NetOpen;
+   hal_net.close       = SDL2_NetClose;
+   hal_net.send        = SDL2_NetSend;
+   hal_net.receive     = SDL2_NetReceive;
+   hal_net.sendTo      = SDL2_NetSendTo;
+   hal_net.receiveFrom = SDL2_NetReceiveFrom;
+
+   hal_net.listenStream  = SDL2_NetListenStream;
+   hal_net.acceptStream  = SDL2_NetAcceptStream;
+   hal_net.sendStream    = SDL2_NetSendStream;
+   hal_net.closeStreams  = SDL2_NetCloseStreams;
+   hal_net.connectStream = SDL2_NetConnectStream;
+   hal_net.receiveStream = SDL2_NetReceiveStream;
 }
 
 #endif
@@ -32,6 +32,7 @@
 #ifdef USE_SDL2
 
 void SDL2_InitHAL(void);
+void SDL2_InitHeadlessHAL(void);
 
 #endif
 
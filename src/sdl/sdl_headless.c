@@ -0,0 +1,290 @@
+/*
+  CALICO
+  
+  SDL 2 headless operation
+  
+  With -headless, the SDL 2 HAL runs with only its timer and threads. Video,
+  input, and sound are replaced with stubs, so the game can run without a
+  window, GPU, or audio device, such as on a build server playing back demos.
+  
+  The MIT License (MIT)
+  
+  Copyright (c) 2016 James Haley
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifdef USE_SDL2
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "SDL.h"
+#include "../hal/hal_types.h"
+#include "../hal/hal_input.h"
+#include "../hal/hal_ml.h"
+#include "../hal/hal_sfx.h"
+#include "../hal/hal_video.h"
+#include "sdl_hal.h"
+#include "sdl_init.h"
+
+//=============================================================================
+//
+// Media layer
+//
+
+//
+// Initialize only the parts of SDL 2 which need no devices
+//
+static hal_bool SDL2_InitHeadless(void)
+{
+   SDL2_CountAllocations();
+   if(SDL_Init(SDL_INIT_TIMER) != 0)
+      return HAL_FALSE;
+
+   atexit(SDL_Quit);
+   return HAL_TRUE;
+}
+
+//
+// There is no one to show a message box to, so write it out instead
+//
+static int SDL2_HeadlessMsgBox(const char *title, const char *msg, hal_bool isError)
+{
+   fprintf(isError ? stderr : stdout, "%s: %s\n", title, msg);
+   return 0;
+}
+
+//=============================================================================
+//
+// Video
+//
+
+static void SDL2_HeadlessVoid(void)
+{
+}
+
+static hal_bool SDL2_HeadlessSetNewVideoMode(int w, int h, int fs, int mnum)
+{
+   return HAL_TRUE;
+}
+
+static void *SDL2_HeadlessGetGLProcAddress(const char *proc)
+{
+   return NULL;
+}
+
+static void SDL2_HeadlessGetWindowSize(int *width, int *height)
+{
+   *width  = CALICO_ORIG_SCREENWIDTH;
+   *height = CALICO_ORIG_SCREENHEIGHT;
+}
+
+static void SDL2_HeadlessTransformCoord2i(int x, int y, int *tx, int *ty)
+{
+   *tx = x;
+   *ty = y;
+}
+
+static void SDL2_HeadlessTransformCoord2f(int x, int y, float *tx, float *ty)
+{
+   *tx = (float)x;
+   *ty = (float)y;
+}
+
+static unsigned int SDL2_HeadlessTransformSize(unsigned int s)
+{
+   return s;
+}
+
+static int SDL2_HeadlessToggleGLSwap(hal_bool swap)
+{
+   return 0;
+}
+
+static unsigned int SDL2_HeadlessGetZero(void)
+{
+   return 0;
+}
+
+static int SDL2_HeadlessGetIntZero(void)
+{
+   return 0;
+}
+
+static void SDL2_HeadlessSetGrab(hal_bool grab)
+{
+}
+
+static void SDL2_HeadlessWarpMouse(int x, int y)
+{
+}
+
+static void *SDL2_HeadlessGetWindowHandle(void)
+{
+   return NULL;
+}
+
+static hal_aspect_t SDL2_HeadlessGetAspectRatioType(void)
+{
+   return HAL_ASPECT_NOMINAL;
+}
+
+static void SDL2_HeadlessGetSubscreenExtents(int *x, int *y, int *w, int *h)
+{
+   *x = *y = 0;
+   *w = CALICO_ORIG_SCREENWIDTH;
+   *h = CALICO_ORIG_SCREENHEIGHT;
+}
+
+//=============================================================================
+//
+// Input and app state
+//
+
+static hal_bool SDL2_HeadlessFalse(void)
+{
+   return HAL_FALSE;
+}
+
+static int SDL2_HeadlessGetEvents(void)
+{
+   return 0;
+}
+
+//=============================================================================
+//
+// Sound
+//
+
+static int SDL2_HeadlessStartSound(float *data, size_t numsamples, int volume, hal_bool loop)
+{
+   return -1;
+}
+
+static void SDL2_HeadlessStopSound(int handle)
+{
+}
+
+static void SDL2_HeadlessSetSoundParams(int handle, int volume, int separation)
+{
+}
+
+static hal_bool SDL2_HeadlessSampleState(int handle)
+{
+   return HAL_FALSE;
+}
+
+static int SDL2_HeadlessGetSampleRate(void)
+{
+   return 44100; // sounds are still converted, and never played
+}
+
+static void SDL2_HeadlessSetMusicRenderer(hal_musicrender_t renderer)
+{
+}
+
+static void SDL2_HeadlessHoldLoops(hal_bool hold)
+{
+}
+
+static void SDL2_HeadlessBatchCommands(hal_bool begin)
+{
+}
+
+static void SDL2_HeadlessGetSoundStats(hal_soundstats_t *stats)
+{
+   stats->callbackInterval = 0;
+   stats->underruns        = 0;
+   stats->startLatency     = 0;
+   stats->dspLoadPeak      = 0;
+   stats->dspLoadAvg       = 0;
+   stats->voicesPeak       = 0;
+}
+
+//=============================================================================
+//
+// Main Interface
+//
+
+//
+// Replace the devices of the SDL 2 HAL with stubs. Call after SDL2_InitHAL
+// and before hal_medialayer.init.
+//
+void SDL2_InitHeadlessHAL(void)
+{
+   // Basic interface
+   hal_medialayer.init   = SDL2_InitHeadless;
+   hal_medialayer.msgbox = SDL2_HeadlessMsgBox;
+
+   // Video functions
+   hal_video.initVideo            = SDL2_HeadlessVoid;
+   hal_video.setNewVideoMode      = SDL2_HeadlessSetNewVideoMode;
+   hal_video.getWindowSize        = SDL2_HeadlessGetWindowSize;
+   hal_video.getGLProcAddress     = SDL2_HeadlessGetGLProcAddress;
+   hal_video.transformFBCoord     = SDL2_HeadlessTransformCoord2i;
+   hal_video.transformGameCoord2i = SDL2_HeadlessTransformCoord2i;
+   hal_video.transformGameCoord2f = SDL2_HeadlessTransformCoord2f;
+   hal_video.transformWidth       = SDL2_HeadlessTransformSize;
+   hal_video.transformHeight      = SDL2_HeadlessTransformSize;
+   hal_video.toggleGLSwap         = SDL2_HeadlessToggleGLSwap;
+   hal_video.endFrame             = SDL2_HeadlessVoid;
+   hal_video.getPresentInterval   = SDL2_HeadlessGetZero;
+   hal_video.isFullScreen         = SDL2_HeadlessGetIntZero;
+   hal_video.getCurrentDisplay    = SDL2_HeadlessGetIntZero;
+   hal_video.getWindowFlags       = SDL2_HeadlessGetZero;
+   hal_video.setGrab              = SDL2_HeadlessSetGrab;
+   hal_video.warpMouse            = SDL2_HeadlessWarpMouse;
+   hal_video.getWindowHandle      = SDL2_HeadlessGetWindowHandle;
+   hal_video.getAspectRatioType   = SDL2_HeadlessGetAspectRatioType;
+   hal_video.getSubscreenExtents  = SDL2_HeadlessGetSubscreenExtents;
+
+   // App state maintenance
+   hal_appstate.mouseShouldBeGrabbed = SDL2_HeadlessFalse;
+   hal_appstate.updateGrab           = SDL2_HeadlessVoid;
+   hal_appstate.updateFocus          = SDL2_HeadlessVoid;
+   hal_appstate.setGrabState         = SDL2_HeadlessSetGrab;
+   hal_appstate.getBackgroundState   = SDL2_HeadlessGetIntZero;
+
+   // Input
+   hal_input.initInput  = SDL2_HeadlessVoid;
+   hal_input.getEvents  = SDL2_HeadlessGetEvents;
+   hal_input.resetInput = SDL2_HeadlessVoid;
+
+   // Sound
+   hal_sound.initSound        = SDL2_HeadlessFalse;
+   hal_sound.isInit           = SDL2_HeadlessFalse;
+   hal_sound.startSound       = SDL2_HeadlessStartSound;
+   hal_sound.stopSound        = SDL2_HeadlessStopSound;
+   hal_sound.setSoundParams   = SDL2_HeadlessSetSoundParams;
+   hal_sound.isSamplePlaying  = SDL2_HeadlessSampleState;
+   hal_sound.isSampleAtStart  = SDL2_HeadlessSampleState;
+   hal_sound.stopAllChannels  = SDL2_HeadlessVoid;
+   hal_sound.updateEQParams   = SDL2_HeadlessVoid;
+   hal_sound.getSampleRate    = SDL2_HeadlessGetSampleRate;
+   hal_sound.getNumChannels   = SDL2_HeadlessGetIntZero;
+   hal_sound.setMusicRenderer = SDL2_HeadlessSetMusicRenderer;
+   hal_sound.getStats         = SDL2_HeadlessGetSoundStats;
+   hal_sound.holdLoops        = SDL2_HeadlessHoldLoops;
+   hal_sound.batchCommands    = SDL2_HeadlessBatchCommands;
+}
+
+#endif
+
+// EOF
+
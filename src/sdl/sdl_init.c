@@ -33,15 +33,69 @@
 #include "../elib/atexit.h"
 #include "../hal/hal_ml.h"
 #include "../hal/hal_video.h"
+#include "../m_alloc.h"
+#include "../sdl/sdl_init.h"
 #include "../sdl/sdl_video.h"
 
 static hal_bool isExiting;
 
+#if SDL_VERSION_ATLEAST(2, 0, 7)
+//
+// SDL's own allocations, counted with the engine's
+//
+static void *SDLCALL SDL2_Malloc(size_t size)
+{
+   unsigned int start = M_AllocBegin();
+   void *ptr = malloc(size);
+
+   M_AllocEnd(ALLOC_SDL, size, start);
+   return ptr;
+}
+
+static void *SDLCALL SDL2_Calloc(size_t count, size_t size)
+{
+   unsigned int start = M_AllocBegin();
+   void *ptr = calloc(count, size);
+
+   M_AllocEnd(ALLOC_SDL, count * size, start);
+   return ptr;
+}
+
+static void *SDLCALL SDL2_Realloc(void *ptr, size_t size)
+{
+   unsigned int start = M_AllocBegin();
+
+   ptr = realloc(ptr, size);
+   M_AllocEnd(ALLOC_SDL, size, start);
+   return ptr;
+}
+
+static void SDLCALL SDL2_Free(void *ptr)
+{
+   unsigned int start = M_AllocBegin();
+
+   free(ptr);
+   M_FreeEnd(ALLOC_SDL, start);
+}
+#endif
+
+//
+// Send SDL's allocations through the counters. Must be done before SDL
+// allocates anything.
+//
+void SDL2_CountAllocations(void)
+{
+#if SDL_VERSION_ATLEAST(2, 0, 7)
+   SDL_SetMemoryFunctions(SDL2_Malloc, SDL2_Calloc, SDL2_Realloc, SDL2_Free);
+#endif
+}
+
 //
 // Initialize the SDL 2 library
 //
 hal_bool SDL2_Init(void)
 {
+   SDL2_CountAllocations();
    if(SDL_Init(SDL_INIT_EVERYTHING) != 0)
       return HAL_FALSE;
 
@@ -96,6 +150,25 @@ hal_bool SDL2_IsExiting(void)
    return isExiting;
 }
 
+//
+// Return the set of HAL_CPU_* instruction set extensions available on the host
+//
+unsigned int SDL2_GetCPUFeatures(void)
+{
+   unsigned int features = 0;
+
+   if(SDL_HasSSE2())
+      features |= HAL_CPU_SSE2;
+   if(SDL_HasAVX2())
+      features |= HAL_CPU_AVX2;
+#if SDL_VERSION_ATLEAST(2, 0, 6)
+   if(SDL_HasNEON())
+      features |= HAL_CPU_NEON;
+#endif
+
+   return features;
+}
+
 #endif
 
 // EOF
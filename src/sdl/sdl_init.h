@@ -33,11 +33,13 @@
 
 #include "../hal/hal_types.h"
 
-hal_bool  SDL2_Init(void);
-void      SDL2_Exit(void);
-void      SDL2_Error(void);
-int       SDL2_MsgBox(const char *title, const char *msg, hal_bool isError);
-hal_bool  SDL2_IsExiting(void);
+void         SDL2_CountAllocations(void);
+hal_bool     SDL2_Init(void);
+void         SDL2_Exit(void);
+void         SDL2_Error(void);
+int          SDL2_MsgBox(const char *title, const char *msg, hal_bool isError);
+hal_bool     SDL2_IsExiting(void);
+unsigned int SDL2_GetCPUFeatures(void);
 
 #endif
 
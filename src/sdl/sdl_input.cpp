@@ -36,6 +36,8 @@
 #include "../hal/hal_ml.h"
 #include "../hal/hal_video.h"
 #include "../jagpad.h"
+#include "../rb/rb_screenshot.h"
+#include "../m_perfhud.h"
 #include "sdl_input.h"
 
 //=============================================================================
@@ -47,6 +49,12 @@ static hal_bool windowFocused;
 static hal_bool screenVisible;
 static hal_bool shouldGrabInput;
 
+// what to do without focus: 0 to carry on, 1 to draw less often, and not at
+// all while minimized, or 2 to pause
+static int background_mode = 1;
+static cfgrange_t<int> backgroundRange = { 0, 2 };
+static CfgItem cfgBackgroundMode("background_mode", &background_mode, &backgroundRange);
+
 //
 // Set application input grabbing state
 //
@@ -112,6 +120,20 @@ void SDL2_UpdateFocus(void)
    windowFocused = (hal_bool)(active && focused);
 }
 
+//
+// Get what background_mode asks for in the window's current state; the
+// state is as of the last SDL2_UpdateFocus
+//
+int SDL2_GetBackgroundState(void)
+{
+   if(windowFocused || !background_mode)
+      return HAL_BACKGROUND_NONE;
+   if(background_mode == 2)
+      return HAL_BACKGROUND_PAUSE;
+
+   return screenVisible ? HAL_BACKGROUND_THROTTLE : HAL_BACKGROUND_HIDDEN;
+}
+
 //=============================================================================
 //
 // Mouse code
@@ -206,7 +228,8 @@ static SDL_Keycode kbKeyCodes[KBJK_MAX] =
    SDLK_8,
    SDLK_9
 };
-static bool kbKeyDown[KBJK_MAX];
+static int  kbKeyDown[KBJK_MAX];    // CALICO: a bit for each key of a left/right pair
+static bool kbKeyPressed[KBJK_MAX]; // CALICO: went down since the last read
 static int kbKeyToJagButton[KBJK_MAX] =
 {
    JP_A,
@@ -254,40 +277,120 @@ static CfgItem cfgKeyName7("kb_key_7",      &kbKeyNames[KBJK_7]);
 static CfgItem cfgKeyName8("kb_key_8",      &kbKeyNames[KBJK_8]);
 static CfgItem cfgKeyName9("kb_key_9",      &kbKeyNames[KBJK_9]);
 
+// not a Jaguar button; saves a screenshot when pressed
+static char        *kbScreenshotName;
+static SDL_Keycode  kbScreenshotCode = SDLK_F12;
+
+static CfgItem cfgKeyNameShot("kb_key_screenshot", &kbScreenshotName);
+
+// nor this; shows or hides the performance HUD
+static char        *kbPerfHUDName;
+static SDL_Keycode  kbPerfHUDCode = SDLK_F11;
+
+static CfgItem cfgKeyNameHUD("kb_key_perfhud", &kbPerfHUDName);
+
 //
-// Handle key down events
+// CALICO: key events are queued with their timestamps by an event watch as
+// SDL adds them, and taken in order when the game next reads input.
+// Rebuilding the buttons from the keyboard state at each read, as was done
+// before, would miss a key pressed and released in between; now such a key
+// counts as pressed for that read.
 //
-static void SDL2_processKeyboard()
+struct kbevent_t
 {
-   const Uint8 *state = SDL_GetKeyboardState(nullptr);
-   const Uint8 *state1, *state2;
+   Uint32 timestamp;
+   int    key; // KBJK_ index
+   int    bit; // which of a left/right pair
+   bool   down;
+};
 
-   for(size_t i = 0; i < KBJK_MAX; i++)
+#define KBQUEUESIZE 256 // power of two
+
+static kbevent_t    kbQueue[KBQUEUESIZE];
+static SDL_atomic_t kbQueueHead; // advanced only by the event watch
+static SDL_atomic_t kbQueueTail; // advanced only by SDL2_processKeyboard
+
+//
+// Which key of a bound key's left/right pair sym is, as a bit, or 0 if sym
+// is not the bound key. Either Ctrl, Shift or Alt does for the other.
+//
+static int SDL2_keyBit(SDL_Keycode bound, SDL_Keycode sym)
+{
+   static const SDL_Keycode pairs[][2] =
    {
-      SDL_Scancode sc = SDL_GetScancodeFromKey(kbKeyCodes[i]);
-      if(sc == SDL_SCANCODE_LCTRL || sc == SDL_SCANCODE_RCTRL)
-      {
-         state1 = &state[SDL_SCANCODE_LCTRL];
-         state2 = &state[SDL_SCANCODE_RCTRL];
-      }
-      else if(sc == SDL_SCANCODE_LSHIFT || sc == SDL_SCANCODE_RSHIFT)
+      { SDLK_LCTRL,  SDLK_RCTRL  },
+      { SDLK_LSHIFT, SDLK_RSHIFT },
+      { SDLK_LALT,   SDLK_RALT   }
+   };
+
+   for(const auto &pair : pairs)
+   {
+      if(bound == pair[0] || bound == pair[1])
       {
-         state1 = &state[SDL_SCANCODE_LSHIFT];
-         state2 = &state[SDL_SCANCODE_RSHIFT];
+         if(sym == pair[0])
+            return 1;
+         return sym == pair[1] ? 2 : 0;
       }
-      else if(sc == SDL_SCANCODE_LALT || sc == SDL_SCANCODE_RALT)
+   }
+
+   return sym == bound ? 1 : 0;
+}
+
+//
+// Queue bound key events. Called by SDL on whichever thread adds the event.
+//
+static int SDLCALL SDL2_inputWatch(void *userdata, SDL_Event *evt)
+{
+   if((evt->type != SDL_KEYDOWN || evt->key.repeat) && evt->type != SDL_KEYUP)
+      return 1;
+
+   for(int i = 0; i < KBJK_MAX; i++)
+   {
+      int bit, head;
+
+      if(!(bit = SDL2_keyBit(kbKeyCodes[i], evt->key.keysym.sym)))
+         continue;
+
+      head = SDL_AtomicGet(&kbQueueHead);
+      if(head - SDL_AtomicGet(&kbQueueTail) >= KBQUEUESIZE)
+         break; // full; drop it rather than wait on the game
+
+      kbevent_t &ke = kbQueue[head & (KBQUEUESIZE - 1)];
+      ke.timestamp = evt->key.timestamp;
+      ke.key       = i;
+      ke.bit       = bit;
+      ke.down      = (evt->type == SDL_KEYDOWN);
+      SDL_AtomicSet(&kbQueueHead, head + 1);
+   }
+
+   return 1;
+}
+
+//
+// Apply the key events queued before until
+//
+static void SDL2_processKeyboard(Uint32 until)
+{
+   int tail = SDL_AtomicGet(&kbQueueTail);
+   int head = SDL_AtomicGet(&kbQueueHead);
+
+   for(; tail != head; tail++)
+   {
+      const kbevent_t &ke = kbQueue[tail & (KBQUEUESIZE - 1)];
+
+      if(static_cast<Sint32>(ke.timestamp - until) > 0)
+         break; // came in after this read began; leave it for the next
+
+      if(ke.down)
       {
-         state1 = &state[SDL_SCANCODE_LALT];
-         state2 = &state[SDL_SCANCODE_RALT];
+         kbKeyDown[ke.key]   |= ke.bit;
+         kbKeyPressed[ke.key] = true;
       }
       else
-      {
-         state1 = &state[sc];
-         state2 = nullptr;
-      }
-
-      kbKeyDown[i] = !!*state1 || (state2 ? !!*state2 : false);
+         kbKeyDown[ke.key] &= ~ke.bit;
    }
+
+   SDL_AtomicSet(&kbQueueTail, tail);
 }
 
 //=============================================================================
@@ -308,6 +411,18 @@ void SDL2_InitInput(void)
       else
          kbKeyCodes[i] = SDL_GetKeyFromName(kbKeyNames[i]);
    }
+
+   if(estrempty(kbScreenshotName))
+      kbScreenshotName = estrdup(SDL_GetKeyName(kbScreenshotCode));
+   else
+      kbScreenshotCode = SDL_GetKeyFromName(kbScreenshotName);
+
+   if(estrempty(kbPerfHUDName))
+      kbPerfHUDName = estrdup(SDL_GetKeyName(kbPerfHUDCode));
+   else
+      kbPerfHUDCode = SDL_GetKeyFromName(kbPerfHUDName);
+
+   SDL_AddEventWatch(SDL2_inputWatch, nullptr); // CALICO
 }
 
 //
@@ -330,6 +445,12 @@ int SDL2_GetEvents(void)
    {
       switch(evt.type)
       {
+      case SDL_KEYDOWN:
+         if(evt.key.keysym.sym == kbScreenshotCode && !evt.key.repeat)
+            RB_RequestScreenshot();
+         else if(evt.key.keysym.sym == kbPerfHUDCode && !evt.key.repeat)
+            M_TogglePerfHUD();
+         break;
       case SDL_MOUSEMOTION:
          // CALICO_TODO: mouse motion
          break;
@@ -360,16 +481,18 @@ int SDL2_GetEvents(void)
       }
    }
 
-   // process keyboard state
-   SDL2_processKeyboard();
+   // process keyboard events; SDL stamps them as it pumps, so any stamped
+   // after this were added from another thread since, and can wait
+   SDL2_processKeyboard(SDL_GetTicks());
 
    // turn input into Jaguar gamepad buttons
    int buttons = 0;
 
    for(size_t i = 0; i < KBJK_MAX; i++)
    {
-      if(kbKeyDown[i])
+      if(kbKeyDown[i] || kbKeyPressed[i])
          buttons |= kbKeyToJagButton[i];
+      kbKeyPressed[i] = false;
    }
 
    return buttons;
@@ -381,7 +504,10 @@ int SDL2_GetEvents(void)
 void SDL2_ResetInput(void)
 {
    for(size_t i = 0; i < KBJK_MAX; i++)
-      kbKeyDown[i] = false;
+   {
+      kbKeyDown[i]    = 0;
+      kbKeyPressed[i] = false;
+   }
 }
 
 #endif
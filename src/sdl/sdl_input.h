@@ -39,6 +39,7 @@ void     SDL2_SetGrabState(hal_bool state);
 hal_bool SDL2_MouseShouldBeGrabbed(void);
 void     SDL2_UpdateGrab(void);
 void     SDL2_UpdateFocus(void);
+int      SDL2_GetBackgroundState(void);
 void     SDL2_InitInput(void);
 int      SDL2_GetEvents(void);
 void     SDL2_ResetInput(void);
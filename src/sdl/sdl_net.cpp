@@ -0,0 +1,348 @@
+/*
+  CALICO
+  
+  SDL 2 Networking
+  
+  The MIT License (MIT)
+  
+  Copyright (c) 2016 James Haley
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifdef USE_SDL2
+
+#include <string.h>
+#include "SDL.h"
+#include "SDL_net.h"
+#include "../hal/hal_net.h"
+#include "sdl_net.h"
+
+#define NETPACKETSIZE 512
+
+static bool      netinit;
+static UDPsocket netsocket;
+static UDPpacket *netpacket;
+static IPaddress  netpeer;
+static bool       havepeer;
+
+#define MAXPEERS 4
+
+static IPaddress  peers[MAXPEERS]; // for a dedicated server
+static int        numpeers;
+
+static bool SDL2_NetInit(void)
+{
+   if(!netinit)
+   {
+      if(SDLNet_Init() < 0)
+         return false;
+      netinit = true;
+   }
+   return true;
+}
+
+//
+// Open a socket to host on port, or listen on port if host is NULL
+//
+hal_bool SDL2_NetOpen(const char *host, int port)
+{
+   SDL2_NetClose();
+
+   if(!SDL2_NetInit())
+      return HAL_FALSE;
+
+   havepeer = false;
+   numpeers = 0;
+   if(host)
+   {
+      if(SDLNet_ResolveHost(&netpeer, host, static_cast<Uint16>(port)) < 0)
+         return HAL_FALSE;
+      havepeer = true;
+   }
+
+   // a joining player uses any free port; the listener uses the one given
+   if(!(netsocket = SDLNet_UDP_Open(host ? 0 : static_cast<Uint16>(port))))
+      return HAL_FALSE;
+
+   if(!(netpacket = SDLNet_AllocPacket(NETPACKETSIZE)))
+   {
+      SDL2_NetClose();
+      return HAL_FALSE;
+   }
+
+   return HAL_TRUE;
+}
+
+void SDL2_NetClose(void)
+{
+   if(netpacket)
+   {
+      SDLNet_FreePacket(netpacket);
+      netpacket = nullptr;
+   }
+   if(netsocket)
+   {
+      SDLNet_UDP_Close(netsocket);
+      netsocket = nullptr;
+   }
+   havepeer = false;
+}
+
+//
+// Send one datagram to the other player
+//
+hal_bool SDL2_NetSend(const void *data, int len)
+{
+   if(!netsocket || !havepeer || len > NETPACKETSIZE)
+      return HAL_FALSE;
+
+   memcpy(netpacket->data, data, len);
+   netpacket->len     = len;
+   netpacket->address = netpeer;
+
+   return SDLNet_UDP_Send(netsocket, -1, netpacket) ? HAL_TRUE : HAL_FALSE;
+}
+
+//
+// Take the next waiting datagram, if any. A listener adopts the sender of
+// each one as its peer, so a player who rejoins from a new port is heard.
+//
+int SDL2_NetReceive(void *data, int maxlen)
+{
+   int len;
+
+   if(!netsocket || SDLNet_UDP_Recv(netsocket, netpacket) <= 0)
+      return 0;
+
+   netpeer  = netpacket->address;
+   havepeer = true;
+
+   len = netpacket->len < maxlen ? netpacket->len : maxlen;
+   memcpy(data, netpacket->data, len);
+   return len;
+}
+
+//
+// Send one datagram to a peer numbered by SDL2_NetReceiveFrom
+//
+hal_bool SDL2_NetSendTo(int peer, const void *data, int len)
+{
+   if(!netsocket || peer < 0 || peer >= numpeers || len > NETPACKETSIZE)
+      return HAL_FALSE;
+
+   memcpy(netpacket->data, data, len);
+   netpacket->len     = len;
+   netpacket->address = peers[peer];
+
+   return SDLNet_UDP_Send(netsocket, -1, netpacket) ? HAL_TRUE : HAL_FALSE;
+}
+
+//
+// Take the next waiting datagram, if any, and say which peer sent it. Each
+// new sender is given the next number, until there is no room for more.
+//
+int SDL2_NetReceiveFrom(void *data, int maxlen, int *peer)
+{
+   while(netsocket && SDLNet_UDP_Recv(netsocket, netpacket) > 0)
+   {
+      const IPaddress &addr = netpacket->address;
+      int i, len;
+
+      for(i = 0; i < numpeers; i++)
+      {
+         if(peers[i].host == addr.host && peers[i].port == addr.port)
+            break;
+      }
+      if(i == numpeers)
+      {
+         if(numpeers == MAXPEERS)
+            continue;
+         peers[numpeers++] = addr;
+      }
+
+      *peer = i;
+      len = netpacket->len < maxlen ? netpacket->len : maxlen;
+      memcpy(data, netpacket->data, len);
+      return len;
+   }
+
+   return 0;
+}
+
+//=============================================================================
+//
+// Spectator streams
+//
+
+#define MAXSTREAMS 32
+
+static TCPsocket    streamserver;
+static TCPsocket    streams[MAXSTREAMS];
+static TCPsocket    streamclient;
+static SDLNet_SocketSet streamset;
+
+//
+// Listen for spectators on port
+//
+hal_bool SDL2_NetListenStream(int port)
+{
+   IPaddress addr;
+
+   SDL2_NetCloseStreams();
+
+   if(!SDL2_NetInit())
+      return HAL_FALSE;
+   if(SDLNet_ResolveHost(&addr, nullptr, static_cast<Uint16>(port)) < 0)
+      return HAL_FALSE;
+
+   return (streamserver = SDLNet_TCP_Open(&addr)) ? HAL_TRUE : HAL_FALSE;
+}
+
+//
+// Take the next waiting spectator, if any
+//
+int SDL2_NetAcceptStream(void)
+{
+   TCPsocket sock;
+
+   if(!streamserver || !(sock = SDLNet_TCP_Accept(streamserver)))
+      return -1;
+
+   for(int i = 0; i < MAXSTREAMS; i++)
+   {
+      if(!streams[i])
+      {
+         streams[i] = sock;
+         return i;
+      }
+   }
+
+   SDLNet_TCP_Close(sock); // full
+   return -1;
+}
+
+//
+// Send to one spectator, or all of them if client is -1, dropping any whose
+// connection has gone
+//
+hal_bool SDL2_NetSendStream(int client, const void *data, int len)
+{
+   if(client == -1)
+   {
+      for(int i = 0; i < MAXSTREAMS; i++)
+      {
+         if(streams[i])
+            SDL2_NetSendStream(i, data, len);
+      }
+      return HAL_TRUE;
+   }
+
+   if(client < 0 || client >= MAXSTREAMS || !streams[client])
+      return HAL_FALSE;
+
+   if(SDLNet_TCP_Send(streams[client], data, len) < len)
+   {
+      SDLNet_TCP_Close(streams[client]);
+      streams[client] = nullptr;
+      return HAL_FALSE;
+   }
+
+   return HAL_TRUE;
+}
+
+void SDL2_NetCloseStreams(void)
+{
+   for(int i = 0; i < MAXSTREAMS; i++)
+   {
+      if(streams[i])
+      {
+         SDLNet_TCP_Close(streams[i]);
+         streams[i] = nullptr;
+      }
+   }
+   if(streamserver)
+   {
+      SDLNet_TCP_Close(streamserver);
+      streamserver = nullptr;
+   }
+   if(streamset)
+   {
+      SDLNet_FreeSocketSet(streamset);
+      streamset = nullptr;
+   }
+   if(streamclient)
+   {
+      SDLNet_TCP_Close(streamclient);
+      streamclient = nullptr;
+   }
+}
+
+//
+// Connect to a server as a spectator
+//
+hal_bool SDL2_NetConnectStream(const char *host, int port)
+{
+   IPaddress addr;
+
+   SDL2_NetCloseStreams();
+
+   if(!SDL2_NetInit())
+      return HAL_FALSE;
+   if(SDLNet_ResolveHost(&addr, host, static_cast<Uint16>(port)) < 0)
+      return HAL_FALSE;
+   if(!(streamclient = SDLNet_TCP_Open(&addr)))
+      return HAL_FALSE;
+
+   // a set is needed to read without blocking
+   if(!(streamset = SDLNet_AllocSocketSet(1)))
+   {
+      SDL2_NetCloseStreams();
+      return HAL_FALSE;
+   }
+   SDLNet_TCP_AddSocket(streamset, streamclient);
+
+   return HAL_TRUE;
+}
+
+//
+// Read whatever the server has sent, if anything
+//
+int SDL2_NetReceiveStream(void *data, int maxlen)
+{
+   int len;
+
+   if(!streamclient)
+      return -1;
+   if(SDLNet_CheckSockets(streamset, 0) <= 0 || !SDLNet_SocketReady(streamclient))
+      return 0;
+
+   if((len = SDLNet_TCP_Recv(streamclient, data, maxlen)) <= 0)
+   {
+      SDL2_NetCloseStreams();
+      return -1;
+   }
+
+   return len;
+}
+
+#endif
+
+// EOF
+
@@ -0,0 +1,63 @@
+/*
+  CALICO
+  
+  SDL 2 Networking
+  
+  The MIT License (MIT)
+  
+  Copyright (c) 2016 James Haley
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef SDL_NET_H__
+#define SDL_NET_H__
+
+#ifdef USE_SDL2
+
+#include "../hal/hal_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+hal_bool SDL2_NetOpen(const char *host, int port);
+void     SDL2_NetClose(void);
+hal_bool SDL2_NetSend(const void *data, int len);
+int      SDL2_NetReceive(void *data, int maxlen);
+hal_bool SDL2_NetSendTo(int peer, const void *data, int len);
+int      SDL2_NetReceiveFrom(void *data, int maxlen, int *peer);
+
+hal_bool SDL2_NetListenStream(int port);
+int      SDL2_NetAcceptStream(void);
+hal_bool SDL2_NetSendStream(int client, const void *data, int len);
+void     SDL2_NetCloseStreams(void);
+hal_bool SDL2_NetConnectStream(const char *host, int port);
+int      SDL2_NetReceiveStream(void *data, int maxlen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+#endif
+
+// EOF
+
@@ -3,6 +3,12 @@
   
   SDL2 Audio Implementation
   
+  Channels are mixed in blocks: the number of frames left before a channel
+  reaches the end of its sample is worked out up front, so the inner loop
+  carries no end checks, and unit-step channels use SSE2 or NEON kernels
+  when the CPU has them. SDL2Sfx_mixChannelRef is the original per-sample
+  loop and is kept as the reference; set s_simdmix to 0 to use it.
+  
   The MIT License (MIT)
   
   Copyright (c) 2017 James Haley
@@ -32,18 +38,48 @@
 #include "SDL_mixer.h"
 #include "SDL_thread.h"
 
+#include <atomic>
+
 #include "sdl_sound.h"
 
+#include "../hal/hal_ml.h"
 #include "../hal/hal_platform.h"
+#include "../hal/hal_timer.h"
 #include "../elib/elib.h"
 #include "../elib/atexit.h"
 #include "../elib/compare.h"
 #include "../elib/configfile.h"
+#include "../rb/rb_capture.h"
+#include "../m_thread.h"
+#include "../m_trace.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define CALICO_SIMD_X86
+#include <emmintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define CALICO_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(__GNUC__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#define TARGET_SSE2
+#endif
 
-// CALICO-TODO: allow more sound channels as an option?
-#define MAXCHANNELS 4
+// most sound channels that can be configured
+#define MAXCHANNELS 32
 
-// channel structure
+// channel status bits published by the audio callback
+#define CHAN_PLAYING     0x00000001
+#define CHAN_ATSTART     0x00000002
+#define CHAN_FLAGS       0x00000003
+#define CHAN_SERIALSHIFT 2
+#define CHAN_SERIALMASK  (0xffffffffu >> CHAN_SERIALSHIFT)
+
+// channel structure; owned by the audio callback except for status
 struct channelinfo_t
 {
    unsigned int  step;               // channel step amount
@@ -52,13 +88,42 @@ struct channelinfo_t
    float        *startdata;          // starting location
    float        *enddata;            // end of sample
    float         leftvol, rightvol;  // stereo volume levels
+   float         lefttarget;         // levels being ramped toward
+   float         righttarget;
    bool          loop;               // looping?
-   SDL_sem      *sem;                // semaphore
-   bool          shouldstop;         // flagged to stop by game engine
+   unsigned int  serial;             // serial of the sound being played
+   std::atomic<unsigned int> status; // serial << CHAN_SERIALSHIFT | CHAN_* flags
+};
+
+// game thread's view of each channel
+struct voiceinfo_t
+{
+   unsigned int serial;  // serial of the last sound started
+   bool         stopped; // stopped by the game engine
 };
 
 // sound channels
 static channelinfo_t channels[MAXCHANNELS];
+static voiceinfo_t   voices[MAXCHANNELS];
+
+// number of sound channels in use, fixed at initialization
+static int s_channels = 8;
+static cfgrange_t<int> channelRange = { 1, MAXCHANNELS };
+static CfgItem cfgSChannels("s_channels", &s_channels, &channelRange);
+
+static int numchannels;
+
+// output format requested from the device
+static int s_samplerate = 44100;
+static int s_buffersize = 2048; // in sample frames
+static cfgrange_t<int> sampleRateRange = { 8000, 96000 };
+static cfgrange_t<int> bufferSizeRange = { 64,   16384 };
+static CfgItem cfgSSampleRate("s_samplerate", &s_samplerate, &sampleRateRange);
+static CfgItem cfgSBufferSize("s_buffersize", &s_buffersize, &bufferSizeRange);
+
+// format actually obtained
+static int samplerate = 44100;
+static int bufferframes;
 
 // track whether or not sound was successfully initialized
 static bool sndInit;
@@ -67,38 +132,191 @@ static bool sndInit;
 static float *mixbuffer;
 static Uint32 mixbufferSize;
 
+// music sequencer, run after the channels are mixed
+static std::atomic<hal_musicrender_t> musicRenderer;
+
+// looped channels and music are held where they are while this is set
+static std::atomic<bool> loopsHeld;
+
 //=============================================================================
 //
-// Channel Management
+// Command Queue
+//
+// The game thread never touches channel state directly. Starts and stops are
+// posted to a single-producer/single-consumer ring which the audio callback
+// drains before mixing, so neither side ever takes a lock.
 //
 
+enum sndcmdtype_t
+{
+   SNDCMD_START,
+   SNDCMD_PARAMS,
+   SNDCMD_STOP,
+   SNDCMD_STOPALL
+};
+
+struct sndcmd_t
+{
+   sndcmdtype_t  type;
+   int           channel;
+   unsigned int  serial;
+   unsigned int  time;       // hal_timer.getTimeUS when posted
+   float        *data;
+   size_t        numsamples;
+   float         volume;
+   float         separation; // 0 to 1, 0.5 for center
+   bool          loop;
+};
+
+// must be a power of two
+#define CMDRINGSIZE 64
+
+static sndcmd_t                  cmdring[CMDRINGSIZE];
+static std::atomic<unsigned int> cmdhead; // written by the game thread
+static std::atomic<unsigned int> cmdtail; // written by the audio callback
+
+// while a batch is open, commands are written ahead of cmdhead to here, and
+// cmdhead only moves up to them when the batch is closed
+static unsigned int cmdpending;
+static bool         cmdbatching;
+
+// output timing, written by the audio callback and taken by SDL2Sfx_GetStats
+static std::atomic<unsigned int> statInterval;  // longest callback interval
+static std::atomic<unsigned int> statUnderruns; // late callbacks
+static std::atomic<unsigned int> statLatency;   // start of the latest sound
+static std::atomic<unsigned int> statLoadPeak;  // DSP load, in 0.1% of the period
+static std::atomic<unsigned int> statLoadSum;
+static std::atomic<unsigned int> statLoadCount;
+static std::atomic<unsigned int> statVoicesPeak;
+
 //
-// Add the effect to the already determined free channel.
+// Raise a statistic to at least value.
 //
-static bool SDL2Sfx_addSfx(float *data, size_t numsamples, int volume, bool loop, int channel)
+static void SDL2Sfx_statMax(std::atomic<unsigned int> &stat, unsigned int value)
 {
-   // critical section
-   if(SDL_SemWait(channels[channel].sem) == 0)
+   unsigned int current = stat.load(std::memory_order_relaxed);
+
+   while(value > current &&
+         !stat.compare_exchange_weak(current, value, std::memory_order_relaxed))
+      ;
+}
+
+//
+// Post a command to the audio callback. Returns false if the ring is full.
+//
+static bool SDL2Sfx_postCommand(const sndcmd_t &cmd)
+{
+   unsigned int head = cmdbatching ? cmdpending : cmdhead.load(std::memory_order_relaxed);
+
+   if(head - cmdtail.load(std::memory_order_acquire) >= CMDRINGSIZE)
+      return false;
+
+   cmdring[head & (CMDRINGSIZE - 1)] = cmd;
+   if(cmdbatching)
+      cmdpending = head + 1;
+   else
+      cmdhead.store(head + 1, std::memory_order_release);
+   return true;
+}
+
+//
+// Apply all pending commands. Called only from the audio callback.
+//
+static void SDL2Sfx_runCommands(unsigned int now)
+{
+   unsigned int tail = cmdtail.load(std::memory_order_relaxed);
+   unsigned int head = cmdhead.load(std::memory_order_acquire);
+
+   // a sound mixed now is heard once the buffer ahead of it has played out
+   unsigned int bufferus = unsigned(uint64_t(bufferframes) * 1000000 / samplerate);
+
+   for(; tail != head; tail++)
    {
-      channels[channel].data      = data;
-      channels[channel].enddata   = data + numsamples - 1;
-      channels[channel].startdata = channels[channel].data;
+      const sndcmd_t &cmd  = cmdring[tail & (CMDRINGSIZE - 1)];
+      channelinfo_t  *chan = &channels[cmd.channel];
 
-      channels[channel].stepremainder = 0;
-      channels[channel].loop = loop;
-      channels[channel].shouldstop = false;
+      switch(cmd.type)
+      {
+      case SNDCMD_START:
+         chan->data          = cmd.data;
+         chan->enddata       = cmd.data + cmd.numsamples - 1;
+         chan->startdata     = cmd.data;
+         chan->stepremainder = 0;
+         chan->step          = 1 << 16;
+         chan->loop          = cmd.loop;
+         chan->serial        = cmd.serial;
+
+         chan->leftvol  = chan->lefttarget  = cmd.volume;
+         chan->rightvol = chan->righttarget = cmd.volume;
+
+         statLatency.store(now - cmd.time + bufferus, std::memory_order_relaxed);
+         break;
+      case SNDCMD_PARAMS:
+         if(chan->serial == cmd.serial && chan->data)
+         {
+            chan->lefttarget  = cmd.volume * emin(1.0f, 2.0f * (1.0f - cmd.separation));
+            chan->righttarget = cmd.volume * emin(1.0f, 2.0f * cmd.separation);
 
-      // CALICO-TODO: allow stereo separation as option?
-      channels[channel].leftvol  = (float)(eclamp((double)volume / 191.0, 0.0, 1.0));
-      channels[channel].rightvol = channels[channel].leftvol;
+            // a sound which hasn't been heard yet can jump straight there
+            if(chan->data == chan->startdata && !chan->stepremainder)
+            {
+               chan->leftvol  = chan->lefttarget;
+               chan->rightvol = chan->righttarget;
+            }
+         }
+         break;
+      case SNDCMD_STOP:
+         if(chan->serial == cmd.serial)
+            chan->data = nullptr;
+         break;
+      case SNDCMD_STOPALL:
+         for(int i = 0; i < numchannels; i++)
+            channels[i].data = nullptr;
+         break;
+      }
+   }
 
-      channels[channel].step = 1 << 16;
+   cmdtail.store(tail, std::memory_order_release);
+}
 
-      SDL_SemPost(channels[channel].sem);
-      return true;
+//
+// Publish the state of every channel for the game thread.
+//
+static void SDL2Sfx_publishStatus()
+{
+   for(channelinfo_t *chan = channels; chan != &channels[numchannels]; chan++)
+   {
+      unsigned int status = chan->serial << CHAN_SERIALSHIFT;
+
+      if(chan->data)
+      {
+         status |= CHAN_PLAYING;
+         if(chan->data == chan->startdata)
+            status |= CHAN_ATSTART;
+      }
+
+      chan->status.store(status, std::memory_order_release);
    }
-   else
-      return false;
+}
+
+//=============================================================================
+//
+// Channel Management
+//
+
+//
+// Get the CHAN_* flags for a channel as seen by the game thread. A sound
+// whose start hasn't reached the audio callback yet counts as playing and
+// sitting at its start.
+//
+static unsigned int SDL2Sfx_channelFlags(int handle)
+{
+   unsigned int status = channels[handle].status.load(std::memory_order_acquire);
+
+   if((status >> CHAN_SERIALSHIFT) != voices[handle].serial)
+      return CHAN_PLAYING | CHAN_ATSTART;
+
+   return status & CHAN_FLAGS;
 }
 
 //
@@ -111,16 +329,51 @@ int SDL2Sfx_StartSound(float *data, size_t numsamples, int volume, hal_bool loop
    if(!sndInit)
       return -1;
 
-   for(handle = 0; handle < MAXCHANNELS; handle++)
+   for(handle = 0; handle < numchannels; handle++)
    {
-      if(channels[handle].data == nullptr || channels[handle].shouldstop)
+      if(voices[handle].stopped || !(SDL2Sfx_channelFlags(handle) & CHAN_PLAYING))
          break;
    }
 
-   if(handle == MAXCHANNELS)
+   if(handle == numchannels)
       return -1;
 
-   return SDL2Sfx_addSfx(data, numsamples, volume, loop == HAL_TRUE, handle) ? handle : -1;
+   sndcmd_t cmd;
+   cmd.type       = SNDCMD_START;
+   cmd.channel    = handle;
+   cmd.serial     = (voices[handle].serial + 1) & CHAN_SERIALMASK;
+   cmd.data       = data;
+   cmd.numsamples = numsamples;
+   cmd.volume     = (float)(eclamp((double)volume / 191.0, 0.0, 1.0));
+   cmd.loop       = (loop == HAL_TRUE);
+   cmd.time       = hal_timer.getTimeUS();
+
+   if(!SDL2Sfx_postCommand(cmd))
+      return -1;
+
+   voices[handle].serial  = cmd.serial;
+   voices[handle].stopped = false;
+   return handle;
+}
+
+//
+// Change the volume and stereo separation (0-255, 128 for center) of a
+// playing sound. The mixer ramps to the new levels over one buffer.
+//
+void SDL2Sfx_SetSoundParams(int handle, int volume, int separation)
+{
+   if(!sndInit || handle < 0 || handle >= numchannels || voices[handle].stopped)
+      return;
+
+   sndcmd_t cmd = sndcmd_t();
+   cmd.type       = SNDCMD_PARAMS;
+   cmd.channel    = handle;
+   cmd.serial     = voices[handle].serial;
+   cmd.volume     = (float)(eclamp((double)volume / 191.0, 0.0, 1.0));
+   cmd.separation = (float)(eclamp((double)separation / 255.0, 0.0, 1.0));
+
+   // dropped if the ring is full; the next tic sends it again if still needed
+   SDL2Sfx_postCommand(cmd);
 }
 
 //
@@ -128,10 +381,17 @@ int SDL2Sfx_StartSound(float *data, size_t numsamples, int volume, hal_bool loop
 //
 void SDL2Sfx_StopSound(int handle)
 {
-   if(!sndInit || handle < 0 || handle >= MAXCHANNELS)
+   if(!sndInit || handle < 0 || handle >= numchannels || voices[handle].stopped)
       return;
 
-   channels[handle].shouldstop = true;
+   sndcmd_t cmd = sndcmd_t();
+   cmd.type    = SNDCMD_STOP;
+   cmd.channel = handle;
+   cmd.serial  = voices[handle].serial;
+
+   // if the ring is full the sound just runs out on its own
+   SDL2Sfx_postCommand(cmd);
+   voices[handle].stopped = true;
 }
 
 //
@@ -139,10 +399,10 @@ void SDL2Sfx_StopSound(int handle)
 //
 hal_bool SDL2Sfx_IsSamplePlaying(int handle)
 {
-   if(!sndInit || handle < 0 || handle >= MAXCHANNELS)
+   if(!sndInit || handle < 0 || handle >= numchannels)
       return HAL_FALSE;
 
-   return hal_bool(!channels[handle].shouldstop && channels[handle].data);
+   return hal_bool(!voices[handle].stopped && (SDL2Sfx_channelFlags(handle) & CHAN_PLAYING));
 }
 
 //
@@ -150,21 +410,12 @@ hal_bool SDL2Sfx_IsSamplePlaying(int handle)
 //
 hal_bool SDL2Sfx_IsSampleAtStart(int handle)
 {
-   hal_bool atStart = HAL_FALSE;
-
-   if(!sndInit || handle < 0 || handle >= MAXCHANNELS)
+   if(!sndInit || handle < 0 || handle >= numchannels)
       return HAL_FALSE;
 
-   if(SDL_SemWait(channels[handle].sem) == 0)
-   {
-      atStart = hal_bool(channels[handle].data == channels[handle].startdata);
-      SDL_SemPost(channels[handle].sem);
-   }
-
-   return atStart;
+   return hal_bool((SDL2Sfx_channelFlags(handle) & CHAN_ATSTART) != 0);
 }
 
-
 //
 // Stop all active channels.
 //
@@ -173,8 +424,12 @@ void SDL2Sfx_StopAllChannels()
    if(!sndInit)
       return;
 
-   for(int i = 0; i < MAXCHANNELS; i++)
-      channels[i].shouldstop = true;
+   sndcmd_t cmd = sndcmd_t();
+   cmd.type = SNDCMD_STOPALL;
+
+   SDL2Sfx_postCommand(cmd);
+   for(int i = 0; i < numchannels; i++)
+      voices[i].stopped = true;
 }
 
 //=============================================================================
@@ -253,6 +508,27 @@ static inline double rational_tanh(double x)
       return x * (27 + x * x) / (27 + 9 * x * x);
 }
 
+// samples below this magnitude are passed through the soft clipper unchanged
+#define CLIPKNEE 0.5
+
+// set when all three gains are 1.0 and the filters can be skipped
+static bool eqflat;
+
+//
+// Soft clip a sample and convert it to 16-bit. Only the part of the range
+// above CLIPKNEE is bent, through rational_tanh, so the curve meets the
+// linear part with matching slope and still tops out at full scale.
+//
+static inline Sint16 SDL2Sfx_clipSample(double x)
+{
+   if(x > CLIPKNEE)
+      x = CLIPKNEE + (1.0 - CLIPKNEE) * rational_tanh((x - CLIPKNEE) / (1.0 - CLIPKNEE));
+   else if(x < -CLIPKNEE)
+      x = -CLIPKNEE + (1.0 - CLIPKNEE) * rational_tanh((x + CLIPKNEE) / (1.0 - CLIPKNEE));
+
+   return (Sint16)(x * 32767.0);
+}
+
 //
 // do_3band
 //
@@ -267,63 +543,368 @@ static inline double rational_tanh(double x)
 // The author assumes NO RESPONSIBILITY for any problems caused by the use of
 // this software.
 //
+// CALICO: the filter state for both stereo channels is kept in local
+// two-lane arrays for the whole block, so each step of the filter is the
+// same operation on the left and right lanes and can be vectorized.
+//
 static void do_3band(float *stream, float *end, Sint16 *dest)
 {
-   int esnum = 0;
+   static const double vsa = (1.0 / 4294967295.0);
 
-   static double vsa = (1.0 / 4294967295.0);
-   double sample, l, m, h;    // Low / Mid / High - Sample Values
+   const double preamp = s_preampmul;
+   const double lf = eqstate[0].lf, hf = eqstate[0].hf;
+   const double lg = eqstate[0].lg, mg = eqstate[0].mg, hg = eqstate[0].hg;
 
-   while(stream != end)
+   double f1p0[2], f1p1[2], f1p2[2], f1p3[2];
+   double f2p0[2], f2p1[2], f2p2[2], f2p3[2];
+   double sdm1[2], sdm2[2], sdm3[2];
+   double out[2];
+
+   for(int c = 0; c < 2; c++)
    {
-      auto es = &eqstate[esnum];
-      esnum ^= 1; // haleyjd: toggle between equalizer channels
+      f1p0[c] = eqstate[c].f1p0; f1p1[c] = eqstate[c].f1p1;
+      f1p2[c] = eqstate[c].f1p2; f1p3[c] = eqstate[c].f1p3;
+      f2p0[c] = eqstate[c].f2p0; f2p1[c] = eqstate[c].f2p1;
+      f2p2[c] = eqstate[c].f2p2; f2p3[c] = eqstate[c].f2p3;
+      sdm1[c] = eqstate[c].sdm1; sdm2[c] = eqstate[c].sdm2;
+      sdm3[c] = eqstate[c].sdm3;
+   }
 
-      sample = *stream++ * s_preampmul;
+   for(; stream != end; stream += 2, dest += 2)
+   {
+      for(int c = 0; c < 2; c++)
+      {
+         double sample = stream[c] * preamp;
+         double l, m, h; // Low / Mid / High - Sample Values
 
-      // Filter #1 (lowpass)
-      es->f1p0  += (es->lf * (sample   - es->f1p0)) + vsa;
-      es->f1p1  += (es->lf * (es->f1p0 - es->f1p1));
-      es->f1p2  += (es->lf * (es->f1p1 - es->f1p2));
-      es->f1p3  += (es->lf * (es->f1p2 - es->f1p3));
+         // Filter #1 (lowpass)
+         f1p0[c] += (lf * (sample  - f1p0[c])) + vsa;
+         f1p1[c] += (lf * (f1p0[c] - f1p1[c]));
+         f1p2[c] += (lf * (f1p1[c] - f1p2[c]));
+         f1p3[c] += (lf * (f1p2[c] - f1p3[c]));
 
-      l          = es->f1p3;
+         l = f1p3[c];
 
-      // Filter #2 (highpass)
-      es->f2p0  += (es->hf * (sample   - es->f2p0)) + vsa;
-      es->f2p1  += (es->hf * (es->f2p0 - es->f2p1));
-      es->f2p2  += (es->hf * (es->f2p1 - es->f2p2));
-      es->f2p3  += (es->hf * (es->f2p2 - es->f2p3));
+         // Filter #2 (highpass)
+         f2p0[c] += (hf * (sample  - f2p0[c])) + vsa;
+         f2p1[c] += (hf * (f2p0[c] - f2p1[c]));
+         f2p2[c] += (hf * (f2p1[c] - f2p2[c]));
+         f2p3[c] += (hf * (f2p2[c] - f2p3[c]));
 
-      h          = es->sdm3 - es->f2p3;
+         h = sdm3[c] - f2p3[c];
 
-      // Calculate midrange (signal - (low + high))
-      m          = es->sdm3 - (h + l);
+         // Calculate midrange (signal - (low + high))
+         m = sdm3[c] - (h + l);
 
-      // Scale, Combine and store
-      l         *= es->lg;
-      m         *= es->mg;
-      h         *= es->hg;
+         // Shuffle history buffer
+         sdm3[c] = sdm2[c];
+         sdm2[c] = sdm1[c];
+         sdm1[c] = sample;
 
-      // Shuffle history buffer
-      es->sdm3   = es->sdm2;
-      es->sdm2   = es->sdm1;
-      es->sdm1   = sample;                
+         // Scale and combine
+         out[c] = l * lg + m * mg + h * hg;
+      }
 
-      // Return result
-      // haleyjd: use rational_tanh for soft clipping
-      *dest++ = (Sint16)(rational_tanh(l + m + h) * 32767.0);
+      // haleyjd: soft clipping
+      dest[0] = SDL2Sfx_clipSample(out[0]);
+      dest[1] = SDL2Sfx_clipSample(out[1]);
    }
+
+   for(int c = 0; c < 2; c++)
+   {
+      eqstate[c].f1p0 = f1p0[c]; eqstate[c].f1p1 = f1p1[c];
+      eqstate[c].f1p2 = f1p2[c]; eqstate[c].f1p3 = f1p3[c];
+      eqstate[c].f2p0 = f2p0[c]; eqstate[c].f2p1 = f2p1[c];
+      eqstate[c].f2p2 = f2p2[c]; eqstate[c].f2p3 = f2p3[c];
+      eqstate[c].sdm1 = sdm1[c]; eqstate[c].sdm2 = sdm2[c];
+      eqstate[c].sdm3 = sdm3[c];
+   }
+}
+
+//
+// Output pass used when the EQ is flat. With unity gains the filter bands
+// sum back to the input, so only the preamp and clipping are left.
+//
+static void SDL2Sfx_flatOutput(float *stream, float *end, Sint16 *dest)
+{
+   const double preamp = s_preampmul;
+
+   while(stream != end)
+      *dest++ = SDL2Sfx_clipSample(*stream++ * preamp);
 }
 
 //=============================================================================
 //
-// Audiospec Callback
+// Channel Mixing
 //
 
 #define SAMPLESIZE sizeof(Sint16)
 #define STEP       2
 
+// use the block mixer; 0 selects the reference loop
+static int s_simdmix = 1;
+static cfgrange_t<int> simdMixRange = { 0, 1 };
+static CfgItem cfgSSimdMix("s_simdmix", &s_simdmix, &simdMixRange);
+
+//
+// Reference mixer: one output frame per iteration, with the resampling step
+// and end-of-sample checks done for every frame.
+//
+static void SDL2Sfx_mixChannelRef(channelinfo_t *chan, float *leftout, float *leftend)
+{
+   while(leftout != leftend)
+   {
+      float sample = *chan->data;
+      *(leftout + 0) = *(leftout + 0) + sample * chan->leftvol;
+      *(leftout + 1) = *(leftout + 1) + sample * chan->rightvol;
+
+      // increment current pointers in stream
+      leftout += STEP;
+
+      // increment index
+      chan->stepremainder += chan->step;
+
+      // MSB is next sample
+      chan->data += chan->stepremainder >> 16;
+
+      // limit to LSB
+      chan->stepremainder &= 0xffff;
+
+      // check if done
+      if(chan->data >= chan->enddata)
+      {
+         if(chan->loop) // TODO: stop looping while game is paused
+         {
+            chan->data = chan->startdata;
+            chan->stepremainder = 0;
+         }
+         else
+         {
+            // flag the channel to be stopped by the main thread ASAP
+            chan->data = nullptr;
+            break;
+         }
+      }
+   }
+}
+
+//
+// Mix a channel whose levels are moving to new targets, stepping them
+// linearly across the buffer so the change doesn't click.
+//
+static void SDL2Sfx_mixChannelRamp(channelinfo_t *chan, float *leftout, float *leftend)
+{
+   unsigned int frames = unsigned(leftend - leftout) / STEP;
+   float        lv     = chan->leftvol;
+   float        rv     = chan->rightvol;
+   float        ldelta = frames ? (chan->lefttarget  - lv) / frames : 0.0f;
+   float        rdelta = frames ? (chan->righttarget - rv) / frames : 0.0f;
+
+   // levels arrive at their targets even if the sample ends early
+   chan->leftvol  = chan->lefttarget;
+   chan->rightvol = chan->righttarget;
+
+   while(leftout != leftend)
+   {
+      float sample = *chan->data;
+      lv += ldelta;
+      rv += rdelta;
+      *(leftout + 0) = *(leftout + 0) + sample * lv;
+      *(leftout + 1) = *(leftout + 1) + sample * rv;
+
+      leftout += STEP;
+
+      chan->stepremainder += chan->step;
+      chan->data += chan->stepremainder >> 16;
+      chan->stepremainder &= 0xffff;
+
+      if(chan->data >= chan->enddata)
+      {
+         if(chan->loop)
+         {
+            chan->data = chan->startdata;
+            chan->stepremainder = 0;
+         }
+         else
+         {
+            chan->data = nullptr;
+            break;
+         }
+      }
+   }
+}
+
+//
+// Mix count frames of a channel playing at its native rate into out.
+//
+static void SDL2Sfx_mixUnitC(float *out, const float *src, unsigned int count, float lv, float rv)
+{
+   for(unsigned int i = 0; i < count; i++)
+   {
+      out[i*STEP + 0] = out[i*STEP + 0] + src[i] * lv;
+      out[i*STEP + 1] = out[i*STEP + 1] + src[i] * rv;
+   }
+}
+
+#ifdef CALICO_SIMD_X86
+//
+// SSE2 unit-step mixer: four source samples are duplicated into two
+// interleaved L/R pairs and scaled by the stereo gains.
+//
+TARGET_SSE2 static void SDL2Sfx_mixUnitSSE2(float *out, const float *src, unsigned int count, float lv, float rv)
+{
+   const __m128 gains = _mm_setr_ps(lv, rv, lv, rv);
+   unsigned int i = 0;
+
+   for(; i + 4 <= count; i += 4, src += 4, out += 4*STEP)
+   {
+      __m128 s  = _mm_loadu_ps(src);
+      __m128 lo = _mm_mul_ps(_mm_unpacklo_ps(s, s), gains);
+      __m128 hi = _mm_mul_ps(_mm_unpackhi_ps(s, s), gains);
+      _mm_storeu_ps(out,     _mm_add_ps(_mm_loadu_ps(out),     lo));
+      _mm_storeu_ps(out + 4, _mm_add_ps(_mm_loadu_ps(out + 4), hi));
+   }
+
+   SDL2Sfx_mixUnitC(out, src, count - i, lv, rv);
+}
+#endif
+
+#ifdef CALICO_SIMD_NEON
+//
+// NEON unit-step mixer: the output is deinterleaved four frames at a time.
+// Multiply and add are kept separate so results match the reference mixer.
+//
+static void SDL2Sfx_mixUnitNEON(float *out, const float *src, unsigned int count, float lv, float rv)
+{
+   const float32x4_t lgain = vdupq_n_f32(lv);
+   const float32x4_t rgain = vdupq_n_f32(rv);
+   unsigned int i = 0;
+
+   for(; i + 4 <= count; i += 4, src += 4, out += 4*STEP)
+   {
+      float32x4_t   s  = vld1q_f32(src);
+      float32x4x2_t lr = vld2q_f32(out);
+      lr.val[0] = vaddq_f32(lr.val[0], vmulq_f32(s, lgain));
+      lr.val[1] = vaddq_f32(lr.val[1], vmulq_f32(s, rgain));
+      vst2q_f32(out, lr);
+   }
+
+   SDL2Sfx_mixUnitC(out, src, count - i, lv, rv);
+}
+#endif
+
+// unit-step kernel used by the block mixer
+static void (*SDL2Sfx_mixUnit)(float *, const float *, unsigned int, float, float) = SDL2Sfx_mixUnitC;
+
+//
+// Block mixer. Produces the same output as SDL2Sfx_mixChannelRef, but mixes
+// each run of frames up to the end of the sample without testing for it.
+//
+static void SDL2Sfx_mixChannelBlock(channelinfo_t *chan, float *leftout, float *leftend)
+{
+   unsigned int frames = unsigned(leftend - leftout) / STEP;
+
+   while(frames)
+   {
+      // frames until the step lands on or past enddata; always at least one,
+      // since the reference mixes the current sample before checking
+      uint64_t toend = frames;
+      if(chan->step)
+      {
+         uint64_t distance = 0;
+         if(chan->data < chan->enddata)
+            distance = (uint64_t(chan->enddata - chan->data) << 16) - chan->stepremainder;
+         toend = emax<uint64_t>((distance + chan->step - 1) / chan->step, 1);
+      }
+      unsigned int count = unsigned(emin<uint64_t>(toend, frames));
+
+      if(chan->step == 1 << 16)
+      {
+         // native rate; the remainder is unchanged
+         SDL2Sfx_mixUnit(leftout, chan->data, count, chan->leftvol, chan->rightvol);
+         chan->data += count;
+      }
+      else
+      {
+         uint64_t pos = chan->stepremainder;
+         for(unsigned int i = 0; i < count; i++, pos += chan->step)
+         {
+            float sample = chan->data[pos >> 16];
+            leftout[i*STEP + 0] = leftout[i*STEP + 0] + sample * chan->leftvol;
+            leftout[i*STEP + 1] = leftout[i*STEP + 1] + sample * chan->rightvol;
+         }
+         chan->data += pos >> 16;
+         chan->stepremainder = unsigned(pos & 0xffff);
+      }
+
+      leftout += count * STEP;
+      frames  -= count;
+
+      if(count == toend)
+      {
+         if(chan->loop) // TODO: stop looping while game is paused
+         {
+            chan->data = chan->startdata;
+            chan->stepremainder = 0;
+         }
+         else
+         {
+            // flag the channel to be stopped by the main thread ASAP
+            chan->data = nullptr;
+            break;
+         }
+      }
+   }
+}
+
+// channel mixer in use
+static void (*SDL2Sfx_mixChannel)(channelinfo_t *, float *, float *) = SDL2Sfx_mixChannelRef;
+
+//
+// Choose the channel mixer based on configuration and host CPU features.
+//
+static void SDL2Sfx_initMixer()
+{
+   const char  *name     = "C";
+   unsigned int features = 0;
+
+   if(!s_simdmix)
+   {
+      SDL2Sfx_mixChannel = SDL2Sfx_mixChannelRef;
+      hal_platform.debugMsg("SDL2Sfx_initMixer: using reference mixer\n");
+      return;
+   }
+
+   if(hal_medialayer.getCPUFeatures)
+      features = hal_medialayer.getCPUFeatures();
+
+   SDL2Sfx_mixChannel = SDL2Sfx_mixChannelBlock;
+   SDL2Sfx_mixUnit    = SDL2Sfx_mixUnitC;
+
+#ifdef CALICO_SIMD_X86
+   if(features & HAL_CPU_SSE2)
+   {
+      SDL2Sfx_mixUnit = SDL2Sfx_mixUnitSSE2;
+      name = "SSE2";
+   }
+#endif
+
+#ifdef CALICO_SIMD_NEON
+   if(features & HAL_CPU_NEON)
+   {
+      SDL2Sfx_mixUnit = SDL2Sfx_mixUnitNEON;
+      name = "NEON";
+   }
+#endif
+
+   hal_platform.debugMsg("SDL2Sfx_initMixer: using %s block mixer\n", name);
+}
+
+//=============================================================================
+//
+// Audiospec Callback
+//
+
 //
 // Convert the input buffer to floating point.
 //
@@ -344,77 +925,96 @@ static inline void SDL2Sfx_cvtBuffer(Uint8 *stream, int len)
    }
 }
 
+//
+// Track the interval between callbacks. One which comes more than half a
+// buffer late means the device ran dry, or nearly so.
+//
+static void SDL2Sfx_timeCallback(unsigned int now, int frames)
+{
+   static unsigned int lastcall;
+   static bool         started;
+
+   if(started)
+   {
+      unsigned int interval = now - lastcall;
+      unsigned int expected = unsigned(uint64_t(frames) * 1000000 / samplerate);
+
+      SDL2Sfx_statMax(statInterval, interval);
+
+      if(interval > expected + expected / 2)
+         statUnderruns.fetch_add(1, std::memory_order_relaxed);
+   }
+
+   lastcall = now;
+   started  = true;
+}
+
 //
 // SDL_mixer postmix callback routine, dispatched asynchronously. We do
 // our own mixing on up to 32 digital sound channels.
 //
 static void SDL2Sfx_updateSoundCB(void *userdata, Uint8 *stream, int len)
 {
+   unsigned int now    = hal_timer.getTimeUS();
+   int          frames = int(unsigned(len) / (2 * SAMPLESIZE));
+   unsigned int voices = 0;
+
+   // the mixer owns this thread, so it's set up on its first callback
+   static thread_local bool scheduled;
+   if(!scheduled)
+   {
+      M_ScheduleThread(THREAD_AUDIO);
+      scheduled = true;
+   }
+
+   SDL2Sfx_timeCallback(now, frames);
    SDL2Sfx_cvtBuffer(stream, len);
 
    float *leftout = mixbuffer;
    float *leftend = mixbuffer + (len / SAMPLESIZE);
 
-   for(channelinfo_t *chan = channels; chan != &channels[MAXCHANNELS]; chan++)
-   {
-      // fast rejection before semaphore lock
-      if(chan->shouldstop || !chan->data)
-         continue;
+   SDL2Sfx_runCommands(now);
 
-      // try to acquire semaphore, but do not block; if the main thread is using
-      // this channel we'll skip it for now, this is safer and faster.
-      if(SDL_SemTryWait(chan->sem) != 0)
-         continue;
+   bool held = loopsHeld.load(std::memory_order_relaxed);
 
-      // lost before semaphore lock?
-      if(chan->shouldstop || !chan->data)
+   for(channelinfo_t *chan = channels; chan != &channels[numchannels]; chan++)
+   {
+      if(chan->data && !(held && chan->loop))
       {
-         SDL_SemPost(chan->sem);
-         continue;
+         if(chan->leftvol != chan->lefttarget || chan->rightvol != chan->righttarget)
+            SDL2Sfx_mixChannelRamp(chan, leftout, leftend);
+         else
+            SDL2Sfx_mixChannel(chan, leftout, leftend);
+         ++voices;
       }
+   }
 
-      while(leftout != leftend)
-      {
-         float sample = *chan->data;
-         *(leftout + 0) = *(leftout + 0) + sample * chan->leftvol;
-         *(leftout + 1) = *(leftout + 1) + sample * chan->rightvol;
-
-         // increment current pointers in stream
-         leftout += STEP;
+   SDL2Sfx_publishStatus();
 
-         // increment index
-         chan->stepremainder += chan->step;
+   hal_musicrender_t render = musicRenderer.load(std::memory_order_acquire);
+   if(render && !held)
+      voices += unsigned(render(mixbuffer, frames));
 
-         // MSB is next sample
-         chan->data += chan->stepremainder >> 16;
+   // equalization output pass
+   if(eqflat)
+      SDL2Sfx_flatOutput(mixbuffer, leftend, (Sint16 *)stream);
+   else
+      do_3band(mixbuffer, leftend, (Sint16 *)stream);
 
-         // limit to LSB
-         chan->stepremainder &= 0xffff;
+   RB_CaptureAudio((const int16_t *)stream, unsigned(frames), samplerate);
 
-         // check if done
-         if(chan->data >= chan->enddata)
-         {
-            if(chan->loop) // TODO: stop looping while game is paused or minimized
-            {
-               chan->data = chan->startdata;
-               chan->stepremainder = 0;
-            }
-            else
-            {
-               // flag the channel to be stopped by the main thread ASAP
-               chan->data = nullptr;
-               break;
-            }
-         }
-      }
+   // DSP load: the share of the buffer's playing time spent producing it
+   if(frames)
+   {
+      uint64_t period = uint64_t(frames) * 1000000 / samplerate;
+      unsigned int load = unsigned(uint64_t(hal_timer.getTimeUS() - now) * 1000 / emax<uint64_t>(period, 1));
 
-      // release semaphore and move on to next channel
-      SDL_SemPost(chan->sem);
-      leftout = mixbuffer;
+      SDL2Sfx_statMax(statLoadPeak, load);
+      statLoadSum.fetch_add(load, std::memory_order_relaxed);
+      statLoadCount.fetch_add(1, std::memory_order_relaxed);
    }
-
-   // equalization output pass
-   do_3band(mixbuffer, leftend, (Sint16 *)stream);
+   SDL2Sfx_statMax(statVoicesPeak, voices);
+   M_TraceEnd("audiomix", now);
 }
 
 //=============================================================================
@@ -435,8 +1035,10 @@ void SDL2Sfx_UpdateEQParams()
    eqstate[0].mg = eqstate[1].mg = s_midgain;
    eqstate[0].hg = eqstate[1].hg = s_highgain;
 
-   eqstate[0].lf = eqstate[1].lf = 2 * std::sin(SND_PI * (s_lowfreq  / (double)SAMPLERATE));
-   eqstate[0].hf = eqstate[1].hf = 2 * std::sin(SND_PI * (s_highfreq / (double)SAMPLERATE));
+   eqstate[0].lf = eqstate[1].lf = 2 * std::sin(SND_PI * (s_lowfreq  / (double)samplerate));
+   eqstate[0].hf = eqstate[1].hf = 2 * std::sin(SND_PI * (s_highfreq / (double)samplerate));
+
+   eqflat = (s_lowgain == 1.0 && s_midgain == 1.0 && s_highgain == 1.0);
 }
 
 //
@@ -444,17 +1046,13 @@ void SDL2Sfx_UpdateEQParams()
 //
 static void SDL2Sfx_initChannels()
 {
+   numchannels = s_channels;
+
    // allocate mixing buffer
    mixbuffer = ecalloc(float, 2*mixbufferSize, sizeof(float));
 
-   // create semaphores
-   for(int i = 0; i < MAXCHANNELS; i++)
-   {
-      if(!(channels[i].sem = SDL_CreateSemaphore(1)))
-         hal_platform.fatalError("Could not initialize sound channel semaphore");
-   }
-
    SDL2Sfx_UpdateEQParams();
+   SDL2Sfx_initMixer();
 }
 
 // Dummy callback for audiospec during buffer size test
@@ -468,10 +1066,10 @@ static Uint32 SDL2Sfx_testSoundBufferSize()
 {
    Uint32 ret = 0;
    SDL_AudioSpec want, have;
-   want.freq     = SAMPLERATE;
+   want.freq     = s_samplerate;
    want.format   = MIX_DEFAULT_FORMAT;
    want.channels = 2;
-   want.samples  = 2048;
+   want.samples  = Uint16(s_buffersize);
    want.callback = SDL2Sfx_dummyCallback;
 
    if(SDL_OpenAudio(&want, &have) >= 0)
@@ -499,6 +1097,53 @@ hal_bool SDL2Sfx_IsInit()
    return hal_bool(sndInit);
 }
 
+//
+// Get the number of sound effect channels available.
+//
+int SDL2Sfx_GetNumChannels()
+{
+   return sndInit ? numchannels : 0;
+}
+
+//
+// Set the music renderer run by the postmix callback.
+//
+void SDL2Sfx_SetMusicRenderer(hal_musicrender_t renderer)
+{
+   musicRenderer.store(renderer, std::memory_order_release);
+}
+
+//
+// Hold looped sounds and the music where they are, such as while the game
+// is in the background, or let them carry on. Other sounds play out.
+//
+void SDL2Sfx_HoldLoops(hal_bool hold)
+{
+   loopsHeld.store(hold == HAL_TRUE, std::memory_order_relaxed);
+}
+
+//
+// Hold back the commands posted between a begin and an end, then pass them
+// to the audio callback all at once, so that sounds started together are
+// first mixed in the same buffer.
+//
+void SDL2Sfx_BatchCommands(hal_bool begin)
+{
+   if(begin == HAL_TRUE)
+   {
+      if(!cmdbatching)
+      {
+         cmdpending  = cmdhead.load(std::memory_order_relaxed);
+         cmdbatching = true;
+      }
+   }
+   else if(cmdbatching)
+   {
+      cmdbatching = false;
+      cmdhead.store(cmdpending, std::memory_order_release);
+   }
+}
+
 //
 // Initialize SDL_mixer for sound effects and music
 //
@@ -512,12 +1157,22 @@ hal_bool SDL2Sfx_MixerInit()
       return HAL_FALSE;
    }
 
-   if(Mix_OpenAudio(SAMPLERATE, MIX_DEFAULT_FORMAT, 2, 2048) != 0)
+   if(Mix_OpenAudio(s_samplerate, MIX_DEFAULT_FORMAT, 2, s_buffersize) != 0)
    {
       hal_platform.debugMsg("Mix_OpenAudio failed\n");
       return HAL_FALSE;
    }
 
+   // the device may not give the rate asked for
+   Uint16 format;
+   int    channelcount;
+   if(!Mix_QuerySpec(&samplerate, &format, &channelcount))
+      samplerate = s_samplerate;
+   bufferframes = int(mixbufferSize / (2 * SAMPLESIZE));
+
+   hal_platform.debugMsg("SDL2Sfx_MixerInit: %d Hz, %d frame buffer (%d ms)\n",
+                         samplerate, bufferframes, bufferframes * 1000 / samplerate);
+
    sndInit = true;
    E_AtExit(SDL2Sfx_Shutdown, 1);
 
@@ -534,7 +1189,23 @@ hal_bool SDL2Sfx_MixerInit()
 //
 int SDL2Sfx_GetSampleRate(void)
 {
-   return SAMPLERATE;
+   return samplerate;
+}
+
+//
+// Take the output timing gathered since the last call.
+//
+void SDL2Sfx_GetStats(hal_soundstats_t *stats)
+{
+   stats->callbackInterval = statInterval.exchange(0, std::memory_order_relaxed);
+   stats->underruns        = statUnderruns.exchange(0, std::memory_order_relaxed);
+   stats->startLatency     = statLatency.exchange(0, std::memory_order_relaxed);
+   stats->dspLoadPeak      = statLoadPeak.exchange(0, std::memory_order_relaxed);
+   stats->voicesPeak       = statVoicesPeak.exchange(0, std::memory_order_relaxed);
+
+   unsigned int sum   = statLoadSum.exchange(0, std::memory_order_relaxed);
+   unsigned int count = statLoadCount.exchange(0, std::memory_order_relaxed);
+   stats->dspLoadAvg = count ? sum / count : 0;
 }
 
 #endif
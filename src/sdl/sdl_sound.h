@@ -31,9 +31,7 @@
 
 #ifdef USE_SDL2
 
-#include "../hal/hal_types.h"
-
-#define SAMPLERATE 44100
+#include "../hal/hal_sfx.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -41,6 +39,7 @@ extern "C" {
 
 int      SDL2Sfx_StartSound(float *data, size_t numsamples, int volume, hal_bool loop);
 void     SDL2Sfx_StopSound(int handle);
+void     SDL2Sfx_SetSoundParams(int handle, int volume, int separation);
 hal_bool SDL2Sfx_IsSamplePlaying(int handle);
 hal_bool SDL2Sfx_IsSampleAtStart(int handle);
 void     SDL2Sfx_StopAllChannels(void);
@@ -48,6 +47,11 @@ void     SDL2Sfx_UpdateEQParams(void);
 hal_bool SDL2Sfx_IsInit(void);
 hal_bool SDL2Sfx_MixerInit(void);
 int      SDL2Sfx_GetSampleRate(void);
+int      SDL2Sfx_GetNumChannels(void);
+void     SDL2Sfx_SetMusicRenderer(hal_musicrender_t renderer);
+void     SDL2Sfx_GetStats(hal_soundstats_t *stats);
+void     SDL2Sfx_HoldLoops(hal_bool hold);
+void     SDL2Sfx_BatchCommands(hal_bool begin);
 
 #ifdef __cplusplus
 }
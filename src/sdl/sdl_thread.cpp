@@ -0,0 +1,100 @@
+/*
+  CALICO
+  
+  SDL 2 Threads
+  
+  The MIT License (MIT)
+  
+  Copyright (c) 2016 James Haley
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifdef USE_SDL2
+
+#include "SDL.h"
+#include "../hal/hal_thread.h"
+#include "sdl_thread.h"
+
+//
+// Start a new thread running func(data). Returns NULL on failure.
+//
+hal_threadhandle_t SDL2_CreateThread(hal_threadfunc_t func, const char *name, void *data)
+{
+   return SDL_CreateThread(func, name, data);
+}
+
+//
+// Wait for a thread to finish and return its exit code.
+//
+int SDL2_WaitThread(hal_threadhandle_t thread)
+{
+   int status = 0;
+
+   if(thread)
+      SDL_WaitThread(static_cast<SDL_Thread *>(thread), &status);
+
+   return status;
+}
+
+//
+// Create a counting semaphore. Returns NULL on failure.
+//
+hal_semhandle_t SDL2_CreateSemaphore(unsigned int initialValue)
+{
+   return SDL_CreateSemaphore(initialValue);
+}
+
+//
+// Destroy a semaphore created by SDL2_CreateSemaphore.
+//
+void SDL2_DestroySemaphore(hal_semhandle_t sem)
+{
+   if(sem)
+      SDL_DestroySemaphore(static_cast<SDL_sem *>(sem));
+}
+
+//
+// Increment a semaphore, waking one waiting thread.
+//
+void SDL2_SemPost(hal_semhandle_t sem)
+{
+   SDL_SemPost(static_cast<SDL_sem *>(sem));
+}
+
+//
+// Block until a semaphore can be decremented.
+//
+void SDL2_SemWait(hal_semhandle_t sem)
+{
+   SDL_SemWait(static_cast<SDL_sem *>(sem));
+}
+
+//
+// Get the number of logical CPU cores available.
+//
+int SDL2_GetCPUCount(void)
+{
+   return SDL_GetCPUCount();
+}
+
+#endif
+
+// EOF
+
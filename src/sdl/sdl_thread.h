@@ -0,0 +1,57 @@
+/*
+  CALICO
+  
+  SDL 2 Threads
+  
+  The MIT License (MIT)
+  
+  Copyright (c) 2016 James Haley
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef SDL_THREAD_H__
+#define SDL_THREAD_H__
+
+#ifdef USE_SDL2
+
+#include "../hal/hal_thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+hal_threadhandle_t SDL2_CreateThread(hal_threadfunc_t func, const char *name, void *data);
+int                SDL2_WaitThread(hal_threadhandle_t thread);
+hal_semhandle_t    SDL2_CreateSemaphore(unsigned int initialValue);
+void               SDL2_DestroySemaphore(hal_semhandle_t sem);
+void               SDL2_SemPost(hal_semhandle_t sem);
+void               SDL2_SemWait(hal_semhandle_t sem);
+int                SDL2_GetCPUCount(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+#endif
+
+// EOF
+
@@ -32,6 +32,17 @@
 #include "../hal/hal_timer.h"
 #include "sdl_timer.h"
 
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(_POSIX_TIMERS) && _POSIX_TIMERS > 0 && defined(_POSIX_MONOTONIC_CLOCK) && defined(TIMER_ABSTIME)
+#define SDL2_POSIX_CLOCK
+#endif
+#endif
+
 //
 // Delay for at least ms milliseconds.
 //
@@ -70,6 +81,176 @@ unsigned int SDL2_GetTimeMS(void)
    return ticks - basetime;
 }
 
+static Uint64 baseperfcount = 0;
+
+//
+// Get time in microseconds from the high resolution performance counter
+//
+unsigned int SDL2_GetTimeUS(void)
+{
+   static Uint64 freq;
+   Uint64 count = SDL_GetPerformanceCounter();
+
+   if(baseperfcount == 0)
+   {
+      baseperfcount = count;
+      freq = SDL_GetPerformanceFrequency();
+   }
+
+   count -= baseperfcount;
+
+   return static_cast<unsigned int>((count / freq) * 1000000 + (count % freq) * 1000000 / freq);
+}
+
+//=============================================================================
+//
+// Nanosecond clock
+//
+// Win32 reads QueryPerformanceCounter and sleeps on a high resolution
+// waitable timer where the system has them. POSIX systems with a monotonic
+// clock read it and sleep to an absolute time on it, which doesn't drift
+// with the time it takes to get to sleep. Anything else uses SDL's counter
+// and SDL_Delay. In every case the last of a sleep is spun, since waking is
+// only ever late.
+//
+
+// clock reading at the first SDL2_GetTimeNS call
+static uint64_t clockbase = 0;
+
+#if defined(_WIN32)
+
+// left to spin at the end of a wait; more if the timer isn't high resolution
+static uint64_t spinns = 1000000;
+
+static uint64_t SDL2_ReadClockNS(void)
+{
+   static LARGE_INTEGER freq;
+   LARGE_INTEGER count;
+
+   if(!freq.QuadPart)
+      QueryPerformanceFrequency(&freq);
+   QueryPerformanceCounter(&count);
+
+   uint64_t c = uint64_t(count.QuadPart), f = uint64_t(freq.QuadPart);
+   return (c / f) * 1000000000 + (c % f) * 1000000000 / f;
+}
+
+static void SDL2_SleepNS(uint64_t target, uint64_t now)
+{
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+   static HANDLE timer;
+   static bool   tried;
+
+   if(!tried)
+   {
+      tried = true;
+      timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+      if(!timer)
+      {
+         // before Windows 10 1803; waits are only as fine as the system tick
+         timer  = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+         spinns = 2000000;
+      }
+   }
+
+   if(target - now <= spinns)
+      return;
+
+   if(timer)
+   {
+      LARGE_INTEGER due;
+      due.QuadPart = -LONGLONG((target - now - spinns) / 100); // relative, in 100ns units
+      if(SetWaitableTimer(timer, &due, 0, nullptr, nullptr, FALSE))
+      {
+         WaitForSingleObject(timer, INFINITE);
+         return;
+      }
+   }
+
+   SDL_Delay(Uint32((target - now - spinns) / 1000000));
+}
+
+#elif defined(SDL2_POSIX_CLOCK)
+
+static const uint64_t spinns = 200000;
+
+static uint64_t SDL2_ReadClockNS(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return uint64_t(ts.tv_sec) * 1000000000 + uint64_t(ts.tv_nsec);
+}
+
+static void SDL2_SleepNS(uint64_t target, uint64_t now)
+{
+   struct timespec ts;
+
+   if(target - now <= spinns)
+      return;
+
+   // the clock reading taken at startup is added back to get its own time
+   target = target - spinns + clockbase;
+   ts.tv_sec  = time_t(target / 1000000000);
+   ts.tv_nsec = long(target % 1000000000);
+   while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+      ;
+}
+
+#else
+
+static const uint64_t spinns = 2000000;
+
+static uint64_t SDL2_ReadClockNS(void)
+{
+   static Uint64 freq;
+   Uint64 count = SDL_GetPerformanceCounter();
+
+   if(!freq)
+      freq = SDL_GetPerformanceFrequency();
+
+   return (count / freq) * 1000000000 + (count % freq) * 1000000000 / freq;
+}
+
+static void SDL2_SleepNS(uint64_t target, uint64_t now)
+{
+   if(target - now > spinns)
+      SDL_Delay(Uint32((target - now - spinns) / 1000000));
+}
+
+#endif
+
+//
+// Get time in nanoseconds since the first call
+//
+uint64_t SDL2_GetTimeNS(void)
+{
+   uint64_t ns = SDL2_ReadClockNS();
+
+   if(!clockbase)
+      clockbase = ns;
+
+   return ns - clockbase;
+}
+
+//
+// Sleep until SDL2_GetTimeNS reaches ns, which may already have passed
+//
+void SDL2_SleepUntilNS(uint64_t ns)
+{
+   uint64_t now = SDL2_GetTimeNS();
+
+   if(now >= ns)
+      return;
+
+   SDL2_SleepNS(ns, now);
+
+   while(SDL2_GetTimeNS() < ns)
+      ;
+}
+
 #endif
 
 // EOF
@@ -38,6 +38,9 @@ extern "C" {
 void         SDL2_Delay(unsigned int ms);
 unsigned int SDL2_GetTime(void);
 unsigned int SDL2_GetTimeMS(void);
+unsigned int SDL2_GetTimeUS(void);
+uint64_t     SDL2_GetTimeNS(void);
+void         SDL2_SleepUntilNS(uint64_t ns);
 
 #ifdef __cplusplus
 }
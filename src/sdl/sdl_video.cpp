@@ -32,13 +32,17 @@
 #include "SDL_syswm.h"
 
 #include "sdl_video.h"
+#include "../elib/compare.h"
 #include "../elib/configfile.h"
 #include "../hal/hal_types.h"
 #include "../hal/hal_input.h"
 #include "../hal/hal_platform.h"
+#include "../hal/hal_timer.h"
 #include "../hal/hal_video.h"
 #include "../rb/rb_draw.h"
+#include "../rb/rb_capture.h"
 #include "../rb/rb_main.h"
+#include "../rb/rb_screenshot.h"
 #include "../rb/rb_texture.h"
 #include "../rb/valloc.h"
 
@@ -65,12 +69,16 @@ static int monitornum      = 0;
 static hal_aspect_t aspect = HAL_ASPECT_NOMINAL;
 static int aspectNum       = 10;
 static int aspectDenom     = 7;
+static int vsync           = 1; // 0 = off, 1 = on, -1 = adaptive
+static int maxfps          = 0; // limit when not synced; 0 = none
 
 static cfgrange_t<int> swRange = { 320, 32768 };
 static cfgrange_t<int> shRange = { 224, 32768 };
 static cfgrange_t<int> fsRange = { -1,  1     };
 static cfgrange_t<int> anRange = {  3,  32    };
 static cfgrange_t<int> adRange = {  2,  32    };
+static cfgrange_t<int> vsRange = { -1,  1     };
+static cfgrange_t<int> mfRange = {  0,  1000  };
 
 static CfgItem cfgScreenWidth ("screenwidth",  &screenwidth,  &swRange);
 static CfgItem cfgScreenHeight("screenheight", &screenheight, &shRange);
@@ -78,6 +86,8 @@ static CfgItem cfgFullScreen  ("fullscreen",   &fullscreen,   &fsRange);
 static CfgItem cfgMonitorNum  ("monitornum",   &monitornum);
 static CfgItem cfgAspectNum   ("aspectnum",    &aspectNum,    &anRange);
 static CfgItem cfgAspectDenom ("aspectdenom",  &aspectDenom,  &adRange);
+static CfgItem cfgVSync       ("vsync",        &vsync,        &vsRange);
+static CfgItem cfgMaxFPS      ("maxfps",       &maxfps,       &mfRange);
 
 //=============================================================================
 //
@@ -93,6 +103,15 @@ static int curmonitornum;
 // 4:3 subscreen
 static rbScissor_t subscreen;
 
+// swap interval in effect for the current context
+static int  curswapinterval;
+static bool swapon; // false if swapping was turned off outright
+
+// present timing, in performance counter ticks
+static Uint64 lastpresent;
+static Uint64 presentinterval;
+static Uint64 nextframedue;
+
 // scale factors
 static float screenxscale;
 static float screenyscale;
@@ -206,6 +225,7 @@ hal_bool SDL2_SetVideoMode(int width, int height, int fs, int mnum)
    SDL_GL_SetAttribute(SDL_GL_ALPHA_SIZE,    8);
    SDL_GL_SetAttribute(SDL_GL_BUFFER_SIZE,  32);
    SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER,  1);
+   SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE,   24); // for the hardware renderer
 
    if(!(mainwindow = SDL_CreateWindow("Calico", x, y, width, height, flags)))
    {
@@ -241,6 +261,7 @@ hal_bool SDL2_SetVideoMode(int width, int height, int fs, int mnum)
 
    // make current and set swap
    SDL_GL_MakeCurrent(mainwindow, glcontext);
+   curswapinterval = -2; // a new context starts with no known interval
    SDL2_ToggleGLSwap(HAL_TRUE);
 
    // wake up RB system
@@ -256,6 +277,57 @@ hal_bool SDL2_SetVideoMode(int width, int height, int fs, int mnum)
    return HAL_TRUE;
 }
 
+//
+// Change the mode of the existing window, keeping its GL context and with it
+// every texture. Returns false if the window must be recreated instead.
+//
+static bool SDL2_changeVideoMode(int width, int height, int fs, int mnum)
+{
+   if(!mainwindow || !glcontext || mnum != curmonitornum)
+      return false;
+
+   if(!(width && height) || fs == -1)
+   {
+      if(SDL_SetWindowFullscreen(mainwindow, SDL_WINDOW_FULLSCREEN_DESKTOP))
+         return false;
+      fs = -1;
+   }
+   else if(fs == 1)
+   {
+      SDL_DisplayMode mode;
+
+      if(SDL_GetWindowDisplayMode(mainwindow, &mode))
+         return false;
+
+      mode.w = width;
+      mode.h = height;
+      if(SDL_SetWindowDisplayMode(mainwindow, &mode) ||
+         SDL_SetWindowFullscreen(mainwindow, SDL_WINDOW_FULLSCREEN))
+         return false;
+   }
+   else
+   {
+      if(SDL_SetWindowFullscreen(mainwindow, 0))
+         return false;
+
+      SDL_SetWindowSize(mainwindow, width, height);
+      SDL_SetWindowPosition(mainwindow, SDL_WINDOWPOS_CENTERED_DISPLAY(mnum),
+                            SDL_WINDOWPOS_CENTERED_DISPLAY(mnum));
+   }
+
+   // remember set state
+   SDL_GetWindowSize(mainwindow, &curscreenwidth, &curscreenheight);
+   curfullscreen = fs;
+
+   SDL2_calcSubRect();
+   SDL2_setOrthoMode(curscreenwidth, curscreenheight);
+
+   hal_appstate.updateFocus();
+   hal_appstate.updateGrab();
+
+   return true;
+}
+
 //
 // Remember the current video mode in the configuration file
 //
@@ -283,6 +355,13 @@ hal_bool SDL2_SetNewVideoMode(int w, int h, int fs, int mnum)
 {
    hal_bool res;
 
+   // nothing needs to be regenerated if the GL context survives
+   if(SDL2_changeVideoMode(w, h, fs, mnum))
+   {
+      SDL2_saveVideoMode();
+      return HAL_TRUE;
+   }
+
    if((res = SDL2_SetVideoMode(w, h, fs, mnum)))
       SDL2_saveVideoMode(); // remember settings
 
@@ -407,17 +486,58 @@ void *SDL2_GetGLProcAddress(const char *proc)
 }
 
 //
-// Toggle swapping
+// Toggle swapping. Turning it on uses the vsync setting; adaptive sync falls
+// back to plain vsync where the driver doesn't support it.
 //
 int SDL2_ToggleGLSwap(hal_bool swap)
 {
-   static hal_bool swapState;
+   int interval = swap ? vsync : 0;
+   int ret;
 
-   if(swap == swapState)
+   swapon = !!swap;
+
+   if(interval == curswapinterval)
       return 0;
-   swapState = swap;
 
-   return SDL_GL_SetSwapInterval(!!swap);
+   if((ret = SDL_GL_SetSwapInterval(interval)) < 0 && interval == -1)
+   {
+      hal_platform.debugMsg("Adaptive sync unavailable, using vsync (%s)\n", SDL_GetError());
+      ret = SDL_GL_SetSwapInterval(interval = 1);
+   }
+
+   curswapinterval = (ret < 0) ? 0 : interval;
+   nextframedue    = 0;
+
+   return ret;
+}
+
+//
+// Hold frames to maxfps. Only done when swaps aren't synced to the display,
+// which would otherwise be waiting as well, and not at all once swapping has
+// been turned off, as for -timedemo.
+//
+static void SDL2_limitFrameRate()
+{
+   if(!maxfps || curswapinterval || !swapon)
+      return;
+
+   const Uint64 freq  = SDL_GetPerformanceFrequency();
+   const Uint64 frame = freq / emax(maxfps, CALICO_GLOBAL_FPS);
+   Uint64       now   = SDL_GetPerformanceCounter();
+
+   // start over rather than race to catch up after a stall
+   if(!nextframedue || now > nextframedue + frame)
+      nextframedue = now;
+
+   while(now < nextframedue)
+   {
+      Uint64 ms = (nextframedue - now) * 1000 / freq;
+      if(ms > 1)
+         SDL_Delay(Uint32(ms - 1)); // leave the last bit to the loop
+      now = SDL_GetPerformanceCounter();
+   }
+
+   nextframedue += frame;
 }
 
 //
@@ -425,8 +545,28 @@ int SDL2_ToggleGLSwap(hal_bool swap)
 //
 void SDL2_EndFrame(void)
 {
+   RB_EndFrameScreenshots();
+   RB_EndFrameCapture();
+
    if(mainwindow)
+   {
+      SDL2_limitFrameRate();
       SDL_GL_SwapWindow(mainwindow);
+
+      // measure the time between presents
+      Uint64 now = SDL_GetPerformanceCounter();
+      if(lastpresent)
+         presentinterval = now - lastpresent;
+      lastpresent = now;
+   }
+}
+
+//
+// Get the time between the last two presents in microseconds
+//
+unsigned int SDL2_GetPresentInterval(void)
+{
+   return static_cast<unsigned int>(presentinterval * 1000000 / SDL_GetPerformanceFrequency());
 }
 
 //
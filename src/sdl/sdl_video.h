@@ -56,6 +56,7 @@ unsigned int  SDL2_GetWindowFlags(void);
 void          SDL2_SetGrab(hal_bool grab);
 void          SDL2_WarpMouse(int x, int y);
 void          SDL2_EndFrame(void);
+unsigned int  SDL2_GetPresentInterval(void);
 void         *SDL2_GetWindowHandle(void);
 hal_aspect_t  SDL2_GetAspectRatioType(void);
 void          SDL2_GetSubscreenExtents(int *x, int *y, int *w, int *h);
@@ -47,7 +47,7 @@ typedef struct
 
 #define	INTERNALQUADS 256 // 4k / 16 bytes per quad (64 bits)
 #define	EXTERNALQUADS 512 // 16k  / 32 bytes per quad (16 bits+music)
-#define	SFXCHANNELS   4
+#define	SFXCHANNELS   32 // CALICO: most channels; numsfxchannels are used
 
 typedef struct sfxchannel_s
 {
@@ -58,9 +58,17 @@ typedef struct sfxchannel_s
    sfxinfo_t    *sfx;
    mobj_t       *origin;
    int           handle;     // CALICO: handle to low-level sound channel
+   int           halvol;     // CALICO: volume last sent to the HAL
+   int           sep;        // CALICO: stereo separation last sent to the HAL
+   boolean       positional; // CALICO: follows origin each tic
 } sfxchannel_t;
 
 extern sfxchannel_t sfxchannels[SFXCHANNELS];
+extern int          numsfxchannels; // CALICO
+
+extern int sfxstolen;   // CALICO: voices stolen this tic
+extern int sfxrejected; // CALICO: sounds rejected this tic
+extern int sfxmerged;   // CALICO: sound starts merged this tic
 
 extern int finalquad;    // the last quad mixed by update.
 
@@ -83,6 +91,8 @@ extern int samplecount; // 22khz sample counter in DSP memory
 void S_Init(void);
 void S_Clear(void);
 void S_StartSound(mobj_t *origin, int sound_id);
+void S_PrefetchSound(int sound_id); // CALICO
+void S_RemoveOrigin(mobj_t *origin); // CALICO
 void S_UpdateSounds(void);
 
 #endif
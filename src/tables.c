@@ -2060,599 +2060,6 @@ int tantoangle[2049] = {
 536870912
 };
 
-#ifndef MARS
-angle_t xtoviewangle[161] = {
-537395200,532676608,528482304,524288000,519569408,514850816,510656512,505937920,
-501219328,496500736,491782144,486539264,481820672,476577792,471859200,466616320,
-461373440,456130560,450887680,445644800,439877632,434634752,428867584,423624704,
-417857536,412090368,406323200,400031744,394264576,387973120,382205952,375914496,
-369623040,363331584,357040128,350224384,343932928,337117184,330825728,324009984,
-317194240,310378496,303562752,296222720,289406976,282066944,274726912,267386880,
-260046848,252706816,245366784,238026752,230162432,222822400,214958080,207093760,
-199229440,191365120,183500800,175636480,167772160,159383552,151519232,143130624,
-135266304,126877696,118489088,110100480,101711872,93323264,84934656,76546048,
-68157440,59768832,51380224,42467328,34078720,25690112,17301504,8388608,
-0,-8388608,-17301504,-25690112,-34078720,-42467328,-51380224,-59768832,
--68157440,-76546048,-84934656,-93323264,-101711872,-110100480,-118489088,-126877696,
--135266304,-143130624,-151519232,-159383552,-167772160,-175636480,-183500800,-191365120,
--199229440,-207093760,-214958080,-222822400,-230162432,-238026752,-245366784,-252706816,
--260046848,-267386880,-274726912,-282066944,-289406976,-296222720,-303562752,-310378496,
--317194240,-324009984,-330825728,-337117184,-343932928,-350224384,-357040128,-363331584,
--369623040,-375914496,-382205952,-387973120,-394264576,-400031744,-406323200,-412090368,
--417857536,-423624704,-428867584,-434634752,-439877632,-445644800,-450887680,-456130560,
--461373440,-466616320,-471859200,-476577792,-481820672,-486539264,-491782144,-496500736,
--501219328,-505937920,-510656512,-514850816,-519569408,-524288000,-528482304,-532676608,
--537395200
-};
-
-int viewangletox[4096] = {
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-160,160,160,160,160,160,160,160,
-159,159,159,159,159,159,159,159,
-158,158,158,158,158,158,158,158,
-157,157,157,157,157,157,157,157,
-157,156,156,156,156,156,156,156,
-156,156,155,155,155,155,155,155,
-155,155,154,154,154,154,154,154,
-154,154,154,153,153,153,153,153,
-153,153,153,153,152,152,152,152,
-152,152,152,152,152,151,151,151,
-151,151,151,151,151,151,150,150,
-150,150,150,150,150,150,150,150,
-149,149,149,149,149,149,149,149,
-149,148,148,148,148,148,148,148,
-148,148,148,147,147,147,147,147,
-147,147,147,147,146,146,146,146,
-146,146,146,146,146,146,145,145,
-145,145,145,145,145,145,145,145,
-144,144,144,144,144,144,144,144,
-144,144,143,143,143,143,143,143,
-143,143,143,143,142,142,142,142,
-142,142,142,142,142,142,141,141,
-141,141,141,141,141,141,141,141,
-141,140,140,140,140,140,140,140,
-140,140,140,139,139,139,139,139,
-139,139,139,139,139,139,138,138,
-138,138,138,138,138,138,138,138,
-137,137,137,137,137,137,137,137,
-137,137,137,136,136,136,136,136,
-136,136,136,136,136,136,135,135,
-135,135,135,135,135,135,135,135,
-135,134,134,134,134,134,134,134,
-134,134,134,134,134,133,133,133,
-133,133,133,133,133,133,133,133,
-132,132,132,132,132,132,132,132,
-132,132,132,132,131,131,131,131,
-131,131,131,131,131,131,131,130,
-130,130,130,130,130,130,130,130,
-130,130,130,129,129,129,129,129,
-129,129,129,129,129,129,129,128,
-128,128,128,128,128,128,128,128,
-128,128,128,127,127,127,127,127,
-127,127,127,127,127,127,127,126,
-126,126,126,126,126,126,126,126,
-126,126,126,126,125,125,125,125,
-125,125,125,125,125,125,125,125,
-124,124,124,124,124,124,124,124,
-124,124,124,124,124,123,123,123,
-123,123,123,123,123,123,123,123,
-123,122,122,122,122,122,122,122,
-122,122,122,122,122,122,121,121,
-121,121,121,121,121,121,121,121,
-121,121,121,120,120,120,120,120,
-120,120,120,120,120,120,120,120,
-119,119,119,119,119,119,119,119,
-119,119,119,119,119,118,118,118,
-118,118,118,118,118,118,118,118,
-118,118,118,117,117,117,117,117,
-117,117,117,117,117,117,117,117,
-116,116,116,116,116,116,116,116,
-116,116,116,116,116,116,115,115,
-115,115,115,115,115,115,115,115,
-115,115,115,115,114,114,114,114,
-114,114,114,114,114,114,114,114,
-114,114,113,113,113,113,113,113,
-113,113,113,113,113,113,113,113,
-112,112,112,112,112,112,112,112,
-112,112,112,112,112,112,111,111,
-111,111,111,111,111,111,111,111,
-111,111,111,111,110,110,110,110,
-110,110,110,110,110,110,110,110,
-110,110,109,109,109,109,109,109,
-109,109,109,109,109,109,109,109,
-109,108,108,108,108,108,108,108,
-108,108,108,108,108,108,108,107,
-107,107,107,107,107,107,107,107,
-107,107,107,107,107,107,106,106,
-106,106,106,106,106,106,106,106,
-106,106,106,106,106,105,105,105,
-105,105,105,105,105,105,105,105,
-105,105,105,105,104,104,104,104,
-104,104,104,104,104,104,104,104,
-104,104,104,103,103,103,103,103,
-103,103,103,103,103,103,103,103,
-103,103,102,102,102,102,102,102,
-102,102,102,102,102,102,102,102,
-102,101,101,101,101,101,101,101,
-101,101,101,101,101,101,101,101,
-100,100,100,100,100,100,100,100,
-100,100,100,100,100,100,100,100,
-99,99,99,99,99,99,99,99,
-99,99,99,99,99,99,99,98,
-98,98,98,98,98,98,98,98,
-98,98,98,98,98,98,98,97,
-97,97,97,97,97,97,97,97,
-97,97,97,97,97,97,96,96,
-96,96,96,96,96,96,96,96,
-96,96,96,96,96,96,95,95,
-95,95,95,95,95,95,95,95,
-95,95,95,95,95,95,94,94,
-94,94,94,94,94,94,94,94,
-94,94,94,94,94,94,93,93,
-93,93,93,93,93,93,93,93,
-93,93,93,93,93,93,92,92,
-92,92,92,92,92,92,92,92,
-92,92,92,92,92,92,91,91,
-91,91,91,91,91,91,91,91,
-91,91,91,91,91,91,90,90,
-90,90,90,90,90,90,90,90,
-90,90,90,90,90,90,89,89,
-89,89,89,89,89,89,89,89,
-89,89,89,89,89,89,88,88,
-88,88,88,88,88,88,88,88,
-88,88,88,88,88,88,87,87,
-87,87,87,87,87,87,87,87,
-87,87,87,87,87,87,86,86,
-86,86,86,86,86,86,86,86,
-86,86,86,86,86,86,86,85,
-85,85,85,85,85,85,85,85,
-85,85,85,85,85,85,85,84,
-84,84,84,84,84,84,84,84,
-84,84,84,84,84,84,84,83,
-83,83,83,83,83,83,83,83,
-83,83,83,83,83,83,83,82,
-82,82,82,82,82,82,82,82,
-82,82,82,82,82,82,82,82,
-81,81,81,81,81,81,81,81,
-81,81,81,81,81,81,81,81,
-80,80,80,80,80,80,80,80,
-80,80,80,80,80,80,80,80,
-79,79,79,79,79,79,79,79,
-79,79,79,79,79,79,79,79,
-79,78,78,78,78,78,78,78,
-78,78,78,78,78,78,78,78,
-78,77,77,77,77,77,77,77,
-77,77,77,77,77,77,77,77,
-77,76,76,76,76,76,76,76,
-76,76,76,76,76,76,76,76,
-76,75,75,75,75,75,75,75,
-75,75,75,75,75,75,75,75,
-75,75,74,74,74,74,74,74,
-74,74,74,74,74,74,74,74,
-74,74,73,73,73,73,73,73,
-73,73,73,73,73,73,73,73,
-73,73,72,72,72,72,72,72,
-72,72,72,72,72,72,72,72,
-72,72,71,71,71,71,71,71,
-71,71,71,71,71,71,71,71,
-71,71,70,70,70,70,70,70,
-70,70,70,70,70,70,70,70,
-70,70,69,69,69,69,69,69,
-69,69,69,69,69,69,69,69,
-69,69,68,68,68,68,68,68,
-68,68,68,68,68,68,68,68,
-68,68,67,67,67,67,67,67,
-67,67,67,67,67,67,67,67,
-67,67,66,66,66,66,66,66,
-66,66,66,66,66,66,66,66,
-66,66,65,65,65,65,65,65,
-65,65,65,65,65,65,65,65,
-65,65,64,64,64,64,64,64,
-64,64,64,64,64,64,64,64,
-64,63,63,63,63,63,63,63,
-63,63,63,63,63,63,63,63,
-63,62,62,62,62,62,62,62,
-62,62,62,62,62,62,62,62,
-61,61,61,61,61,61,61,61,
-61,61,61,61,61,61,61,61,
-60,60,60,60,60,60,60,60,
-60,60,60,60,60,60,60,59,
-59,59,59,59,59,59,59,59,
-59,59,59,59,59,59,58,58,
-58,58,58,58,58,58,58,58,
-58,58,58,58,58,57,57,57,
-57,57,57,57,57,57,57,57,
-57,57,57,57,56,56,56,56,
-56,56,56,56,56,56,56,56,
-56,56,56,55,55,55,55,55,
-55,55,55,55,55,55,55,55,
-55,55,54,54,54,54,54,54,
-54,54,54,54,54,54,54,54,
-54,53,53,53,53,53,53,53,
-53,53,53,53,53,53,53,52,
-52,52,52,52,52,52,52,52,
-52,52,52,52,52,52,51,51,
-51,51,51,51,51,51,51,51,
-51,51,51,51,50,50,50,50,
-50,50,50,50,50,50,50,50,
-50,50,49,49,49,49,49,49,
-49,49,49,49,49,49,49,49,
-48,48,48,48,48,48,48,48,
-48,48,48,48,48,48,47,47,
-47,47,47,47,47,47,47,47,
-47,47,47,47,46,46,46,46,
-46,46,46,46,46,46,46,46,
-46,46,45,45,45,45,45,45,
-45,45,45,45,45,45,45,45,
-44,44,44,44,44,44,44,44,
-44,44,44,44,44,43,43,43,
-43,43,43,43,43,43,43,43,
-43,43,43,42,42,42,42,42,
-42,42,42,42,42,42,42,42,
-41,41,41,41,41,41,41,41,
-41,41,41,41,41,40,40,40,
-40,40,40,40,40,40,40,40,
-40,40,39,39,39,39,39,39,
-39,39,39,39,39,39,39,38,
-38,38,38,38,38,38,38,38,
-38,38,38,37,37,37,37,37,
-37,37,37,37,37,37,37,37,
-36,36,36,36,36,36,36,36,
-36,36,36,36,35,35,35,35,
-35,35,35,35,35,35,35,35,
-35,34,34,34,34,34,34,34,
-34,34,34,34,34,33,33,33,
-33,33,33,33,33,33,33,33,
-33,32,32,32,32,32,32,32,
-32,32,32,32,32,31,31,31,
-31,31,31,31,31,31,31,31,
-31,30,30,30,30,30,30,30,
-30,30,30,30,29,29,29,29,
-29,29,29,29,29,29,29,29,
-28,28,28,28,28,28,28,28,
-28,28,28,27,27,27,27,27,
-27,27,27,27,27,27,27,26,
-26,26,26,26,26,26,26,26,
-26,26,25,25,25,25,25,25,
-25,25,25,25,25,24,24,24,
-24,24,24,24,24,24,24,24,
-23,23,23,23,23,23,23,23,
-23,23,22,22,22,22,22,22,
-22,22,22,22,22,21,21,21,
-21,21,21,21,21,21,21,20,
-20,20,20,20,20,20,20,20,
-20,20,19,19,19,19,19,19,
-19,19,19,19,18,18,18,18,
-18,18,18,18,18,18,17,17,
-17,17,17,17,17,17,17,17,
-16,16,16,16,16,16,16,16,
-16,16,15,15,15,15,15,15,
-15,15,15,15,14,14,14,14,
-14,14,14,14,14,13,13,13,
-13,13,13,13,13,13,13,12,
-12,12,12,12,12,12,12,12,
-11,11,11,11,11,11,11,11,
-11,11,10,10,10,10,10,10,
-10,10,10,9,9,9,9,9,
-9,9,9,9,8,8,8,8,
-8,8,8,8,8,7,7,7,
-7,7,7,7,7,7,6,6,
-6,6,6,6,6,6,5,5,
-5,5,5,5,5,5,5,4,
-4,4,4,4,4,4,4,4,
-3,3,3,3,3,3,3,3,
-2,2,2,2,2,2,2,2,
-1,1,1,1,1,1,1,1,
-1,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0,
-0,0,0,0,0,0,0,0
-
-};
-
-unsigned short yslope[180] = {
-2013,2036,2059,2083,2107,2132,2158,2184,
-2211,2238,2266,2295,2325,2355,2387,2419,
-2452,2485,2520,2556,2593,2631,2669,2710,
-2751,2794,2838,2883,2930,2978,3028,3080,
-3134,3189,3247,3306,3368,3432,3499,3568,
-3640,3715,3794,3875,3960,4049,4143,4240,
-4342,4449,4562,4681,4805,4937,5076,5223,
-5379,5545,5721,5908,6109,6323,6553,6800,
-7067,7356,7669,8009,8382,8791,9242,9741,
-10298,10922,11627,12429,13349,14417,15671,17164,
-18970,21202,24029,27726,32767,40049,51492,65535,
-65535,65535,65535,65535,65535,51492,40049,32767,
-27726,24029,21202,18970,17164,15671,14417,13349,
-12429,11627,10922,10298,9741,9242,8791,8382,
-8009,7669,7356,7067,6800,6553,6323,6109,
-5908,5721,5545,5379,5223,5076,4937,4805,
-4681,4562,4449,4342,4240,4143,4049,3960,
-3875,3794,3715,3640,3568,3499,3432,3368,
-3306,3247,3189,3134,3080,3028,2978,2930,
-2883,2838,2794,2751,2710,2669,2631,2593,
-2556,2520,2485,2452,2419,2387,2355,2325,
-2295,2266,2238,2211,2184,2158,2132,2107,
-2083,2059,2036,2013
-};
-
-unsigned short distscale[160] = {
-46394,46077,45800,45528,45228,44933,44677,44395,
-44117,43845,43578,43289,43034,42756,42510,42245,
-41984,41728,41478,41235,40972,40739,40488,40264,
-40025,39791,39563,39319,39102,38871,38664,38444,
-38229,38021,37817,37603,37411,37209,37027,36835,
-36650,36469,36294,36112,35947,35776,35610,35451,
-35296,35147,35003,34865,34722,34594,34462,34336,
-34215,34099,33988,33883,33784,33682,33592,33502,
-33422,33343,33269,33200,33136,33077,33024,32976,
-32933,32894,32861,32832,32809,32792,32779,32771,
-32768,32770,32778,32791,32808,32830,32860,32892,
-32930,32973,33021,33074,33132,33196,33264,33338,
-33418,33497,33586,33676,33777,33877,33981,34091,
-34207,34327,34454,34585,34712,34855,34994,35137,
-35286,35439,35599,35764,35935,36099,36281,36456,
-36635,36821,37012,37193,37395,37587,37801,38003,
-38212,38426,38645,38851,39082,39299,39541,39770,
-40003,40242,40465,40715,40948,41210,41454,41703,
-41957,42218,42484,42728,43005,43261,43549,43815,
-44087,44363,44646,44902,45194,45494,45766,46041
-
-};
-
-#endif
-
 // EOF
 
 
@@ -0,0 +1,255 @@
+/*
+  CALICO
+
+  Decoded lump cache
+
+  With -lumpcache, every compressed lump in the IWAD is decoded once and
+  written to a cache file next to it. Later runs read the whole file back in
+  and serve lumps from it, so starting up costs I/O rather than LZSS decoding.
+  The cache file records a hash and the length of the IWAD it was made from,
+  and is rebuilt whenever they no longer match.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "doomdef.h"
+#include "m_argv.h"
+#include "m_jobs.h"
+#include "w_iwad.h"
+
+#define DCACHEID      "CDLC"
+#define DCACHEVERSION 1
+
+typedef struct dcacheheader_s
+{
+   char     id[4];
+   int32_t  version;
+   uint32_t iwadhash;
+   int32_t  iwadlength;
+   int32_t  numlumps;
+   // followed by numlumps offsets from the start of the file, or 0 for lumps
+   // which are not compressed, and then the decoded lumps
+} dcacheheader_t;
+
+static byte    *dcache;        // the whole cache file
+static long     dcachelength;
+static int32_t *dcacheoffsets;
+
+void decode(unsigned char *input, unsigned char *output);
+
+//
+// FNV-1a hash of the IWAD data
+//
+static uint32_t W_HashIWAD(void)
+{
+   uint32_t hash = 2166136261u;
+   long     i, length = W_IWADLength();
+
+   for(i = 0; i < length; i++)
+   {
+      hash ^= wadfileptr[i];
+      hash *= 16777619u;
+   }
+
+   return hash;
+}
+
+//
+// Check that a cache file was made from the loaded IWAD and that every lump
+// it claims to hold lies within it
+//
+static boolean W_CheckDecodedCache(byte *data, long length, uint32_t hash)
+{
+   dcacheheader_t *header = (dcacheheader_t *)data;
+   int32_t        *offsets;
+   long            tablesize = sizeof(*header) + numlumps * sizeof(int32_t);
+   int             i;
+
+   if(length < tablesize                          ||
+      memcmp(header->id, DCACHEID, 4)             ||
+      header->version    != DCACHEVERSION         ||
+      header->iwadhash   != hash                  ||
+      header->iwadlength != W_IWADLength()        ||
+      header->numlumps   != numlumps)
+      return false;
+
+   offsets = (int32_t *)(header + 1);
+   for(i = 0; i < numlumps; i++)
+   {
+      if(!(lumpinfo[i].name[0] & 0x80))
+      {
+         if(offsets[i])
+            return false;
+         continue;
+      }
+
+      if(offsets[i] < tablesize || offsets[i] + BIGLONG(lumpinfo[i].size) > length)
+         return false;
+   }
+
+   return true;
+}
+
+//
+// Read in an existing cache file. Returns false if there is none, or it is
+// for some other IWAD.
+//
+static boolean W_LoadDecodedCache(const char *filename, uint32_t hash)
+{
+   FILE *f;
+   long  length;
+   byte *data;
+
+   if(!(f = fopen(filename, "rb")))
+      return false;
+
+   if(fseek(f, 0, SEEK_END) || (length = ftell(f)) <= 0 || fseek(f, 0, SEEK_SET))
+   {
+      fclose(f);
+      return false;
+   }
+
+   if(!(data = malloc(length)))
+      I_Error("W_LoadDecodedCache: no memory for %s", filename);
+
+   if(fread(data, 1, length, f) != (size_t)length || !W_CheckDecodedCache(data, length, hash))
+   {
+      fclose(f);
+      free(data);
+      return false;
+   }
+
+   fclose(f);
+   dcache       = data;
+   dcachelength = length;
+   return true;
+}
+
+//
+// Job to decode one lump into the cache being built
+//
+static void W_DecodeLumpJob(void *data, int lump)
+{
+   int32_t *offsets = data;
+
+   if(offsets[lump])
+      decode(wadfileptr + BIGLONG(lumpinfo[lump].filepos), dcache + offsets[lump]);
+}
+
+//
+// Decode every compressed lump and try to save the result. Every lump's
+// place in the cache is worked out first, so the lumps themselves can be
+// decoded in any order, on as many job threads as there are.
+//
+static void W_BuildDecodedCache(const char *filename, uint32_t hash)
+{
+   dcacheheader_t *header;
+   int32_t        *offsets;
+   long            length = sizeof(*header) + numlumps * sizeof(int32_t);
+   int             i;
+   FILE           *f;
+
+   for(i = 0; i < numlumps; i++)
+   {
+      if(lumpinfo[i].name[0] & 0x80)
+         length += (BIGLONG(lumpinfo[i].size) + 3) & ~3;
+   }
+
+   if(!(dcache = malloc(length)))
+      I_Error("W_BuildDecodedCache: no memory for %li bytes", length);
+
+   header  = (dcacheheader_t *)dcache;
+   offsets = (int32_t *)(header + 1);
+   length  = sizeof(*header) + numlumps * sizeof(int32_t);
+
+   memcpy(header->id, DCACHEID, 4);
+   header->version    = DCACHEVERSION;
+   header->iwadhash   = hash;
+   header->iwadlength = W_IWADLength();
+   header->numlumps   = numlumps;
+
+   for(i = 0; i < numlumps; i++)
+   {
+      if(!(lumpinfo[i].name[0] & 0x80))
+      {
+         offsets[i] = 0;
+         continue;
+      }
+
+      offsets[i] = length;
+      length += (BIGLONG(lumpinfo[i].size) + 3) & ~3;
+   }
+
+   M_RunJobs("decodelumps", W_DecodeLumpJob, offsets, numlumps);
+   dcachelength = length;
+
+   // the cache is still used for this run if it can't be written
+   if(!(f = fopen(filename, "wb")))
+   {
+      D_printf("W_BuildDecodedCache: could not create %s\n", filename);
+      return;
+   }
+   if(fwrite(dcache, 1, length, f) != (size_t)length)
+   {
+      fclose(f);
+      remove(filename);
+      D_printf("W_BuildDecodedCache: could not write %s\n", filename);
+      return;
+   }
+   fclose(f);
+}
+
+//
+// Load or create the cache file if -lumpcache was given
+//
+void W_InitDecodedCache(void)
+{
+   const char *iwadname = W_IWADName();
+   char       *filename;
+   uint32_t    hash;
+
+   if(!M_FindArgument("-lumpcache") || !iwadname)
+      return;
+
+   if(!(filename = malloc(strlen(iwadname) + sizeof(".cache"))))
+      I_Error("W_InitDecodedCache: no memory for file name");
+   strcpy(filename, iwadname);
+   strcat(filename, ".cache");
+
+   hash = W_HashIWAD();
+   if(W_LoadDecodedCache(filename, hash))
+      D_printf("W_InitDecodedCache: using %s\n", filename);
+   else
+   {
+      W_BuildDecodedCache(filename, hash);
+      D_printf("W_InitDecodedCache: built %s\n", filename);
+   }
+
+   dcacheoffsets = (int32_t *)((dcacheheader_t *)dcache + 1);
+   free(filename);
+}
+
+//
+// Get the decoded data for a compressed lump, or NULL if it has to be
+// decoded from the IWAD
+//
+byte *W_DecodedLump(int lump)
+{
+   if(!dcache || !dcacheoffsets[lump])
+      return NULL;
+
+   return dcache + dcacheoffsets[lump];
+}
+
+//
+// Get the size of the cache held in memory
+//
+long W_DecodedCacheSize(void)
+{
+   return dcachelength;
+}
+
+// EOF
+
@@ -31,6 +31,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "keywords.h"
+#include "hal/hal_platform.h"
 #include "m_argv.h"
 #include "w_iwad.h"
 
@@ -42,6 +43,10 @@ typedef enum wfiletype_e
    WFT_ROM         // Jaguar ROM image
 } wfiletype_e;
 
+static const char *iwadname;   // file the IWAD was loaded from
+static long        iwadlength; // bytes from the IWAD header to the end of file
+static int         iwadmapped; // mapped from the file rather than read in
+
 //
 // Check for the -iwad command line parameter
 //
@@ -50,7 +55,7 @@ static FILE *W_checkForIWADArg(void)
    int i;
 
    if((i = M_GetArgParameters("-iwad", 1)) != 0)
-      return fopen(myargv[i], "rb");
+      return fopen((iwadname = myargv[i]), "rb");
 
    return NULL;
 }
@@ -60,7 +65,7 @@ static FILE *W_checkForIWADArg(void)
 //
 static FILE *W_haveJagDoomWAD(void)
 {
-   return fopen("jagdoom.wad", "rb");
+   return fopen((iwadname = "jagdoom.wad"), "rb");
 }
 
 //
@@ -68,20 +73,15 @@ static FILE *W_haveJagDoomWAD(void)
 //
 static FILE *W_haveJagDoomROM(void)
 {
-   return fopen("doom.jag", "rb");
+   return fopen((iwadname = "doom.jag"), "rb");
 }
 
 //
 // Test whether the loaded file is an IWAD
 //
-static wfiletype_e W_isIWAD(FILE *f, long *offset)
+static wfiletype_e W_isIWAD(const byte *data, long length, long *offset)
 {
-   char id[4];
-
-   if(fread(id, 1, earrlen(id), f) != earrlen(id))
-      return WFT_ERROR;
-
-   if(!strncmp(id, "IWAD", earrlen(id)))
+   if(length >= 4 && !strncmp((const char *)data, "IWAD", 4))
    {
       *offset = 0;
       return WFT_WAD;
@@ -90,72 +90,120 @@ static wfiletype_e W_isIWAD(FILE *f, long *offset)
    return WFT_UNKNOWN;
 }
 
-#define WBUFFERSIZE 0x400
+#define ROMOFSSAMPLE 0x10000 // bytes hashed at each end of a ROM image
+
+//
+// CALICO: Hash the size of a ROM image and the data at either end of it; it
+// is enough to tell one ROM from another without reading all of it
+//
+static uint32_t W_hashROM(const byte *data, long length)
+{
+   uint32_t hash = 2166136261u ^ (uint32_t)length;
+   long     i, sample = length < ROMOFSSAMPLE ? length : ROMOFSSAMPLE;
+
+   for(i = 0; i < sample; i++)
+   {
+      hash ^= data[i];
+      hash *= 16777619u;
+      hash ^= data[length - 1 - i];
+      hash *= 16777619u;
+   }
+
+   return hash;
+}
 
 //
-// Test whether the loaded file is a Jaguar ROM that contains an IWAD
+// CALICO: Get the name of the file the IWAD offset in a ROM is kept in
 //
-// unzip.h -- IO for uncompress .zip files using zlib
-// Version 0.15 beta, Mar 19th, 1998,
+static char *W_romOffsetFileName(void)
+{
+   char *filename;
+
+   if((filename = malloc(strlen(iwadname) + sizeof(".ofs"))))
+   {
+      strcpy(filename, iwadname);
+      strcat(filename, ".ofs");
+   }
+
+   return filename;
+}
+
 //
-// Copyright (C) 1998 Gilles Vollant
+// CALICO: Read the IWAD offset found the last time this ROM was loaded.
+// Returns -1 if there is none, or it was for some other ROM.
 //
-// I WAIT FEEDBACK at mail info@winimage.com
-// Visit also http://www.winimage.com/zLibDll/unzip.htm for evolution
+static long W_readROMOffset(const byte *data, long length, uint32_t hash)
+{
+   char    *filename;
+   FILE    *f;
+   long     offset = -1;
+   long     cachedlength, cachedoffset;
+   unsigned cachedhash;
+
+   if(!(filename = W_romOffsetFileName()))
+      return -1;
+
+   if((f = fopen(filename, "r")))
+   {
+      if(fscanf(f, "%ld %x %ld", &cachedlength, &cachedhash, &cachedoffset) == 3 &&
+         cachedlength == length && cachedhash == hash &&
+         cachedoffset > 0 && cachedoffset <= length - 4 &&
+         !memcmp(data + cachedoffset, "IWAD", 4))
+      {
+         offset = cachedoffset;
+      }
+      fclose(f);
+   }
+
+   free(filename);
+   return offset;
+}
+
 //
-// This software is provided 'as-is', without any express or implied
-// warranty. In no event will the authors be held liable for any damages
-// arising from the use of this software.
-// 
-// Permission is granted to anyone to use this software for any purpose,
-// including commercial applications, and to alter it and redistribute it
-// freely, subject to the following restrictions:
-// 
-// 1. The origin of this software must not be misrepresented; you must not
-//    claim that you wrote the original software. If you use this software
-//    in a product, an acknowledgment in the product documentation would be
-//    appreciated but is not required.
-// 2. Altered source versions must be plainly marked as such, and must not be
-//    misrepresented as being the original software.
-// 3. This notice may not be removed or altered from any source distribution.
+// CALICO: Remember where the IWAD is in this ROM for next time
 //
-static wfiletype_e W_isROM(FILE *f, long *offset)
+static void W_writeROMOffset(long length, uint32_t hash, long offset)
 {
-   uint8_t buffer[WBUFFERSIZE + 4];
-   long fileSize = 0;
-   long backRead = 4;
+   char *filename;
+   FILE *f;
 
-   if(fseek(f, 0, SEEK_END))
-      return WFT_ERROR;
+   if(!(filename = W_romOffsetFileName()))
+      return;
 
-   fileSize = ftell(f);
-   while(backRead < fileSize)
+   if((f = fopen(filename, "w")))
    {
-      long i, readSize, readPos;
-      size_t sReadSize;
+      fprintf(f, "%ld %x %ld\n", length, (unsigned)hash, offset);
+      fclose(f);
+   }
 
-      if(backRead + WBUFFERSIZE > fileSize)
-         backRead = fileSize;
-      else
-         backRead += WBUFFERSIZE;
+   free(filename);
+}
 
-      readPos  = fileSize - backRead;
-      readSize = emin(earrlen(buffer), fileSize - readPos);
+//
+// Test whether the loaded file is a Jaguar ROM that contains an IWAD.
+// CALICO: The whole image is in memory, so the last "IWAD" in it is found by
+// scanning back from the end four bytes at a time for its first letter. The
+// offset found is kept in a file next to the ROM for the next launch.
+//
+static wfiletype_e W_isROM(const byte *data, long length, long *offset)
+{
+   uint32_t hash = W_hashROM(data, length);
+   long     i;
 
-      if(fseek(f, readPos, SEEK_SET))
-         return WFT_ERROR;
+   if((*offset = W_readROMOffset(data, length, hash)) > 0)
+      return WFT_ROM;
 
-      sReadSize = (size_t)readSize;
-      if(fread(buffer, 1, sReadSize, f) != sReadSize)
-         return WFT_ERROR;
+   for(i = length - 4; i > 0; i--)
+   {
+      // skip four bytes at a time while none of them can start the signature
+      while(i >= 4 && data[i] != 'I' && data[i - 1] != 'I' && data[i - 2] != 'I' && data[i - 3] != 'I')
+         i -= 4;
 
-      for(i = readSize - 3; (i--) > 0; )
+      if(data[i] == 'I' && data[i + 1] == 'W' && data[i + 2] == 'A' && data[i + 3] == 'D')
       {
-         if(buffer[i] == 'I' && buffer[i + 1] == 'W' && buffer[i + 2] == 'A' && buffer[i + 3] == 'D')
-         {
-            *offset = readPos + i;
-            return WFT_ROM;
-         }
+         *offset = i;
+         W_writeROMOffset(length, hash, i);
+         return WFT_ROM;
       }
    }
    
@@ -165,46 +213,59 @@ static wfiletype_e W_isROM(FILE *f, long *offset)
 //
 // Determine format of input file
 //
-static wfiletype_e W_checkFileFormat(FILE *f, long *offset)
+static wfiletype_e W_checkFileFormat(const byte *data, long length, long *offset)
 {
    wfiletype_e ret;
 
    // check if it is an IWAD   
-   switch((ret = W_isIWAD(f, offset)))
+   switch((ret = W_isIWAD(data, length, offset)))
    {
    case WFT_WAD:
    case WFT_ERROR:
       return ret;
    default:
       // check if it is a ROM file
-      return W_isROM(f, offset);
+      return W_isROM(data, length, offset);
    }
 }
 
 //
 // Read the WAD file into memory
 //
-static byte *W_cacheWADFile(FILE *f, long offset)
+static byte *W_cacheWADFile(FILE *f, long *length)
 {
-   long length;
    byte *buffer;
 
    if(fseek(f, 0, SEEK_END))
       return NULL;
-   length = ftell(f);
-   if(fseek(f, 0, SEEK_SET))
+   *length = ftell(f);
+   if(*length <= 0 || fseek(f, 0, SEEK_SET))
       return NULL;
 
-   if(!(buffer = malloc(length)))
+   if(!(buffer = malloc(*length)))
       return NULL;
 
-   if(fread(buffer, 1, length, f) != length)
+   if(fread(buffer, 1, *length, f) != (size_t)*length)
    {
       free(buffer);
       return NULL;
    }
 
-   return buffer + offset;
+   return buffer;
+}
+
+//
+// CALICO: Map the WAD file into memory instead of reading it, if the platform
+// can. Lumps which aren't compressed can then be used where they lie, and
+// only the pages actually touched are ever read in. -nommap turns this off.
+// The mapping is read-only; writing to it will fault.
+//
+static byte *W_mapWADFile(long *length)
+{
+   if(!hal_platform.mapFile || M_FindArgument("-nommap"))
+      return NULL;
+
+   return (byte *)hal_platform.mapFile(iwadname, length);
 }
 
 //
@@ -214,7 +275,7 @@ byte *W_LoadIWAD(void)
 {
    FILE *f = NULL;
    wfiletype_e type;
-   long offset = 0;
+   long offset = 0, length = 0;
    byte *data = NULL;
 
    // check for -iwad specification on command line
@@ -229,13 +290,48 @@ byte *W_LoadIWAD(void)
       }
    }
 
-   // check format of opened file
-   type = W_checkFileFormat(f, &offset);
-   if(type == WFT_WAD || type == WFT_ROM)
-      data = W_cacheWADFile(f, offset);
-
+   // CALICO: the whole file is brought in once, and its format checked there
+   if((data = W_mapWADFile(&length)))
+      iwadmapped = 1;
+   else
+      data = W_cacheWADFile(f, &length);
    fclose(f);
-   return data;
+
+   if(!data)
+      return NULL;
+
+   // check format of loaded file
+   type = W_checkFileFormat(data, length, &offset);
+   if(type != WFT_WAD && type != WFT_ROM)
+      return NULL;
+
+   iwadlength = length - offset;
+   return data + offset;
+}
+
+//
+// Get the name of the file the IWAD was loaded from
+//
+const char *W_IWADName(void)
+{
+   return iwadname;
+}
+
+//
+// Get the length of the loaded IWAD data
+//
+long W_IWADLength(void)
+{
+   return iwadlength;
+}
+
+//
+// True if the IWAD is mapped from its file, so that its pages can be
+// dropped and read back in by the system rather than taking up memory
+//
+int W_IWADMapped(void)
+{
+   return iwadmapped;
 }
 
 // EOF
@@ -29,7 +29,10 @@
 #ifndef W_IWAD_H__
 #define W_IWAD_H__
 
-byte *W_LoadIWAD(void);
+byte       *W_LoadIWAD(void);
+const char *W_IWADName(void);
+long        W_IWADLength(void);
+int         W_IWADMapped(void);
 
 #endif
 
@@ -0,0 +1,299 @@
+/*
+  CALICO
+
+  Lump streaming
+
+  With -streamlumps, a background thread decodes lumps which have been asked
+  for ahead of time, so that the frame which finally needs them doesn't have
+  to. Memory for a streamed lump is always reserved by the main thread and
+  kept from being purged or evicted until the lump is decoded; the thread
+  only ever writes into it. Finished lumps are handed back on the main
+  thread, either once a frame by W_RetireStreams, or by W_WaitStream when
+  one is needed before that. A lump still waiting for the thread when it is
+  needed is simply decoded on the spot instead.
+*/
+
+#include <stdlib.h>
+#include "doomdef.h"
+#include "hal/hal_thread.h"
+#include "m_argv.h"
+#include "m_thread.h"
+
+#define MAXSTREAMS 64 // lumps in flight at once
+
+typedef enum
+{
+   STREAM_FREE,
+   STREAM_QUEUED, // waiting for the thread
+   STREAM_BUSY,   // being decoded by the thread or the main thread
+   STREAM_DONE    // waiting to be retired
+} streamstate_t;
+
+typedef struct lumpstream_s
+{
+   streamstate_t  state;
+   unsigned int   seq;    // requests are decoded in the order they were made
+   int            lump;
+   void          *dest;
+   streamfunc_t   decode; // called on either thread
+   finishfunc_t   finish; // called on the main thread
+   int            data;   // passed to finish
+} lumpstream_t;
+
+boolean streaming;
+
+static lumpstream_t        streams[MAXSTREAMS];
+static short               lumpstreams[MAXLUMPS]; // slot + 1, or 0 if not streaming
+static unsigned int        streamseq;
+static hal_semhandle_t     streamlock; // guards the state of every slot
+static hal_semhandle_t     streamwork; // posted for every request
+static hal_semhandle_t     streamdone; // posted whenever the thread finishes one
+static hal_threadhandle_t  streamthread;
+
+//
+// Take the oldest queued request. Call with streamlock held.
+//
+static lumpstream_t *W_NextStream(void)
+{
+   lumpstream_t *next = NULL;
+   int i;
+
+   for(i = 0; i < MAXSTREAMS; i++)
+   {
+      if(streams[i].state == STREAM_QUEUED &&
+         (!next || (int)(streams[i].seq - next->seq) < 0))
+         next = &streams[i];
+   }
+
+   return next;
+}
+
+//
+// Streaming thread main loop
+//
+static int W_StreamThread(void *data)
+{
+   lumpstream_t *ls;
+
+   M_ScheduleThread(THREAD_IO);
+
+   while(1)
+   {
+      hal_threads.semWait(streamwork);
+
+      hal_threads.semWait(streamlock);
+      if((ls = W_NextStream()))
+         ls->state = STREAM_BUSY;
+      hal_threads.semPost(streamlock);
+
+      // the main thread may have already taken it
+      if(!ls)
+         continue;
+
+      ls->decode(ls->lump, ls->dest);
+
+      hal_threads.semWait(streamlock);
+      ls->state = STREAM_DONE;
+      hal_threads.semPost(streamlock);
+      hal_threads.semPost(streamdone);
+   }
+
+   return 0;
+}
+
+//
+// Start the streaming thread if -streamlumps was given
+//
+void W_InitStreaming(void)
+{
+   if(!M_FindArgument("-streamlumps") || !hal_threads.createThread)
+      return;
+
+   streamlock = hal_threads.createSemaphore(1);
+   streamwork = hal_threads.createSemaphore(0);
+   streamdone = hal_threads.createSemaphore(0);
+
+   if(streamlock && streamwork && streamdone &&
+      (streamthread = hal_threads.createThread(W_StreamThread, "W_StreamThread", NULL)))
+   {
+      streaming = true;
+      D_printf("W_InitStreaming: started\n");
+      return;
+   }
+
+   hal_threads.destroySemaphore(streamlock);
+   hal_threads.destroySemaphore(streamwork);
+   hal_threads.destroySemaphore(streamdone);
+   streamlock = streamwork = streamdone = NULL;
+}
+
+//
+// Hand a decoded lump back to its owner
+//
+static void W_FinishStream(lumpstream_t *ls)
+{
+   lumpstreams[ls->lump] = 0;
+   ls->state = STREAM_FREE;
+   if(ls->finish)
+      ls->finish(ls->lump, ls->dest, ls->data);
+}
+
+//
+// Check whether another lump can be streamed now
+//
+boolean W_CanStream(void)
+{
+   int i;
+
+   if(!streaming)
+      return false;
+
+   // only the main thread ever frees a slot, so no lock is needed
+   for(i = 0; i < MAXSTREAMS; i++)
+   {
+      if(streams[i].state == STREAM_FREE)
+         return true;
+   }
+
+   return false;
+}
+
+//
+// Queue lump to be decoded into dest by the streaming thread. When it is
+// done, finish is called with data on the main thread. Returns false if it
+// can't be queued, in which case the caller must decode the lump itself.
+//
+boolean W_StreamLump(int lump, void *dest, streamfunc_t decode, finishfunc_t finish, int data)
+{
+   lumpstream_t *ls = NULL;
+   int i;
+
+   if(!streaming || lumpstreams[lump])
+      return false;
+
+   for(i = 0; i < MAXSTREAMS; i++)
+   {
+      if(streams[i].state == STREAM_FREE)
+      {
+         ls = &streams[i];
+         break;
+      }
+   }
+   if(!ls)
+      return false;
+
+   ls->seq    = streamseq++;
+   ls->lump   = lump;
+   ls->dest   = dest;
+   ls->decode = decode;
+   ls->finish = finish;
+   ls->data   = data;
+   lumpstreams[lump] = (short)(i + 1);
+
+   hal_threads.semWait(streamlock);
+   ls->state = STREAM_QUEUED;
+   hal_threads.semPost(streamlock);
+   hal_threads.semPost(streamwork);
+
+   return true;
+}
+
+//
+// Check whether a lump is being streamed
+//
+boolean W_LumpStreaming(int lump)
+{
+   return lumpstreams[lump] != 0;
+}
+
+//
+// Make sure a streamed lump is decoded and hand it back, decoding it here if
+// the thread has not got to it yet
+//
+void W_WaitStream(int lump)
+{
+   lumpstream_t *ls;
+   boolean       take;
+
+   if(!lumpstreams[lump])
+      return;
+
+   ls = &streams[lumpstreams[lump] - 1];
+
+   hal_threads.semWait(streamlock);
+   if((take = (ls->state == STREAM_QUEUED)))
+      ls->state = STREAM_BUSY;
+   hal_threads.semPost(streamlock);
+
+   if(take)
+      ls->decode(ls->lump, ls->dest);
+   else
+   {
+      // the thread is working on it
+      while(1)
+      {
+         streamstate_t state;
+
+         hal_threads.semWait(streamlock);
+         state = ls->state;
+         hal_threads.semPost(streamlock);
+
+         if(state == STREAM_DONE)
+            break;
+         hal_threads.semWait(streamdone);
+      }
+   }
+
+   W_FinishStream(ls);
+}
+
+//
+// Hand back every lump the thread has finished. Called once a frame.
+//
+void W_RetireStreams(void)
+{
+   lumpstream_t *done[MAXSTREAMS];
+   int i, numdone = 0;
+
+   if(!streaming)
+      return;
+
+   hal_threads.semWait(streamlock);
+   for(i = 0; i < MAXSTREAMS; i++)
+   {
+      if(streams[i].state == STREAM_DONE)
+         done[numdone++] = &streams[i];
+   }
+   hal_threads.semPost(streamlock);
+
+   for(i = 0; i < numdone; i++)
+      W_FinishStream(done[i]);
+}
+
+//
+// Zone lumps are kept static until they are decoded
+//
+static void W_FinishPrefetch(int lump, void *dest, int tag)
+{
+   Z_ChangeTag(dest, tag);
+}
+
+//
+// Start decoding a lump into the zone ahead of a W_CacheLumpNum which will
+// need it, after which it is given tag. Does nothing if the lump is already
+// cached or there is no streaming thread.
+//
+void W_PrefetchLump(int lump, int tag)
+{
+   if(lump < 0 || lump >= numlumps)
+      I_Error("W_PrefetchLump: %i >= numlumps", lump);
+
+   if(lumpcache[lump] || !W_CanStream())
+      return;
+
+   Z_Malloc(W_LumpLength(lump), PU_STATIC, &lumpcache[lump]);
+   W_StreamLump(lump, lumpcache[lump], W_ReadLump, W_FinishPrefetch, tag);
+}
+
+// EOF
+
@@ -4,8 +4,12 @@
   WAD File Management
 */
 
+#include <stdlib.h>
+#include <string.h>
 #include "keywords.h"
 #include "doomdef.h"
+#include "m_prof.h"
+#include "m_trace.h"
 
 //===============
 //   TYPES
@@ -37,6 +41,11 @@ lumpinfo_t *lumpinfo; // points directly to rom image
 int         numlumps;
 void       *lumpcache[MAXLUMPS];
 
+// CALICO: lumps hashed by name, each chain holding later lumps first
+static int *lumphash;
+static int *lumphashnext;
+static int  lumphashmask;
+
 void D_strupr(char *s)
 {
    char	c;
@@ -58,7 +67,11 @@ unsigned char *decomp_input;
 unsigned char *decomp_output;
 extern int     decomp_start;
 
-void decode(unsigned char *input, unsigned char *output)
+//
+// CALICO: the original byte-at-a-time decoder, kept as the reference for
+// -checklzss
+//
+static void decode_ref(unsigned char *input, unsigned char *output)
 {
    int getidbyte = 0;
    int len;
@@ -91,6 +104,64 @@ void decode(unsigned char *input, unsigned char *output)
    }
 }
 
+//
+// CALICO: decode a group of eight codes per idbyte. A group with no
+// back-references is copied in one go, and back-references which do not
+// overlap their own output are copied a word at a time by memcpy.
+//
+void decode(unsigned char *input, unsigned char *output)
+{
+   int len;
+   int pos;
+   int idbyte;
+   int bit;
+   unsigned char *source;
+
+   while(1)
+   {
+      idbyte = *input++;
+
+      // eight literals
+      if(!idbyte)
+      {
+         memcpy(output, input, 8);
+         output += 8;
+         input  += 8;
+         continue;
+      }
+
+      for(bit = 0; bit < 8; bit++, idbyte >>= 1)
+      {
+         if(!(idbyte & 1))
+         {
+            *output++ = *input++;
+            continue;
+         }
+
+         pos = ((input[0] << LENSHIFT) | (input[1] >> LENSHIFT)) + 1;
+         len = (input[1] & 0xf) + 1;
+         input += 2;
+         if(len == 1)
+            return;
+
+         source = output - pos;
+         if(pos >= len)
+            memcpy(output, source, len);
+         else if(pos == 1)
+            memset(output, *source, len); // run of one byte
+         else
+         {
+            // the copy reads its own output; must go a byte at a time
+            unsigned char *end = output + len;
+            while(output < end)
+               *output++ = *source++;
+            continue;
+         }
+         output += len;
+      }
+   }
+}
+
 /*
 ============================================================================
 
@@ -99,6 +170,62 @@ LUMP BASED ROUTINES
 ============================================================================
 */
 
+//
+// CALICO: Get the name of a lump, or the name being looked for, as eight
+// upper-case bytes padded with zeroes, without the compression bit
+//
+static void W_LumpKey(const char *name, char key[8])
+{
+   int i;
+
+   D_memset(key, 0, 8);
+   for(i = 0; i < 8 && (name[i] & 0x7f); i++)
+      key[i] = name[i] & 0x7f;
+}
+
+static unsigned int W_HashKey(const char key[8])
+{
+   unsigned int hash = 0;
+   int i;
+
+   for(i = 0; i < 8 && key[i]; i++)
+      hash = hash * 31 + (unsigned char)key[i];
+
+   return hash;
+}
+
+//
+// CALICO: Index the lump directory by name
+//
+static void W_InitLumpHash(void)
+{
+   int  i, size = 1;
+   char key[8];
+
+   while(size < numlumps)
+      size <<= 1;
+
+   lumphash     = malloc(size * sizeof(int));
+   lumphashnext = malloc(numlumps * sizeof(int));
+   if(!lumphash || !lumphashnext)
+      I_Error("W_InitLumpHash: no memory for %i lumps", numlumps);
+
+   lumphashmask = size - 1;
+   for(i = 0; i < size; i++)
+      lumphash[i] = -1;
+
+   // later lumps go on the front of their chain so patch lumps take precedence
+   for(i = 0; i < numlumps; i++)
+   {
+      unsigned int h;
+
+      W_LumpKey(lumpinfo[i].name, key);
+      h = W_HashKey(key) & lumphashmask;
+      lumphashnext[i] = lumphash[h];
+      lumphash[h]     = i;
+   }
+}
+
 /*
 ====================
 =
@@ -120,6 +247,10 @@ void W_Init(void)
 
    infotableofs = BIGLONG(((wadinfo_t*)wadfileptr)->infotableofs);
    lumpinfo = (lumpinfo_t *) (wadfileptr + infotableofs);
+
+   W_InitDecodedCache(); // CALICO
+   W_InitLumpHash();     // CALICO
+   W_InitStreaming();    // CALICO
 }
 
 // used for stripping out the hi bit of the first character of the
@@ -165,24 +296,26 @@ int W_strncasecmp(const char *s1, const char *s2, int len)
 int W_CheckNumForName(const char *name)
 {
    char name8[9];
-   lumpinfo_t *lump_p;
+   char key[8], lumpkey[8];
+   int  i;
+   unsigned int start = M_ProfStart(); // CALICO
 
    D_memset(name8, 0, sizeof(name8));
    D_strncpy(name8, name, 8);
    name8[8] = '\0'; // in case the name was a full 8 chars
    D_strupr(name8); // case insensitive
 
-   // scan backwards so patch lump files take precedence
-   lump_p = lumpinfo + numlumps;
-
-   // CALICO: eliminated int-packing hack
-   while(lump_p-- != lumpinfo)
+   // CALICO: look in the name's hash chain rather than scanning every lump
+   W_LumpKey(name8, key);
+   for(i = lumphash[W_HashKey(key) & lumphashmask]; i != -1; i = lumphashnext[i])
    {
-      if(!W_strncasecmp(lump_p->name, name8, 8))
-         return lump_p - lumpinfo;
+      W_LumpKey(lumpinfo[i].name, lumpkey);
+      if(!memcmp(key, lumpkey, 8))
+         break;
    }
 
-   return -1;
+   M_ProfEnd(PROF_LUMPLOOKUP, start);
+   return i;
 }
 
 /*
@@ -238,11 +371,14 @@ int W_LumpLength(int lump)
 void W_ReadLump(int lump, void *dest)
 {
    lumpinfo_t *l;
+   byte       *decoded;
 
    if(lump >= numlumps)
       I_Error ("W_ReadLump: %i >= numlumps",lump);
    l = lumpinfo+lump;
-   if(l->name[0] & 0x80) // compressed
+   if((decoded = W_DecodedLump(lump))) // CALICO: already decoded on disk
+      memcpy(dest, decoded, BIGLONG(l->size));
+   else if(l->name[0] & 0x80) // compressed
    {
       decode((unsigned char *) (wadfileptr + BIGLONG(l->filepos)),
          (unsigned char *) dest);
@@ -251,6 +387,50 @@ void W_ReadLump(int lump, void *dest)
       D_memcpy(dest, wadfileptr + BIGLONG(l->filepos), BIGLONG(l->size));
 }
 
+/*
+====================
+=
+= W_CheckDecode
+=
+= CALICO: decode every compressed lump with both the fast and the original
+= LZSS decoder and stop on the first difference. Run with -checklzss.
+=
+====================
+*/
+
+void W_CheckDecode(void)
+{
+   int i, size, checked = 0;
+   unsigned char *fast, *ref;
+   lumpinfo_t *l;
+
+   for(i = 0, l = lumpinfo; i < numlumps; i++, l++)
+   {
+      unsigned char *src;
+
+      if(!(l->name[0] & 0x80))
+         continue;
+
+      size = BIGLONG(l->size);
+      src  = (unsigned char *)(wadfileptr + BIGLONG(l->filepos));
+      fast = malloc(size + 1);
+      ref  = malloc(size + 1);
+      if(!fast || !ref)
+         I_Error("W_CheckDecode: no memory for lump %i", i);
+
+      decode(src, fast);
+      decode_ref(src, ref);
+      if(memcmp(fast, ref, size))
+         I_Error("W_CheckDecode: lump %i decodes differently", i);
+
+      free(fast);
+      free(ref);
+      ++checked;
+   }
+
+   D_printf("W_CheckDecode: %i lumps ok\n", checked);
+}
+
 /*
 ====================
 =
@@ -264,12 +444,19 @@ void *W_CacheLumpNum(int lump, int tag)
    if(lump < 0 || lump >= numlumps)
       I_Error("W_CacheLumpNum: %i >= numlumps",lump);
 
+   // CALICO: a prefetched lump may still be on its way
+   W_WaitStream(lump);
+   W_TouchWorkingSet(WS_LUMP, lump);
+
    if(!lumpcache[lump])
    {
+      unsigned int start = M_TraceBegin(); // CALICO: for -trace
+
       // read the lump in
       //printf ("cache miss on lump %i\n",lump);
       Z_Malloc(W_LumpLength(lump), tag, &lumpcache[lump]);
       W_ReadLump(lump, lumpcache[lump]);
+      M_TraceEnd("lumpmiss", start);
    }
    else
       Z_ChangeTag(lumpcache[lump],tag);
@@ -279,6 +466,60 @@ void *W_CacheLumpNum(int lump, int tag)
 }
 
 
+/*
+====================
+=
+= W_LumpData
+=
+= CALICO: Get a lump's data for reading. It is only decoded into buffer if
+= it is compressed and not in the decoded lump cache; otherwise the IWAD's
+= or the cache's own copy is returned.
+=
+====================
+*/
+
+const void *W_LumpData(int lump, void *buffer)
+{
+   byte *decoded;
+
+   if(lump < 0 || lump >= numlumps)
+      I_Error("W_LumpData: %i >= numlumps", lump);
+
+   if((decoded = W_DecodedLump(lump)))
+      return decoded;
+   if(!(lumpinfo[lump].name[0] & 0x80))
+      return wadfileptr + BIGLONG(lumpinfo[lump].filepos);
+
+   W_ReadLump(lump, buffer);
+   return buffer;
+}
+
+/*
+====================
+=
+= W_CacheLumpNumConst
+=
+= CALICO: Like W_CacheLumpNum, but for lumps which are only read and never
+= freed. Those which don't need decoding aren't copied into the zone at all.
+=
+====================
+*/
+
+const void *W_CacheLumpNumConst(int lump, int tag)
+{
+   byte *decoded;
+
+   if(lump < 0 || lump >= numlumps)
+      I_Error("W_CacheLumpNumConst: %i >= numlumps", lump);
+
+   if((decoded = W_DecodedLump(lump)))
+      return decoded;
+   if(!(lumpinfo[lump].name[0] & 0x80))
+      return wadfileptr + BIGLONG(lumpinfo[lump].filepos);
+
+   return W_CacheLumpNum(lump, tag);
+}
+
 /*
 ====================
 =
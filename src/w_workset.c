@@ -0,0 +1,345 @@
+/*
+  CALICO
+
+  Per-map working sets
+
+  With -worksets, every graphic the refresh looks at, every lump cached, and
+  every sound started while a map is played are noted in the order they are
+  first used, and written out when the map ends. The next time the map is
+  loaded, the set from the last play is read back: its graphics join the
+  level's precache, or with -streamlumps are fetched in order by the
+  streaming thread, a few more each frame, along with its lumps; its sounds
+  are converted straight away. What was used before but not this time is
+  kept at the end of the new set, so a file covers every way through the
+  map it has been played. Each file records a hash of the IWAD directory,
+  which lump numbers refer to, and is ignored when that no longer matches.
+
+  The same queue is used to stream in the next map's set, and the graphics
+  its sides and sectors name, while the intermission before it is showing.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "doomdef.h"
+#include "m_argv.h"
+#include "w_iwad.h"
+
+#define WSID      "CLWS"
+#define WSVERSION 1
+
+typedef struct wsheader_s
+{
+   char     id[4];
+   int32_t  version;
+   uint32_t hash;
+   int32_t  count;
+   // followed by count entries of kind << 24 | number
+} wsheader_t;
+
+#define WS_ENTRY(kind, num) ((int32_t)(((uint32_t)(kind) << 24) | (uint32_t)(num)))
+#define WS_KIND(entry)      ((wskind_t)((uint32_t)(entry) >> 24))
+#define WS_NUM(entry)       ((int)((entry) & 0xffffff))
+
+static char    *wsname;      // file for the map being played, if any
+static uint32_t wshash;
+static byte     wstouched[MAXLUMPS]; // 1 << kind for each number used
+
+// this play's entries, in first-use order
+static int32_t *wsused;
+static int      numwsused, maxwsused;
+
+// the last play's, read back when the map was loaded, and anything else
+// queued to be prefetched
+static int32_t *wsloaded;
+static int      numwsloaded, maxwsloaded;
+static int      wsnext; // next of them to prefetch
+static byte     wsqueued[MAXLUMPS]; // 1 << kind for each number queued
+
+//
+// Hash of the IWAD directory, which the lump numbers come from
+//
+static uint32_t W_HashDirectory(void)
+{
+   const byte *data = (const byte *)lumpinfo;
+   size_t      len  = numlumps * sizeof(lumpinfo_t);
+   uint32_t    hash = 2166136261u;
+   size_t      i;
+
+   for(i = 0; i < len; i++)
+   {
+      hash ^= data[i];
+      hash *= 16777619u;
+   }
+
+   return hash;
+}
+
+//
+// Check that an entry can be used on this IWAD
+//
+static boolean W_ValidEntry(int32_t entry)
+{
+   int num = WS_NUM(entry);
+
+   switch(WS_KIND(entry))
+   {
+   case WS_GRAPHIC:
+   case WS_LUMP:
+      return num < numlumps;
+   case WS_SOUND:
+      return num > 0 && num < NUMSFX;
+   default:
+      return false;
+   }
+}
+
+//
+// Get the name of the file for the map at maplump, or NULL if working sets
+// aren't being kept
+//
+static char *W_WorkingSetName(int maplump)
+{
+   const char *iwadname = W_IWADName();
+   char       *name;
+
+   if(!M_FindArgument("-worksets") || !iwadname)
+      return NULL;
+
+   if(!(name = malloc(strlen(iwadname) + 16)))
+      I_Error("W_WorkingSetName: no memory for file name");
+   sprintf(name, "%s.%.8s.ws", iwadname, lumpinfo[maplump].name);
+
+   return name;
+}
+
+//
+// Read back the set from the last play of a map. Leaves it empty if there
+// is no file, or it doesn't match the IWAD.
+//
+static void W_ReadWorkingSet(const char *name)
+{
+   FILE      *f;
+   wsheader_t header;
+   int        i;
+
+   numwsloaded = wsnext = 0;
+   D_memset(wsqueued, 0, sizeof(wsqueued));
+
+   if(!(f = fopen(name, "rb")))
+      return;
+
+   if(fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.id, WSID, 4) ||
+      header.version != WSVERSION || header.hash != wshash ||
+      header.count < 0 || header.count > MAXLUMPS * NUMWSKINDS)
+   {
+      fclose(f);
+      return;
+   }
+
+   if(header.count >= maxwsloaded)
+   {
+      maxwsloaded = header.count + 1;
+      if(!(wsloaded = realloc(wsloaded, maxwsloaded * sizeof(*wsloaded))))
+         I_Error("W_ReadWorkingSet: no memory for %i entries", maxwsloaded);
+   }
+
+   if(fread(wsloaded, sizeof(*wsloaded), header.count, f) == (size_t)header.count)
+   {
+      for(i = 0; i < header.count; i++)
+      {
+         if(!W_ValidEntry(wsloaded[i]))
+            break;
+      }
+      if(i == header.count)
+         numwsloaded = header.count;
+   }
+
+   fclose(f);
+
+   for(i = 0; i < numwsloaded; i++)
+      wsqueued[WS_NUM(wsloaded[i])] |= (byte)(1 << WS_KIND(wsloaded[i]));
+}
+
+//
+// Write this play's set, followed by whatever the last one had which this
+// one didn't use
+//
+static void W_WriteWorkingSet(void)
+{
+   FILE      *f;
+   wsheader_t header;
+   int        i;
+
+   for(i = 0; i < numwsloaded; i++)
+   {
+      int32_t entry = wsloaded[i];
+
+      if(!(wstouched[WS_NUM(entry)] & (1 << WS_KIND(entry))))
+         W_TouchWorkingSet(WS_KIND(entry), WS_NUM(entry));
+   }
+
+   if(!numwsused || !(f = fopen(wsname, "wb")))
+      return;
+
+   memcpy(header.id, WSID, 4);
+   header.version = WSVERSION;
+   header.hash    = wshash;
+   header.count   = numwsused;
+
+   if(fwrite(&header, sizeof(header), 1, f) != 1 ||
+      fwrite(wsused, sizeof(*wsused), numwsused, f) != (size_t)numwsused)
+   {
+      // don't leave a partial file to be read back
+      fclose(f);
+      remove(wsname);
+      return;
+   }
+
+   fclose(f);
+}
+
+//
+// Load the working set of the map at maplump and start recording a new one.
+// Called by P_SetupLevel once the level is built and before it is
+// precached, so that nothing loaded to build it counts.
+//
+void W_BeginWorkingSet(int maplump)
+{
+   int i;
+
+   W_EndWorkingSet();
+
+   // anything still queued from the intermission is left to the precache
+   numwsloaded = wsnext = 0;
+
+   if(!(wsname = W_WorkingSetName(maplump)))
+      return;
+
+   wshash = W_HashDirectory();
+   W_ReadWorkingSet(wsname);
+
+   // sounds are only converted on first use, which is quick enough to do
+   // for all of them now
+   for(i = 0; i < numwsloaded; i++)
+   {
+      if(WS_KIND(wsloaded[i]) == WS_SOUND)
+         S_PrefetchSound(WS_NUM(wsloaded[i]));
+   }
+
+   D_memset(wstouched, 0, sizeof(wstouched));
+   numwsused = 0;
+}
+
+//
+// Write out the map's working set and stop recording. Does nothing if none
+// is being recorded.
+//
+void W_EndWorkingSet(void)
+{
+   if(!wsname)
+      return;
+
+   W_WriteWorkingSet();
+
+   free(wsname);
+   wsname = NULL;
+   numwsloaded = wsnext = 0;
+}
+
+//
+// Note a use of a graphic, lump or sound effect
+//
+void W_TouchWorkingSet(wskind_t kind, int num)
+{
+   if(!wsname || num < 0 || num >= MAXLUMPS || (wstouched[num] & (1 << kind)))
+      return;
+
+   wstouched[num] |= (byte)(1 << kind);
+
+   if(numwsused == maxwsused)
+   {
+      maxwsused = maxwsused ? maxwsused * 2 : 256;
+      if(!(wsused = realloc(wsused, maxwsused * sizeof(*wsused))))
+         I_Error("W_TouchWorkingSet: no memory for %i entries", maxwsused);
+   }
+   wsused[numwsused++] = WS_ENTRY(kind, num);
+}
+
+//
+// Step through the graphics of the last play's set, for R_PrecacheLevel to
+// load in order when they can't be streamed. Start *index at 0; returns -1
+// after the last one.
+//
+int W_WorkingSetGraphic(int *index)
+{
+   while(*index < numwsloaded)
+   {
+      int32_t entry = wsloaded[(*index)++];
+
+      if(WS_KIND(entry) == WS_GRAPHIC)
+         return WS_NUM(entry);
+   }
+
+   return -1;
+}
+
+//
+// Queue the set from the last play of the map at maplump to be prefetched
+// ahead of the map being loaded, in place of anything queued before
+//
+void W_PreloadWorkingSet(int maplump)
+{
+   char *name;
+
+   numwsloaded = wsnext = 0;
+   D_memset(wsqueued, 0, sizeof(wsqueued));
+
+   if((name = W_WorkingSetName(maplump)))
+   {
+      wshash = W_HashDirectory();
+      W_ReadWorkingSet(name);
+      free(name);
+   }
+}
+
+//
+// Add a graphic or lump to the end of what is to be prefetched, unless it is
+// already there
+//
+void W_QueuePrefetch(wskind_t kind, int num)
+{
+   if(num < 0 || num >= numlumps || (wsqueued[num] & (1 << kind)))
+      return;
+
+   wsqueued[num] |= (byte)(1 << kind);
+
+   if(numwsloaded == maxwsloaded)
+   {
+      maxwsloaded = maxwsloaded ? maxwsloaded * 2 : 256;
+      if(!(wsloaded = realloc(wsloaded, maxwsloaded * sizeof(*wsloaded))))
+         I_Error("W_QueuePrefetch: no memory for %i entries", maxwsloaded);
+   }
+   wsloaded[numwsloaded++] = WS_ENTRY(kind, num);
+}
+
+//
+// Queue as much more of what is to be prefetched to the streaming thread as
+// it has room for. Called once a frame.
+//
+void W_PrefetchWorkingSet(void)
+{
+   while(wsnext < numwsloaded && W_CanStream())
+   {
+      int32_t entry = wsloaded[wsnext++];
+
+      if(WS_KIND(entry) == WS_GRAPHIC)
+         R_PrefetchPixels(WS_NUM(entry));
+      else if(WS_KIND(entry) == WS_LUMP)
+         W_PrefetchLump(WS_NUM(entry), PU_CACHE);
+   }
+}
+
+// EOF
+
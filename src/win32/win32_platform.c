@@ -31,7 +31,11 @@
 #include "../elib/elib.h"
 #include <direct.h>
 #include <io.h>
+#include <limits.h>
 #include <Windows.h>
+#include <avrt.h>
+#include <mmsystem.h>
+#include <psapi.h>
 #include "../../vc2015/resource.h"
 
 #include "../elib/misc.h"
@@ -131,16 +135,231 @@ static void Win32_SetIcon(void)
    }
 }
 
+//
+// Map a whole file into memory for reading. The mapping lasts until exit.
+//
+static const void *Win32_MapFile(const char *filename, long *length)
+{
+   HANDLE        file, mapping;
+   LARGE_INTEGER size;
+   const void   *data = NULL;
+
+   file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                      FILE_ATTRIBUTE_NORMAL, NULL);
+   if(file == INVALID_HANDLE_VALUE)
+      return NULL;
+
+   if(GetFileSizeEx(file, &size) && size.QuadPart > 0 && size.QuadPart <= LONG_MAX)
+   {
+      if((mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL)))
+      {
+         if((data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)))
+            *length = (long)size.QuadPart;
+         CloseHandle(mapping); // the view keeps the mapping open
+      }
+   }
+
+   CloseHandle(file);
+   return data;
+}
+
+//
+// Open a serial port as a raw 8N1 line at the given rate
+//
+static hal_serialhandle_t Win32_OpenSerial(const char *device, int baud)
+{
+   char         name[MAX_PATH];
+   HANDLE       port;
+   DCB          dcb;
+   COMMTIMEOUTS timeouts;
+
+   // COM10 and up can only be opened through the device namespace
+   psnprintf(name, sizeof(name), "\\\\.\\%s", device);
+
+   port = CreateFileA(name, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+   if(port == INVALID_HANDLE_VALUE)
+      return NULL;
+
+   memset(&dcb, 0, sizeof(dcb));
+   dcb.DCBlength = sizeof(dcb);
+   if(!GetCommState(port, &dcb))
+   {
+      CloseHandle(port);
+      return NULL;
+   }
+
+   dcb.BaudRate     = (DWORD)baud;
+   dcb.ByteSize     = 8;
+   dcb.Parity       = NOPARITY;
+   dcb.StopBits     = ONESTOPBIT;
+   dcb.fBinary      = TRUE;
+   dcb.fOutxCtsFlow = FALSE;
+   dcb.fOutxDsrFlow = FALSE;
+   dcb.fDtrControl  = DTR_CONTROL_ENABLE;
+   dcb.fRtsControl  = RTS_CONTROL_ENABLE;
+   dcb.fOutX        = FALSE;
+   dcb.fInX         = FALSE;
+
+   // reads return at once with whatever is there, or wait briefly for more
+   timeouts.ReadIntervalTimeout         = MAXDWORD;
+   timeouts.ReadTotalTimeoutMultiplier  = MAXDWORD;
+   timeouts.ReadTotalTimeoutConstant    = 1;
+   timeouts.WriteTotalTimeoutMultiplier = 0;
+   timeouts.WriteTotalTimeoutConstant   = 100;
+
+   if(!SetCommState(port, &dcb) || !SetCommTimeouts(port, &timeouts))
+   {
+      CloseHandle(port);
+      return NULL;
+   }
+   PurgeComm(port, PURGE_RXCLEAR | PURGE_TXCLEAR);
+
+   return port;
+}
+
+static void Win32_CloseSerial(hal_serialhandle_t port)
+{
+   CloseHandle((HANDLE)port);
+}
+
+static int Win32_ReadSerial(hal_serialhandle_t port, void *buf, int maxlen)
+{
+   DWORD read, errors;
+
+   if(!ReadFile((HANDLE)port, buf, (DWORD)maxlen, &read, NULL))
+   {
+      ClearCommError((HANDLE)port, &errors, NULL);
+      return -1;
+   }
+
+   return (int)read;
+}
+
+static int Win32_WriteSerial(hal_serialhandle_t port, const void *buf, int len)
+{
+   DWORD written;
+
+   if(!WriteFile((HANDLE)port, buf, (DWORD)len, &written, NULL))
+      return -1;
+
+   return (int)written;
+}
+
+//
+// Set the calling thread's priority. Real-time threads join the MMCSS "Pro
+// Audio" task, which keeps them scheduled when other processes load the
+// machine; if the service is unavailable, time-critical priority is used.
+//
+static int Win32_SetThreadPriority(int priority)
+{
+   static __declspec(thread) HANDLE mmcss;
+   DWORD task = 0;
+   int   level;
+
+   if(priority == HAL_PRIORITY_REALTIME)
+   {
+      if(!mmcss)
+         mmcss = AvSetMmThreadCharacteristicsA("Pro Audio", &task);
+      if(mmcss && AvSetMmThreadPriority(mmcss, AVRT_PRIORITY_HIGH))
+         return 1;
+      return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+   }
+
+   if(mmcss)
+   {
+      AvRevertMmThreadCharacteristics(mmcss);
+      mmcss = NULL;
+   }
+
+   switch(priority)
+   {
+   case HAL_PRIORITY_LOW:  level = THREAD_PRIORITY_BELOW_NORMAL; break;
+   case HAL_PRIORITY_HIGH: level = THREAD_PRIORITY_HIGHEST;      break;
+   default:                level = THREAD_PRIORITY_NORMAL;       break;
+   }
+
+   return SetThreadPriority(GetCurrentThread(), level) != 0;
+}
+
+//
+// Pin the calling thread to one logical CPU
+//
+static int Win32_SetThreadAffinity(int core)
+{
+   if(core < 0 || core >= (int)(sizeof(DWORD_PTR) * 8))
+      return 0;
+
+   return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core) != 0;
+}
+
+//
+// Raise the system timer rate so that Sleep and waits wake on time. Only one
+// period is held at once.
+//
+static int Win32_SetTimerResolution(int ms)
+{
+   static UINT period;
+
+   if(period)
+   {
+      timeEndPeriod(period);
+      period = 0;
+   }
+
+   if(ms <= 0)
+      return 1;
+
+   if(timeBeginPeriod((UINT)ms) != TIMERR_NOERROR)
+      return 0;
+
+   period = (UINT)ms;
+   return 1;
+}
+
+//
+// Get the working set of the process
+//
+static void Win32_GetProcessMemory(size_t *resident, size_t *peak)
+{
+   PROCESS_MEMORY_COUNTERS counters;
+
+   *resident = *peak = 0;
+   if(GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+   {
+      *resident = counters.WorkingSetSize;
+      *peak     = counters.PeakWorkingSetSize;
+   }
+}
+
+//
+// Replace a file with a newly-written one, waiting until the move is on the
+// disk
+//
+static int Win32_ReplaceFile(const char *tmpname, const char *filename)
+{
+   return MoveFileExA(tmpname, filename, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+}
+
 //
 // Populate the HAL platform interface with Win32 implementation function pointers
 //
 void Win32_InitHAL(void)
 {
-   hal_platform.debugMsg          = Win32_DebugMsg;
-   hal_platform.exitWithMsg       = Win32_ExitWithMsg;
-   hal_platform.fatalError        = Win32_FatalError;
-   hal_platform.getWriteDirectory = Win32_GetWriteDirectory;
-   hal_platform.setIcon           = Win32_SetIcon;
+   hal_platform.debugMsg           = Win32_DebugMsg;
+   hal_platform.exitWithMsg        = Win32_ExitWithMsg;
+   hal_platform.fatalError         = Win32_FatalError;
+   hal_platform.getWriteDirectory  = Win32_GetWriteDirectory;
+   hal_platform.setIcon            = Win32_SetIcon;
+   hal_platform.mapFile            = Win32_MapFile;
+   hal_platform.openSerial         = Win32_OpenSerial;
+   hal_platform.closeSerial        = Win32_CloseSerial;
+   hal_platform.readSerial         = Win32_ReadSerial;
+   hal_platform.writeSerial        = Win32_WriteSerial;
+   hal_platform.setThreadPriority  = Win32_SetThreadPriority;
+   hal_platform.setThreadAffinity  = Win32_SetThreadAffinity;
+   hal_platform.setTimerResolution = Win32_SetTimerResolution;
+   hal_platform.getProcessMemory   = Win32_GetProcessMemory;
+   hal_platform.replaceFile        = Win32_ReplaceFile;
 }
 
 #endif
@@ -0,0 +1,41 @@
+/*
+  CALICO
+
+  Zone configuration
+
+  The size of the zone and whether it may grow are kept in the config file,
+  where they can be raised for maps and graphics larger than the cartridge
+  had room for. -zonesize and -zonegrow override them.
+*/
+
+#include "elib/elib.h"
+#include "elib/configfile.h"
+
+//
+// Config Vars
+//
+
+// in KB; 0 keeps the original 1312 KB heap
+static int zone_size = 0;
+
+static cfgrange_t<int> zsRange = { 0, 1024 * 1024 };
+
+static CfgItem cfgZoneSize("zone_size", &zone_size, &zsRange);
+
+// add more memory when the zone is full rather than stopping with an error
+static bool zone_grow = false;
+
+static CfgItem cfgZoneGrow("zone_grow", &zone_grow);
+
+extern "C" int Z_ConfigZoneSize(void)
+{
+   return zone_size;
+}
+
+extern "C" int Z_ConfigZoneGrow(void)
+{
+   return zone_grow;
+}
+
+// EOF
+
@@ -0,0 +1,196 @@
+/*
+  CALICO
+
+  Zone usage reports and allocation tracing
+
+  Z_PrintZoneStats reports how much of a zone each kind of tag is using, how
+  broken up its free space is, and how full the level arena is, and Z_MapZone gives the kind of block at
+  evenly spaced points through a zone for drawing with -heapmap. With
+  -zonetrace <file>, every allocation and free is written to the file along
+  with the source file and line it came from.
+*/
+
+#include <stdio.h>
+#include "doomdef.h"
+#include "elib/atexit.h"
+#include "m_argv.h"
+
+boolean zonetracing;
+
+static FILE *zonetrace;
+
+static const char *zonetagnames[NUMZONETAGS] =
+{
+   "static",
+   "sound",
+   "music",
+   "level",
+   "levspec",
+   "purgable",
+   "other"
+};
+
+static void Z_TraceAtExit(void)
+{
+   fclose(zonetrace);
+}
+
+//
+// Open the trace file if -zonetrace was given
+//
+void Z_InitTrace(void)
+{
+   int p;
+
+   if(!(p = M_GetArgParameters("-zonetrace", 1)))
+      return;
+
+   if(!(zonetrace = fopen(myargv[p], "w")))
+   {
+      D_printf("Z_InitTrace: could not create %s\n", myargv[p]);
+      return;
+   }
+
+   zonetracing = true;
+   E_AtExit(Z_TraceAtExit, false);
+}
+
+void Z_TraceMalloc(void *ptr, int size, int tag, const char *file, int line)
+{
+   fprintf(zonetrace, "+ %p %i %s %s:%i\n", ptr, size, zonetagnames[Z_TagIndex(tag)], file, line);
+}
+
+void Z_TraceFree(void *ptr, const char *file, int line)
+{
+   fprintf(zonetrace, "- %p %s:%i\n", ptr, file, line);
+}
+
+//
+// Make sure everything traced so far is in the file, as I_Error never returns
+//
+void Z_FlushTrace(void)
+{
+   if(zonetracing)
+      fflush(zonetrace);
+}
+
+//
+// Get the kind of memory a tag is used for
+//
+int Z_TagIndex(int tag)
+{
+   switch(tag)
+   {
+   case PU_STATIC:  return ZT_STATIC;
+   case PU_SOUND:   return ZT_SOUND;
+   case PU_MUSIC:   return ZT_MUSIC;
+   case PU_LEVEL:   return ZT_LEVEL;
+   case PU_LEVSPEC: return ZT_LEVSPEC;
+   default:
+      return tag >= PU_PURGELEVEL ? ZT_PURGABLE : ZT_OTHER;
+   }
+}
+
+const char *Z_TagName(int tagindex)
+{
+   return tagindex < NUMZONETAGS ? zonetagnames[tagindex] : "free";
+}
+
+//
+// Count up the blocks of a zone
+//
+void Z_GetZoneStats(memzone_t *zone, zonestats_t *stats)
+{
+   memblock_t *block;
+
+   D_memset(stats, 0, sizeof(*stats));
+
+   for(; zone; zone = zone->next)
+   {
+      ++stats->numzones;
+
+      for(block = &zone->blocklist; block; block = block->next)
+      {
+         ++stats->numblocks;
+
+         if(!block->user)
+         {
+            stats->freebytes += block->size;
+            ++stats->freeblocks;
+            if(block->size > stats->largestfree)
+               stats->largestfree = block->size;
+         }
+         else
+         {
+            int tagindex = Z_TagIndex(block->tag);
+
+            stats->tagbytes[tagindex] += block->size;
+            ++stats->tagblocks[tagindex];
+         }
+      }
+   }
+}
+
+//
+// Report how a zone is used
+//
+void Z_PrintZoneStats(memzone_t *zone)
+{
+   zonestats_t stats;
+   int         i, used, size;
+
+   Z_GetZoneStats(zone, &stats);
+
+   D_printf("Z_Zone: %i arenas, %i blocks, %i KB free in %i blocks (largest %i KB)\n",
+            stats.numzones, stats.numblocks, stats.freebytes / 1024, stats.freeblocks, 
+            stats.largestfree / 1024);
+
+   for(i = 0; i < NUMZONETAGS; i++)
+   {
+      if(stats.tagblocks[i])
+      {
+         D_printf("  %s: %i KB in %i blocks\n", zonetagnames[i], 
+                  stats.tagbytes[i] / 1024, stats.tagblocks[i]);
+      }
+   }
+
+   Z_GetLevelArenaStats(&used, &size);
+   D_printf("  level arena: %i/%i KB\n", used / 1024, size / 1024);
+}
+
+//
+// Fill in the kind of block, or ZT_FREE, found at each of numcells evenly
+// spaced points through a zone and its arenas, which are laid end to end
+//
+void Z_MapZone(memzone_t *mainzone, byte *cells, int numcells)
+{
+   memzone_t  *zone;
+   memblock_t *block = &mainzone->blocklist;
+   long long   total = 0, zonestart = 0;
+   int         i;
+
+   for(zone = mainzone; zone; zone = zone->next)
+      total += zone->size;
+
+   zone = mainzone;
+   for(i = 0; i < numcells; i++)
+   {
+      long long offset = total * i / numcells;
+
+      while(offset >= zonestart + zone->size && zone->next)
+      {
+         zonestart += zone->size;
+         zone  = zone->next;
+         block = &zone->blocklist;
+      }
+
+      offset -= zonestart;
+      while(block->next && (byte *)block->next <= (byte *)zone + offset)
+         block = block->next;
+
+      cells[i] = block->user ? Z_TagIndex(block->tag) : ZT_FREE;
+   }
+}
+
+// EOF
+
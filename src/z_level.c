@@ -0,0 +1,205 @@
+/*
+  CALICO
+
+  Level arena
+
+  Everything tagged PU_LEVEL or PU_LEVSPEC is thrown out together when the
+  level ends, so rather than take it from the zone it is cut one block after
+  another from a separate arena. Freeing the level is then just a matter of
+  clearing the owners' marks and rewinding the arena to its start, and level
+  data no longer leaves holes in the zone when it goes.
+
+  The arena is made of chunks taken from the C heap as they're needed. They
+  are kept for the next level, which will likely need about as much room.
+*/
+
+#include <stdlib.h>
+#include "doomdef.h"
+
+#define LEVELCHUNK (512*1024)
+
+typedef struct levelchunk_s
+{
+   struct levelchunk_s *next;
+   int                  size; // including the header
+   int                  used; // including the header
+} levelchunk_t;
+
+// keeps the blocks phrase aligned
+#define CHUNKHEADER ((int)(sizeof(levelchunk_t) + 7) & ~7)
+
+static levelchunk_t *firstchunk, *curchunk;
+
+// blocks with owners, whose marks must be cleared when the arena is reset
+static memblock_t ownedblocks = { 0, NULL, 0, 0, 0, &ownedblocks, &ownedblocks };
+
+static int levelbytes; // in use by the current level
+
+//
+// Add a chunk with room for at least size bytes after the current one
+//
+static levelchunk_t *Z_NewLevelChunk(int size)
+{
+   levelchunk_t *chunk;
+
+   size += CHUNKHEADER;
+   if(size < LEVELCHUNK)
+      size = LEVELCHUNK;
+
+   if(!(chunk = malloc(size)))
+      return NULL;
+
+   chunk->size = size;
+   chunk->used = CHUNKHEADER;
+
+   if(curchunk)
+   {
+      chunk->next    = curchunk->next;
+      curchunk->next = chunk;
+   }
+   else
+   {
+      chunk->next = firstchunk;
+      firstchunk  = chunk;
+   }
+
+   return chunk;
+}
+
+//
+// Cut a block of size bytes, including its header, from the arena. Returns
+// NULL if there is no memory for it.
+//
+memblock_t *Z_LevelAlloc(int size, int tag, void **user)
+{
+   levelchunk_t *chunk;
+   memblock_t   *block;
+
+   // use the first chunk from the current one on with room
+   for(chunk = curchunk ? curchunk : firstchunk; chunk; chunk = chunk->next)
+   {
+      if(chunk->size - chunk->used >= size)
+         break;
+   }
+
+   if(!chunk && !(chunk = Z_NewLevelChunk(size)))
+      return NULL;
+
+   curchunk = chunk;
+
+   block = (memblock_t *)((byte *)chunk + chunk->used);
+   chunk->used += size;
+   levelbytes  += size;
+
+   block->size = size;
+   block->tag  = tag;
+   block->id   = LEVELID;
+   block->lockframe = -1;
+
+   if(user)
+   {
+      block->user = user;
+      *user = (byte *)block + sizeof(memblock_t);
+
+      block->next = ownedblocks.next;
+      block->prev = &ownedblocks;
+      ownedblocks.next->prev = block;
+      ownedblocks.next = block;
+   }
+   else
+   {
+      // CALICO_FIXME: non-portable idiom...
+      block->user = (void **)2; // mark as in use, but unowned
+      block->next = block->prev = NULL;
+   }
+
+   return block;
+}
+
+//
+// Free a block from the arena. Its memory is not used again until the arena
+// is reset.
+//
+void Z_LevelFree(memblock_t *block)
+{
+   if(block->next)
+   {
+      *block->user = NULL; // clear the user's mark
+      block->next->prev = block->prev;
+      block->prev->next = block->next;
+   }
+
+   block->user = NULL;
+   block->tag  = 0;
+   block->id   = 0;
+}
+
+//
+// Call func for every block in the arena which has not been freed
+//
+static void Z_ForLevelBlocks(void (*func)(memblock_t *))
+{
+   levelchunk_t *chunk;
+   int           offset;
+
+   for(chunk = firstchunk; chunk; chunk = chunk->next)
+   {
+      for(offset = CHUNKHEADER; offset < chunk->used; )
+      {
+         memblock_t *block = (memblock_t *)((byte *)chunk + offset);
+
+         offset += block->size;
+         if(block->id == LEVELID)
+            func(block);
+      }
+      if(chunk == curchunk)
+         break;
+   }
+}
+
+static void Z_TraceLevelFree(memblock_t *block)
+{
+   Z_TraceFree((byte *)block + sizeof(memblock_t), __FILE__, __LINE__);
+}
+
+//
+// Throw out everything in the arena
+//
+void Z_ResetLevelArena(void)
+{
+   levelchunk_t *chunk;
+   memblock_t   *block;
+
+   if(zonetracing)
+      Z_ForLevelBlocks(Z_TraceLevelFree);
+
+   for(block = ownedblocks.next; block != &ownedblocks; block = block->next)
+      *block->user = NULL; // clear the user's mark
+   ownedblocks.next = ownedblocks.prev = &ownedblocks;
+
+   for(chunk = firstchunk; chunk; chunk = chunk->next)
+   {
+      chunk->used = CHUNKHEADER;
+      if(chunk == curchunk)
+         break;
+   }
+
+   curchunk   = NULL;
+   levelbytes = 0;
+}
+
+//
+// Get how many bytes the current level is using, and how big the arena is
+//
+void Z_GetLevelArenaStats(int *used, int *size)
+{
+   levelchunk_t *chunk;
+
+   *used = levelbytes;
+   *size = 0;
+   for(chunk = firstchunk; chunk; chunk = chunk->next)
+      *size += chunk->size;
+}
+
+// EOF
+
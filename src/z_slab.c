@@ -0,0 +1,121 @@
+/*
+  CALICO
+
+  Fixed-size object pools
+
+  Mobjs and special thinkers are allocated often and all of one size, so
+  rather than go through the zone's first-fit rover one at a time, each type
+  has a slab which takes SLABCHUNK objects from the zone at once and keeps
+  the ones given back on a free list. The chunks are ordinary level blocks,
+  so Z_FreeTags releases them along with the rest of the level, and every
+  slab then starts over with an empty free list.
+*/
+
+#include "doomdef.h"
+
+#define SLABCHUNK 64
+
+// each object is preceded by the slab it belongs to
+typedef struct slabobj_s
+{
+   slab_t           *slab;
+   struct slabobj_s *next; // on the free list
+} slabobj_t;
+
+// bumped each time the level blocks are freed
+static int slabgeneration = 1;
+
+#define Z_SlabObjSize(slab) ((sizeof(slabobj_t) + (slab)->size + 7) & ~7)
+
+//
+// Forget every slab's chunks, which Z_FreeTags has just freed
+//
+void Z_ResetSlabs(void)
+{
+   ++slabgeneration;
+}
+
+//
+// Start a slab over if the level blocks have been freed since it was used
+//
+static void Z_CheckSlabGeneration(slab_t *slab)
+{
+   if(slab->generation != slabgeneration)
+   {
+      slab->generation = slabgeneration;
+      slab->freelist   = NULL;
+      slab->capacity   = 0;
+      slab->count      = 0;
+   }
+}
+
+//
+// Take a new chunk of count objects from the zone
+//
+static void Z_GrowSlab(slab_t *slab, int count)
+{
+   int   objsize = Z_SlabObjSize(slab);
+   byte *chunk   = Z_Malloc(count * objsize, slab->tag, NULL);
+   int   i;
+
+   // the free list is in address order, so objects are handed out that way
+   for(i = count - 1; i >= 0; i--)
+   {
+      slabobj_t *obj = (slabobj_t *)(chunk + i * objsize);
+
+      obj->slab = slab;
+      obj->next = slab->freelist;
+      slab->freelist = obj;
+   }
+
+   slab->capacity += count;
+}
+
+//
+// Make sure the next count allocations come from one chunk, such as the
+// things spawned when a level is loaded
+//
+void Z_SlabReserve(slab_t *slab, int count)
+{
+   Z_CheckSlabGeneration(slab);
+
+   if(count > SLABCHUNK && !slab->freelist)
+      Z_GrowSlab(slab, count);
+}
+
+//
+// Allocate one object. Its contents are undefined.
+//
+void *Z_SlabAlloc(slab_t *slab)
+{
+   slabobj_t *obj;
+
+   Z_CheckSlabGeneration(slab);
+
+   if(!slab->freelist)
+      Z_GrowSlab(slab, SLABCHUNK);
+
+   obj = slab->freelist;
+   slab->freelist = obj->next;
+
+   if(++slab->count > slab->highwater)
+      slab->highwater = slab->count;
+
+   return obj + 1;
+}
+
+//
+// Give an object back to its slab
+//
+void Z_SlabFree(void *ptr)
+{
+   slabobj_t *obj  = (slabobj_t *)ptr - 1;
+   slab_t    *slab = obj->slab;
+
+   obj->next = slab->freelist;
+   slab->freelist = obj;
+   --slab->count;
+}
+
+// EOF
+
@@ -1,6 +1,10 @@
 /* Z_zone.c */
 
+#include <stdlib.h>
 #include "doomdef.h"
+#include "m_alloc.h"
+#include "m_argv.h"
+#include "m_trace.h"
 
 /* 
 ============================================================================== 
@@ -10,7 +14,19 @@ ZONE MEMORY ALLOCATION
 There is never any space between memblocks, and there will never be two
 contiguous free memblocks.
 
-The rover can be left pointing at a non-empty block
+CALICO: rather than scanning the block list from a rover, free blocks are
+kept on lists by size. Blocks under 256 bytes have a list for each size, and
+larger ones a list for each power of 2. Blocks are merged with their free
+neighbours as soon as they are freed, so both allocating and freeing take
+about the same time however fragmented the zone becomes. Purgable blocks are
+only thrown out when no free block is big enough.
+
+CALICO: PU_LEVEL and PU_LEVSPEC blocks are not kept here at all, but in
+the level arena in z_level.c, which is thrown out all at once.
+
+CALICO: with -zonegrow or zone_grow set in the config file, another arena is
+chained on after the zone instead of failing when it runs out of room. Each
+arena is a zone of its own, and blocks never span more than one.
 
 It is of no value to free a cachable block, because it will get overwritten
 automatically if needed
@@ -19,8 +35,59 @@ automatically if needed
 */ 
  
 memzone_t *mainzone;
-memzone_t *refzone;
- 
+
+static boolean zonegrow; // CALICO: add arenas rather than fail
+
+// a free block's links to the others of its size are kept in its data
+typedef struct
+{
+   memblock_t *next, *prev;
+} zonelinks_t;
+
+#define Z_Links(block) ((zonelinks_t *)((byte *)(block) + sizeof(memblock_t)))
+
+// a block must be able to hold its links once it is freed
+#define MINBLOCKSIZE ((int)(sizeof(memblock_t) + sizeof(zonelinks_t) + 7) & ~7)
+
+//
+// CALICO: Get the free list for blocks of a size
+//
+static int Z_ListForSize(int size)
+{
+   int list;
+
+   if(size < NUMZONESMALL * 8)
+      return size >> 3;
+
+   for(list = NUMZONESMALL, size >>= 9; size; size >>= 1)
+      ++list;
+
+   return list;
+}
+
+static void Z_LinkFree(memzone_t *mainzone, memblock_t *block)
+{
+   memblock_t **head = &mainzone->freelists[Z_ListForSize(block->size)];
+
+   Z_Links(block)->prev = NULL;
+   Z_Links(block)->next = *head;
+   if(*head)
+      Z_Links(*head)->prev = block;
+   *head = block;
+}
+
+static void Z_UnlinkFree(memzone_t *mainzone, memblock_t *block)
+{
+   zonelinks_t *links = Z_Links(block);
+
+   if(links->prev)
+      Z_Links(links->prev)->next = links->next;
+   else
+      mainzone->freelists[Z_ListForSize(block->size)] = links->next;
+   if(links->next)
+      Z_Links(links->next)->prev = links->prev;
+}
+
 /*
 ========================
 =
@@ -34,16 +101,17 @@ memzone_t *Z_InitZone(byte *base, int size)
    memzone_t *zone;
 
    zone = (memzone_t *)base;
+   D_memset(zone, 0, sizeof(*zone));
 
-   zone->size = size;
-   zone->rover = &zone->blocklist;
-   zone->blocklist.size = size - 8;
+   zone->blocklist.size = (size - (int)((byte *)&zone->blocklist - base)) & ~7;
    zone->blocklist.user = NULL;
    zone->blocklist.tag = 0;
    zone->blocklist.id = ZONEID;
    zone->blocklist.next = NULL;
    zone->blocklist.prev = NULL;
    zone->blocklist.lockframe = -1;
+   zone->size = (int)((byte *)&zone->blocklist - base) + zone->blocklist.size;
+   Z_LinkFree(zone, &zone->blocklist);
 
    return zone;
 }
@@ -63,25 +131,81 @@ void Z_Init(void)
 
    mem = I_ZoneBase(&size);
 
-   mainzone = Z_InitZone(mem, 0x80000);
-   refzone  = Z_InitZone(mem + 0x80000, size - 0x80000);
+   // CALICO: the refzone is gone; decoded graphics are kept in r_cache.c
+   mainzone = Z_InitZone(mem, size);
+   zonegrow = M_FindArgument("-zonegrow") || Z_ConfigZoneGrow();
+   Z_InitTrace();
 }
 
 /*
 ========================
 =
-= Z_Free2
+= Z_AddArena
+=
+= CALICO: Chain another arena onto a zone, big enough for a block of at 
+= least size bytes
 =
 ========================
 */
 
-void Z_Free2(memzone_t *mainzone, void *ptr)
+static memzone_t *Z_AddArena(memzone_t *mainzone, int size)
 {
-   memblock_t *block;
+   memzone_t *zone, *arena;
+   byte      *base;
 
-   block = (memblock_t *)((byte *)ptr - sizeof(memblock_t));
-   if(block->id != ZONEID)
-      I_Error("Z_Free: freed a pointer without ZONEID");
+   size += sizeof(memzone_t);
+   if(size < mainzone->size)
+      size = mainzone->size;
+
+   if(!(base = malloc(size)))
+      return NULL;
+
+   for(zone = mainzone; zone->next; zone = zone->next)
+      ;
+   zone->next = arena = Z_InitZone(base, size);
+
+   D_printf("Z_AddArena: %i KB\n", size / 1024);
+   return arena;
+}
+
+/*
+========================
+=
+= Z_ZoneForBlock
+=
+= CALICO: Find the zone or arena a block is in
+=
+========================
+*/
+
+static memzone_t *Z_ZoneForBlock(memzone_t *mainzone, memblock_t *block)
+{
+   memzone_t *zone;
+
+   // CALICO_TODO: non-portable pointer comparison
+   for(zone = mainzone; zone->next; zone = zone->next)
+   {
+      if((byte *)block > (byte *)zone && (byte *)block < (byte *)zone + zone->size)
+         break;
+   }
+
+   return zone;
+}
+
+/*
+========================
+=
+= Z_FreeBlock
+=
+= CALICO: Free a block and merge it with its free neighbours. Returns the
+= block it ends up part of.
+=
+========================
+*/
+
+static memblock_t *Z_FreeBlock(memzone_t *mainzone, memblock_t *block)
+{
+   memblock_t *other;
 
    // CALICO_TODO: non-portable pointer comparison
    if(block->user > (void **)0x100) // smaller values are not pointers
@@ -89,72 +213,187 @@ void Z_Free2(memzone_t *mainzone, void *ptr)
    block->user = NULL; // mark as free
    block->tag = 0;
    block->id = 0;
+
+   if((other = block->next) && !other->user)
+   {
+      // merge the next block into this one
+      Z_UnlinkFree(mainzone, other);
+      block->size += other->size;
+      block->next = other->next;
+      if(block->next)
+         block->next->prev = block;
+   }
+
+   if((other = block->prev) && !other->user)
+   {
+      // merge this block into the previous one
+      Z_UnlinkFree(mainzone, other);
+      other->size += block->size;
+      other->next = block->next;
+      if(other->next)
+         other->next->prev = other;
+      block = other;
+   }
+
+   Z_LinkFree(mainzone, block);
+   return block;
 }
- 
+
 /*
 ========================
 =
-= Z_Malloc2
+= Z_Free2
 =
-= You can pass a NULL user if the tag is < PU_PURGELEVEL
 ========================
 */
 
-#define MINFRAGMENT 64
-
-void *Z_Malloc2(memzone_t *mainzone, int size, int tag, void *user)
+void Z_Free2(memzone_t *mainzone, void *ptr, const char *file, int line)
 {
-   int         extra;
-   memblock_t *start, *rover, *newblock, *base;
+   memblock_t  *block;
+   unsigned int start = M_AllocBegin(); // CALICO
 
-   //
-   // scan through the block list looking for the first free block
-   // of sufficient size, throwing out any purgable blocks along the way
-   //
-   size += sizeof(memblock_t); // account for size of block header
-   size = (size + 7) & ~7;     // phrase align everything
+   block = (memblock_t *)((byte *)ptr - sizeof(memblock_t));
+   if(block->id != ZONEID && block->id != LEVELID)
+   {
+      Z_FlushTrace(); // CALICO
+      I_Error("Z_Free: freed a pointer without ZONEID at %s:%i", file, line);
+   }
 
-   start = base = mainzone->rover;
+   if(zonetracing)
+      Z_TraceFree(ptr, file, line); // CALICO
 
-   while(base->user || base->size < size)
-   {
-      if(base->user)
-         rover = base;
-      else
-         rover = base->next;
+   if(block->id == LEVELID)
+      Z_LevelFree(block); // CALICO
+   else
+      Z_FreeBlock(Z_ZoneForBlock(mainzone, block), block);
 
-      if(!rover)
-         goto backtostart;
+   M_FreeEnd(ALLOC_ZONE, start); // CALICO
+}
 
-      if(rover->user)
+/*
+========================
+=
+= Z_FindFree
+=
+= CALICO: Find a free block of at least size bytes and take it off its list, 
+= or return NULL if there is none.
+=
+========================
+*/
+
+static memblock_t *Z_FindFree(memzone_t *mainzone, int size)
+{
+   int         list = Z_ListForSize(size);
+   int         i;
+   memblock_t *block;
+
+   // every block on a small list, or any larger list, is big enough
+   i = (list < NUMZONESMALL) ? list : list + 1;
+   for(; i < NUMZONELISTS; i++)
+   {
+      if((block = mainzone->freelists[i]))
+      {
+         Z_UnlinkFree(mainzone, block);
+         return block;
+      }
+   }
+
+   // a list for a range of sizes may still have one which fits
+   if(list >= NUMZONESMALL)
+   {
+      for(block = mainzone->freelists[list]; block; block = Z_Links(block)->next)
       {
-         // hit an in use block, so move base past it
-         base = rover->next;
-         if(!base)
+         if(block->size >= size)
          {
-backtostart:
-            base = &mainzone->blocklist;
+            Z_UnlinkFree(mainzone, block);
+            return block;
          }
+      }
+   }
+
+   return NULL;
+}
+
+/*
+========================
+=
+= Z_PurgeFor
+=
+= CALICO: Throw out purgable blocks until a free block of at least size 
+= bytes is made, and take it off its list. Returns NULL if there is no room
+= even then.
+=
+========================
+*/
+
+static memblock_t *Z_PurgeFor(memzone_t *mainzone, int size)
+{
+   memblock_t *block, *next;
 
-         if(base == start)	// scaned all the way around the list
-            I_Error("Z_Malloc: failed on %i", size);
+   for(block = &mainzone->blocklist; block; block = next)
+   {
+      next = block->next;
+      if(!block->user || block->tag < PU_PURGELEVEL || block->lockframe == framecount)
          continue;
-      }
 
-      //
-      // free the rover block (adding the size to base)
-      //
-      rover->id = 0;
-      rover->user = NULL; // mark as free
-
-      if(base != rover)
-      { 
-         // merge with base
-         base->size += rover->size;
-         base->next = rover->next;
-         if(rover->next)
-            rover->next->prev = base;
+      if(zonetracing)
+         Z_TraceFree((byte *)block + sizeof(memblock_t), __FILE__, __LINE__); // CALICO
+      block = Z_FreeBlock(mainzone, block);
+      if(block->size >= size)
+      {
+         Z_UnlinkFree(mainzone, block);
+         return block;
       }
+      next = block->next;
+   }
+
+   return NULL;
+}
+ 
+/*
+========================
+=
+= Z_Malloc2
+=
+= You can pass a NULL user if the tag is < PU_PURGELEVEL
+========================
+*/
+
+#define MINFRAGMENT 64
+
+static void *Z_DoMalloc(memzone_t *mainzone, int size, int tag, void *user, const char *file, int line)
+{
+   int         extra, request = size;
+   memzone_t  *zone;
+   memblock_t *newblock, *base = NULL;
+
+   size += sizeof(memblock_t); // account for size of block header
+   size = (size + 7) & ~7;     // phrase align everything
+   if(size < MINBLOCKSIZE)
+      size = MINBLOCKSIZE;
+
+   // CALICO: level data goes in the level arena when there's memory for it
+   if((tag == PU_LEVEL || tag == PU_LEVSPEC) && (base = Z_LevelAlloc(size, tag, user)))
+   {
+      if(zonetracing)
+         Z_TraceMalloc((byte *)base + sizeof(memblock_t), request, tag, file, line);
+      return (void *)((byte *)base + sizeof(memblock_t));
+   }
+
+   // CALICO: look through every arena before purging any of them
+   for(zone = mainzone; zone && !base; zone = zone->next)
+      base = Z_FindFree(zone, size);
+   for(zone = mainzone; zone && !base; zone = zone->next)
+      base = Z_PurgeFor(zone, size);
+   if(!base && zonegrow && (zone = Z_AddArena(mainzone, size)))
+      base = Z_FindFree(zone, size);
+
+   if(!base)
+   {
+      // CALICO: say what the zone had room for, and where the request came from
+      Z_PrintZoneStats(mainzone);
+      Z_FlushTrace();
+      I_Error("Z_Malloc: failed on %i at %s:%i", size, file, line);
    }
 
    //
@@ -168,12 +407,14 @@ backtostart:
       newblock->size = extra;
       newblock->user = NULL; // free block
       newblock->tag = 0;
+      newblock->id = 0;
       newblock->prev = base;
       newblock->next = base->next;
       if(newblock->next)
          newblock->next->prev = newblock;
       base->next = newblock;
       base->size = size;
+      Z_LinkFree(Z_ZoneForBlock(mainzone, base), newblock);
    }
 
    if(user)
@@ -192,13 +433,25 @@ backtostart:
    base->id = ZONEID;
    base->lockframe = -1;
 
-   mainzone->rover = base->next; // next allocation will start looking here
-   if(!mainzone->rover)
-      mainzone->rover = &mainzone->blocklist;
+   if(zonetracing)
+      Z_TraceMalloc((byte *)base + sizeof(memblock_t), request, tag, file, line); // CALICO
 
    return (void *)((byte *)base + sizeof(memblock_t));
 }
 
+// CALICO: every allocation is counted, and is a section on the -trace
+// timeline
+void *Z_Malloc2(memzone_t *mainzone, int size, int tag, void *user, const char *file, int line)
+{
+   unsigned int start      = M_TraceBegin();
+   unsigned int allocstart = M_AllocBegin();
+   void        *ptr        = Z_DoMalloc(mainzone, size, tag, user, file, line);
+
+   M_AllocEnd(ALLOC_ZONE, size, allocstart);
+   M_TraceEnd("zmalloc", start);
+   return ptr;
+}
+
 /*
 ========================
 =
@@ -209,16 +462,27 @@ backtostart:
 
 void Z_FreeTags(memzone_t *mainzone)
 {
+   memzone_t  *zone;
    memblock_t *block, *next;
 
-   for(block = &mainzone->blocklist; block; block = next)
+   for(zone = mainzone; zone; zone = zone->next)
    {
-      next = block->next; // get link before freeing
-      if(!block->user)
-         continue;        // free block
-      if(block->tag == PU_LEVEL || block->tag == PU_LEVSPEC)
-         Z_Free2(mainzone, (byte *)block + sizeof(memblock_t));
+      for(block = &zone->blocklist; block; block = next)
+      {
+         next = block->next; // get link before freeing
+         if(!block->user)
+            continue;        // free block
+         if(block->tag == PU_LEVEL || block->tag == PU_LEVSPEC)
+         {
+            if(zonetracing)
+               Z_TraceFree((byte *)block + sizeof(memblock_t), __FILE__, __LINE__); // CALICO
+            next = Z_FreeBlock(zone, block)->next; // CALICO: it may have merged with next
+         }
+      }
    }
+
+   Z_ResetLevelArena(); // CALICO
+   Z_ResetSlabs();      // CALICO: their chunks are gone
 }
 
 /*
@@ -233,19 +497,26 @@ memblock_t *checkblock;
 
 void Z_CheckHeap(memzone_t *mainzone)
 {
-   for(checkblock = &mainzone->blocklist; checkblock; checkblock = checkblock->next)
+   memzone_t *zone;
+
+   for(zone = mainzone; zone; zone = zone->next)
    {
-      if(!checkblock->next)
+      for(checkblock = &zone->blocklist; checkblock; checkblock = checkblock->next)
       {
-         if((byte *)checkblock + checkblock->size - (byte *)mainzone != mainzone->size)
-            I_Error("Z_CheckHeap: zone size changed\n");
-         continue;
-      }
+         if(!checkblock->next)
+         {
+            if((byte *)checkblock + checkblock->size - (byte *)zone != zone->size)
+               I_Error("Z_CheckHeap: zone size changed\n");
+            continue;
+         }
 
-      if((byte *)checkblock + checkblock->size != (byte *)checkblock->next)
-         I_Error("Z_CheckHeap: block size does not touch the next block\n");
-      if(checkblock->next->prev != checkblock)
-         I_Error("Z_CheckHeap: next block doesn't have proper back link\n");
+         if((byte *)checkblock + checkblock->size != (byte *)checkblock->next)
+            I_Error("Z_CheckHeap: block size does not touch the next block\n");
+         if(checkblock->next->prev != checkblock)
+            I_Error("Z_CheckHeap: next block doesn't have proper back link\n");
+         if(!checkblock->user && !checkblock->next->user)
+            I_Error("Z_CheckHeap: two free blocks are contiguous\n");
+      }
    }
 }
 
@@ -262,7 +533,9 @@ void Z_ChangeTag(void *ptr, int tag)
    memblock_t *block;
 
    block = (memblock_t *)((byte *)ptr - sizeof(memblock_t));
-   if(block->id != ZONEID)
+   if(block->id == LEVELID && tag != PU_LEVEL && tag != PU_LEVSPEC)
+      I_Error("Z_ChangeTag: level arena blocks can't outlive the level"); // CALICO
+   if(block->id != ZONEID && block->id != LEVELID)
       I_Error("Z_ChangeTag: freed a pointer without ZONEID");
    if(tag >= PU_PURGELEVEL && (int)block->user < 0x100) // CALICO_FIXME: non-portable comparison
       I_Error("Z_ChangeTag: an owner is required for purgable blocks");
@@ -279,17 +552,42 @@ void Z_ChangeTag(void *ptr, int tag)
 
 int Z_FreeMemory(memzone_t *mainzone)
 {
+   memzone_t  *zone;
    memblock_t *block;
    int         free;
 
    free = 0;
-   for(block = &mainzone->blocklist; block; block = block->next)
+   for(zone = mainzone; zone; zone = zone->next)
    {
-      if(!block->user)
-         free += block->size;
+      for(block = &zone->blocklist; block; block = block->next)
+      {
+         if(!block->user)
+            free += block->size;
+      }
    }
    return free;
 }
 
+/*
+========================
+=
+= Z_TotalMemory
+=
+= CALICO: size of a zone and any arenas added to it
+=
+========================
+*/
+
+int Z_TotalMemory(memzone_t *mainzone)
+{
+   memzone_t *zone;
+   int        total;
+
+   total = 0;
+   for(zone = mainzone; zone; zone = zone->next)
+      total += zone->size;
+   return total;
+}
+
 // EOF
 